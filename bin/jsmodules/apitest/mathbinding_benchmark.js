@@ -0,0 +1,127 @@
+// Micro-benchmark comparing the generated math bindings (float3, Quat, Transform) with the nativemath types.
+// Run in an EC_Script or with --run after a scene has been loaded, e.g.
+//     ./viewer --file scenes/Avatar/scene.txml --run jsmodules/apitest/mathbinding_benchmark.js
+// Each test runs the same computation with both bindings and prints the time per iteration.
+
+var iterations = 20000;
+var numEntities = 500;
+
+function Measure(name, func)
+{
+    var start = new Date().getTime();
+    var result = func();
+    var elapsed = new Date().getTime() - start;
+    print(name + ": " + elapsed + " ms, " + (elapsed * 1000.0 / iterations).toFixed(3) + " us/iteration (result " + result + ")");
+    return elapsed;
+}
+
+function Compare(name, generated, native)
+{
+    var tGenerated = Measure(name + " [generated]", generated);
+    var tNative = Measure(name + " [nativemath]", native);
+    if (tNative > 0)
+        print(name + ": nativemath is " + (tGenerated / tNative).toFixed(2) + "x faster.");
+}
+
+// Steering: accelerate towards a target, clamp the speed and integrate the position.
+Compare("Steering",
+    function()
+    {
+        var pos = new float3(0, 0, 0);
+        var vel = new float3(0, 0, 0);
+        var target = new float3(100, 0, 50);
+        for(var i = 0; i < iterations; ++i)
+        {
+            var dir = target.Sub(pos);
+            if (dir.LengthSq() > 0.0001)
+                dir = dir.Normalized();
+            vel = vel.Add(dir.Mul(0.1));
+            if (vel.Length() > 2)
+                vel = vel.ScaledToLength(2);
+            pos = pos.Add(vel.Mul(0.016));
+        }
+        return pos.Length().toFixed(3);
+    },
+    function()
+    {
+        var pos = new nativemath.float3(0, 0, 0);
+        var vel = new nativemath.float3(0, 0, 0);
+        var target = new nativemath.float3(100, 0, 50);
+        var dir = new nativemath.float3();
+        for(var i = 0; i < iterations; ++i)
+        {
+            vel.AddScaled(dir.Set(target).Sub(pos).Normalize(), 0.1);
+            if (vel.Length() > 2)
+                vel.ScaleToLength(2);
+            pos.AddScaled(vel, 0.016);
+        }
+        return pos.Length().toFixed(3);
+    });
+
+// Camera rig: orbit a point by rotating an offset vector with a quaternion.
+Compare("Camera orbit",
+    function()
+    {
+        var offset = new float3(0, 2, 10);
+        var step = Quat.RotateAxisAngle(new float3(0, 1, 0), 0.01);
+        var center = new float3(5, 0, 5);
+        var eye;
+        for(var i = 0; i < iterations; ++i)
+        {
+            offset = step.Mul(offset);
+            eye = center.Add(offset);
+        }
+        return eye.Length().toFixed(3);
+    },
+    function()
+    {
+        var offset = new nativemath.float3(0, 2, 10);
+        var step = new nativemath.Quat().SetFromAxisAngle(new nativemath.float3(0, 1, 0), 0.01);
+        var center = new nativemath.float3(5, 0, 5);
+        var eye = new nativemath.float3();
+        for(var i = 0; i < iterations; ++i)
+        {
+            step.Transform(offset);
+            eye.Set(center).Add(offset);
+        }
+        return eye.Length().toFixed(3);
+    });
+
+// Transform updates of many entities per frame, one at a time versus packed arrays.
+var ents = [];
+var scn = framework.Scene().MainCameraScene();
+if (scn)
+{
+    for(var i = 0; i < numEntities; ++i)
+        ents.push(scn.CreateLocalEntity(["EC_Placeable"]));
+
+    var frames = Math.max(1, Math.floor(iterations / numEntities));
+    Compare("Entity positions (" + numEntities + " entities)",
+        function()
+        {
+            for(var f = 0; f < frames; ++f)
+                for(var i = 0; i < ents.length; ++i)
+                {
+                    var t = ents[i].placeable.transform;
+                    t.pos.y += 0.01;
+                    ents[i].placeable.transform = t;
+                }
+            return ents[0].placeable.transform.pos.y.toFixed(3);
+        },
+        function()
+        {
+            for(var f = 0; f < frames; ++f)
+            {
+                var positions = nativemath.GetPositions(ents);
+                for(var i = 1; i < positions.length; i += 3)
+                    positions[i] += 0.01;
+                nativemath.SetPositions(ents, positions);
+            }
+            return ents[0].placeable.transform.pos.y.toFixed(3);
+        });
+
+    for(var i = 0; i < ents.length; ++i)
+        scn.RemoveEntity(ents[i].id);
+}
+else
+    print("No scene loaded, skipping the entity transform benchmark.");
@@ -111,6 +111,10 @@ function ServerHandleUserConnected(connectionID, user) {
     transform.pos.z = (Math.random() - 0.5) * avatar_area_size + avatar_area_z;
     placeable.transform = transform;
 
+    // The controlled entity is the one the client predicts, when started with --clientPrediction.
+    if (user != null)
+        user.SetControlledEntity(avatarEntity);
+
     if (user != null)
         print("[Avatar Application] Created avatar for " + user.GetProperty("username"));
 }
@@ -45,6 +45,10 @@ function SimpleAvatar(entity, comp)
     this.crosshair = null;
     this.isMouseLookLockedOnX = true;
 
+    // With client-side prediction (--clientPrediction) the own avatar is moved locally,
+    // and the server gets the movement from the client's input commands
+    this.actionExecType = 2; // Execute movement actions on server
+
     // Animation detection
     this.standAnimName = "Stand";
     this.walkAnimName = "Walk";
@@ -250,6 +254,13 @@ SimpleAvatar.prototype.ClientInitialize = function() {
     // on an entity, and we could theoretically control anyone's avatar
     if (this.me.name == "Avatar" + client.connectionId) {
         this.ownAvatar = true;
+        if (framework.HasCommandLineParameter("--clientPrediction")) {
+            this.actionExecType = 1; // Execute movement actions locally
+            this.attrs = this.me.dynamiccomponent;
+            this.me.Action("Move").Triggered.connect(this, this.ServerHandleMove);
+            this.me.Action("Stop").Triggered.connect(this, this.ServerHandleStop);
+            this.me.Action("SetRotation").Triggered.connect(this, this.ServerHandleSetRotation);
+        }
         this.ClientCreateInputMapper();
         this.ClientCreateAvatarCamera();
         this.crosshair = new Crosshair(/*bool useLabelInsteadOfCursor*/ true);
@@ -336,7 +347,7 @@ SimpleAvatar.prototype.ClientCreateInputMapper = function() {
     inputmapper.takeKeyboardEventsOverQt = false;
     inputmapper.modifiersEnabled = false;
     inputmapper.keyrepeatTrigger = false; // Disable repeat keyevent sending over network, not needed and will flood network
-    inputmapper.executionType = 2; // Execute actions on server
+    inputmapper.executionType = this.actionExecType; // Execute actions on server, or locally with client-side prediction
 
     // Key pressed -actions
     inputmapper.RegisterMapping("W", "Move(forward)", 1); // 1 = keypress
@@ -407,7 +418,7 @@ SimpleAvatar.prototype.GestureStarted = function(gestureEvent) {
         if (attrs.GetAttribute("enableRotate")) {
             var x = new Number(gestureEvent.Gesture().offset.toPoint().x());
             this.yaw += x;
-            this.me.Exec(2, "SetRotation", this.yaw.toString());
+            this.me.Exec(this.actionExecType, "SetRotation", this.yaw.toString());
         }
 
         gestureEvent.Accept();
@@ -425,7 +436,7 @@ SimpleAvatar.prototype.GestureUpdated = function(gestureEvent) {
         // Rotate avatar with X pan gesture
         delta = gestureEvent.Gesture().delta.toPoint();
         this.yaw += delta.x;
-        this.me.Exec(2, "SetRotation", this.yaw.toString());
+        this.me.Exec(this.actionExecType, "SetRotation", this.yaw.toString());
 
         // Start walking or stop if total Y len of pan gesture is 100
         var walking = false;
@@ -435,19 +446,19 @@ SimpleAvatar.prototype.GestureUpdated = function(gestureEvent) {
         if (totalOffset.y() < -100)
         {
             if (walking) {
-                this.me.Exec(2, "Stop", "forward");
-                this.me.Exec(2, "Stop", "back");
+                this.me.Exec(this.actionExecType, "Stop", "forward");
+                this.me.Exec(this.actionExecType, "Stop", "back");
             } else
-                this.me.Exec(2, "Move", "forward");
+                this.me.Exec(this.actionExecType, "Move", "forward");
             listenGesture = false;
         }
         else if (totalOffset.y() > 100)
         {
             if (walking) {
-                this.me.Exec(2, "Stop", "forward");
-                this.me.Exec(2, "Stop", "back");
+                this.me.Exec(this.actionExecType, "Stop", "forward");
+                this.me.Exec(this.actionExecType, "Stop", "back");
             } else
-                this.me.Exec(2, "Move", "back");
+                this.me.Exec(this.actionExecType, "Move", "back");
             this.listenGesture = false;
         }
         gestureEvent.Accept();
@@ -532,7 +543,7 @@ SimpleAvatar.prototype.ClientUpdateRotation = function(frametime) {
 
     if (this.rotate != 0) {
         this.yaw -= this.rotateSpeed * this.rotate * frametime;
-        this.me.Exec(2, "SetRotation", this.yaw.toString());
+        this.me.Exec(this.actionExecType, "SetRotation", this.yaw.toString());
     }
 }
 
@@ -647,7 +658,7 @@ SimpleAvatar.prototype.ClientHandleMouseMove = function(mouseevent) {
     {
         // Rotate avatar or camera
         this.yaw -= this.mouseRotateSensitivity * parseInt(mouseevent.relativeX);
-        this.me.Exec(2, "SetRotation", this.yaw.toString());
+        this.me.Exec(this.actionExecType, "SetRotation", this.yaw.toString());
     }
 
     if (mouseevent.relativeY != 0 && (firstPerson || !this.isMouseLookLockedOnX))
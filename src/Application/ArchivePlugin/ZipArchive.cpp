@@ -0,0 +1,284 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "ZipArchive.h"
+#include "ZipWorker.h"
+#include "ZipHelpers.h"
+#include "LoggingFunctions.h"
+#include "Profiler.h"
+
+#include "zzip/zzip.h"
+#include "zzip/mmapped.h"
+#include "zzip/format.h"
+
+#include <QDir>
+#include <QThreadPool>
+
+#include <cstdlib>
+
+ZipArchive::ZipArchive(const QString &diskSource_, bool memoryMapped_) :
+    diskSource(diskSource_),
+    memoryMapped(memoryMapped_),
+    disk(0),
+    closed(true)
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+    Close();
+}
+
+bool ZipArchive::Open()
+{
+    Close();
+
+    PROFILE(ZipArchive_Open);
+
+    files.clear();
+    fileIndex.clear();
+    diskEntries.clear();
+
+    const QByteArray nativePath = QDir::toNativeSeparators(diskSource).toLocal8Bit();
+    if (memoryMapped)
+    {
+        disk = zzip_disk_open(const_cast<char *>(nativePath.constData()));
+        if (!disk)
+        {
+            LogError("ZipArchive: Failed to memory map " + diskSource);
+            return false;
+        }
+
+        for(ZZIP_DISK_ENTRY *entry = zzip_disk_findfirst(disk); entry; entry = zzip_disk_findnext(disk, entry))
+        {
+            char *name = zzip_disk_entry_strdup_name(disk, entry);
+            if (!name)
+                continue;
+            ZipArchiveFile file;
+            file.relativePath = QDir::fromNativeSeparators(name);
+            free(name);
+            if (file.relativePath.endsWith("/"))
+                continue;
+            file.compressedSize = zzip_disk_entry_csize(entry);
+            file.uncompressedSize = zzip_disk_entry_usize(entry);
+            fileIndex[file.relativePath.toLower()] = files.size();
+            files << file;
+            diskEntries.push_back(entry);
+        }
+    }
+    else
+    {
+        zzip_error_t error = ZZIP_NO_ERROR;
+        zzip_dir *archive = zzip_dir_open(nativePath.constData(), &error);
+        if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive) || !archive)
+        {
+            if (archive)
+                zzip_dir_close(archive);
+            return false;
+        }
+
+        ZZIP_DIRENT archiveEntry;
+        while(zzip_dir_read(archive, &archiveEntry))
+        {
+            ZipArchiveFile file;
+            file.relativePath = QDir::fromNativeSeparators(archiveEntry.d_name);
+            if (file.relativePath.endsWith("/"))
+                continue;
+            file.compressedSize = archiveEntry.d_csize;
+            file.uncompressedSize = archiveEntry.st_size;
+            fileIndex[file.relativePath.toLower()] = files.size();
+            files << file;
+        }
+
+        // Keep the handle open for decompressing the files.
+        ReleaseHandle(archive);
+    }
+
+    QMutexLocker lock(&slotMutex);
+    fileSlots.clear();
+    fileSlots.resize(files.size());
+    closed = false;
+    return true;
+}
+
+void ZipArchive::Close()
+{
+    {
+        // Cancel the queued files, and wait for the files being decompressed, as they use the handles and the mapping.
+        QMutexLocker lock(&slotMutex);
+        closed = true;
+        for(;;)
+        {
+            bool decompressing = false;
+            for(size_t i = 0; i < fileSlots.size(); ++i)
+                if (fileSlots[i].state == Decompressing)
+                    decompressing = true;
+            if (!decompressing)
+                break;
+            slotDone.wait(&slotMutex);
+        }
+        fileSlots.clear();
+    }
+
+    {
+        QMutexLocker lock(&handleMutex);
+        foreach(zzip_dir *handle, handles)
+            zzip_dir_close(handle);
+        handles.clear();
+    }
+
+    if (disk)
+    {
+        zzip_disk_close(disk);
+        disk = 0;
+    }
+    diskEntries.clear();
+}
+
+int ZipArchive::IndexOf(const QString &relativePath) const
+{
+    return fileIndex.value(QDir::fromNativeSeparators(relativePath).toLower(), -1);
+}
+
+void ZipArchive::Prefetch(const QList<int> &indices)
+{
+    QMutexLocker lock(&slotMutex);
+    if (closed)
+        return;
+
+    foreach(int i, indices)
+    {
+        if (i < 0 || i >= (int)fileSlots.size() || fileSlots[i].state != NotLoaded)
+            continue;
+        fileSlots[i].state = Queued;
+        // The pool runs the workers of the same priority in the order they were started.
+        QThreadPool::globalInstance()->start(new ZipWorker(shared_from_this(), i));
+    }
+}
+
+std::vector<u8> ZipArchive::TakeData(int index)
+{
+    std::vector<u8> data;
+    QMutexLocker lock(&slotMutex);
+    if (closed || index < 0 || index >= (int)fileSlots.size())
+        return data;
+
+    while(fileSlots[index].state == Decompressing)
+        slotDone.wait(&slotMutex);
+    if (closed)
+        return data;
+
+    Slot &slot = fileSlots[index];
+    if (slot.state == Ready)
+    {
+        data.swap(slot.data);
+        slot.state = NotLoaded;
+        return data;
+    }
+
+    // Not decompressed, or still waiting in the queue: decompress it here. The queued worker will skip it.
+    slot.state = Decompressing;
+    lock.unlock();
+    if (!Decompress(index, data))
+        data.clear();
+    lock.relock();
+    fileSlots[index].state = NotLoaded;
+    slotDone.wakeAll();
+    return data;
+}
+
+void ZipArchive::RunQueued(int index)
+{
+    {
+        QMutexLocker lock(&slotMutex);
+        if (closed || index >= (int)fileSlots.size() || fileSlots[index].state != Queued)
+            return;
+        fileSlots[index].state = Decompressing;
+    }
+
+    std::vector<u8> data;
+    if (!Decompress(index, data))
+        data.clear();
+
+    QMutexLocker lock(&slotMutex);
+    // A failed file is left ready with no data, so that TakeData() does not try it again.
+    fileSlots[index].data.swap(data);
+    fileSlots[index].state = Ready;
+    slotDone.wakeAll();
+}
+
+bool ZipArchive::Decompress(int index, std::vector<u8> &data)
+{
+    PROFILE(ZipArchive_Decompress);
+
+    const ZipArchiveFile &file = files[index];
+    data.resize(file.uncompressedSize);
+    if (data.empty())
+        return true;
+
+    if (memoryMapped)
+    {
+        ZZIP_DISK_FILE *diskFile = zzip_disk_entry_fopen(disk, diskEntries[index]);
+        if (!diskFile)
+        {
+            LogError("ZipArchive: Failed to open " + file.relativePath + " in " + diskSource);
+            return false;
+        }
+        const zzip_size_t numRead = zzip_disk_fread(&data[0], 1, data.size(), diskFile);
+        zzip_disk_fclose(diskFile);
+        if (numRead != data.size())
+        {
+            LogError("ZipArchive: Failed to decompress " + file.relativePath + " in " + diskSource);
+            return false;
+        }
+        return true;
+    }
+
+    zzip_dir *archive = AcquireHandle();
+    if (!archive)
+        return false;
+
+    bool success = false;
+    ZZIP_FILE *zzipFile = zzip_file_open(archive, file.relativePath.toStdString().c_str(), ZZIP_ONLYZIP | ZZIP_CASELESS);
+    if (zzipFile && !CheckAndLogArchiveError(archive))
+    {
+        size_t total = 0;
+        zzip_ssize_t numRead = 0;
+        while(total < data.size() && 0 < (numRead = zzip_read(zzipFile, &data[total], data.size() - total)))
+            total += numRead;
+        success = total == data.size();
+        if (!success)
+            LogError("ZipArchive: Failed to decompress " + file.relativePath + " in " + diskSource);
+    }
+    else
+        LogError("ZipArchive: Failed to open " + file.relativePath + " in " + diskSource);
+    if (zzipFile)
+        zzip_file_close(zzipFile);
+
+    ReleaseHandle(archive);
+    return success;
+}
+
+zzip_dir *ZipArchive::AcquireHandle()
+{
+    {
+        QMutexLocker lock(&handleMutex);
+        if (!handles.isEmpty())
+            return handles.takeLast();
+    }
+
+    zzip_error_t error = ZZIP_NO_ERROR;
+    zzip_dir *archive = zzip_dir_open(QDir::toNativeSeparators(diskSource).toLocal8Bit().constData(), &error);
+    if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive) || !archive)
+    {
+        if (archive)
+            zzip_dir_close(archive);
+        return 0;
+    }
+    return archive;
+}
+
+void ZipArchive::ReleaseHandle(zzip_dir *handle)
+{
+    QMutexLocker lock(&handleMutex);
+    handles << handle;
+}
@@ -0,0 +1,121 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <vector>
+
+struct zzip_dir;
+struct zzip_disk;
+struct zzip_disk_entry;
+
+/// A file in a zip archive.
+struct ZipArchiveFile
+{
+    QString relativePath;
+    uint compressedSize;
+    uint uncompressedSize;
+};
+typedef QList<ZipArchiveFile> ZipFileList;
+
+/// Random access to the files of a zip archive, decompressing them in parallel on demand.
+/** The central directory of the archive is read once into an index, and the files are decompressed straight from
+    the archive when they are requested, without extracting them to disk.
+
+    Files can be queued for decompression in the global thread pool with Prefetch(), in the order they are going
+    to be requested. TakeData() returns the data of a file: if a worker has already decompressed it, the data is
+    returned immediately, if a worker is decompressing it, the call waits for it, and otherwise the file is
+    decompressed in the calling thread, so that the requested file never waits behind the queue.
+
+    By default each thread decompresses through its own zziplib handle, taken from a pool of open handles.
+    With memory mapping, the archive is mapped into memory once and all threads read it directly. Memory mapping
+    is optional, because mapping a large archive can exhaust the address space of a 32-bit process.
+
+    The archive is shared by the workers with a shared pointer, so that it stays alive until the queued work is done. */
+class ZipArchive : public boost::enable_shared_from_this<ZipArchive>
+{
+public:
+    /// Constructor.
+    /** @param diskSource Path to the zip file.
+        @param memoryMapped Whether to read the archive through a memory mapping. */
+    ZipArchive(const QString &diskSource, bool memoryMapped);
+
+    /// Closes the archive.
+    ~ZipArchive();
+
+    /// Opens the archive and reads its central directory. Returns false if the archive could not be read.
+    bool Open();
+
+    /// Closes the archive. Cancels the queued work and frees the data not taken yet.
+    void Close();
+
+    /// Returns the files of the archive, excluding directories.
+    const ZipFileList &Files() const { return files; }
+
+    /// Returns the index of a file by its relative path, ignoring case, or -1 if the file does not exist.
+    int IndexOf(const QString &relativePath) const;
+
+    /// Queues the files for decompression in the global thread pool, in the given order.
+    /** Files that are already queued, being decompressed or decompressed are skipped. */
+    void Prefetch(const QList<int> &indices);
+
+    /// Returns the data of a file, and frees it from the archive.
+    /** Decompresses the file in the calling thread, unless a worker has already decompressed it or is decompressing it.
+        @return The data, or an empty vector if the file could not be decompressed. */
+    std::vector<u8> TakeData(int index);
+
+    /// Decompresses a queued file. Called by ZipWorker in a worker thread.
+    void RunQueued(int index);
+
+private:
+    /// Decompression state of a file.
+    enum State
+    {
+        NotLoaded,
+        Queued,
+        Decompressing,
+        Ready
+    };
+
+    struct Slot
+    {
+        Slot() : state(NotLoaded) {}
+        State state;
+        std::vector<u8> data;
+    };
+
+    /// Decompresses a file. Thread-safe.
+    bool Decompress(int index, std::vector<u8> &data);
+
+    /// Takes an open zziplib handle from the pool, or opens a new one.
+    zzip_dir *AcquireHandle();
+
+    /// Returns a handle to the pool.
+    void ReleaseHandle(zzip_dir *handle);
+
+    QString diskSource;
+    bool memoryMapped;
+    ZipFileList files;
+    QHash<QString, int> fileIndex; ///< Lower case relative paths to indices of files.
+
+    zzip_disk *disk; ///< Memory mapping of the archive, if memory mapped.
+    std::vector<zzip_disk_entry *> diskEntries; ///< Central directory entries of the files, if memory mapped.
+
+    QMutex handleMutex;
+    QList<zzip_dir *> handles; ///< Open handles not in use.
+
+    QMutex slotMutex;
+    QWaitCondition slotDone; ///< Signalled when a file has been decompressed.
+    std::vector<Slot> fileSlots;
+    bool closed; ///< Has the archive been closed, so that no more files are decompressed.
+};
+
+typedef boost::shared_ptr<ZipArchive> ZipArchivePtr;
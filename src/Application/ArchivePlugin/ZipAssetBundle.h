@@ -4,13 +4,14 @@
 
 #include "AssetAPI.h"
 #include "IAssetBundle.h"
-#include "ZipWorker.h"
+#include "ZipArchive.h"
 
 #include <boost/shared_ptr.hpp>
 
-struct zzip_dir;
-
 /// Provides zip packed asset bundle support.
+/** The sub assets are not extracted to the asset cache, but decompressed straight from the archive when they are requested.
+    The sub assets that AssetAPI is about to request are decompressed in parallel in the background, in the order they
+    are requested. With --zipMemoryMap the archive is read through a memory mapping. */
 class ZipAssetBundle : public IAssetBundle
 {
 Q_OBJECT
@@ -32,8 +33,8 @@ public:
     /// IAssetBundle override.
     /** Our current zziplib implementation requires disk source for processing.
         So we fail DeserializeFromData and try our best here to.
-        This function unpacks the archive content to asset cache to normal cache files
-        and provides the sub asset data via GetSubAssetData and GetSubAssetDiskSource. */
+        This function reads the central directory of the archive, after which the bundle is loaded
+        and provides the sub asset data via GetSubAssetData. */
     virtual bool DeserializeFromDiskSource();
 
     /// IAssetBundle override.
@@ -42,27 +43,23 @@ public:
     virtual bool DeserializeFromData(const u8 *data, size_t numBytes);
 
     /// IAssetBundle override.
+    /** Decompresses the sub asset from the archive, unless it has already been decompressed in the background. */
     virtual std::vector<u8> GetSubAssetData(const QString &subAssetName);
 
     /// IAssetBundle override.
+    /** The sub assets are not extracted to disk, so always returns an empty string. */
     virtual QString GetSubAssetDiskSource(const QString &subAssetName);
-    
-private slots:
-    /// Returns full asset reference for a sub asset.
-    QString GetFullAssetReference(const QString &subAssetName);
-    
-    /// Handler for asynch loading completion.
-    void OnAsynchLoadCompleted(bool successful);
+
+    /// IAssetBundle override.
+    /** Starts decompressing the sub assets in the background, in the given order. */
+    virtual void PrefetchSubAssets(const QStringList &subAssetNames);
     
 private:
     /// Closes zip file.
     void Close();
     
-    /// Zziplib ptr to the zip file.
-    zzip_dir *archive_;
-    
-    /// Zip sub assets.
-    ZipFileList files_;
+    /// Index of the archive, and the sub assets decompressed in the background.
+    ZipArchivePtr archive_;
 };
 
 typedef boost::shared_ptr<ZipAssetBundle> ArchiveAssetPtr;
@@ -2,48 +2,20 @@
 
 #pragma once
 
-#include <QObject>
-#include <QRunnable>
-#include <QString>
-#include <QDateTime>
-#include <QList>
-
-struct zzip_dir;
+#include "ZipArchive.h"
 
-struct ZipArchiveFile
-{
-    QString relativePath;
-    QString cachePath;
-    uint compressedSize;
-    uint uncompressedSize;
-    QDateTime lastModified;
-    bool doExtract;
-};
-typedef QList<ZipArchiveFile> ZipFileList;
+#include <QRunnable>
 
-/// Worker thread that unpacks zip file contents.
-class ZipWorker : public QObject, public QRunnable
+/// Worker that decompresses one queued file of a ZipArchive in the thread pool.
+class ZipWorker : public QRunnable
 {
-Q_OBJECT
-
 public:
-    ZipWorker(const QString &diskSource, ZipFileList files);
-    ~ZipWorker();
+    ZipWorker(const ZipArchivePtr &archive, int index);
 
-    /// QThread override.
+    /// QRunnable override.
     virtual void run();
-    
-signals:
-    /// Emitted when zip processing has been completed.
-    /** @note Connect your slot with Qt::QueuedConnection so
-        you will receive the callback in your thread. */
-    void AsynchLoadCompleted(bool successfull);
-    
+
 private:
-    void Close();
-    
-    QString diskSource_;
-    ZipFileList files_;
-    zzip_dir *archive_;
+    ZipArchivePtr archive_;
+    int index_;
 };
-    
\ No newline at end of file
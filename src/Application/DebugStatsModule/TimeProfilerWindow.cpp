@@ -21,6 +21,7 @@
 #include "Entity.h"
 #include "Renderer.h"
 #include "OgreWorld.h"
+#include "OgreMaterialDeduplicator.h"
 #include "AssetAPI.h"
 #include "LoggingFunctions.h"
 #include "EC_RigidBody.h"
@@ -1754,6 +1755,12 @@ void TimeProfilerWindow::RefreshSceneComplexityProfilingData()
     text << "# of total batches rendered last frame: " << batches << std::endl;
     text << "# of total triangles rendered last frame: " << triangles << std::endl;
     text << "# of avg. triangles per batch: " << triangles / (batches ? batches : 1) << std::endl;
+    const RenderStateStats &renderStats = renderer->GetActiveOgreWorld()->RenderStats();
+    text << "# of materials used last frame: " << renderStats.numMaterials << std::endl;
+    text << "# of pass (render state) changes last frame: " << renderStats.numPassChanges << std::endl;
+    const OgreRenderer::UiUploadStats &uiStats = renderer->UiUploadStatistics();
+    text << "# of UI overlay rectangles uploaded last frame: " << uiStats.numRects << (uiStats.fullRedraw ? " (full redraw)" : "") << std::endl;
+    text << "UI overlay bytes uploaded last frame: " << kNet::FormatBytes((u64)uiStats.numBytes) << std::endl;
     text << "Avg. FPS: " << avgfps << std::endl;
     text << std::endl;
     
@@ -2019,6 +2026,8 @@ void TimeProfilerWindow::RefreshSceneComplexityProfilingData()
     
     text << "Ogre Materials" << std::endl;
     text << "# of materials total: " << GetNumResources(Ogre::MaterialManager::getSingleton()) << std::endl;
+    text << "# of deduplicated material assets: " << renderer->MaterialDeduplicator()->NumDeduplicatedAssets()
+         << " (sharing " << renderer->MaterialDeduplicator()->NumSharedMaterials() << " materials)" << std::endl;
     
     uint vertex_shaders = 0;
     uint pixel_shaders = 0;
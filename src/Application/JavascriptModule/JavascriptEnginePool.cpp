@@ -0,0 +1,116 @@
+/**
+ *  For conditions of distribution and use, see copyright notice in LICENSE
+ *
+ *  @file   JavascriptEnginePool.cpp
+ *  @brief  Shared script engines and parsed script program cache for Javascript script instances.
+ */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "JavascriptEnginePool.h"
+#include "JavascriptModule.h"
+#include "ScriptMetaTypeDefines.h"
+#include "ScriptCoreTypeDefines.h"
+#include "LoggingFunctions.h"
+#include "Profiler.h"
+
+#include <QScriptEngine>
+#include <QCryptographicHash>
+
+#include "MemoryLeakCheck.h"
+
+JavascriptEnginePool::JavascriptEnginePool(JavascriptModule *module_) :
+    module(module_),
+    enabled(false)
+{
+}
+
+JavascriptEnginePool::~JavascriptEnginePool()
+{
+    foreach(const SharedEngine &shared, engines)
+        delete shared.engine;
+    engines.clear();
+}
+
+QScriptEngine *JavascriptEnginePool::AcquireEngine(bool trusted)
+{
+    for(QMap<QScriptEngine*, SharedEngine>::iterator iter = engines.begin(); iter != engines.end(); ++iter)
+        if (iter->trusted == trusted)
+        {
+            ++iter->refCount;
+            return iter->engine;
+        }
+
+    PROFILE(JavascriptEnginePool_CreateEngine);
+    SharedEngine shared;
+    shared.engine = new QScriptEngine;
+    shared.refCount = 1;
+    shared.trusted = trusted;
+    connect(shared.engine, SIGNAL(signalHandlerException(const QScriptValue &)), SLOT(OnSignalHandlerException(const QScriptValue &)));
+
+    ExposeQtMetaTypes(shared.engine);
+    ExposeCoreTypes(shared.engine);
+    ExposeCoreApiMetaTypes(shared.engine);
+    module->PrepareScriptEngine(shared.engine);
+
+    engines[shared.engine] = shared;
+    LogDebug(QString("JavascriptEnginePool: Created a shared engine for ") + (trusted ? "trusted" : "untrusted") + " scripts.");
+    emit EngineCreated(shared.engine);
+    return shared.engine;
+}
+
+void JavascriptEnginePool::ReleaseEngine(QScriptEngine *engine)
+{
+    QMap<QScriptEngine*, SharedEngine>::iterator iter = engines.find(engine);
+    if (iter == engines.end() || --iter->refCount > 0)
+        return;
+    engines.erase(iter);
+    // The last instance may be unloaded by a script running in this same engine, so do not delete it immediately.
+    engine->deleteLater();
+}
+
+QString JavascriptEnginePool::AcquireProgram(const QString &content, const QString &fileName)
+{
+    // The file name is part of the key, so that errors are reported with the correct script name.
+    QString key = QCryptographicHash::hash(content.toUtf8(), QCryptographicHash::Sha1).toHex() + ":" + fileName;
+    QMap<QString, CachedProgram>::iterator iter = programs.find(key);
+    if (iter == programs.end())
+    {
+        PROFILE(JavascriptEnginePool_ParseProgram);
+        CachedProgram cached;
+        cached.program = QScriptProgram(content, fileName);
+        QScriptSyntaxCheckResult syntaxResult = QScriptEngine::checkSyntax(content);
+        cached.valid = syntaxResult.state() == QScriptSyntaxCheckResult::Valid;
+        cached.errorMessage = syntaxResult.errorMessage();
+        cached.errorLine = syntaxResult.errorLineNumber();
+        iter = programs.insert(key, cached);
+    }
+    ++iter->refCount;
+    return key;
+}
+
+void JavascriptEnginePool::ReleaseProgram(const QString &key)
+{
+    QMap<QString, CachedProgram>::iterator iter = programs.find(key);
+    if (iter != programs.end() && --iter->refCount <= 0)
+        programs.erase(iter);
+}
+
+const JavascriptEnginePool::CachedProgram &JavascriptEnginePool::Program(const QString &key) const
+{
+    static const CachedProgram empty;
+    QMap<QString, CachedProgram>::const_iterator iter = programs.find(key);
+    return iter != programs.end() ? *iter : empty;
+}
+
+void JavascriptEnginePool::OnSignalHandlerException(const QScriptValue &exception)
+{
+    QScriptEngine *engine = exception.engine();
+    LogError(exception.toString());
+    if (!engine)
+        return;
+    foreach(const QString &error, engine->uncaughtExceptionBacktrace())
+        LogError(error);
+    LogError("Line " + QString::number(engine->uncaughtExceptionLineNumber()) + ".");
+}
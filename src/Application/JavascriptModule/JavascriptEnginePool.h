@@ -0,0 +1,97 @@
+/**
+ *  For conditions of distribution and use, see copyright notice in LICENSE
+ *
+ *  @file   JavascriptEnginePool.h
+ *  @brief  Shared script engines and parsed script program cache for Javascript script instances.
+ */
+
+#pragma once
+
+#include "JavascriptFwd.h"
+
+#include <QObject>
+#include <QMap>
+#include <QString>
+#include <QScriptProgram>
+
+/// Shares script engines between Javascript script instances and caches parsed script programs.
+/** By default every EC_Script gets a script engine of its own, which is costly in scenes with thousands of scripted entities:
+    each engine gets all the type bindings and core API objects registered to it, and parses its scripts again.
+
+    When engine sharing is enabled with --jsSharedEngines, the script instances loaded from script assets share one engine per trust
+    domain, i.e. trusted and untrusted scripts never share an engine. Each instance evaluates its scripts in its own activation object,
+    so variables and functions declared by a script, as well as the "me", "scene" and "engine" objects, are private to the instance.
+    Values assigned to undeclared variables still end up in the global object, and signal connections made by a script are not broken
+    when the instance is unloaded, so a script that connects to e.g. frame.Updated must disconnect in its OnScriptDestroyed function.
+
+    The parsed programs are cached regardless of engine sharing, keyed by the hash of the script content and the script name.
+    This avoids parsing the same script again for syntax checking for every instance, and in a shared engine also compiling it again. */
+class JavascriptEnginePool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JavascriptEnginePool(JavascriptModule *module);
+    ~JavascriptEnginePool();
+
+    /// A cached script program and the result of its syntax check.
+    struct CachedProgram
+    {
+        CachedProgram() : valid(false), errorLine(0), refCount(0) {}
+        QScriptProgram program;
+        bool valid; ///< False if the program has a syntax error.
+        QString errorMessage;
+        int errorLine;
+        int refCount; ///< Number of script instances using the program.
+    };
+
+    /// Returns whether script instances loaded from script assets share engines.
+    bool IsEnabled() const { return enabled; }
+
+    /// Enables or disables engine sharing. Affects only the script instances that create their engine after the call.
+    void SetEnabled(bool enable) { enabled = enable; }
+
+    /// Returns the shared engine of the given trust domain, creating it if it does not exist, and increments its user count.
+    QScriptEngine *AcquireEngine(bool trusted);
+
+    /// Decrements the user count of a shared engine. The engine is deleted when it has no more users.
+    void ReleaseEngine(QScriptEngine *engine);
+
+    /// Returns the key of the cached program for the given script content, parsing and adding it to the cache if necessary.
+    /** Increments the user count of the program. Call ReleaseProgram when the program is no longer needed. */
+    QString AcquireProgram(const QString &content, const QString &fileName);
+
+    /// Decrements the user count of a cached program. The program is removed from the cache when it has no more users.
+    void ReleaseProgram(const QString &key);
+
+    /// Returns the cached program with the given key, or an empty program if the key is unknown.
+    const CachedProgram &Program(const QString &key) const;
+
+    /// Returns the number of shared engines.
+    int NumEngines() const { return engines.size(); }
+
+    /// Returns the number of cached programs.
+    int NumPrograms() const { return programs.size(); }
+
+signals:
+    /// A shared script engine has been created and the framework services have been registered to it.
+    void EngineCreated(QScriptEngine *engine);
+
+private slots:
+    void OnSignalHandlerException(const QScriptValue &exception);
+
+private:
+    /// A shared engine and its number of users
+    struct SharedEngine
+    {
+        SharedEngine() : engine(0), refCount(0), trusted(false) {}
+        QScriptEngine *engine;
+        int refCount;
+        bool trusted;
+    };
+
+    JavascriptModule *module;
+    bool enabled;
+    QMap<QScriptEngine*, SharedEngine> engines;
+    QMap<QString, CachedProgram> programs;
+};
@@ -10,9 +10,12 @@
 
 #include "JavascriptInstance.h"
 #include "JavascriptModule.h"
+#include "JavascriptEnginePool.h"
+#include "JavascriptProfiler.h"
 #include "ScriptMetaTypeDefines.h"
 #include "ScriptCoreTypeDefines.h"
 #include "EC_Script.h"
+#include "Entity.h"
 #include "ScriptAsset.h"
 #include "AssetAPI.h"
 #include "Application.h"
@@ -35,6 +38,7 @@ Q_DECLARE_METATYPE(QScriptClass*)
 
 JavascriptInstance::JavascriptInstance(const QString &fileName, JavascriptModule *module) :
     engine_(0),
+    sharedEngine_(false),
     sourceFile(fileName),
     module_(module),
     evaluated(false)
@@ -45,6 +49,7 @@ JavascriptInstance::JavascriptInstance(const QString &fileName, JavascriptModule
 
 JavascriptInstance::JavascriptInstance(ScriptAssetPtr scriptRef, JavascriptModule *module) :
     engine_(0),
+    sharedEngine_(false),
     module_(module),
     evaluated(false)
 {
@@ -58,6 +63,7 @@ JavascriptInstance::JavascriptInstance(ScriptAssetPtr scriptRef, JavascriptModul
 
 JavascriptInstance::JavascriptInstance(const std::vector<ScriptAssetPtr>& scriptRefs, JavascriptModule *module) :
     engine_(0),
+    sharedEngine_(false),
     module_(module),
     evaluated(false)
 {
@@ -73,6 +79,7 @@ JavascriptInstance::JavascriptInstance(const std::vector<ScriptAssetPtr>& script
 JavascriptInstance::~JavascriptInstance()
 {
     DeleteEngine();
+    ReleasePrograms();
 }
 
 QMap<QString, uint> JavascriptInstance::DumpEngineInformation()
@@ -92,7 +99,7 @@ QMap<QString, uint> JavascriptInstance::DumpEngineInformation()
     uint qobjCount = 0;
     uint qobjMethodCount = 0;   
 
-    GetObjectInformation(engine_->globalObject(), ids, valueCount, objectCount, nullCount, numberCount, boolCount, stringCount, arrayCount, funcCount, qobjCount, qobjMethodCount);
+    GetObjectInformation(ScopeObject(), ids, valueCount, objectCount, nullCount, numberCount, boolCount, stringCount, arrayCount, funcCount, qobjCount, qobjMethodCount);
 
     QMap<QString, uint> dump;
     dump["QScriptValues"] = valueCount;
@@ -176,11 +183,7 @@ void JavascriptInstance::Load()
 
     // Determine based on code origin whether it can be trusted with system access or not
     if (useAssetAPI)
-    {
-        trusted_ = true;
-        for(unsigned i = 0; i < scriptRefs_.size(); ++i)
-            trusted_ = trusted_ && scriptRefs_[i]->IsTrusted();
-    }
+        trusted_ = ScriptRefsTrusted();
     else // Local file: always trusted.
     {
         program_ = LoadScript(sourceFile);
@@ -189,21 +192,18 @@ void JavascriptInstance::Load()
         // the client to load a script into local cache, he could use this code path to automatically load that unsafe script from cache, and make it trusted. -jj.
     }
 
-    // Check the validity of the syntax in the input.
+    // Get the parsed programs, and check the validity of the syntax in the input. Instances running the same script share the parse result.
+    ReleasePrograms();
+    JavascriptEnginePool *pool = module_->EnginePool();
     for (unsigned i = 0; i < numScripts; ++i)
     {
         QString scriptSourceFilename = (useAssetAPI ? scriptRefs_[i]->Name() : sourceFile);
         QString &scriptContent = (useAssetAPI ? scriptRefs_[i]->scriptContent : program_);
 
-        QScriptSyntaxCheckResult syntaxResult = engine_->checkSyntax(scriptContent);
-        if (syntaxResult.state() != QScriptSyntaxCheckResult::Valid)
-        {
-            LogError("Syntax error in script " + scriptSourceFilename + "," + QString::number(syntaxResult.errorLineNumber()) +
-                ": " + syntaxResult.errorMessage());
-
-            // Delete our loaded script content (if any exists).
-            program_ == "";
-        }
+        programKeys_ << pool->AcquireProgram(scriptContent, scriptSourceFilename);
+        const JavascriptEnginePool::CachedProgram &program = pool->Program(programKeys_.back());
+        if (!program.valid)
+            LogError("Syntax error in script " + scriptSourceFilename + "," + QString::number(program.errorLine) + ": " + program.errorMessage);
     }
 }
 
@@ -297,16 +297,32 @@ void JavascriptInstance::Run()
     bool useAssets = !scriptRefs_.empty();
     unsigned numScripts = useAssets ? scriptRefs_.size() : 1;
     includedFiles.clear();
+    JavascriptInstance *previousInstance = module_->ScriptProfiler()->SetEvaluatingInstance(this);
     
     for (unsigned i = 0; i < numScripts; ++i)
     {
         PROFILE(JSInstance_Evaluate);
-        QString scriptSourceFilename = (useAssets ? scriptRefs_[i]->Name() : sourceFile);
-        QString &scriptContent = (useAssets ? scriptRefs_[i]->scriptContent : program_);
-
-        QScriptValue result = engine_->evaluate(scriptContent, scriptSourceFilename);
+        QScriptProgram program;
+        if (i < (unsigned)programKeys_.size())
+            program = module_->EnginePool()->Program(programKeys_[i]).program;
+        if (program.isNull())
+            program = QScriptProgram(useAssets ? scriptRefs_[i]->scriptContent : program_, useAssets ? scriptRefs_[i]->Name() : sourceFile);
+
+        QScriptValue result;
+        if (sharedEngine_)
+        {
+            // Evaluate in the activation object of this instance, so that the declarations of the script stay private to it.
+            QScriptContext *context = engine_->pushContext();
+            context->setActivationObject(scope_);
+            context->setThisObject(scope_);
+            result = engine_->evaluate(program);
+            engine_->popContext();
+        }
+        else
+            result = engine_->evaluate(program);
         CheckAndPrintException("In run/evaluate: ", result);
     }
+    module_->ScriptProfiler()->SetEvaluatingInstance(previousInstance);
     
     evaluated = true;
     emit ScriptEvaluated();
@@ -326,7 +342,7 @@ bool JavascriptInstance::RegisterService(QObject *serviceObject, const QString &
     }
 
     QScriptValue scriptValue = engine_->newQObject(serviceObject);
-    engine_->globalObject().setProperty(name, scriptValue);
+    ScopeObject().setProperty(name, scriptValue);
     return true;
 }
 
@@ -349,15 +365,19 @@ void JavascriptInstance::IncludeFile(const QString &path)
         return;
     }
 
-    QScriptContext *parent = context->parentContext();
-    if (!parent)
+    // In a shared engine, the included file is evaluated in a context of its own below, like in Run().
+    if (!sharedEngine_)
     {
-        LogError("JavascriptInstance::IncludeFile: QScriptEngine::parentContext() returned null!");
-        return;
-    }
+        QScriptContext *parent = context->parentContext();
+        if (!parent)
+        {
+            LogError("JavascriptInstance::IncludeFile: QScriptEngine::parentContext() returned null!");
+            return;
+        }
 
-    context->setActivationObject(context->parentContext()->activationObject());
-    context->setThisObject(context->parentContext()->thisObject());
+        context->setActivationObject(parent->activationObject());
+        context->setThisObject(parent->thisObject());
+    }
 
     QScriptSyntaxCheckResult syntaxResult = engine_->checkSyntax(script);
     if(syntaxResult.state() != QScriptSyntaxCheckResult::Valid)
@@ -367,7 +387,21 @@ void JavascriptInstance::IncludeFile(const QString &path)
         return;
     }
 
-    QScriptValue result = engine_->evaluate(script, path);
+    JavascriptInstance *previousInstance = module_->ScriptProfiler()->SetEvaluatingInstance(this);
+    QScriptValue result;
+    if (sharedEngine_)
+    {
+        // Evaluate in the activation object of this instance, so that the declarations of the included file
+        // stay private to it instead of leaking to the global object of the shared engine.
+        QScriptContext *includeContext = engine_->pushContext();
+        includeContext->setActivationObject(scope_);
+        includeContext->setThisObject(scope_);
+        result = engine_->evaluate(script, path);
+        engine_->popContext();
+    }
+    else
+        result = engine_->evaluate(script, path);
+    module_->ScriptProfiler()->SetEvaluatingInstance(previousInstance);
 
     includedFiles.push_back(path);
     
@@ -445,17 +479,29 @@ void JavascriptInstance::CreateEngine()
 {
     if (engine_)
         DeleteEngine();
-    engine_ = new QScriptEngine;
-    connect(engine_, SIGNAL(signalHandlerException(const QScriptValue &)), SLOT(OnSignalHandlerException(const QScriptValue &)));
+
+    JavascriptEnginePool *pool = module_->EnginePool();
+    if (pool->IsEnabled() && !scriptRefs_.empty())
+    {
+        // Shared engines have the type bindings and the framework services registered already.
+        engine_ = pool->AcquireEngine(ScriptRefsTrusted());
+        sharedEngine_ = true;
+        scope_ = engine_->newObject();
+    }
+    else
+    {
+        engine_ = new QScriptEngine;
+        connect(engine_, SIGNAL(signalHandlerException(const QScriptValue &)), SLOT(OnSignalHandlerException(const QScriptValue &)));
 //#ifndef QT_NO_SCRIPTTOOLS
-//    debugger_ = new QScriptEngineDebugger();
-//    debugger.attachTo(engine_);
-////  debugger_->action(QScriptEngineDebugger::InterruptAction)->trigger();
+//        debugger_ = new QScriptEngineDebugger();
+//        debugger.attachTo(engine_);
+////      debugger_->action(QScriptEngineDebugger::InterruptAction)->trigger();
 //#endif
 
-    ExposeQtMetaTypes(engine_);
-    ExposeCoreTypes(engine_);
-    ExposeCoreApiMetaTypes(engine_);
+        ExposeQtMetaTypes(engine_);
+        ExposeCoreTypes(engine_);
+        ExposeCoreApiMetaTypes(engine_);
+    }
 
     EC_Script *ec = dynamic_cast<EC_Script *>(owner_.lock().get());
     module_->PrepareScriptInstance(this, ec);
@@ -468,7 +514,10 @@ void JavascriptInstance::DeleteEngine()
         return;
 
     program_ = "";
-    engine_->abortEvaluation();
+    ReleasePrograms();
+    // A shared engine may be running another instance's script that is unloading this one.
+    if (!sharedEngine_)
+        engine_->abortEvaluation();
 
     // As a convention, we call a function 'OnScriptDestroyed' for each JS script
     // so that they can clean up their data before the script is removed from the object,
@@ -476,17 +525,62 @@ void JavascriptInstance::DeleteEngine()
     
     emit ScriptUnloading();
     
-    QScriptValue destructor = engine_->globalObject().property("OnScriptDestroyed");
+    QScriptValue destructor = ScopeObject().property("OnScriptDestroyed");
     if (!destructor.isUndefined())
     {
-        QScriptValue result = destructor.call();
+        QScriptValue result = sharedEngine_ ? destructor.call(scope_) : destructor.call();
         CheckAndPrintException("In script destructor: ", result);
     }
     
-    SAFE_DELETE(engine_);
+    if (sharedEngine_)
+    {
+        scope_ = QScriptValue();
+        module_->EnginePool()->ReleaseEngine(engine_);
+        engine_ = 0;
+        sharedEngine_ = false;
+    }
+    else
+        SAFE_DELETE(engine_);
     //SAFE_DELETE(debugger_);
 }
 
+QString JavascriptInstance::Name() const
+{
+    QStringList sources;
+    for(size_t i = 0; i < scriptRefs_.size(); ++i)
+        sources << scriptRefs_[i]->Name();
+    if (sources.isEmpty())
+        sources << sourceFile;
+
+    EC_Script *script = dynamic_cast<EC_Script *>(owner_.lock().get());
+    Entity *entity = script ? script->ParentEntity() : 0;
+    if (!entity)
+        return sources.join(", ");
+    return QString("%1 (%2): %3").arg(entity->Name()).arg(entity->Id()).arg(sources.join(", "));
+}
+
+QScriptValue JavascriptInstance::ScopeObject() const
+{
+    if (sharedEngine_)
+        return scope_;
+    return engine_ ? engine_->globalObject() : QScriptValue();
+}
+
+bool JavascriptInstance::ScriptRefsTrusted() const
+{
+    bool trusted = true;
+    for(unsigned i = 0; i < scriptRefs_.size(); ++i)
+        trusted = trusted && scriptRefs_[i]->IsTrusted();
+    return trusted;
+}
+
+void JavascriptInstance::ReleasePrograms()
+{
+    foreach(const QString &key, programKeys_)
+        module_->EnginePool()->ReleaseProgram(key);
+    programKeys_.clear();
+}
+
 void JavascriptInstance::OnSignalHandlerException(const QScriptValue& exception)
 {
     LogError(exception.toString());
@@ -12,6 +12,9 @@
 #include "AssetFwd.h"
 #include "JavascriptFwd.h"
 
+#include <QScriptValue>
+#include <QStringList>
+
 //#include <QtScript>
 //#ifndef QT_NO_SCRIPTTOOLS
 //#include <QScriptEngineDebugger>
@@ -59,6 +62,13 @@ public:
     //void SetPrototype(QScriptable *prototype, );
     QScriptEngine* Engine() const { return engine_; }
 
+    /// Returns whether this instance runs in an engine shared with other instances. @see JavascriptEnginePool
+    bool IsEngineShared() const { return sharedEngine_; }
+
+    /// Returns the object that holds the variables, functions and services of this instance.
+    /** This is the global object of the engine, unless the engine is shared, in which case it is the activation object of this instance. */
+    QScriptValue ScopeObject() const;
+
     /// Sets owner (EC_Script) component.
     /** @param owner Owner component. */
     void SetOwner(const ComponentPtr &owner) { owner_ = owner; }
@@ -66,6 +76,9 @@ public:
     /// Return owner component
     ComponentWeakPtr Owner() const { return owner_; }
 
+    /// Returns a descriptive name of this instance, i.e. the script source and the owner entity, if any. Used for diagnostics.
+    QString Name() const;
+
 public slots:
     /// Loads a given script in engine. This function can be used to create a property as you could include js-files.
     /** Multiple inclusion of same file is prevented. (by using simple string compare)
@@ -98,12 +111,21 @@ private:
     /// Deletes script context/engine.
     void DeleteEngine();
 
+    /// Returns whether all the script assets of this instance come from trusted sources.
+    bool ScriptRefsTrusted() const;
+
+    /// Releases the cached programs used by this instance.
+    void ReleasePrograms();
+
     QString LoadScript(const QString &fileName);
     
     void GetObjectInformation(const QScriptValue &object, QSet<qint64> &ids, uint &valueCount, uint &objectCount, uint &nullCount, uint &numberCount, 
         uint &boolCount, uint &stringCount, uint &arrayCount, uint &funcCount, uint &qobjCount, uint &qobjMethodCount);
         
     QScriptEngine *engine_; ///< Qt script engine.
+    bool sharedEngine_; ///< Is engine_ owned by the engine pool of the module.
+    QScriptValue scope_; ///< Activation object of this instance in a shared engine.
+    QStringList programKeys_; ///< Keys of the cached programs of the script sources, in the same order as the sources.
 
     // The script content for a JavascriptInstance is loaded either using the Asset API or 
     // using an absolute path name from the local file system.
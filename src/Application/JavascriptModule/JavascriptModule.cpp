@@ -11,6 +11,8 @@
 #include "JavascriptModule.h"
 #include "ScriptMetaTypeDefines.h"
 #include "JavascriptInstance.h"
+#include "JavascriptEnginePool.h"
+#include "JavascriptProfiler.h"
 #include "ScriptCoreTypeDefines.h"
 
 #include "Profiler.h"
@@ -40,13 +42,18 @@
 
 JavascriptModule::JavascriptModule() :
     IModule("Javascript"),
-    engine(new QScriptEngine(this))
+    engine(new QScriptEngine(this)),
+    enginePool(new JavascriptEnginePool(this)),
+    profiler(0)
 {
+    connect(enginePool, SIGNAL(EngineCreated(QScriptEngine*)), this, SIGNAL(ScriptEngineCreated(QScriptEngine*)));
 }
 
 JavascriptModule::~JavascriptModule()
 {
+    SAFE_DELETE(enginePool);
     SAFE_DELETE(engine);
+    SAFE_DELETE(profiler);
 }
 
 void JavascriptModule::Load()
@@ -71,6 +78,20 @@ void JavascriptModule::Initialize()
 
     RegisterCoreMetaTypes();
 
+    enginePool->SetEnabled(framework_->HasCommandLineParameter("--jsSharedEngines"));
+
+    profiler = new JavascriptProfiler(framework_);
+    connect(this, SIGNAL(ScriptEngineCreated(QScriptEngine*)), profiler, SLOT(AddEngine(QScriptEngine*)));
+    profiler->AddEngine(engine);
+    profiler->SetProfiling(framework_->HasCommandLineParameter("--jsProfiler"));
+    QStringList budget = framework_->CommandLineParameters("--jsBudget");
+    if (!budget.isEmpty())
+    {
+        QStringList action = framework_->CommandLineParameters("--jsBudgetAction");
+        profiler->SetBudget(budget.first().toDouble(), !action.isEmpty() && action.first().toLower() == "throttle" ?
+            JavascriptProfiler::BudgetThrottle : JavascriptProfiler::BudgetWarn);
+    }
+
     framework_->Console()->RegisterCommand(
         "JsExec", "Execute given code in the embedded Javascript interpreter. Usage: JsExec(mycodestring)",
         this, SLOT(RunString(const QString &)));
@@ -87,6 +108,14 @@ void JavascriptModule::Initialize()
         "JsDumpInfo", "Dumps all EC_Script information to console",
         this, SLOT(DumpScriptInfo()));
 
+    framework_->Console()->RegisterCommand(
+        "JsProfiler", "Profiles the time spent in scripts per script instance and function. Usage: JsProfiler(start|stop|reset|dump [count])",
+        profiler, SLOT(ProfilerCommand(const QStringList &)));
+
+    framework_->Console()->RegisterCommand(
+        "JsBudget", "Sets the per-frame time budget of each script instance. Usage: JsBudget(msecs [warn|throttle]), 0 disables budgets.",
+        profiler, SLOT(BudgetCommand(const QStringList &)));
+
     // Initialize startup scripts
     LoadStartupScripts();
 
@@ -104,6 +133,11 @@ void JavascriptModule::Uninitialize()
     UnloadStartupScripts();
 }
 
+void JavascriptModule::Update(f64 /*frametime*/)
+{
+    profiler->BeginFrame();
+}
+
 void JavascriptModule::RunString(const QString &codestr, const QVariantMap &context)
 {
     QMapIterator<QString, QVariant> i(context);
@@ -118,6 +152,8 @@ void JavascriptModule::RunString(const QString &codestr, const QVariantMap &cont
 
 void JavascriptModule::DumpScriptInfo()
 {
+    LogInfo(QString("Shared script engines: %1, cached script programs: %2").arg(enginePool->NumEngines()).arg(enginePool->NumPrograms()));
+
     if (!framework_->Scene()->MainCameraScene())
     {
         LogInfo("Scene is null, no scripts running.");
@@ -383,7 +419,7 @@ void JavascriptModule::CreateScriptObject(EC_Script* app, EC_Script* instance, c
         return;
     
     QScriptEngine* appEngine = jsInstance->Engine();
-    QScriptValue globalObject = appEngine->globalObject();
+    QScriptValue globalObject = jsInstance->ScopeObject();
    
     // Get the object container that holds the created script class instances from this application
     QScriptValue objectContainer = globalObject.property("scriptObjects");
@@ -397,7 +433,7 @@ void JavascriptModule::CreateScriptObject(EC_Script* app, EC_Script* instance, c
         return;
     
     const QString& appAndClassName = instance->className.Get();
-    QScriptValue constructor = appEngine->globalObject().property(className);
+    QScriptValue constructor = globalObject.property(className);
     QScriptValue object;
     if (constructor.isFunction())
     {
@@ -437,8 +473,7 @@ void JavascriptModule::RemoveScriptObject(EC_Script* instance)
     if (!jsInstance || !jsInstance->IsEvaluated())
         return;
     
-    QScriptEngine* appEngine = jsInstance->Engine();
-    QScriptValue globalObject = appEngine->globalObject();
+    QScriptValue globalObject = jsInstance->ScopeObject();
    
     // Get the object container that holds the created script class instances from this application
     QScriptValue objectContainer = globalObject.property("scriptObjects");
@@ -514,7 +549,7 @@ void JavascriptModule::RemoveScriptObjects(JavascriptInstance* jsInstance)
     if (!appEngine)
         return;
     
-    QScriptValue globalObject = appEngine->globalObject();
+    QScriptValue globalObject = jsInstance->ScopeObject();
     
     // Get the object container that holds the created script class instances from this application
     QScriptValue objectContainer = globalObject.property("scriptObjects");
@@ -661,42 +696,55 @@ void JavascriptModule::UnloadStartupScripts()
 void JavascriptModule::PrepareScriptInstance(JavascriptInstance* instance, EC_Script *comp)
 {
     PROFILE(JSModule_PrepareScriptInstance);
+
+    // A shared engine has been prepared once when it was created. Only the services specific to this instance are registered to it.
+    if (!instance->IsEngineShared())
+        PrepareScriptEngine(instance->Engine());
+
+    instance->RegisterService(instance, "engine");
+
+    if (comp)
+    {
+        // Set entity and scene that own the EC_Script component.
+        instance->RegisterService(comp->ParentEntity(), "me");
+        instance->RegisterService(comp->ParentScene(), "scene");
+    }
+
+    if (!instance->IsEngineShared())
+        emit ScriptEngineCreated(instance->Engine());
+}
+
+void JavascriptModule::PrepareScriptEngine(QScriptEngine *scriptEngine)
+{
     static std::set<QObject*> checked;
-    
+    if (!scriptEngine)
+        return;
+
     // Register framework's dynamic properties (service objects) and the framework itself to the script engine
+    QScriptValue globalObject = scriptEngine->globalObject();
     QList<QByteArray> properties = framework_->dynamicPropertyNames();
     for(QList<QByteArray>::size_type i = 0; i < properties.size(); ++i)
     {
         QString name = properties[i];
         QObject* serviceobject = framework_->property(name.toStdString().c_str()).value<QObject*>();
-        if (instance->RegisterService(serviceobject, name))
+        if (!serviceobject)
         {
-            if (checked.find(serviceobject) == checked.end())
-            {
-                // Check if the service object has an OnScriptEngineCreated() slot, and give it a chance to perform further actions
-                const QMetaObject* meta = serviceobject->metaObject();
-                if (meta->indexOfSlot("OnScriptEngineCreated(QScriptEngine*)") != -1)
-                    QObject::connect(this, SIGNAL(ScriptEngineCreated(QScriptEngine*)), serviceobject, SLOT(OnScriptEngineCreated(QScriptEngine*)));
-                
-                checked.insert(serviceobject);
-            }
+            LogError("JavascriptModule::PrepareScriptEngine: Trying to pass a null service object pointer to RegisterService!");
+            continue;
         }
-    }
-
-    instance->RegisterService(framework_, "framework");
-    instance->RegisterService(instance, "engine");
-    
-    for(uint i = 0; i < (uint)properties.size(); ++i)
-        instance->RegisterService(framework_->property(properties[i]).value<QObject*>(), properties[i]);
+        globalObject.setProperty(name, scriptEngine->newQObject(serviceobject));
+        if (checked.find(serviceobject) == checked.end())
+        {
+            // Check if the service object has an OnScriptEngineCreated() slot, and give it a chance to perform further actions
+            const QMetaObject* meta = serviceobject->metaObject();
+            if (meta->indexOfSlot("OnScriptEngineCreated(QScriptEngine*)") != -1)
+                QObject::connect(this, SIGNAL(ScriptEngineCreated(QScriptEngine*)), serviceobject, SLOT(OnScriptEngineCreated(QScriptEngine*)));
 
-    if (comp)
-    {
-        // Set entity and scene that own the EC_Script component.
-        instance->RegisterService(comp->ParentEntity(), "me");
-        instance->RegisterService(comp->ParentScene(), "scene");
+            checked.insert(serviceobject);
+        }
     }
 
-    emit ScriptEngineCreated(instance->Engine());
+    globalObject.setProperty("framework", scriptEngine->newQObject(framework_));
 }
 
 extern "C"
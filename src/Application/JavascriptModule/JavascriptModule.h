@@ -16,6 +16,8 @@
 #include <QVariant>
 
 class JavascriptInstance;
+class JavascriptEnginePool;
+class JavascriptProfiler;
 
 /// Enables Javascript execution and scripting by using QtScript.
 class JavascriptModule : public IModule
@@ -29,6 +31,7 @@ public:
     void Load();
     void Initialize();
     void Uninitialize();
+    void Update(f64 frametime);
 
     /// Prepares script instance by registering all needed services to it.
     /** If script is part of the scene, i.e. EC_Script component is present, we add some special services.
@@ -36,6 +39,16 @@ public:
         @param comp Script component, null by default. */
     void PrepareScriptInstance(JavascriptInstance* instance, EC_Script *comp = 0);
 
+    /// Registers the framework and its service objects to the global object of a script engine.
+    /** Done by PrepareScriptInstance for instances that have an engine of their own, and by JavascriptEnginePool for shared engines. */
+    void PrepareScriptEngine(QScriptEngine *engine);
+
+    /// Returns the shared script engines and the script program cache.
+    JavascriptEnginePool *EnginePool() const { return enginePool; }
+
+    /// Returns the script profiler.
+    JavascriptProfiler *ScriptProfiler() const { return profiler; }
+
 public slots:
     void DumpScriptInfo();
     
@@ -80,6 +93,12 @@ private:
     /// Default engine for console & commandline script execution
     QScriptEngine *engine;
 
+    /// Shared engines and cached programs of the script instances
+    JavascriptEnginePool *enginePool;
+
+    /// Script execution profiler and budgets
+    JavascriptProfiler *profiler;
+
     /// Engines for executing startup (possibly persistent) scripts
     std::vector<JavascriptInstance *> startupScripts_;
 
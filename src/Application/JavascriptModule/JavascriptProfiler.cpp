@@ -0,0 +1,453 @@
+/**
+ *  For conditions of distribution and use, see copyright notice in LICENSE
+ *
+ *  @file   JavascriptProfiler.cpp
+ *  @brief  Per script instance and per function timing of Javascript execution, and per-frame script time budgets.
+ */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "JavascriptProfiler.h"
+#include "JavascriptInstance.h"
+#include "LoggingFunctions.h"
+#include "Profiler.h"
+
+#include <QScriptEngine>
+#include <QScriptEngineAgent>
+#include <QScriptContextInfo>
+#include <QPair>
+
+#include <algorithm>
+#include <vector>
+
+#include "MemoryLeakCheck.h"
+
+/// Times the script calls of one script engine for JavascriptProfiler.
+class JavascriptProfilerAgent : public QScriptEngineAgent
+{
+public:
+    JavascriptProfilerAgent(QScriptEngine *engine, JavascriptProfiler *profiler_) :
+        QScriptEngineAgent(engine),
+        profiler(profiler_),
+        outer(0),
+        numStatements(0)
+    {
+    }
+
+    ~JavascriptProfilerAgent()
+    {
+#ifdef PROFILING
+        // Removed in the middle of a call, e.g. when a script stops the profiler.
+        if (!stack.empty())
+            ProfilerSection::GetProfiler()->EndBlock(outerBlockName);
+#endif
+        if (profiler)
+            profiler->AgentDeleted(this);
+    }
+
+    void scriptLoad(qint64 id, const QString & /*program*/, const QString &fileName, int /*baseLineNumber*/)
+    {
+        fileNames[id] = fileName;
+    }
+
+    void scriptUnload(qint64 id)
+    {
+        fileNames.remove(id);
+    }
+
+    void functionEntry(qint64 scriptId)
+    {
+        if (!profiler)
+            return;
+
+        Call call;
+        call.native = (scriptId == -1);
+        call.childTicks = 0;
+        call.function = (profiler->profiling && !call.native) ? FunctionFor(scriptId) : 0;
+
+        if (stack.empty())
+        {
+            // A call from native code into the scripts of an instance.
+            outer = profiler->Stats(CurrentInstance());
+            outerBlockName = outer->blockName;
+            ++outer->calls;
+            numStatements = 0;
+            if (outer->throttled)
+                engine()->abortEvaluation();
+#ifdef PROFILING
+            ProfilerSection::GetProfiler()->StartBlock(outerBlockName);
+#endif
+        }
+
+        call.start = GetCurrentClockTime();
+        stack.push_back(call);
+    }
+
+    void functionExit(qint64 /*scriptId*/, const QScriptValue & /*returnValue*/)
+    {
+        if (stack.empty()) // The agent was installed in the middle of a call.
+            return;
+
+        const Call call = stack.back();
+        stack.pop_back();
+        const tick_t elapsed = GetCurrentClockTime() - call.start;
+
+        if (call.function)
+        {
+            call.function->totalTicks += elapsed;
+            call.function->selfTicks += elapsed - call.childTicks;
+            ++call.function->calls;
+        }
+
+        if (!stack.empty())
+        {
+            // Native functions are part of the self time of the script function that called them, but the script
+            // functions they call in turn are not.
+            stack.back().childTicks += call.native ? call.childTicks : elapsed;
+            return;
+        }
+
+        if (outer)
+        {
+            outer->frameTicks += elapsed;
+            outer->totalTicks += elapsed;
+            outer = 0;
+        }
+#ifdef PROFILING
+        ProfilerSection::GetProfiler()->EndBlock(outerBlockName);
+#endif
+    }
+
+    void positionChange(qint64 /*scriptId*/, int /*lineNumber*/, int /*columnNumber*/)
+    {
+        // Abort runaway calls in throttle mode. Reading the clock on every statement would be too costly.
+        if (!profiler || !outer || stack.empty() || profiler->budgetAction != JavascriptProfiler::BudgetThrottle ||
+            profiler->budgetMsecs <= 0 || ++numStatements % 1024 != 0)
+            return;
+        if (profiler->TicksToMsecs(GetCurrentClockTime() - stack.front().start) > cMaxCallBudgets * profiler->budgetMsecs)
+        {
+            LogWarning(QString("JavascriptProfiler: Aborting a script call of %1 that has run longer than %2 ms.")
+                .arg(outer->name).arg(cMaxCallBudgets * profiler->budgetMsecs));
+            engine()->abortEvaluation();
+        }
+    }
+
+    /// Returns the script instance of the call being entered.
+    /** Each instance has itself as the "engine" service in its scope object: the global object of an engine of its own,
+        or its activation object in a shared engine. The functions of an instance have that object in their scope chain,
+        so a shared compiled script is attributed to the instance whose function is called, not to the one that loaded it.
+        Contexts pushed from native code have no scope of their own yet, so they fall back to the instance being evaluated. */
+    JavascriptInstance *CurrentInstance()
+    {
+        const QScriptValueList scopeChain = engine()->currentContext()->scopeChain();
+        for(int i = 0; i < scopeChain.size(); ++i)
+        {
+            JavascriptInstance *instance = qobject_cast<JavascriptInstance *>(scopeChain[i].property("engine", QScriptValue::ResolveLocal).toQObject());
+            if (instance)
+                return instance;
+        }
+        JavascriptInstance *evaluating = profiler->evaluatingInstance;
+        return evaluating && evaluating->Engine() == engine() ? evaluating : 0;
+    }
+
+    /// Returns the statistics of the function that is being entered.
+    JavascriptProfiler::FunctionStats *FunctionFor(qint64 scriptId)
+    {
+        QScriptContextInfo info(engine()->currentContext());
+        JavascriptProfiler::FunctionStats *&stats = functionCache[qMakePair(scriptId, info.functionStartLineNumber())];
+        if (!stats)
+        {
+            QString name = info.functionName();
+            if (name.isEmpty())
+                name = info.functionStartLineNumber() == -1 ? "<program>" : "<anonymous>";
+            stats = profiler->Function(QString("%1:%2 %3").arg(fileNames.value(scriptId)).arg(info.functionStartLineNumber()).arg(name));
+        }
+        return stats;
+    }
+
+    /// The profiler, or null if the agent has been detached from it.
+    JavascriptProfiler *profiler;
+    /// Statistics of the instance of the outermost call in progress. Null if none, or if the instance has been deleted.
+    JavascriptProfiler::InstanceStats *outer;
+    /// Cached function statistics by script id and function start line.
+    QHash<QPair<qint64, int>, JavascriptProfiler::FunctionStats *> functionCache;
+
+private:
+    /// Number of budgets a single call may take in throttle mode before it is aborted.
+    static const int cMaxCallBudgets = 10;
+
+    struct Call
+    {
+        tick_t start;
+        tick_t childTicks; ///< Time spent in the script functions called by this function.
+        JavascriptProfiler::FunctionStats *function; ///< Null for native functions and when not profiling.
+        bool native;
+    };
+
+    std::vector<Call> stack;
+    QHash<qint64, QString> fileNames; ///< File names of the loaded scripts by script id.
+    std::string outerBlockName;
+    uint numStatements; ///< Statements executed in the outermost call in progress.
+};
+
+namespace
+{
+
+bool InstanceTimeGreater(const QPair<QString, tick_t> &a, const QPair<QString, tick_t> &b)
+{
+    return a.second > b.second;
+}
+
+}
+
+JavascriptProfiler::JavascriptProfiler(Framework *framework_, QObject *parent) :
+    QObject(parent),
+    framework(framework_),
+    profiling(false),
+    budgetMsecs(0),
+    budgetAction(BudgetWarn),
+    clockFreq(GetCurrentClockFreq()),
+    numFrames(0),
+    evaluatingInstance(0)
+{
+}
+
+JavascriptProfiler::~JavascriptProfiler()
+{
+    for(QHash<QScriptEngine*, JavascriptProfilerAgent*>::iterator iter = engines.begin(); iter != engines.end(); ++iter)
+        if (iter.value())
+        {
+            iter.key()->setAgent(0);
+            iter.value()->profiler = 0;
+            delete iter.value();
+        }
+    engines.clear();
+}
+
+void JavascriptProfiler::SetProfiling(bool enable)
+{
+    profiling = enable;
+    UpdateAgents();
+}
+
+void JavascriptProfiler::SetBudget(double msecs, BudgetAction action)
+{
+    budgetMsecs = std::max(msecs, 0.0);
+    budgetAction = action;
+    if (budgetMsecs <= 0 || budgetAction != BudgetThrottle)
+        for(QHash<QObject*, InstanceStats>::iterator iter = instances.begin(); iter != instances.end(); ++iter)
+        {
+            iter->debtMsecs = 0;
+            iter->throttled = false;
+        }
+    UpdateAgents();
+}
+
+JavascriptInstance *JavascriptProfiler::SetEvaluatingInstance(JavascriptInstance *instance)
+{
+    JavascriptInstance *previous = evaluatingInstance;
+    evaluatingInstance = instance;
+    return previous;
+}
+
+void JavascriptProfiler::BeginFrame()
+{
+    if (!profiling && budgetMsecs <= 0)
+        return;
+
+    ++numFrames;
+    const tick_t now = GetCurrentClockTime();
+    for(QHash<QObject*, InstanceStats>::iterator iter = instances.begin(); iter != instances.end(); ++iter)
+    {
+        InstanceStats &stats = iter.value();
+        stats.maxFrameTicks = std::max(stats.maxFrameTicks, stats.frameTicks);
+        if (budgetMsecs > 0 && iter.key())
+        {
+            const double frameMsecs = TicksToMsecs(stats.frameTicks);
+            if (frameMsecs > budgetMsecs && (stats.lastWarningTime == 0 || TicksToMsecs(now - stats.lastWarningTime) > 5000.0))
+            {
+                LogWarning(QString("JavascriptProfiler: %1 used %2 ms in a frame, budget is %3 ms.").arg(stats.name).arg(frameMsecs, 0, 'f', 2).arg(budgetMsecs));
+                stats.lastWarningTime = now;
+            }
+            if (budgetAction == BudgetThrottle)
+            {
+                stats.debtMsecs = std::max(0.0, stats.debtMsecs + frameMsecs - budgetMsecs);
+                const bool throttle = stats.debtMsecs > 0;
+                if (throttle && !stats.throttled)
+                    LogWarning(QString("JavascriptProfiler: Throttling %1 until its %2 ms overrun has been paid back.").arg(stats.name).arg(stats.debtMsecs, 0, 'f', 2));
+                stats.throttled = throttle;
+                if (throttle)
+                    ++stats.throttledFrames;
+            }
+        }
+        stats.frameTicks = 0;
+    }
+}
+
+void JavascriptProfiler::Reset()
+{
+    numFrames = 0;
+    for(QHash<QObject*, InstanceStats>::iterator iter = instances.begin(); iter != instances.end(); ++iter)
+    {
+        iter->totalTicks = 0;
+        iter->maxFrameTicks = 0;
+        iter->calls = 0;
+        iter->throttledFrames = 0;
+    }
+    foreach(JavascriptProfilerAgent *agent, engines)
+        if (agent)
+            agent->functionCache.clear();
+    functions.clear();
+}
+
+QStringList JavascriptProfiler::Report(int maxFunctions) const
+{
+    QStringList lines;
+    QString budgetText = budgetMsecs > 0 ? QString(", budget %1 ms per frame (%2)").arg(budgetMsecs).arg(budgetAction == BudgetThrottle ? "throttle" : "warn") : QString();
+    lines << QString("Script time over %1 frames%2:").arg(numFrames).arg(budgetText);
+
+    QList<QPair<QString, tick_t> > sorted;
+    for(QHash<QObject*, InstanceStats>::const_iterator iter = instances.begin(); iter != instances.end(); ++iter)
+    {
+        const InstanceStats &stats = iter.value();
+        QString line = QString("  %1 ms total, %2 ms/frame, %3 ms max frame, %4 calls").arg(TicksToMsecs(stats.totalTicks), 0, 'f', 2)
+            .arg(numFrames > 0 ? TicksToMsecs(stats.totalTicks) / numFrames : 0.0, 0, 'f', 3).arg(TicksToMsecs(stats.maxFrameTicks), 0, 'f', 2).arg(stats.calls);
+        if (stats.throttledFrames > 0)
+            line += QString(", throttled %1 frames").arg(stats.throttledFrames);
+        sorted.append(qMakePair(line + ": " + stats.name, stats.totalTicks));
+    }
+    qSort(sorted.begin(), sorted.end(), InstanceTimeGreater);
+    for(int i = 0; i < sorted.size(); ++i)
+        lines << sorted[i].first;
+
+    if (functions.isEmpty())
+        return lines;
+
+    sorted.clear();
+    foreach(const FunctionStats &stats, functions)
+        sorted.append(qMakePair(QString("  self %1 ms, total %2 ms, %3 calls: %4").arg(TicksToMsecs(stats.selfTicks), 0, 'f', 2)
+            .arg(TicksToMsecs(stats.totalTicks), 0, 'f', 2).arg(stats.calls).arg(stats.name), stats.selfTicks));
+    qSort(sorted.begin(), sorted.end(), InstanceTimeGreater);
+    lines << QString("Top %1 of %2 script functions by self time:").arg(std::min(maxFunctions, sorted.size())).arg(sorted.size());
+    for(int i = 0; i < sorted.size() && i < maxFunctions; ++i)
+        lines << sorted[i].first;
+    return lines;
+}
+
+void JavascriptProfiler::AddEngine(QScriptEngine *engine)
+{
+    if (!engine || engines.contains(engine))
+        return;
+    connect(engine, SIGNAL(destroyed(QObject *)), SLOT(OnEngineDestroyed(QObject *)));
+    engines.insert(engine, 0);
+    UpdateAgents();
+}
+
+void JavascriptProfiler::ProfilerCommand(const QStringList &params)
+{
+    const QString action = params.isEmpty() ? QString("dump") : params[0].trimmed().toLower();
+    if (action == "start")
+    {
+        SetProfiling(true);
+        LogInfo("JsProfiler: Profiling started.");
+    }
+    else if (action == "stop")
+    {
+        SetProfiling(false);
+        LogInfo("JsProfiler: Profiling stopped.");
+    }
+    else if (action == "reset")
+        Reset();
+    else if (action == "dump")
+    {
+        int count = params.size() > 1 ? params[1].trimmed().toInt() : 0;
+        foreach(const QString &line, Report(count > 0 ? count : 20))
+            LogInfo(line);
+    }
+    else
+        LogError("JsProfiler: Unknown action \"" + action + "\". Usage: JsProfiler(start|stop|reset|dump [count])");
+}
+
+void JavascriptProfiler::BudgetCommand(const QStringList &params)
+{
+    if (params.isEmpty())
+    {
+        if (budgetMsecs > 0)
+            LogInfo(QString("JsBudget: %1 ms per script instance per frame, %2.").arg(budgetMsecs).arg(budgetAction == BudgetThrottle ? "throttle" : "warn"));
+        else
+            LogInfo("JsBudget: Script budgets are disabled.");
+        return;
+    }
+
+    bool ok = false;
+    double msecs = params[0].trimmed().toDouble(&ok);
+    if (!ok || msecs < 0)
+    {
+        LogError("JsBudget: Invalid budget \"" + params[0] + "\". Usage: JsBudget(msecs [warn|throttle]), 0 disables budgets.");
+        return;
+    }
+    SetBudget(msecs, params.size() > 1 && params[1].trimmed().toLower() == "throttle" ? BudgetThrottle : BudgetWarn);
+}
+
+void JavascriptProfiler::OnEngineDestroyed(QObject *engine)
+{
+    // The engine deletes its agent itself.
+    JavascriptProfilerAgent *agent = engines.take(static_cast<QScriptEngine *>(engine));
+    if (agent)
+        agent->profiler = 0;
+}
+
+void JavascriptProfiler::OnInstanceDestroyed(QObject *instance)
+{
+    QHash<QObject*, InstanceStats>::iterator iter = instances.find(instance);
+    if (iter == instances.end())
+        return;
+    foreach(JavascriptProfilerAgent *agent, engines)
+        if (agent && agent->outer == &iter.value())
+            agent->outer = 0;
+    instances.erase(iter);
+}
+
+JavascriptProfiler::InstanceStats *JavascriptProfiler::Stats(JavascriptInstance *instance)
+{
+    QHash<QObject*, InstanceStats>::iterator iter = instances.find(instance);
+    if (iter == instances.end())
+    {
+        InstanceStats stats;
+        stats.name = instance ? instance->Name() : QString("<unattributed>");
+        stats.blockName = "JS_" + stats.name.toStdString();
+        if (instance)
+            connect(instance, SIGNAL(destroyed(QObject *)), SLOT(OnInstanceDestroyed(QObject *)));
+        iter = instances.insert(instance, stats);
+    }
+    return &iter.value();
+}
+
+void JavascriptProfiler::UpdateAgents()
+{
+    const bool active = profiling || budgetMsecs > 0;
+    for(QHash<QScriptEngine*, JavascriptProfilerAgent*>::iterator iter = engines.begin(); iter != engines.end(); ++iter)
+    {
+        if (active && !iter.value())
+        {
+            iter.value() = new JavascriptProfilerAgent(iter.key(), this);
+            iter.key()->setAgent(iter.value());
+        }
+        else if (!active && iter.value())
+        {
+            JavascriptProfilerAgent *agent = iter.value();
+            iter.value() = 0;
+            iter.key()->setAgent(0);
+            agent->profiler = 0;
+            delete agent;
+        }
+    }
+}
+
+void JavascriptProfiler::AgentDeleted(JavascriptProfilerAgent *agent)
+{
+    for(QHash<QScriptEngine*, JavascriptProfilerAgent*>::iterator iter = engines.begin(); iter != engines.end(); ++iter)
+        if (iter.value() == agent)
+            iter.value() = 0;
+}
@@ -0,0 +1,149 @@
+/**
+ *  For conditions of distribution and use, see copyright notice in LICENSE
+ *
+ *  @file   JavascriptProfiler.h
+ *  @brief  Per script instance and per function timing of Javascript execution, and per-frame script time budgets.
+ */
+
+#pragma once
+
+#include "JavascriptFwd.h"
+#include "HighPerfClock.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include <string>
+
+class Framework;
+class JavascriptProfilerAgent;
+
+/// Measures the time spent in Javascript per script instance and per function, and enforces per-frame time budgets.
+/** The profiler installs a QScriptEngineAgent to every script engine while profiling or budgets are enabled. The agents
+    time each call from native code into a script, e.g. a signal handler or the evaluation of a script, and attribute it
+    to the script instance found in the scope chain of the call. This also separates the instances that share an engine
+    and a compiled script asset with --jsSharedEngines.
+
+    Profiling is started with --jsProfiler or the console command JsProfiler(start). In addition to the per instance times,
+    profiling records the self and total time of each script function. JsProfiler(dump) prints the results. In builds with
+    PROFILING defined, the time of each script instance is also shown in the Profiler tree as a "JS_<instance name>" block.
+
+    Budgets are enabled with --jsBudget <msecs> or the console command JsBudget(msecs, warn|throttle). When a script instance
+    uses more than the budget in a frame, a warning is logged. In throttle mode, the overrun is also recorded as debt: the
+    script calls of the instance are aborted in the following frames until the debt has been paid back at the rate of one
+    budget per frame, and a single call that runs longer than ten budgets is aborted. This keeps one script from stalling
+    the simulation of a whole server. Budgets only measure the time, so they are cheaper than full profiling. */
+class JavascriptProfiler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// What to do when a script instance exceeds its frame budget.
+    enum BudgetAction
+    {
+        BudgetWarn, ///< Log a warning.
+        BudgetThrottle ///< Log a warning and skip the scripts of the instance until the overrun has been paid back.
+    };
+
+    explicit JavascriptProfiler(Framework *framework, QObject *parent = 0);
+    ~JavascriptProfiler();
+
+    /// Returns whether per function profiling is enabled.
+    bool IsProfiling() const { return profiling; }
+
+    /// Enables or disables per function profiling.
+    void SetProfiling(bool enable);
+
+    /// Returns the per-frame time budget of a script instance in milliseconds, or 0 if budgets are disabled.
+    double Budget() const { return budgetMsecs; }
+
+    /// Returns what is done when a script instance exceeds its budget.
+    BudgetAction BudgetActionType() const { return budgetAction; }
+
+    /// Sets the per-frame time budget of a script instance. Pass 0 to disable budgets.
+    void SetBudget(double msecs, BudgetAction action);
+
+    /// Sets the script instance that is evaluating scripts, so that evaluation calls without a scope of their own are attributed to it.
+    /** Set by JavascriptInstance around script evaluation. @return The previously evaluating instance, to be restored afterwards. */
+    JavascriptInstance *SetEvaluatingInstance(JavascriptInstance *instance);
+
+    /// Called at the start of each frame. Checks the budgets against the previous frame and resets the frame times.
+    void BeginFrame();
+
+    /// Clears the collected statistics.
+    void Reset();
+
+    /// Returns the collected statistics as text lines, including at most maxFunctions functions sorted by self time.
+    QStringList Report(int maxFunctions) const;
+
+public slots:
+    /// Starts tracking a script engine. The profiler agent is installed to the engine while profiling or budgets are enabled.
+    void AddEngine(QScriptEngine *engine);
+
+    /// Console command JsProfiler(start|stop|reset|dump [count]).
+    void ProfilerCommand(const QStringList &params);
+
+    /// Console command JsBudget(msecs [warn|throttle]).
+    void BudgetCommand(const QStringList &params);
+
+private slots:
+    void OnEngineDestroyed(QObject *engine);
+    void OnInstanceDestroyed(QObject *instance);
+
+private:
+    friend class JavascriptProfilerAgent;
+
+    /// Time statistics of one script instance.
+    struct InstanceStats
+    {
+        InstanceStats() : frameTicks(0), totalTicks(0), maxFrameTicks(0), calls(0), debtMsecs(0), throttled(false), throttledFrames(0), lastWarningTime(0) {}
+        QString name;
+        std::string blockName; ///< Name of the Profiler block of this instance.
+        tick_t frameTicks; ///< Time spent in the current frame.
+        tick_t totalTicks;
+        tick_t maxFrameTicks;
+        uint calls;
+        double debtMsecs; ///< Budget overrun that has not been paid back yet, in throttle mode.
+        bool throttled; ///< Are the script calls of this instance aborted in the current frame.
+        uint throttledFrames;
+        tick_t lastWarningTime;
+    };
+
+    /// Time statistics of one script function.
+    struct FunctionStats
+    {
+        FunctionStats() : selfTicks(0), totalTicks(0), calls(0) {}
+        QString name;
+        tick_t selfTicks; ///< Time spent in the function itself, excluding the other script functions it called.
+        tick_t totalTicks; ///< Time spent in the function and the functions it called.
+        uint calls;
+    };
+
+    /// Returns the statistics of the given instance, creating them if necessary. Null instance is used for unattributed code.
+    InstanceStats *Stats(JavascriptInstance *instance);
+
+    /// Returns the statistics of the given function, creating them if necessary.
+    FunctionStats *Function(const QString &name) { FunctionStats &stats = functions[name]; stats.name = name; return &stats; }
+
+    /// Installs or removes the agents depending on whether profiling or budgets are enabled.
+    void UpdateAgents();
+
+    /// Called by an agent when it is deleted.
+    void AgentDeleted(JavascriptProfilerAgent *agent);
+
+    double TicksToMsecs(tick_t ticks) const { return ticks * 1000.0 / clockFreq; }
+
+    Framework *framework;
+    bool profiling;
+    double budgetMsecs;
+    BudgetAction budgetAction;
+    tick_t clockFreq;
+    uint numFrames; ///< Frames since the statistics were reset.
+    JavascriptInstance *evaluatingInstance;
+    QHash<QScriptEngine*, JavascriptProfilerAgent*> engines; ///< Tracked engines and their agents, null when not installed.
+    QHash<QObject*, InstanceStats> instances; ///< Statistics of each script instance. Null key is for unattributed code.
+    QHash<QString, FunctionStats> functions; ///< Statistics of each function, by "file:line name".
+};
@@ -37,6 +37,7 @@
 #include "AssetAPI.h"
 #include "Math/MathFunc.h"
 #include "QScriptEngineHelpers.h"
+#include "ScriptNativeMath.h"
 #include "InputAPI.h"
 
 #include <QFile>
@@ -297,6 +298,7 @@ void ExposeCoreApiMetaTypes(QScriptEngine *engine)
     mathNamespace.setProperty("SetMathBreakOnAssume", engine->newFunction(math_SetMathBreakOnAssume, 1), QScriptValue::Undeletable | QScriptValue::ReadOnly);
     mathNamespace.setProperty("MathBreakOnAssume", engine->newFunction(math_SetMathBreakOnAssume, 0), QScriptValue::Undeletable | QScriptValue::ReadOnly);
     engine->globalObject().setProperty("math", mathNamespace);
+    ExposeNativeMathTypes(engine);
 
     // Input metatypes.
     qScriptRegisterQObjectMetaType<MouseEvent*>(engine);
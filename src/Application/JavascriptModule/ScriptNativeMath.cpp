@@ -0,0 +1,855 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   ScriptNativeMath.cpp
+    @brief  Natively stored float3, Quat and Transform script types with in-place operations, and bulk transform access. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "ScriptNativeMath.h"
+#include "QtScriptBindingsHelpers.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+#include "AttributeChangeType.h"
+#include "Transform.h"
+
+#include <QScriptClass>
+#include <QScriptString>
+#include <QScriptEngine>
+
+#include <vector>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+
+class NativeMathTypes;
+
+/// Script class whose objects store a math value of type T natively in their data.
+template<typename T>
+class NativeValueClass : public QScriptClass
+{
+public:
+    NativeValueClass(QScriptEngine *engine, NativeMathTypes *types_, const QString &className) :
+        QScriptClass(engine),
+        types(types_),
+        className_(className)
+    {
+    }
+
+    /// Creates a new script object that holds the given value.
+    QScriptValue New(const T &value)
+    {
+        return engine()->newObject(this, engine()->newVariant(QVariant::fromValue(value)));
+    }
+
+    virtual ~NativeValueClass() {}
+
+    /// Returns the value stored in the given object, or null if the object is not of this class.
+    virtual T *Value(const QScriptValue &object) const
+    {
+        return object.scriptClass() == this ? qscriptvalue_cast<T*>(object.data()) : 0;
+    }
+
+    QString name() const { return className_; }
+    QScriptValue prototype() const { return proto; }
+
+    NativeMathTypes *types;
+    QScriptValue proto;
+
+private:
+    QString className_;
+};
+
+/// Script class for the values that consist of float components, i.e. float3 and Quat. The components are exposed as properties.
+template<typename T>
+class ComponentClass : public NativeValueClass<T>
+{
+public:
+    ComponentClass(QScriptEngine *engine, NativeMathTypes *types, const QString &className, const char *componentNames) :
+        NativeValueClass<T>(engine, types, className)
+    {
+        for(const char *c = componentNames; *c; ++c)
+            components.push_back(engine->toStringHandle(QString(QChar(*c))));
+    }
+
+    QScriptClass::QueryFlags queryProperty(const QScriptValue & /*object*/, const QScriptString &name, QScriptClass::QueryFlags flags, uint *id)
+    {
+        for(uint i = 0; i < components.size(); ++i)
+            if (name == components[i])
+            {
+                *id = i;
+                return flags & (QScriptClass::HandlesReadAccess | QScriptClass::HandlesWriteAccess);
+            }
+        return 0;
+    }
+
+    QScriptValue property(const QScriptValue &object, const QScriptString & /*name*/, uint id)
+    {
+        T *value = this->Value(object);
+        return value ? QScriptValue(value->ptr()[id]) : QScriptValue();
+    }
+
+    void setProperty(QScriptValue &object, const QScriptString & /*name*/, uint id, const QScriptValue &newValue)
+    {
+        T *value = this->Value(object);
+        if (value)
+            value->ptr()[id] = (float)newValue.toNumber();
+    }
+
+    QScriptValue::PropertyFlags propertyFlags(const QScriptValue & /*object*/, const QScriptString & /*name*/, uint /*id*/)
+    {
+        return QScriptValue::Undeletable;
+    }
+
+private:
+    std::vector<QScriptString> components;
+};
+
+/// Returns the member of a transform by index: 0 for the position, 1 for the rotation and 2 for the scale.
+float3 &Member(Transform &t, uint id)
+{
+    return id == 0 ? t.pos : (id == 1 ? t.rot : t.scale);
+}
+
+/// Script class for float3 views of one member of a native Transform. The data of a view object is the Transform object,
+/// so writing to the view, e.g. t.pos.x = 5, modifies the Transform in place.
+class Float3ViewClass : public ComponentClass<float3>
+{
+public:
+    Float3ViewClass(QScriptEngine *engine, NativeMathTypes *types, uint member_) :
+        ComponentClass<float3>(engine, types, "float3", "xyz"),
+        member(member_)
+    {
+    }
+
+    /// Creates a new view of the member of the given Transform object.
+    QScriptValue NewView(const QScriptValue &transform) { return engine()->newObject(this, transform); }
+
+    float3 *Value(const QScriptValue &object) const;
+
+private:
+    uint member;
+};
+
+/// Script class for Transform. The position, rotation and scale are exposed as properties that return native float3 views.
+class TransformClass : public NativeValueClass<Transform>
+{
+public:
+    TransformClass(QScriptEngine *engine, NativeMathTypes *types);
+
+    QueryFlags queryProperty(const QScriptValue &object, const QScriptString &name, QueryFlags flags, uint *id);
+    QScriptValue property(const QScriptValue &object, const QScriptString &name, uint id);
+    void setProperty(QScriptValue &object, const QScriptString &name, uint id, const QScriptValue &newValue);
+    QScriptValue::PropertyFlags propertyFlags(const QScriptValue &object, const QScriptString &name, uint id);
+
+private:
+    QScriptString members[3];
+};
+
+/// The native math script classes of one script engine. Owned by the engine.
+class NativeMathTypes : public QObject
+{
+public:
+    explicit NativeMathTypes(QScriptEngine *engine) :
+        QObject(engine),
+        float3Class(new ComponentClass<float3>(engine, this, "float3", "xyz")),
+        quatClass(new ComponentClass<Quat>(engine, this, "Quat", "xyzw")),
+        transformClass(new TransformClass(engine, this))
+    {
+        for(uint i = 0; i < 3; ++i)
+            float3ViewClasses[i] = new Float3ViewClass(engine, this, i);
+    }
+
+    ~NativeMathTypes()
+    {
+        delete float3Class;
+        for(uint i = 0; i < 3; ++i)
+            delete float3ViewClasses[i];
+        delete quatClass;
+        delete transformClass;
+    }
+
+    /// Returns the value of a native float3 or of a float3 view of a native Transform, or null if the object is neither.
+    float3 *Float3(const QScriptValue &object) const
+    {
+        if (float3 *value = float3Class->Value(object))
+            return value;
+        for(uint i = 0; i < 3; ++i)
+            if (float3 *value = float3ViewClasses[i]->Value(object))
+                return value;
+        return 0;
+    }
+
+    /// Reads a float3 from a native float3 or from any object with x, y and z properties.
+    bool ReadFloat3(const QScriptValue &value, float3 &out) const
+    {
+        if (const float3 *native = Float3(value))
+        {
+            out = *native;
+            return true;
+        }
+        if (!value.isObject())
+            return false;
+        out = float3((float)value.property("x").toNumber(), (float)value.property("y").toNumber(), (float)value.property("z").toNumber());
+        return true;
+    }
+
+    /// Reads a Quat from a native Quat or from any object with x, y, z and w properties.
+    bool ReadQuat(const QScriptValue &value, Quat &out) const
+    {
+        if (const Quat *native = quatClass->Value(value))
+        {
+            out = *native;
+            return true;
+        }
+        if (!value.isObject())
+            return false;
+        out = Quat((float)value.property("x").toNumber(), (float)value.property("y").toNumber(),
+            (float)value.property("z").toNumber(), (float)value.property("w").toNumber());
+        return true;
+    }
+
+    /// Reads a Transform from a native Transform or from any object with pos, rot and scale properties.
+    bool ReadTransform(const QScriptValue &value, Transform &out) const
+    {
+        if (const Transform *native = transformClass->Value(value))
+        {
+            out = *native;
+            return true;
+        }
+        return value.isObject() && ReadFloat3(value.property("pos"), out.pos) && ReadFloat3(value.property("rot"), out.rot) &&
+            ReadFloat3(value.property("scale"), out.scale);
+    }
+
+    ComponentClass<float3> *float3Class;
+    Float3ViewClass *float3ViewClasses[3]; ///< Views of the position, rotation and scale of a Transform.
+    ComponentClass<Quat> *quatClass;
+    TransformClass *transformClass;
+};
+
+float3 *Float3ViewClass::Value(const QScriptValue &object) const
+{
+    if (object.scriptClass() != this)
+        return 0;
+    Transform *transform = types->transformClass->Value(object.data());
+    return transform ? &Member(*transform, member) : 0;
+}
+
+TransformClass::TransformClass(QScriptEngine *engine, NativeMathTypes *types) :
+    NativeValueClass<Transform>(engine, types, "Transform")
+{
+    members[0] = engine->toStringHandle("pos");
+    members[1] = engine->toStringHandle("rot");
+    members[2] = engine->toStringHandle("scale");
+}
+
+QScriptClass::QueryFlags TransformClass::queryProperty(const QScriptValue & /*object*/, const QScriptString &name, QueryFlags flags, uint *id)
+{
+    for(uint i = 0; i < 3; ++i)
+        if (name == members[i])
+        {
+            *id = i;
+            return flags & (HandlesReadAccess | HandlesWriteAccess);
+        }
+    return 0;
+}
+
+QScriptValue TransformClass::property(const QScriptValue &object, const QScriptString & /*name*/, uint id)
+{
+    return Value(object) ? types->float3ViewClasses[id]->NewView(object) : QScriptValue();
+}
+
+void TransformClass::setProperty(QScriptValue &object, const QScriptString & /*name*/, uint id, const QScriptValue &newValue)
+{
+    Transform *value = Value(object);
+    if (value)
+        types->ReadFloat3(newValue, Member(*value, id));
+}
+
+QScriptValue::PropertyFlags TransformClass::propertyFlags(const QScriptValue & /*object*/, const QScriptString & /*name*/, uint /*id*/)
+{
+    return QScriptValue::Undeletable;
+}
+
+/// Returns the native math classes of the engine. They are stored in the data of every function exposed by this file.
+NativeMathTypes *Types(QScriptContext *context)
+{
+    return static_cast<NativeMathTypes *>(context->callee().data().toQObject());
+}
+
+QScriptValue ArgumentError(QScriptContext *context, const char *function, const char *expected)
+{
+    return context->throwError(QScriptContext::TypeError, QString("nativemath.%1: expected %2.").arg(function).arg(expected));
+}
+
+// float3
+
+QScriptValue float3_ctor(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 value = float3::zero;
+    if (context->argumentCount() == 1 && !types->ReadFloat3(context->argument(0), value))
+        return ArgumentError(context, "float3", "an object with x, y and z");
+    else if (context->argumentCount() >= 3)
+        value = float3((float)context->argument(0).toNumber(), (float)context->argument(1).toNumber(), (float)context->argument(2).toNumber());
+    return types->float3Class->New(value);
+}
+
+QScriptValue float3_Set(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "float3.Set", "a nativemath.float3 as this");
+    if (context->argumentCount() >= 3)
+        This->Set((float)context->argument(0).toNumber(), (float)context->argument(1).toNumber(), (float)context->argument(2).toNumber());
+    else if (!types->ReadFloat3(context->argument(0), *This))
+        return ArgumentError(context, "float3.Set", "three numbers or a float3");
+    return context->thisObject();
+}
+
+/// Applies a binary operation with a float3 argument to a native float3 in place.
+template<void (*Op)(float3 &, const float3 &)>
+QScriptValue float3_InPlace(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    float3 v;
+    if (!This || !types->ReadFloat3(context->argument(0), v))
+        return ArgumentError(context, "float3", "a nativemath.float3 as this and a float3 argument");
+    Op(*This, v);
+    return context->thisObject();
+}
+
+void AddOp(float3 &a, const float3 &b) { a += b; }
+void SubOp(float3 &a, const float3 &b) { a -= b; }
+void CrossOp(float3 &a, const float3 &b) { a = a.Cross(b); }
+
+QScriptValue float3_Mul(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "float3.Mul", "a nativemath.float3 as this");
+    float3 v;
+    if (context->argument(0).isNumber())
+        *This *= (float)context->argument(0).toNumber();
+    else if (types->ReadFloat3(context->argument(0), v))
+        *This = This->Mul(v);
+    else
+        return ArgumentError(context, "float3.Mul", "a number or a float3");
+    return context->thisObject();
+}
+
+QScriptValue float3_Div(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "float3.Div", "a nativemath.float3 as this");
+    *This /= (float)context->argument(0).toNumber();
+    return context->thisObject();
+}
+
+QScriptValue float3_AddScaled(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    float3 v;
+    if (!This || !types->ReadFloat3(context->argument(0), v))
+        return ArgumentError(context, "float3.AddScaled", "a float3 and a number");
+    *This += v * (float)context->argument(1).toNumber();
+    return context->thisObject();
+}
+
+QScriptValue float3_Lerp(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    float3 v;
+    if (!This || !types->ReadFloat3(context->argument(0), v))
+        return ArgumentError(context, "float3.Lerp", "a float3 and a number");
+    *This = This->Lerp(v, (float)context->argument(1).toNumber());
+    return context->thisObject();
+}
+
+QScriptValue float3_Negate(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "float3.Negate", "a nativemath.float3 as this");
+    *This = -*This;
+    return context->thisObject();
+}
+
+QScriptValue float3_Normalize(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "float3.Normalize", "a nativemath.float3 as this");
+    // Leave zero vectors as they are instead of asserting, steering code normalizes zero vectors routinely.
+    if (This->LengthSq() > 1e-12f)
+        This->Normalize();
+    return context->thisObject();
+}
+
+QScriptValue float3_ScaleToLength(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "float3.ScaleToLength", "a nativemath.float3 as this");
+    if (This->LengthSq() > 1e-12f)
+        This->ScaleToLength((float)context->argument(0).toNumber());
+    return context->thisObject();
+}
+
+/// Evaluates a scalar function of a native float3 and a float3 argument.
+template<float (*Op)(const float3 &, const float3 &)>
+QScriptValue float3_Scalar(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    float3 v;
+    if (!This || !types->ReadFloat3(context->argument(0), v))
+        return ArgumentError(context, "float3", "a nativemath.float3 as this and a float3 argument");
+    return QScriptValue(Op(*This, v));
+}
+
+float DotOp(const float3 &a, const float3 &b) { return a.Dot(b); }
+float DistanceOp(const float3 &a, const float3 &b) { return a.Distance(b); }
+float DistanceSqOp(const float3 &a, const float3 &b) { return a.DistanceSq(b); }
+
+QScriptValue float3_Length(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    return This ? QScriptValue(This->Length()) : ArgumentError(context, "float3.Length", "a nativemath.float3 as this");
+}
+
+QScriptValue float3_LengthSq(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    return This ? QScriptValue(This->LengthSq()) : ArgumentError(context, "float3.LengthSq", "a nativemath.float3 as this");
+}
+
+QScriptValue float3_Clone(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    float3 *This = types->Float3(context->thisObject());
+    return This ? types->float3Class->New(*This) : ArgumentError(context, "float3.Clone", "a nativemath.float3 as this");
+}
+
+QScriptValue float3_ToFloat3(QScriptContext *context, QScriptEngine *engine)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    return This ? qScriptValueFromValue(engine, *This) : ArgumentError(context, "float3.ToFloat3", "a nativemath.float3 as this");
+}
+
+QScriptValue float3_toString(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    float3 *This = Types(context)->Float3(context->thisObject());
+    return This ? QScriptValue(QString::fromStdString(This->ToString())) : QScriptValue("nativemath.float3");
+}
+
+// Quat
+
+QScriptValue Quat_ctor(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat value = Quat::identity;
+    if (context->argumentCount() == 1 && !types->ReadQuat(context->argument(0), value))
+        return ArgumentError(context, "Quat", "an object with x, y, z and w");
+    else if (context->argumentCount() >= 4)
+        value = Quat((float)context->argument(0).toNumber(), (float)context->argument(1).toNumber(),
+            (float)context->argument(2).toNumber(), (float)context->argument(3).toNumber());
+    return types->quatClass->New(value);
+}
+
+QScriptValue Quat_Set(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat *This = types->quatClass->Value(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "Quat.Set", "a nativemath.Quat as this");
+    if (context->argumentCount() >= 4)
+        This->Set((float)context->argument(0).toNumber(), (float)context->argument(1).toNumber(),
+            (float)context->argument(2).toNumber(), (float)context->argument(3).toNumber());
+    else if (!types->ReadQuat(context->argument(0), *This))
+        return ArgumentError(context, "Quat.Set", "four numbers or a Quat");
+    return context->thisObject();
+}
+
+QScriptValue Quat_Mul(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat *This = types->quatClass->Value(context->thisObject());
+    Quat q;
+    if (!This || !types->ReadQuat(context->argument(0), q))
+        return ArgumentError(context, "Quat.Mul", "a nativemath.Quat as this and a Quat argument");
+    *This = *This * q;
+    return context->thisObject();
+}
+
+QScriptValue Quat_Slerp(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat *This = types->quatClass->Value(context->thisObject());
+    Quat q;
+    if (!This || !types->ReadQuat(context->argument(0), q))
+        return ArgumentError(context, "Quat.Slerp", "a Quat and a number");
+    *This = This->Slerp(q, (float)context->argument(1).toNumber());
+    return context->thisObject();
+}
+
+QScriptValue Quat_Normalize(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    Quat *This = Types(context)->quatClass->Value(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "Quat.Normalize", "a nativemath.Quat as this");
+    This->Normalize();
+    return context->thisObject();
+}
+
+QScriptValue Quat_Inverse(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    Quat *This = Types(context)->quatClass->Value(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "Quat.Inverse", "a nativemath.Quat as this");
+    This->Inverse();
+    return context->thisObject();
+}
+
+QScriptValue Quat_SetFromAxisAngle(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat *This = types->quatClass->Value(context->thisObject());
+    float3 axis;
+    if (!This || !types->ReadFloat3(context->argument(0), axis))
+        return ArgumentError(context, "Quat.SetFromAxisAngle", "a float3 axis and an angle in radians");
+    *This = Quat::RotateAxisAngle(axis.Normalized(), (float)context->argument(1).toNumber());
+    return context->thisObject();
+}
+
+QScriptValue Quat_Transform(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat *This = types->quatClass->Value(context->thisObject());
+    float3 *v = types->Float3(context->argument(0));
+    if (!This || !v)
+        return ArgumentError(context, "Quat.Transform", "a nativemath.float3 to rotate in place");
+    *v = This->Mul(*v);
+    return context->argument(0);
+}
+
+QScriptValue Quat_Clone(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Quat *This = types->quatClass->Value(context->thisObject());
+    return This ? types->quatClass->New(*This) : ArgumentError(context, "Quat.Clone", "a nativemath.Quat as this");
+}
+
+QScriptValue Quat_ToQuat(QScriptContext *context, QScriptEngine *engine)
+{
+    Quat *This = Types(context)->quatClass->Value(context->thisObject());
+    return This ? qScriptValueFromValue(engine, *This) : ArgumentError(context, "Quat.ToQuat", "a nativemath.Quat as this");
+}
+
+QScriptValue Quat_toString(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    Quat *This = Types(context)->quatClass->Value(context->thisObject());
+    return This ? QScriptValue(QString::fromStdString(This->ToString())) : QScriptValue("nativemath.Quat");
+}
+
+// Transform
+
+QScriptValue Transform_ctor(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform value;
+    if (context->argumentCount() == 1 && !types->ReadTransform(context->argument(0), value))
+        return ArgumentError(context, "Transform", "an object with pos, rot and scale");
+    else if (context->argumentCount() >= 3 && !(types->ReadFloat3(context->argument(0), value.pos) &&
+        types->ReadFloat3(context->argument(1), value.rot) && types->ReadFloat3(context->argument(2), value.scale)))
+        return ArgumentError(context, "Transform", "three float3s");
+    return types->transformClass->New(value);
+}
+
+/// Sets a member of a native Transform from a float3 or three numbers.
+template<uint Id>
+QScriptValue Transform_SetMember(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    if (!This)
+        return ArgumentError(context, "Transform", "a nativemath.Transform as this");
+    float3 &member = Member(*This, Id);
+    if (context->argumentCount() >= 3)
+        member.Set((float)context->argument(0).toNumber(), (float)context->argument(1).toNumber(), (float)context->argument(2).toNumber());
+    else if (!types->ReadFloat3(context->argument(0), member))
+        return ArgumentError(context, "Transform", "three numbers or a float3");
+    return context->thisObject();
+}
+
+/// Copies a member of a native Transform into a native float3 given as the argument, and returns the argument.
+template<uint Id>
+QScriptValue Transform_GetMember(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    float3 *out = types->Float3(context->argument(0));
+    if (!This || !out)
+        return ArgumentError(context, "Transform", "a nativemath.float3 to write to");
+    *out = Member(*This, Id);
+    return context->argument(0);
+}
+
+QScriptValue Transform_Translate(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    float3 v;
+    if (!This || !types->ReadFloat3(context->argument(0), v))
+        return ArgumentError(context, "Transform.Translate", "a float3");
+    This->pos += v;
+    return context->thisObject();
+}
+
+QScriptValue Transform_SetOrientation(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    Quat q;
+    if (!This || !types->ReadQuat(context->argument(0), q))
+        return ArgumentError(context, "Transform.SetOrientation", "a Quat");
+    This->SetOrientation(q);
+    return context->thisObject();
+}
+
+QScriptValue Transform_GetOrientation(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    Quat *out = types->quatClass->Value(context->argument(0));
+    if (!This || !out)
+        return ArgumentError(context, "Transform.GetOrientation", "a nativemath.Quat to write to");
+    *out = This->Orientation();
+    return context->argument(0);
+}
+
+QScriptValue Transform_TransformPoint(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    float3 *v = types->Float3(context->argument(0));
+    if (!This || !v)
+        return ArgumentError(context, "Transform.TransformPoint", "a nativemath.float3 to transform in place");
+    *v = This->ToFloat3x4().TransformPos(*v);
+    return context->argument(0);
+}
+
+QScriptValue Transform_Clone(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    NativeMathTypes *types = Types(context);
+    Transform *This = types->transformClass->Value(context->thisObject());
+    return This ? types->transformClass->New(*This) : ArgumentError(context, "Transform.Clone", "a nativemath.Transform as this");
+}
+
+QScriptValue Transform_ToTransform(QScriptContext *context, QScriptEngine *engine)
+{
+    Transform *This = Types(context)->transformClass->Value(context->thisObject());
+    return This ? qScriptValueFromValue(engine, *This) : ArgumentError(context, "Transform.ToTransform", "a nativemath.Transform as this");
+}
+
+QScriptValue Transform_toString(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    Transform *This = Types(context)->transformClass->Value(context->thisObject());
+    return This ? QScriptValue(This->ToString()) : QScriptValue("nativemath.Transform");
+}
+
+// Bulk access to entity transforms
+
+/// Returns the transform attribute of the EC_Placeable of the entity in the given variant, or null.
+Attribute<Transform> *PlaceableTransform(const QVariant &value)
+{
+    Entity *entity = qobject_cast<Entity *>(value.value<QObject *>());
+    if (!entity)
+        return 0;
+    ComponentPtr placeable = entity->GetComponent("EC_Placeable");
+    return placeable ? dynamic_cast<Attribute<Transform> *>(placeable->GetAttribute("Transform")) : 0;
+}
+
+AttributeChange::Type ChangeArgument(QScriptContext *context, int index)
+{
+    return context->argumentCount() > index ? static_cast<AttributeChange::Type>(context->argument(index).toInt32()) : AttributeChange::Default;
+}
+
+/// Appends floats to a packed number list.
+void WriteFloats(QVariantList &list, const float *values, int count)
+{
+    for(int i = 0; i < count; ++i)
+        list.append((double)values[i]);
+}
+
+/// Reads consecutive floats from a packed number list starting at the given index.
+void ReadFloats(const QVariantList &list, int index, float *values, int count)
+{
+    for(int i = 0; i < count; ++i)
+        values[i] = (float)list[index + i].toDouble();
+}
+
+// The script arrays are converted to and from QVariantList in one pass, instead of a script property access per element.
+
+QScriptValue nativemath_GetPositions(QScriptContext *context, QScriptEngine *engine)
+{
+    if (!context->argument(0).isArray())
+        return ArgumentError(context, "GetPositions", "an array of entities");
+    const QVariantList entities = qscriptvalue_cast<QVariantList>(context->argument(0));
+    QVariantList result;
+    result.reserve(entities.size() * 3);
+    foreach(const QVariant &entity, entities)
+    {
+        Attribute<Transform> *transform = PlaceableTransform(entity);
+        WriteFloats(result, (transform ? transform->Get().pos : float3::nan).ptr(), 3);
+    }
+    return engine->toScriptValue(result);
+}
+
+QScriptValue nativemath_SetPositions(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    if (!context->argument(0).isArray() || !context->argument(1).isArray())
+        return ArgumentError(context, "SetPositions", "an array of entities and an array of positions");
+    const QVariantList entities = qscriptvalue_cast<QVariantList>(context->argument(0));
+    const QVariantList positions = qscriptvalue_cast<QVariantList>(context->argument(1));
+    const int numEntities = qMin(entities.size(), positions.size() / 3);
+    const AttributeChange::Type change = ChangeArgument(context, 2);
+    for(int i = 0; i < numEntities; ++i)
+    {
+        Attribute<Transform> *transform = PlaceableTransform(entities[i]);
+        if (!transform)
+            continue;
+        Transform t = transform->Get();
+        ReadFloats(positions, i * 3, t.pos.ptr(), 3);
+        transform->Set(t, change);
+    }
+    return QScriptValue();
+}
+
+QScriptValue nativemath_GetTransforms(QScriptContext *context, QScriptEngine *engine)
+{
+    if (!context->argument(0).isArray())
+        return ArgumentError(context, "GetTransforms", "an array of entities");
+    const QVariantList entities = qscriptvalue_cast<QVariantList>(context->argument(0));
+    QVariantList result;
+    result.reserve(entities.size() * 9);
+    foreach(const QVariant &entity, entities)
+    {
+        Attribute<Transform> *transform = PlaceableTransform(entity);
+        const Transform t = transform ? transform->Get() : Transform(float3::nan, float3::nan, float3::nan);
+        WriteFloats(result, t.pos.ptr(), 3);
+        WriteFloats(result, t.rot.ptr(), 3);
+        WriteFloats(result, t.scale.ptr(), 3);
+    }
+    return engine->toScriptValue(result);
+}
+
+QScriptValue nativemath_SetTransforms(QScriptContext *context, QScriptEngine * /*engine*/)
+{
+    if (!context->argument(0).isArray() || !context->argument(1).isArray())
+        return ArgumentError(context, "SetTransforms", "an array of entities and an array of transforms");
+    const QVariantList entities = qscriptvalue_cast<QVariantList>(context->argument(0));
+    const QVariantList transforms = qscriptvalue_cast<QVariantList>(context->argument(1));
+    const int numEntities = qMin(entities.size(), transforms.size() / 9);
+    const AttributeChange::Type change = ChangeArgument(context, 2);
+    for(int i = 0; i < numEntities; ++i)
+    {
+        Attribute<Transform> *transform = PlaceableTransform(entities[i]);
+        if (!transform)
+            continue;
+        Transform t;
+        ReadFloats(transforms, i * 9, t.pos.ptr(), 3);
+        ReadFloats(transforms, i * 9 + 3, t.rot.ptr(), 3);
+        ReadFloats(transforms, i * 9 + 6, t.scale.ptr(), 3);
+        transform->Set(t, change);
+    }
+    return QScriptValue();
+}
+
+void SetFunction(QScriptValue object, const char *name, QScriptEngine::FunctionSignature function, int numArgs, const QScriptValue &data)
+{
+    QScriptValue f = object.engine()->newFunction(function, numArgs);
+    f.setData(data);
+    object.setProperty(name, f, QScriptValue::Undeletable | QScriptValue::ReadOnly);
+}
+
+} // ~unnamed namespace
+
+void ExposeNativeMathTypes(QScriptEngine *engine)
+{
+    NativeMathTypes *types = new NativeMathTypes(engine);
+    QScriptValue data = engine->newQObject(types);
+
+    QScriptValue float3Proto = engine->newObject();
+    SetFunction(float3Proto, "Set", float3_Set, 3, data);
+    SetFunction(float3Proto, "Add", float3_InPlace<AddOp>, 1, data);
+    SetFunction(float3Proto, "Sub", float3_InPlace<SubOp>, 1, data);
+    SetFunction(float3Proto, "Cross", float3_InPlace<CrossOp>, 1, data);
+    SetFunction(float3Proto, "Mul", float3_Mul, 1, data);
+    SetFunction(float3Proto, "Div", float3_Div, 1, data);
+    SetFunction(float3Proto, "AddScaled", float3_AddScaled, 2, data);
+    SetFunction(float3Proto, "Lerp", float3_Lerp, 2, data);
+    SetFunction(float3Proto, "Negate", float3_Negate, 0, data);
+    SetFunction(float3Proto, "Normalize", float3_Normalize, 0, data);
+    SetFunction(float3Proto, "ScaleToLength", float3_ScaleToLength, 1, data);
+    SetFunction(float3Proto, "Dot", float3_Scalar<DotOp>, 1, data);
+    SetFunction(float3Proto, "Distance", float3_Scalar<DistanceOp>, 1, data);
+    SetFunction(float3Proto, "DistanceSq", float3_Scalar<DistanceSqOp>, 1, data);
+    SetFunction(float3Proto, "Length", float3_Length, 0, data);
+    SetFunction(float3Proto, "LengthSq", float3_LengthSq, 0, data);
+    SetFunction(float3Proto, "Clone", float3_Clone, 0, data);
+    SetFunction(float3Proto, "ToFloat3", float3_ToFloat3, 0, data);
+    SetFunction(float3Proto, "toString", float3_toString, 0, data);
+    types->float3Class->proto = float3Proto;
+    for(uint i = 0; i < 3; ++i)
+        types->float3ViewClasses[i]->proto = float3Proto;
+
+    QScriptValue quatProto = engine->newObject();
+    SetFunction(quatProto, "Set", Quat_Set, 4, data);
+    SetFunction(quatProto, "Mul", Quat_Mul, 1, data);
+    SetFunction(quatProto, "Slerp", Quat_Slerp, 2, data);
+    SetFunction(quatProto, "Normalize", Quat_Normalize, 0, data);
+    SetFunction(quatProto, "Inverse", Quat_Inverse, 0, data);
+    SetFunction(quatProto, "SetFromAxisAngle", Quat_SetFromAxisAngle, 2, data);
+    SetFunction(quatProto, "Transform", Quat_Transform, 1, data);
+    SetFunction(quatProto, "Clone", Quat_Clone, 0, data);
+    SetFunction(quatProto, "ToQuat", Quat_ToQuat, 0, data);
+    SetFunction(quatProto, "toString", Quat_toString, 0, data);
+    types->quatClass->proto = quatProto;
+
+    QScriptValue transformProto = engine->newObject();
+    SetFunction(transformProto, "SetPos", Transform_SetMember<0>, 3, data);
+    SetFunction(transformProto, "SetRot", Transform_SetMember<1>, 3, data);
+    SetFunction(transformProto, "SetScale", Transform_SetMember<2>, 3, data);
+    SetFunction(transformProto, "GetPos", Transform_GetMember<0>, 1, data);
+    SetFunction(transformProto, "GetRot", Transform_GetMember<1>, 1, data);
+    SetFunction(transformProto, "GetScale", Transform_GetMember<2>, 1, data);
+    SetFunction(transformProto, "Translate", Transform_Translate, 1, data);
+    SetFunction(transformProto, "SetOrientation", Transform_SetOrientation, 1, data);
+    SetFunction(transformProto, "GetOrientation", Transform_GetOrientation, 1, data);
+    SetFunction(transformProto, "TransformPoint", Transform_TransformPoint, 1, data);
+    SetFunction(transformProto, "Clone", Transform_Clone, 0, data);
+    SetFunction(transformProto, "ToTransform", Transform_ToTransform, 0, data);
+    SetFunction(transformProto, "toString", Transform_toString, 0, data);
+    types->transformClass->proto = transformProto;
+
+    QScriptValue nativeMath = engine->newObject();
+    SetFunction(nativeMath, "float3", float3_ctor, 3, data);
+    SetFunction(nativeMath, "Quat", Quat_ctor, 4, data);
+    SetFunction(nativeMath, "Transform", Transform_ctor, 3, data);
+    SetFunction(nativeMath, "GetPositions", nativemath_GetPositions, 1, data);
+    SetFunction(nativeMath, "SetPositions", nativemath_SetPositions, 3, data);
+    SetFunction(nativeMath, "GetTransforms", nativemath_GetTransforms, 1, data);
+    SetFunction(nativeMath, "SetTransforms", nativemath_SetTransforms, 3, data);
+    engine->globalObject().setProperty("nativemath", nativeMath, QScriptValue::Undeletable | QScriptValue::ReadOnly);
+}
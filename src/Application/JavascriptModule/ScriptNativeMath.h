@@ -0,0 +1,37 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   ScriptNativeMath.h
+    @brief  Natively stored float3, Quat and Transform script types with in-place operations, and bulk transform access. */
+
+#pragma once
+
+class QScriptEngine;
+
+/// Exposes the "nativemath" namespace object to the given script engine.
+/** The math types exposed by the generated bindings (float3, Quat, Transform etc.) are plain script objects whose members
+    are copied to and from the native value on every function call, so each operation creates a new script object.
+    The nativemath types store their value natively in a QScriptClass-backed object, and their operations modify
+    the object in place and return it, so that e.g. a steering loop does not allocate at all:
+
+        var vel = new nativemath.float3(0, 0, 0);
+        var dir = new nativemath.float3(0, 0, 0);
+        ...
+        vel.AddScaled(dir.Set(target).Sub(pos).Normalize(), accel * dt);
+
+    The constructors are nativemath.float3(), nativemath.Quat() and nativemath.Transform(). They accept either the
+    component values or any object that has the corresponding members, e.g. a float3 of the generated bindings.
+    The native objects can be passed to functions that take the generated types, and they are converted back with
+    ToFloat3(), ToQuat() and ToTransform().
+
+    The pos, rot and scale properties of a nativemath.Transform are float3 views of the Transform rather than copies,
+    so e.g. t.pos.x = 5 and t.pos.Add(v) modify the Transform in place. Use Clone() to get an independent copy.
+
+    The bulk functions read and write the EC_Placeable transforms of whole entity lists in packed number arrays:
+    - nativemath.GetPositions(entities) returns [x0, y0, z0, x1, y1, z1, ...].
+    - nativemath.SetPositions(entities, positions [, change]).
+    - nativemath.GetTransforms(entities) returns 9 numbers per entity: position, rotation (Euler degrees) and scale.
+    - nativemath.SetTransforms(entities, transforms [, change]).
+    The values of entities that have no EC_Placeable are NaN when reading and skipped when writing. The arrays are
+    converted to and from native lists in one pass, so pass plain arrays of numbers rather than objects. */
+void ExposeNativeMathTypes(QScriptEngine *engine);
@@ -1,110 +0,0 @@
-/* from https://github.com/icefox/qscriptprofiler.git */
-
-/*
-* Copyright (C) 2007 Benjamin C Meyer
-* All rights reserved.
-*
-* Redistribution and use in source and binary forms, with or without
-* modification, are permitted provided that the following conditions are met:
-*     * Redistributions of source code must retain the above copyright
-*       notice, this list of conditions and the following disclaimer.
-*     * Redistributions in binary form must reproduce the above copyright
-*       notice, this list of conditions and the following disclaimer in the
-*       documentation and/or other materials provided with the distribution.
-*     * The name of the contributors may not be used to endorse or promote products
-*       derived from this software without specific prior written permission.
-*
-* THIS SOFTWARE IS PROVIDED BY <copyright holder> ``AS IS'' AND ANY
-* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
-* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
-* DISCLAIMED. IN NO EVENT SHALL <copyright holder> BE LIABLE FOR ANY
-* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
-* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
-* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
-* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
-* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
-* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-*/
-
-#ifndef JSPROFILER_H
-#define JSPROFILER_H
-
-#ifndef _WINDOWS
-
-#include <QtScript>
-
-/** @cond PRIVATE */
-namespace jsprofiler {
-
-class Action {
-public:
-    Action(int lineNumber = 0) : line(lineNumber), cost(0), called(0), callObject(-1){}
-    inline bool operator <(const Action &other) const {
-        if (other.line == line)
-            return other.callFunction < callFunction;
-        return other.line < line;
-    }
-    
-    int line;
-    uint cost;
-
-    uint called;
-    uint callObject;
-    QString callFunction;
-    uint callFunctionLine;
-};
-
-class Function {
-public:
-    Function(int line = -1) : startLine(line){}
-    inline bool operator <(const Function &other) const {
-        return other.startLine < startLine;
-    }
-    QString functionName;
-    int startLine;
-    QList<Action> actions;
-};
-
-class Object {
-public:
-    QStringList code;
-    QString fileName;
-    QList<Function> functions;
-};
-
-class Profiler : public QScriptEngineAgent
-{
-public:
-    Profiler(QScriptEngine *engine);
-    ~Profiler();
-
-    void positionChange(qint64 scriptId, int lineNumber, int columnNumber);
-    void scriptLoad (qint64 id, const QString &program, const QString &fileName, int baseLineNumber);
-    void functionEntry(qint64 scriptId);
-    void functionExit(qint64 scriptId, const QScriptValue &returnValue);
-
-private:
-    Function *determineCurrentFunction(qint64 scriptId);
-    Function *currentFunctionCache;
-    int scriptIdCache;
-    void positionDone();
-    QString functionName(QScriptContext *ctx, qint64 scriptId) const;
-
-    QStack<int> currentFunctionLine;
-    QStack<int> currentLine;
-    QStack<int> currentScriptId;
-    
-    bool first;
-
-    QStack<Action *>currentFunction;
-    QHash<int, Object> objects;
-    suseconds_t instTime;
-    suseconds_t funTime;
-};
-
-}
-/** @endcond */
-
-#endif // _WINDOWS
-
-#endif
@@ -0,0 +1,511 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "ImportedScene.h"
+#include "Profiler.h"
+
+#include "assimp/Importer.hpp"
+#include "assimp/postprocess.h"
+
+#include <OgreVector3.h>
+
+#include <QFile>
+#include <QDataStream>
+
+namespace
+{
+const quint32 cMaterialsFileMagic = 0x4D414941; // "AIAM"
+const quint32 cMaterialsFileVersion = 1;
+
+double DegreeToRadian(double degree)
+{
+    return degree * (Ogre::Math::PI/180);
+}
+
+QDataStream &operator <<(QDataStream &s, const Ogre::ColourValue &c)
+{
+    return s << c.r << c.g << c.b << c.a;
+}
+
+QDataStream &operator >>(QDataStream &s, Ogre::ColourValue &c)
+{
+    return s >> c.r >> c.g >> c.b >> c.a;
+}
+
+/// Bakes the bind pose of the animated meshes into their vertices.
+void GetBasePose(const aiScene *sc, const aiNode *nd)
+{
+    for(unsigned int n = 0; n < nd->mNumMeshes; ++n)
+    {
+        const aiMesh *mesh = sc->mMeshes[nd->mMeshes[n]];
+
+        // Fill boneMatrices with the current bone locations.
+        std::vector<aiMatrix4x4> boneMatrices(mesh->mNumBones);
+        for(size_t a = 0; a < mesh->mNumBones; ++a)
+        {
+            aiBone *bone = mesh->mBones[a];
+            // Start with the mesh-to-bone matrix, and append all node transformations down the parent chain until we're back at mesh coordinates.
+            boneMatrices[a] = bone->mOffsetMatrix;
+            for(const aiNode *tempNode = sc->mRootNode->FindNode(bone->mName); tempNode; tempNode = tempNode->mParent)
+                boneMatrices[a] = tempNode->mTransformation * boneMatrices[a];
+        }
+
+        std::vector<aiVector3D> resultPos(mesh->mNumVertices);
+        std::vector<aiVector3D> resultNorm(mesh->mNumVertices);
+
+        // Loop through all vertex weights of all bones.
+        for(size_t a = 0; a < mesh->mNumBones; ++a)
+        {
+            const aiBone *bone = mesh->mBones[a];
+            const aiMatrix4x4 &posTrafo = boneMatrices[a];
+            // The bone matrix without the translation, only with rotation and possibly scaling.
+            aiMatrix3x3 normTrafo = aiMatrix3x3(posTrafo);
+            for(size_t b = 0; b < bone->mNumWeights; ++b)
+            {
+                const aiVertexWeight &weight = bone->mWeights[b];
+                size_t vertexId = weight.mVertexId;
+                resultPos[vertexId] += (posTrafo * mesh->mVertices[vertexId]) * weight.mWeight;
+                resultNorm[vertexId] += (normTrafo * mesh->mNormals[vertexId]) * weight.mWeight;
+            }
+        }
+
+        for(unsigned int t = 0; t < mesh->mNumFaces; ++t)
+        {
+            const aiFace *face = &mesh->mFaces[t];
+            for(unsigned int i = 0; i < face->mNumIndices; ++i)
+            {
+                int vertexIndex = face->mIndices[i];
+                mesh->mNormals[vertexIndex] = resultNorm[vertexIndex];
+                mesh->mVertices[vertexIndex] = resultPos[vertexIndex];
+            }
+        }
+    }
+
+    for(unsigned int n = 0; n < nd->mNumChildren; ++n)
+        GetBasePose(sc, nd->mChildren[n]);
+}
+
+}
+
+void ImportedSubMesh::ReleaseBuffers()
+{
+    std::vector<float>().swap(positionsNormals);
+    std::vector<float>().swap(texCoords);
+    std::vector<Ogre::ColourValue>().swap(colors);
+    std::vector<u16>().swap(indices);
+    std::vector<ImportedBoneWeight>().swap(boneWeights);
+}
+
+ImportedScene::ImportedScene() :
+    scene(0),
+    hasBones(false)
+{
+}
+
+ImportedScene::~ImportedScene()
+{
+    ReleaseScene();
+}
+
+void ImportedScene::ReleaseScene()
+{
+    scene = 0;
+    importer.reset();
+    boneMap.clear();
+    bonesByName.clear();
+    nodeDerivedTransformByName.clear();
+}
+
+bool ImportedScene::Import(const std::vector<u8> &data, const QString &fileName, const QString &diskSource)
+{
+    PROFILE(ImportedScene_Import);
+
+    importer = boost::shared_ptr<Assimp::Importer>(new Assimp::Importer());
+
+    /// NOTICE!!!
+    // Some converted mesh might show up pretty messed up, it's happening because some formats might
+    // contain unnecessary vertex information, lines and points. Uncomment the line below for fixing this issue.
+    // by default remove points and lines from the model, since these are usually
+    // degenerate structures from bad modelling or bad import/export.  if they
+    // are needed it can be turned on with IncludeLinesPoints
+    importer->SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
+    /// END OF NOTICE
+
+    // Limit triangles because for each mesh there's limited index memory (16bit)
+    importer->SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, 21845);
+
+    unsigned int pFlags = 0
+                          | aiProcess_SplitLargeMeshes
+                          | aiProcess_FindInvalidData
+                          | aiProcess_GenSmoothNormals
+                          | aiProcess_Triangulate
+                          | aiProcess_FlipUVs
+                          | aiProcess_JoinIdenticalVertices
+                          | aiProcess_OptimizeMeshes
+                          | aiProcess_RemoveRedundantMaterials
+                          | aiProcess_ImproveCacheLocality
+                          | aiProcess_LimitBoneWeights
+                          | aiProcess_SortByPType;
+
+#ifndef SKELETON_ENABLED
+    pFlags = pFlags | aiProcess_PreTransformVertices;
+#endif
+
+    // Assimp importer looks for a loader to support the file extension specified by hint.
+    QString hint = fileName.right(fileName.length() - fileName.lastIndexOf('.') - 1);
+    if (!data.empty())
+        scene = importer->ReadFileFromMemory(reinterpret_cast<const void*>(&data[0]), data.size(), pFlags, hint.toStdString().c_str());
+
+    if (!scene)
+    {
+        messages << "AssImp importer::convert: Failed to read file:" + fileName + " from memory: " + importer->GetErrorString();
+        messages << "AssImp importer::convert: Trying to load data from file:" + fileName;
+        // If the importer failed to read the file from memory, try to read the file again.
+        if (!diskSource.isEmpty())
+            scene = importer->ReadFile(diskSource.toStdString(), pFlags);
+        if (!scene)
+        {
+            errors << "AssImp importer::convert: conversion failed, importer unable to load data from file:" + fileName;
+            ReleaseScene();
+            return false;
+        }
+    }
+
+    if (scene->HasAnimations())
+        GetBasePose(scene, scene->mRootNode);
+
+    GrabNodeNamesFromNode(scene->mRootNode);
+
+#ifdef SKELETON_ENABLED
+    GrabBoneNamesFromNode(scene->mRootNode);
+#endif
+    hasBones = !bonesByName.empty();
+
+    aiMatrix4x4 transform;
+    transform.FromEulerAnglesXYZ(DegreeToRadian(90), 0, DegreeToRadian(180));
+    scene->mRootNode->mTransformation = transform;
+
+    ComputeNodesDerivedTransform(scene->mRootNode, transform);
+
+    materials.resize(scene->mNumMaterials);
+    for(unsigned int i = 0; i < scene->mNumMaterials; ++i)
+        ReadMaterial(scene->mMaterials[i], materials[i]);
+
+    LoadDataFromNode(scene->mRootNode);
+
+    // The scene is needed in the main thread only for creating the skeleton.
+    if (!hasBones)
+        ReleaseScene();
+    return true;
+}
+
+void ImportedScene::GrabNodeNamesFromNode(const aiNode *pNode)
+{
+    BoneNode bNode;
+    bNode.node = pNode;
+    bNode.parent = pNode->mParent;
+    bNode.isNeeded = false;
+    boneMap.insert(std::make_pair(std::string(pNode->mName.data), bNode));
+
+    messages << "Node " + QString(pNode->mName.data) + " found.";
+
+    for(unsigned int childIdx = 0; childIdx < pNode->mNumChildren; ++childIdx)
+        GrabNodeNamesFromNode(pNode->mChildren[childIdx]);
+}
+
+void ImportedScene::GrabBoneNamesFromNode(const aiNode *pNode)
+{
+    for(unsigned int idx = 0; idx < pNode->mNumMeshes; ++idx)
+    {
+        const aiMesh *pAIMesh = scene->mMeshes[pNode->mMeshes[idx]];
+        for(unsigned int i = 0; i < pAIMesh->mNumBones; ++i)
+        {
+            const aiBone *pAIBone = pAIMesh->mBones[i];
+            if (!pAIBone)
+                continue;
+
+            bonesByName[pAIBone->mName.data] = pAIBone;
+            messages << QString::number(i) + ") REAL BONE with name : " + QString(pAIBone->mName.data);
+
+            // Flag this node and all parents of this node as needed, until we reach the node holding the mesh, or the parent.
+            for(aiNode *node = scene->mRootNode->FindNode(pAIBone->mName.data); node; node = node->mParent)
+            {
+                FlagNodeAsNeeded(node->mName.data);
+                if (node->mName == pNode->mName || (pNode->mParent && node->mName == pNode->mParent->mName))
+                    break;
+            }
+
+            // Flag all children of this node as needed.
+            const aiNode *boneNode = scene->mRootNode->FindNode(pAIBone->mName.data);
+            if (boneNode)
+                MarkAllChildNodesAsNeeded(boneNode);
+        }
+    }
+
+    for(unsigned int childIdx = 0; childIdx < pNode->mNumChildren; ++childIdx)
+        GrabBoneNamesFromNode(pNode->mChildren[childIdx]);
+}
+
+void ImportedScene::ComputeNodesDerivedTransform(const aiNode *pNode, const aiMatrix4x4 &accTransform)
+{
+    if (nodeDerivedTransformByName.find(pNode->mName.data) == nodeDerivedTransformByName.end())
+        nodeDerivedTransformByName[pNode->mName.data] = accTransform;
+    for(unsigned int childIdx = 0; childIdx < pNode->mNumChildren; ++childIdx)
+    {
+        const aiNode *pChildNode = pNode->mChildren[childIdx];
+        ComputeNodesDerivedTransform(pChildNode, accTransform * pChildNode->mTransformation);
+    }
+}
+
+void ImportedScene::MarkAllChildNodesAsNeeded(const aiNode *pNode)
+{
+    FlagNodeAsNeeded(pNode->mName.data);
+    for(unsigned int childIdx = 0; childIdx < pNode->mNumChildren; ++childIdx)
+        MarkAllChildNodesAsNeeded(pNode->mChildren[childIdx]);
+}
+
+void ImportedScene::FlagNodeAsNeeded(const char *name)
+{
+    std::map<std::string, BoneNode>::iterator iter = boneMap.find(name);
+    if (iter != boneMap.end())
+        iter->second.isNeeded = true;
+}
+
+bool ImportedScene::IsNodeNeeded(const char *name) const
+{
+    std::map<std::string, BoneNode>::const_iterator iter = boneMap.find(name);
+    return iter != boneMap.end() && iter->second.isNeeded;
+}
+
+void ImportedScene::ReadMaterial(const aiMaterial *mat, ImportedMaterial &material)
+{
+    aiString path;
+    const bool hasTexture = mat->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS;
+
+    // ambient
+    aiColor4D clr(1.0f, 1.0f, 1.0f, 1.0f);
+    //Ambient is usually way too low! FIX ME!
+    if (!hasTexture)
+        aiGetMaterialColor(mat, AI_MATKEY_COLOR_AMBIENT, &clr);
+    material.ambient = Ogre::ColourValue(clr.r, clr.g, clr.b);
+
+    clr = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+    material.hasDiffuse = aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &clr) == AI_SUCCESS;
+    material.diffuse = Ogre::ColourValue(clr.r, clr.g, clr.b, clr.a);
+
+    clr = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+    material.hasSpecular = aiGetMaterialColor(mat, AI_MATKEY_COLOR_SPECULAR, &clr) == AI_SUCCESS;
+    material.specular = Ogre::ColourValue(clr.r, clr.g, clr.b, clr.a);
+
+    clr = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+    material.hasEmissive = aiGetMaterialColor(mat, AI_MATKEY_COLOR_EMISSIVE, &clr) == AI_SUCCESS;
+    material.emissive = Ogre::ColourValue(clr.r, clr.g, clr.b);
+
+    material.hasShininess = aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &material.shininess) == AI_SUCCESS;
+
+    int twoSided = 0;
+    aiGetMaterialInteger(mat, AI_MATKEY_TWOSIDED, &twoSided);
+    material.twoSided = twoSided != 0;
+
+    // Textures embedded in the scene are not supported, only textures in external files.
+    if (hasTexture && !scene->HasTextures())
+    {
+        material.texture = QString::fromStdString(path.data);
+        messages << "Texture " + material.texture + " for channel 0";
+    }
+}
+
+void ImportedScene::LoadDataFromNode(const aiNode *pNode)
+{
+    for(unsigned int idx = 0; idx < pNode->mNumMeshes; ++idx)
+    {
+        const aiMesh *pAIMesh = scene->mMeshes[pNode->mMeshes[idx]];
+        messages << "SubMesh " + QString::number(idx) + " for mesh '" + QString(pNode->mName.data) + "'";
+
+        // If animated, all submeshes must have bone weights.
+        if (hasBones && !pAIMesh->HasBones())
+        {
+            messages << "Skipping Mesh " + QString(pAIMesh->mName.data) + " with no bone weights";
+            continue;
+        }
+
+        subMeshes.push_back(ImportedSubMesh());
+        ImportedSubMesh &subMesh = subMeshes.back();
+        subMesh.name = std::string(pNode->mName.data) + QString::number(idx).toStdString();
+        subMesh.material = pAIMesh->mMaterialIndex;
+        subMesh.vertexColors = pAIMesh->HasVertexColors(0);
+        CreateVertexData(pNode, pAIMesh, subMesh);
+    }
+
+    for(unsigned int childIdx = 0; childIdx < pNode->mNumChildren; ++childIdx)
+        LoadDataFromNode(pNode->mChildren[childIdx]);
+}
+
+void ImportedScene::CreateVertexData(const aiNode *pNode, const aiMesh *mesh, ImportedSubMesh &subMesh)
+{
+    const uint numVertices = mesh->mNumVertices;
+    subMesh.numVertices = numVertices;
+
+    // Positions and normals, transformed to the scene root.
+    const aiMatrix4x4 &aiM = nodeDerivedTransformByName[pNode->mName.data];
+    subMesh.positionsNormals.resize(numVertices * 6, 0.f);
+    float *dst = subMesh.positionsNormals.empty() ? 0 : &subMesh.positionsNormals[0];
+    for(uint n = 0; n < numVertices; ++n, dst += 6)
+    {
+        if (mesh->mVertices)
+        {
+            aiVector3D vect = mesh->mVertices[n];
+            vect *= aiM;
+            dst[0] = vect.x;
+            dst[1] = vect.y;
+            dst[2] = vect.z;
+            bounds.merge(Ogre::Vector3(vect.x, vect.y, vect.z));
+        }
+        if (mesh->mNormals)
+        {
+            aiVector3D vect = mesh->mNormals[n];
+            vect *= aiM;
+            dst[3] = vect.x;
+            dst[4] = vect.y;
+            dst[5] = vect.z;
+        }
+    }
+
+    // Texture coordinates, tangents and binormals.
+    size_t texCoordStride = 0;
+    subMesh.uvComponents.resize(AI_MAX_NUMBER_OF_TEXTURECOORDS, 0);
+    for(int tn = 0; tn < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++tn)
+        if (mesh->mTextureCoords[tn])
+        {
+            subMesh.uvComponents[tn] = (mesh->mNumUVComponents[tn] == 3 ? 3 : 2);
+            texCoordStride += subMesh.uvComponents[tn];
+        }
+    subMesh.tangents = mesh->HasTangentsAndBitangents();
+    if (subMesh.tangents)
+        texCoordStride += 6;
+
+    if (texCoordStride > 0)
+    {
+        subMesh.texCoords.resize(numVertices * texCoordStride);
+        dst = subMesh.texCoords.empty() ? 0 : &subMesh.texCoords[0];
+        for(uint n = 0; n < numVertices; ++n)
+        {
+            for(int tn = 0; tn < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++tn)
+                for(int c = 0; c < subMesh.uvComponents[tn]; ++c)
+                    *dst++ = mesh->mTextureCoords[tn][n][c];
+            if (subMesh.tangents)
+            {
+                *dst++ = mesh->mTangents[n].x;
+                *dst++ = mesh->mTangents[n].y;
+                *dst++ = mesh->mTangents[n].z;
+                *dst++ = mesh->mBitangents[n].x;
+                *dst++ = mesh->mBitangents[n].y;
+                *dst++ = mesh->mBitangents[n].z;
+            }
+        }
+    }
+
+    // Vertex colors of the first color set. They are converted to the vertex color format of the render system in the main thread.
+    if (mesh->HasVertexColors(0))
+    {
+        subMesh.colors.resize(numVertices);
+        for(uint n = 0; n < numVertices; ++n)
+        {
+            const aiColor4D &c = mesh->mColors[0][n];
+            subMesh.colors[n] = Ogre::ColourValue(c.r, c.g, c.b, c.a);
+        }
+    }
+
+    // Only triangles are supported, so 3 indices per face.
+    subMesh.indices.resize(mesh->mNumFaces * 3);
+    for(unsigned int n = 0; n < mesh->mNumFaces; ++n)
+    {
+        subMesh.indices[n*3] = (u16)mesh->mFaces[n].mIndices[0];
+        subMesh.indices[n*3+1] = (u16)mesh->mFaces[n].mIndices[1];
+        subMesh.indices[n*3+2] = (u16)mesh->mFaces[n].mIndices[2];
+    }
+
+    // Bone weights, resolved to the bones of the skeleton in the main thread.
+    for(unsigned int i = 0; i < mesh->mNumBones; ++i)
+    {
+        const aiBone *pAIBone = mesh->mBones[i];
+        if (!pAIBone)
+            continue;
+        for(unsigned int weightIdx = 0; weightIdx < pAIBone->mNumWeights; ++weightIdx)
+        {
+            ImportedBoneWeight weight;
+            weight.bone = pAIBone->mName.data;
+            weight.vertex = pAIBone->mWeights[weightIdx].mVertexId;
+            weight.weight = pAIBone->mWeights[weightIdx].mWeight;
+            subMesh.boneWeights.push_back(weight);
+        }
+    }
+}
+
+bool ImportedScene::SaveMaterials(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream s(&file);
+    s << cMaterialsFileMagic << cMaterialsFileVersion;
+    s << (quint32)materials.size();
+    for(size_t i = 0; i < materials.size(); ++i)
+    {
+        const ImportedMaterial &m = materials[i];
+        s << m.ambient << m.diffuse << m.specular << m.emissive;
+        s << m.hasDiffuse << m.hasSpecular << m.hasEmissive << m.hasShininess << m.shininess << m.twoSided << m.texture;
+    }
+    s << (quint32)subMeshes.size();
+    for(size_t i = 0; i < subMeshes.size(); ++i)
+        s << (qint32)subMeshes[i].material << subMeshes[i].vertexColors;
+    return s.status() == QDataStream::Ok;
+}
+
+bool ImportedScene::LoadMaterials(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream s(&file);
+    quint32 magic = 0, version = 0, numMaterials = 0, numSubMeshes = 0;
+    s >> magic >> version;
+    if (magic != cMaterialsFileMagic || version != cMaterialsFileVersion)
+        return false;
+
+    s >> numMaterials;
+    if (s.status() != QDataStream::Ok || numMaterials > (quint32)file.size())
+        return false;
+    materials.resize(numMaterials);
+    for(size_t i = 0; i < materials.size(); ++i)
+    {
+        ImportedMaterial &m = materials[i];
+        s >> m.ambient >> m.diffuse >> m.specular >> m.emissive;
+        s >> m.hasDiffuse >> m.hasSpecular >> m.hasEmissive >> m.hasShininess >> m.shininess >> m.twoSided >> m.texture;
+    }
+
+    s >> numSubMeshes;
+    if (s.status() != QDataStream::Ok || numSubMeshes > (quint32)file.size())
+    {
+        materials.clear();
+        return false;
+    }
+    subMeshes.resize(numSubMeshes);
+    for(size_t i = 0; i < subMeshes.size(); ++i)
+    {
+        qint32 material = 0;
+        s >> material >> subMeshes[i].vertexColors;
+        subMeshes[i].material = material;
+        if (material < 0 || material >= (qint32)materials.size())
+            s.setStatus(QDataStream::ReadCorruptData);
+    }
+
+    if (s.status() != QDataStream::Ok)
+    {
+        materials.clear();
+        subMeshes.clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,135 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <OgreColourValue.h>
+#include <OgreAxisAlignedBox.h>
+
+#include <assimp/scene.h>
+
+#include <QString>
+#include <QStringList>
+
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+//#define SKELETON_ENABLED
+
+namespace Assimp { class Importer; }
+
+/// Material of an imported mesh, as read from the Assimp scene.
+struct ImportedMaterial
+{
+    ImportedMaterial() : hasDiffuse(false), hasSpecular(false), hasEmissive(false), hasShininess(false), shininess(0.f), twoSided(false) {}
+
+    Ogre::ColourValue ambient;
+    Ogre::ColourValue diffuse;
+    Ogre::ColourValue specular;
+    Ogre::ColourValue emissive;
+    bool hasDiffuse;
+    bool hasSpecular;
+    bool hasEmissive;
+    bool hasShininess;
+    float shininess;
+    bool twoSided;
+    QString texture; ///< Diffuse texture path as written in the source file, or empty if the material has no external texture.
+};
+
+/// Weight of a bone on a vertex of an imported submesh.
+struct ImportedBoneWeight
+{
+    std::string bone;
+    uint vertex;
+    float weight;
+};
+
+/// Geometry of an imported submesh, laid out in the vertex buffers of the Ogre submesh.
+struct ImportedSubMesh
+{
+    ImportedSubMesh() : material(0), vertexColors(false), numVertices(0), tangents(false) {}
+
+    /// Frees the vertex and index data once they have been copied to the hardware buffers, keeping the material assignment.
+    void ReleaseBuffers();
+
+    std::string name;
+    int material; ///< Index of the material in ImportedScene::materials.
+    bool vertexColors; ///< Is the submesh drawn with the vertex color material instead of its own material.
+    uint numVertices;
+    std::vector<float> positionsNormals; ///< Vertex buffer 0: position and normal of each vertex.
+    std::vector<int> uvComponents; ///< Number of components of each texture coordinate set, 0 if the set does not exist.
+    bool tangents; ///< Does vertex buffer 1 contain tangents and binormals.
+    std::vector<float> texCoords; ///< Vertex buffer 1: texture coordinates, tangents and binormals of each vertex, empty if none.
+    std::vector<Ogre::ColourValue> colors; ///< Vertex buffer 2: color of each vertex, empty if none.
+    std::vector<u16> indices; ///< Triangle list.
+    std::vector<ImportedBoneWeight> boneWeights;
+};
+
+/// A mesh imported with Assimp into plain buffers that are ready to be copied to Ogre hardware buffers.
+/** Import() runs the Assimp import, the bone hierarchy analysis and the vertex conversion without touching Ogre's
+    resource managers, so that it can be run in a worker thread. OpenAssetImport then creates the Ogre mesh, its
+    buffers and its materials from the buffers in the main thread.
+
+    The materials and the submesh material assignments can be saved next to a converted .mesh file, so that
+    the mesh can later be loaded from the .mesh file without importing the source file again. */
+class ImportedScene
+{
+public:
+    ImportedScene();
+    ~ImportedScene();
+
+    /// Imports a mesh file.
+    /** @param fileName Name of the asset, the file suffix is used to choose the Assimp importer.
+        @param diskSource Disk source of the asset, read if Assimp cannot import the file from memory.
+        @return False if the file could not be imported, in which case the reason is in errors. */
+    bool Import(const std::vector<u8> &data, const QString &fileName, const QString &diskSource);
+
+    /// Saves the materials and the submesh material assignments to a file.
+    bool SaveMaterials(const QString &fileName) const;
+
+    /// Loads the materials and the submesh material assignments from a file written by SaveMaterials.
+    /** The submeshes get no geometry, only their material assignments. */
+    bool LoadMaterials(const QString &fileName);
+
+    /// Returns whether a node of the scene is needed for the skeleton.
+    bool IsNodeNeeded(const char *name) const;
+
+    /// Returns the Assimp scene, which is kept after Import() only when the skeleton needs to be created from it.
+    const aiScene *Scene() const { return scene; }
+
+    /// Releases the Assimp scene.
+    void ReleaseScene();
+
+    std::vector<ImportedMaterial> materials;
+    std::vector<ImportedSubMesh> subMeshes;
+    Ogre::AxisAlignedBox bounds;
+    bool hasBones; ///< Do the submeshes have bone weights.
+    QStringList messages; ///< Messages of the import, to be logged in the main thread.
+    QStringList errors; ///< Errors of the import, to be logged in the main thread.
+
+private:
+    struct BoneNode
+    {
+        const aiNode *node;
+        const aiNode *parent;
+        bool isNeeded;
+    };
+
+    void GrabNodeNamesFromNode(const aiNode *pNode);
+    void GrabBoneNamesFromNode(const aiNode *pNode);
+    void ComputeNodesDerivedTransform(const aiNode *pNode, const aiMatrix4x4 &accTransform);
+    void MarkAllChildNodesAsNeeded(const aiNode *pNode);
+    void FlagNodeAsNeeded(const char *name);
+    void LoadDataFromNode(const aiNode *pNode);
+    void CreateVertexData(const aiNode *pNode, const aiMesh *mesh, ImportedSubMesh &subMesh);
+    void ReadMaterial(const aiMaterial *mat, ImportedMaterial &material);
+
+    boost::shared_ptr<Assimp::Importer> importer;
+    const aiScene *scene;
+    std::map<std::string, BoneNode> boneMap;
+    std::map<std::string, const aiBone *> bonesByName;
+    std::map<std::string, aiMatrix4x4> nodeDerivedTransformByName;
+};
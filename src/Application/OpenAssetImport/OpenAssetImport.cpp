@@ -9,8 +9,10 @@ Licensed under the MIT license:
 #include "Framework.h"
 #include "OgreMaterialAsset.h"
 #include "LoggingFunctions.h"
+#include "Profiler.h"
+#include "TaskAPI.h"
+#include "AssetCache.h"
 #include "OpenAssetImport.h"
-#include "assimp/DefaultLogger.hpp"
 #include "assimp/Importer.hpp"
 #include "OgreDataStream.h"
 #include "OgreImage.h"
@@ -40,27 +42,64 @@ Licensed under the MIT license:
 #include <QString>
 #include <QStringList>
 #include <QObject>
+#include <QFile>
+#include <QCryptographicHash>
 #include <boost/tuple/tuple.hpp>
+#include <boost/bind.hpp>
 
-//#define SKELETON_ENABLED
+/// Bump when the conversion changes, so that the conversions cached by older versions are not used.
+static const char *cConversionCacheVersion = "OpenAssetImport/1";
+
+struct OpenAssetImport::ConversionJob
+{
+    ConversionJob() : owner(0), fromCache(false), success(false) {}
+
+    OpenAssetImport *owner; ///< Importer to finish the conversion, or null if it has been deleted. Accessed only in the main thread.
+    std::vector<u8> data; ///< Source file data.
+    QString fileName;
+    QString diskSource;
+    Ogre::MeshPtr mesh;
+    QString cacheDirectory; ///< Asset cache directory, or empty if the conversions are not cached.
+    QString cachePath; ///< Path of the cached conversion without the file suffix.
+    bool fromCache; ///< Was the conversion found in the cache.
+    std::vector<u8> cachedMesh; ///< Contents of the cached .mesh file.
+    ImportedScene scene;
+    bool success;
+};
 
 OpenAssetImport::OpenAssetImport(AssetAPI *assetApi):
-assetAPI(assetApi), meshCreated(false), texCount(0)
+assetAPI(assetApi), meshCreated(false), mTicksPerSecond(1), mAnimationSpeedModifier(1.0f)
 {
 }
 
 OpenAssetImport::~OpenAssetImport()
 {
+    // The conversion tasks may still be running, make the job forget us.
+    if (job)
+        job->owner = 0;
 }
 
 
 int OpenAssetImport::msBoneCount = 0;
 
-double degreeToRadian(double degree)
+/// Reads a whole file without logging, as this is called in worker threads.
+static bool ReadCacheFile(const QString &fileName, std::vector<u8> &dst)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0)
+        return false;
+    dst.resize((size_t)file.size());
+    return file.read((char*)&dst[0], file.size()) == file.size();
+}
+
+/// Replaces a cache file with a fully written temporary file, so that readers in other threads never see a partial file.
+static bool ReplaceCacheFile(const QString &tempFileName, const QString &fileName)
 {
-    double radian = 0;
-    radian = degree * (Ogre::Math::PI/180);
-    return radian;
+    QFile::remove(fileName);
+    if (QFile::rename(tempFileName, fileName))
+        return true;
+    QFile::remove(tempFileName);
+    return false;
 }
 
 /**************************************************************************
@@ -323,267 +362,268 @@ aiMatrix4x4 UpdateAnimationFunc(const aiScene * scene, aiNodeAnim * pchannel, Og
     return mat;
 }
 
-void GetBasePose(const aiScene * sc, const aiNode * nd)
+void OpenAssetImport::Convert(const u8 *data_, size_t numBytes, const QString &fileName, const QString &diskSource, Ogre::MeshPtr mesh)
 {
-    unsigned int i;
-    unsigned int n=0, k = 0, t;
-
-    //insert current mesh's bones into boneMatrices
-    for(n=0; n < nd->mNumMeshes; ++n)
-    {
-        const struct aiMesh* mesh = sc->mMeshes[nd->mMeshes[n]];
-
-        std::vector<aiMatrix4x4> boneMatrices(mesh->mNumBones);
-
-        // fill boneMatrices with current bone locations
-        for( size_t a = 0; a < mesh->mNumBones; ++a)
-        {
-            aiBone* bone = mesh->mBones[a];
-
-            // find the corresponding node by again looking recursively through the node hierarchy for the same name
-            aiNode* node = sc->mRootNode->FindNode(bone->mName);
-
-            // start with the mesh-to-bone matrix
-            boneMatrices[a] = bone->mOffsetMatrix;
+    LogInfo("AssImp importer: Converting file:" +fileName.toStdString());
 
-            // and now append all node transformations down the parent chain until we're back at mesh coordinates again
-            const aiNode* tempNode = node;
+    ConversionJobPtr newJob(new ConversionJob());
+    newJob->owner = this;
+    if (data_ && numBytes > 0)
+        newJob->data.assign(data_, data_ + numBytes);
+    newJob->fileName = fileName;
+    newJob->diskSource = diskSource;
+    newJob->mesh = mesh;
+    if (assetAPI->GetAssetCache())
+        newJob->cacheDirectory = assetAPI->GetAssetCache()->CacheDirectory();
+    StartConversion(newJob);
+}
 
-            while(tempNode)
-            {
-                // check your matrix multiplication order here!!!
-                boneMatrices[a] = tempNode->mTransformation * boneMatrices[a];
+void OpenAssetImport::StartConversion(const ConversionJobPtr &newJob)
+{
+    if (job)
+        job->owner = 0;
+    job = newJob;
 
-                tempNode = tempNode->mParent;
-            }
-        }
+    TaskAPI *tasks = assetAPI->GetFramework()->Tasks();
+    TaskPtr importTask = tasks->Run(boost::bind(&OpenAssetImport::RunConversionJob, job), "OpenAssetImport_Import");
+    tasks->RunOnMainThread(boost::bind(&OpenAssetImport::FinishConversionJob, job), TaskList(1, importTask), "OpenAssetImport_CreateMesh");
+}
 
-        // all using the results from the previous code snippet
-        std::vector<aiVector3D> resultPos( mesh->mNumVertices);
-        std::vector<aiVector3D> resultNorm( mesh->mNumVertices);
+void OpenAssetImport::RunConversionJob(const ConversionJobPtr &job)
+{
+    if (!job->cacheDirectory.isEmpty() && !job->data.empty())
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(QByteArray(cConversionCacheVersion));
+        hash.addData((const char*)&job->data[0], (int)job->data.size());
+        job->cachePath = job->cacheDirectory + QString(hash.result().toHex()) + ".assimp";
 
-        // loop through all vertex weights of all bones
-        for(size_t a = 0; a < mesh->mNumBones; ++a)
+        // The materials file is written last, so a conversion is complete when it exists.
+        if (QFile::exists(job->cachePath + ".materials") && ReadCacheFile(job->cachePath + ".mesh", job->cachedMesh) &&
+            job->scene.LoadMaterials(job->cachePath + ".materials"))
         {
-            const aiBone* bone = mesh->mBones[a];
-            const aiMatrix4x4& posTrafo = boneMatrices[a];
-
-            // 3x3 matrix, contains the bone matrix without the translation, only with rotation and possibly scaling
-            aiMatrix3x3 normTrafo = aiMatrix3x3( posTrafo);
-            for(size_t b = 0; b < bone->mNumWeights; ++b)
-            {
-                const aiVertexWeight& weight = bone->mWeights[b];
-
-                size_t vertexId = weight.mVertexId;
-                const aiVector3D& srcPos = mesh->mVertices[vertexId];
-                const aiVector3D& srcNorm = mesh->mNormals[vertexId];
-
-                resultPos[vertexId] += (posTrafo * srcPos) * weight.mWeight;
-                resultNorm[vertexId] += (normTrafo * srcNorm)* weight.mWeight;
-            }
+            job->fromCache = true;
+            job->success = true;
+            return;
         }
+        job->cachedMesh.clear();
+    }
 
-        for (t = 0; t < mesh->mNumFaces; ++t)
-        {
-            const struct aiFace* face = &mesh->mFaces[t];
+    job->success = job->scene.Import(job->data, job->fileName, job->diskSource);
+    // The source data is needed only if the cached conversion turns out to be unusable.
+    std::vector<u8>().swap(job->data);
+}
 
-            for(i = 0; i < face->mNumIndices; i++)		// go through all vertices in face
-            {
-                int vertexIndex = face->mIndices[i];	// get group index for current index
+void OpenAssetImport::FinishConversionJob(const ConversionJobPtr &job)
+{
+    if (job->owner)
+        job->owner->FinishConversion(job);
+    // The job may be destroyed in a worker thread, and Ogre's shared pointers must be released in the main thread.
+    job->mesh.setNull();
+}
 
+void OpenAssetImport::FinishConversion(const ConversionJobPtr &finished)
+{
+    PROFILE(OpenAssetImport_CreateMesh);
 
-                mesh->mNormals[vertexIndex] = resultNorm[vertexIndex];
-                mesh->mVertices[vertexIndex] = resultPos[vertexIndex];
-            }
+    job.reset();
+    finished->owner = 0;
 
-        }
-    }
+    ImportedScene &imported = finished->scene;
+    foreach(const QString &message, imported.messages)
+        Ogre::LogManager::getSingleton().logMessage(message.toStdString());
+    foreach(const QString &error, imported.errors)
+        LogError(error);
 
-    // draw all children
-    for (n = 0; n < nd->mNumChildren; n++)
+    if (!finished->success)
     {
-        GetBasePose(sc, nd->mChildren[n]);
+        emit ConversionDone(false);
+        return;
     }
-}
-
-void OpenAssetImport::Convert(const u8 *data_, size_t numBytes, const QString &fileName, const QString &diskSource, Ogre::MeshPtr mesh)
-{
-    LogInfo("AssImp importer: Converting file:" +fileName.toStdString());
-    Assimp::DefaultLogger::create("asslogger.log",Assimp::Logger::VERBOSE);
-    mAnimationSpeedModifier = 1.0f;
-    Assimp::Importer importer;
-    bool searchFromIndex = false;
-
-    /// NOTICE!!!
-    // Some converted mesh might show up pretty messed up, it's happening because some formats might
-    // contain unnecessary vertex information, lines and points. Uncomment the line below for fixing this issue.
-    // by default remove points and lines from the model, since these are usually
-    // degenerate structures from bad modelling or bad import/export.  if they
-    // are needed it can be turned on with IncludeLinesPoints
-
-    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-    /// END OF NOTICE
-
-    // Limit triangles because for each mesh there's limited index memory (16bit)
-    // ...which should be easy to just change to 32 bit but it didn't seem to be the case
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, 21845);
-
-    //importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_CAMERAS|aiComponent_LIGHTS|aiComponent_TEXTURES|aiComponent_ANIMATIONS);
-    //importer.SetPropertyInteger(AI_CONFIG_FAVOUR_SPEED,1);
-    //importer.SetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME,0);
-
-    // And have it read the given file with some example postprocessing
-    // Usually - if speed is not the most important aspect for you - you'll
-    // propably to request more postprocessing than we do in this example.
-
-    unsigned int pFlags = 0
-                          | aiProcess_SplitLargeMeshes
-                          | aiProcess_FindInvalidData
-                          | aiProcess_GenSmoothNormals
-                          | aiProcess_Triangulate
-                          | aiProcess_FlipUVs
-                          | aiProcess_JoinIdenticalVertices
-                          | aiProcess_OptimizeMeshes
-                          | aiProcess_RemoveRedundantMaterials
-                          | aiProcess_ImproveCacheLocality
-                          | aiProcess_LimitBoneWeights
-                          | aiProcess_SortByPType;
-
-#ifndef SKELETON_ENABLED
-    pFlags = pFlags | aiProcess_PreTransformVertices;
-#endif
 
-    //assimp importer looks for a loader to support the file extension specified by hint 
-    QString hint = fileName.right(fileName.length() - fileName.lastIndexOf('.')-1);
-    scene = importer.ReadFileFromMemory(reinterpret_cast<const void*>(data_), numBytes, pFlags, hint.toStdString().c_str());
-
-    if(!scene)
+    Ogre::MeshPtr mesh = finished->mesh;
+    if (finished->fromCache)
     {
-        LogInfo("AssImp importer::convert: Failed to read file:" +fileName.toStdString()+ " from memory: ");
-        LogInfo(importer.GetErrorString());
-        LogInfo("AssImp importer::convert: Trying to load data from file:" +fileName.toStdString());
-		
-        // If the importer failed to read the file from memory,
-        // try to read the file again.
-        scene = importer.ReadFile(diskSource.toStdString(), pFlags);
-
-        if(!scene)
+        if (!LoadCachedMesh(*finished))
         {
-            LogError("AssImp importer::convert: conversion failed, importer unable to load data from file:" +fileName.toStdString());
-            emit ConversionDone(false);
+            // Discard the unusable conversion and convert the source again.
+            LogWarning("AssImp importer: Failed to load the cached conversion of " + finished->fileName + ", converting it again.");
+            QFile::remove(finished->cachePath + ".materials");
+            QFile::remove(finished->cachePath + ".mesh");
+            while(mesh->getNumSubMeshes() > 0)
+                mesh->destroySubMesh(0);
+            ConversionJobPtr retry(new ConversionJob());
+            retry->owner = this;
+            retry->data.swap(finished->data);
+            retry->fileName = finished->fileName;
+            retry->diskSource = finished->diskSource;
+            retry->mesh = mesh;
+            StartConversion(retry);
             return;
         }
+        std::vector<u8>().swap(finished->data);
     }
-
-    if (scene->HasAnimations())
-        GetBasePose(scene, scene->mRootNode);
-
-    GrabNodeNamesFromNode(scene, scene->mRootNode);
-
-#ifdef SKELETON_ENABLED
-    GrabBoneNamesFromNode(scene, scene->mRootNode);
-#endif
-
-    aiMatrix4x4 transform;
-    transform.FromEulerAnglesXYZ(degreeToRadian(90), 0, degreeToRadian(180));
-    scene->mRootNode->mTransformation = transform;
-
-    ComputeNodesDerivedTransform(scene, scene->mRootNode, transform);
-
-#ifdef SKELETON_ENABLED
-    if(mBonesByName.size())
+    else
     {
-        mSkeleton = Ogre::SkeletonManager::getSingleton().create("conversion", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+#ifdef SKELETON_ENABLED
+        const aiScene *scene = imported.Scene();
+        if (imported.hasBones && scene)
+        {
+            mSkeleton = Ogre::SkeletonManager::getSingleton().create(finished->fileName.toStdString() + ".skeleton", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, true);
 
-        msBoneCount = 0;
-        CreateBonesFromNode(scene, scene->mRootNode);
-        msBoneCount = 0;
-        CreateBoneHiearchy(scene, scene->mRootNode);
+            msBoneCount = 0;
+            CreateBonesFromNode(imported, scene->mRootNode);
+            msBoneCount = 0;
+            CreateBoneHiearchy(imported, scene->mRootNode);
 
-        if(scene->HasAnimations())
-        {
-            for(int i = 0; i < scene->mNumAnimations; ++i)
+            if(scene->HasAnimations())
             {
-                ParseAnimation(scene, i, scene->mAnimations[i]);
+                for(int i = 0; i < (int)scene->mNumAnimations; ++i)
+                {
+                    ParseAnimation(scene, i, scene->mAnimations[i]);
+                }
             }
         }
-    }
 #endif
+        imported.ReleaseScene();
 
-    LoadDataFromNode(scene, scene->mRootNode, diskSource, fileName, mesh);
-
-    Ogre::LogManager::getSingleton().logMessage("*** Finished loading ass file ***");
-    Assimp::DefaultLogger::kill();
-
-#ifdef SKELETON_ENABLED
-
-    if(!mSkeleton.isNull())
-    {
-        unsigned short numBones = mSkeleton->getNumBones();
-        unsigned short i;
-        for (i = 0; i < numBones; ++i)
+        for(size_t i = 0; i < imported.subMeshes.size(); ++i)
         {
-            Ogre::Bone* pBone = mSkeleton->getBone(i);
-            assert(pBone);
+            Ogre::SubMesh* submesh = mesh->createSubMesh(imported.subMeshes[i].name);
+            CreateVertexData(imported.subMeshes[i], submesh);
+            imported.subMeshes[i].ReleaseBuffers();
         }
 
-        Ogre::SkeletonSerializer binSer;
-
-        //binSer.exportSkeleton(mSkeleton.getPointer(), "model.skeleton");
-    }
-
-    Ogre::MeshSerializer meshSer;
-    for(MeshVector::iterator it = mMeshes.begin(); it != mMeshes.end(); ++it)
-    {
-        Ogre::MeshPtr mMesh = *it;
-        if(mBonesByName.size())
+        // We must indicate the bounding box
+        if (!imported.subMeshes.empty())
         {
-            mMesh->setSkeletonName(fileName.toStdString() + ".skeleton");
+            mesh->_setBounds(imported.bounds);
+            mesh->_setBoundingSphereRadius((imported.bounds.getMaximum() - imported.bounds.getMinimum()).length()/2.0);
         }
 
-        Ogre::Mesh::SubMeshIterator smIt = mMesh->getSubMeshIterator();
-        while (smIt.hasMoreElements())
+#ifdef SKELETON_ENABLED
+        if(!mSkeleton.isNull())
         {
-            Ogre::SubMesh* sm = smIt.getNext();
-            if (!sm->useSharedVertices)
+            mesh->setSkeletonName(mSkeleton->getName());
+
+            Ogre::Mesh::SubMeshIterator smIt = mesh->getSubMeshIterator();
+            while (smIt.hasMoreElements())
             {
-                // AutogreMaterialic
+                Ogre::SubMesh* sm = smIt.getNext();
+                if (!sm->useSharedVertices)
+                {
+                    // AutogreMaterialic
 #if OGRE_VERSION_MINOR >= 8 && OGRE_VERSION_MAJOR >= 1
-                Ogre::VertexDeclaration* newDcl =
-                        sm->vertexData->vertexDeclaration->getAutoOrganisedDeclaration(mMesh->hasSkeleton(), mMesh->hasVertexAnimation(), false);
+                    Ogre::VertexDeclaration* newDcl =
+                            sm->vertexData->vertexDeclaration->getAutoOrganisedDeclaration(mesh->hasSkeleton(), mesh->hasVertexAnimation(), false);
 #else
-                Ogre::VertexDeclaration* newDcl =
-                        sm->vertexData->vertexDeclaration->getAutoOrganisedDeclaration(mMesh->hasSkeleton(), mMesh->hasVertexAnimation());
+                    Ogre::VertexDeclaration* newDcl =
+                            sm->vertexData->vertexDeclaration->getAutoOrganisedDeclaration(mesh->hasSkeleton(), mesh->hasVertexAnimation());
 #endif
-                if (*newDcl != *(sm->vertexData->vertexDeclaration))
-                {
-                    // Usages don't matter here since we're only exporting
-                    Ogre::BufferUsageList bufferUsages;
-                    for (size_t u = 0; u <= newDcl->getMaxSource(); ++u)
-                        bufferUsages.push_back(Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
-                    sm->vertexData->reorganiseBuffers(newDcl, bufferUsages);
+                    if (*newDcl != *(sm->vertexData->vertexDeclaration))
+                    {
+                        // Usages don't matter here since we're only exporting
+                        Ogre::BufferUsageList bufferUsages;
+                        for (size_t u = 0; u <= newDcl->getMaxSource(); ++u)
+                            bufferUsages.push_back(Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+                        sm->vertexData->reorganiseBuffers(newDcl, bufferUsages);
+                    }
                 }
             }
         }
+#endif
     }
 
-#endif
+    for(size_t i = 0; i < imported.subMeshes.size(); ++i)
+    {
+        Ogre::MaterialPtr matptr = MaterialForSubMesh(imported, imported.subMeshes[i], finished->diskSource, finished->fileName);
+        mesh->getSubMesh((unsigned short)i)->setMaterialName(matptr->getName());
+    }
+
+    if (!finished->fromCache && !finished->cachePath.isEmpty())
+        SaveCachedMesh(*finished);
+
+    Ogre::LogManager::getSingleton().logMessage("*** Finished loading ass file ***");
 
-    mMeshes.clear();
-    mMaterialCode = "";
-    mBonesByName.clear();
-    mBoneNodesByName.clear();
-    boneMap.clear();
     mSkeleton = Ogre::SkeletonPtr(NULL);
     mCustomAnimationName = "";
-    // etc...
     meshCreated = true;
     Ogre::MeshManager::getSingleton().removeUnreferencedResources();
     Ogre::SkeletonManager::getSingleton().removeUnreferencedResources();
-	
+
     if(meshCreated && PendingTextures())
         emit ConversionDone(true);
+}
+
+bool OpenAssetImport::LoadCachedMesh(ConversionJob &cached)
+{
+    PROFILE(OpenAssetImport_LoadCachedMesh);
+
+    Ogre::MeshPtr mesh = cached.mesh;
+    try
+    {
+#include "DisableMemoryLeakCheck.h"
+        Ogre::DataStreamPtr stream(new Ogre::MemoryDataStream((void*)&cached.cachedMesh[0], cached.cachedMesh.size(), false));
+#include "EnableMemoryLeakCheck.h"
+        Ogre::MeshSerializer serializer;
+        serializer.importMesh(stream, mesh.getPointer());
+        std::vector<u8>().swap(cached.cachedMesh);
+
+#ifdef SKELETON_ENABLED
+        std::vector<u8> skeletonData;
+        if (ReadCacheFile(cached.cachePath + ".skeleton", skeletonData))
+        {
+            mSkeleton = Ogre::SkeletonManager::getSingleton().create(cached.fileName.toStdString() + ".skeleton", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, true);
+#include "DisableMemoryLeakCheck.h"
+            Ogre::DataStreamPtr skeletonStream(new Ogre::MemoryDataStream((void*)&skeletonData[0], skeletonData.size(), false));
+#include "EnableMemoryLeakCheck.h"
+            Ogre::SkeletonSerializer skeletonSerializer;
+            skeletonSerializer.importSkeleton(skeletonStream, mSkeleton.getPointer());
+            mesh->setSkeletonName(mSkeleton->getName());
+        }
+#endif
+    }
+    catch(const Ogre::Exception &e)
+    {
+        LogError("AssImp importer: Failed to import the cached conversion of " + cached.fileName + ": " + QString(e.what()));
+        return false;
+    }
+
+    return (size_t)mesh->getNumSubMeshes() == cached.scene.subMeshes.size();
+}
+
+void OpenAssetImport::SaveCachedMesh(ConversionJob &converted)
+{
+    PROFILE(OpenAssetImport_SaveCachedMesh);
+
+    const QString meshFile = converted.cachePath + ".mesh";
+    const QString materialsFile = converted.cachePath + ".materials";
+    try
+    {
+        Ogre::MeshSerializer serializer;
+        serializer.exportMesh(converted.mesh.get(), (meshFile + ".tmp").toStdString());
+        if (!ReplaceCacheFile(meshFile + ".tmp", meshFile))
+            return;
 
+#ifdef SKELETON_ENABLED
+        if (!mSkeleton.isNull())
+        {
+            Ogre::SkeletonSerializer skeletonSerializer;
+            skeletonSerializer.exportSkeleton(mSkeleton.get(), (converted.cachePath + ".skeleton.tmp").toStdString());
+            if (!ReplaceCacheFile(converted.cachePath + ".skeleton.tmp", converted.cachePath + ".skeleton"))
+                return;
+        }
+#endif
+    }
+    catch(const Ogre::Exception &e)
+    {
+        LogWarning("AssImp importer: Failed to cache the conversion of " + converted.fileName + ": " + QString(e.what()));
+        QFile::remove(meshFile + ".tmp");
+        return;
+    }
+
+    if (!converted.scene.SaveMaterials(materialsFile + ".tmp") || !ReplaceCacheFile(materialsFile + ".tmp", materialsFile))
+        LogWarning("AssImp importer: Failed to cache the materials of " + converted.fileName);
 }
 
 void OpenAssetImport::ParseAnimation (const aiScene* mScene, int index, aiAnimation* anim)
@@ -641,7 +681,7 @@ void OpenAssetImport::ParseAnimation (const aiScene* mScene, int index, aiAnimat
                 aiQuaternion rot;
                 aiMatrix4x4 mat;
                 float time;
-                UpdateAnimationFunc(scene, node_anim, g, time, mat);
+                UpdateAnimationFunc(mScene, node_anim, g, time, mat);
                 mat.DecomposeNoScaling(rot, pos);
                 keyframe = track->createNodeKeyFrame(Ogre::Real(time));
 
@@ -668,57 +708,9 @@ void OpenAssetImport::ParseAnimation (const aiScene* mScene, int index, aiAnimat
     mSkeleton->optimiseAllAnimations();
 }
 
-void OpenAssetImport::MarkAllChildNodesAsNeeded(const aiNode *pNode)
-{
-    FlagNodeAsNeeded(pNode->mName.data);
-    // Traverse all child nodes of the current node instance
-    for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; ++childIdx )
-    {
-        const aiNode *pChildNode = pNode->mChildren[ childIdx ];
-        MarkAllChildNodesAsNeeded(pChildNode);
-    }
-}
-
-void OpenAssetImport::GrabNodeNamesFromNode(const aiScene* mScene, const aiNode* pNode)
-{
-    boneNode bNode;
-    bNode.node = const_cast<aiNode*>(pNode);
-    if(NULL != pNode->mParent)
-    {
-        bNode.parent = const_cast<aiNode*>(pNode->mParent);
-    }
-    bNode.isNeeded = false;
-    boneMap.insert(std::pair<Ogre::String, boneNode>(Ogre::String(pNode->mName.data), bNode));
-    mBoneNodesByName[pNode->mName.data] = pNode;
-
-    Ogre::LogManager::getSingleton().logMessage("Node " + Ogre::String(pNode->mName.data) + " found.");
-
-
-    // Traverse all child nodes of the current node instance
-    for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; ++childIdx)
-    {
-        const aiNode *pChildNode = pNode->mChildren[childIdx];
-        GrabNodeNamesFromNode(mScene, pChildNode);
-    }
-}
-
-
-void OpenAssetImport::ComputeNodesDerivedTransform(const aiScene* mScene,  const aiNode *pNode, const aiMatrix4x4 accTransform)
-{
-    if(mNodeDerivedTransformByName.find(pNode->mName.data) == mNodeDerivedTransformByName.end())
-    {
-        mNodeDerivedTransformByName[pNode->mName.data] = accTransform;
-    }
-    for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; ++childIdx)
-    {
-        const aiNode *pChildNode = pNode->mChildren[ childIdx ];
-        ComputeNodesDerivedTransform(mScene, pChildNode, accTransform * pChildNode->mTransformation);
-    }
-}
-
-void OpenAssetImport::CreateBonesFromNode(const aiScene* mScene,  const aiNode *pNode)
+void OpenAssetImport::CreateBonesFromNode(const ImportedScene &imported, const aiNode *pNode)
 {
-    if(IsNodeNeeded(pNode->mName.data))
+    if(imported.IsNodeNeeded(pNode->mName.data))
     {
         Ogre::Bone* bone = mSkeleton->createBone(Ogre::String(pNode->mName.data), msBoneCount);
 
@@ -743,13 +735,13 @@ void OpenAssetImport::CreateBonesFromNode(const aiScene* mScene,  const aiNode *
     for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; ++childIdx)
     {
         const aiNode *pChildNode = pNode->mChildren[childIdx];
-        CreateBonesFromNode(mScene, pChildNode);
+        CreateBonesFromNode(imported, pChildNode);
     }
 }
 
-void OpenAssetImport::CreateBoneHiearchy(const aiScene* mScene,  const aiNode *pNode)
+void OpenAssetImport::CreateBoneHiearchy(const ImportedScene &imported, const aiNode *pNode)
 {
-    if(IsNodeNeeded(pNode->mName.data))
+    if(imported.IsNodeNeeded(pNode->mName.data))
     {
         Ogre::Bone* parent = 0;
         Ogre::Bone* child = 0;
@@ -773,84 +765,7 @@ void OpenAssetImport::CreateBoneHiearchy(const aiScene* mScene,  const aiNode *p
     for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; childIdx++)
     {
         const aiNode *pChildNode = pNode->mChildren[ childIdx ];
-        CreateBoneHiearchy(mScene, pChildNode);
-    }
-}
-
-void OpenAssetImport::FlagNodeAsNeeded(const char* name)
-{
-    BoneMapType::iterator iter = boneMap.find(Ogre::String(name));
-    if(iter != boneMap.end())
-    {
-        iter->second.isNeeded = true;
-    }
-}
-
-bool OpenAssetImport::IsNodeNeeded(const char* name)
-{
-    BoneMapType::iterator iter = boneMap.find(Ogre::String(name));
-    if(iter != boneMap.end())
-    {
-        return iter->second.isNeeded;
-    }
-    return false;
-}
-
-void OpenAssetImport::GrabBoneNamesFromNode(const aiScene* mScene,  const aiNode *pNode)
-{
-
-    if(pNode->mNumMeshes > 0)
-    {
-        for(unsigned int idx=0; idx<pNode->mNumMeshes; ++idx)
-        {
-            aiMesh *pAIMesh = mScene->mMeshes[pNode->mMeshes[idx]];
-
-            if(pAIMesh->HasBones())
-            {
-                for(Ogre::uint32 i=0; i < pAIMesh->mNumBones; ++i)
-                {
-                    aiBone *pAIBone = pAIMesh->mBones[i];
-                    if (NULL != pAIBone)
-                    {
-                        mBonesByName[pAIBone->mName.data] = pAIBone;
-
-                        Ogre::LogManager::getSingleton().logMessage(Ogre::StringConverter::toString(i) + ") REAL BONE with name : " + Ogre::String(pAIBone->mName.data));
-
-                        // flag this node and all parents of this node as needed, until we reach the node holding the mesh, or the parent.
-                        aiNode* node = mScene->mRootNode->FindNode(pAIBone->mName.data);
-                        while(node)
-                        {
-                            if(node->mName.data == pNode->mName.data)
-                            {
-                                FlagNodeAsNeeded(node->mName.data);
-                                break;
-                            }
-                            if(node->mName.data == pNode->mParent->mName.data)
-                            {
-                                FlagNodeAsNeeded(node->mName.data);
-                                break;
-                            }
-
-                            // Not a root node, flag this as needed and continue to the parent
-                            FlagNodeAsNeeded(node->mName.data);
-                            node = node->mParent;
-                        }
-
-                        // Flag all children of this node as needed
-                        node = mScene->mRootNode->FindNode(pAIBone->mName.data);
-                        MarkAllChildNodesAsNeeded(node);
-
-                    } // if we have a valid bone
-                } // loop over bones
-            } // if this mesh has bones
-        } // loop over meshes
-    } // if this node has meshes
-
-    // Traverse all child nodes of the current node instance
-    for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; childIdx++)
-    {
-        const aiNode *pChildNode = pNode->mChildren[childIdx];
-        GrabBoneNamesFromNode(mScene, pChildNode);
+        CreateBoneHiearchy(imported, pChildNode);
     }
 }
 
@@ -874,81 +789,55 @@ Ogre::MaterialPtr OpenAssetImport::CreateVertexColorMaterial()
     return ogreMaterial;
 }
 
-Ogre::MaterialPtr OpenAssetImport::CreateMaterial(Ogre::String& matName, const aiMaterial* mat, const QString &meshFileDiskSource, const QString &meshFileName)
-{
-
-    std::ostringstream matname;
-    Ogre::MaterialManager* ogreMaterialMgr =  Ogre::MaterialManager::getSingletonPtr();
-    enum aiTextureType Type = aiTextureType_DIFFUSE;
-    aiString path;
-    aiTextureMapping mapping = aiTextureMapping_UV;       // the mapping (should be uv for now)
-    unsigned int uvindex = 0;                             // the texture uv index channel
-    float blend = 1.0f;                                   // blend
-    aiTextureOp op = aiTextureOp_Multiply;                // op
-    aiTextureMapMode mapmode[2] =  { aiTextureMapMode_Wrap, aiTextureMapMode_Wrap };    // mapmode
-    std::ostringstream texname;
-
-    aiString szPath;
-
-    if(AI_SUCCESS == aiGetMaterialString(mat, AI_MATKEY_TEXTURE_DIFFUSE(0), &szPath))
-    {
-	    Ogre::LogManager::getSingleton().logMessage("File: " + meshFileName.toStdString() + ". Texture " + Ogre::String(szPath.data) + " for channel " + Ogre::StringConverter::toString(uvindex));
-        //LogInfo("File: " + meshFileName.toStdString() + ". Texture " + Ogre::String(szPath.data) + " for channel " + Ogre::StringConverter::toString(uvindex));
-    }
-
-    Ogre::MaterialPtr ogreMaterial = ogreMaterialMgr->create(matName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, true);
-
-    // ambient
-    aiColor4D clr(1.0f, 1.0f, 1.0f, 1.0f);
-    //Ambient is usually way too low! FIX ME!
-    if (mat->GetTexture(Type, 0, &path) != AI_SUCCESS)
-        aiGetMaterialColor(mat, AI_MATKEY_COLOR_AMBIENT, &clr);
 
-    ogreMaterial->setAmbient(clr.r, clr.g, clr.b);
-
-    // diffuse
-    clr = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
-    if(AI_SUCCESS == aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &clr))
-    {
-        ogreMaterial->setDiffuse(clr.r, clr.g, clr.b, clr.a);
-    }
-
-    // specular
-    clr = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
-    if(AI_SUCCESS == aiGetMaterialColor(mat, AI_MATKEY_COLOR_SPECULAR, &clr))
-    {
-        ogreMaterial->setSpecular(clr.r, clr.g, clr.b, clr.a);
-    }
+Ogre::MaterialPtr OpenAssetImport::MaterialForSubMesh(const ImportedScene &imported, const ImportedSubMesh &subMesh, const QString &meshFileDiskSource, const QString &meshFileName)
+{
+    //generates material name
+    Ogre::String matName = Ogre::String(meshFileName.toStdString()+"_generatedMat" + Ogre::StringConverter::toString(subMesh.material)+ ".material");
+    //checks if the material already exist, it might have been generated before to another submesh.
+    Ogre::MaterialPtr matptr = Ogre::MaterialManager::getSingleton().getByName(matName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 
-    // emissive
-    clr = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
-    if(AI_SUCCESS == aiGetMaterialColor(mat, AI_MATKEY_COLOR_EMISSIVE, &clr))
+    if(matptr.isNull())
     {
-        ogreMaterial->setSelfIllumination(clr.r, clr.g, clr.b);
-    }
+        if(subMesh.vertexColors)
+            matptr = CreateVertexColorMaterial();
+        else
+            matptr = CreateMaterial(matName, imported.materials[subMesh.material], meshFileDiskSource, meshFileName);
 
-    float fShininess;
-    if(AI_SUCCESS == aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &fShininess))
-    {
-        ogreMaterial->setShininess(Ogre::Real(fShininess));
+        //we must create an OgreMaterialAsset through assetAPI and put the just created
+        //ogre material pointer to it
+        //GenerateTemporaryNonexistingAssetFilename() is used to prevent the "Asset Storage contains ambiguous assets in two different subdirectories!" warning 
+        QString matname = assetAPI->GenerateTemporaryNonexistingAssetFilename(QString::fromStdString(matptr->getName()));
+        AssetPtr assetPtr = assetAPI->CreateNewAsset("OgreMaterial", matname);
+        OgreMaterialAsset *mat = static_cast<OgreMaterialAsset *>(assetPtr.get());
+        mat->ogreMaterial = matptr;
     }
+    return matptr;
+}
 
-    int two_sided;
-    aiGetMaterialInteger(mat, AI_MATKEY_TWOSIDED, &two_sided);
+Ogre::MaterialPtr OpenAssetImport::CreateMaterial(Ogre::String& matName, const ImportedMaterial &mat, const QString &meshFileDiskSource, const QString &meshFileName)
+{
+    Ogre::MaterialManager* ogreMaterialMgr =  Ogre::MaterialManager::getSingletonPtr();
+    Ogre::MaterialPtr ogreMaterial = ogreMaterialMgr->create(matName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, true);
 
-    if (two_sided != 0)
+    ogreMaterial->setAmbient(mat.ambient.r, mat.ambient.g, mat.ambient.b);
+    if (mat.hasDiffuse)
+        ogreMaterial->setDiffuse(mat.diffuse.r, mat.diffuse.g, mat.diffuse.b, mat.diffuse.a);
+    if (mat.hasSpecular)
+        ogreMaterial->setSpecular(mat.specular.r, mat.specular.g, mat.specular.b, mat.specular.a);
+    if (mat.hasEmissive)
+        ogreMaterial->setSelfIllumination(mat.emissive.r, mat.emissive.g, mat.emissive.b);
+    if (mat.hasShininess)
+        ogreMaterial->setShininess(Ogre::Real(mat.shininess));
+    if (mat.twoSided)
         ogreMaterial->setCullingMode(Ogre::CULL_NONE);
 
-    if (mat->GetTexture(Type, 0, &path) == AI_SUCCESS)
+    if (!mat.texture.isEmpty())
     {
-        //If the assimp scene contains textures they are loaded into the Ogre resource system
-        if (!scene->HasTextures())
-        {
-            QString tex = QString::fromStdString(szPath.data);
-            QString texPath = GetPathToTexture(meshFileName, meshFileDiskSource, tex);
-            texMatMap.insert(TexMatPair(texPath, ogreMaterial));
-            LoadTextureFile(texPath);
-        }
+        QString tex = mat.texture;
+        QString texPath = GetPathToTexture(meshFileName, meshFileDiskSource, tex);
+        texMatMap.insert(TexMatPair(texPath, ogreMaterial));
+        LoadTextureFile(texPath);
     }
     else
         ogreMaterial->load();
@@ -956,22 +845,15 @@ Ogre::MaterialPtr OpenAssetImport::CreateMaterial(Ogre::String& matName, const a
     return ogreMaterial;
 }
 
-bool OpenAssetImport::CreateVertexData(const Ogre::String& name, const aiNode* pNode, const aiMesh *mesh, Ogre::SubMesh* submesh, Ogre::AxisAlignedBox& mAAB)
+void OpenAssetImport::CreateVertexData(const ImportedSubMesh &imported, Ogre::SubMesh* submesh)
 {
-    // if animated all submeshes must have bone weights
-    if(mBonesByName.size() && !mesh->HasBones())
-    {
-        Ogre::LogManager::getSingleton().logMessage("Skipping Mesh " + Ogre::String(mesh->mName.data) + "with no bone weights");
-        return false;
-    }
-    
     // We must create the vertex data, indicating how many vertices there will be
     submesh->useSharedVertices = false;
 #include "DisableMemoryLeakCheck.h"
     submesh->vertexData = new Ogre::VertexData();
 #include "EnableMemoryLeakCheck.h"
     submesh->vertexData->vertexStart = 0;
-    submesh->vertexData->vertexCount = mesh->mNumVertices;
+    submesh->vertexData->vertexCount = imported.numVertices;
     Ogre::VertexData *data = submesh->vertexData;
 
     // Vertex declarations
@@ -981,272 +863,100 @@ bool OpenAssetImport::CreateVertexData(const Ogre::String& name, const aiNode* p
     offset += decl->addElement(0,offset,Ogre::VET_FLOAT3,Ogre::VES_NORMAL).getSize();
 
     offset = 0;
-    for(int tn=0 ; tn<AI_MAX_NUMBER_OF_TEXTURECOORDS ; ++tn)
+    for(int tn = 0; tn < (int)imported.uvComponents.size(); ++tn)
     {
-        if(mesh->mTextureCoords[tn])
+        if (imported.uvComponents[tn] == 3)
         {
-            if(mesh->mNumUVComponents[tn] == 3)
-            {
-                decl->addElement(1, offset, Ogre::VET_FLOAT3, Ogre::VES_TEXTURE_COORDINATES, tn);
-                offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT3);
-            } 
-            else
-            {
-                decl->addElement(1, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, tn);
-                offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT2);
-            }
+            decl->addElement(1, offset, Ogre::VET_FLOAT3, Ogre::VES_TEXTURE_COORDINATES, tn);
+            offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT3);
+        }
+        else if (imported.uvComponents[tn] == 2)
+        {
+            decl->addElement(1, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, tn);
+            offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT2);
         }
     }
 
-    if (mesh->HasTangentsAndBitangents())
+    if (imported.tangents)
     {
         decl->addElement(1, offset, Ogre::VET_FLOAT3, Ogre::VES_TANGENT);
         offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT3);
         decl->addElement(1, offset, Ogre::VET_FLOAT3, Ogre::VES_BINORMAL);
     }
 
-    offset = 0;
-    for(int vn=0 ; vn<AI_MAX_NUMBER_OF_COLOR_SETS; ++vn)
-    {
-        if (mesh->mColors[vn])
-        {
-            decl->addElement(2, offset, Ogre::VET_COLOUR, Ogre::VES_DIFFUSE);
-            offset += Ogre::VertexElement::getTypeSize(Ogre::VET_COLOUR);
-
-        }
-    }
-
-    // Write vertex data to buffer
-    Ogre::HardwareVertexBufferSharedPtr vbuf = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
-            decl->getVertexSize(0), // This value is the size of a vertex in memory
-            data->vertexCount, // The number of vertices you'll put into this buffer
-            Ogre::HardwareBuffer::HBU_DYNAMIC // Properties
-            );
-    Ogre::Real *vbData = static_cast<Ogre::Real*>(vbuf->lock(Ogre::HardwareBuffer::HBL_NORMAL));
-
-    aiMatrix4x4 aiM = mNodeDerivedTransformByName.find(pNode->mName.data)->second;
-
-    offset = 0;
-    aiVector3D vect;
-    for (unsigned int n=0 ; n<data->vertexCount ; ++n)
-    {
-        if (mesh->mVertices != NULL)
-        {
-            vect.x = mesh->mVertices[n].x;
-            vect.y = mesh->mVertices[n].y;
-            vect.z = mesh->mVertices[n].z;
-#ifndef SKELETONS_ENABLED
-            vect *= aiM;
-#endif
-
-            Ogre::Vector3 position( vect.x, vect.y, vect.z );
-            vbData[offset++] = vect.x;
-            vbData[offset++] = vect.y;
-            vbData[offset++] = vect.z;
-
-            mAAB.merge(position);
-        }
-
-        if (mesh->mNormals != NULL)
-        {
-            vect.x = mesh->mNormals[n].x;
-            vect.y = mesh->mNormals[n].y;
-            vect.z = mesh->mNormals[n].z;
-#ifndef SKELETONS_ENABLED
-            vect *= aiM;
-#endif
-            vbData[offset++] = vect.x;
-            vbData[offset++] = vect.y;
-            vbData[offset++] = vect.z;
-        }
-    }
-
-    vbuf->unlock();
-    data->vertexBufferBinding->setBinding(0, vbuf);
+    if (!imported.colors.empty())
+        decl->addElement(2, 0, Ogre::VET_COLOUR, Ogre::VES_DIFFUSE);
 
-    if (mesh->HasTextureCoords(0))
+    // The buffers are only copied here, the conversion to the vertex layout was done in the worker thread.
+    if (data->vertexCount > 0)
     {
-        vbuf = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
-                decl->getVertexSize(1), // This value is the size of a vertex in memory
+        Ogre::HardwareVertexBufferSharedPtr vbuf = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+                decl->getVertexSize(0), // This value is the size of a vertex in memory
                 data->vertexCount, // The number of vertices you'll put into this buffer
                 Ogre::HardwareBuffer::HBU_DYNAMIC // Properties
                 );
-        vbData = static_cast<Ogre::Real*>(vbuf->lock(Ogre::HardwareBuffer::HBL_NORMAL));
+        vbuf->writeData(0, vbuf->getSizeInBytes(), &imported.positionsNormals[0], true);
+        data->vertexBufferBinding->setBinding(0, vbuf);
 
-        offset = 0;
-        for (unsigned int n=0 ; n<data->vertexCount ; ++n)
+        if (!imported.texCoords.empty())
         {
-            for (int tn=0 ; tn<AI_MAX_NUMBER_OF_TEXTURECOORDS ; ++tn)
-            {
-                if (mesh->mTextureCoords[tn])
-                {
-                    if (mesh->mNumUVComponents[tn] == 3)
-                    {
-                        vbData[offset++] = mesh->mTextureCoords[tn][n].x;
-                        vbData[offset++] = mesh->mTextureCoords[tn][n].y;
-                        vbData[offset++] = mesh->mTextureCoords[tn][n].z;
-                    } 
-                    else
-                    {
-                        vbData[offset++] = mesh->mTextureCoords[tn][n].x;
-                        vbData[offset++] = mesh->mTextureCoords[tn][n].y;
-                    }
-                }
-            }
-            if (mesh->HasTangentsAndBitangents())
-            {
-                vbData[offset++] = mesh->mTangents[n].x;
-                vbData[offset++] = mesh->mTangents[n].y;
-                vbData[offset++] = mesh->mTangents[n].z;
-
-                vbData[offset++] = mesh->mBitangents[n].x;
-                vbData[offset++] = mesh->mBitangents[n].y;
-                vbData[offset++] = mesh->mBitangents[n].z;
-            }
+            vbuf = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+                    decl->getVertexSize(1), // This value is the size of a vertex in memory
+                    data->vertexCount, // The number of vertices you'll put into this buffer
+                    Ogre::HardwareBuffer::HBU_DYNAMIC // Properties
+                    );
+            vbuf->writeData(0, vbuf->getSizeInBytes(), &imported.texCoords[0], true);
+            data->vertexBufferBinding->setBinding(1, vbuf);
         }
-        vbuf->unlock();
-        data->vertexBufferBinding->setBinding(1, vbuf);
-    }
-
-    if(mesh->HasVertexColors(0))
-    {
-        Ogre::HardwareVertexBufferSharedPtr vbufColor= Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
-                decl->getVertexSize(2), // This value is the size of a vertex in memory
-                data->vertexCount, // The number of vertices you'll put into this buffer
-                Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY, // Properties
-                false
-                );
-        Ogre::RGBA* pVertexColor = static_cast<Ogre::RGBA*>(vbufColor->lock(Ogre::HardwareBuffer::HBL_NORMAL));
 
-        for (unsigned int n=0; n<data->vertexCount; ++n)
+        if (!imported.colors.empty())
         {
-            for (int vn=0; vn<AI_MAX_NUMBER_OF_COLOR_SETS; ++vn)
-            {
-                if (mesh->mColors[vn])
-                {
-				    Ogre::RenderSystem* rs = Ogre::Root::getSingleton().getRenderSystem();
-                    if (rs)
-                        rs->convertColourValue(Ogre::ColourValue(mesh->mColors[vn][n].r, mesh->mColors[vn][n].g, mesh->mColors[vn][n].b, mesh->mColors[vn][n].a), &pVertexColor[n]);
-                }
-            }
+            Ogre::HardwareVertexBufferSharedPtr vbufColor= Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+                    decl->getVertexSize(2), // This value is the size of a vertex in memory
+                    data->vertexCount, // The number of vertices you'll put into this buffer
+                    Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY, // Properties
+                    false
+                    );
+            // The vertex color format depends on the render system, so the colors can only be converted here.
+            std::vector<Ogre::RGBA> vertexColors(data->vertexCount, 0xFFFFFFFF);
+            Ogre::RenderSystem* rs = Ogre::Root::getSingleton().getRenderSystem();
+            if (rs)
+                for (size_t n = 0; n < vertexColors.size(); ++n)
+                    rs->convertColourValue(imported.colors[n], &vertexColors[n]);
+            vbufColor->writeData(0, vbufColor->getSizeInBytes(), &vertexColors[0], true);
+            data->vertexBufferBinding->setBinding(2, vbufColor);
+            data->closeGapsInBindings();
         }
-        vbufColor->unlock();
-        data->vertexBufferBinding->setBinding(2, vbufColor);
-        data->closeGapsInBindings();
     }
 
-    size_t numIndices = mesh->mNumFaces * 3;            // support only triangles, so 3 indices per face
-
-    Ogre::HardwareIndexBufferSharedPtr ibuf = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
-            Ogre::HardwareIndexBuffer::IT_16BIT, // You can use several different value types here
-            numIndices, // The number of indices you'll put in that buffer
-            Ogre::HardwareBuffer::HBU_DYNAMIC // Properties
-            );
-
-    Ogre::uint16 *idxData = static_cast<Ogre::uint16*>(ibuf->lock(Ogre::HardwareBuffer::HBL_NORMAL));
-    offset = 0;
-    for (unsigned int n=0 ; n<mesh->mNumFaces ; ++n)
+    if (!imported.indices.empty())
     {
-        idxData[offset++] = mesh->mFaces[n].mIndices[0];
-        idxData[offset++] = mesh->mFaces[n].mIndices[1];
-        idxData[offset++] = mesh->mFaces[n].mIndices[2];
+        Ogre::HardwareIndexBufferSharedPtr ibuf = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
+                Ogre::HardwareIndexBuffer::IT_16BIT, // You can use several different value types here
+                imported.indices.size(), // The number of indices you'll put in that buffer
+                Ogre::HardwareBuffer::HBU_DYNAMIC // Properties
+                );
+        ibuf->writeData(0, ibuf->getSizeInBytes(), &imported.indices[0], true);
+        submesh->indexData->indexBuffer = ibuf; // The pointer to the index buffer
     }
-
-    ibuf->unlock();
-
-    submesh->indexData->indexBuffer = ibuf; // The pointer to the index buffer
-    submesh->indexData->indexCount = numIndices; // The number of indices we'll use
+    submesh->indexData->indexCount = imported.indices.size(); // The number of indices we'll use
     submesh->indexData->indexStart = 0;
 
     // set bone weigths
-    if(mesh->HasBones())
+    if (!mSkeleton.isNull())
     {
-        for(Ogre::uint32 i=0; i < mesh->mNumBones; i++ )
+        for(size_t i = 0; i < imported.boneWeights.size(); ++i)
         {
-            aiBone *pAIBone = mesh->mBones[ i ];
-            if (NULL != pAIBone)
-            {
-                Ogre::String bname = pAIBone->mName.data;
-                for (Ogre::uint32 weightIdx = 0; weightIdx < pAIBone->mNumWeights; weightIdx++)
-                {
-                    aiVertexWeight aiWeight = pAIBone->mWeights[weightIdx];
-
-                    Ogre::VertexBoneAssignment vba;
-                    vba.vertexIndex = aiWeight.mVertexId;
-                    vba.boneIndex = mSkeleton->getBone(bname)->getHandle();
-                    vba.weight= aiWeight.mWeight;
-
-                    submesh->addBoneAssignment(vba);
-                }
-            }
-        }
-    } // if mesh has bones
+            const ImportedBoneWeight &weight = imported.boneWeights[i];
+            if (!mSkeleton->hasBone(weight.bone))
+                continue;
 
-    return true;
-}
-
-void OpenAssetImport::LoadDataFromNode(const aiScene* mScene,  const aiNode *pNode, const QString &meshFileDiskSource, const QString &meshFileName,Ogre::MeshPtr mesh)
-{
-    if(pNode->mNumMeshes > 0)
-    {
-        Ogre::AxisAlignedBox mAAB;
-
-        if(mMeshes.size() == 0)
-        {
-            mMeshes.push_back(mesh);
-        }
-        else
-        {
-            mesh = mMeshes[0];
-            mAAB = mesh->getBounds();
+            Ogre::VertexBoneAssignment vba;
+            vba.vertexIndex = weight.vertex;
+            vba.boneIndex = mSkeleton->getBone(weight.bone)->getHandle();
+            vba.weight = weight.weight;
+            submesh->addBoneAssignment(vba);
         }
-
-        for (unsigned int idx=0; idx<pNode->mNumMeshes; ++idx )
-        {
-            aiMesh *pAIMesh = mScene->mMeshes[ pNode->mMeshes[ idx ] ];
-            //if pAIMesh->
-            Ogre::LogManager::getSingleton().logMessage("SubMesh " + Ogre::StringConverter::toString(idx) + " for mesh '" + Ogre::String(pNode->mName.data) + "'");
-
-            const aiMaterial *pAIMaterial = mScene->mMaterials[ pAIMesh->mMaterialIndex ];
-            Ogre::MaterialPtr matptr;
-
-            //generates material name
-            Ogre::String matName = Ogre::String(meshFileName.toStdString()+"_generatedMat" + Ogre::StringConverter::toString(pAIMesh->mMaterialIndex)+ ".material");
-            //checks if the material already exist, it might have been generated before to another submesh.
-            matptr = Ogre::MaterialManager::getSingleton().getByName(matName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-
-            if(matptr.isNull())
-            {
-                if(pAIMesh->HasVertexColors(0))
-                    matptr = CreateVertexColorMaterial();
-                else
-                   matptr = CreateMaterial(matName, pAIMaterial, meshFileDiskSource, meshFileName);
-
-                //we must create an OgreMaterialAsset through assetAPI and put the just created
-                //ogre material pointer to it
-                //GenerateTemporaryNonexistingAssetFilename() is used to prevent the "Asset Storage contains ambiguous assets in two different subdirectories!" warning 
-                QString matname = assetAPI->GenerateTemporaryNonexistingAssetFilename(QString::fromStdString(matptr->getName()));
-                AssetPtr assetPtr = assetAPI->CreateNewAsset("OgreMaterial", matname);
-                OgreMaterialAsset *mat = static_cast<OgreMaterialAsset *>(assetPtr.get());
-                mat->ogreMaterial = matptr;
-            }
-
-            Ogre::SubMesh* submesh = mesh->createSubMesh(pNode->mName.data + Ogre::StringConverter::toString(idx));
-            CreateVertexData(Ogre::StringConverter::toString(pNode->mName.data), pNode, pAIMesh, submesh, mAAB);
-            submesh->setMaterialName(matptr->getName());
-        }
-
-        // We must indicate the bounding box
-        mesh->_setBounds(mAAB);
-        mesh->_setBoundingSphereRadius((mAAB.getMaximum()- mAAB.getMinimum()).length()/2.0);
-    }
-
-    // Traverse all child nodes of the current node instance
-
-    for (unsigned int childIdx=0; childIdx<pNode->mNumChildren; childIdx++)
-    {
-        const aiNode *pChildNode = pNode->mChildren[ childIdx ];
-        LoadDataFromNode(mScene, pChildNode, meshFileDiskSource, meshFileName, mesh);
     }
 }
 
@@ -14,6 +14,7 @@ Licensed under the MIT license:
 #include "IAsset.h"
 #include "AssetFwd.h"
 #include "OpenAssetImportApi.h"
+#include "ImportedScene.h"
 
 #include <string>
 #include <OgreMesh.h>
@@ -26,18 +27,8 @@ Licensed under the MIT license:
 #include <QString>
 #include <QObject>
 
-struct boneNode
-{
-    aiNode* node;
-    aiNode* parent;
-    bool isNeeded;
-};
+#include <boost/shared_ptr.hpp>
 
-typedef std::map<Ogre::String, const aiBone*> BoneMap;
-typedef std::map<Ogre::String, boneNode> BoneMapType;
-typedef std::map<Ogre::String, const aiNode*> BoneNodeMap;
-typedef std::map<Ogre::String, aiMatrix4x4> NodeTransformMap;
-typedef std::vector<Ogre::MeshPtr> MeshVector;
 typedef std::map<QString, Ogre::MaterialPtr> TextureMaterialPointerMap;
 typedef std::pair<QString, Ogre::MaterialPtr> TexMatPair;
 
@@ -49,6 +40,11 @@ public:
     OpenAssetImport(AssetAPI *assetApi);
     ~OpenAssetImport();
     /// Converts collada files to ogre meshes, also parses and genarates ogre materials.
+    /** The file is imported with Assimp and converted to vertex and index buffers in a worker thread, and only the
+        hardware buffers, the materials and the textures are created in the main thread on a later frame.
+        The converted mesh is stored in the asset cache, keyed by the hash of the source data, so that later
+        conversions of the same data load the converted mesh without running Assimp.
+        ConversionDone is always emitted after this function has returned. */
     void Convert(const u8 *data_, size_t numBytes, const QString &fileName, const QString &diskSource, Ogre::MeshPtr mesh);
 
 signals:
@@ -56,6 +52,23 @@ signals:
     void ConversionDone(bool success);
 
 private:
+    /// State of a conversion shared with its tasks.
+    struct ConversionJob;
+    typedef boost::shared_ptr<ConversionJob> ConversionJobPtr;
+
+    /// Imports the file, or reads the cached conversion. Run in a worker thread.
+    static void RunConversionJob(const ConversionJobPtr &job);
+    /// Passes the finished job to its importer, unless the importer has been deleted. Run in the main thread.
+    static void FinishConversionJob(const ConversionJobPtr &job);
+
+    /// Queues the tasks of a conversion.
+    void StartConversion(const ConversionJobPtr &job);
+    /// Creates the mesh from the imported scene or the cached conversion.
+    void FinishConversion(const ConversionJobPtr &job);
+    /// Loads the mesh from the converted .mesh file.
+    bool LoadCachedMesh(ConversionJob &job);
+    /// Writes the converted mesh and its materials to the asset cache.
+    void SaveCachedMesh(ConversionJob &job);
     /// Sets texture unit to material.
     void SetTexture(QString &texFile);
     /// Returns if all textures are loaded.
@@ -64,27 +77,17 @@ private:
     QString GetPathToTexture(const QString &meshFileName, const QString &meshFileDiskSource, QString &texturePath);
     /// Loads texture files from disk or requests them from http asset server.
     void LoadTextureFile(QString &filename);
-    /// Creates vertex data to submeshes.
-    bool CreateVertexData(const Ogre::String& name, const aiNode* pNode, const aiMesh *mesh, Ogre::SubMesh* submesh, Ogre::AxisAlignedBox& mAAB);
+    /// Creates the hardware vertex and index buffers of a submesh from the imported buffers.
+    void CreateVertexData(const ImportedSubMesh &imported, Ogre::SubMesh* submesh);
+    /// Returns the material of a submesh, generating it if it does not exist yet.
+    Ogre::MaterialPtr MaterialForSubMesh(const ImportedScene &imported, const ImportedSubMesh &subMesh, const QString &meshFileDiskSource, const QString &meshFileName);
     /// Generates the ogre materials.
-    Ogre::MaterialPtr CreateMaterial(Ogre::String& matName, const aiMaterial* mat, const QString &meshFileDiskSource, const QString &meshFileName);
+    Ogre::MaterialPtr CreateMaterial(Ogre::String& matName, const ImportedMaterial &mat, const QString &meshFileDiskSource, const QString &meshFileName);
     Ogre::MaterialPtr CreateVertexColorMaterial();
-    Ogre::MaterialPtr CreateMaterialByScript(int index, const aiMaterial* mat);
-    void GrabNodeNamesFromNode(const aiScene* mScene,  const aiNode* pNode);
-    void GrabBoneNamesFromNode(const aiScene* mScene,  const aiNode* pNode);
-    void ComputeNodesDerivedTransform(const aiScene* mScene,  const aiNode *pNode, const aiMatrix4x4 accTransform);
-    void CreateBonesFromNode(const aiScene* mScene,  const aiNode* pNode);
-    void CreateBoneHiearchy(const aiScene* mScene,  const aiNode *pNode);
-    void LoadDataFromNode(const aiScene* mScene,  const aiNode *pNode, const QString &meshFileDiskSource, const QString &meshFileName,Ogre::MeshPtr mesh);
-    void MarkAllChildNodesAsNeeded(const aiNode *pNode);
-    void FlagNodeAsNeeded(const char* name);
-    bool IsNodeNeeded(const char* name);
-    void ParseAnimation (const aiScene* mScene, int index, aiAnimation* anim);
-
-    const aiScene *scene;
-    int mLoaderParams;
-    int texCount;
-    Ogre::String mMaterialCode;
+    void CreateBonesFromNode(const ImportedScene &imported, const aiNode* pNode);
+    void CreateBoneHiearchy(const ImportedScene &imported, const aiNode *pNode);
+    void ParseAnimation(const aiScene* mScene, int index, aiAnimation* anim);
+
     Ogre::String mCustomAnimationName;
     Ogre::SkeletonPtr mSkeleton;
     static int msBoneCount;
@@ -97,11 +100,7 @@ private:
     ///Map that holds the corresponding texture name and the ogre material pointer whre the texture belongs.
     TextureMaterialPointerMap texMatMap;
 
-    BoneMapType boneMap;
-    BoneNodeMap mBoneNodesByName;
-    BoneMap mBonesByName;
-    NodeTransformMap mNodeDerivedTransformByName;
-    MeshVector mMeshes;
+    ConversionJobPtr job; ///< The conversion in progress.
 
 private slots:
     void OnTextureLoaded(IAssetTransfer* assetTransfer);
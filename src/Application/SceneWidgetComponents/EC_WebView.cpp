@@ -48,10 +48,14 @@
 
 static int NoneControlID = -1;
 
+/// Render timer interval, in milliseconds, while the panel is paused because it is not visible.
+static const int cPausedRenderPollInterval = 500;
+
 EC_WebView::EC_WebView(Scene *scene) :
     IComponent(scene),
     webview_(0),
     renderTimer_(0),
+    renderIntervalMsec_(0),
     webviewLoading_(false),
     webviewHasContent_(false),
     componentPrepared_(false),
@@ -112,7 +116,7 @@ EC_WebView::EC_WebView(Scene *scene) :
     
     // Prepare render timer
     renderTimer_ = new QTimer(this);
-    connect(renderTimer_, SIGNAL(timeout()), SLOT(Render()), Qt::UniqueConnection);
+    connect(renderTimer_, SIGNAL(timeout()), SLOT(RenderTimerTimeout()), Qt::UniqueConnection);
     resizeRenderTimer_ = new QTimer(this);
     resizeRenderTimer_->setSingleShot(true);
     connect(resizeRenderTimer_, SIGNAL(timeout()), SLOT(RenderDelayed()), Qt::UniqueConnection);
@@ -772,6 +776,7 @@ void EC_WebView::RenderTimerStartOrSingleShot()
             int rateNow = 1000 / getrenderRefreshRate();
             if (rateNow < 40)
                 rateNow = 40; // Max allowed FPS 25 == 40ms timer timeout
+            renderIntervalMsec_ = rateNow;
             renderTimer_->start(rateNow);
         }
         else
@@ -786,6 +791,22 @@ void EC_WebView::RenderTimerStartOrSingleShot()
         ResetWebView();
 }
 
+void EC_WebView::RenderTimerTimeout()
+{
+    if (!renderTimer_)
+        return;
+
+    // Slow down the rendering of panels that appear small in the active camera, and pause the panels
+    // that are not visible or too far away. The timer keeps polling slowly to notice when they come into view.
+    EC_WidgetCanvas *sceneCanvas = GetSceneCanvasComponent();
+    const int interval = (sceneCanvas ? sceneCanvas->AdaptiveUpdateInterval(renderIntervalMsec_) : renderIntervalMsec_);
+    const int timerInterval = (interval < 0 ? cPausedRenderPollInterval : interval);
+    if (timerInterval > 0 && renderTimer_->interval() != timerInterval)
+        renderTimer_->setInterval(timerInterval);
+    if (interval >= 0)
+        Render();
+}
+
 void EC_WebView::TargetMeshReady()
 {
     if (!componentPrepared_)
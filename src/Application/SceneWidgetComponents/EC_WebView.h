@@ -56,7 +56,7 @@ Registered by SceneWidgetComponents plugin.
 <li>int: renderSubmeshIndex
 <div>Sets the submesh index of the entitys EC_Mesh where the browser content will be rendered in the 3D scene object.</div>
 <li>int: renderRefreshRate
-<div>Sets how many times in a second the browser should be rendered (updated) in the 3D scene object. 0 is no automatic updates, then rendering will be done only when browser content is scrolled.</div>
+<div>Sets how many times in a second the browser should be rendered (updated) in the 3D scene object. 0 is no automatic updates, then rendering will be done only when browser content is scrolled. The rate is the maximum: it is lowered when the object appears small in the active camera, rendering is paused while the object is not visible, and only the changed parts of the page are uploaded to the texture.</div>
 <li>bool: interactive
 <div>Sets if this web browser is interactive. This means when you click it you will get a context menu to show 2D browser and to start/stop shared browsing.</div>
 <li>int: controllerId
@@ -222,6 +222,9 @@ private slots:
     /// Starts the update timer, or does a delayed rendering. Depending on the 'renderRefreshRate' value.
     void RenderTimerStartOrSingleShot();
 
+    /// Handler for the update timer. Adapts the timer interval to how large the panel appears in the active camera, and renders unless the panel is paused.
+    void RenderTimerTimeout();
+
     /// Handler when EC_Mesh emits that the mesh is ready.
     void TargetMeshReady();
 
@@ -279,6 +282,9 @@ private:
     /// Internal timer for updating inworld EC_WidgetCanvas.
     QTimer *renderTimer_;
 
+    /// Interval of the update timer, in milliseconds, given by the 'renderRefreshRate' value.
+    int renderIntervalMsec_;
+
     /// Internal time for updating the rendering after a window resize event.
     QTimer *resizeRenderTimer_;
 
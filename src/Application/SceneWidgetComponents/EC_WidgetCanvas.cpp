@@ -8,21 +8,30 @@
 #include "Framework.h"
 #include "IRenderer.h"
 #include "Entity.h"
+#include "Scene.h"
 #include "LoggingFunctions.h"
+#include "Profiler.h"
 
 #include "OgreMaterialUtils.h"
 #include "EC_Mesh.h"
 #include "EC_OgreCustomObject.h"
+#include "OgreWorld.h"
+#include "Renderer.h"
 
 #include <OgreTextureManager.h>
 #include <OgreMaterialManager.h>
 #include <OgreHardwarePixelBuffer.h>
 #include <OgreTechnique.h>
+#include <OgreCamera.h>
+#include <OgreEntity.h>
 
 #include <QWidget>
 #include <QPainter>
 #include <QDebug>
 
+#include <algorithm>
+#include <vector>
+
 #if defined(DIRECTX_ENABLED) && defined(WIN32)
 #ifdef SAFE_DELETE
 #undef SAFE_DELETE
@@ -37,10 +46,40 @@
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+/// Size of the tiles, in pixels, in which consecutive updates are compared.
+const int cTileSize = 64;
+
+/// Maximum number of changed rectangles uploaded separately. More are merged to their bounding rectangle.
+const int cMaxChangedRects = 8;
+
+/// Refresh timer interval, in milliseconds, while the mesh is not visible, for noticing when it becomes visible again.
+const int cPausedPollInterval = 500;
+
+/// Projected size, as a fraction of the viewport height, below which the canvas is not updated.
+const float cMinScreenSize = 0.02f;
+
+/// Screen size based update LOD steps, from the smallest to the largest.
+/** Meshes whose projected size is less than 'screenSize' of the viewport height are updated at 'intervalMultiplier'
+    times the nominal interval. */
+const struct CanvasLodStep
+{
+    float screenSize;
+    int intervalMultiplier;
+} cCanvasLodSteps[] =
+{
+    { 0.05f, 8 },
+    { 0.15f, 4 },
+    { 0.3f, 2 }
+};
+}
+
 EC_WidgetCanvas::EC_WidgetCanvas(Scene *scene) :
     IComponent(scene),
     widget_(0),
     update_internals_(false),
+    full_upload_(true),
     mesh_hooked_(false),
     refresh_timer_(0),
     update_interval_msec_(0),
@@ -49,6 +88,8 @@ EC_WidgetCanvas::EC_WidgetCanvas(Scene *scene) :
 {
     if (framework->IsHeadless())
         return;
+    if (scene)
+        world_ = scene->GetWorld<OgreWorld>();
 	
 	if (framework->Renderer())
     {
@@ -208,7 +249,7 @@ void EC_WidgetCanvas::SetRefreshRate(int refresh_per_second)
     if (refresh_per_second != 0)
     {
         refresh_timer_ = new QTimer(this);
-        connect(refresh_timer_, SIGNAL(timeout()), SLOT(Update()), Qt::UniqueConnection);
+        connect(refresh_timer_, SIGNAL(timeout()), SLOT(RefreshTimeout()), Qt::UniqueConnection);
 
         int temp_msec = 1000 / refresh_per_second;
         if (update_interval_msec_ != temp_msec && was_running)
@@ -294,9 +335,10 @@ void EC_WidgetCanvas::Update(QImage buffer)
             texture->setWidth(buffer.width());
             texture->setHeight(buffer.height());
             texture->createInternalResources();
+            full_upload_ = true;
         }
 
-        Blit(buffer, texture);
+        Upload(buffer, texture);
     }
     catch (Ogre::Exception &e) // inherits std::exception
     {
@@ -329,8 +371,12 @@ void EC_WidgetCanvas::Update()
         if (buffer_.width() <= 0 || buffer_.height() <= 0)
             return;
 
-        QPainter painter(&buffer_);
-        widget_->render(&painter);
+        {
+            PROFILE(EC_WidgetCanvas_RenderWidget);
+            // The painter detaches the buffer from the uploaded image, which is kept for comparison.
+            QPainter painter(&buffer_);
+            widget_->render(&painter);
+        }
 
         // Set texture to material
         if (update_internals_ && !material_name_.empty())
@@ -350,9 +396,10 @@ void EC_WidgetCanvas::Update()
             texture->setWidth(buffer_.width());
             texture->setHeight(buffer_.height());
             texture->createInternalResources();
+            full_upload_ = true;
         }
 
-        Blit(buffer_, texture);
+        Upload(buffer_, texture);
     }
     catch (Ogre::Exception &e) // inherits std::exception
     {
@@ -364,6 +411,136 @@ void EC_WidgetCanvas::Update()
     }
 }
 
+void EC_WidgetCanvas::RefreshTimeout()
+{
+    if (!refresh_timer_)
+        return;
+
+    const int interval = AdaptiveUpdateInterval(update_interval_msec_);
+    const int timerInterval = (interval < 0 ? cPausedPollInterval : interval);
+    if (refresh_timer_->interval() != timerInterval)
+        refresh_timer_->setInterval(timerInterval);
+    if (interval >= 0)
+        Update();
+}
+
+int EC_WidgetCanvas::AdaptiveUpdateInterval(int intervalMsec) const
+{
+    OgreWorldPtr world = world_.lock();
+    Entity *entity = ParentEntity();
+    if (!world || !entity || !world->IsActive())
+        return intervalMsec;
+
+    // OgreWorld caches the visibility query of the active camera, so this is cheap after the first call during a frame.
+    if (!world->IsEntityVisible(entity))
+        return -1;
+
+    EC_Mesh *mesh = entity->GetComponent<EC_Mesh>().get();
+    Ogre::Entity *ogreEntity = (mesh ? mesh->GetEntity() : 0);
+    Ogre::Camera *camera = world->Renderer()->MainOgreCamera();
+    if (!ogreEntity || !camera)
+        return intervalMsec;
+
+    // Projected diameter of the bounding sphere relative to the viewport height.
+    const Ogre::Sphere &bounds = ogreEntity->getWorldBoundingSphere(true);
+    const float distance = camera->getDerivedPosition().distance(bounds.getCenter());
+    if (distance <= bounds.getRadius())
+        return intervalMsec;
+    const float screenSize = bounds.getRadius() / (distance * Ogre::Math::Tan(camera->getFOVy() * 0.5f));
+
+    if (screenSize < cMinScreenSize)
+        return -1;
+    for(size_t i = 0; i < sizeof(cCanvasLodSteps) / sizeof(cCanvasLodSteps[0]); ++i)
+        if (screenSize < cCanvasLodSteps[i].screenSize)
+            return intervalMsec * cCanvasLodSteps[i].intervalMultiplier;
+    return intervalMsec;
+}
+
+void EC_WidgetCanvas::Upload(const QImage &image, Ogre::TexturePtr texture)
+{
+    PROFILE(EC_WidgetCanvas_Upload);
+
+    if (full_upload_ || uploaded_.size() != image.size() || uploaded_.format() != image.format())
+    {
+        if (Blit(image, texture))
+            full_upload_ = false;
+    }
+    else
+    {
+        const QVector<QRect> changed = ChangedRectangles(image);
+        foreach(const QRect &rect, changed)
+            Blit(image, rect, texture);
+    }
+
+    // Shares the data, the next update detaches from it when it paints to its image.
+    uploaded_ = image;
+}
+
+QVector<QRect> EC_WidgetCanvas::ChangedRectangles(const QImage &image) const
+{
+    PROFILE(EC_WidgetCanvas_ChangedRectangles);
+
+    QVector<QRect> rects;
+    const int width = image.width();
+    const int height = image.height();
+    const int tilesX = (width + cTileSize - 1) / cTileSize;
+    std::vector<bool> changed(tilesX);
+
+    for(int tileY = 0; tileY < height; tileY += cTileSize)
+    {
+        const int tileHeight = qMin(cTileSize, height - tileY);
+        std::fill(changed.begin(), changed.end(), false);
+        for(int y = tileY; y < tileY + tileHeight; ++y)
+        {
+            const uchar *current = image.scanLine(y);
+            const uchar *previous = uploaded_.scanLine(y);
+            for(int i = 0; i < tilesX; ++i)
+            {
+                if (changed[i])
+                    continue;
+                const int x = i * cTileSize;
+                const int bytes = qMin(cTileSize, width - x) * 4;
+                if (memcmp(current + x * 4, previous + x * 4, bytes) != 0)
+                    changed[i] = true;
+            }
+        }
+
+        // Merge the changed tiles of the row to spans, and the spans to the same span of the previous row.
+        for(int i = 0; i < tilesX; ++i)
+        {
+            if (!changed[i])
+                continue;
+            int end = i + 1;
+            while(end < tilesX && changed[end])
+                ++end;
+            const QRect span(i * cTileSize, tileY, qMin(end * cTileSize, width) - i * cTileSize, tileHeight);
+            bool merged = false;
+            for(int r = 0; r < rects.size(); ++r)
+            {
+                if (rects[r].left() == span.left() && rects[r].width() == span.width() && rects[r].bottom() + 1 == span.top())
+                {
+                    rects[r].setBottom(span.bottom());
+                    merged = true;
+                    break;
+                }
+            }
+            if (!merged)
+                rects << span;
+            i = end;
+        }
+    }
+
+    if (rects.size() > cMaxChangedRects)
+    {
+        QRect bounds;
+        foreach(const QRect &rect, rects)
+            bounds |= rect;
+        rects.clear();
+        rects << bounds;
+    }
+    return rects;
+}
+
 bool EC_WidgetCanvas::Blit(const QImage &source, Ogre::TexturePtr destination)
 {
 #if defined(DIRECTX_ENABLED) && defined(WIN32)
@@ -406,6 +583,42 @@ bool EC_WidgetCanvas::Blit(const QImage &source, Ogre::TexturePtr destination)
     return true;
 }
 
+bool EC_WidgetCanvas::Blit(const QImage &source, const QRect &rect, Ogre::TexturePtr destination)
+{
+#if defined(DIRECTX_ENABLED) && defined(WIN32)
+    Ogre::HardwarePixelBufferSharedPtr pb = destination->getBuffer();
+    Ogre::D3D9HardwarePixelBuffer *pixelBuffer = dynamic_cast<Ogre::D3D9HardwarePixelBuffer*>(pb.get());
+    if (!pixelBuffer)
+        return false;
+
+    LPDIRECT3DSURFACE9 surface = pixelBuffer->getSurface(Ogre::D3D9RenderSystem::getActiveD3D9Device());
+    if (!surface)
+        return false;
+
+    // Lock only the changed rectangle, the rest of the surface keeps its content.
+    RECT lockRect = { rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1 };
+    D3DLOCKED_RECT lock;
+    HRESULT hr = surface->LockRect(&lock, &lockRect, 0);
+    if (FAILED(hr))
+        return false;
+    const int bytesPerPixel = 4;
+    const int rowBytes = bytesPerPixel * rect.width();
+    for(int y = 0; y < rect.height(); ++y)
+        memcpy((u8*)lock.pBits + lock.Pitch * y, source.scanLine(rect.top() + y) + bytesPerPixel * rect.left(), rowBytes);
+    surface->UnlockRect();
+#else
+    if (destination->getBuffer().isNull())
+        return false;
+
+    // The pixel box spans the whole image, so its subvolume refers to the rows of the rectangle in place.
+    Ogre::PixelBox image(source.width(), source.height(), 1, Ogre::PF_A8R8G8B8, (void*)source.bits());
+    Ogre::Box box(rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1);
+    destination->getBuffer()->blitFromMemory(image.getSubVolume(box), box);
+#endif
+
+    return true;
+}
+
 void EC_WidgetCanvas::UpdateSubmeshes()
 {
     if (framework->IsHeadless())
@@ -4,12 +4,15 @@
 
 #include "SceneWidgetComponentsApi.h"
 #include "IComponent.h"
+#include "OgreModuleFwd.h"
 
 #include <QMap>
 #include <QImage>
 #include <QPointer>
 #include <QWidget>
 #include <QString>
+#include <QVector>
+#include <QRect>
 
 #include <OgreTexture.h>
 
@@ -30,6 +33,10 @@ they need QWidget painting done to a 3D object.
 Paints UI widgets on to a 3D object surface via EC_Mesh and a submesh index.
 So a EC_Mesh needs to be present on the entity this component is used.
 
+Each update is compared to the previous one in tiles, and only the changed parts are uploaded to the texture,
+so a static widget costs no texture uploads. The refresh timer adapts its interval to how large the mesh
+appears in the active camera, and pauses while the mesh is not visible, see AdaptiveUpdateInterval().
+
 Registered by SceneWidgetComponents plugin.
 
 <b>No Attributes</b>
@@ -65,6 +72,11 @@ public:
     explicit EC_WidgetCanvas(Scene *scene);
     ~EC_WidgetCanvas();
 
+    /// Returns the interval, in milliseconds, at which the canvas is worth updating when its nominal interval is @c intervalMsec.
+    /** The interval grows when the mesh covers only a small part of the active camera's view.
+        @return The adjusted interval, or -1 if the mesh is not visible or too small on the screen to be updated at all. */
+    int AdaptiveUpdateInterval(int intervalMsec) const;
+
 public slots:
     void Start();
     void Stop();
@@ -88,6 +100,8 @@ public slots:
 
 private slots:
     bool Blit(const QImage &source, Ogre::TexturePtr destination);
+    bool Blit(const QImage &source, const QRect &rect, Ogre::TexturePtr destination);
+    void RefreshTimeout();
     void WidgetDestroyed(QObject *obj);
     void MeshMaterialsUpdated(uint index, const QString &material_name);
 
@@ -109,6 +123,15 @@ private:
     int update_interval_msec_;
     bool update_internals_;
 
+    /// Uploads the parts of the image that differ from the previously uploaded image.
+    void Upload(const QImage &image, Ogre::TexturePtr texture);
+
+    /// Returns the tiles of the image that differ from the previously uploaded image, merged to rectangles.
+    QVector<QRect> ChangedRectangles(const QImage &image) const;
+
     QImage buffer_;
+    QImage uploaded_; ///< The image currently in the texture, shares its data with the image that was uploaded.
+    bool full_upload_; ///< Does the next update need to upload the whole image, e.g. after the texture was recreated.
     bool mesh_hooked_;
+    OgreWorldWeakPtr world_;
 };
@@ -1417,6 +1417,20 @@ void AssetAPI::Update(f64 frametime)
         // readySubTransfers contains sub asset transfers to loaded bundles. The sub asset loading cannot be completed in RequestAsset
         // as it would trigger signals before the calling code can receive and hook to the AssetTransfer. We delay calling LoadSubAssetToTransfer
         // into this function so that all is hooked and loading can be done normally. This is very similar to the above case for readyTransfers.
+        std::map<QString, QStringList> subAssetNames;
+        for(size_t i = 0; i < readySubTransfers.size(); ++i)
+        {
+            QString subAssetName;
+            ParseAssetRef(readySubTransfers[i].subAssetTransfer->source.ref, 0, 0, 0, 0, 0, 0, 0, &subAssetName);
+            subAssetNames[readySubTransfers[i].parentBundleRef] << subAssetName;
+        }
+        for(std::map<QString, QStringList>::const_iterator iter = subAssetNames.begin(); iter != subAssetNames.end(); ++iter)
+        {
+            AssetBundleMap::iterator bundleIter = assetBundles.find(iter->first);
+            if (bundleIter != assetBundles.end())
+                bundleIter->second->PrefetchSubAssets(iter->second);
+        }
+
         for(size_t i = 0; i < readySubTransfers.size(); ++i)
         {
             AssetTransferPtr subTransfer = readySubTransfers[i].subAssetTransfer;
@@ -1798,6 +1812,16 @@ void AssetAPI::AssetBundleLoadCompleted(IAssetBundle *bundle)
         std::vector<AssetTransferPtr> subTransfers = bundleMonitor->SubAssetTransfers();
         bundleMonitors.erase(monitorIter);
         
+        // Let the bundle start unpacking the sub assets in the order they are loaded below.
+        QStringList subAssetNames;
+        for (std::vector<AssetTransferPtr>::iterator subIter = subTransfers.begin(); subIter != subTransfers.end(); ++subIter)
+        {
+            QString subAssetName;
+            ParseAssetRef((*subIter)->source.ref, 0, 0, 0, 0, 0, 0, 0, &subAssetName);
+            subAssetNames << subAssetName;
+        }
+        bundle->PrefetchSubAssets(subAssetNames);
+
         // Start the load process for all sub asset transfers now. From here on out the normal asset request flow should followed.
         for (std::vector<AssetTransferPtr>::iterator subIter = subTransfers.begin(); subIter != subTransfers.end(); ++subIter)
             LoadSubAssetToTransfer((*subIter), bundle, (*subIter)->source.ref);
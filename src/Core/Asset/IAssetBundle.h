@@ -4,6 +4,7 @@
 
 #include <boost/enable_shared_from_this.hpp>
 #include <QObject>
+#include <QStringList>
 #include <vector>
 
 #include "CoreTypes.h"
@@ -53,6 +54,11 @@ public slots:
         @return Absolute disk source path if available, empty string otherwise.*/
     virtual QString GetSubAssetDiskSource(const QString &subAssetName) = 0;
 
+    /// Tells the bundle which sub assets are going to be requested next, in the order they will be requested.
+    /** Bundles that need to unpack their sub assets can start unpacking them in the background.
+        The default implementation does nothing. */
+    virtual void PrefetchSubAssets(const QStringList & /*subAssetNames*/) {}
+
     /// Returns the type of this asset bundle. The type of an asset cannot change during the lifetime of the instance of an asset.
     QString Type() const;
 
@@ -28,8 +28,44 @@
 
 #include "MemoryLeakCheck.h"
 
+#include <algorithm>
+
 using namespace std;
 
+/// Default maximum number of voices bound to OpenAL sources.
+static const int cDefaultMaxVoices = 32;
+/// Voices with lower audibility than this are never bound to an OpenAL source.
+static const float cInaudibleGain = 0.001f;
+/// Audibility bonus of voices that already have a source, so that voices of similar audibility do not swap sources every frame.
+static const float cVoiceHysteresis = 1.25f;
+
+namespace
+{
+
+/// Orders voices by priority, then by audibility.
+struct VoiceRank
+{
+    VoiceRank(SoundChannel *channel_) :
+        channel(channel_),
+        priority(channel_->Priority()),
+        audibility(channel_->Audibility() * (channel_->IsReal() ? cVoiceHysteresis : 1.f))
+    {
+    }
+
+    bool operator <(const VoiceRank &rhs) const
+    {
+        if (priority != rhs.priority)
+            return priority > rhs.priority;
+        return audibility > rhs.audibility;
+    }
+
+    SoundChannel *channel;
+    int priority;
+    float audibility;
+};
+
+}
+
 struct AudioAPI::AudioApiImpl
 {
 public:
@@ -42,7 +78,15 @@ public:
         captureDevice(0),
         captureSampleSize(0),
         nextChannelId(0),
-        masterGain(0.0f)
+        masterGain(0.0f),
+        maxVoices(cDefaultMaxVoices),
+        deviceMaxSources(0),
+        numRealVoices(0),
+        numVirtualVoices(0),
+        peakRealVoices(0),
+        numPromotions(0),
+        numDemotions(0),
+        numFailedPromotions(0)
     {
     }
 
@@ -70,6 +114,19 @@ public:
     float masterGain;
     /// Master gain for individual sound types
     std::map<SoundChannel::SoundType, float> soundMasterGain;
+
+    /// Maximum number of voices bound to OpenAL sources
+    int maxVoices;
+    /// Number of sources supported by the playback device, 0 if not known
+    int deviceMaxSources;
+    /// Voice statistics of the last update
+    int numRealVoices;
+    int numVirtualVoices;
+    int peakRealVoices;
+    /// Voice statistics since initialization
+    uint numPromotions;
+    uint numDemotions;
+    uint numFailedPromotions;
 };
 
 AudioAPI::AudioAPI(Framework *fw, AssetAPI *assetAPI_)
@@ -97,6 +154,17 @@ assetAPI(assetAPI_)
         LogWarning("Specified multiple --audiodevice parameters. Using \"" + device + "\".");
     Initialize(device);
 
+    QStringList maxVoices = fw->CommandLineParameters("--audioVoices");
+    if (maxVoices.size() > 0)
+    {
+        bool ok;
+        int voices = maxVoices.back().toInt(&ok);
+        if (ok && voices > 0)
+            SetMaxVoices(voices);
+        else
+            LogWarning("Invalid --audioVoices parameter \"" + maxVoices.back() + "\".");
+    }
+
     // Load sound settings. If we have "master_gain" in config we very likely have all the other settings as well.
     if (fw->Config()->HasValue(ConfigAPI::FILE_FRAMEWORK, ConfigAPI::SECTION_SOUND, "master_gain"))
         LoadSoundSettingsFromConfig();
@@ -144,6 +212,15 @@ bool AudioAPI::Initialize(const QString &playbackDeviceName)
     }
        
     alcMakeContextCurrent(impl->context);
+
+    // Query how many sources the device supports, so that the voice manager does not try to allocate more.
+    ALCint monoSources = 0, stereoSources = 0;
+    alcGetIntegerv(impl->device, ALC_MONO_SOURCES, 1, &monoSources);
+    alcGetIntegerv(impl->device, ALC_STEREO_SOURCES, 1, &stereoSources);
+    impl->deviceMaxSources = monoSources + stereoSources;
+    if (impl->deviceMaxSources > 0 && impl->maxVoices > impl->deviceMaxSources)
+        impl->maxVoices = impl->deviceMaxSources;
+
     if (playbackDeviceName.isEmpty())
         LogInfo("Opened default OpenAL playback device.");
     else
@@ -189,6 +266,9 @@ void AudioAPI::Uninitialize()
 
     StopRecording();
     
+    // Release the sources while the context still exists
+    for(SoundChannelMap::iterator i = impl->channels.begin(); i != impl->channels.end(); ++i)
+        i->second->Demote();
     impl->channels.clear();
     
     if (impl->context)
@@ -243,7 +323,7 @@ void AudioAPI::Update(f64 frametime)
     SoundChannelMap::iterator i = impl->channels.begin();
     while(i != impl->channels.end())
     {
-        i->second->Update(impl->listenerPosition);
+        i->second->Update(impl->listenerPosition, frametime);
         if (i->second->State() == SoundChannel::Stopped)
         {
             channelsToDelete.push_back(i);
@@ -251,9 +331,14 @@ void AudioAPI::Update(f64 frametime)
         ++i;
     }
     
-    // Remove stopped channels
+    // Remove stopped channels. Release their sources, as the channel objects may still be held elsewhere.
     for(uint j = 0; j < channelsToDelete.size(); ++j)
-        impl->channels.erase(channelsToDelete[j]);   
+    {
+        channelsToDelete[j]->second->Demote();
+        impl->channels.erase(channelsToDelete[j]);
+    }
+    
+    UpdateVoices();
     
  //   mutex.unlock();
 }
@@ -312,12 +397,7 @@ SoundChannelPtr AudioAPI::PlaySound(AssetPtr audioAsset, SoundChannel::SoundType
     if (!impl || !impl->initialized)
         return SoundChannelPtr();
 
-    if (!channel)
-    {
-        sound_id_t newId = GetNextSoundChannelID();
-        channel = SoundChannelPtr(new SoundChannel(newId, type));
-        impl->channels.insert(make_pair(newId, channel));
-    }
+    channel = PrepareChannel(type, channel);
 
     channel->SetMasterGain(impl->soundMasterGain[type] * impl->masterGain);
     channel->SetPositional(false);
@@ -331,12 +411,7 @@ SoundChannelPtr AudioAPI::PlaySound3D(const float3 &position, AssetPtr audioAsse
     if (!impl || !impl->initialized)
         return SoundChannelPtr();
 
-    if (!channel)
-    {
-        sound_id_t newId = GetNextSoundChannelID();
-        channel = SoundChannelPtr(new SoundChannel(newId, type));
-        impl->channels.insert(make_pair(newId, channel));
-    }
+    channel = PrepareChannel(type, channel);
 
     channel->SetMasterGain(impl->soundMasterGain[type] * impl->masterGain);
     channel->SetPositional(true);
@@ -351,12 +426,7 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer(const SoundBuffer &buffer, SoundChanne
     if (!impl->initialized)
         return SoundChannelPtr();
         
-    if (!channel)
-    {
-        sound_id_t newId = GetNextSoundChannelID();
-        channel = SoundChannelPtr(new SoundChannel(newId, type));
-        impl->channels.insert(make_pair(newId, channel));
-    }
+    channel = PrepareChannel(type, channel);
 
     AudioAssetPtr audioAsset = CreateAudioAssetFromSoundBuffer(buffer);
 
@@ -372,12 +442,7 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer3D(const SoundBuffer &buffer, SoundChan
     if (!impl->initialized)
         return SoundChannelPtr();
         
-    if (!channel)
-    {
-        sound_id_t newId = GetNextSoundChannelID();
-        channel = SoundChannelPtr(new SoundChannel(newId, type));
-        impl->channels.insert(make_pair(newId, channel));
-    }
+    channel = PrepareChannel(type, channel);
 
     AudioAssetPtr audioAsset = CreateAudioAssetFromSoundBuffer(buffer);
 
@@ -389,6 +454,18 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer3D(const SoundBuffer &buffer, SoundChan
     return channel;
 }
 
+SoundChannelPtr AudioAPI::PrepareChannel(SoundChannel::SoundType type, SoundChannelPtr channel)
+{
+    if (!channel)
+    {
+        sound_id_t newId = GetNextSoundChannelID();
+        channel = SoundChannelPtr(new SoundChannel(newId, type));
+    }
+    // A reused channel may have been removed from the channel map when it stopped
+    impl->channels[channel->ChannelId()] = channel;
+    return channel;
+}
+
 void AudioAPI::Stop(SoundChannelPtr channel) const
 {
     if (channel)
@@ -446,6 +523,107 @@ void AudioAPI::ApplyMasterGain()
     }
 }
 
+void AudioAPI::UpdateVoices()
+{
+    PROFILE(AudioAPI_UpdateVoices);
+
+    // Buffered voices can not be virtual, so they are served first. The rest compete for the remaining sources.
+    std::vector<SoundChannel*> selected;
+    std::vector<VoiceRank> candidates;
+    int numVoices = 0;
+    for(SoundChannelMap::iterator i = impl->channels.begin(); i != impl->channels.end(); ++i)
+    {
+        SoundChannel *channel = i->second.get();
+        if (channel->State() == SoundChannel::Stopped)
+            continue;
+        ++numVoices;
+        if (channel->IsBuffered())
+            selected.push_back(channel);
+        else if (channel->IsReady() && channel->Audibility() > cInaudibleGain)
+            candidates.push_back(VoiceRank(channel));
+    }
+
+    int numFree = impl->maxVoices - (int)selected.size();
+    if (numFree > 0 && candidates.size() > 0)
+    {
+        size_t numSelected = std::min((size_t)numFree, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + numSelected, candidates.end());
+        for(size_t j = 0; j < numSelected; ++j)
+            selected.push_back(candidates[j].channel);
+    }
+    std::sort(selected.begin(), selected.end());
+
+    // Demote first to free the sources for the promoted voices
+    for(SoundChannelMap::iterator i = impl->channels.begin(); i != impl->channels.end(); ++i)
+    {
+        SoundChannel *channel = i->second.get();
+        if (channel->IsReal() && !std::binary_search(selected.begin(), selected.end(), channel))
+        {
+            channel->Demote();
+            ++impl->numDemotions;
+        }
+    }
+
+    int numReal = 0;
+    for(size_t j = 0; j < selected.size(); ++j)
+    {
+        if (selected[j]->IsReal())
+            ++numReal;
+        else if (selected[j]->Promote())
+        {
+            ++numReal;
+            ++impl->numPromotions;
+        }
+        else
+            ++impl->numFailedPromotions;
+    }
+
+    impl->numRealVoices = numReal;
+    impl->numVirtualVoices = numVoices - numReal;
+    impl->peakRealVoices = std::max(impl->peakRealVoices, numReal);
+}
+
+int AudioAPI::MaxVoices() const
+{
+    return impl ? impl->maxVoices : 0;
+}
+
+void AudioAPI::SetMaxVoices(int maxVoices)
+{
+    if (!impl)
+        return;
+    if (impl->deviceMaxSources > 0 && maxVoices > impl->deviceMaxSources)
+    {
+        LogWarning("AudioAPI::SetMaxVoices: The playback device supports only " + QString::number(impl->deviceMaxSources) + " sources.");
+        maxVoices = impl->deviceMaxSources;
+    }
+    impl->maxVoices = std::max(maxVoices, 0);
+}
+
+int AudioAPI::NumRealVoices() const
+{
+    return impl ? impl->numRealVoices : 0;
+}
+
+int AudioAPI::NumVirtualVoices() const
+{
+    return impl ? impl->numVirtualVoices : 0;
+}
+
+void AudioAPI::PrintVoiceStatistics() const
+{
+    if (!impl || !impl->initialized)
+    {
+        LogInfo("Audio is not initialized.");
+        return;
+    }
+    LogInfo("Voices: " + QString::number(impl->numRealVoices) + " real, " + QString::number(impl->numVirtualVoices) + " virtual, " +
+        QString::number(impl->maxVoices) + " max, " + QString::number(impl->peakRealVoices) + " peak real.");
+    LogInfo("Device sources: " + (impl->deviceMaxSources > 0 ? QString::number(impl->deviceMaxSources) : QString("unknown")));
+    LogInfo("Promotions: " + QString::number(impl->numPromotions) + ", demotions: " + QString::number(impl->numDemotions) +
+        ", failed promotions: " + QString::number(impl->numFailedPromotions));
+}
+
 QStringList AudioAPI::GetRecordingDevices() const
 {
     QStringList names;
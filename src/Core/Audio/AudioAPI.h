@@ -12,6 +12,11 @@
 class Framework;
 
 /// Enables audio playback functionality.
+/** All playing sound channels are voices, but only the MaxVoices() most important ones are bound to OpenAL sources.
+    Each frame, the voice manager ranks the voices by priority and then by audibility (gain * master gain * distance
+    attenuation). The voices that fall outside the limit, or are inaudible, become virtual: they release their source
+    but keep tracking their playback position, and continue from there when they are promoted back. Channels that are
+    fed with sound buffers (PlaySoundBuffer) can not be virtual and are always given a source first. */
 class AUDIO_API AudioAPI : public QObject
 {
     Q_OBJECT
@@ -135,6 +140,22 @@ public slots:
     /// Get recording device names
     QStringList GetRecordingDevices() const;
 
+    /// Returns the maximum number of voices that are bound to OpenAL sources at the same time.
+    int MaxVoices() const;
+
+    /// Sets the maximum number of voices that are bound to OpenAL sources at the same time.
+    /** The value is clamped to the number of sources the playback device supports. */
+    void SetMaxVoices(int maxVoices);
+
+    /// Returns the number of voices that are currently bound to OpenAL sources.
+    int NumRealVoices() const;
+
+    /// Returns the number of playing or pending voices that currently have no OpenAL source.
+    int NumVirtualVoices() const;
+
+    /// Prints the voice statistics to the console.
+    void PrintVoiceStatistics() const;
+
     /// Create new audio asset directly from sound buffer.
     AudioAssetPtr CreateAudioAssetFromSoundBuffer(const SoundBuffer &buffer) const;
 
@@ -148,6 +169,12 @@ private:
     /// Reapply master gain to all existing channels
     void ApplyMasterGain();
 
+    /// Binds the most important voices to OpenAL sources and makes the rest virtual.
+    void UpdateVoices();
+
+    /// Returns the channel for playing a sound, creating a new one if the given channel is null.
+    SoundChannelPtr PrepareChannel(SoundChannel::SoundType type, SoundChannelPtr channel);
+
     AssetAPI *assetAPI;
 
     struct AudioApiImpl;
@@ -19,8 +19,11 @@
 #include <alc.h>
 #endif
 
+/// By default, .ogg files of more than 256 KB, about 15 seconds of music, are streamed.
+size_t AudioAsset::streamingThreshold = 256 * 1024;
+
 AudioAsset::AudioAsset(AssetAPI *owner, const QString &type_, const QString &name_)
-:IAsset(owner, type_, name_), handle(0)
+:IAsset(owner, type_, name_), handle(0), length(0.0)
 {
 }
 
@@ -36,6 +39,8 @@ void AudioAsset::DoUnload()
         alDeleteBuffers(1, &handle);
         handle = 0;
     }
+    streamData.reset();
+    length = 0.0;
 }
 
 bool AudioAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool allowAsynchronous)
@@ -49,7 +54,10 @@ bool AudioAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool allow
     }
     else if (this->Name().endsWith(".ogg", Qt::CaseInsensitive))
     {
-        loadResult = LoadFromOggVorbisFileInMemory(data, numBytes);
+        if (numBytes > streamingThreshold)
+            loadResult = LoadStreamFromOggVorbisFileInMemory(data, numBytes);
+        else
+            loadResult = LoadFromOggVorbisFileInMemory(data, numBytes);
         if (loadResult)
             assetAPI->AssetLoadCompleted(Name());
     }
@@ -79,6 +87,27 @@ bool AudioAsset::LoadFromOggVorbisFileInMemory(const u8 *data, size_t numBytes)
     return LoadFromRawPCMWavData(&buf.data[0], buf.data.size(), buf.stereo, buf.is16Bit, buf.frequency);
 }
 
+bool AudioAsset::LoadStreamFromOggVorbisFileInMemory(const u8 *data, size_t numBytes)
+{
+    DoUnload();
+
+    if (!data || numBytes == 0)
+    {
+        LogError("Null data passed in AudioAsset::LoadStreamFromOggVorbisFileInMemory!");
+        return false;
+    }
+
+    boost::shared_ptr<std::vector<u8> > fileData(new std::vector<u8>(data, data + numBytes));
+    // Open the stream once to check that the data can be decoded.
+    OggVorbisLoader::OggVorbisStream stream;
+    if (!stream.Open(fileData))
+        return false;
+
+    streamData = fileData;
+    length = stream.Length();
+    return true;
+}
+
 bool AudioAsset::LoadFromRawPCMWavData(const u8 *data, size_t numBytes, bool stereo, bool is16Bit, int frequency)
 {
     // Clean up the previous OpenAL audio buffer handle, if old data existed.
@@ -113,6 +142,7 @@ bool AudioAsset::LoadFromRawPCMWavData(const u8 *data, size_t numBytes, bool ste
         DoUnload();
         return false;
     }
+    length = frequency > 0 ? (double)numBytes / ((stereo ? 2 : 1) * (is16Bit ? 2 : 1) * frequency) : 0.0;
     return true;
 }
 
@@ -143,5 +173,5 @@ bool AudioAsset::CreateBuffer()
 
 bool AudioAsset::IsLoaded() const
 {
-    return handle != 0;
+    return handle != 0 || streamData.get() != 0;
 }
@@ -9,6 +9,8 @@
 #include "SoundBuffer.h"
 
 /// Stores raw decoded audio data ready for playback.
+/** Ogg Vorbis files larger than StreamingThreshold() bytes are not decoded when loaded. Instead, the encoded file is kept
+    in memory and SoundChannel decodes it in a background thread while playing, see IsStreaming(). */
 class AUDIO_API AudioAsset : public IAsset
 {
     Q_OBJECT
@@ -28,6 +30,9 @@ public:
     /// Loads this audio asset from the given .ogg file in memory.
     bool LoadFromOggVorbisFileInMemory(const u8 *data, size_t numBytes);
 
+    /// Loads this audio asset as a streamed .ogg file. The file data is copied and validated, but not decoded.
+    bool LoadStreamFromOggVorbisFileInMemory(const u8 *data, size_t numBytes);
+
     /// Loads this audio asset from the given raw PCM WAV data.
     /// @param data Contains the source data. This data is copied to internal AudioAsset memory, and does not need
     ///    to be stored in memory afterwards.
@@ -48,9 +53,32 @@ public:
 
     bool IsLoaded() const;
 
+    /// Returns the duration of the sound in seconds, or 0 if not loaded.
+    double Length() const { return length; }
+
+    /// Returns true if this asset is played by streaming from the encoded data instead of an OpenAL buffer.
+    bool IsStreaming() const { return streamData.get() != 0; }
+
+    /// Returns the encoded .ogg file data of a streaming asset, or null if the asset is not streaming.
+    const boost::shared_ptr<std::vector<u8> > &StreamData() const { return streamData; }
+
+    /// Returns the encoded size in bytes above which .ogg files are streamed.
+    static size_t StreamingThreshold() { return streamingThreshold; }
+
+    /// Sets the encoded size in bytes above which .ogg files are streamed. Affects only assets loaded afterwards.
+    static void SetStreamingThreshold(size_t numBytes) { streamingThreshold = numBytes; }
+
 private:
     /// The actual sound data is stored in an OpenAL internal audio buffer. This handle specifies the buffer.
     /// If == 0, then this AudioAsset is unloaded.
     ALuint handle;
+
+    /// Duration of the sound in seconds.
+    double length;
+
+    /// The encoded .ogg file data of a streaming asset. Shared with the decoders of the channels playing it.
+    boost::shared_ptr<std::vector<u8> > streamData;
+
+    static size_t streamingThreshold;
 };
 
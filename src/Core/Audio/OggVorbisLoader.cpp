@@ -163,4 +163,118 @@ bool LoadOggVorbisFromFileInMemory(const u8 *fileData, size_t numBytes, std::vec
     return true;
 }
 
+struct OggVorbisStream::Impl
+{
+    Impl(const boost::shared_ptr<std::vector<u8> > &fileData) :
+        data(fileData),
+        source(&(*fileData)[0], fileData->size())
+    {
+    }
+
+    boost::shared_ptr<std::vector<u8> > data;
+    OggMemDataSource source;
+    OggVorbis_File vf;
+};
+
+OggVorbisStream::OggVorbisStream() :
+    impl(0),
+    stereo(false),
+    frequency(0)
+{
+}
+
+OggVorbisStream::~OggVorbisStream()
+{
+    Close();
+}
+
+bool OggVorbisStream::Open(const boost::shared_ptr<std::vector<u8> > &fileData)
+{
+    Close();
+
+    if (!fileData || fileData->empty())
+    {
+        LogError("OggVorbisStream::Open: Null input data passed in");
+        return false;
+    }
+
+    impl = new Impl(fileData);
+
+    ov_callbacks cb;
+    cb.read_func = &OggReadCallback;
+    cb.seek_func = &OggSeekCallback;
+    cb.tell_func = &OggTellCallback;
+    cb.close_func = 0;
+
+    if (ov_open_callbacks(&impl->source, &impl->vf, 0, 0, cb) < 0)
+    {
+        LogError("Not ogg vorbis format");
+        ov_clear(&impl->vf);
+        delete impl;
+        impl = 0;
+        return false;
+    }
+
+    vorbis_info* vi = ov_info(&impl->vf, -1);
+    if (!vi)
+    {
+        LogError("No ogg vorbis stream info");
+        Close();
+        return false;
+    }
+
+    frequency = vi->rate;
+    stereo = (vi->channels > 1);
+    if (vi->channels != 1 && vi->channels != 2)
+        LogWarning("Warning: Streamed Ogg Vorbis data contains an unsupported number of channels: " + QString::number(vi->channels));
+    return true;
+}
+
+void OggVorbisStream::Close()
+{
+    if (impl)
+    {
+        ov_clear(&impl->vf);
+        delete impl;
+        impl = 0;
+    }
+}
+
+size_t OggVorbisStream::Decode(u8 *dst, size_t maxBytes)
+{
+    if (!impl || !dst)
+        return 0;
+
+    size_t decoded_bytes = 0;
+    while(decoded_bytes < maxBytes)
+    {
+        int bitstream;
+        long ret = ov_read(&impl->vf, (char*)dst + decoded_bytes, (int)(maxBytes - decoded_bytes), 0, 2, 1, &bitstream);
+        if (ret == OV_HOLE)
+            continue; // Interruption in the data, skip it.
+        if (ret <= 0)
+            break;
+        decoded_bytes += ret;
+    }
+    return decoded_bytes;
+}
+
+bool OggVorbisStream::Rewind()
+{
+    return impl && ov_raw_seek(&impl->vf, 0) == 0;
+}
+
+bool OggVorbisStream::Seek(double seconds)
+{
+    return impl && ov_time_seek(&impl->vf, seconds) == 0;
+}
+
+double OggVorbisStream::Length() const
+{
+    if (!impl)
+        return 0.0;
+    double length = ov_time_total(&impl->vf, -1);
+    return length > 0.0 ? length : 0.0;
+}
+
 } // ~OggVorbisLoader
@@ -1,6 +1,9 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
+#pragma once
+
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include "CoreTypes.h"
 #include "SoundBuffer.h"
 #include "AudioApiExports.h"
@@ -26,6 +29,49 @@ inline bool AUDIO_API LoadOggVorbisFileToSoundBuffer(const u8 *data, size_t numB
     return LoadOggVorbisFromFileInMemory(data, numBytes, dst.data, &dst.stereo, &dst.is16Bit, &dst.frequency);
 }
 
+/// Incremental decoder of a .ogg file in memory.
+/** Unlike LoadOggVorbisFromFileInMemory, decodes the file in small pieces, so that long sounds can be streamed to
+    the audio device without holding the whole decoded PCM data in memory. The output is always 16 bits per sample. */
+class AUDIO_API OggVorbisStream
+{
+public:
+    OggVorbisStream();
+    ~OggVorbisStream();
+
+    /// Opens the given .ogg file contents for decoding. The stream keeps a reference to the data.
+    /// @return True on success, false if the data is not a valid Ogg Vorbis stream.
+    bool Open(const boost::shared_ptr<std::vector<u8> > &fileData);
+
+    /// Closes the stream and releases the reference to the file data.
+    void Close();
+
+    /// Decodes up to maxBytes of PCM data to dst.
+    /// @return The number of bytes decoded, 0 at the end of the stream or on error.
+    size_t Decode(u8 *dst, size_t maxBytes);
+
+    /// Seeks back to the start of the stream.
+    bool Rewind();
+
+    /// Seeks to the given time in seconds from the start of the stream.
+    bool Seek(double seconds);
+
+    /// Returns the length of the stream in seconds, or 0 if not known.
+    double Length() const;
+
+    bool IsOpen() const { return impl != 0; }
+    bool IsStereo() const { return stereo; }
+    int Frequency() const { return frequency; }
+
+private:
+    struct Impl;
+    Impl *impl;
+    bool stereo;
+    int frequency;
+
+    OggVorbisStream(const OggVorbisStream &);
+    void operator =(const OggVorbisStream &);
+};
+
 /// Returns true the header of the given file in memory matches a .ogg file. \todo Implement this.
 /// bool AUDIO_API IdentifyOggVorbisFileInMemory(const u8 *fileData, size_t numBytes);
 
@@ -2,6 +2,7 @@
 
 #include "DebugOperatorNew.h"
 #include "SoundChannel.h"
+#include "SoundStream.h"
 #include "LoggingFunctions.h"
 #include "Math/MathFunc.h"
 
@@ -19,6 +20,8 @@ static const float cMinimumRollOff = 0.1f;
 static const float cDefaultRollOff = 2.0f;
 static const float cDefaultInnerRadius = 1.0f;
 static const float cDefaultOuterRadius = 50.0f;
+/// Number of OpenAL buffers used by a streaming channel. Each buffer holds one decoded chunk.
+static const int cNumStreamBuffers = 4;
 
 SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type) :
     type_(type),
@@ -34,6 +37,10 @@ SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type) :
     positional_(false),
     looped_(false),
     buffered_mode_(false),
+    real_(false),
+    priority_(0),
+    playback_position_(0.0),
+    stream_format_(0),
     state_(Stopped),
     channelId(channelId_)
 { 
@@ -44,12 +51,28 @@ SoundChannel::~SoundChannel()
     DeleteSource();
 }
 
-void SoundChannel::Update(const float3& listener_pos)
+void SoundChannel::Update(const float3& listener_pos, f64 frametime)
 {
     CalculateAttenuation(listener_pos);
+    if (!real_)
+    {
+        UpdateVirtual(frametime);
+        return;
+    }
+    
     SetAttenuatedGain();
     QueueBuffers();
-    UnqueueBuffers();
+    if (stream_)
+    {
+        UpdateStream();
+        // Streams can not tell their position from the source, as the buffers are requeued
+        ALint playing;
+        alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
+        if (playing == AL_PLAYING)
+            AdvancePosition(frametime);
+    }
+    else
+        UnqueueBuffers();
     
     if (state_ == Playing)
     {
@@ -57,7 +80,8 @@ void SoundChannel::Update(const float3& listener_pos)
         {
             ALint playing;
             alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
-            if (playing != AL_PLAYING)
+            // A stream that has run out of decoded data keeps playing when the decoder catches up
+            if (playing != AL_PLAYING && (!stream_ || stream_->IsFinished()))
             {
                 // Stopped state may trigger removal of audio channel, so don't
                 // do that in buffered mode
@@ -89,6 +113,12 @@ void SoundChannel::Play(AudioAssetPtr audioAsset)
 
 void SoundChannel::AddBuffer(AudioAssetPtr buffer)
 {
+    if (buffer && buffer->IsStreaming())
+    {
+        LogError("SoundChannel::AddBuffer: Streaming audio asset " + buffer->Name() + " can not be added as a buffer");
+        return;
+    }
+    
     pending_sounds_.push_back(buffer);
     
     // Buffered mode should not loop
@@ -141,9 +171,11 @@ void SoundChannel::Stop()
         // Set null buffer to be sure we cleared the buffer queue
         alSourcei(handle_, AL_BUFFER, 0);
     }
+    StopStream();
     
     pending_sounds_.clear();
     playing_sounds_.clear();
+    playback_position_ = 0.0;
     
     state_ = Stopped;
 }
@@ -181,7 +213,10 @@ void SoundChannel::SetLooped(bool enable)
         enable = false;
     
     looped_ = enable;
-    if (handle_)
+    // Streams are looped by the decoder
+    if (stream_)
+        stream_->SetLooped(looped_);
+    else if (handle_)
         alSourcei(handle_, AL_LOOPING, looped_ ? AL_TRUE : AL_FALSE);
 }
 
@@ -290,6 +325,20 @@ void SoundChannel::QueueBuffers()
             pending_sounds_.pop_front();
             continue;
         }
+        if (sound->IsStreaming())
+        {
+            pending_sounds_.pop_front();
+            if (StartStream(sound))
+            {
+                playing_sounds_.push_back(sound);
+                state_ = Playing;
+            }
+            else if (!queued)
+                state_ = Stopped;
+            // A stream occupies the whole source. Sounds pending after it are dropped.
+            pending_sounds_.clear();
+            return;
+        }
         ALuint buffer = sound->GetHandle();
         // If no valid handle yet, cannot play this one, break out
         if (!buffer)
@@ -329,14 +378,19 @@ void SoundChannel::QueueBuffers()
         ALint playing;
         alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
         if (playing != AL_PLAYING)
+        {
+            // Continue from where the voice was when it was virtual
+            if (!buffered_mode_ && playback_position_ > 0.0)
+                alSourcef(handle_, AL_SEC_OFFSET, (ALfloat)playback_position_);
             alSourcePlay(handle_);
+        }
         state_ = Playing;
     }
 }
 
 void SoundChannel::UnqueueBuffers()
 {
-    if (handle_)
+    if (handle_ && !stream_)
     {
         int processed = 0;
         alGetSourcei(handle_, AL_BUFFERS_PROCESSED, &processed);
@@ -360,3 +414,205 @@ void SoundChannel::UnqueueBuffers()
         }
     }
 }
+
+bool SoundChannel::StartStream(AudioAssetPtr sound)
+{
+    // Any previously queued buffers are replaced by the stream
+    alSourceStop(handle_);
+    alSourcei(handle_, AL_BUFFER, 0);
+    playing_sounds_.clear();
+    StopStream();
+    
+    boost::shared_ptr<SoundStream> stream(new SoundStream(sound->StreamData(), looped_, playback_position_));
+    if (!stream->IsValid())
+    {
+        LogError("Could not start streaming sound " + sound->Name());
+        return false;
+    }
+    
+    stream_buffers_.resize(cNumStreamBuffers);
+    alGetError();
+    alGenBuffers(cNumStreamBuffers, &stream_buffers_[0]);
+    if (alGetError() != AL_NONE)
+    {
+        LogError("Could not create OpenAL stream buffers");
+        stream_buffers_.clear();
+        return false;
+    }
+    free_stream_buffers_ = stream_buffers_;
+    
+    stream_ = stream;
+    stream_format_ = stream_->IsStereo() ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+    // The decoder loops the stream, so the source must not loop the individual buffers
+    alSourcei(handle_, AL_LOOPING, AL_FALSE);
+    
+    // Queue whatever the decoder has already produced, playback starts once there is data
+    UpdateStream();
+    return true;
+}
+
+void SoundChannel::UpdateStream()
+{
+    if (!stream_ || !handle_)
+        return;
+    
+    int processed = 0;
+    alGetSourcei(handle_, AL_BUFFERS_PROCESSED, &processed);
+    while(processed--)
+    {
+        ALuint buffer = 0;
+        alSourceUnqueueBuffers(handle_, 1, &buffer);
+        if (buffer)
+            free_stream_buffers_.push_back(buffer);
+    }
+    
+    std::vector<u8> chunk;
+    while(free_stream_buffers_.size() > 0 && stream_->PopChunk(chunk))
+    {
+        ALuint buffer = free_stream_buffers_.back();
+        alGetError();
+        alBufferData(buffer, stream_format_, &chunk[0], chunk.size(), stream_->Frequency());
+        alSourceQueueBuffers(handle_, 1, &buffer);
+        ALenum error = alGetError();
+        if (error != AL_NONE)
+        {
+            LogError("Could not queue OpenAL stream buffer: " + QString::number(error));
+            break;
+        }
+        free_stream_buffers_.pop_back();
+    }
+    
+    // Start playback, or resume it if the source ran out of data before the decoder caught up
+    ALint queued = 0;
+    alGetSourcei(handle_, AL_BUFFERS_QUEUED, &queued);
+    ALint playing;
+    alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
+    if (queued > 0 && playing != AL_PLAYING)
+        alSourcePlay(handle_);
+}
+
+void SoundChannel::StopStream()
+{
+    // Joins the decoder thread
+    stream_.reset();
+    
+    // The buffers must have been detached from the source before deleting them
+    if (stream_buffers_.size() > 0)
+    {
+        alDeleteBuffers(stream_buffers_.size(), &stream_buffers_[0]);
+        stream_buffers_.clear();
+    }
+    free_stream_buffers_.clear();
+}
+
+void SoundChannel::SetPriority(int priority)
+{
+    priority_ = priority;
+}
+
+float SoundChannel::Audibility() const
+{
+    if (positional_)
+        return master_gain_ * gain_ * attenuation_;
+    else
+        return master_gain_ * gain_;
+}
+
+bool SoundChannel::IsReady() const
+{
+    if (state_ == Stopped)
+        return false;
+    if (playing_sounds_.size() > 0)
+        return true;
+    AudioAssetPtr pending = pending_sounds_.size() > 0 ? pending_sounds_.front() : AudioAssetPtr();
+    return pending && pending->IsLoaded();
+}
+
+double SoundChannel::PlaybackPosition() const
+{
+    if (real_ && handle_ && !stream_ && !buffered_mode_ && playing_sounds_.size() > 0)
+    {
+        ALfloat offset = 0.0f;
+        alGetSourcef(handle_, AL_SEC_OFFSET, &offset);
+        return offset;
+    }
+    return playback_position_;
+}
+
+bool SoundChannel::Promote()
+{
+    if (real_)
+        return true;
+    if (!CreateSource())
+        return false;
+    
+    real_ = true;
+    // Queue the pending sound now, starting from the tracked position
+    QueueBuffers();
+    return true;
+}
+
+void SoundChannel::Demote()
+{
+    if (!real_)
+        return;
+    
+    playback_position_ = PlaybackPosition();
+    real_ = false;
+    
+    if (handle_)
+    {
+        alSourceStop(handle_);
+        alSourcei(handle_, AL_BUFFER, 0);
+    }
+    StopStream();
+    
+    // Move the sound back to pending, so that it is queued again when the voice is promoted.
+    // Buffered data is played only once, so it is dropped.
+    if (!buffered_mode_)
+        pending_sounds_.insert(pending_sounds_.begin(), playing_sounds_.begin(), playing_sounds_.end());
+    playing_sounds_.clear();
+    
+    if (handle_)
+    {
+        alDeleteSources(1, &handle_);
+        handle_ = 0;
+    }
+}
+
+void SoundChannel::UpdateVirtual(f64 frametime)
+{
+    // Buffered data waits in the pending queue until the voice is promoted
+    if (state_ == Stopped || buffered_mode_)
+        return;
+    
+    AudioAssetPtr sound = pending_sounds_.size() > 0 ? pending_sounds_.front() : AudioAssetPtr();
+    if (!sound)
+    {
+        Stop();
+        return;
+    }
+    // Wait for the asset to load before starting the clock
+    if (!sound->IsLoaded())
+        return;
+    
+    state_ = Playing;
+    AdvancePosition(frametime);
+}
+
+void SoundChannel::AdvancePosition(f64 frametime)
+{
+    AudioAssetPtr sound = playing_sounds_.size() > 0 ? playing_sounds_.front() : (pending_sounds_.size() > 0 ? pending_sounds_.front() : AudioAssetPtr());
+    double length = sound ? sound->Length() : 0.0;
+    
+    playback_position_ += frametime * pitch_;
+    if (length > 0.0 && playback_position_ >= length)
+    {
+        if (looped_)
+            playback_position_ = fmod(playback_position_, length);
+        else if (!real_)
+            Stop(); // A virtual voice has played to the end
+        else
+            playback_position_ = length;
+    }
+}
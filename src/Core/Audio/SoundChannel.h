@@ -9,7 +9,15 @@
 #include "Math/float3.h"
 #include "AssetFwd.h"
 
+class SoundStream;
+
 /// An OpenAL sound channel (source).
+/** Streaming audio assets (see AudioAsset::IsStreaming) are decoded in a background thread while playing, and the
+    channel queues the decoded data to the source in a few small OpenAL buffers of its own.
+
+    A playing channel is a voice. The voice manager of AudioAPI binds only the most audible voices to OpenAL sources.
+    The rest are virtual: they have no source, but keep track of their playback position, so that they continue from
+    the right place when they are promoted back to a real voice. */
 class AUDIO_API SoundChannel : public QObject, public boost::enable_shared_from_this<SoundChannel>
 {
     Q_OBJECT
@@ -27,6 +35,9 @@ class AUDIO_API SoundChannel : public QObject, public boost::enable_shared_from_
     Q_PROPERTY(float pitch READ Pitch WRITE SetPitch)
     Q_PROPERTY(float gain READ Gain WRITE SetGain)
     Q_PROPERTY(float masterGain READ MasterGain WRITE SetMasterGain)
+    Q_PROPERTY(int priority READ Priority WRITE SetPriority)
+    Q_PROPERTY(bool virtualVoice READ IsVirtual)
+    Q_PROPERTY(double playbackPosition READ PlaybackPosition)
 
 public:
     /// States of sound channels
@@ -72,7 +83,8 @@ public slots:
 
 public:
     /// Per-frame update with new listener position
-    void Update(const float3& listenerPos);
+    /** @param frametime Time elapsed since the previous update in seconds, used to advance the playback position of virtual voices. */
+    void Update(const float3& listenerPos, f64 frametime);
 
     /// Return current state of channel.
     SoundState State() const { return state_; }
@@ -128,11 +140,54 @@ public:
     /// Get master gain.
     float MasterGain() const { return master_gain_; }
 
+    /// Sets the voice priority. When there are more voices than OpenAL sources, voices of higher priority get the sources first.
+    /** Between voices of the same priority, the more audible ones are preferred. Default is 0. */
+    void SetPriority(int priority);
+
+    /// Get voice priority.
+    int Priority() const { return priority_; }
+
+    /// Returns the final gain of the channel: gain * master gain * possible distance attenuation.
+    float Audibility() const;
+
+    /// Returns whether the channel is playing or pending without an OpenAL source.
+    bool IsVirtual() const { return state_ != Stopped && !real_; }
+
+    /// Returns whether the channel is bound to an OpenAL source by the voice manager.
+    bool IsReal() const { return real_; }
+
+    /// Returns whether the channel is fed with sound buffers (AddBuffer). Buffered channels can not be virtual, as they would lose data.
+    bool IsBuffered() const { return buffered_mode_; }
+
+    /// Returns whether the channel has loaded sound data to play.
+    bool IsReady() const;
+
+    /// Returns the playback position of the current sound in seconds.
+    double PlaybackPosition() const;
+
+    /// Binds the channel to an OpenAL source and continues playback from the tracked position.
+    /** Called by the voice manager of AudioAPI. @return False if no source could be created, the channel stays virtual. */
+    bool Promote();
+
+    /// Releases the OpenAL source of the channel, but keeps tracking its playback position.
+    /** Called by the voice manager of AudioAPI. */
+    void Demote();
+
 private:
     /// Queue buffers and start playing
     void QueueBuffers();
     /// Remove processed buffers
     void UnqueueBuffers();
+    /// Start streaming the given streaming audio asset
+    bool StartStream(AudioAssetPtr sound);
+    /// Refill processed stream buffers with decoded data and keep the source playing
+    void UpdateStream();
+    /// Stop the stream decoder and delete the stream buffers
+    void StopStream();
+    /// Advance the playback position of a virtual voice
+    void UpdateVirtual(f64 frametime);
+    /// Advance the tracked playback position, wrapping or stopping at the end of the sound
+    void AdvancePosition(f64 frametime);
     /// Create OpenAL source if one does not exist yet
     bool CreateSource();
     /// Delete OpenAL source
@@ -152,6 +207,14 @@ private:
     std::list<AudioAssetPtr> pending_sounds_;
     /// Currently playing sound buffers
     std::vector<AudioAssetPtr> playing_sounds_;
+    /// Decoder of the currently streamed sound, null if not streaming
+    boost::shared_ptr<SoundStream> stream_;
+    /// OpenAL buffers owned by the channel for streaming
+    std::vector<ALuint> stream_buffers_;
+    /// Stream buffers that are not queued to the source
+    std::vector<ALuint> free_stream_buffers_;
+    /// OpenAL format of the streamed data
+    int stream_format_;
     /// Pitch
     float pitch_;
     /// Gain
@@ -172,6 +235,12 @@ private:
     bool positional_;
     /// Buffered operation flag. Will never report as stopped, unless explicitly stopped
     bool buffered_mode_;
+    /// Real voice flag, set when the voice manager has granted an OpenAL source
+    bool real_;
+    /// Voice priority
+    int priority_;
+    /// Tracked playback position of the current sound in seconds
+    double playback_position_;
     /// Position
     float3 position_;
     /// State 
@@ -0,0 +1,109 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "DebugOperatorNew.h"
+#include "SoundStream.h"
+#include "LoggingFunctions.h"
+#include "MemoryLeakCheck.h"
+
+/// Size of one decoded chunk in bytes, about 0.2 seconds of 44.1 kHz 16-bit stereo.
+static const size_t cChunkSize = 32768;
+/// Maximum number of decoded chunks waiting in the queue.
+static const size_t cMaxQueuedChunks = 4;
+
+SoundStream::SoundStream(const boost::shared_ptr<std::vector<u8> > &fileData, bool looped_, double startTime) :
+    valid(false),
+    looped(looped_),
+    endOfStream(false),
+    stopRequested(false)
+{
+    valid = stream.Open(fileData);
+    if (valid && startTime > 0.0 && !stream.Seek(startTime))
+        LogWarning("SoundStream: Could not seek to " + QString::number(startTime) + " seconds, starting from the beginning.");
+    if (valid)
+        decoderThread = boost::thread(boost::bind(&SoundStream::ThreadMain, this));
+}
+
+SoundStream::~SoundStream()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopRequested = true;
+    }
+    queueNotFull.notify_one();
+    if (decoderThread.joinable())
+        decoderThread.join();
+}
+
+void SoundStream::SetLooped(bool looped_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    looped = looped_;
+}
+
+bool SoundStream::PopChunk(std::vector<u8> &dst)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (chunks.empty())
+            return false;
+        dst.swap(chunks.front());
+        chunks.pop_front();
+    }
+    queueNotFull.notify_one();
+    return true;
+}
+
+bool SoundStream::IsFinished()
+{
+    if (!valid)
+        return true;
+    boost::mutex::scoped_lock lock(mutex);
+    return endOfStream && chunks.empty();
+}
+
+void SoundStream::ThreadMain()
+{
+    std::vector<u8> chunk;
+    for(;;)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            while(!stopRequested && chunks.size() >= cMaxQueuedChunks)
+                queueNotFull.wait(lock);
+            if (stopRequested)
+                return;
+        }
+
+        chunk.resize(cChunkSize);
+        size_t decoded = stream.Decode(&chunk[0], cChunkSize);
+        bool rewound = false;
+        if (decoded < cChunkSize)
+        {
+            bool loop;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                loop = looped;
+            }
+            // Fill the rest of a looped chunk from the start of the stream, so that there is no gap at the loop point.
+            if (loop && stream.Rewind())
+            {
+                rewound = true;
+                decoded += stream.Decode(&chunk[decoded], cChunkSize - decoded);
+            }
+        }
+        chunk.resize(decoded);
+
+        boost::mutex::scoped_lock lock(mutex);
+        if (!chunk.empty())
+        {
+            chunks.push_back(std::vector<u8>());
+            chunks.back().swap(chunk);
+        }
+        // Stop at the end, unless looping. A looped stream that produces nothing after a rewind is broken, so stop it too.
+        if (decoded == 0 || (!rewound && decoded < cChunkSize))
+        {
+            endOfStream = true;
+            return;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <list>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "CoreTypes.h"
+#include "OggVorbisLoader.h"
+
+/// Decodes a streamed Ogg Vorbis sound in a background thread.
+/** The decoder thread keeps a small queue of decoded PCM chunks filled ahead of playback. SoundChannel pops the chunks
+    in the main thread, copies them to OpenAL buffers and queues them to its source, so all OpenAL calls stay in the
+    main thread. Looping is done by the decoder by seeking back to the start of the stream.
+    @cond PRIVATE */
+class SoundStream
+{
+public:
+    /// Opens the given .ogg file contents and starts the decoder thread.
+    /** @param startTime Time in seconds from the start of the stream where decoding starts. */
+    SoundStream(const boost::shared_ptr<std::vector<u8> > &fileData, bool looped, double startTime = 0.0);
+    /// Stops the decoder thread.
+    ~SoundStream();
+
+    /// Returns whether the stream was opened successfully.
+    bool IsValid() const { return valid; }
+
+    bool IsStereo() const { return stream.IsStereo(); }
+    int Frequency() const { return stream.Frequency(); }
+
+    /// Sets whether the decoder starts over at the end of the stream.
+    void SetLooped(bool looped);
+
+    /// Takes the next decoded chunk to dst. Returns false if no chunk is ready.
+    bool PopChunk(std::vector<u8> &dst);
+
+    /// Returns true when the whole stream has been decoded and all the chunks have been taken.
+    bool IsFinished();
+
+private:
+    /// Boost thread entry point.
+    void ThreadMain();
+
+    OggVorbisLoader::OggVorbisStream stream;
+    bool valid;
+
+    boost::thread decoderThread;
+    boost::mutex mutex;
+    boost::condition_variable queueNotFull;
+    std::list<std::vector<u8> > chunks;
+    bool looped;
+    bool endOfStream;
+    bool stopRequested;
+};
+/** @endcond */
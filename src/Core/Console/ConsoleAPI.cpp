@@ -18,13 +18,15 @@
 #include "UiGraphicsView.h"
 #include "LoggingFunctions.h"
 #include "FunctionInvoker.h"
+#include "LogSink.h"
 
 #include <boost/make_shared.hpp>
 
 #include <stdlib.h>
+#include <algorithm>
 
-#include <QFile>
-#include <QTextStream>
+#include <QDateTime>
+#include <QHash>
 
 #include "MemoryLeakCheck.h"
 
@@ -32,9 +34,14 @@ ConsoleAPI::ConsoleAPI(Framework *fw) :
     QObject(fw),
     framework(fw),
     enabledLogChannels(LogLevelErrorWarnInfo),
-    logFile(0),
-    logFileText(0)
+    numSuppressed(0),
+    logStartTime(QDateTime::currentMSecsSinceEpoch())
 {
+    rateLimitsPerSecond[0] = 100; // LogChannelError
+    rateLimitsPerSecond[1] = 100; // LogChannelWarning
+    rateLimitsPerSecond[2] = 0; // LogChannelInfo
+    rateLimitsPerSecond[3] = 0; // LogChannelDebug
+
     if (!fw->IsHeadless())
         consoleWidget = new ConsoleWidget(framework);
 
@@ -46,6 +53,7 @@ ConsoleAPI::ConsoleAPI(Framework *fw) :
     RegisterCommand("clear", "Clears the console log.", this, SLOT(ClearLog()));
     RegisterCommand("loglevel", "Sets the current log level. Call with one of the parameters \"error\", \"warning\", \"info\", or \"debug\".",
         this, SLOT(SetLogLevel(const QString &)));
+    RegisterCommand("flushlog", "Writes the queued messages to the log file.", this, SLOT(FlushLog()));
 
     /// \todo Visual Leak Detector shows a memory leak originating from this allocation although the shellInputThread is released in the destructor. Perhaps a shared pointer is held elsewhere.
     shellInputThread = boost::make_shared<ShellInputThread>();
@@ -56,6 +64,14 @@ ConsoleAPI::ConsoleAPI(Framework *fw) :
     if (logLevel.size() > 1)
         LogWarning("Ignoring multiple --loglevel command line parameters!");
 
+    QStringList rateLimit = fw->CommandLineParameters("--logRateLimit");
+    if (rateLimit.size() >= 1)
+    {
+        int messagesPerSecond = rateLimit.last().toInt();
+        SetLogRateLimit(LogChannelError, messagesPerSecond);
+        SetLogRateLimit(LogChannelWarning, messagesPerSecond);
+    }
+
     QStringList logFile = fw->CommandLineParameters("--logfile");
     if (logFile.size() >= 1)
         SetLogFile(logFile[logFile.size()-1]);
@@ -70,12 +86,12 @@ ConsoleAPI::~ConsoleAPI()
 
 void ConsoleAPI::Reset()
 {
+    ReportSuppressedMessages(true);
     commands.clear();
     inputContext.reset();
     SAFE_DELETE(consoleWidget);
     shellInputThread.reset();
-    SAFE_DELETE(logFileText);
-    SAFE_DELETE(logFile);
+    logSink.reset();
 }
 
 QVariant ConsoleCommand::Invoke(const QStringList &params)
@@ -189,34 +205,25 @@ void ConsoleAPI::ExecuteCommand(const QString &command)
 }
 
 void ConsoleAPI::Print(const QString &message)
+{
+    Output(0, message);
+}
+
+void ConsoleAPI::Output(u32 logChannel, const QString &message)
 {
     if (consoleWidget)
         consoleWidget->PrintToConsole(message);
     ///\todo Temporary hack which appends line ending in case it's not there (output of console commands in headless mode)
     if (!message.endsWith("\n"))
-    {
         printf("%s\n", message.toStdString().c_str());
-        if (logFileText)
-        {
-            (*logFileText) << message << "\n";
-            /// \note If we want to guarantee that each message gets to the log even in the presence of a crash, we must flush()
-            /// after each write. Tested that on Windows 7, if you kill the process using Ctrl-C on command line, or from 
-            /// task manager, the log will not contain all the text, so this is required for correctness.
-            /// But this flush() after each message also causes a *serious* performance drawback.
-            /// One way to try avoiding this issue is to move to using C API for file writing, and at atexit() and other crash 
-            /// handlers, close the file handle gracefully.
-            logFileText->flush(); 
-        }
-    }
     else
-    {
         printf("%s", message.toStdString().c_str());
-        if (logFileText)
-        {
-            (*logFileText) << message;
-            logFileText->flush(); // See comment about flush() above.
-        }
-    }
+
+    // The log file is written in the background, so that file I/O does not stall the caller.
+    // Note that a crash may lose the messages of the last few milliseconds.
+    boost::shared_ptr<LogSink> sink = logSink;
+    if (sink)
+        sink->Write(logChannel, message);
 }
 
 void ConsoleAPI::ListCommands()
@@ -255,24 +262,128 @@ void ConsoleAPI::SetLogFile(const QString &wildCardFilename)
 {
     QString filename = Application::ParseWildCardFilename(wildCardFilename);
     
+    // Closing the previous sink writes its queued messages.
+    logSink.reset();
+
     // An empty log file closes the log output writing.
     if (filename.isEmpty())
-    {
-        SAFE_DELETE(logFileText);
-        SAFE_DELETE(logFile);
         return;
-    }
-    logFile = new QFile(filename);
-    bool isOpen = logFile->open(QIODevice::WriteOnly | QIODevice::Text);
-    if (!isOpen)
-    {
+
+    LogSink::Format format = framework->HasCommandLineParameter("--logJson") ? LogSink::JsonLines : LogSink::PlainText;
+    QStringList maxSize = framework->CommandLineParameters("--logMaxSize");
+    QStringList maxAge = framework->CommandLineParameters("--logMaxAge");
+    QStringList maxFiles = framework->CommandLineParameters("--logMaxFiles");
+    u64 maxBytes = maxSize.size() > 0 ? (u64)(maxSize.last().toDouble() * 1024 * 1024) : 0;
+    uint maxAgeSecs = maxAge.size() > 0 ? (uint)(maxAge.last().toDouble() * 60) : 0;
+    uint numFiles = maxFiles.size() > 0 ? maxFiles.last().toUInt() : 5;
+
+    boost::shared_ptr<LogSink> sink = boost::make_shared<LogSink>(filename, format, maxBytes, maxAgeSecs, numFiles);
+    if (!sink->IsOpen())
         LogError("Failed to open file \"" + filename + "\" for logging! (parsed from string \"" + wildCardFilename + "\")");
-        SAFE_DELETE(logFile);
-    }
     else
     {
         printf("Opened logging file \"%s\".\n", filename.toStdString().c_str());
-        logFileText = new QTextStream(logFile);
+        logSink = sink;
+    }
+}
+
+void ConsoleAPI::FlushLog()
+{
+    ReportSuppressedMessages(true);
+    if (logSink)
+        logSink->Flush();
+}
+
+void ConsoleAPI::SetLogRateLimit(u32 logChannel, int messagesPerSecond)
+{
+    for(int i = 0; i < cNumRateLimitedChannels; ++i)
+        if ((logChannel & (1 << i)) != 0)
+            rateLimitsPerSecond[i] = std::max(messagesPerSecond, 0);
+}
+
+QString ConsoleAPI::MessageTemplate(const QString &message)
+{
+    QString messageTemplate;
+    messageTemplate.reserve(message.size());
+    for(int i = 0; i < message.size(); ++i)
+        if (!message[i].isDigit())
+            messageTemplate.append(message[i]);
+        else if (i == 0 || !message[i-1].isDigit())
+            messageTemplate.append('#');
+    return messageTemplate;
+}
+
+int ConsoleAPI::AdvanceRateLimitWindow(LogRateLimit &limit)
+{
+    int second = (int)((QDateTime::currentMSecsSinceEpoch() - logStartTime) / 1000);
+    int windowSecond = limit.second;
+    // The thread that moves the window forward resets the counters and reports the drops of the previous window.
+    if (second != windowSecond && limit.second.testAndSetOrdered(windowSecond, second))
+    {
+        limit.count = 0;
+        int suppressed = limit.suppressed.fetchAndStoreOrdered(0);
+        numSuppressed.fetchAndAddOrdered(-suppressed);
+        return suppressed;
+    }
+    return 0;
+}
+
+bool ConsoleAPI::CheckRateLimit(u32 logChannel, const QString &message)
+{
+    int index = 0;
+    while(index < cNumRateLimitedChannels && (logChannel & (1 << index)) == 0)
+        ++index;
+    if (index >= cNumRateLimitedChannels || rateLimitsPerSecond[index] <= 0)
+        return true;
+
+    const QString messageTemplate = MessageTemplate(message);
+    LogRateLimit &limit = rateLimits[(qHash(messageTemplate) ^ (uint)index) % cNumRateLimits];
+    int suppressed = AdvanceRateLimitWindow(limit);
+    if (suppressed > 0)
+        ReportSuppressed(limit, suppressed);
+    if (limit.count.fetchAndAddRelaxed(1) >= rateLimitsPerSecond[index])
+    {
+        {
+            QMutexLocker lock(&rateLimitMutex);
+            limit.channel = logChannel;
+            limit.messageTemplate = messageTemplate;
+        }
+        limit.suppressed.ref();
+        numSuppressed.ref();
+        return false;
+    }
+    return true;
+}
+
+void ConsoleAPI::ReportSuppressed(LogRateLimit &limit, int suppressed)
+{
+    u32 channel;
+    QString messageTemplate;
+    {
+        QMutexLocker lock(&rateLimitMutex);
+        channel = limit.channel;
+        messageTemplate = limit.messageTemplate.trimmed();
+    }
+    Output(channel, "Log rate limit suppressed " + QString::number(suppressed) + " messages like: " + messageTemplate);
+}
+
+void ConsoleAPI::ReportSuppressedMessages(bool force)
+{
+    for(int i = 0; i < cNumRateLimits && (int)numSuppressed > 0; ++i)
+    {
+        LogRateLimit &limit = rateLimits[i];
+        if ((int)limit.suppressed <= 0)
+            continue;
+        int suppressed = 0;
+        if (force)
+        {
+            suppressed = limit.suppressed.fetchAndStoreOrdered(0);
+            numSuppressed.fetchAndAddOrdered(-suppressed);
+        }
+        else
+            suppressed = AdvanceRateLimitWindow(limit);
+        if (suppressed > 0)
+            ReportSuppressed(limit, suppressed);
     }
 }
 
@@ -280,6 +391,10 @@ void ConsoleAPI::Update(f64 frametime)
 {
     PROFILE(ConsoleAPI_Update);
 
+    // Report the drops of the rate limited messages that have gone quiet.
+    if ((int)numSuppressed > 0)
+        ReportSuppressedMessages(false);
+
     std::string input = shellInputThread->GetLine();
     if (input.length() > 0)
         ExecuteCommand(input.c_str());
@@ -325,7 +440,8 @@ void ConsoleAPI::Log(u32 logChannel, const QString &message)
     if (!IsLogChannelEnabled(logChannel))
         return;
 
-    Print(message);
+    if (CheckRateLimit(logChannel, message))
+        Output(logChannel, message);
 }
 
 void ConsoleAPI::SetEnabledLogChannels(u32 newChannels)
@@ -13,17 +13,21 @@
 #include <QPointer>
 #include <QObject>
 #include <QMap>
+#include <QAtomicInt>
+#include <QMutex>
 
-class QFile;
-class QTextStream;
 class Framework;
 
 class ConsoleWidget;
 class ShellInputThread;
 class ConsoleCommand;
+class LogSink;
 
 /// Console core API.
 /** Allows printing text to console, executing console commands programmatically and registering new console commands.
+    The log file is written asynchronously by a background thread, see SetLogFile. Each log channel can be rate limited
+    with SetLogRateLimit, so that a warning printed every frame does not flood the log. The limit applies separately to
+    each message template, i.e. the message with its numbers left out, so one noisy message does not hide the others.
     @note Console commands are case-insensitive. */
 class ConsoleAPI : public QObject
 {
@@ -103,8 +107,20 @@ public slots:
     ///    $(USERDOCS) is expanded to Application::UserDocumentsDirectory.
     ///    $(DATE:format) is expanded to show the current time, in this format http://doc.qt.nokia.com/latest/qdatetime.html#toString .
     ///    E.g. $(DATE:yyyyMMdd) gives something like "20110905".
+    /// The file is written in a background thread. It is rotated according to the --logMaxSize, --logMaxAge and --logMaxFiles
+    /// command line parameters, and written as JSON lines if --logJson is specified.
     void SetLogFile(const QString &filename);
 
+    /// Sets the maximum number of messages of each template per second printed to the given log channel. Pass 0 to disable the limit.
+    /// The template of a message is the message with its numbers left out, so e.g. "Entity 12 has gone missing" and
+    /// "Entity 34 has gone missing" share a limit. Messages beyond the limit are dropped. A summary line with the number
+    /// of dropped messages is printed after the second has passed, or at the latest when the log is flushed or closed.
+    /// By default, errors and warnings are limited to 100 messages per second and the other channels are not limited.
+    void SetLogRateLimit(u32 logChannel, int messagesPerSecond);
+
+    /// Prints the pending summaries of dropped messages, and writes the queued log messages to the log file. Blocks until done.
+    void FlushLog();
+
     /// Log printing funtionality for scripts.
     void LogInfo(const QString &message);
     void LogWarning(const QString &message);
@@ -126,8 +142,44 @@ private:
     QPointer<ConsoleWidget> consoleWidget;
     boost::shared_ptr<ShellInputThread> shellInputThread;
     u32 enabledLogChannels; ///< Stores the set of currently active log channels.
-    QFile *logFile; ///< Points to the currently open text file for logging.
-    QTextStream *logFileText;
+    boost::shared_ptr<LogSink> logSink; ///< Writes the log file, null if not logging to file.
+
+    /// Rate limit state of the messages of one template. Updated with atomics, as logging may happen from any thread.
+    struct LogRateLimit
+    {
+        LogRateLimit() : second(0), count(0), suppressed(0), channel(0) {}
+        QAtomicInt second; ///< The second of the current limit window, counted from ConsoleAPI creation.
+        QAtomicInt count; ///< Messages in the current window.
+        QAtomicInt suppressed; ///< Messages dropped and not yet reported.
+        u32 channel; ///< Log channel of the dropped messages. Guarded by rateLimitMutex.
+        QString messageTemplate; ///< Template of the dropped messages. Guarded by rateLimitMutex.
+    };
+    static const int cNumRateLimitedChannels = 4;
+    int rateLimitsPerSecond[cNumRateLimitedChannels]; ///< Messages per second of each template, 0 if not limited. Indexed by the bit number of the LogChannel.
+    /// The message templates are hashed to a fixed number of limits, so that logging does not allocate. Templates that collide share a limit.
+    static const int cNumRateLimits = 512;
+    LogRateLimit rateLimits[cNumRateLimits];
+    QMutex rateLimitMutex; ///< Guards the channels and templates of the dropped messages.
+    QAtomicInt numSuppressed; ///< Messages dropped and not yet reported, over all the limits.
+    qint64 logStartTime; ///< Creation time of ConsoleAPI in milliseconds since epoch, the origin of the rate limit windows.
+
+    /// Returns the message with each run of digits replaced with '#', so that the messages printed from the same place share a rate limit.
+    static QString MessageTemplate(const QString &message);
+
+    /// Moves the rate limit window to the current second. Returns the number of messages dropped before, if the window moved.
+    int AdvanceRateLimitWindow(LogRateLimit &limit);
+
+    /// Returns whether a message on the given channel passes the rate limit of its template.
+    bool CheckRateLimit(u32 logChannel, const QString &message);
+
+    /// Prints a summary line of the messages dropped by a limit.
+    void ReportSuppressed(LogRateLimit &limit, int suppressed);
+
+    /// Prints the summary lines of the messages dropped by the limits whose window has passed, or by all of them if force is true.
+    void ReportSuppressedMessages(bool force);
+
+    /// Prints the message to the console widget, stdout and the log file.
+    void Output(u32 logChannel, const QString &message);
 
 private slots:
     void HandleKeyEvent(KeyEvent *e);
@@ -0,0 +1,224 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   LogSink.cpp
+    @brief  Asynchronous, rotating log file writer. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "LogSink.h"
+#include "LoggingFunctions.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QThread>
+
+#include "MemoryLeakCheck.h"
+
+/// How often the writer thread checks the queue when it is idle.
+static const int cWriterIntervalMsecs = 20;
+/// Maximum number of queued messages. Messages beyond this are dropped rather than growing the queue without limit.
+static const int cMaxPendingMessages = 100000;
+
+namespace
+{
+
+const char *LogChannelName(u32 logChannel)
+{
+    if ((logChannel & LogChannelError) != 0) return "error";
+    if ((logChannel & LogChannelWarning) != 0) return "warning";
+    if ((logChannel & LogChannelInfo) != 0) return "info";
+    if ((logChannel & LogChannelDebug) != 0) return "debug";
+    return "console";
+}
+
+/// Returns the string as a quoted JSON string.
+QString JsonString(const QString &str)
+{
+    QString out;
+    out.reserve(str.length() + 2);
+    out += '"';
+    for(int i = 0; i < str.length(); ++i)
+    {
+        QChar c = str[i];
+        switch(c.unicode())
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c.unicode() < 0x20)
+                out += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+            else
+                out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+}
+
+LogSink::LogSink(const QString &filename_, Format format_, u64 maxBytes_, uint maxAgeSecs_, uint maxFiles_) :
+    filename(filename_),
+    format(format_),
+    maxBytes(maxBytes_),
+    maxAgeSecs(maxAgeSecs_),
+    maxFiles(maxFiles_),
+    file(0),
+    fileBytes(0),
+    fileOpenTime(0),
+    pending(0),
+    dropped(0),
+    stopRequested(0)
+{
+    // The queue always contains a stub entry, so that producers never need to touch the consumer end.
+    tail = new Entry;
+    tail->next = 0;
+    head = tail;
+
+    if (OpenFile())
+        writerThread = boost::thread(boost::bind(&LogSink::ThreadMain, this));
+}
+
+LogSink::~LogSink()
+{
+    stopRequested = 1;
+    if (writerThread.joinable())
+        writerThread.join();
+    else
+        WriteQueued();
+
+    if (file)
+        fclose(file);
+
+    while(tail)
+    {
+        Entry *next = tail->next;
+        delete tail;
+        tail = next;
+    }
+}
+
+void LogSink::Write(u32 logChannel, const QString &message)
+{
+    if (pending.fetchAndAddRelaxed(1) >= cMaxPendingMessages)
+    {
+        pending.fetchAndAddRelaxed(-1);
+        dropped.ref();
+        return;
+    }
+
+    Entry *entry = new Entry;
+    entry->next = 0;
+    entry->time = QDateTime::currentMSecsSinceEpoch();
+    entry->threadId = (quintptr)QThread::currentThreadId();
+    entry->logChannel = logChannel;
+    entry->message = message;
+
+    // Swap the new entry in as the head, then link the previous head to it. The writer sees the entry once it is linked.
+    Entry *prev = head.fetchAndStoreOrdered(entry);
+    prev->next.fetchAndStoreRelease(entry);
+}
+
+void LogSink::Flush()
+{
+    if (!writerThread.joinable())
+        return;
+    while((int)pending > 0)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+}
+
+void LogSink::ThreadMain()
+{
+    for(;;)
+    {
+        bool stop = (int)stopRequested != 0;
+        int written = WriteQueued();
+        if (written > 0 && file)
+            fflush(file);
+        else if (stop)
+            return;
+        else
+            boost::this_thread::sleep(boost::posix_time::milliseconds(cWriterIntervalMsecs));
+    }
+}
+
+int LogSink::WriteQueued()
+{
+    int written = 0;
+    for(;;)
+    {
+        Entry *next = tail->next;
+        if (!next)
+            break;
+        // The next entry becomes the new stub once its message has been written.
+        WriteEntry(*next);
+        next->message.clear();
+        delete tail;
+        tail = next;
+        pending.fetchAndAddRelaxed(-1);
+        ++written;
+    }
+    return written;
+}
+
+void LogSink::WriteEntry(const Entry &entry)
+{
+    if (!file)
+        return;
+
+    if ((maxBytes > 0 && fileBytes >= maxBytes) || (maxAgeSecs > 0 && entry.time - fileOpenTime >= (qint64)maxAgeSecs * 1000))
+        Rotate();
+    if (!file)
+        return;
+
+    QByteArray line;
+    if (format == JsonLines)
+    {
+        QString message = entry.message;
+        while(message.endsWith('\n'))
+            message.chop(1);
+        QString json = "{\"time\":\"" + QDateTime::fromMSecsSinceEpoch(entry.time).toString("yyyy-MM-ddThh:mm:ss.zzz") +
+            "\",\"channel\":\"" + LogChannelName(entry.logChannel) + "\",\"thread\":" + QString::number(entry.threadId) +
+            ",\"message\":" + JsonString(message) + "}\n";
+        line = json.toUtf8();
+    }
+    else
+    {
+        line = entry.message.toUtf8();
+        if (!line.endsWith('\n'))
+            line += '\n';
+    }
+
+    fileBytes += fwrite(line.constData(), 1, line.size(), file);
+}
+
+void LogSink::Rotate()
+{
+    fclose(file);
+    file = 0;
+
+    if (maxFiles == 0)
+        QFile::remove(filename);
+    else
+    {
+        QFile::remove(filename + "." + QString::number(maxFiles));
+        for(uint i = maxFiles - 1; i >= 1; --i)
+            QFile::rename(filename + "." + QString::number(i), filename + "." + QString::number(i + 1));
+        QFile::rename(filename, filename + ".1");
+    }
+
+    OpenFile();
+}
+
+bool LogSink::OpenFile()
+{
+    file = fopen(QFile::encodeName(filename).constData(), "w");
+    fileBytes = 0;
+    fileOpenTime = QDateTime::currentMSecsSinceEpoch();
+    return file != 0;
+}
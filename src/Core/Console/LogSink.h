@@ -0,0 +1,104 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   LogSink.h
+    @brief  Asynchronous, rotating log file writer. */
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <QString>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+
+#include <boost/thread.hpp>
+
+#include <stdio.h>
+
+/// Writes log messages to a file in a background thread.
+/** Messages are pushed to a lock-free multi-producer queue, so logging from any thread never waits for file I/O.
+    The writer thread drains the queue periodically and flushes the file after each batch.
+    The file is rotated when it grows larger than maxBytes or gets older than maxAgeSecs: the current file is renamed
+    to "<filename>.1", the previous "<filename>.1" to "<filename>.2" and so on, keeping at most maxFiles old files.
+    In JSON-lines format, each message is written as one JSON object with the fields time, channel, thread and message.
+    @cond PRIVATE */
+class LogSink
+{
+public:
+    /// Output format of the log file.
+    enum Format
+    {
+        PlainText, ///< Messages as printed to the console.
+        JsonLines ///< One JSON object per line.
+    };
+
+    /// Opens the log file and starts the writer thread.
+    /** @param maxBytes Size limit of one file in bytes, 0 for no limit.
+        @param maxAgeSecs Age limit of one file in seconds, 0 for no limit.
+        @param maxFiles Number of rotated files to keep. */
+    LogSink(const QString &filename, Format format, u64 maxBytes, uint maxAgeSecs, uint maxFiles);
+    /// Writes the queued messages and closes the file.
+    ~LogSink();
+
+    /// Returns whether the log file was opened successfully.
+    bool IsOpen() const { return file != 0; }
+
+    /// Queues a message to be written. Can be called from any thread.
+    /** @param logChannel The LogChannel of the message, or 0 for console output that is not a log message. */
+    void Write(u32 logChannel, const QString &message);
+
+    /// Blocks until all the messages queued so far have been written.
+    void Flush();
+
+    /// Returns the number of messages dropped because the writer could not keep up.
+    uint NumDropped() const { return (int)dropped; }
+
+private:
+    /// Node of the lock-free queue.
+    struct Entry
+    {
+        QAtomicPointer<Entry> next;
+        qint64 time; ///< Milliseconds since epoch.
+        quintptr threadId;
+        u32 logChannel;
+        QString message;
+    };
+
+    /// Boost thread entry point.
+    void ThreadMain();
+
+    /// Writes all the queued messages. Called only in the writer thread. Returns the number of messages written.
+    int WriteQueued();
+
+    /// Writes one message to the file. Called only in the writer thread.
+    void WriteEntry(const Entry &entry);
+
+    /// Closes the file, renames it and the older files, and opens a new file. Called only in the writer thread.
+    void Rotate();
+
+    /// Opens the log file for writing, truncating it.
+    bool OpenFile();
+
+    QString filename;
+    Format format;
+    u64 maxBytes;
+    uint maxAgeSecs;
+    uint maxFiles;
+
+    FILE *file;
+    u64 fileBytes; ///< Bytes written to the current file.
+    qint64 fileOpenTime; ///< Time the current file was opened, in milliseconds since epoch.
+
+    QAtomicPointer<Entry> head; ///< The most recently pushed entry. Producers swap themselves in here.
+    Entry *tail; ///< The consumed stub entry, whose successor is the next entry to write. Accessed only by the writer thread.
+    QAtomicInt pending; ///< Number of queued entries that have not been written yet.
+    QAtomicInt dropped;
+    QAtomicInt stopRequested;
+
+    boost::thread writerThread;
+
+    LogSink(const LogSink &);
+    void operator =(const LogSink &);
+};
+/** @endcond */
@@ -15,13 +15,13 @@
 #include <QPushButton>
 #include <QMap>
 
-class QTreeWidgetItem;
+class QModelIndex;
 class SceneTreeWidget;
 class Framework;
 
 /// Window with tree view showing every entity in a scene.
-/** This class will only handle adding and removing of entities and components and updating
-    their names. The SceneTreeWidget implements most of the functionality. */
+/** This class only handles the search, sorting and visibility controls. SceneTreeModel keeps the tree up to date
+    with the scene, and SceneTreeWidget implements most of the functionality. */
 class SceneStructureWindow : public QWidget
 {
     Q_OBJECT
@@ -66,22 +66,8 @@ protected:
     void changeEvent(QEvent* e);
 
 private:
-    /// Populates tree widget with all entities.
-    void Populate();
-
-    /// Clears tree widget.
-    void Clear();
-
-    /// Creates asset reference items.
-    void CreateAssetReferences();
-
-    /// Clears i.e. deletes all asset reference items.
-    void ClearAssetReferences();
-
-    /// Create asset reference item to the tree widget.
-    /** @param parentItem Parent item, can be entity or component item.
-        @param attr AssetReference attribute. */
-    void CreateAssetItem(QTreeWidgetItem *parentItem, IAttribute *attr);
+    /// Expands the shown items whose child items match the search filter.
+    void ExpandSearchMatches();
 
     Framework *framework; ///< Framework.
     SceneWeakPtr scene; ///< Scene which we are showing the in tree widget currently.
@@ -92,72 +78,21 @@ private:
     QPushButton *expandAndCollapseButton; ///< Expand/collapse all button.
 
 private slots:
-    /// Adds the entity to the tree widget.
-    /** @param entity Entity to be added. */
-    void AddEntity(Entity *entity);
-
-    /// Removes entity from the tree widget.
-    /** @param entity Entity to be removed. */
-    void RemoveEntity(Entity *entity);
-
-    /// Readds entity on server ack.
-    /** @param entity Entity to be readded.
-        @param oldId Old entity id */
-    void AckEntity(Entity *entity, entity_id_t oldId);
-
-    /// Updates temporary state of an entity and its components in the tree widget
-    /** @param entity The entity which temporary state was toggled */
-    void UpdateEntityTemporaryState(Entity *entity);
-
-    /// Adds the entity to the tree widget.
-    /** @param entity Altered entity.
-        @param comp Component which was added. */
-    void AddComponent(Entity *entity, IComponent *comp);
-
-    /// Removes entity from the tree widget.
-    /** @param entity Altered entity.
-        @param comp Component which was removed. */
-    void RemoveComponent(Entity *entity, IComponent *comp);
-
-    /// @overload
-    /** This is called only by EC_DynamicComponent when asset ref attribute is added to it.
-        @param attr AssetReference attribute. */
-    void AddAssetReference(IAttribute *attr);
-
-    /// Removes asset reference from the tree widget.
-    /** This is called only by EC_DynamicComponent when asset ref attribute is removed from it.
-        @param attr AssetReference attribute. */
-    void RemoveAssetReference(IAttribute *attr);
-
-    /// When asset reference attribute changes, update UI accordingly.
-    /** @param attr AssetReference attribute. */
-    void UpdateAssetReference(IAttribute *attr);
-
-    /// Updates entity's name in the tree widget if entity's EC_Name component's "name" attribute has changed.
-    /** EC_Name component's AttributeChanged() signal is connected to this slot.
-        @param attr EC_Name's attribute which was changed. */
-    void UpdateEntityName(IAttribute *attr);
-
-    /// Updates component's name in the tree widget if components name has changed.
-    /** @param oldName Old component name.
-        @param newName New component name. */
-    void UpdateComponentName(const QString &oldName, const QString &newName);
-
     /// Sort items in the tree widget. The outstanding sort order is used.
     /** @param criteria Sorting criteria. Currently tr("ID") and tr("Name") are supported. */
     void Sort(const QString &criteria);
 
-    /// Searches for items containing @c text (case-insensitive) and toggles their visibility.
-    /** If match is found the item is set visible and expanded, otherwise it's hidden.
+    /// Shows only the items containing @c text (case-insensitive), and their parents.
+    /** The items whose children contain the text are expanded.
         @param filter Text used as a filter. */
     void Search(const QString &filter);
 
     /// Expands or collapses the whole tree view, depending on the previous action.
     void ExpandOrCollapseAll();
 
-    /// Checks the expand status to mark it to the expand/collapse button
-    void CheckTreeExpandStatus(QTreeWidgetItem *item);
+    /// Marks the expand/collapse button to collapse when an item is expanded.
+    void OnItemExpanded();
 
-    /// Removes entity from the tree widget by ID
-    void RemoveEntityById(entity_id_t id);
+    /// Checks the expand status to mark it to the expand/collapse button
+    void CheckTreeExpandStatus();
 };
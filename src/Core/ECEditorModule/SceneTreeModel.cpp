@@ -0,0 +1,817 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneTreeModel.cpp
+    @brief  Item model showing the scene structure. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneTreeModel.h"
+#include "SceneTreeWidgetItems.h"
+
+#include "Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+#include "EC_Name.h"
+#include "AssetReference.h"
+#include "Profiler.h"
+
+#include <QFont>
+#include <QBrush>
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+
+/// If the new entities of one batch go to more places in the rows than this, the model is reset instead of inserting the rows.
+const size_t cMaxInsertRanges = 256;
+
+/// Orders the entity items by ID, or by name and then ID.
+struct EntityItemLess
+{
+    EntityItemLess(int column, Qt::SortOrder order) : byName(column == 1), descending(order == Qt::DescendingOrder) {}
+
+    bool operator()(const EntityItem *lhs, const EntityItem *rhs) const
+    {
+        if (descending)
+            std::swap(lhs, rhs);
+        if (byName)
+        {
+            int result = lhs->sortName.compare(rhs->sortName);
+            if (result != 0)
+                return result < 0;
+        }
+        return lhs->Id() < rhs->Id();
+    }
+
+    bool byName;
+    bool descending;
+};
+
+/// Appends the names and values of the asset reference attributes of the component.
+void GetAssetReferences(IComponent *comp, std::vector<std::pair<QString, QString> > &refs)
+{
+    foreach(IAttribute *attr, comp->Attributes())
+    {
+        if (!attr)
+            continue;
+        if (attr->TypeId() == cAttributeAssetReference)
+        {
+            Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
+            if (assetRef)
+                refs.push_back(std::make_pair(attr->Name(), assetRef->Get().ref));
+        }
+        else if (attr->TypeId() == cAttributeAssetReferenceList)
+        {
+            Attribute<AssetReferenceList> *assetRefList = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
+            if (assetRefList)
+            {
+                const AssetReferenceList &list = assetRefList->Get();
+                for(int i = 0; i < list.Size(); ++i)
+                    refs.push_back(std::make_pair(attr->Name(), list[i].ref));
+            }
+        }
+    }
+}
+
+}
+
+SceneTreeModel::SceneTreeModel(QObject *parent) :
+    QAbstractItemModel(parent),
+    showComponents(true),
+    showAssets(true),
+    negation(false),
+    sortColumn(0),
+    sortOrder(Qt::AscendingOrder),
+    rowsDirty(false)
+{
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(0);
+    connect(&flushTimer, SIGNAL(timeout()), SLOT(FlushChanges()));
+}
+
+SceneTreeModel::~SceneTreeModel()
+{
+    DeleteItems();
+}
+
+void SceneTreeModel::SetScene(const ScenePtr &newScene)
+{
+    ScenePtr previous = scene.lock();
+    if (previous == newScene && (newScene || entities.isEmpty()))
+        return;
+    if (previous)
+        disconnect(previous.get(), 0, this, 0);
+
+    beginResetModel();
+    DeleteItems();
+    scene = newScene;
+    if (newScene)
+    {
+        Scene *scenePtr = newScene.get();
+        connect(scenePtr, SIGNAL(EntityCreated(Entity *, AttributeChange::Type)), SLOT(OnEntityCreated(Entity *)));
+        connect(scenePtr, SIGNAL(EntitiesCreated(const QList<Entity *> &, AttributeChange::Type)), SLOT(OnEntitiesCreated(const QList<Entity *> &)));
+        connect(scenePtr, SIGNAL(EntityRemoved(Entity *, AttributeChange::Type)), SLOT(OnEntityRemoved(Entity *)));
+        connect(scenePtr, SIGNAL(EntityAcked(Entity *, entity_id_t)), SLOT(OnEntityAcked(Entity *, entity_id_t)));
+        connect(scenePtr, SIGNAL(EntityTemporaryStateToggled(Entity *)), SLOT(OnEntityChanged(Entity *)));
+        connect(scenePtr, SIGNAL(ComponentAdded(Entity *, IComponent *, AttributeChange::Type)), SLOT(OnComponentChanged(Entity *)));
+        connect(scenePtr, SIGNAL(ComponentRemoved(Entity *, IComponent *, AttributeChange::Type)), SLOT(OnComponentChanged(Entity *)));
+        connect(scenePtr, SIGNAL(AttributeChanged(IComponent *, IAttribute *, AttributeChange::Type)), SLOT(OnAttributeChanged(IComponent *, IAttribute *)));
+        connect(scenePtr, SIGNAL(AttributeAdded(IComponent *, IAttribute *, AttributeChange::Type)), SLOT(OnAttributeChanged(IComponent *, IAttribute *)));
+        connect(scenePtr, SIGNAL(AttributeRemoved(IComponent *, IAttribute *, AttributeChange::Type)), SLOT(OnAttributeChanged(IComponent *, IAttribute *)));
+
+        for(Scene::iterator it = newScene->begin(); it != newScene->end(); ++it)
+        {
+            EntityItem *item = new EntityItem((*it).second);
+            entities.insert(item->Id(), item);
+        }
+        RebuildRows();
+    }
+    endResetModel();
+}
+
+void SceneTreeModel::SetShowComponents(bool show)
+{
+    if (showComponents == show)
+        return;
+    showComponents = show;
+    beginResetModel();
+    RebuildRows();
+    endResetModel();
+}
+
+void SceneTreeModel::SetShowAssetReferences(bool show)
+{
+    if (showAssets == show)
+        return;
+    showAssets = show;
+    beginResetModel();
+    RebuildRows();
+    endResetModel();
+}
+
+void SceneTreeModel::SetFilter(const QString &text)
+{
+    PROFILE(SceneTreeModel_SetFilter);
+
+    QString newFilter = text.trimmed();
+    bool newNegation = newFilter.startsWith('!');
+    if (newNegation)
+        newFilter = newFilter.mid(1);
+    newFilter = newFilter.toLower();
+    if (newFilter.isEmpty())
+        newNegation = false;
+    if (newFilter == filter && newNegation == negation)
+        return;
+
+    // If the new filter contains the previous one, only the entities shown currently can match it.
+    const bool narrowing = !filter.isEmpty() && !negation && !newNegation && newFilter.contains(filter);
+    filter = newFilter;
+    negation = newNegation;
+
+    beginResetModel();
+    if (narrowing)
+    {
+        std::vector<EntityItem *> candidates;
+        candidates.swap(rows);
+        for(size_t i = 0; i < candidates.size(); ++i)
+        {
+            EntityItem *item = candidates[i];
+            item->ClearChildren();
+            item->shown = IsShown(item);
+            if (item->shown)
+                rows.push_back(item);
+        }
+        rowsDirty = true;
+    }
+    else
+        RebuildRows();
+    endResetModel();
+}
+
+bool SceneTreeModel::ChildrenMatchFilter(const QModelIndex &index) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item || filter.isEmpty() || negation)
+        return false;
+
+    if (item->type == SceneTreeItem::EntityItemType)
+    {
+        EntityItem *eItem = static_cast<EntityItem *>(item);
+        UpdateSearchText(eItem);
+        // The filter can not contain the newline separating the entity's own text from the texts of its children.
+        return eItem->searchText.indexOf(filter, eItem->entityTextLength) >= 0;
+    }
+
+    for(size_t i = 0; i < item->children.size(); ++i)
+        if (item->children[i]->Text().toLower().contains(filter))
+            return true;
+    return false;
+}
+
+void SceneTreeModel::SetEntityBold(entity_id_t id, bool bold)
+{
+    if (bold)
+        boldEntities.insert(id);
+    else
+        boldEntities.remove(id);
+
+    EntityItem *item = entities.value(id, 0);
+    if (!item || item->bold == bold)
+        return;
+    item->bold = bold;
+    if (item->shown)
+    {
+        QModelIndex index = EntityIndex(id);
+        emit dataChanged(index, index);
+    }
+}
+
+void SceneTreeModel::ClearBoldEntities()
+{
+    foreach(entity_id_t id, boldEntities)
+        SetEntityBold(id, false);
+}
+
+SceneTreeItem *SceneTreeModel::Item(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<SceneTreeItem *>(index.internalPointer()) : 0;
+}
+
+QModelIndex SceneTreeModel::EntityIndex(entity_id_t id) const
+{
+    EntityItem *item = entities.value(id, 0);
+    if (!item || !item->shown)
+        return QModelIndex();
+    UpdateRows();
+    return createIndex(item->row, 0, item);
+}
+
+QModelIndex SceneTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (row < 0 || column < 0 || column >= columnCount())
+        return QModelIndex();
+
+    if (!parent.isValid())
+        return row < (int)rows.size() ? createIndex(row, column, rows[row]) : QModelIndex();
+
+    SceneTreeItem *parentItem = Item(parent);
+    if (parent.column() != 0)
+        return QModelIndex();
+    EnsureChildren(parentItem);
+    return row < (int)parentItem->children.size() ? createIndex(row, column, parentItem->children[row]) : QModelIndex();
+}
+
+QModelIndex SceneTreeModel::parent(const QModelIndex &index) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item || !item->parent)
+        return QModelIndex();
+
+    SceneTreeItem *parentItem = item->parent;
+    if (parentItem->type == SceneTreeItem::EntityItemType)
+        UpdateRows();
+    return createIndex(parentItem->row, 0, parentItem);
+}
+
+int SceneTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return (int)rows.size();
+    if (parent.column() != 0)
+        return 0;
+
+    SceneTreeItem *item = Item(parent);
+    EnsureChildren(item);
+    return (int)item->children.size();
+}
+
+int SceneTreeModel::columnCount(const QModelIndex &parent) const
+{
+    return 2;
+}
+
+bool SceneTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return !rows.empty();
+    if (parent.column() != 0)
+        return false;
+
+    SceneTreeItem *item = Item(parent);
+    if (item->childrenCreated)
+        return !item->children.empty();
+
+    // Without a filter, an entity with components has component items, so they need not be created yet.
+    if (item->type == SceneTreeItem::EntityItemType && showComponents && filter.isEmpty())
+    {
+        EntityPtr entity = static_cast<EntityItem *>(item)->Entity();
+        return entity && !entity->Components().empty();
+    }
+
+    EnsureChildren(item);
+    return !item->children.empty();
+}
+
+QVariant SceneTreeModel::data(const QModelIndex &index, int role) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item)
+        return QVariant();
+
+    switch(role)
+    {
+    case Qt::DisplayRole:
+        if (index.column() == 0)
+            return item->Text();
+        if (item->type == SceneTreeItem::EntityItemType)
+            return static_cast<EntityItem *>(item)->sortName;
+        return QVariant();
+    case Qt::EditRole:
+        if (item->type == SceneTreeItem::EntityItemType)
+        {
+            EntityPtr entity = static_cast<EntityItem *>(item)->Entity();
+            return entity ? entity->Name() : QString();
+        }
+        return QVariant();
+    case Qt::ForegroundRole:
+        return QBrush(item->TextColor());
+    case Qt::FontRole:
+        if (item->type == SceneTreeItem::EntityItemType && static_cast<EntityItem *>(item)->bold)
+        {
+            QFont font;
+            font.setBold(true);
+            return font;
+        }
+        return QVariant();
+    default:
+        return QVariant();
+    }
+}
+
+bool SceneTreeModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    SceneTreeItem *item = Item(index);
+    if (!item || index.column() != 0 || role != Qt::EditRole || item->type != SceneTreeItem::EntityItemType)
+        return false;
+
+    EntityPtr entity = static_cast<EntityItem *>(item)->Entity();
+    if (!entity)
+        return false;
+    // The item is updated when the scene signals the change of the name.
+    if (entity->Name() != value.toString())
+        entity->SetName(value.toString());
+    return true;
+}
+
+Qt::ItemFlags SceneTreeModel::flags(const QModelIndex &index) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item)
+        return 0;
+    if (item->type == SceneTreeItem::EntityItemType && index.column() == 0)
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable;
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled;
+}
+
+QVariant SceneTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+    if (section == 0)
+        return tr("Scene entities");
+    if (section == 1)
+        return tr("Name");
+    return QVariant();
+}
+
+void SceneTreeModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= columnCount())
+        return;
+
+    PROFILE(SceneTreeModel_Sort);
+
+    sortColumn = column;
+    sortOrder = order;
+
+    emit layoutAboutToBeChanged();
+    std::stable_sort(rows.begin(), rows.end(), EntityItemLess(sortColumn, sortOrder));
+    rowsDirty = true;
+    UpdateRows();
+
+    // Only the rows of the entity items change, the child items keep their rows.
+    QModelIndexList from, to;
+    foreach(const QModelIndex &index, persistentIndexList())
+    {
+        SceneTreeItem *item = Item(index);
+        if (item && item->type == SceneTreeItem::EntityItemType && item->row != index.row())
+        {
+            from << index;
+            to << createIndex(item->row, index.column(), item);
+        }
+    }
+    changePersistentIndexList(from, to);
+    emit layoutChanged();
+}
+
+void SceneTreeModel::FlushChanges()
+{
+    PROFILE(SceneTreeModel_FlushChanges);
+
+    flushTimer.stop();
+    QSet<entity_id_t> created, removed, changed;
+    created.swap(createdEntities);
+    removed.swap(removedEntities);
+    changed.swap(changedEntities);
+
+    ScenePtr s = scene.lock();
+    if (!s)
+        return;
+
+    // Removed entities
+    std::vector<int> removedRows;
+    UpdateRows();
+    foreach(entity_id_t id, removed)
+    {
+        EntityItem *item = entities.value(id, 0);
+        if (item && item->shown)
+            removedRows.push_back(item->row);
+    }
+    RemoveRows(removedRows);
+    foreach(entity_id_t id, removed)
+        delete entities.take(id);
+
+    // An entity created again with the ID of an existing item, e.g. after a removal and an ack, is handled as a change.
+    foreach(entity_id_t id, created)
+        if (entities.contains(id))
+            changed.insert(id);
+
+    // Changed entities
+    std::vector<int> hiddenRows;
+    std::vector<EntityItem *> newRows;
+    bool sortOrderChanged = false;
+    UpdateRows();
+    foreach(entity_id_t id, changed)
+    {
+        EntityItem *item = entities.value(id, 0);
+        if (!item || !item->Entity())
+            continue;
+
+        const QString oldSortName = item->sortName;
+        item->Update();
+        const bool shown = IsShown(item);
+        if (item->shown && !shown)
+            hiddenRows.push_back(item->row);
+        else if (!item->shown && shown)
+            newRows.push_back(item);
+        else if (shown)
+        {
+            if (item->sortName != oldSortName)
+                sortOrderChanged = true;
+            RecreateChildren(item);
+            emit dataChanged(createIndex(item->row, 0, item), createIndex(item->row, columnCount() - 1, item));
+        }
+    }
+    RemoveRows(hiddenRows);
+    if (sortOrderChanged && sortColumn == 1)
+        sort(sortColumn, sortOrder);
+
+    // Created entities
+    foreach(entity_id_t id, created)
+    {
+        if (entities.contains(id))
+            continue;
+        EntityPtr entity = s->GetEntity(id);
+        if (!entity)
+            continue;
+        EntityItem *item = new EntityItem(entity);
+        item->bold = boldEntities.contains(id);
+        entities.insert(id, item);
+        if (IsShown(item))
+            newRows.push_back(item);
+    }
+    InsertItems(newRows);
+}
+
+void SceneTreeModel::DeleteItems()
+{
+    flushTimer.stop();
+    createdEntities.clear();
+    removedEntities.clear();
+    changedEntities.clear();
+    boldEntities.clear();
+    rows.clear();
+    qDeleteAll(entities);
+    entities.clear();
+}
+
+void SceneTreeModel::RebuildRows()
+{
+    rows.clear();
+    rows.reserve(entities.size());
+    for(QHash<entity_id_t, EntityItem *>::const_iterator it = entities.begin(); it != entities.end(); ++it)
+    {
+        EntityItem *item = it.value();
+        item->ClearChildren();
+        item->searchTextValid = false;
+        item->shown = IsShown(item);
+        if (item->shown)
+            rows.push_back(item);
+    }
+    std::sort(rows.begin(), rows.end(), EntityItemLess(sortColumn, sortOrder));
+    rowsDirty = true;
+}
+
+void SceneTreeModel::UpdateRows() const
+{
+    if (!rowsDirty)
+        return;
+    for(size_t i = 0; i < rows.size(); ++i)
+        rows[i]->row = (int)i;
+    rowsDirty = false;
+}
+
+bool SceneTreeModel::IsShown(EntityItem *item) const
+{
+    if (filter.isEmpty())
+        return true;
+    // An entity is shown if it or any of its children matches, so the whole search text can be searched at once.
+    UpdateSearchText(item);
+    return item->searchText.contains(filter) != negation;
+}
+
+void SceneTreeModel::UpdateSearchText(EntityItem *item) const
+{
+    if (item->searchTextValid)
+        return;
+
+    EntityPtr entity = item->Entity();
+    QString text = entity ? EntityItem::EntityText(entity.get()) : QString::number(item->Id());
+    item->entityTextLength = text.length();
+    if (entity && (showComponents || showAssets))
+    {
+        std::vector<std::pair<QString, QString> > refs;
+        const Entity::ComponentMap &components = entity->Components();
+        for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+        {
+            if (showComponents)
+                text += '\n' + ComponentItem::ComponentText(i->second.get());
+            if (showAssets)
+            {
+                refs.clear();
+                GetAssetReferences(i->second.get(), refs);
+                for(size_t j = 0; j < refs.size(); ++j)
+                    text += '\n' + AssetRefItem::AssetRefText(refs[j].first, refs[j].second);
+            }
+        }
+    }
+
+    item->searchText = text.toLower();
+    item->searchTextValid = true;
+}
+
+void SceneTreeModel::EnsureChildren(SceneTreeItem *item) const
+{
+    if (!item->childrenCreated && item->type == SceneTreeItem::EntityItemType)
+        const_cast<SceneTreeModel *>(this)->CreateChildren(static_cast<EntityItem *>(item));
+}
+
+void SceneTreeModel::CreateChildren(EntityItem *item)
+{
+    item->childrenCreated = true;
+    EntityPtr entity = item->Entity();
+    if (!entity)
+        return;
+
+    const Entity::ComponentMap &components = entity->Components();
+    for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+    {
+        IComponent *comp = i->second.get();
+        if (showComponents)
+        {
+            ComponentItem *cItem = new ComponentItem(i->second, item);
+            cItem->childrenCreated = true;
+            const bool childMatches = showAssets && CreateAssetRefItems(comp, cItem);
+            const bool matches = !filter.isEmpty() && cItem->Text().toLower().contains(filter);
+            if (filter.isEmpty() || (matches || childMatches) != negation)
+            {
+                item->AddChild(cItem);
+                connect(comp, SIGNAL(ComponentNameChanged(const QString &, const QString &)),
+                    SLOT(OnComponentNameChanged()), Qt::UniqueConnection);
+            }
+            else
+                delete cItem;
+        }
+        else if (showAssets)
+            CreateAssetRefItems(comp, item);
+    }
+}
+
+bool SceneTreeModel::CreateAssetRefItems(IComponent *comp, SceneTreeItem *parent)
+{
+    std::vector<std::pair<QString, QString> > refs;
+    GetAssetReferences(comp, refs);
+
+    bool anyMatches = false;
+    for(size_t i = 0; i < refs.size(); ++i)
+    {
+        const bool matches = !filter.isEmpty() && AssetRefItem::AssetRefText(refs[i].first, refs[i].second).toLower().contains(filter);
+        anyMatches = anyMatches || matches;
+        if (filter.isEmpty() || matches != negation)
+            parent->AddChild(new AssetRefItem(refs[i].first, refs[i].second, parent));
+    }
+    return anyMatches;
+}
+
+void SceneTreeModel::RecreateChildren(EntityItem *item)
+{
+    if (!item->childrenCreated)
+        return;
+
+    UpdateRows();
+    const QModelIndex index = createIndex(item->row, 0, item);
+    if (!item->children.empty())
+    {
+        beginRemoveRows(index, 0, (int)item->children.size() - 1);
+        std::vector<SceneTreeItem *> oldChildren;
+        oldChildren.swap(item->children);
+        endRemoveRows();
+        for(size_t i = 0; i < oldChildren.size(); ++i)
+            delete oldChildren[i];
+    }
+
+    // Create the children aside, so that the model reports no children until the insertion is signalled.
+    CreateChildren(item);
+    std::vector<SceneTreeItem *> newChildren;
+    newChildren.swap(item->children);
+    if (!newChildren.empty())
+    {
+        beginInsertRows(index, 0, (int)newChildren.size() - 1);
+        item->children.swap(newChildren);
+        endInsertRows();
+    }
+}
+
+void SceneTreeModel::RemoveRows(std::vector<int> &removedRows)
+{
+    if (removedRows.empty())
+        return;
+
+    std::sort(removedRows.begin(), removedRows.end());
+    removedRows.erase(std::unique(removedRows.begin(), removedRows.end()), removedRows.end());
+
+    // Remove contiguous ranges starting from the last one, so that the rows of the remaining ranges stay valid.
+    size_t end = removedRows.size();
+    while(end > 0)
+    {
+        size_t begin = end - 1;
+        while(begin > 0 && removedRows[begin - 1] == removedRows[begin] - 1)
+            --begin;
+
+        const int first = removedRows[begin];
+        const int last = removedRows[end - 1];
+        beginRemoveRows(QModelIndex(), first, last);
+        std::vector<EntityItem *> removedItems(rows.begin() + first, rows.begin() + last + 1);
+        rows.erase(rows.begin() + first, rows.begin() + last + 1);
+        rowsDirty = true;
+        endRemoveRows();
+
+        for(size_t i = 0; i < removedItems.size(); ++i)
+        {
+            removedItems[i]->shown = false;
+            removedItems[i]->ClearChildren();
+        }
+        end = begin;
+    }
+}
+
+void SceneTreeModel::InsertItems(std::vector<EntityItem *> &items)
+{
+    if (items.empty())
+        return;
+
+    EntityItemLess less(sortColumn, sortOrder);
+    std::sort(items.begin(), items.end(), less);
+
+    std::vector<int> positions(items.size());
+    size_t numRanges = 0;
+    for(size_t i = 0; i < items.size(); ++i)
+    {
+        positions[i] = (int)(std::upper_bound(rows.begin(), rows.end(), items[i], less) - rows.begin());
+        if (i == 0 || positions[i] != positions[i - 1])
+            ++numRanges;
+    }
+
+    for(size_t i = 0; i < items.size(); ++i)
+        items[i]->shown = true;
+
+    // Interleaving a large number of new entities with the existing ones is cheaper to do as a reset.
+    if (numRanges > cMaxInsertRanges)
+    {
+        beginResetModel();
+        const size_t oldSize = rows.size();
+        rows.insert(rows.end(), items.begin(), items.end());
+        std::inplace_merge(rows.begin(), rows.begin() + oldSize, rows.end(), less);
+        rowsDirty = true;
+        endResetModel();
+        return;
+    }
+
+    // Insert contiguous ranges starting from the last one, so that the positions of the remaining ranges stay valid.
+    size_t end = items.size();
+    while(end > 0)
+    {
+        size_t begin = end - 1;
+        while(begin > 0 && positions[begin - 1] == positions[end - 1])
+            --begin;
+
+        const int first = positions[begin];
+        beginInsertRows(QModelIndex(), first, first + (int)(end - begin) - 1);
+        rows.insert(rows.begin() + first, items.begin() + begin, items.begin() + end);
+        rowsDirty = true;
+        endInsertRows();
+        end = begin;
+    }
+}
+
+void SceneTreeModel::MarkChanged(entity_id_t id)
+{
+    changedEntities.insert(id);
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void SceneTreeModel::MarkRemoved(entity_id_t id)
+{
+    createdEntities.remove(id);
+    changedEntities.remove(id);
+    removedEntities.insert(id);
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void SceneTreeModel::OnEntityCreated(Entity *entity)
+{
+    // The entities of a bulk creation were already received in OnEntitiesCreated.
+    ScenePtr s = scene.lock();
+    if (s && s->IsSignallingBulkCreation())
+        return;
+
+    createdEntities.insert(entity->Id());
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void SceneTreeModel::OnEntitiesCreated(const QList<Entity *> &newEntities)
+{
+    foreach(Entity *entity, newEntities)
+        createdEntities.insert(entity->Id());
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void SceneTreeModel::OnEntityRemoved(Entity *entity)
+{
+    MarkRemoved(entity->Id());
+}
+
+void SceneTreeModel::OnEntityAcked(Entity *entity, entity_id_t oldId)
+{
+    MarkRemoved(oldId);
+    createdEntities.insert(entity->Id());
+}
+
+void SceneTreeModel::OnEntityChanged(Entity *entity)
+{
+    MarkChanged(entity->Id());
+}
+
+void SceneTreeModel::OnComponentChanged(Entity *entity)
+{
+    MarkChanged(entity->Id());
+}
+
+void SceneTreeModel::OnAttributeChanged(IComponent *comp, IAttribute *attr)
+{
+    // Only the name of the entity and the asset references are shown.
+    const bool assetRef = attr && (attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList);
+    if (comp->TypeId() != EC_Name::TypeIdStatic() && !(showAssets && assetRef))
+        return;
+
+    Entity *entity = comp->ParentEntity();
+    if (entity)
+        MarkChanged(entity->Id());
+}
+
+void SceneTreeModel::OnComponentNameChanged()
+{
+    IComponent *comp = dynamic_cast<IComponent *>(sender());
+    if (comp && comp->ParentEntity())
+        MarkChanged(comp->ParentEntity()->Id());
+}
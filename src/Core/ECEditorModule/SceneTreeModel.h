@@ -0,0 +1,188 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneTreeModel.h
+    @brief  Item model showing the scene structure. */
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+#include <vector>
+
+class SceneTreeItem;
+class EntityItem;
+
+/// Item model showing the entities of a scene, with their components and asset references as child items.
+/** The model is built for large scenes. Each entity has one light item, and the items of its components and asset
+    references are created only when the view asks for them, i.e. when the entity item is expanded.
+
+    The changes signalled by the scene are not applied immediately, but collected and applied together on the next
+    event loop iteration by FlushChanges(). This way e.g. loading a scene or receiving a large number of entities from
+    the server results in a few row insertions instead of one for each entity and component.
+
+    Each entity item keeps a lower case search text containing its own text and the texts of its child items.
+    The text is built when first needed and invalidated when the entity changes, so applying a filter does not
+    create any child items, and narrowing down a filter, e.g. when typing, searches only the entities shown currently.
+
+    The first column shows the items, and the second column contains the entity names for sorting by name. */
+class SceneTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    /// Constructor.
+    /** @param parent Parent object. */
+    explicit SceneTreeModel(QObject *parent = 0);
+
+    /// Destructor.
+    ~SceneTreeModel();
+
+    /// Sets the scene shown by the model.
+    /** @param newScene Scene, or null to clear the model. */
+    void SetScene(const ScenePtr &newScene);
+
+    /// Sets do we show components as children of the entities.
+    void SetShowComponents(bool show);
+
+    /// Sets do we show asset references as children of the components, or of the entities if components are not shown.
+    void SetShowAssetReferences(bool show);
+
+    /// Sets the filter of the shown items.
+    /** Items whose text contains the filter (case-insensitive) are shown, with their parent items.
+        If the filter starts with '!', the items whose text does not contain the rest of the filter are shown.
+        @param text Filter, or empty string to show all items. */
+    void SetFilter(const QString &text);
+
+    /// Returns true if any of the child items of the item at index match the filter.
+    /** Can be used to expand the items whose child items contain the searched text. */
+    bool ChildrenMatchFilter(const QModelIndex &index) const;
+
+    /// Sets the entity item shown in bold.
+    /** @param id Entity ID.
+        @param bold Whether to bold (true) or unbold (false) the item. */
+    void SetEntityBold(entity_id_t id, bool bold);
+
+    /// Unbolds all bolded entity items.
+    void ClearBoldEntities();
+
+    /// Returns the item at index, or null if the index is not valid.
+    /** @note The items are owned by the model. Do not store the pointers over the changes of the scene. */
+    SceneTreeItem *Item(const QModelIndex &index) const;
+
+    /// Returns the index of the item of the entity, or invalid index if the entity is not shown.
+    QModelIndex EntityIndex(entity_id_t id) const;
+
+    /// Returns the number of entities in the model, including the ones not shown due to filtering.
+    int NumEntities() const { return entities.size(); }
+
+    /// QAbstractItemModel override.
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+
+    /// QAbstractItemModel override.
+    QModelIndex parent(const QModelIndex &index) const;
+
+    /// QAbstractItemModel override.
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    /// QAbstractItemModel override.
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+
+    /// QAbstractItemModel override. Does not create the child items if the number of children is known otherwise.
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+
+    /// QAbstractItemModel override.
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    /// QAbstractItemModel override. Renames the entity when its item is edited.
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+
+    /// QAbstractItemModel override.
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+
+    /// QAbstractItemModel override.
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+    /// QAbstractItemModel override. Column 0 sorts the entities by ID and column 1 by name.
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+public slots:
+    /// Applies the pending changes of the scene to the model.
+    /** Called automatically on the next event loop iteration after a change. */
+    void FlushChanges();
+
+private:
+    /// Deletes all items.
+    void DeleteItems();
+
+    /// Recomputes the shown entity items and sorts them. Used only between beginResetModel() and endResetModel().
+    void RebuildRows();
+
+    /// Updates the row numbers of the shown entity items if they have changed.
+    void UpdateRows() const;
+
+    /// Returns whether the entity item passes the filter.
+    bool IsShown(EntityItem *item) const;
+
+    /// Builds the search text of the entity item if it is not up to date.
+    void UpdateSearchText(EntityItem *item) const;
+
+    /// Creates the child items of the item if they have not been created.
+    void EnsureChildren(SceneTreeItem *item) const;
+
+    /// Creates the child items of the entity item that pass the filter.
+    void CreateChildren(EntityItem *item);
+
+    /// Creates the asset reference items of the component that pass the filter as children of the parent item.
+    /** @return True if any of the asset references matches the filter. */
+    bool CreateAssetRefItems(IComponent *comp, SceneTreeItem *parent);
+
+    /// Recreates the child items of a shown entity item after a change.
+    void RecreateChildren(EntityItem *item);
+
+    /// Removes the shown entity items at the rows.
+    void RemoveRows(std::vector<int> &removedRows);
+
+    /// Inserts entity items to their sorted positions in the shown rows.
+    void InsertItems(std::vector<EntityItem *> &items);
+
+    /// Marks the entity changed and schedules FlushChanges().
+    void MarkChanged(entity_id_t id);
+
+    /// Marks the entity removed and schedules FlushChanges().
+    void MarkRemoved(entity_id_t id);
+
+    SceneWeakPtr scene; ///< Scene shown by the model.
+    bool showComponents; ///< Do we show components.
+    bool showAssets; ///< Do we show asset references.
+    QString filter; ///< Lower case filter, without the negation.
+    bool negation; ///< Are the items matching the filter hidden instead of shown.
+    int sortColumn; ///< Column by which the entities are sorted.
+    Qt::SortOrder sortOrder; ///< Sort order of the entities.
+
+    QHash<entity_id_t, EntityItem *> entities; ///< Items of all the entities of the scene, also the ones not shown.
+    std::vector<EntityItem *> rows; ///< Shown entity items in the sort order.
+    mutable bool rowsDirty; ///< Do the row numbers of the shown entity items need to be updated.
+    QSet<entity_id_t> boldEntities; ///< Entities shown in bold.
+
+    QSet<entity_id_t> createdEntities; ///< Entities created since the last FlushChanges().
+    QSet<entity_id_t> removedEntities; ///< Entities removed since the last FlushChanges().
+    QSet<entity_id_t> changedEntities; ///< Entities changed since the last FlushChanges().
+    QTimer flushTimer; ///< Single shot timer triggering FlushChanges().
+
+private slots:
+    void OnEntityCreated(Entity *entity);
+    void OnEntitiesCreated(const QList<Entity *> &newEntities);
+    void OnEntityRemoved(Entity *entity);
+    void OnEntityAcked(Entity *entity, entity_id_t oldId);
+    void OnEntityChanged(Entity *entity);
+    void OnComponentChanged(Entity *entity);
+    void OnAttributeChanged(IComponent *comp, IAttribute *attr);
+    void OnComponentNameChanged();
+};
@@ -2,13 +2,14 @@
     For conditions of distribution and use, see copyright notice in LICENSE
 
     @file   SceneTreeWidget.cpp
-    @brief  Tree widget showing the scene structure. */
+    @brief  Tree view showing the scene structure. */
 
 #include "StableHeaders.h"
 #include "DebugOperatorNew.h"
 
 #include "SceneTreeWidget.h"
 #include "SceneTreeWidgetItems.h"
+#include "SceneTreeModel.h"
 #include "SceneStructureModule.h"
 #include "SupportedFileTypes.h"
 #include "Scene.h"
@@ -79,9 +80,9 @@ void Menu::keyReleaseEvent(QKeyEvent *e)
 // SceneTreeWidget
 
 SceneTreeWidget::SceneTreeWidget(Framework *fw, QWidget *parent) :
-    QTreeWidget(parent),
+    QTreeView(parent),
     framework(fw),
-    showComponents(false),
+    model(new SceneTreeModel(this)),
     historyMaxItemCount(100),
     numberOfInvokeItemsVisible(5),
     fetchReferences(false)
@@ -95,11 +96,14 @@ SceneTreeWidget::SceneTreeWidget(Framework *fw, QWidget *parent) :
     setAllColumnsShowFocus(true);
     //setDefaultDropAction(Qt::MoveAction);
     setDropIndicatorShown(true);
-    setHeaderLabel(tr("Scene entities"));
-    setColumnCount(2);
+    // All rows have the same height, so the view does not need to query the items outside the viewport.
+    setUniformRowHeights(true);
+    setModel(model);
     header()->setSectionHidden(1, true);
 
     connect(this, SIGNAL(doubleClicked(const QModelIndex &)), SLOT(Edit()));
+    connect(model, SIGNAL(modelAboutToBeReset()), SLOT(SaveSelection()));
+    connect(model, SIGNAL(modelReset()), SLOT(RestoreSelection()));
 
     // Create keyboard shortcuts.
     QShortcut *renameShortcut = new QShortcut(QKeySequence(Qt::Key_F2), this);
@@ -112,8 +116,6 @@ SceneTreeWidget::SceneTreeWidget(Framework *fw, QWidget *parent) :
     connect(copyShortcut, SIGNAL(activated()), SLOT(Copy()));
     connect(pasteShortcut, SIGNAL(activated()), SLOT(Paste()));
 
-//    disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *, int)));
-
     LoadInvokeHistory();
 }
 
@@ -135,6 +137,7 @@ SceneTreeWidget::~SceneTreeWidget()
 void SceneTreeWidget::SetScene(const ScenePtr &s)
 {
     scene = s;
+    model->SetScene(s);
 }
 
 void SceneTreeWidget::contextMenuEvent(QContextMenuEvent *e)
@@ -204,7 +207,7 @@ void SceneTreeWidget::dropEvent(QDropEvent *e)
         e->acceptProposedAction();
     }
     else
-        QTreeWidget::dropEvent(e);
+        QTreeView::dropEvent(e);
 }
 
 void SceneTreeWidget::AddAvailableActions(QMenu *menu)
@@ -279,7 +282,7 @@ void SceneTreeWidget::AddAvailableEntityActions(QMenu *menu)
     }
 
     // "Save scene as..." action is possible if we have at least one entity in the scene.
-    bool saveSceneAsPossible = (topLevelItemCount() > 0);
+    bool saveSceneAsPossible = (model->NumEntities() > 0);
     QAction *saveSceneAsAction = 0;
     QAction *exportAllAction = 0;
     if (saveSceneAsPossible)
@@ -484,10 +487,11 @@ void SceneTreeWidget::AddAvailableEntityActions(QMenu *menu)
 SceneTreeWidgetSelection SceneTreeWidget::SelectedItems() const
 {
     SceneTreeWidgetSelection ret;
-    QListIterator<QTreeWidgetItem *> it(selectedItems());
-    while(it.hasNext())
+    foreach(const QModelIndex &index, selectionModel()->selectedIndexes())
     {
-        QTreeWidgetItem *item = it.next();
+        if (index.column() != 0)
+            continue;
+        SceneTreeItem *item = model->Item(index);
         EntityItem *eItem = dynamic_cast<EntityItem *>(item);
         if (eItem)
             ret.entities << eItem;
@@ -685,108 +689,12 @@ void SceneTreeWidget::Rename()
     if (!index.isValid())
         return;
 
+    // The editor shows the name of the entity, and the model renames the entity when the editing is committed.
     SceneTreeWidgetSelection sel = SelectedItems();
-    if (sel.entities.size() == 1)
-    {
-        EntityItem *eItem = sel.entities[0];
-        EntityPtr entity = eItem->Entity();
-        if (entity)
-        {
-            // Disable sorting when renaming so that the item will not jump around in the list.
-            setSortingEnabled(false);
-            // Remove the entity ID from the text when user is editing entity's name.
-            eItem->setText(0, entity->Name());
-//            openPersistentEditor(eItem);
-//            setCurrentIndex(index);
-            edit(index);
-            connect(this->itemDelegate(), SIGNAL(commitData(QWidget*)), SLOT(OnCommitData(QWidget*)), Qt::UniqueConnection);
-            connect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), SLOT(OnItemEdited(QTreeWidgetItem *, int)), Qt::UniqueConnection);
-//            connect(this, SIGNAL(currentItemChanged(QTreeWidgetItem *, QTreeWidgetItem *)), SLOT(CloseEditor(QTreeWidgetItem *,QTreeWidgetItem *)));
-        }
-    }
-/*
-    else if (sel.components.size() == 1)
-    {
-        ComponentItem *cItem = sel.components[0];
-        // Remove the type name from the text when user is editing entity's name.
-        cItem->setText(0, cItem->name);
+    if (sel.entities.size() == 1 && sel.entities[0]->Entity())
         edit(index);
-//        connect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), SLOT(OnItemEdited(QTreeWidgetItem *)), Qt::UniqueConnection);
-    }
-*/
-}
-
-void SceneTreeWidget::OnCommitData(QWidget * editor)
-{
-    QModelIndex index = selectionModel()->currentIndex();
-    if (!index.isValid())
-        return;
-
-    SceneTreeWidgetSelection selection = SelectedItems();
-    if (selection.entities.size() == 1)
-    {
-        EntityItem *entityItem = selection.entities[0];
-        EntityPtr entity = entityItem->Entity();
-        if (entity)
-        {
-            QLineEdit *edit = dynamic_cast<QLineEdit*>(editor);
-            if (edit)
-                // If there are no changes, restore back the previous stripped entity ID from the item, and restore sorting
-                if (edit->text() == entity->Name())
-                {
-                    disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *, int)));
-                    entityItem->SetText(entity.get());
-                    setSortingEnabled(true);
-                }
-        }
-    }
 }
 
-void SceneTreeWidget::OnItemEdited(QTreeWidgetItem *item, int column)
-{
-    if (column != 0)
-        return;
-
-    EntityItem *eItem = dynamic_cast<EntityItem *>(item);
-    if (eItem)
-    {
-        EntityPtr entity = eItem->Entity();
-        assert(entity);
-        if (entity)
-        {
-            QString newName = eItem->text(0);
-            disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *, int)));
-            // We don't need to set item text here. It's done when SceneStructureWindow gets AttributeChanged() signal from Scene.
-            entity->SetName(newName);
-//            closePersistentEditor(item);
-            setSortingEnabled(true);
-            return;
-        }
-    }
-/*
-    ComponentItem *cItem = dynamic_cast<ComponentItem *>(item);
-    EntityItem *parentItem = dynamic_cast<EntityItem *>(cItem->parent());
-    if (cItem && parentItem)
-    {
-        EntityPtr entity = scene->GetEntity(parentItem->id);
-        QString newName = cItem->text(0);
-        disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *)));
-        ComponentPtr component = entity->GetComponent(cItem->typeName, cItem->name);
-        if (component)
-            component->SetName(newName);
-        //cItem->typeName
-    }
-*/
-}
-
-/*
-void SceneTreeWidget::CloseEditor(QTreeWidgetItem *c, QTreeWidgetItem *p)
-{
-//    foreach(EntityItem *eItem, SelectedItems().entities)
-    closePersistentEditor(p);
-}
-*/
-
 void SceneTreeWidget::NewEntity()
 {
     if (scene.expired())
@@ -1416,18 +1324,15 @@ void SceneTreeWidget::ExportAllDialogClosed(int result)
     if (!sel.HasEntities())
     {
         // Export all assets
-        for(int i = 0; i < topLevelItemCount(); ++i)
-        {
-            EntityItem *eItem = dynamic_cast<EntityItem *>(topLevelItem(i));
-            if (eItem)
-                assets.unite(GetAssetRefs(eItem));
-        }
+        ScenePtr scn = scene.lock();
+        for(Scene::iterator it = scn->begin(); it != scn->end(); ++it)
+            assets.unite(GetAssetRefs((*it).second));
     }
     else
     {
         // Export assets for selected entities
         foreach(EntityItem *eItem, sel.entities)
-            assets.unite(GetAssetRefs(eItem));
+            assets.unite(GetAssetRefs(eItem->Entity()));
     }
 
     savedAssets.clear();
@@ -1460,46 +1365,34 @@ void SceneTreeWidget::ExportAllDialogClosed(int result)
     }
 }
 
-QSet<QString> SceneTreeWidget::GetAssetRefs(const EntityItem *eItem) const
+QSet<QString> SceneTreeWidget::GetAssetRefs(const EntityPtr &entity) const
 {
     assert(scene.lock());
     QSet<QString> assets;
 
-    EntityPtr entity = eItem->Entity();
     if (entity)
     {
-        int entityChildCount = eItem->childCount();
-        for(int j = 0; j < entityChildCount; ++j)
-        {
-            ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-            if (!cItem)
-                continue;
-            ComponentPtr comp = cItem->Component();
-            if (!comp)
-                continue;
-
-            const Entity::ComponentMap &components = entity->Components();
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-                foreach(IAttribute *attr, i->second->Attributes())
+        const Entity::ComponentMap &components = entity->Components();
+        for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+            foreach(IAttribute *attr, i->second->Attributes())
+            {
+                if (!attr)
+                    continue;
+
+                if (attr->TypeName() == "assetreference")
                 {
-                    if (!attr)
-                        continue;
-                    
-                    if (attr->TypeName() == "assetreference")
-                    {
-                        Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
-                        if (assetRef)
-                            assets.insert(assetRef->Get().ref);
-                    }
-                    else if (attr->TypeName() == "assetreferencelist")
-                    {
-                        Attribute<AssetReferenceList> *assetRefs = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
-                        if (assetRefs)
-                            for(int i = 0; i < assetRefs->Get().Size(); ++i)
-                                assets.insert(assetRefs->Get()[i].ref);
-                    }
+                    Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
+                    if (assetRef)
+                        assets.insert(assetRef->Get().ref);
                 }
-        }
+                else if (attr->TypeName() == "assetreferencelist")
+                {
+                    Attribute<AssetReferenceList> *assetRefs = dynamic_cast<Attribute<AssetReferenceList> *>(attr);
+                    if (assetRefs)
+                        for(int i = 0; i < assetRefs->Get().Size(); ++i)
+                            assets.insert(assetRefs->Get()[i].ref);
+                }
+            }
     }
 
     return assets;
@@ -1761,8 +1654,26 @@ void SceneTreeWidget::SetAsTemporary(bool temporary)
 {
     foreach(EntityItem *item, SelectedItems().entities)
         if (item->Entity())
-        {
             item->Entity()->SetTemporary(temporary);
-            item->SetText(item->Entity().get());
-        }
+}
+
+void SceneTreeWidget::SaveSelection()
+{
+    selectionBeforeReset.clear();
+    foreach(EntityItem *item, SelectedItems().entities)
+        selectionBeforeReset.append(item->Id());
+}
+
+void SceneTreeWidget::RestoreSelection()
+{
+    QItemSelection selection;
+    foreach(entity_id_t id, selectionBeforeReset)
+    {
+        QModelIndex index = model->EntityIndex(id);
+        if (index.isValid())
+            selection.select(index, index);
+    }
+    selectionBeforeReset.clear();
+    if (!selection.isEmpty())
+        selectionModel()->select(selection, QItemSelectionModel::Select);
 }
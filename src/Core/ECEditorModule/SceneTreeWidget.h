@@ -10,7 +10,7 @@
 #include "SceneFwd.h"
 #include "AssetFwd.h"
 
-#include <QTreeWidget>
+#include <QTreeView>
 #include <QPointer>
 #include <QMenu>
 
@@ -20,7 +20,7 @@ class QFileDialog;
 class ECEditorWindow;
 class IArgumentType;
 class IAssetTransfer;
-class EntityItem;
+class SceneTreeModel;
 
 struct InvokeItem;
 struct SceneTreeWidgetSelection;
@@ -47,8 +47,9 @@ private:
 };
 /// @endcond
 
-/// Tree widget showing the scene structure.
-class SceneTreeWidget : public QTreeWidget
+/// Tree view showing the scene structure.
+/** The items are provided by SceneTreeModel, which is owned by the view. */
+class SceneTreeWidget : public QTreeView
 {
     Q_OBJECT
 
@@ -65,8 +66,8 @@ public:
     /** @param scene Scene which contents we want to modify. */
     void SetScene(const ScenePtr &scene);
 
-    /// Do we show components in the tree widget or not.
-    bool showComponents;
+    /// Returns the model of the tree view.
+    SceneTreeModel *Model() const { return model; }
 
 protected:
     /// QAbstractItemView override.
@@ -109,10 +110,12 @@ private:
     /// Return most recently used InvokeItem.
     InvokeItem *FindMruItem();
 
-    /// Returns all asset references for the specified entity item.
-    QSet<QString> GetAssetRefs(const EntityItem *eItem) const;
+    /// Returns all asset references for the specified entity.
+    QSet<QString> GetAssetRefs(const EntityPtr &entity) const;
 
     Framework *framework; ///< Framework pointer.
+    SceneTreeModel *model; ///< Model of the tree view.
+    QList<entity_id_t> selectionBeforeReset; ///< Selected entities while the model is being reset.
     SceneWeakPtr scene; ///< Scene which we are showing the in tree widget currently.
     QList<QPointer<ECEditorWindow> > ecEditors; ///< This EC editors owned by this widget.
     int historyMaxItemCount; ///< Maximum count of invoke history items.
@@ -141,14 +144,11 @@ private slots:
     /// Renames selected entity.
     void Rename();
 
-    /// Sets new name for item (entity or component) when it's renamed.
-    /** @item The item which was renamed. */
-    void OnItemEdited(QTreeWidgetItem *item, int);
+    /// Stores the selected entities before the model is reset.
+    void SaveSelection();
 
-    /// Used to restore the entity ID in case the rename action does not make changes to the editing
-    /** @editor The editor widget (QLineEdit). */
-    void OnCommitData(QWidget * editor);
-//    void CloseEditor(QTreeWidgetItem *,QTreeWidgetItem *);
+    /// Selects the stored entities again after the model has been reset.
+    void RestoreSelection();
 
     /// Creates a new entity.
     void NewEntity();
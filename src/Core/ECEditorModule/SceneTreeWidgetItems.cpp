@@ -1,8 +1,8 @@
 /**
  *  For conditions of distribution and use, see copyright notice in LICENSE
  *
- *  @file   SceneTreeWidgetItems.h
- *  @brief  Tree widget -related classes used in @c SceneTreeWidget and @c AssetTreeWidget.
+ *  @file   SceneTreeWidgetItems.cpp
+ *  @brief  Tree item -related classes used in @c SceneTreeModel and @c AssetTreeWidget.
  */
 
 #include "StableHeaders.h"
@@ -20,49 +20,97 @@
 
 #include "MemoryLeakCheck.h"
 
+// SceneTreeItem
+
+SceneTreeItem::SceneTreeItem(ItemType itemType, SceneTreeItem *parentItem) :
+    type(itemType),
+    parent(parentItem),
+    childrenCreated(false),
+    row(0)
+{
+}
+
+SceneTreeItem::~SceneTreeItem()
+{
+    ClearChildren();
+}
+
+QColor SceneTreeItem::TextColor() const
+{
+    return QColor(Qt::black);
+}
+
+void SceneTreeItem::ClearChildren()
+{
+    for(size_t i = 0; i < children.size(); ++i)
+        delete children[i];
+    children.clear();
+    childrenCreated = false;
+}
+
+void SceneTreeItem::AddChild(SceneTreeItem *child)
+{
+    child->row = (int)children.size();
+    children.push_back(child);
+}
+
 // EntityItem
 
 EntityItem::EntityItem(const EntityPtr &entity) :
-    ptr(entity), id(entity->Id())
+    SceneTreeItem(EntityItemType, 0),
+    entityTextLength(0),
+    searchTextValid(false),
+    shown(false),
+    bold(false),
+    id(entity->Id()),
+    ptr(entity)
 {
-    SetText(entity.get());
+    Update();
 }
 
-void EntityItem::SetText(::Entity *entity)
+QString EntityItem::Text() const
 {
-    if (ptr.lock().get() != entity)
-        LogWarning("EntityItem::SetText: the entity given is different than the entity this item represents.");
+    EntityPtr entity = ptr.lock();
+    return entity ? EntityText(entity.get()) : QString::number(id);
+}
 
-    QString name = QString("%1 %2").arg(entity->Id()).arg(entity->Name().isEmpty() ? "(no name)" : entity->Name());
+QColor EntityItem::TextColor() const
+{
+    EntityPtr entity = ptr.lock();
+    if (entity && entity->IsTemporary())
+        return QColor(Qt::red);
+    if (entity && entity->IsLocal())
+        return QColor(Qt::blue);
+    return QColor(Qt::black);
+}
 
-    setTextColor(0, QColor(Qt::black));
-    
-    bool local = entity->IsLocal();
-    bool temp = entity->IsTemporary();
+QString EntityItem::EntityText(::Entity *entity)
+{
+    QString name = QString("%1 %2").arg(entity->Id()).arg(entity->Name().isEmpty() ? "(no name)" : entity->Name());
 
     QString info;
-    if (local)
-    {
-        setTextColor(0, QColor(Qt::blue));
+    if (entity->IsLocal())
         info.append("Local");
-    }
 
-    if (temp)
+    if (entity->IsTemporary())
     {
-        setTextColor(0, QColor(Qt::red));
         if (!info.isEmpty())
             info.append(" ");
         info.append("Temporary");
     }
 
     if (!info.isEmpty())
-    {
-        info.prepend(" [");
-        info.append("]");
-        setText(0, name + info);
-    }
+        return name + " [" + info + "]";
     else
-        setText(0, name);
+        return name;
+}
+
+void EntityItem::Update()
+{
+    EntityPtr entity = ptr.lock();
+    QString name = entity ? entity->Name() : QString();
+    sortName = (name.isEmpty() ? QString("(no name)") : name).toLower();
+    searchTextValid = false;
 }
 
 EntityPtr EntityItem::Entity() const
@@ -75,88 +123,68 @@ entity_id_t EntityItem::Id() const
     return id;
 }
 
-bool EntityItem::operator <(const QTreeWidgetItem &rhs) const
-{
-    int c = treeWidget()->sortColumn();
-    if (c == 0)
-        return (entity_id_t)text(0).split(" ")[0].toInt() < (entity_id_t)rhs.text(0).split(" ")[0].toInt();
-    else if (c == 1)
-    {
-        QStringList lhsText = text(0).split(" ");
-        QStringList rhsText = rhs.text(0).split(" ");
-        if (lhsText.size() > 1 && rhsText.size() > 1)
-            return lhsText[1].toLower() < rhsText[1].toLower();
-        else
-            return false;
-    }
-    else
-        return QTreeWidgetItem::operator <(rhs);
-}
-
 // ComponentItem
 
 ComponentItem::ComponentItem(const ComponentPtr &comp, EntityItem *parent) :
-    QTreeWidgetItem(parent), parentItem(parent), ptr(comp), typeName(comp->TypeName()), name(comp->Name())
+    SceneTreeItem(ComponentItemType, parent),
+    typeName(comp->TypeName()),
+    name(comp->Name()),
+    ptr(comp)
 {
-    SetText(comp.get());
 }
 
-void ComponentItem::SetText(IComponent *comp)
+QString ComponentItem::Text() const
 {
-    if (ptr.lock().get() != comp)
-        LogWarning("ComponentItem::SetText: the component given is different than the component this item represents.");
+    ComponentPtr comp = ptr.lock();
+    return comp ? ComponentText(comp.get()) : QString("%1 %2").arg(typeName).arg(name);
+}
+
+QColor ComponentItem::TextColor() const
+{
+    ComponentPtr comp = ptr.lock();
+    if (comp && comp->IsTemporary())
+        return QColor(Qt::red);
+    if (comp && !comp->IsReplicated())
+        return QColor(Qt::blue);
+    return QColor(Qt::black);
+}
 
+QString ComponentItem::ComponentText(IComponent *comp)
+{
     QString compType = comp->TypeName();
     if (compType.startsWith("ec_", Qt::CaseInsensitive))
         compType = compType.right(compType.length() - 3);
     QString name = QString("%1 %2").arg(compType).arg(comp->Name());
-    setTextColor(0, QColor(Qt::black));
-
-    QString localText = QApplication::translate("ComponentItem", "Local");
-    QString temporaryText = QApplication::translate("ComponentItem", "Temporary");
-    QString localOnlyText = QApplication::translate("ComponentItem", "UpdateMode:LocalOnly");
-    QString disconnectedText = QApplication::translate("ComponentItem", "UpdateMode:Disconnected");
-
-    bool sync = comp->IsReplicated();
-    bool temporary = comp->IsTemporary();
 
     QString info;
-    if (!sync)
-    {
-        setTextColor(0, QColor(Qt::blue));
-        info.append(localText);
-    }
+    if (!comp->IsReplicated())
+        info.append(QApplication::translate("ComponentItem", "Local"));
 
-    if (temporary)
+    if (comp->IsTemporary())
     {
-        setTextColor(0, QColor(Qt::red));
         if (!info.isEmpty())
             info.append(" ");
-        info.append(temporaryText);
+        info.append(QApplication::translate("ComponentItem", "Temporary"));
     }
 
     if (comp->UpdateMode() == AttributeChange::LocalOnly)
     {
         if (!info.isEmpty())
             info.append(" ");
-        info.append(localOnlyText);
+        info.append(QApplication::translate("ComponentItem", "UpdateMode:LocalOnly"));
     }
 
     if (comp->UpdateMode() == AttributeChange::Disconnected)
     {
         if (!info.isEmpty())
             info.append(" ");
-        info.append(disconnectedText);
+        info.append(QApplication::translate("ComponentItem", "UpdateMode:Disconnected"));
     }
 
     if (!info.isEmpty())
-    {
-        info.prepend(" (");
-        info.append(")");
-        setText(0, name + info);
-    }
+        return name + " (" + info + ")";
     else
-        setText(0, name);
+        return name;
 }
 
 ComponentPtr ComponentItem::Component() const
@@ -166,35 +194,27 @@ ComponentPtr ComponentItem::Component() const
 
 EntityItem *ComponentItem::Parent() const
 {
-    return parentItem;
+    return static_cast<EntityItem *>(parent);
 }
 
 // AssetRefItem
 
-AssetRefItem::AssetRefItem(IAttribute *attr, QTreeWidgetItem *parent) :
-    QTreeWidgetItem(parent)
+AssetRefItem::AssetRefItem(const QString &assetName, const QString &assetRef, SceneTreeItem *parent) :
+    SceneTreeItem(AssetRefItemType, parent),
+    name(assetName),
+    id(assetRef)
 {
-    Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
-    assert(assetRef);
-    name = assetRef->Name();
-    id = assetRef->Get().ref;
-    SetText(assetRef);
+    childrenCreated = true;
 }
 
-AssetRefItem::AssetRefItem(const QString &assetName, const QString &assetRef, QTreeWidgetItem *parent) :
-    QTreeWidgetItem(parent),
-    name(assetName),
-    id(assetRef)
+QString AssetRefItem::Text() const
 {
-    setText(0, QString("%1: %2").arg(name).arg(id));
+    return AssetRefText(name, id);
 }
 
-void AssetRefItem::SetText(IAttribute *attr)
+QString AssetRefItem::AssetRefText(const QString &assetName, const QString &assetRef)
 {
-    Attribute<AssetReference> *assetRef = dynamic_cast<Attribute<AssetReference> *>(attr);
-    assert(assetRef);
-    if (assetRef)
-        setText(0, QString("%1: %2").arg(assetRef->Name()).arg(assetRef->Get().ref));
+    return QString("%1: %2").arg(assetName).arg(assetRef);
 }
 
 // SceneTreeWidgetSelection
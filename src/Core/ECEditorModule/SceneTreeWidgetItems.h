@@ -2,7 +2,7 @@
  *  For conditions of distribution and use, see copyright notice in LICENSE
  *
  *  @file   SceneTreeWidgetItems.h
- *  @brief  Tree widget -related classes used in @c SceneTreeWidget and @c AssetTreeWidget.
+ *  @brief  Tree item -related classes used in @c SceneTreeModel and @c AssetTreeWidget.
  */
 
 #pragma once
@@ -10,17 +10,68 @@
 #include "SceneFwd.h"
 #include "AssetFwd.h"
 
-/// Tree widget item representing an entity.
-class EntityItem : public QTreeWidgetItem
+#include <vector>
+
+/// Item of SceneTreeModel.
+/** The items are owned by SceneTreeModel. Entity items live as long as their entities are in the scene, while
+    the child items are created on demand and recreated when the entity changes. */
+class SceneTreeItem
+{
+public:
+    /// Item types.
+    enum ItemType
+    {
+        EntityItemType,
+        ComponentItemType,
+        AssetRefItemType
+    };
+
+    /// Constructor.
+    /** @param itemType Type of the item.
+        @param parentItem Parent item, null for entity items. */
+    SceneTreeItem(ItemType itemType, SceneTreeItem *parentItem);
+
+    /// Destructor. Deletes the child items.
+    virtual ~SceneTreeItem();
+
+    /// Returns the text shown for the item.
+    virtual QString Text() const = 0;
+
+    /// Returns the color of the item text.
+    virtual QColor TextColor() const;
+
+    /// Deletes the child items.
+    void ClearChildren();
+
+    /// Appends a child item and takes ownership of it.
+    void AddChild(SceneTreeItem *child);
+
+    ItemType type; ///< Type of the item.
+    SceneTreeItem *parent; ///< Parent item, null for entity items.
+    std::vector<SceneTreeItem *> children; ///< Child items.
+    bool childrenCreated; ///< Have the child items been created.
+    int row; ///< Row of the item under its parent. Kept up to date for entity items by SceneTreeModel.
+};
+
+/// Tree item representing an entity.
+class EntityItem : public SceneTreeItem
 {
 public:
     /// Constructor.
     /** @param entity Entity which the item represents. */
     explicit EntityItem(const EntityPtr &entity);
 
-    /// Decorates the item (text + color) accordingly to the entity information.
-    /** @param entity Entity which the item represents. */
-    void SetText(::Entity *entity);
+    /// SceneTreeItem override. Returns "<id> <name>", with the local and temporary state of the entity.
+    QString Text() const;
+
+    /// SceneTreeItem override. Local entities are blue and temporary entities red.
+    QColor TextColor() const;
+
+    /// Returns the text of an entity item.
+    static QString EntityText(::Entity *entity);
+
+    /// Updates the cached name of the entity used for sorting and invalidates the search text.
+    void Update();
 
     /// Returns pointer to the entity this item represents.
     EntityPtr Entity() const;
@@ -28,17 +79,20 @@ public:
     /// Return Entity ID of the entity associated with this tree widget item.
     entity_id_t Id() const;
 
-    /// QTreeWidgetItem override.
-    /** If treeWidget::sortColumn() is 0, items are sorted by ID, or if it's 1, items are sorted by name (if applicable). */
-    bool operator <(const QTreeWidgetItem &rhs) const;
+    QString sortName; ///< Lower case name of the entity, used for sorting by name.
+    QString searchText; ///< Lower case texts of the item and its child items, separated by newlines. See SceneTreeModel::SetFilter.
+    int entityTextLength; ///< Length of the item's own text at the start of searchText.
+    bool searchTextValid; ///< Is searchText up to date.
+    bool shown; ///< Is the item currently one of the rows of the model.
+    bool bold; ///< Is the item shown in bold.
 
 private:
     entity_id_t id; ///< Entity ID associated with this tree widget item.
     EntityWeakPtr ptr; ///< Weak pointer to the component this item represents.
 };
 
-/// Tree widget item representing a component.
-class ComponentItem : public QTreeWidgetItem
+/// Tree item representing a component.
+class ComponentItem : public SceneTreeItem
 {
 public:
     /// Constructor.
@@ -46,9 +100,14 @@ public:
         @param parent Parent entity item. */
     ComponentItem(const ComponentPtr &comp, EntityItem *parent);
 
-    /// Decorates the item (text + color) accordingly to the component information.
-    /** @param comp Component which the item represents. */
-    void SetText(IComponent *comp);
+    /// SceneTreeItem override. Returns the type and name of the component, with its replication and update mode.
+    QString Text() const;
+
+    /// SceneTreeItem override. Local components are blue and temporary components red.
+    QColor TextColor() const;
+
+    /// Returns the text of a component item.
+    static QString ComponentText(IComponent *comp);
 
     /// Returns pointer to the entity this item represents.
     ComponentPtr Component() const;
@@ -61,31 +120,26 @@ public:
 
 private:
     ComponentWeakPtr ptr; ///< Weak pointer to the component this item represents.
-    EntityItem *parentItem; ///< Parent entity item.
 };
 
-/// Tree widget item representing an asset reference.
-class AssetRefItem : public QTreeWidgetItem
+/// Tree item representing an asset reference.
+class AssetRefItem : public SceneTreeItem
 {
 public:
-    /// Constructor.
-    /** @param attr Asset reference attribute.
-        @param parent Parent item. */
-    AssetRefItem(IAttribute *attr, QTreeWidgetItem *parent = 0);
-
     /// Constructor.
     /** @param name Name of the asset.
         @param ref Asset reference.
         @param parent Parent item. */
-    AssetRefItem(const QString &assetName, const QString &assetRef, QTreeWidgetItem *parent = 0);
+    AssetRefItem(const QString &assetName, const QString &assetRef, SceneTreeItem *parent);
+
+    /// SceneTreeItem override. Returns "<name>: <ref>".
+    QString Text() const;
 
-    /// Sets the item text accordingly to the attribute information.
-    /** @param attr Asset reference attribute. */
-    void SetText(IAttribute *attr);
+    /// Returns the text of an asset reference item.
+    static QString AssetRefText(const QString &assetName, const QString &assetRef);
 
     QString name; ///< Name of the attribute.
     QString id; ///< ID.
-    QString type; ///< Type. \todo Remove/evaluate if needed.
 };
 
 /// Represents selection of SceneTreeWidget items.
@@ -28,6 +28,8 @@
 #include <utility>
 #include <boost/make_shared.hpp>
 
+#include <QtConcurrentMap>
+
 #include "MemoryLeakCheck.h"
 
 using namespace std;
@@ -297,6 +299,8 @@ void EC_Terrain::Destroy()
         sceneMgr->destroySceneNode(rootNode);
         rootNode = 0;
     }
+
+    patchIndexBuffers.clear();
 }
 
 float EC_Terrain::GetPoint(int x, int y) const
@@ -1195,95 +1199,80 @@ void EC_Terrain::AttachTerrainRootNode()
     }
 }
 
+/// @cond PRIVATE
+struct EC_Terrain::PatchVertexData
+{
+    PatchVertexData() : terrain(0), patchX(0), patchY(0), verticesX(0), verticesY(0), minHeight(0.f), maxHeight(0.f) {}
+
+    /// Number of floats per vertex: position (3), normal (3), diffuse UV (2) and blend mask UV (2).
+    static const int cFloatsPerVertex = 10;
+
+    const EC_Terrain *terrain;
+    int patchX;
+    int patchY;
+    /// Vertex grid size of the patch. Interior patches have cPatchSize+1 vertices per side to connect the seams to the neighbors.
+    int verticesX;
+    int verticesY;
+    /// Interleaved vertex data, laid out as in the vertex declaration created by CreatePatchGeometry.
+    std::vector<float> vertices;
+    float minHeight;
+    float maxHeight;
+};
+/// @endcond
+
+void EC_Terrain::GeneratePatchVertexDataJob(PatchVertexData &data)
+{
+    data.terrain->GeneratePatchVertexData(data);
+}
+
 void EC_Terrain::GenerateTerrainGeometryForOnePatch(int patchX, int patchY)
 {
     PROFILE(EC_Terrain_GenerateTerrainGeometryForOnePatch);
 
-    EC_Terrain::Patch &patch = GetPatch(patchX, patchY);
-
     if (!ViewEnabled())
         return;
-    if (world_.expired())
-        return;
-    OgreWorldPtr world = world_.lock();
-    Ogre::SceneManager *sceneMgr = world->OgreSceneManager();
-
-    Ogre::SceneNode *node = patch.node;
-    bool firstTimeFill = (node == 0);
-    UNREFERENCED_PARAM(firstTimeFill);
-    if (!node)
-    {
-        CreateOgreTerrainPatchNode(node, patch.x, patch.y);
-        patch.node = node;
-    }
-    assert(node);
-
-    Ogre::MaterialPtr terrainMaterial = Ogre::MaterialManager::getSingleton().getByName(currentMaterial.toStdString().c_str());
-    if (!terrainMaterial.get()) // If we could not find the material we were supposed to use, just use the default system terrain material.
-        terrainMaterial = OgreRenderer::GetOrCreateLitTexturedMaterial("Rex/TerrainPCF");
 
-    Ogre::ManualObject *manual = sceneMgr->createManualObject(world->GetUniqueObjectName("EC_Terrain_manual"));
-    manual->setCastShadows(false);
+    PatchVertexData data;
+    data.terrain = this;
+    data.patchX = patchX;
+    data.patchY = patchY;
+    GeneratePatchVertexData(data);
+    CreatePatchGeometry(data);
+}
 
-    manual->clear();
-    manual->estimateVertexCount((cPatchSize+1)*(cPatchSize+1));
-    manual->estimateIndexCount((cPatchSize+1)*(cPatchSize+1)*3*2);
-    manual->begin(terrainMaterial->getName(), Ogre::RenderOperation::OT_TRIANGLE_LIST);
+void EC_Terrain::GeneratePatchVertexData(PatchVertexData &data) const
+{
+    const Patch &patch = GetPatch(data.patchX, data.patchY);
 
     const float vertexSpacingX = 1.f;
     const float vertexSpacingY = 1.f;
     const float patchSpacingX = cPatchSize * vertexSpacingX;
     const float patchSpacingY = cPatchSize * vertexSpacingY;
-    const Ogre::Vector3 patchOrigin(patch.x * patchSpacingX, 0.f, patch.y * patchSpacingY);
-// Opensim:    const Ogre::Vector3 patchOrigin(patch.x * patchSpacingX, patch.y * patchSpacingY, 0.f);
-
-    int curIndex = 0;
+    const float3 patchOrigin(patch.x * patchSpacingX, 0.f, patch.y * patchSpacingY);
+// Opensim:    const float3 patchOrigin(patch.x * patchSpacingX, patch.y * patchSpacingY, 0.f);
 
     const int cPatchVertexWidth = cPatchSize; // The number of vertices in the patch in horizontal direction. We use the fixed value of cPatchSize==16.
     const int cPatchVertexHeight = cPatchSize; // The number of vertices in the patch in vertical  direction. We use the fixed value of cPatchSize==16.
     // If we assume each patch is 16x16 vertices, then all the internal patches will get a 17x17 grid, since we need to connect seams.
     // But, the outermost patch row and column at the terrain edge will not have this, since they do not need to connect to a next patch.
-    // This is the vertex stride for the terrain.
-    const int stride = (patch.x + 1 >= patchWidth) ? cPatchVertexWidth : (cPatchVertexWidth+1);
+    data.verticesX = (patch.x + 1 >= patchWidth) ? cPatchVertexWidth : (cPatchVertexWidth+1);
+    data.verticesY = (patch.y + 1 >= patchHeight) ? cPatchVertexHeight : (cPatchVertexHeight+1);
+    data.vertices.resize(data.verticesX * data.verticesY * PatchVertexData::cFloatsPerVertex);
+    data.minHeight = std::numeric_limits<float>::max();
+    data.maxHeight = -std::numeric_limits<float>::max();
 
     const float uScale = this->uScale.Get();
     const float vScale = this->vScale.Get();
 
-    for(int y = 0; y <= cPatchVertexHeight; ++y)
-        for(int x = 0; x <= cPatchVertexWidth; ++x)
+    float *v = &data.vertices[0];
+    for(int y = 0; y < data.verticesY; ++y)
+        for(int x = 0; x < data.verticesX; ++x)
         {
-            if ((patch.x + 1 >= patchWidth && x == cPatchVertexWidth) ||
-                (patch.y + 1 >= patchHeight && y == cPatchVertexHeight))
-                continue; // We are at the single corner-most vertex of the whole terrain. That is to be skipped.
-
-            // These coordinates are directly generated to our Ogre coordinate system, i.e. are cycled from OpenSim XYZ -> our YZX.
-            // see OpenSimToOgreCoordinateAxes.
-            Ogre::Vector3 pos;
-            pos.x = vertexSpacingX * x;
-            pos.z = vertexSpacingY * y;
-// Opensim:             pos.x = vertexSpacingX * x;
-// Opensim              pos.y = vertexSpacingY * y;
-
-            EC_Terrain::Patch *thisPatch;
+            const EC_Terrain::Patch *thisPatch;
             int X = x;
             int Y = y;
             if (x < cPatchVertexWidth && y < cPatchVertexHeight)
-            {
                 thisPatch = &patch;
-
-                if ((patch.x + 1 < patchWidth || x+1 < cPatchVertexWidth) &&
-                    (patch.y + 1 < patchHeight || y+1 < cPatchVertexHeight))
-                {
-                    // Note: winding needs to be flipped when terrain X axis goes along world X axis and terrain Y axis along world Z
-                    manual->index(curIndex+stride);
-                    manual->index(curIndex+1);
-                    manual->index(curIndex);
-
-                    manual->index(curIndex+stride);
-                    manual->index(curIndex+stride+1);
-                    manual->index(curIndex+1);
-                }
-            }
             else if (x == cPatchVertexWidth && y == cPatchVertexHeight)
             {
                 thisPatch = &GetPatch(patch.x + 1, patch.y + 1);
@@ -1301,23 +1290,85 @@ void EC_Terrain::GenerateTerrainGeometryForOnePatch(int patchX, int patchY)
                 Y = 0;
             }
 
-            pos.y = thisPatch->heightData[Y*cPatchVertexWidth+X];
-// Opensim:            pos.z = thisPatch->heightData[Y*cPatchVertexWidth+X];
-
-            manual->position(pos);
-            manual->normal(CalculateNormal(thisPatch->x, thisPatch->y, X, Y));
-
+            // These coordinates are directly generated to our Ogre coordinate system, i.e. are cycled from OpenSim XYZ -> our YZX.
+            // see OpenSimToOgreCoordinateAxes.
+            const float posX = vertexSpacingX * x;
+            const float posY = thisPatch->heightData[Y*cPatchVertexWidth+X];
+            const float posZ = vertexSpacingY * y;
+            data.minHeight = min(data.minHeight, posY);
+            data.maxHeight = max(data.maxHeight, posY);
+
+            const float3 normal = CalculateNormal(thisPatch->x, thisPatch->y, X, Y);
+
+            *v++ = posX;
+            *v++ = posY;
+            *v++ = posZ;
+            *v++ = normal.x;
+            *v++ = normal.y;
+            *v++ = normal.z;
             // The UV set 0 contains the diffuse texture UV map. Do a planar mapping with the given specified UV scale.
-            manual->textureCoord((patchOrigin.x + pos.x) * uScale, (patchOrigin.z + pos.z) * vScale);
-// Opensim:             manual->textureCoord((patchOrigin.x + pos.x) * uScale, (patchOrigin.y + pos.y) * vScale);
-
+            *v++ = (patchOrigin.x + posX) * uScale;
+            *v++ = (patchOrigin.z + posZ) * vScale;
             // The UV set 1 contains the terrain blend mask UV map, which stretches once across the whole terrain.
-            manual->textureCoord((float)(patch.x*cPatchSize + x)/(VerticesWidth()-1), (float)(patch.y*cPatchSize + y)/(VerticesHeight()-1)); 
+            *v++ = (float)(patch.x*cPatchSize + x)/(VerticesWidth()-1);
+            *v++ = (float)(patch.y*cPatchSize + y)/(VerticesHeight()-1);
+        }
+}
 
-            ++curIndex;
+Ogre::HardwareIndexBufferSharedPtr EC_Terrain::PatchIndexBuffer(int verticesX, int verticesY)
+{
+    std::pair<int, int> key(verticesX, verticesY);
+    std::map<std::pair<int, int>, Ogre::HardwareIndexBufferSharedPtr>::iterator iter = patchIndexBuffers.find(key);
+    if (iter != patchIndexBuffers.end())
+        return iter->second;
+
+    std::vector<u16> indices;
+    indices.reserve((verticesX-1) * (verticesY-1) * 6);
+    for(int y = 0; y + 1 < verticesY; ++y)
+        for(int x = 0; x + 1 < verticesX; ++x)
+        {
+            const int curIndex = y * verticesX + x;
+            // Note: winding needs to be flipped when terrain X axis goes along world X axis and terrain Y axis along world Z
+            indices.push_back((u16)(curIndex+verticesX));
+            indices.push_back((u16)(curIndex+1));
+            indices.push_back((u16)curIndex);
+
+            indices.push_back((u16)(curIndex+verticesX));
+            indices.push_back((u16)(curIndex+verticesX+1));
+            indices.push_back((u16)(curIndex+1));
         }
 
-    manual->end();
+    Ogre::HardwareIndexBufferSharedPtr indexBuffer = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
+        Ogre::HardwareIndexBuffer::IT_16BIT, indices.size(), Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    indexBuffer->writeData(0, indexBuffer->getSizeInBytes(), &indices[0], true);
+    patchIndexBuffers[key] = indexBuffer;
+    return indexBuffer;
+}
+
+void EC_Terrain::CreatePatchGeometry(const PatchVertexData &data)
+{
+    PROFILE(EC_Terrain_CreatePatchGeometry);
+
+    EC_Terrain::Patch &patch = GetPatch(data.patchX, data.patchY);
+
+    if (world_.expired() || data.vertices.empty())
+        return;
+    OgreWorldPtr world = world_.lock();
+    Ogre::SceneManager *sceneMgr = world->OgreSceneManager();
+
+    Ogre::SceneNode *node = patch.node;
+    if (!node)
+    {
+        CreateOgreTerrainPatchNode(node, patch.x, patch.y);
+        patch.node = node;
+    }
+    assert(node);
+    if (!node)
+        return;
+
+    Ogre::MaterialPtr terrainMaterial = Ogre::MaterialManager::getSingleton().getByName(currentMaterial.toStdString().c_str());
+    if (!terrainMaterial.get()) // If we could not find the material we were supposed to use, just use the default system terrain material.
+        terrainMaterial = OgreRenderer::GetOrCreateLitTexturedMaterial("Rex/TerrainPCF");
 
     // If there exists a previously generated GPU Mesh resource, delete it before creating a new one.
     if (patch.meshGeometryName.length() > 0)
@@ -1330,11 +1381,41 @@ void EC_Terrain::GenerateTerrainGeometryForOnePatch(int patchX, int patchY)
     }
 
     patch.meshGeometryName = world->GetUniqueObjectName("EC_Terrain_patchmesh");
-    Ogre::MeshPtr terrainMesh = manual->convertToMesh(patch.meshGeometryName);
-
-    // Odd: destroyManualObject seems to leave behind a memory leak if we don't call manualObject->clear first.
-    manual->clear();
-    sceneMgr->destroyManualObject(manual);
+    Ogre::MeshPtr terrainMesh = Ogre::MeshManager::getSingleton().createManual(patch.meshGeometryName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    Ogre::SubMesh *subMesh = terrainMesh->createSubMesh();
+    subMesh->useSharedVertices = false;
+    subMesh->operationType = Ogre::RenderOperation::OT_TRIANGLE_LIST;
+
+    // Upload the vertex data straight into a hardware buffer. The submesh takes ownership of the VertexData.
+    const size_t numVertices = data.verticesX * data.verticesY;
+    subMesh->vertexData = new Ogre::VertexData();
+    subMesh->vertexData->vertexStart = 0;
+    subMesh->vertexData->vertexCount = numVertices;
+    Ogre::VertexDeclaration *decl = subMesh->vertexData->vertexDeclaration;
+    size_t offset = 0;
+    offset += decl->addElement(0, offset, Ogre::VET_FLOAT3, Ogre::VES_POSITION).getSize();
+    offset += decl->addElement(0, offset, Ogre::VET_FLOAT3, Ogre::VES_NORMAL).getSize();
+    offset += decl->addElement(0, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0).getSize();
+    offset += decl->addElement(0, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 1).getSize();
+    assert(offset == PatchVertexData::cFloatsPerVertex * sizeof(float));
+
+    Ogre::HardwareVertexBufferSharedPtr vertexBuffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+        offset, numVertices, Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    vertexBuffer->writeData(0, vertexBuffer->getSizeInBytes(), &data.vertices[0], true);
+    subMesh->vertexData->vertexBufferBinding->setBinding(0, vertexBuffer);
+
+    // All patches with the same grid size share the index data on the GPU.
+    Ogre::HardwareIndexBufferSharedPtr indexBuffer = PatchIndexBuffer(data.verticesX, data.verticesY);
+    subMesh->indexData->indexBuffer = indexBuffer;
+    subMesh->indexData->indexStart = 0;
+    subMesh->indexData->indexCount = indexBuffer->getNumIndexes();
+
+    subMesh->setMaterialName(terrainMaterial->getName());
+
+    const Ogre::AxisAlignedBox bounds(0.f, data.minHeight, 0.f, (float)(data.verticesX-1), data.maxHeight, (float)(data.verticesY-1));
+    terrainMesh->_setBounds(bounds);
+    terrainMesh->_setBoundingSphereRadius(Ogre::Math::Sqrt(std::max(bounds.getMinimum().squaredLength(), bounds.getMaximum().squaredLength())));
+    terrainMesh->load();
 
     patch.entity = sceneMgr->createEntity(world->GetUniqueObjectName("EC_Terrain_patchentity"), patch.meshGeometryName);
     patch.entity->setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
@@ -1466,8 +1547,9 @@ void EC_Terrain::RegenerateDirtyTerrainPatches()
     if (!parentEntity)
         return;
     EC_Placeable *position = parentEntity->GetComponent<EC_Placeable>().get();
-    if (!GetFramework()->IsHeadless() && (!position || position->visible.Get())) // Only need to create GPU resources if the placeable itself is visible.
+    if (!GetFramework()->IsHeadless() && ViewEnabled() && (!position || position->visible.Get())) // Only need to create GPU resources if the placeable itself is visible.
     {
+        std::vector<PatchVertexData> dirtyPatches;
         for(int y = 0; y < patchHeight; ++y)
             for(int x = 0; x < patchWidth; ++x)
             {
@@ -1498,8 +1580,23 @@ void EC_Terrain::RegenerateDirtyTerrainPatches()
                 }
 
                 if (neighborsLoaded)
-                    GenerateTerrainGeometryForOnePatch(x, y);
+                {
+                    dirtyPatches.push_back(PatchVertexData());
+                    dirtyPatches.back().terrain = this;
+                    dirtyPatches.back().patchX = x;
+                    dirtyPatches.back().patchY = y;
+                }
             }
+
+        // Generating the vertex data only reads the height map, so it is done for all dirty patches in parallel on the worker threads.
+        // The GPU resources must be created in the main thread.
+        if (dirtyPatches.size() > 1)
+            QtConcurrent::blockingMap(dirtyPatches, GeneratePatchVertexDataJob);
+        else if (dirtyPatches.size() == 1)
+            GeneratePatchVertexData(dirtyPatches.front());
+
+        for(size_t i = 0; i < dirtyPatches.size(); ++i)
+            CreatePatchGeometry(dirtyPatches[i]);
     }
     
     // All the new geometry we created will be visible for Ogre by default. If the EC_Placeable's visible attribute is false,
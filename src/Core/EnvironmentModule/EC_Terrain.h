@@ -11,6 +11,10 @@
 #include "AssetRefListener.h"
 #include "OgreModuleFwd.h"
 
+#include <OgreHardwareIndexBuffer.h>
+
+#include <map>
+
 namespace Ogre { class Matrix4; }
 
 /// Adds a heightmap-based terrain to the scene.
@@ -405,6 +409,24 @@ private:
     /// patch if the associated Ogre resources already exist.
     void GenerateTerrainGeometryForOnePatch(int patchX, int patchY);
 
+    /// CPU-side vertex data of a single patch, generated by GeneratePatchVertexData.
+    struct PatchVertexData;
+
+    /// Fills in the interleaved vertex data (position, normal, two UV sets) of the patch specified in 'data'.
+    /** Only reads the height data of the patch and its neighbors, so this can be run for several patches in parallel. */
+    void GeneratePatchVertexData(PatchVertexData &data) const;
+
+    /// Worker thread entry point for QtConcurrent, calls GeneratePatchVertexData for the terrain stored in 'data'.
+    static void GeneratePatchVertexDataJob(PatchVertexData &data);
+
+    /// Creates the Ogre mesh and entity for a patch directly into hardware buffers from the given vertex data.
+    /** Must be called in the main thread. */
+    void CreatePatchGeometry(const PatchVertexData &data);
+
+    /// Returns the index buffer for a patch grid of the given size, creating it if it does not exist yet.
+    /** All patches with the same grid size share the same index buffer. */
+    Ogre::HardwareIndexBufferSharedPtr PatchIndexBuffer(int verticesX, int verticesY);
+
     boost::shared_ptr<AssetRefListener> heightMapAsset;
 
     /// For all terrain patches, we maintain a global parent/root node to be able to transform the whole terrain at one go.
@@ -422,6 +444,10 @@ private:
 
     /// Stores the actual height patches.
     std::vector<Patch> patches;
+
+    /// Index buffers shared by all the patch meshes, keyed by the patch vertex grid size.
+    /** Interior patches are (cPatchSize+1)^2 vertices, patches on the far terrain edges have one row or column less. */
+    std::map<std::pair<int, int>, Ogre::HardwareIndexBufferSharedPtr> patchIndexBuffers;
     
     /// Ogre world for referring to the Ogre scene manager
     OgreWorldWeakPtr world_;
@@ -10,6 +10,7 @@
 #include "CoreStringUtils.h"
 #include "CoreException.h"
 #include "LoggingFunctions.h"
+#include "FrameAPI.h"
 
 #include <iostream>
 #include <utility>
@@ -598,6 +599,11 @@ void Application::UpdateFrame()
         /// which can cause the Win32 message loop inside Qt to starve. (Qt keeps spinning the timer.start(0) loop for Tundra mainloop and neglects Win32 API).
         double msecsToSleep = std::min(std::max(1.0, msecsPerFrame - msecsSpentInFrame), msecsPerFrame);
 
+        // With a fixed simulation tick rate, a headless server sleeps until the next tick is due, which keeps the tick steady.
+        FrameAPI *frameApi = framework->Frame();
+        if (framework->IsHeadless() && frameApi->TickRate() > 0.f)
+            msecsToSleep = std::max(1.0, frameApi->SecondsToNextTick() * 1000.0 - msecsSpentInFrame);
+
         // Reduce frame rate when unfocused
         if (!frameUpdateTimer.isActive())
         {
@@ -10,13 +10,79 @@
 #include "FrameAPI.h"
 #include "HighPerfClock.h"
 #include "Profiler.h"
-#include <QTimer>
+#include "LoggingFunctions.h"
+
+#include <QMetaMethod>
+
+#include <algorithm>
 
 #include "MemoryLeakCheck.h"
 
-FrameAPI::FrameAPI(Framework *fw) : QObject(fw), currentFrameNumber(0)
+/// Names of the FrameAPI::Phase values.
+static const char * const cPhaseNames[] = { "input", "simulation", "audio", "render", "frame" };
+
+/// Number of slots in the lowest timer wheel level, which holds the timers expiring within this many milliseconds.
+static const int cWheelSlots0 = 256;
+static const int cWheelBits0 = 8;
+/// Number of slots in each of the higher timer wheel levels.
+static const int cWheelSlots = 64;
+static const int cWheelBits = 6;
+/// Number of wheel levels above the lowest. Together the levels cover 2^32 milliseconds, about 49 days.
+static const int cWheelLevels = 4;
+/// Number of bits of a timer handle used for the timer index. The rest hold the generation of the timer.
+static const int cTimerIndexBits = 22;
+static const uint cTimerIndexMask = (1u << cTimerIndexBits) - 1;
+static const uint cTimerGenerationMask = (1u << (32 - cTimerIndexBits)) - 1;
+
+namespace
+{
+
+/// Returns the index of the method of the receiver given with the SLOT() or SIGNAL() macro, or -1 if it can not be invoked by a timer.
+int TimerMethodIndex(const QObject *receiver, const char *member)
+{
+    if (!receiver || !member)
+        return -1;
+    // SLOT() and SIGNAL() prefix the signature with a method type code.
+    if (*member >= '0' && *member <= '2')
+        ++member;
+    int index = receiver->metaObject()->indexOfMethod(QMetaObject::normalizedSignature(member));
+    if (index < 0)
+    {
+        LogError("FrameAPI: No such method " + QString(member) + " in " + receiver->metaObject()->className() + ".");
+        return -1;
+    }
+    QList<QByteArray> types = receiver->metaObject()->method(index).parameterTypes();
+    if (types.size() > 1 || (types.size() == 1 && types[0] != "float"))
+    {
+        LogError("FrameAPI: Method " + QString(member) + " must take no parameters or one float parameter.");
+        return -1;
+    }
+    return index;
+}
+
+u64 SecondsToMsecs(float seconds)
+{
+    return seconds > 0.f ? (u64)(seconds * 1000.0 + 0.5) : 0;
+}
+
+}
+
+FrameAPI::FrameAPI(Framework *fw) :
+    QObject(fw),
+    currentFrameNumber(0),
+    tickRate(0.f),
+    maxTicksPerFrame(5),
+    tickAccumulator(0.0),
+    ticksInLastFrame(0),
+    freeTimers(-1),
+    wheelTime(0),
+    numPendingTimers(0),
+    nextTimerSequence(0)
 {
     startTime = GetCurrentClockTime();
+    wheelSlots.resize(cWheelSlots0 + cWheelLevels * cWheelSlots, -1);
+    for(int i = 0; i < NumPhases; ++i)
+        phaseTimes[i] = averagePhaseTimes[i] = 0.0;
 }
 
 FrameAPI::~FrameAPI()
@@ -25,8 +91,14 @@ FrameAPI::~FrameAPI()
 
 void FrameAPI::Reset()
 {
-    qDeleteAll(delayedSignals);
-    delayedSignals.clear();
+    for(size_t i = 0; i < timers.size(); ++i)
+        if (timers[i].pending && timers[i].methodIndex < 0)
+            delete timers[i].receiver.data();
+    timers.clear();
+    freeTimers = -1;
+    wheelSlots.assign(wheelSlots.size(), -1);
+    expiredTimers.clear();
+    numPendingTimers = 0;
 }
 
 float FrameAPI::WallClockTime() const
@@ -34,22 +106,261 @@ float FrameAPI::WallClockTime() const
     return (float)((double)(GetCurrentClockTime() - startTime) / GetCurrentClockFreq());
 }
 
+u64 FrameAPI::ElapsedMsecs() const
+{
+    return (u64)((double)(GetCurrentClockTime() - startTime) * 1000.0 / GetCurrentClockFreq());
+}
+
 DelayedSignal *FrameAPI::DelayedExecute(float time)
 {
-    DelayedSignal *delayed = new DelayedSignal(GetCurrentClockTime());
-    QTimer::singleShot(time*1000, delayed, SLOT(Expire()));
-    connect(delayed, SIGNAL(Triggered(float)), SLOT(DeleteDelayedSignal()));
-    delayedSignals.push_back(delayed);
-    return delayed;
+    return AddSignalTimer(time, false);
 }
 
 void FrameAPI::DelayedExecute(float time, const QObject *receiver, const char *member)
 {
-    DelayedSignal *delayed = new DelayedSignal(GetCurrentClockTime());
-    QTimer::singleShot(time*1000, delayed, SLOT(Expire()));
-    connect(delayed, SIGNAL(Triggered(float)), receiver, member);
-    connect(delayed, SIGNAL(Triggered(float)), SLOT(DeleteDelayedSignal()));
-    delayedSignals.push_back(delayed);
+    CancellableDelayedExecute(time, receiver, member);
+}
+
+uint FrameAPI::CancellableDelayedExecute(float time, const QObject *receiver, const char *member)
+{
+    int methodIndex = TimerMethodIndex(receiver, member);
+    if (methodIndex < 0)
+        return 0;
+    return AddTimer(SecondsToMsecs(time), 0, const_cast<QObject *>(receiver), methodIndex);
+}
+
+DelayedSignal *FrameAPI::RepeatedExecute(float interval)
+{
+    return AddSignalTimer(interval, true);
+}
+
+uint FrameAPI::RepeatedExecute(float interval, const QObject *receiver, const char *member)
+{
+    int methodIndex = TimerMethodIndex(receiver, member);
+    if (methodIndex < 0)
+        return 0;
+    u64 intervalMsecs = std::max<u64>(SecondsToMsecs(interval), 1);
+    return AddTimer(intervalMsecs, (u32)std::min<u64>(intervalMsecs, 0xFFFFFFFFu), const_cast<QObject *>(receiver), methodIndex);
+}
+
+DelayedSignal *FrameAPI::AddSignalTimer(float time, bool repeat)
+{
+    DelayedSignal *delayed = new DelayedSignal(this);
+    u64 delayMsecs = SecondsToMsecs(time);
+    if (repeat)
+        delayMsecs = std::max<u64>(delayMsecs, 1);
+    delayed->handle = AddTimer(delayMsecs, repeat ? (u32)std::min<u64>(delayMsecs, 0xFFFFFFFFu) : 0, delayed, -1);
+    return delayed;
+}
+
+bool FrameAPI::CancelDelayedExecute(uint handle)
+{
+    int index = TimerIndex(handle);
+    if (index < 0)
+        return false;
+
+    timers[index].pending = false;
+    --numPendingTimers;
+    // A timer that is being triggered is freed by UpdateTimers when the batch is done.
+    if (timers[index].slot >= 0)
+    {
+        UnlinkTimer(index);
+        FreeTimer(index);
+    }
+    return true;
+}
+
+uint FrameAPI::AddTimer(u64 delayMsecs, u32 intervalMsecs, QObject *receiver, int methodIndex)
+{
+    int index = freeTimers;
+    if (index >= 0)
+        freeTimers = timers[index].next;
+    else
+    {
+        if (timers.size() > cTimerIndexMask)
+        {
+            LogError("FrameAPI: Too many pending timers.");
+            return 0;
+        }
+        index = (int)timers.size();
+        timers.push_back(Timer());
+        timers[index].generation = 1;
+    }
+
+    // An idle wheel is not advanced, so bring it to the current time before linking.
+    const u64 now = ElapsedMsecs();
+    if (numPendingTimers == 0 && wheelTime < now)
+        wheelTime = now;
+
+    Timer &timer = timers[index];
+    timer.scheduleTime = now;
+    timer.expireTime = now + delayMsecs;
+    timer.interval = intervalMsecs;
+    timer.receiver = receiver;
+    timer.methodIndex = methodIndex;
+    timer.prev = timer.next = timer.slot = -1;
+    timer.pending = true;
+    timer.sequence = nextTimerSequence++;
+    LinkTimer(index);
+    ++numPendingTimers;
+    return (timer.generation << cTimerIndexBits) | (uint)index;
+}
+
+int FrameAPI::TimerIndex(uint handle) const
+{
+    uint index = handle & cTimerIndexMask;
+    if (index >= timers.size() || timers[index].generation != (handle >> cTimerIndexBits) || !timers[index].pending)
+        return -1;
+    return (int)index;
+}
+
+void FrameAPI::LinkTimer(int index)
+{
+    Timer &timer = timers[index];
+    if (timer.expireTime < wheelTime)
+        timer.expireTime = wheelTime;
+
+    const u64 delta = timer.expireTime - wheelTime;
+    int slot = -1;
+    if (delta < cWheelSlots0)
+        slot = (int)(timer.expireTime & (cWheelSlots0 - 1));
+    else
+    {
+        for(int level = 1; level <= cWheelLevels && slot < 0; ++level)
+        {
+            const int shift = cWheelBits0 + (level - 1) * cWheelBits;
+            if (level == cWheelLevels && (delta >> (shift + cWheelBits)) != 0)
+                timer.expireTime = wheelTime + (((u64)1 << (shift + cWheelBits)) - 1); // Clamp to the range of the wheel.
+            if (level == cWheelLevels || (delta >> (shift + cWheelBits)) == 0)
+                slot = cWheelSlots0 + (level - 1) * cWheelSlots + (int)((timer.expireTime >> shift) & (cWheelSlots - 1));
+        }
+    }
+
+    timer.slot = slot;
+    timer.prev = -1;
+    timer.next = wheelSlots[slot];
+    if (timer.next >= 0)
+        timers[timer.next].prev = index;
+    wheelSlots[slot] = index;
+}
+
+void FrameAPI::UnlinkTimer(int index)
+{
+    Timer &timer = timers[index];
+    if (timer.prev >= 0)
+        timers[timer.prev].next = timer.next;
+    else
+        wheelSlots[timer.slot] = timer.next;
+    if (timer.next >= 0)
+        timers[timer.next].prev = timer.prev;
+    timer.prev = timer.next = timer.slot = -1;
+}
+
+void FrameAPI::FreeTimer(int index)
+{
+    Timer &timer = timers[index];
+    timer.receiver = 0;
+    timer.pending = false;
+    timer.generation = (timer.generation + 1) & cTimerGenerationMask;
+    if (timer.generation == 0)
+        timer.generation = 1;
+    timer.next = freeTimers;
+    freeTimers = index;
+}
+
+void FrameAPI::CascadeTimers(int slot)
+{
+    int index = wheelSlots[slot];
+    wheelSlots[slot] = -1;
+    while(index >= 0)
+    {
+        int next = timers[index].next;
+        LinkTimer(index);
+        index = next;
+    }
+}
+
+void FrameAPI::UpdateTimers()
+{
+    PROFILE(FrameAPI_UpdateTimers);
+
+    const u64 now = ElapsedMsecs();
+    if (numPendingTimers == 0)
+    {
+        wheelTime = std::max(wheelTime, now + 1);
+        return;
+    }
+
+    // Collect all the timers that expired since the last frame, in the order of their expiration times.
+    for(; wheelTime <= now; ++wheelTime)
+    {
+        if ((wheelTime & (cWheelSlots0 - 1)) == 0)
+        {
+            // The lowest level has wrapped around: move the timers of the next slot of each higher level down.
+            for(int level = 1; level <= cWheelLevels; ++level)
+            {
+                const int slotIndex = (int)((wheelTime >> (cWheelBits0 + (level - 1) * cWheelBits)) & (cWheelSlots - 1));
+                CascadeTimers(cWheelSlots0 + (level - 1) * cWheelSlots + slotIndex);
+                if (slotIndex != 0)
+                    break;
+            }
+        }
+
+        const int slot = (int)(wheelTime & (cWheelSlots0 - 1));
+        const size_t slotBegin = expiredTimers.size();
+        while(wheelSlots[slot] >= 0)
+        {
+            int index = wheelSlots[slot];
+            UnlinkTimer(index);
+            expiredTimers.push_back(std::make_pair(timers[index].sequence, index));
+        }
+        // The slot lists are not kept in any order, so sort the timers expiring on this millisecond by their scheduling order.
+        std::sort(expiredTimers.begin() + slotBegin, expiredTimers.end());
+    }
+
+    // Trigger the batch. Timers added meanwhile expire at the earliest on the next frame.
+    for(size_t i = 0; i < expiredTimers.size(); ++i)
+    {
+        const int index = expiredTimers[i].second;
+        QObject *receiver = timers[index].receiver;
+        if (timers[index].pending && receiver)
+        {
+            float elapsed = (float)(now - timers[index].scheduleTime) / 1000.f;
+            if (timers[index].methodIndex < 0)
+                emit checked_static_cast<DelayedSignal *>(receiver)->Triggered(elapsed);
+            else
+            {
+                void *args[] = { 0, &elapsed };
+                QMetaObject::metacall(receiver, QMetaObject::InvokeMetaMethod, timers[index].methodIndex, args);
+            }
+        }
+        else if (timers[index].pending)
+        {
+            // The receiver has been deleted.
+            timers[index].pending = false;
+            --numPendingTimers;
+        }
+
+        // The callback may have cancelled the timer, or added timers and reallocated the pool.
+        Timer &timer = timers[index];
+        if (timer.pending && timer.interval > 0)
+        {
+            timer.scheduleTime = now;
+            timer.expireTime = now + timer.interval;
+            timer.sequence = nextTimerSequence++;
+            LinkTimer(index);
+            continue;
+        }
+        if (timer.pending)
+        {
+            timer.pending = false;
+            --numPendingTimers;
+            if (timer.methodIndex < 0 && timer.receiver)
+                timer.receiver->deleteLater();
+        }
+        FreeTimer(index);
+    }
+    expiredTimers.clear();
 }
 
 void FrameAPI::Update(float frametime)
@@ -64,12 +375,9 @@ void FrameAPI::Update(float frametime)
         currentFrameNumber = 0;
 }
 
-void FrameAPI::DeleteDelayedSignal()
+void FrameAPI::EndFrame(float frametime)
 {
-    DelayedSignal *expiredSignal = checked_static_cast<DelayedSignal *>(sender());
-    assert(expiredSignal);
-    delayedSignals.removeOne(expiredSignal);
-    SAFE_DELETE_LATER(expiredSignal);
+    emit FrameProcessed(frametime);
 }
 
 int FrameAPI::FrameNumber() const
@@ -77,11 +385,95 @@ int FrameAPI::FrameNumber() const
     return currentFrameNumber;
 }
 
-DelayedSignal::DelayedSignal(u64 startTime_) : startTime(startTime_)
+void FrameAPI::SetTickRate(float ticksPerSecond)
+{
+    tickRate = std::max(ticksPerSecond, 0.f);
+    tickAccumulator = 0.0;
+}
+
+void FrameAPI::SetMaxTicksPerFrame(int maxTicks)
+{
+    maxTicksPerFrame = std::max(maxTicks, 1);
+}
+
+int FrameAPI::BeginTicks(double frametime)
+{
+    if (tickRate <= 0.f)
+    {
+        ticksInLastFrame = 1;
+        return 1;
+    }
+
+    const double tickTime = 1.0 / tickRate;
+    tickAccumulator += frametime;
+    int ticks = (int)(tickAccumulator / tickTime);
+    if (ticks > maxTicksPerFrame)
+    {
+        // Too far behind: drop the excess time instead of trying to catch up, which would only make the next frame longer.
+        ticks = maxTicksPerFrame;
+        tickAccumulator = ticks * tickTime;
+    }
+    tickAccumulator -= ticks * tickTime;
+    ticksInLastFrame = ticks;
+    return ticks;
+}
+
+double FrameAPI::SecondsToNextTick() const
+{
+    if (tickRate <= 0.f)
+        return 0.0;
+    return std::max(0.0, 1.0 / tickRate - tickAccumulator);
+}
+
+float FrameAPI::TickInterpolation() const
+{
+    if (tickRate <= 0.f)
+        return 0.f;
+    return (float)std::min(tickAccumulator * tickRate, 0.999999);
+}
+
+void FrameAPI::SetPhaseTime(Phase phase, double msecs)
+{
+    phaseTimes[phase] = msecs;
+    averagePhaseTimes[phase] = 0.95 * averagePhaseTimes[phase] + 0.05 * msecs;
+}
+
+double FrameAPI::PhaseTime(const QString &phase) const
+{
+    for(int i = 0; i < NumPhases; ++i)
+        if (phase.compare(cPhaseNames[i], Qt::CaseInsensitive) == 0)
+            return phaseTimes[i];
+    LogWarning("FrameAPI::PhaseTime: Unknown phase \"" + phase + "\".");
+    return 0.0;
+}
+
+QVariantMap FrameAPI::PhaseTimes() const
+{
+    QVariantMap times;
+    for(int i = 0; i < NumPhases; ++i)
+        times[cPhaseNames[i]] = phaseTimes[i];
+    return times;
+}
+
+void FrameAPI::PrintPhaseTimes() const
+{
+    if (tickRate > 0.f)
+        LogInfo("Fixed tick rate " + QString::number(tickRate) + " Hz, " + QString::number(ticksInLastFrame) + " tick(s) in the last frame.");
+    else
+        LogInfo("Variable time step, one simulation update per frame.");
+    for(int i = 0; i < NumPhases; ++i)
+        LogInfo(QString(cPhaseNames[i]).leftJustified(12) + QString::number(phaseTimes[i], 'f', 3) + " ms (average " +
+            QString::number(averagePhaseTimes[i], 'f', 3) + " ms)");
+}
+
+DelayedSignal::DelayedSignal(FrameAPI *owner_) :
+    owner(owner_),
+    handle(0)
 {
 }
 
-void DelayedSignal::Expire()
+void DelayedSignal::Cancel()
 {
-    emit Triggered((float)((GetCurrentClockTime() - startTime) / GetCurrentClockFreq()));
+    if (owner->CancelDelayedExecute(handle))
+        deleteLater();
 }
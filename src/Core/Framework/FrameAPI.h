@@ -10,6 +10,11 @@
 #include "CoreTypes.h"
 
 #include <QObject>
+#include <QVariant>
+#include <QPointer>
+
+#include <vector>
+#include <utility>
 
 class Framework;
 class DelayedSignal;
@@ -19,7 +24,23 @@ class DelayedSignal;
     FrameAPI object can be used to:
     -retrieve signal every time frame has been processed
     -retrieve the wall clock time of Framework
-    -trigger delayed signals when spesified amount of time has elapsed. */
+    -trigger delayed signals when spesified amount of time has elapsed, once or repeatedly.
+    -control the simulation tick rate and retrieve the time spent in each phase of the frame.
+
+    The time spent in each frame is measured in phases: input (assets, input and console), simulation (module updates
+    and the Updated and PostFrameUpdate signals), audio and render. By default the simulation runs once per frame with
+    the variable frame time, and the updates run in their original order, in which the phases interleave. When a tick
+    rate is set with SetTickRate() or --tickRate, the phases instead run one after another, and the simulation runs in
+    fixed steps of 1/rate seconds: a frame runs as many ticks as the elapsed time covers, possibly none, and frametime
+    in the Updated() signal is always the fixed step. In headless mode, the main loop then sleeps until the next tick
+    is due. The fixed tick is opt-in in headless mode as well.
+
+    Delayed and repeated executions are kept in a hierarchical timer wheel with millisecond resolution, so scheduling
+    and cancelling a timer take constant time regardless of the number of pending timers. The timers are checked once
+    per frame at the start of the simulation phase, and all the timers that expired since the previous frame are
+    triggered together in the order of their expiration times, and the timers with the same expiration time in the
+    order they were scheduled. A timer therefore never triggers more than once per frame:
+    a repeated timer whose interval is shorter than the frame time triggers once and is rescheduled from the current time. */
 class FrameAPI : public QObject
 {
     Q_OBJECT
@@ -28,13 +49,19 @@ public slots:
     /// Return wall clock time of Framework in seconds.
     float WallClockTime() const;
 
-    /// Triggers DelayedSignal::Triggered(float) signal when spesified amount of time has elapsed.
-    /** Use this function when the receiver is a QObject.
+    /// Invokes the member of the receiver when spesified amount of time has elapsed.
+    /** Use this function when the receiver is a QObject. The member may take no parameters, or one float parameter
+        which receives the elapsed time in seconds. No QObjects are allocated for the timer. If the receiver is deleted
+        before the time has elapsed, nothing is invoked.
         @param time Time in seconds.
         @param receiver Receiver object.
         @param member Member slot. */
     void DelayedExecute(float time, const QObject *receiver, const char *member);
 
+    /// Same as DelayedExecute, but returns a handle to the timer, so that it can be cancelled.
+    /** @return Handle that can be passed to CancelDelayedExecute, or 0 if the member was not found. */
+    uint CancellableDelayedExecute(float time, const QObject *receiver, const char *member);
+
     /// @overload
     /** This function is provided for convenience for scripting languages
         @param time Time in seconds.
@@ -42,10 +69,61 @@ public slots:
         @note Never store the returned pointer. */
     DelayedSignal *DelayedExecute(float time);
 
+    /// Invokes the member of the receiver every interval seconds, until cancelled or the receiver is deleted.
+    /** The timer is reused for each interval, so periodic work does not allocate anything.
+        @param interval Interval in seconds. Intervals shorter than one millisecond trigger once per frame.
+        @param receiver Receiver object.
+        @param member Member slot, see DelayedExecute.
+        @return Handle that can be passed to CancelDelayedExecute, or 0 if the member was not found. */
+    uint RepeatedExecute(float interval, const QObject *receiver, const char *member);
+
+    /// @overload
+    /** This function is provided for convenience for scripting languages. The returned object emits Triggered()
+        every interval seconds until its Cancel() slot is called, after which it is deleted. */
+    DelayedSignal *RepeatedExecute(float interval);
+
+    /// Cancels a pending delayed or repeated execution.
+    /** Cancelling a timer that has already triggered or been cancelled does nothing.
+        @return True if the timer was pending. */
+    bool CancelDelayedExecute(uint handle);
+
+    /// Returns the number of pending delayed and repeated executions.
+    int NumPendingTimers() const { return numPendingTimers; }
+
     /// Returns the current application frame number.
-    /** @note It is best not to tie any timing-specific animation to this number, but instead use WallClockTime(). */
+    /** @note It is best not to tie any timing-specific animation to this number, but instead use WallClockTime().
+        @note With a fixed tick rate, this is the number of simulation ticks. */
     int FrameNumber() const;
 
+    /// Returns the fixed simulation tick rate in ticks per second, or 0 if the simulation runs once per frame.
+    float TickRate() const { return tickRate; }
+
+    /// Sets the fixed simulation tick rate in ticks per second. Pass 0 to run the simulation once per frame with a variable time step.
+    void SetTickRate(float ticksPerSecond);
+
+    /// Returns the maximum number of simulation ticks run in one frame. If the frames fall further behind, the simulation slows down.
+    int MaxTicksPerFrame() const { return maxTicksPerFrame; }
+
+    /// Sets the maximum number of simulation ticks run in one frame.
+    void SetMaxTicksPerFrame(int maxTicks);
+
+    /// Returns the number of simulation ticks run in the last frame.
+    int TicksInLastFrame() const { return ticksInLastFrame; }
+
+    /// Returns how far the time is between the previous and the next simulation tick, in the range [0, 1[.
+    /** Can be used to interpolate rendered positions between ticks. Always 0 if the tick rate is not fixed. */
+    float TickInterpolation() const;
+
+    /// Returns the time in milliseconds the given phase took in the last frame.
+    /** @param phase One of "input", "simulation", "audio", "render" or "frame" for the whole frame. */
+    double PhaseTime(const QString &phase) const;
+
+    /// Returns the phase times of the last frame as a map of phase name to milliseconds.
+    QVariantMap PhaseTimes() const;
+
+    /// Prints the phase times of the last frame and their averages to the console.
+    void PrintPhaseTimes() const;
+
 signals:
     /// Emitted when it is time for client code to update their applications.
     /** Scripts and client C++ code can hook into this signal to perform custom per-frame processing.
@@ -63,6 +141,12 @@ signals:
             call to the Updated(frametime) signal above. */
     void PostFrameUpdate(float frametime);
 
+    /// Emitted once at the end of each frame, after all the phases, so also for frames that run no simulation ticks.
+    /** Unlike Updated() and PostFrameUpdate(), which are emitted once per simulation tick, this can be used to sample
+        per-frame measurements: the phase times of the frame are already available through PhaseTime().
+        @param frametime Elapsed time in seconds since the previous frame. */
+    void FrameProcessed(float frametime);
+
 private:
     friend class Framework;
 
@@ -78,39 +162,114 @@ private:
     /** @param frametime Time elapsed since last frame. */
     void Update(float frametime);
 
+    /// Emits FrameProcessed() signal. Called by Framework at the end of each frame.
+    void EndFrame(float frametime);
+
+    /// Triggers the timers that have expired since the previous call. Called by Framework each frame.
+    void UpdateTimers();
+
+    /// A delayed or repeated execution stored in the timer wheel.
+    struct Timer
+    {
+        u64 expireTime; ///< Milliseconds since startTime.
+        u64 scheduleTime; ///< Time the timer was scheduled or last triggered, in milliseconds since startTime.
+        u32 interval; ///< Repeat interval in milliseconds, 0 for a one-shot timer.
+        QPointer<QObject> receiver; ///< Receiver object, or the DelayedSignal for scripting timers.
+        int methodIndex; ///< Index of the invoked method in the receiver's meta object, -1 for DelayedSignal.
+        int prev; ///< Previous timer in the same wheel slot or the free list, -1 if none.
+        int next; ///< Next timer in the same wheel slot or the free list, -1 if none.
+        int slot; ///< Wheel slot the timer is linked to, -1 if not linked.
+        uint generation; ///< Incremented each time the timer is reused, so that stale handles are rejected.
+        u64 sequence; ///< Order in which the timer was scheduled or last rescheduled.
+        bool pending; ///< Is the timer scheduled, or triggering and not cancelled.
+    };
+
+    /// Allocates and schedules a timer. Returns its handle.
+    uint AddTimer(u64 delayMsecs, u32 intervalMsecs, QObject *receiver, int methodIndex);
+
+    /// Creates a DelayedSignal object with a timer.
+    DelayedSignal *AddSignalTimer(float time, bool repeat);
+
+    /// Returns the index of the timer of the handle, or -1 if the handle is stale.
+    int TimerIndex(uint handle) const;
+
+    /// Links the timer to the wheel slot of its expiration time.
+    void LinkTimer(int index);
+
+    /// Unlinks the timer from its wheel slot.
+    void UnlinkTimer(int index);
+
+    /// Returns the timer to the free list.
+    void FreeTimer(int index);
+
+    /// Moves the timers of a slot of a higher wheel level to the lower levels.
+    void CascadeTimers(int slot);
+
+    /// Returns the time of Framework in milliseconds since startTime.
+    u64 ElapsedMsecs() const;
+
+    /// Phases of a frame, see the class description.
+    enum Phase
+    {
+        PhaseInput = 0,
+        PhaseSimulation,
+        PhaseAudio,
+        PhaseRender,
+        PhaseFrame,
+        NumPhases
+    };
+
+    /// Adds the elapsed time of the frame to the tick accumulator and returns the number of simulation ticks to run.
+    /** Called by Framework each frame. Returns 1 if the tick rate is not fixed. */
+    int BeginTicks(double frametime);
+
+    /// Returns the number of seconds until the next simulation tick is due, or 0 if the tick rate is not fixed.
+    double SecondsToNextTick() const;
+
+    /// Records the time spent in a phase. Called by Framework.
+    void SetPhaseTime(Phase phase, double msecs);
+
     u64 startTime; ///< Start time time of Framework/this object;
-    QList<DelayedSignal *> delayedSignals; ///< Delayed signals waiting for expiration.
+    std::vector<Timer> timers; ///< Timer pool. Indices stay valid while timers are freed and reused.
+    int freeTimers; ///< First timer of the free list, -1 if none.
+    std::vector<int> wheelSlots; ///< First timer of each slot of all the wheel levels, -1 if none.
+    u64 wheelTime; ///< Next millisecond to be processed by the timer wheel, since startTime.
+    int numPendingTimers;
+    u64 nextTimerSequence; ///< Sequence number given to the next scheduled timer.
+    std::vector<std::pair<u64, int> > expiredTimers; ///< Sequence numbers and indices of the timers triggered in the current UpdateTimers batch.
     int currentFrameNumber;
-
-private slots:
-    /// Deletes delayed signal object and removes it from the list when it's expired.
-    void DeleteDelayedSignal();
+    float tickRate; ///< Fixed simulation ticks per second, 0 for variable step.
+    int maxTicksPerFrame;
+    double tickAccumulator; ///< Elapsed time not yet consumed by simulation ticks, in seconds.
+    int ticksInLastFrame;
+    double phaseTimes[NumPhases]; ///< Time spent in each phase in the last frame, in milliseconds.
+    double averagePhaseTimes[NumPhases]; ///< Exponential moving average of the phase times, in milliseconds.
 };
 
 /// Stores a delayed signal invocation.
 /** Scripting languages connect their slots when wanting to receive delayed signal when certain amount of application time has passed.
     In C++ you can ignore the existence of this class, and just give your slot to FrameAPI's DelayedExecute as a parameter.
-    This class cannot be created directly, it's created by FrameAPI. */
+    This class cannot be created directly, it's created by FrameAPI. A one-shot signal deletes itself after it has been
+    triggered, a repeated signal when it is cancelled. */
 class DelayedSignal : public QObject
 {
     Q_OBJECT
 
     friend class FrameAPI;
 
+public slots:
+    /// Cancels the signal if it has not been triggered yet, or stops repeating it, and deletes this object.
+    void Cancel();
+
 signals:
     /// Emitted when delayed signal is triggered.
-    /** @param time Elapsed framework wall clock time. */
+    /** @param time Elapsed time in seconds since the signal was created or last triggered. */
     void Triggered(float time);
 
 private:
     /// Construct new signal delayed signal object.
-    /** @param startTime Application tick. */
-    explicit DelayedSignal(u64 startTime);
-
-    u64 startTime; ///< Application tick when object was created.
+    explicit DelayedSignal(FrameAPI *owner);
 
-private slots:
-    /// Emits Triggered() signal
-    /** Called by FrameAPI object when the spesified amount of time has passed. */
-    void Expire();
+    FrameAPI *owner;
+    uint handle; ///< Handle of the timer in owner.
 };
@@ -14,6 +14,7 @@
 #include "LoggingFunctions.h"
 #include "IModule.h"
 #include "FrameAPI.h"
+#include "TaskAPI.h"
 #include "ConsoleAPI.h"
 
 #include "InputAPI.h"
@@ -93,6 +94,15 @@ struct CommandLineParameterMap
 };
 /** @endcond */
 
+/// Returns the milliseconds elapsed since the given time, and sets the time to the current time.
+double TakeElapsedMsecs(tick_t &time, tick_t clockFreq)
+{
+    const tick_t now = GetCurrentClockTime();
+    const double msecs = (now - time) * 1000.0 / clockFreq;
+    time = now;
+    return msecs;
+}
+
 } //~unnamed namespace
 
 Framework *Framework::instance = 0;
@@ -110,6 +120,7 @@ Framework::Framework(int argc_, char** argv_) :
     asset(0),
     audio(0),
     plugin(0),
+    tasks(0),
     config(0),
     ui(0),
 #ifdef PROFILING
@@ -153,10 +164,17 @@ Framework::Framework(int argc_, char** argv_) :
     cmdLineDescs.commands["--version"] = "Produces version information."; // Framework
     cmdLineDescs.commands["--headless"] = "Runs Tundra in headless mode without any windows or rendering."; // Framework
     cmdLineDescs.commands["--disableRunOnLoad"] = "Prevents script applications (EC_Script's with applicationName defined) starting automatically."; //JavascriptModule
+    cmdLineDescs.commands["--jsSharedEngines"] = "Script instances loaded from script assets share one Javascript engine per trust level instead of each creating their own."; // JavascriptModule
+    cmdLineDescs.commands["--jsProfiler"] = "Starts profiling the time spent in Javascript per script instance and function. See the JsProfiler console command."; // JavascriptModule
+    cmdLineDescs.commands["--jsBudget"] = "Specifies the time budget in milliseconds that each Javascript script instance may use per frame. Disabled by default."; // JavascriptModule
+    cmdLineDescs.commands["--jsBudgetAction"] = "Specifies what is done when a script instance exceeds --jsBudget. Options: 'warn' (default) and 'throttle'."; // JavascriptModule
     cmdLineDescs.commands["--server"] = "Starts Tundra as server."; // TundraLogicModule
     cmdLineDescs.commands["--port"] = "Specifies the Tundra server port."; // TundraLogicModule
     cmdLineDescs.commands["--protocol"] = "Specifies the Tundra server protocol. Options: '--protocol tcp' and '--protocol udp'. Defaults to udp if no protocol is spesified."; // KristalliProtocolModule
     cmdLineDescs.commands["--fpsLimit"] = "Specifies the FPS cap to use in rendering. Default: 60. Pass in 0 to disable."; // Framework
+    cmdLineDescs.commands["--tickRate"] = "Runs the simulation in fixed steps of the given number of ticks per second instead of once per frame, with the frame split into input, simulation, audio and render phases. In headless mode, the main loop then sleeps until the next tick. Default: 0, i.e. once per frame in the original update order."; // Framework
+    cmdLineDescs.commands["--taskThreads"] = "Specifies the number of TaskAPI worker threads. Default: the number of hardware threads minus one."; // Framework
+    cmdLineDescs.commands["--tickMaxSteps"] = "Specifies the maximum number of simulation ticks run in one frame with --tickRate. Default: 5."; // Framework
     cmdLineDescs.commands["--run"] = "Runs script on startup"; // JavaScriptModule
     cmdLineDescs.commands["--file"] = "Specifies a startup scene file. Multiple files supported. Accepts absolute and relative paths, local:// and http:// are accepted and fetched via the AssetAPI."; // TundraLogicModule & AssetModule
     cmdLineDescs.commands["--storage"] = "Adds the given directory as a local storage directory on startup."; // AssetModule
@@ -169,6 +187,11 @@ Framework::Framework(int argc_, char** argv_) :
     cmdLineDescs.commands["--clear-asset-cache"] = "At the start of Tundra, remove all data and metadata files from asset cache."; // AssetCache
     cmdLineDescs.commands["--logLevel"] = "Sets the current log level: 'error', 'warning', 'info', 'debug'."; // ConsoleAPI
     cmdLineDescs.commands["--logFile"] = "Sets logging file. Usage example: '--logfile TundraLogFile.txt'."; // ConsoleAPI
+    cmdLineDescs.commands["--logJson"] = "Writes the log file as JSON lines with time, channel and thread of each message."; // ConsoleAPI
+    cmdLineDescs.commands["--logMaxSize"] = "Rotates the log file when it grows larger than the given size in megabytes."; // ConsoleAPI
+    cmdLineDescs.commands["--logMaxAge"] = "Rotates the log file when it is older than the given number of minutes."; // ConsoleAPI
+    cmdLineDescs.commands["--logMaxFiles"] = "Specifies how many rotated log files are kept. Default: 5."; // ConsoleAPI
+    cmdLineDescs.commands["--logRateLimit"] = "Specifies the maximum number of errors and of warnings with the same text, ignoring numbers, logged per second. The number of dropped messages is logged afterwards. Pass in 0 to disable. Default: 100."; // ConsoleAPI
     cmdLineDescs.commands["--physicsRate"] = "Specifies the number of physics simulation steps per second. Default: 60."; // PhysicsModule
     cmdLineDescs.commands["--physicsMaxSteps"] = "Specifies the maximum number of physics simulation steps in one frame to limit CPU usage. If the limit would be exceeded, physics will appear to slow down. Default: 6."; // PhysicsModule
     cmdLineDescs.commands["--splash"] = "Shows splash screen during the startup."; // Framework
@@ -190,7 +213,25 @@ Framework::Framework(int argc_, char** argv_) :
     cmdLineDescs.commands["--noCentralWidget"] = "Disables the usage of QMainWindow's central widget."; // Framework
     cmdLineDescs.commands["--noMenuBar"] = "Disables showing of the application menu bar automatically."; // Framework
     cmdLineDescs.commands["--clientExtrapolationTime"] = "Rigidbody extrapolation time on client in milliseconds. Default 66."; // TundraProtocolModule
+    cmdLineDescs.commands["--noAnimationLod"] = "Disables visibility- and distance-based update rate reduction of skeletal animations."; // OgreRenderingModule
+    cmdLineDescs.commands["--parallelSkeletalAnimation"] = "Blends the animations of independent hardware-skinned skeletons in parallel on worker threads. Can also be enabled with the \"parallel skeletal animation\" rendering config setting."; // OgreRenderingModule
+    cmdLineDescs.commands["--occlusionCulling"] = "Enables software occlusion culling of meshes hidden behind large occluder meshes from the main camera."; // OgreRenderingModule
+    cmdLineDescs.commands["--noHoveringTextBatching"] = "Disables drawing EC_HoveringText components in shared batches from a glyph atlas, painting each text into its own texture instead."; // EC_HoveringText
+    cmdLineDescs.commands["--noMaterialDeduplication"] = "Disables sharing one Ogre material between identical deduplicated material assets, such as EC_Material outputs."; // OgreRenderingModule
+    cmdLineDescs.commands["--audioVoices"] = "Specifies the maximum number of sounds that are played with OpenAL sources at the same time. The least audible sounds are played as virtual voices. Default: 32."; // AudioAPI
+    cmdLineDescs.commands["--renderBenchmark"] = "Renders the startup scene along a camera path and writes the CPU frame time breakdown to the given JSON file, then exits. Usage: '--renderBenchmark <file.json>'."; // OgreRenderingModule
+    cmdLineDescs.commands["--benchmarkFrames"] = "Number of frames recorded by --renderBenchmark. Default: 600."; // OgreRenderingModule
+    cmdLineDescs.commands["--benchmarkWarmup"] = "Number of frames run before recording with --renderBenchmark. Default: 60."; // OgreRenderingModule
+    cmdLineDescs.commands["--benchmarkCameraPath"] = "Camera path file for --renderBenchmark with one 'posX posY posZ targetX targetY targetZ' waypoint per line. Default: orbit around the scene."; // OgreRenderingModule
+    cmdLineDescs.commands["--benchmarkRtt"] = "Renders --renderBenchmark offscreen into a render texture instead of the window. Usage: '--benchmarkRtt [<width>x<height>]'. Default size: 1280x720."; // OgreRenderingModule
+    cmdLineDescs.commands["--serverBenchmark"] = "Connects simulated clients to the server, runs a workload and writes the server tick times, bandwidth, queue depths and memory usage to the given JSON file, then exits. Requires --server. Usage: '--serverBenchmark <file.json>'."; // TundraProtocolModule
+    cmdLineDescs.commands["--serverBenchmarkClients"] = "Comma-separated client counts of the stages run by --serverBenchmark. Default: 10,100,500."; // TundraProtocolModule
+    cmdLineDescs.commands["--serverBenchmarkWarmup"] = "Seconds the workload runs before recording each stage of --serverBenchmark. Default: 5."; // TundraProtocolModule
+    cmdLineDescs.commands["--serverBenchmarkDuration"] = "Seconds recorded for each stage of --serverBenchmark. Default: 30."; // TundraProtocolModule
+    cmdLineDescs.commands["--serverBenchmarkWorkload"] = "Workload file for --serverBenchmark with one '<move|edit|action> <rate> [arguments]' item per line. Default: move 10, edit 0.2, action 1."; // TundraProtocolModule
+    cmdLineDescs.commands["--zipMemoryMap"] = "Reads the sub assets of zip asset bundles through a memory mapping of the archive instead of file handles."; // ArchivePlugin
     cmdLineDescs.commands["--noClientPhysics"] = "Disables rigidbody handoff to client simulation after no movement packets received from server."; // TundraProtocolModule
+    cmdLineDescs.commands["--clientPrediction"] = "Simulates the entity assigned with UserConnection::SetControlledEntity on the client right away from the input, and replays the unacknowledged inputs on the server state. See the predictionstats console command."; // TundraProtocolModule
     
     apiVersionInfo = new VersionInfo(Application::Version());
     applicationVersionInfo = new VersionInfo(Application::Version());
@@ -253,6 +294,14 @@ Framework::Framework(int argc_, char** argv_) :
 
     // Create core APIs
     frame = new FrameAPI(this);
+    QStringList taskThreadsParam = CommandLineParameters("--taskThreads");
+    tasks = new TaskAPI(this, taskThreadsParam.size() > 0 ? taskThreadsParam.last().toInt() : -1);
+    QStringList tickRateParam = CommandLineParameters("--tickRate");
+    if (tickRateParam.size() > 0)
+        frame->SetTickRate(tickRateParam.last().toFloat());
+    QStringList maxTicksParam = CommandLineParameters("--tickMaxSteps");
+    if (maxTicksParam.size() > 0)
+        frame->SetMaxTicksPerFrame(maxTicksParam.last().toInt());
     scene = new SceneAPI(this);
     plugin = new PluginAPI(this);
     asset = new AssetAPI(this, headless);
@@ -272,6 +321,11 @@ Framework::Framework(int argc_, char** argv_) :
     console->RegisterCommand("exit", "Shuts down gracefully.", this, SLOT(Exit()));
     console->RegisterCommand("inputContexts", "Prints all currently registered input contexts in InputAPI.", input, SLOT(DumpInputContexts()));
     console->RegisterCommand("dynamicObjects", "Prints all currently registered dynamic objets in Framework.", this, SLOT(PrintDynamicObjects()));
+    console->RegisterCommand("taskStats", "Prints the thread pool statistics of TaskAPI.", tasks, SLOT(PrintStatistics()));
+    console->RegisterCommand("frameTimings", "Prints the time spent in each phase of the last frame.", frame, SLOT(PrintPhaseTimes()));
+    console->RegisterCommand("benchmarkSceneLoad", "Loads a scene XML file into a temporary scene with the streaming and the QDomDocument loader and prints the load times. "
+        "Usage: benchmarkSceneLoad(filename,runs=1)", scene, SLOT(BenchmarkSceneLoad(const QString &, int)), SLOT(BenchmarkSceneLoad(const QString &)));
+    console->RegisterCommand("audioVoices", "Prints the voice statistics of AudioAPI.", audio, SLOT(PrintVoiceStatistics()));
 
     /// @todo Remove when SceneInteract is moved out of the core.
     scene->GetSceneInteract()->Initialize(this);
@@ -295,6 +349,7 @@ Framework::~Framework()
     SAFE_DELETE(asset);
     SAFE_DELETE(audio);
     SAFE_DELETE(plugin);
+    SAFE_DELETE(tasks);
 #ifdef PROFILING
     SAFE_DELETE(profiler);
 #endif
@@ -334,6 +389,71 @@ void Framework::ProcessOneFrame()
     double frametime = ((double)currClockTime - (double)lastClockTime) / (double) clockFreq;
     lastClockTime = currClockTime;
 
+    const int numTicks = frame->BeginTicks(frametime);
+    tick_t phaseTime = currClockTime;
+    if (frame->TickRate() <= 0.f)
+    {
+        // Without a fixed tick rate, the updates run once per frame in their original order, which the existing
+        // applications depend on. The phase times add up the interleaved parts of each phase.
+        tasks->Update();
+        frame->UpdateTimers();
+        UpdateModules(frametime);
+        double simulationMsecs = TakeElapsedMsecs(phaseTime, clockFreq);
+        asset->Update(frametime);
+        input->Update(frametime);
+        double inputMsecs = TakeElapsedMsecs(phaseTime, clockFreq);
+        audio->Update(frametime);
+        frame->SetPhaseTime(FrameAPI::PhaseAudio, TakeElapsedMsecs(phaseTime, clockFreq));
+        console->Update(frametime);
+        inputMsecs += TakeElapsedMsecs(phaseTime, clockFreq);
+        frame->Update(frametime);
+        simulationMsecs += TakeElapsedMsecs(phaseTime, clockFreq);
+        frame->SetPhaseTime(FrameAPI::PhaseInput, inputMsecs);
+        frame->SetPhaseTime(FrameAPI::PhaseSimulation, simulationMsecs);
+    }
+    else
+    {
+        // Input phase: asset loading, input and console commands.
+        // Input events are moved to the current state only when the simulation runs, so that ticks never miss them.
+        {
+            PROFILE(Framework_PhaseInput);
+            tasks->Update();
+            asset->Update(frametime);
+            if (numTicks > 0)
+                input->Update(frametime);
+            console->Update(frametime);
+        }
+        frame->SetPhaseTime(FrameAPI::PhaseInput, TakeElapsedMsecs(phaseTime, clockFreq));
+
+        // Simulation phase: module updates and the FrameAPI signals in fixed ticks.
+        {
+            PROFILE(Framework_PhaseSimulation);
+            frame->UpdateTimers();
+            const double tickTime = 1.0 / frame->TickRate();
+            for(int tick = 0; tick < numTicks; ++tick)
+            {
+                UpdateModules(tickTime);
+                frame->Update(tickTime);
+            }
+        }
+        frame->SetPhaseTime(FrameAPI::PhaseSimulation, TakeElapsedMsecs(phaseTime, clockFreq));
+
+        // Audio phase.
+        audio->Update(frametime);
+        frame->SetPhaseTime(FrameAPI::PhaseAudio, TakeElapsedMsecs(phaseTime, clockFreq));
+    }
+
+    // Render phase. The renderer reads the scene state written by the simulation on this same thread,
+    // so rendering can not overlap with the next tick.
+    if (renderer)
+        renderer->Render(frametime);
+    frame->SetPhaseTime(FrameAPI::PhaseRender, TakeElapsedMsecs(phaseTime, clockFreq));
+    frame->SetPhaseTime(FrameAPI::PhaseFrame, (phaseTime - currClockTime) * 1000.0 / clockFreq);
+    frame->EndFrame(frametime);
+}
+
+void Framework::UpdateModules(f64 frametime)
+{
     for(size_t i = 0; i < modules.size(); ++i)
     {
         try
@@ -357,15 +477,6 @@ void Framework::ProcessOneFrame()
             LogError(error);
         }
     }
-
-    asset->Update(frametime);
-    input->Update(frametime);
-    audio->Update(frametime);
-    console->Update(frametime);
-    frame->Update(frametime);
-
-    if (renderer)
-        renderer->Render(frametime);
 }
 
 void Framework::Go()
@@ -394,6 +505,9 @@ void Framework::Go()
     // Qt main loop execution has ended, we are exiting.
     exitSignal = true;
 
+    // Finish the pending tasks before the modules they may refer to go away.
+    tasks->Reset();
+
     for(size_t i = 0; i < modules.size(); ++i)
     {
         LogDebug("Uninitializing module " + modules[i]->Name());
@@ -507,6 +621,11 @@ PluginAPI *Framework::Plugins() const
     return plugin;
 }
 
+TaskAPI *Framework::Tasks() const
+{
+    return tasks;
+}
+
 IRenderer *Framework::Renderer() const
 {
     return renderer;
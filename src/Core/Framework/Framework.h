@@ -113,6 +113,9 @@ public slots:
     /// Returns core API Plugin object.
     PluginAPI *Plugins() const;
 
+    /// Returns core API Task object.
+    TaskAPI *Tasks() const;
+
     /// The Tundra API version information of this build.
     /** May differ from the end user application version of the default distribution, i.e. app may change when api stays same.
         @todo Delete/simplify. */
@@ -159,6 +162,9 @@ private:
     /// Appends all found startup options from the given file to the startupOptions member.
     void LoadStartupOptionsFromXML(QString configurationFile);
 
+    /// Calls Update for all the modules, catching any exceptions.
+    void UpdateModules(f64 frametime);
+
     bool exitSignal; ///< If true, exit application.
 #ifdef PROFILING
     Profiler *profiler;
@@ -175,6 +181,7 @@ private:
     SceneAPI *scene;
     ConfigAPI *config;
     PluginAPI *plugin;
+    TaskAPI *tasks;
     IRenderer *renderer;
 
     /// Stores all command line parameters and startup options specified in the Config XML files.
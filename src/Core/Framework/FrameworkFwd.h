@@ -19,6 +19,7 @@ class Exception;
 class FrameAPI;
 class ConfigAPI;
 class PluginAPI;
+class TaskAPI;
 class VersionInfo;
 // The following are external to Framework
 class UiAPI;
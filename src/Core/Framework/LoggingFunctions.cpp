@@ -21,7 +21,7 @@ void PrintLogMessage(u32 logChannel, const char *str)
 #endif
     // The console and stdout prints are equivalent.
     if (console)
-        console->Print(str);
+        console->Log(logChannel, str);
     else // The Console API is already dead for some reason, print directly to stdout to guarantee we don't lose any logging messags.
         printf("%s", str);
 
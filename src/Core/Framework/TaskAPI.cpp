@@ -0,0 +1,372 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TaskAPI.cpp
+    @brief  Task core API. Runs work on a shared work-stealing thread pool. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "TaskAPI.h"
+#include "Framework.h"
+#include "Profiler.h"
+#include "LoggingFunctions.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+
+/// Index of the worker of the current thread. Not set in threads outside the pool.
+boost::thread_specific_ptr<int> currentWorkerIndex;
+
+/// Runs body for one subrange of TaskAPI::ParallelFor.
+void RunRange(const boost::function<void(int, int)> &body, int rangeBegin, int rangeEnd)
+{
+    body(rangeBegin, rangeEnd);
+}
+
+}
+
+Task::Task(const boost::function<void()> &func_, const std::string &name_, bool mainThread_) :
+    func(func_),
+    name(name_),
+    mainThread(mainThread_),
+    unfinishedDependencies(1),
+    finished(0)
+{
+}
+
+TaskAPI::TaskAPI(Framework *fw, int numThreads) :
+    QObject(fw),
+    framework(fw),
+    nextWorker(0),
+    numQueued(0),
+    stopRequested(0),
+    frameNumber(0),
+    numExecutedOnMainThread(0)
+{
+    mainThreadId = boost::this_thread::get_id();
+
+    if (numThreads < 0)
+        numThreads = std::max<int>((int)boost::thread::hardware_concurrency() - 1, 1);
+
+    for(int i = 0; i < numThreads; ++i)
+        workers.push_back(new Worker);
+    // Start the threads only when all the queues exist, as the workers steal from each other.
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i]->thread = boost::thread(boost::bind(&TaskAPI::WorkerMain, this, (int)i));
+}
+
+TaskAPI::~TaskAPI()
+{
+    Reset();
+}
+
+void TaskAPI::Reset()
+{
+    {
+        boost::mutex::scoped_lock lock(sleepMutex);
+        stopRequested = 1;
+    }
+    workAvailable.notify_all();
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i]->thread.join();
+
+    // Run what was left in the queues, so that no dependent waits forever.
+    for(TaskPtr task = FindTask(-1); task; task = FindTask(-1))
+        Execute(task);
+    for(TaskPtr task = PopMainThreadTask(); task; task = PopMainThreadTask())
+        Execute(task);
+
+    for(size_t i = 0; i < workers.size(); ++i)
+        delete workers[i];
+    workers.clear();
+}
+
+TaskPtr TaskAPI::Run(const boost::function<void()> &func, const std::string &name)
+{
+    return Submit(TaskPtr(new Task(func, name, false)), TaskList());
+}
+
+TaskPtr TaskAPI::Run(const boost::function<void()> &func, const TaskList &dependencies, const std::string &name)
+{
+    return Submit(TaskPtr(new Task(func, name, false)), dependencies);
+}
+
+TaskPtr TaskAPI::RunOnMainThread(const boost::function<void()> &func, const TaskList &dependencies, const std::string &name)
+{
+    return Submit(TaskPtr(new Task(func, name, true)), dependencies);
+}
+
+TaskPtr TaskAPI::Submit(const TaskPtr &task, const TaskList &dependencies)
+{
+    for(size_t i = 0; i < dependencies.size(); ++i)
+    {
+        Task *dependency = dependencies[i].get();
+        if (!dependency)
+            continue;
+        boost::mutex::scoped_lock lock(dependency->dependentsMutex);
+        if (!dependency->IsFinished())
+        {
+            task->unfinishedDependencies.ref();
+            dependency->dependents.push_back(task);
+        }
+    }
+
+    // Release the reference held during scheduling. If all dependencies were already done, the task is ready now.
+    if (!task->unfinishedDependencies.deref())
+        Schedule(task);
+    return task;
+}
+
+void TaskAPI::Schedule(const TaskPtr &task)
+{
+    if (task->mainThread || workers.empty() || (int)stopRequested)
+    {
+        boost::mutex::scoped_lock lock(mainThreadMutex);
+        mainThreadTasks.push_back(task);
+    }
+    else
+    {
+        // Workers push to their own queue, other threads distribute the tasks in turn.
+        int index = CurrentWorkerIndex();
+        if (index < 0)
+            index = (nextWorker.fetchAndAddRelaxed(1) & 0x7fffffff) % (int)workers.size();
+        Worker *worker = workers[index];
+        {
+            boost::mutex::scoped_lock lock(worker->mutex);
+            worker->tasks.push_back(task);
+        }
+        numQueued.ref();
+        // Take the sleep mutex so that the notification can not slip in between a worker's check and wait.
+        boost::mutex::scoped_lock lock(sleepMutex);
+        workAvailable.notify_one();
+    }
+    // A waiting thread may be able to run this task.
+    taskFinished.notify_all();
+}
+
+void TaskAPI::Execute(const TaskPtr &task)
+{
+    {
+#ifdef PROFILING
+        boost::shared_ptr<ProfilerSection> section;
+        if (!task->name.empty())
+            section = boost::shared_ptr<ProfilerSection>(new ProfilerSection("Task_" + task->name));
+#endif
+        try
+        {
+            if (task->func)
+                task->func();
+        }
+        catch(const std::exception &e)
+        {
+            LogError("TaskAPI: Task " + QString::fromStdString(task->name) + " threw an exception: " + (e.what() ? e.what() : "(null)"));
+        }
+        catch(...)
+        {
+            LogError("TaskAPI: Task " + QString::fromStdString(task->name) + " threw an unknown exception.");
+        }
+    }
+    // Release the captured state now rather than when the last reference to the task goes away.
+    task->func.clear();
+
+    std::vector<TaskPtr> dependents;
+    {
+        boost::mutex::scoped_lock lock(task->dependentsMutex);
+        task->finished = 1;
+        dependents.swap(task->dependents);
+    }
+    for(size_t i = 0; i < dependents.size(); ++i)
+        if (!dependents[i]->unfinishedDependencies.deref())
+            Schedule(dependents[i]);
+
+    {
+        boost::mutex::scoped_lock lock(sleepMutex);
+        taskFinished.notify_all();
+    }
+}
+
+TaskPtr TaskAPI::FindTask(int workerIndex)
+{
+    if (workerIndex >= 0)
+    {
+        Worker *own = workers[workerIndex];
+        boost::mutex::scoped_lock lock(own->mutex);
+        if (!own->tasks.empty())
+        {
+            TaskPtr task = own->tasks.back();
+            own->tasks.pop_back();
+            numQueued.deref();
+            return task;
+        }
+    }
+
+    // Steal the oldest task of another worker, starting from the next worker to spread the contention.
+    const int numWorkers = (int)workers.size();
+    for(int i = 1; i <= numWorkers; ++i)
+    {
+        int victimIndex = (workerIndex + i + numWorkers) % numWorkers;
+        if (victimIndex == workerIndex)
+            continue;
+        Worker *victim = workers[victimIndex];
+        boost::mutex::scoped_lock lock(victim->mutex);
+        if (!victim->tasks.empty())
+        {
+            TaskPtr task = victim->tasks.front();
+            victim->tasks.pop_front();
+            numQueued.deref();
+            if (workerIndex >= 0)
+                ++workers[workerIndex]->numStolen;
+            return task;
+        }
+    }
+    return TaskPtr();
+}
+
+TaskPtr TaskAPI::PopMainThreadTask()
+{
+    boost::mutex::scoped_lock lock(mainThreadMutex);
+    if (mainThreadTasks.empty())
+        return TaskPtr();
+    TaskPtr task = mainThreadTasks.front();
+    mainThreadTasks.pop_front();
+    return task;
+}
+
+void TaskAPI::WorkerMain(int workerIndex)
+{
+    currentWorkerIndex.reset(new int(workerIndex));
+    Worker *worker = workers[workerIndex];
+    int lastFrame = (int)frameNumber;
+
+    for(;;)
+    {
+        TaskPtr task = FindTask(workerIndex);
+        if (task)
+        {
+            Execute(task);
+            ++worker->numExecuted;
+            continue;
+        }
+
+#ifdef PROFILING
+        // The Profiler data of each thread must be reset once per frame.
+        if ((int)frameNumber != lastFrame)
+        {
+            lastFrame = (int)frameNumber;
+            RESETPROFILER;
+        }
+#endif
+
+        boost::mutex::scoped_lock lock(sleepMutex);
+        if ((int)stopRequested)
+            return;
+        if ((int)numQueued <= 0)
+            workAvailable.wait(lock);
+    }
+}
+
+void TaskAPI::Update()
+{
+    PROFILE(TaskAPI_Update);
+
+    frameNumber.ref();
+    // Run only the tasks that were ready at the start, so that a task scheduling itself again does not hang the frame.
+    size_t numReady;
+    {
+        boost::mutex::scoped_lock lock(mainThreadMutex);
+        numReady = mainThreadTasks.size();
+    }
+    for(size_t i = 0; i < numReady; ++i)
+    {
+        TaskPtr task = PopMainThreadTask();
+        if (!task)
+            break;
+        Execute(task);
+        numExecutedOnMainThread.ref();
+    }
+}
+
+void TaskAPI::Wait(const TaskPtr &task)
+{
+    if (!task)
+        return;
+
+    const int workerIndex = CurrentWorkerIndex();
+    const bool mainThread = IsMainThread();
+    while(!task->IsFinished())
+    {
+        // Help instead of blocking. Main thread tasks may only run on the main thread.
+        TaskPtr other;
+        if (mainThread)
+            other = PopMainThreadTask();
+        if (!other && !workers.empty())
+            other = FindTask(workerIndex);
+        if (other)
+        {
+            Execute(other);
+            if (mainThread)
+                numExecutedOnMainThread.ref();
+            continue;
+        }
+
+        boost::mutex::scoped_lock lock(sleepMutex);
+        if (!task->IsFinished())
+            taskFinished.timed_wait(lock, boost::posix_time::milliseconds(1));
+    }
+}
+
+void TaskAPI::WaitAll(const TaskList &tasks)
+{
+    for(size_t i = 0; i < tasks.size(); ++i)
+        Wait(tasks[i]);
+}
+
+void TaskAPI::ParallelFor(int begin, int end, const boost::function<void(int, int)> &body, int grainSize, const std::string &name)
+{
+    if (end <= begin)
+        return;
+
+    const int count = end - begin;
+    if (grainSize <= 0)
+        grainSize = std::max(1, count / (4 * (NumThreads() + 1)));
+    if (count <= grainSize || workers.empty())
+    {
+        body(begin, end);
+        return;
+    }
+
+    TaskList tasks;
+    // The calling thread runs the first range itself.
+    for(int rangeBegin = begin + grainSize; rangeBegin < end; rangeBegin += grainSize)
+        tasks.push_back(Run(boost::bind(&RunRange, boost::cref(body), rangeBegin, std::min(rangeBegin + grainSize, end)), name));
+    body(begin, begin + grainSize);
+    WaitAll(tasks);
+}
+
+int TaskAPI::CurrentWorkerIndex() const
+{
+    int *index = currentWorkerIndex.get();
+    return index ? *index : -1;
+}
+
+bool TaskAPI::IsMainThread() const
+{
+    return boost::this_thread::get_id() == mainThreadId;
+}
+
+void TaskAPI::PrintStatistics() const
+{
+    LogInfo("TaskAPI: " + QString::number(workers.size()) + " worker threads, " + QString::number((int)numQueued) + " tasks queued, " +
+        QString::number((int)numExecutedOnMainThread) + " tasks run on the main thread.");
+    for(size_t i = 0; i < workers.size(); ++i)
+        LogInfo("Worker " + QString::number(i) + ": " + QString::number(workers[i]->numExecuted) + " tasks run, " +
+            QString::number(workers[i]->numStolen) + " stolen.");
+}
@@ -0,0 +1,168 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TaskAPI.h
+    @brief  Task core API. Runs work on a shared work-stealing thread pool. */
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <QObject>
+#include <QAtomicInt>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <deque>
+#include <vector>
+#include <string>
+
+class Framework;
+class TaskAPI;
+
+/// A unit of work scheduled with TaskAPI.
+/** Tasks are created with TaskAPI::Run or TaskAPI::RunOnMainThread, never directly.
+    A task starts when all of its dependencies have finished, and can be waited for with TaskAPI::Wait. */
+class Task
+{
+public:
+    /// Returns true when the task has finished running.
+    bool IsFinished() const { return (int)finished != 0; }
+
+    /// Returns the name of the task, used as its Profiler block name.
+    const std::string &Name() const { return name; }
+
+private:
+    friend class TaskAPI;
+    Task(const boost::function<void()> &func, const std::string &name, bool mainThread);
+
+    boost::function<void()> func;
+    std::string name;
+    bool mainThread; ///< Must the task run on the main thread.
+    QAtomicInt unfinishedDependencies; ///< Dependencies not finished yet, plus one while the task is being scheduled.
+    QAtomicInt finished;
+    boost::mutex dependentsMutex; ///< Protects dependents, and the transition to finished.
+    std::vector<boost::shared_ptr<Task> > dependents; ///< Tasks waiting for this task to finish.
+};
+
+typedef boost::shared_ptr<Task> TaskPtr;
+typedef std::vector<TaskPtr> TaskList;
+
+/// Runs work on a shared thread pool sized to the machine.
+/** Each worker thread has its own task queue. A worker runs the most recently queued task of its own queue first,
+    and when its queue is empty, steals the oldest task of another worker. Tasks scheduled from the main thread are
+    distributed to the workers in turn.
+
+    Tasks may depend on other tasks, in which case they are started only when all the dependencies have finished.
+    Tasks created with RunOnMainThread run on the main thread when Framework processes the next frame, which is useful
+    for continuations that touch the scene, Ogre or Qt objects. Wait() runs other queued tasks while waiting, so waiting
+    in a task does not starve the pool.
+
+    In builds with PROFILING defined, each named task is shown as a "Task_<name>" block in the Profiler tree of its thread.
+
+    The number of worker threads defaults to the number of hardware threads minus one for the main thread,
+    and can be set with --taskThreads. With --taskThreads 0, all tasks run on the main thread when they are waited for
+    or when the next frame is processed. */
+class TaskAPI : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// Runs the function on a worker thread.
+    /** @param name Name of the task for profiling, may be empty. */
+    TaskPtr Run(const boost::function<void()> &func, const std::string &name = std::string());
+
+    /// Runs the function on a worker thread after all the given tasks have finished.
+    TaskPtr Run(const boost::function<void()> &func, const TaskList &dependencies, const std::string &name = std::string());
+
+    /// Runs the function on the main thread during the next frame, after all the given tasks have finished.
+    TaskPtr RunOnMainThread(const boost::function<void()> &func, const TaskList &dependencies = TaskList(), const std::string &name = std::string());
+
+    /// Blocks until the task has finished, running other tasks meanwhile.
+    /** Waiting on the main thread for a task created with RunOnMainThread runs it immediately when its dependencies are done. */
+    void Wait(const TaskPtr &task);
+
+    /// Blocks until all the given tasks have finished.
+    void WaitAll(const TaskList &tasks);
+
+    /// Calls body(rangeBegin, rangeEnd) for consecutive subranges of [begin, end[ in parallel, and returns when all are done.
+    /** @param grainSize Minimum number of indices in one subrange. 0 chooses a size that gives a few subranges per thread. */
+    void ParallelFor(int begin, int end, const boost::function<void(int, int)> &body, int grainSize = 0, const std::string &name = std::string());
+
+    /// Returns the number of worker threads.
+    int NumThreads() const { return (int)workers.size(); }
+
+public slots:
+    /// Prints the task statistics to the console.
+    void PrintStatistics() const;
+
+private:
+    friend class Framework;
+
+    /// Constructor. Framework takes ownership of this object.
+    /** @param numThreads Number of worker threads, or -1 to use one less than the number of hardware threads. */
+    TaskAPI(Framework *fw, int numThreads);
+    ~TaskAPI();
+
+    /// Stops and joins the worker threads. Remaining worker tasks are run on the calling thread.
+    void Reset();
+
+    /// Runs the main thread tasks that are ready. Called by Framework each frame.
+    void Update();
+
+    /// Queue of one worker thread.
+    struct Worker
+    {
+        Worker() : numExecuted(0), numStolen(0) {}
+        boost::mutex mutex;
+        std::deque<TaskPtr> tasks; ///< The owner pops from the back, thieves from the front.
+        boost::thread thread;
+        uint numExecuted;
+        uint numStolen;
+    };
+
+    /// Queues a task whose dependencies have finished.
+    void Schedule(const TaskPtr &task);
+
+    /// Adds the dependencies and schedules the task if they have all finished.
+    TaskPtr Submit(const TaskPtr &task, const TaskList &dependencies);
+
+    /// Runs the task and schedules the dependents whose last dependency it was.
+    void Execute(const TaskPtr &task);
+
+    /// Takes a task from the given worker's own queue, or steals one from the other workers. Worker index -1 only steals.
+    TaskPtr FindTask(int workerIndex);
+
+    /// Takes a ready main thread task.
+    TaskPtr PopMainThreadTask();
+
+    /// Entry point of a worker thread.
+    void WorkerMain(int workerIndex);
+
+    /// Returns the index of the worker of the calling thread, or -1 if called outside the pool.
+    int CurrentWorkerIndex() const;
+
+    /// Returns true if called from the main thread.
+    bool IsMainThread() const;
+
+    Framework *framework;
+    std::vector<Worker*> workers;
+    QAtomicInt nextWorker; ///< Round-robin target for tasks scheduled outside the pool.
+    QAtomicInt numQueued; ///< Tasks in the worker queues.
+    QAtomicInt stopRequested;
+    QAtomicInt frameNumber; ///< Incremented each frame, so that the workers know when to reset their Profiler data.
+
+    boost::mutex sleepMutex;
+    boost::condition_variable workAvailable; ///< Signaled when tasks are queued.
+    boost::condition_variable taskFinished; ///< Signaled when any task finishes, for Wait.
+
+    boost::mutex mainThreadMutex;
+    std::deque<TaskPtr> mainThreadTasks;
+    boost::thread::id mainThreadId;
+
+    QAtomicInt numExecutedOnMainThread;
+};
@@ -7,6 +7,9 @@
 #include "Entity.h"
 #include "FrameAPI.h"
 #include "OgreRenderingModule.h"
+#include "OgreWorld.h"
+#include "Renderer.h"
+#include "Scene.h"
 #include "CoreStringUtils.h"
 #include "Profiler.h"
 
@@ -18,11 +21,36 @@
 
 using namespace OgreRenderer;
 
+namespace
+{
+/// Animation update interval, in seconds, for entities that are not visible in the active camera.
+const float cInvisibleUpdateInterval = 0.5f;
+
+/// Distance-based animation LOD steps, from the farthest to the nearest.
+/** Entities farther than 'distance' from the active camera are updated at most once per 'interval' seconds. */
+const struct AnimationLodStep
+{
+    float distance;
+    float interval;
+} cAnimationLodSteps[] =
+{
+    { 100.f, 1.f / 8.f },
+    { 50.f, 1.f / 15.f },
+    { 25.f, 1.f / 30.f }
+};
+}
+
 EC_AnimationController::EC_AnimationController(Scene* scene) :
     IComponent(scene),
     animationState(this, "Animation state", ""),
-    mesh(0)
+    mesh(0),
+    entity_(0),
+    timeSinceLastUpdate_(0.f),
+    lodEnabled_(!framework->HasCommandLineParameter("--noAnimationLod"))
 {
+    if (scene)
+        world_ = scene->GetWorld<OgreWorld>();
+
     ResetState();
     
     QObject::connect(framework->Frame(), SIGNAL(Updated(float)), this, SLOT(Update(float)));
@@ -35,7 +63,42 @@ EC_AnimationController::~EC_AnimationController()
 
 void EC_AnimationController::SetMeshEntity(EC_Mesh *new_mesh)
 {
+    if (mesh)
+        disconnect(mesh, SIGNAL(MeshAboutToBeDestroyed()), this, SLOT(InvalidateAnimationStates()));
     mesh = new_mesh;
+    if (mesh)
+        connect(mesh, SIGNAL(MeshAboutToBeDestroyed()), this, SLOT(InvalidateAnimationStates()), Qt::UniqueConnection);
+    InvalidateAnimationStates();
+}
+
+void EC_AnimationController::SetAnimationLodEnabled(bool enable)
+{
+    lodEnabled_ = enable;
+}
+
+float EC_AnimationController::AnimationUpdateInterval(Ogre::Entity* entity) const
+{
+    if (!lodEnabled_)
+        return 0.f;
+    OgreWorldPtr world = world_.lock();
+    Entity *parent = ParentEntity();
+    if (!world || !parent || !world->IsActive())
+        return 0.f;
+
+    // OgreWorld caches the visibility query of the active camera, so this is cheap after the first call during a frame.
+    if (!world->IsEntityVisible(parent))
+        return cInvisibleUpdateInterval;
+
+    Ogre::Camera *camera = world->Renderer()->MainOgreCamera();
+    Ogre::SceneNode *node = entity->getParentSceneNode();
+    if (!camera || !node)
+        return 0.f;
+
+    const float distanceSq = camera->getDerivedPosition().squaredDistance(node->_getDerivedPosition());
+    for(size_t i = 0; i < sizeof(cAnimationLodSteps) / sizeof(cAnimationLodSteps[0]); ++i)
+        if (distanceSq > cAnimationLodSteps[i].distance * cAnimationLodSteps[i].distance)
+            return cAnimationLodSteps[i].interval;
+    return 0.f;
 }
 
 QStringList EC_AnimationController::GetAvailableAnimations()
@@ -76,12 +139,25 @@ void EC_AnimationController::Update(float frametime)
     
     PROFILE(EC_AnimationController_Update);
 
+    // Animation LOD: accumulate the elapsed time and step the animations only when the LOD interval has passed.
+    // Ogre recomputes the bone matrices only when the animation states change, so skipped frames also skip the skinning work.
+    if (animations_.empty())
+    {
+        timeSinceLastUpdate_ = 0.f;
+        return;
+    }
+    timeSinceLastUpdate_ += frametime;
+    if (timeSinceLastUpdate_ < AnimationUpdateInterval(entity))
+        return;
+    frametime = timeSinceLastUpdate_;
+    timeSinceLastUpdate_ = 0.f;
+
     std::vector<QString> erase_list;
     
     // Loop through all animations & update them as necessary
     for(AnimationMap::iterator i = animations_.begin(); i != animations_.end(); ++i)
     {
-        Ogre::AnimationState* animstate = GetAnimationState(entity, i->first);
+        Ogre::AnimationState* animstate = CachedAnimationState(entity, i);
         if (!animstate)
             continue;
             
@@ -214,12 +290,9 @@ void EC_AnimationController::Update(float frametime)
     }
     
     // High-priority/low-priority blending code
-    if (entity->hasSkeleton())
+    Ogre::SkeletonInstance* skel = entity->hasSkeleton() ? entity->getSkeleton() : 0;
+    if (skel)
     {
-        Ogre::SkeletonInstance* skel = entity->getSkeleton();
-        if (!skel)
-            return;
-            
         if (highpriority_mask_.size() != skel->getNumBones())
             highpriority_mask_.resize(skel->getNumBones());
         if (lowpriority_mask_.size() != skel->getNumBones())
@@ -234,9 +307,9 @@ void EC_AnimationController::Update(float frametime)
         // Loop through all high priority animations & update the lowpriority-blendmask based on their active tracks
         for(AnimationMap::iterator i = animations_.begin(); i != animations_.end(); ++i)
         {
-            Ogre::AnimationState* animstate = GetAnimationState(entity, i->first);
+            Ogre::AnimationState* animstate = i->second.animstate_;
             if (!animstate)
-                continue;            
+                continue;
             // Create blend mask if animstate doesn't have it yet
             if (!animstate->hasBlendMask())
                 animstate->createBlendMask(skel->getNumBones());
@@ -269,12 +342,17 @@ void EC_AnimationController::Update(float frametime)
         // Now set the calculated blendmask on low-priority animations
         for(AnimationMap::iterator i = animations_.begin(); i != animations_.end(); ++i)
         {
-            Ogre::AnimationState* animstate = GetAnimationState(entity, i->first);
+            Ogre::AnimationState* animstate = i->second.animstate_;
             if (!animstate)
-                continue;    
+                continue;
             if (i->second.high_priority_ == false)
                 animstate->_setBlendMaskData(&lowpriority_mask_[0]);
         }
+
+        // Let OgreWorld compute the bone matrices of this skeleton, possibly in parallel with other skeletons
+        OgreWorldPtr world = world_.lock();
+        if (world)
+            world->QueueSkeletalAnimationUpdate(mesh, entity);
     }
 }
 
@@ -295,6 +373,9 @@ Ogre::Entity* EC_AnimationController::GetEntity()
         mesh_name_ = entity->getMesh()->getName();
         ResetState();
     }
+    else if (entity != entity_)
+        InvalidateAnimationStates();
+    entity_ = entity;
     
     return entity;
 }
@@ -302,15 +383,28 @@ Ogre::Entity* EC_AnimationController::GetEntity()
 void EC_AnimationController::ResetState()
 {
     animations_.clear();
+    entity_ = 0;
+    timeSinceLastUpdate_ = 0.f;
+}
+
+void EC_AnimationController::InvalidateAnimationStates()
+{
+    for(AnimationMap::iterator i = animations_.begin(); i != animations_.end(); ++i)
+        i->second.animstate_ = 0;
+    entity_ = 0;
 }
 
 /// Finds an animation state from Ogre::AnimationStateSet by name, performing a case-insensitive name search.
-/// @note This function is O(n), while normal set search would be O(logN) or O(1).
+/// @note The exact-case lookup is O(logN), the case-insensitive fallback is O(n).
 Ogre::AnimationState *OgreAnimStateSetFindNoCase(Ogre::AnimationStateSet *set, const QString &animState)
 {
     if (!set)
         return 0;
 
+    const std::string name = animState.toStdString();
+    if (set->hasAnimationState(name))
+        return set->getAnimationState(name);
+
     Ogre::AnimationStateIterator iter = set->getAnimationStateIterator();
     while(iter.hasMoreElements())
     {
@@ -330,6 +424,13 @@ Ogre::AnimationState* EC_AnimationController::GetAnimationState(Ogre::Entity* en
     return OgreAnimStateSetFindNoCase(entity->getAllAnimationStates(), name);
 }
 
+Ogre::AnimationState* EC_AnimationController::CachedAnimationState(Ogre::Entity* entity, AnimationMap::iterator i)
+{
+    if (!i->second.animstate_)
+        i->second.animstate_ = GetAnimationState(entity, i->first);
+    return i->second.animstate_;
+}
+
 bool EC_AnimationController::EnableExclusiveAnimation(const QString& name, bool looped, float fadein, float fadeout, bool high_priority)
 {
     // Disable all other active animations
@@ -366,6 +467,7 @@ bool EC_AnimationController::EnableAnimation(const QString& name, bool looped, f
         i->second.num_repeats_ = (looped ? 0: 1);
         i->second.fade_period_ = fadein;
         i->second.high_priority_ = high_priority;
+        i->second.animstate_ = animstate;
         // If animation is nonlooped and has already reached end, rewind to beginning
         if ((!looped) && (i->second.speed_factor_ > 0.0f))
         {
@@ -383,6 +485,7 @@ bool EC_AnimationController::EnableAnimation(const QString& name, bool looped, f
     newanim.num_repeats_ = (looped ? 0: 1); // if looped, repeat 0 times (loop indefinetly) otherwise repeat one time.
     newanim.fade_period_ = fadein;
     newanim.high_priority_ = high_priority;
+    newanim.animstate_ = animstate;
 
     animations_[name] = newanim;
 
@@ -42,6 +42,7 @@
     <li>"SetAnimationNumLoops": @copydoc SetAnimationNumLoops
     <li>"GetAvailableAnimations": @copydoc GetAvailableAnimations
     <li>"GetActiveAnimations": @copydoc GetActiveAnimations
+    <li>"SetAnimationLodEnabled": @copydoc SetAnimationLodEnabled
     </ul>
 
     <b>Reacts on the following actions:</b>
@@ -120,6 +121,9 @@ public:
         /// current phase
         AnimationPhase phase_;
 
+        /// Cached Ogre animation state, resolved once instead of doing a name lookup every frame. Null if not resolved yet.
+        Ogre::AnimationState *animstate_;
+
         Animation() :
             auto_stop_(false),
             fade_period_(0.0),
@@ -128,7 +132,8 @@ public:
             speed_factor_(1.0),
             num_repeats_(0),
             high_priority_(false),
-            phase_(PHASE_STOP)
+            phase_(PHASE_STOP),
+            animstate_(0)
         {
         }
     };
@@ -233,6 +238,16 @@ public slots:
     
     /// Get active animations as a simple stringlist
     QStringList GetActiveAnimations() const;
+
+    /// Enables or disables visibility- and distance-based animation level of detail for this controller.
+    /** When enabled (default), animations of entities that are not visible in the active camera, or that are far away from it,
+        are stepped less frequently. Disable if your logic depends on exact timing of AnimationFinished/AnimationCycled signals
+        for entities that are out of view.
+        @note LOD can be disabled globally with the --noAnimationLod command line parameter. */
+    void SetAnimationLodEnabled(bool enable);
+
+    /// Returns whether animation level of detail is enabled for this controller.
+    bool IsAnimationLodEnabled() const { return lodEnabled_; }
     
     /// Returns length of animation
     /** @param name Animation name
@@ -277,6 +292,8 @@ private slots:
     void UpdateSignals();
     /// Called when component has been removed from the parent entity. Checks if the component removed was the mesh, and autodissociates it.
     void OnComponentRemoved(IComponent* component, AttributeChange::Type change);
+    /// Forgets the cached Ogre animation state handles. Called when the Ogre entity of the mesh is about to be destroyed.
+    void InvalidateAnimationStates();
 
 private:
     /// Gets Ogre entity from the mesh entity component and checks if it has changed; in that case resets internal state
@@ -287,6 +304,13 @@ private:
         @param name Animation name
         @return animationstate, or null if not found */
     Ogre::AnimationState* GetAnimationState(Ogre::Entity* entity, const QString& name);
+
+    /// Returns the cached animationstate of a running animation, resolving it by name if not cached yet
+    Ogre::AnimationState* CachedAnimationState(Ogre::Entity* entity, AnimationMap::iterator i);
+
+    /// Returns the animation LOD update interval in seconds for the entity, based on its visibility and distance to the active camera
+    /** @return 0 if the animation should be updated every frame. */
+    float AnimationUpdateInterval(Ogre::Entity* entity) const;
     
     /// Resets internal state
     void ResetState();
@@ -296,6 +320,18 @@ private:
     
     /// Current mesh name
     std::string mesh_name_;
+
+    /// Ogre entity the cached animation states belong to
+    Ogre::Entity *entity_;
+
+    /// Ogre world of the parent scene, used for visibility queries and skeletal animation update batching
+    OgreWorldWeakPtr world_;
+
+    /// Time accumulated since the animations were last stepped, used by animation LOD
+    float timeSinceLastUpdate_;
+
+    /// Is animation LOD enabled for this controller
+    bool lodEnabled_;
     
     /// Current animations
     AnimationMap animations_;
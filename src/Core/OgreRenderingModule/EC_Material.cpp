@@ -149,28 +149,32 @@ void EC_Material::ApplyParameters(OgreMaterialAsset* srcMatAsset)
             outputMatName.replace(questionMark, 1, QString::number(parentEntity->Id()));
     }
     
-    OgreMaterialAsset* destMatAsset = 0;
+    // If dest. material is empty, apply in-place
+    OgreMaterialAsset* destMatAsset = srcMatAsset;
+    AssetPtr destAsset;
     if (!outputMatName.isEmpty())
     {
         // If dest. asset does not exist, create it now
-        AssetPtr destAsset = assetAPI->GetAsset(assetAPI->ResolveAssetRef("", outputMatName));
+        destAsset = assetAPI->GetAsset(assetAPI->ResolveAssetRef("", outputMatName));
         if (!destAsset)
             destAsset = assetAPI->CreateNewAsset("OgreMaterial", outputMatName);
-        
         destMatAsset = dynamic_cast<OgreMaterialAsset*>(destAsset.get());
-        // Copy source material to destination, however check that src & dest aren't same
-        if ((destMatAsset) && (srcMatAsset != destMatAsset))
-            destMatAsset->CopyContent(AssetPtr(srcMatAsset->shared_from_this()));
-    }
-    else
-    {
-        // If dest. material is empty, apply in-place
-        destMatAsset = srcMatAsset;
     }
     
     if (!destMatAsset)
         return;
     
+    // Signal the change of the destination material once for the whole apply, instead of once per copied and set attribute.
+    OgreMaterialAsset::ContentChangeScope changeScope(destMatAsset);
+    
+    // Copy source material to destination, however check that src & dest aren't same
+    if (srcMatAsset != destMatAsset)
+    {
+        destMatAsset->CopyContent(AssetPtr(srcMatAsset->shared_from_this()));
+        // The outputs of components with identical parameters are identical, so let them share one Ogre material.
+        destMatAsset->SetDeduplicated(true);
+    }
+    
     // Apply parameters
     const QVariantList& params = parameters.Get();
     for (int i = 0; i < params.size(); ++i)
@@ -64,6 +64,8 @@ public:
     DEFINE_QPROPERTY_ATTRIBUTE(QString, inputMat);
 
     /// Output material asset.
+    /** Outputs with identical content, e.g. from components applying the same parameters to the same input, are rendered using one shared Ogre material.
+        @see OgreMaterialAsset::SetDeduplicated */
     Q_PROPERTY(QString outputMat READ getoutputMat WRITE setoutputMat);
     DEFINE_QPROPERTY_ATTRIBUTE(QString, outputMat);
 
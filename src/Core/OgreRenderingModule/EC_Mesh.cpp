@@ -13,6 +13,7 @@
 #include "OgreSkeletonAsset.h"
 #include "OgreMeshAsset.h"
 #include "OgreMaterialAsset.h"
+#include "OgreMaterialDeduplicator.h"
 #include "IAssetTransfer.h"
 #include "AssetAPI.h"
 #include "AttributeMetadata.h"
@@ -612,7 +613,18 @@ bool EC_Mesh::SetMaterial(uint index, const QString& material_name)
     
     try
     {
-        entity_->getSubEntity(index)->setMaterialName(AssetAPI::SanitateAssetRef(material_name.toStdString()));
+        std::string ogreMaterialName = AssetAPI::SanitateAssetRef(material_name.toStdString());
+        // Deduplicated material assets are rendered using the Ogre material shared by all their identical copies.
+        OgreWorldPtr world = world_.lock();
+        OgreMaterialAsset *materialAsset = dynamic_cast<OgreMaterialAsset*>(framework->Asset()->GetAsset(material_name).get());
+        if (world && materialAsset && materialAsset->IsLoaded())
+        {
+            OgreMaterialDeduplicator *deduplicator = world->Renderer()->MaterialDeduplicator();
+            ogreMaterialName = deduplicator->MaterialName(materialAsset);
+            connect(materialAsset, SIGNAL(ContentChanged(OgreMaterialAsset*)), this, SLOT(OnMaterialAssetChanged(OgreMaterialAsset*)), Qt::UniqueConnection);
+            connect(deduplicator, SIGNAL(SharedMaterialChanged(OgreMaterialAsset*)), this, SLOT(OnMaterialAssetChanged(OgreMaterialAsset*)), Qt::UniqueConnection);
+        }
+        entity_->getSubEntity(index)->setMaterialName(ogreMaterialName);
         emit MaterialChanged(index, material_name);
     }
     catch(Ogre::Exception& e)
@@ -1041,6 +1053,23 @@ void EC_Mesh::OnMaterialAssetLoaded(AssetPtr asset)
     #endif
 }
 
+void EC_Mesh::OnMaterialAssetChanged(OgreMaterialAsset *asset)
+{
+    OgreWorldPtr world = world_.lock();
+    if (!entity_ || !world)
+        return;
+
+    // A deduplicated material may now map to another shared material. Reapply it to the submeshes whose Ogre material changes.
+    std::string ogreMaterialName = world->Renderer()->MaterialDeduplicator()->MaterialName(asset);
+    if (ogreMaterialName.empty())
+        return;
+    AssetReferenceList materialList = meshMaterial.Get();
+    for(int i = 0; i < materialList.Size() && i < (int)entity_->getNumSubEntities(); ++i)
+        if (framework->Asset()->ResolveAssetRef("", materialList[i].ref).compare(asset->Name(), Qt::CaseInsensitive) == 0 &&
+            entity_->getSubEntity(i)->getMaterialName() != ogreMaterialName)
+            SetMaterial(i, asset->Name());
+}
+
 void EC_Mesh::OnMaterialAssetFailed(IAssetTransfer* transfer, QString reason)
 {
     // Check which of the material(s) match the failed ref
@@ -398,6 +398,9 @@ private slots:
     /// Called when loading a material asset failed
     void OnMaterialAssetFailed(IAssetTransfer* transfer, QString reason);
 
+    /// Called when the content of a material asset in use has changed, or it has been deduplicated again. Reapplies it if it now maps to another Ogre material.
+    void OnMaterialAssetChanged(OgreMaterialAsset *asset);
+
 private:
     /// Prepares a mesh for creating an entity. some safeguards are needed because of Ogre "features"
     /** @param meshName Mesh to prepare
@@ -0,0 +1,331 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "OcclusionBuffer.h"
+#include "Math/float3.h"
+#include "Math/float4.h"
+#include "Math/float3x4.h"
+#include "Math/MathFunc.h"
+#include "Geometry/AABB.h"
+
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_BUFFER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+/// Vertices closer than this in clip space w are considered to cross the near plane.
+const float cMinW = 1e-4f;
+
+struct ScreenVertex
+{
+    float x;
+    float y;
+    float z;
+};
+
+/// Twice the signed area of the triangle (a, b, p). Positive when p is to the left of the edge a->b in screen space.
+inline float EdgeFunction(const ScreenVertex &a, const ScreenVertex &b, float px, float py)
+{
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+inline int RoundUpToMultipleOfFour(int value)
+{
+    return (value + 3) & ~3;
+}
+}
+
+OcclusionBuffer::OcclusionBuffer(int width_, int height_) :
+    width(0),
+    height(0),
+    viewProj(float4x4::identity)
+{
+    Resize(width_, height_);
+}
+
+void OcclusionBuffer::Resize(int width_, int height_)
+{
+    width = RoundUpToMultipleOfFour(std::max(width_, 4));
+    height = std::max(height_, 1);
+    depth.resize(width * height);
+    Clear();
+}
+
+void OcclusionBuffer::Clear()
+{
+    std::fill(depth.begin(), depth.end(), FLT_MAX);
+}
+
+void OcclusionBuffer::SetViewProjection(const float4x4 &viewProj_)
+{
+    viewProj = viewProj_;
+}
+
+int OcclusionBuffer::DrawTriangles(const float3x4 &localToWorld, const float3 *vertices, const u32 *indices, size_t numIndices)
+{
+    if (!vertices || !indices)
+        return 0;
+
+    // Concatenate the world transform to avoid transforming every vertex twice.
+    const float4x4 localToClip = viewProj * float4x4(localToWorld);
+    int numDrawn = 0;
+    for(size_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        float4 a = localToClip * float4(vertices[indices[i]], 1.f);
+        float4 b = localToClip * float4(vertices[indices[i+1]], 1.f);
+        float4 c = localToClip * float4(vertices[indices[i+2]], 1.f);
+        if (DrawClipSpaceTriangle(a, b, c))
+            ++numDrawn;
+    }
+    return numDrawn;
+}
+
+bool OcclusionBuffer::DrawTriangle(const float3 &a, const float3 &b, const float3 &c)
+{
+    return DrawClipSpaceTriangle(viewProj * float4(a, 1.f), viewProj * float4(b, 1.f), viewProj * float4(c, 1.f));
+}
+
+bool OcclusionBuffer::DrawClipSpaceTriangle(const float4 &a, const float4 &b, const float4 &c)
+{
+    // Clipping against the near plane is not done. Triangles that cross it are simply left out, which can only
+    // make the result more conservative.
+    if (a.w <= cMinW || b.w <= cMinW || c.w <= cMinW)
+        return false;
+
+    const float halfWidth = width * 0.5f;
+    const float halfHeight = height * 0.5f;
+    ScreenVertex v[3];
+    const float4 *clip[3] = { &a, &b, &c };
+    for(int i = 0; i < 3; ++i)
+    {
+        const float invW = 1.f / clip[i]->w;
+        v[i].x = (clip[i]->x * invW + 1.f) * halfWidth;
+        v[i].y = (1.f - clip[i]->y * invW) * halfHeight;
+        v[i].z = clip[i]->z * invW;
+    }
+
+    // Occluders are rasterized double-sided: the nearest depth is kept anyway, and open geometry such as walls
+    // made of single quads occludes from both sides.
+    float area = EdgeFunction(v[0], v[1], v[2].x, v[2].y);
+    if (area < 0.f)
+    {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+    if (area <= 0.f)
+        return false;
+
+    const float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+    const float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+    const float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+    const float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+    if (maxX < 0.f || maxY < 0.f || minX >= (float)width || minY >= (float)height)
+        return false;
+
+    // Pixel rectangle whose centers may be inside the triangle. The start column is aligned to four pixels so that
+    // the SSE loop can use whole quads; the width of the buffer is a multiple of four, so no quad goes past a row.
+    int x0 = std::max(0, (int)floor(minX)) & ~3;
+    int x1 = std::min(width - 1, (int)ceil(maxX));
+    int y0 = std::max(0, (int)floor(minY));
+    int y1 = std::min(height - 1, (int)ceil(maxY));
+
+    // Edge function increments. Edge i is opposite to vertex i, so its value is the barycentric weight of vertex i.
+    const float e0dx = -(v[2].y - v[1].y), e0dy = v[2].x - v[1].x;
+    const float e1dx = -(v[0].y - v[2].y), e1dy = v[0].x - v[2].x;
+    const float e2dx = -(v[1].y - v[0].y), e2dy = v[1].x - v[0].x;
+
+    const float invArea = 1.f / area;
+    const float z0 = v[0].z;
+    const float dz1 = (v[1].z - v[0].z) * invArea;
+    const float dz2 = (v[2].z - v[0].z) * invArea;
+
+    const float startX = x0 + 0.5f;
+    float rowY = y0 + 0.5f;
+    float e0Row = EdgeFunction(v[1], v[2], startX, rowY);
+    float e1Row = EdgeFunction(v[2], v[0], startX, rowY);
+    float e2Row = EdgeFunction(v[0], v[1], startX, rowY);
+
+#ifdef OCCLUSION_BUFFER_SSE2
+    const __m128 laneOffsets = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+    const __m128 e0StepX = _mm_set1_ps(e0dx * 4.f);
+    const __m128 e1StepX = _mm_set1_ps(e1dx * 4.f);
+    const __m128 e2StepX = _mm_set1_ps(e2dx * 4.f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 z0v = _mm_set1_ps(z0);
+    const __m128 dz1v = _mm_set1_ps(dz1);
+    const __m128 dz2v = _mm_set1_ps(dz2);
+#endif
+
+    for(int y = y0; y <= y1; ++y)
+    {
+        float *row = &depth[y * width];
+#ifdef OCCLUSION_BUFFER_SSE2
+        __m128 e0 = _mm_add_ps(_mm_set1_ps(e0Row), _mm_mul_ps(laneOffsets, _mm_set1_ps(e0dx)));
+        __m128 e1 = _mm_add_ps(_mm_set1_ps(e1Row), _mm_mul_ps(laneOffsets, _mm_set1_ps(e1dx)));
+        __m128 e2 = _mm_add_ps(_mm_set1_ps(e2Row), _mm_mul_ps(laneOffsets, _mm_set1_ps(e2dx)));
+        for(int x = x0; x <= x1; x += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if (_mm_movemask_ps(inside))
+            {
+                __m128 z = _mm_add_ps(z0v, _mm_add_ps(_mm_mul_ps(e1, dz1v), _mm_mul_ps(e2, dz2v)));
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+            e0 = _mm_add_ps(e0, e0StepX);
+            e1 = _mm_add_ps(e1, e1StepX);
+            e2 = _mm_add_ps(e2, e2StepX);
+        }
+#else
+        float e0 = e0Row, e1 = e1Row, e2 = e2Row;
+        for(int x = x0; x <= x1; ++x)
+        {
+            if (e0 >= 0.f && e1 >= 0.f && e2 >= 0.f)
+            {
+                float z = z0 + e1 * dz1 + e2 * dz2;
+                if (z < row[x])
+                    row[x] = z;
+            }
+            e0 += e0dx;
+            e1 += e1dx;
+            e2 += e2dx;
+        }
+#endif
+        e0Row += e0dy;
+        e1Row += e1dy;
+        e2Row += e2dy;
+    }
+    return true;
+}
+
+bool OcclusionBuffer::IsVisible(const AABB &worldAABB) const
+{
+    float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for(int i = 0; i < 8; ++i)
+    {
+        float4 p = viewProj * float4(worldAABB.CornerPoint(i), 1.f);
+        // The box reaches behind the near plane, so the camera may be inside or very close to it.
+        if (p.w <= cMinW)
+            return true;
+        const float invW = 1.f / p.w;
+        const float x = (p.x * invW + 1.f) * width * 0.5f;
+        const float y = (1.f - p.y * invW) * height * 0.5f;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        minZ = std::min(minZ, p.z * invW);
+    }
+
+    // Off-screen boxes are the job of frustum culling. The buffer has no information about them.
+    if (maxX < 0.f || maxY < 0.f || minX >= (float)width || minY >= (float)height)
+        return true;
+
+    const int x0 = std::max(0, (int)floor(minX));
+    const int x1 = std::min(width - 1, std::max(x0, (int)ceil(maxX) - 1));
+    const int y0 = std::max(0, (int)floor(minY));
+    const int y1 = std::min(height - 1, std::max(y0, (int)ceil(maxY) - 1));
+
+    // The box is visible if any pixel it covers has nothing nearer than the nearest point of the box.
+    for(int y = y0; y <= y1; ++y)
+    {
+        const float *row = &depth[y * width];
+#ifdef OCCLUSION_BUFFER_SSE2
+        const __m128 boxDepth = _mm_set1_ps(minZ);
+        const int alignedX0 = x0 & ~3;
+        for(int x = alignedX0; x <= x1; x += 4)
+        {
+            int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth));
+            // Ignore the lanes outside the tested rectangle.
+            if (x < x0)
+                mask &= 0xF << (x0 - x);
+            if (x + 3 > x1)
+                mask &= 0xF >> (x + 3 - x1);
+            if (mask)
+                return true;
+        }
+#else
+        for(int x = x0; x <= x1; ++x)
+            if (row[x] >= minZ)
+                return true;
+#endif
+    }
+    return false;
+}
+
+int OcclusionBuffer::DrawBox(const AABB &worldAABB)
+{
+    // The faces of the box as quads of AABB::CornerPoint indices. The winding does not matter, as occluders are double-sided.
+    static const int faces[6][4] = { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+    float3 corners[8];
+    for(int i = 0; i < 8; ++i)
+        corners[i] = worldAABB.CornerPoint(i);
+    u32 indices[36];
+    for(int i = 0; i < 6; ++i)
+    {
+        const u32 quad[6] = { faces[i][0], faces[i][1], faces[i][2], faces[i][0], faces[i][2], faces[i][3] };
+        std::copy(quad, quad + 6, indices + i * 6);
+    }
+    return DrawTriangles(float3x4::identity, corners, indices, 36);
+}
+
+bool OcclusionBuffer::RunSyntheticTest(std::string *failure)
+{
+    // The camera is at the origin looking towards -Z, with an OpenGL-style perspective projection like Ogre's,
+    // a 90 degree vertical field of view and the aspect ratio of the buffer.
+    OcclusionBuffer buffer(256, 128);
+    const float nearClip = 0.1f;
+    const float farClip = 1000.f;
+    const float aspect = (float)buffer.Width() / buffer.Height();
+    const float focal = 1.f / Tan(DegToRad(45.f));
+    float4x4 proj = float4x4::zero;
+    proj[0][0] = focal / aspect;
+    proj[1][1] = focal;
+    proj[2][2] = (farClip + nearClip) / (nearClip - farClip);
+    proj[2][3] = 2.f * farClip * nearClip / (nearClip - farClip);
+    proj[3][2] = -1.f;
+    buffer.SetViewProjection(proj);
+
+    const AABB occluder(float3(-5.f, -5.f, -11.f), float3(5.f, 5.f, -10.f));
+    if (buffer.DrawBox(occluder) == 0)
+    {
+        if (failure)
+            *failure = "the occluder box was not rasterized";
+        return false;
+    }
+
+    struct TestCase
+    {
+        const char *name;
+        AABB box;
+        bool visible;
+    };
+    const TestCase cases[] =
+    {
+        { "box behind the occluder", AABB(float3(-1.f, -1.f, -21.f), float3(1.f, 1.f, -20.f)), false },
+        { "box beside the box behind the occluder", AABB(float3(14.f, -1.f, -21.f), float3(16.f, 1.f, -20.f)), true },
+        { "box partially behind the occluder", AABB(float3(5.f, -1.f, -21.f), float3(15.f, 1.f, -20.f)), true },
+        { "box in front of the occluder", AABB(float3(-1.f, -1.f, -6.f), float3(1.f, 1.f, -5.f)), true },
+        { "box crossing the near plane", AABB(float3(-1.f, -1.f, -21.f), float3(1.f, 1.f, 1.f)), true }
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+        if (buffer.IsVisible(cases[i].box) != cases[i].visible)
+        {
+            if (failure)
+                *failure = std::string(cases[i].name) + (cases[i].visible ? " was reported occluded" : " was reported visible");
+            return false;
+        }
+    return true;
+}
@@ -0,0 +1,82 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "OgreModuleApi.h"
+#include "CoreTypes.h"
+#include "Math/float4x4.h"
+#include "Math/MathFwd.h"
+
+#include <vector>
+#include <string>
+
+/// Coarse software depth buffer for CPU occlusion culling.
+/** Occluder triangles are rasterized into a low-resolution depth buffer, after which the screen-space bounding
+    rectangles of other objects can be tested against it. The buffer does not depend on Ogre, so it can be filled
+    and queried with synthetic geometry also in headless mode.
+
+    The rasterization and depth test inner loops process four pixels at a time using SSE2 when it is available.
+
+    The test is conservative with respect to the near plane: occluder triangles that cross it are not rasterized,
+    and bounding boxes that cross it are always reported visible.
+
+    Used by OgreWorld to hide EC_Mesh objects that are behind occluders before they are submitted for rendering. */
+class OGRE_MODULE_API OcclusionBuffer
+{
+public:
+    /// Creates a buffer of the given size. The width is rounded up to a multiple of four pixels.
+    explicit OcclusionBuffer(int width = 256, int height = 128);
+
+    /// Resizes the buffer and clears it. The width is rounded up to a multiple of four pixels.
+    void Resize(int width, int height);
+
+    /// Returns the buffer width in pixels.
+    int Width() const { return width; }
+
+    /// Returns the buffer height in pixels.
+    int Height() const { return height; }
+
+    /// Resets all pixels to the farthest depth.
+    void Clear();
+
+    /// Sets the view-projection matrix used to transform occluders and tested bounding boxes to screen.
+    void SetViewProjection(const float4x4 &viewProj);
+
+    /// Rasterizes an indexed triangle list as an occluder.
+    /** @param localToWorld Transform of the vertices to world space.
+        @param vertices Vertex positions in local space.
+        @param indices Triangle list indices to the vertex array.
+        @param numIndices Number of indices. Every three indices form a triangle.
+        @return The number of triangles that were rasterized, i.e. were not rejected by the near plane or for being outside the screen. */
+    int DrawTriangles(const float3x4 &localToWorld, const float3 *vertices, const u32 *indices, size_t numIndices);
+
+    /// Rasterizes a single world-space triangle as an occluder.
+    /** @return True if the triangle was rasterized, false if it was rejected. */
+    bool DrawTriangle(const float3 &a, const float3 &b, const float3 &c);
+
+    /// Tests whether any part of a world-space bounding box may be visible.
+    /** @return False only if the screen rectangle of the box is completely behind the depth already rasterized to the buffer. */
+    bool IsVisible(const AABB &worldAABB) const;
+
+    /// Returns the depth value of the given pixel. The depth is the post-projection z/w, smaller being closer.
+    float Depth(int x, int y) const { return depth[y * width + x]; }
+
+    /// Rasterizes the triangles of a world-space box as an occluder.
+    /** @return The number of triangles that were rasterized. */
+    int DrawBox(const AABB &worldAABB);
+
+    /// Tests the buffer with a synthetic scene of boxes, without any rendering.
+    /** A box behind an occluder box must be occluded, while boxes beside, in front of or partially behind it must be visible.
+        @param failure If not null, receives the description of the first failed case.
+        @return True if all the cases passed. */
+    static bool RunSyntheticTest(std::string *failure = 0);
+
+private:
+    /// Rasterizes a triangle given in clip space.
+    bool DrawClipSpaceTriangle(const float4 &a, const float4 &b, const float4 &c);
+
+    std::vector<float> depth; ///< Depth values in row-major order, initialized to the farthest depth by Clear().
+    int width;
+    int height;
+    float4x4 viewProj; ///< Transforms from world space to clip space.
+};
@@ -168,6 +168,7 @@ unsigned GetEnumValue(const QString& name, EnumStr* enums)
     
     return enums->value;
 }
+
 /// @endcond
 
 OgreMaterialAsset::~OgreMaterialAsset()
@@ -396,6 +397,8 @@ AssetPtr OgreMaterialAsset::Clone(QString newAssetName) const
 
 void OgreMaterialAsset::CopyContent(AssetPtr source)
 {
+    ContentChangeScope changeScope(this);
+
     // Not supported in headless mode
     if (assetAPI->IsHeadless())
         return;
@@ -486,6 +489,20 @@ std::vector<AssetReference> OgreMaterialAsset::FindReferences() const
     return references_;
 }
 
+void OgreMaterialAsset::MarkContentChanged()
+{
+    ++contentVersion;
+    emit ContentChanged(this);
+}
+
+void OgreMaterialAsset::SetDeduplicated(bool enabled)
+{
+    if (deduplicated == enabled)
+        return;
+    ContentChangeScope changeScope(this);
+    deduplicated = enabled;
+}
+
 bool OgreMaterialAsset::IsLoaded() const
 {
     return ogreMaterial.get() != 0;
@@ -496,6 +513,8 @@ void OgreMaterialAsset::DoUnload()
     if (ogreMaterial.isNull())
         return;
 
+    ++contentVersion;
+
     std::string materialName = ogreMaterial->getName();
     ogreMaterial.setNull();
 
@@ -508,6 +527,8 @@ void OgreMaterialAsset::DoUnload()
 
 void OgreMaterialAsset::SetAttribute(const QString& key, const QString& value)
 {
+    ContentChangeScope changeScope(this);
+
     // Material must exist
     if (!IsLoaded())
         return;
@@ -674,6 +695,7 @@ bool OgreMaterialAsset::HasPass(int techIndex, int passIndex)
 
 bool OgreMaterialAsset::CreateOgreMaterial(const std::string &materialData)
 {
+    ++contentVersion;
     Ogre::MaterialManager& matmgr = Ogre::MaterialManager::getSingleton(); 
 
 #include "DisableMemoryLeakCheck.h"
@@ -754,6 +776,8 @@ bool OgreMaterialAsset::CreateOgreMaterial()
 
 int OgreMaterialAsset::CreateTechnique()
 {
+    ContentChangeScope changeScope(this);
+
     if (ogreMaterial.isNull())
         if (!CreateOgreMaterial())
             return -1;
@@ -779,6 +803,8 @@ int OgreMaterialAsset::CreateTechnique()
 
 int OgreMaterialAsset::CreatePass(int techIndex)
 {
+    ContentChangeScope changeScope(this);
+
     if (ogreMaterial.isNull())
         if (!CreateOgreMaterial())
             return -1;
@@ -807,6 +833,8 @@ int OgreMaterialAsset::CreatePass(int techIndex)
 
 int OgreMaterialAsset::CreateTextureUnit(int techIndex, int passIndex)
 {
+    ContentChangeScope changeScope(this);
+
     if (ogreMaterial.isNull())
         if (!CreateOgreMaterial())
             return -1;
@@ -835,6 +863,8 @@ int OgreMaterialAsset::CreateTextureUnit(int techIndex, int passIndex)
 
 bool OgreMaterialAsset::RemoveTextureUnit(int techIndex, int passIndex, int texUnitIndex)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -854,6 +884,8 @@ bool OgreMaterialAsset::RemoveTextureUnit(int techIndex, int passIndex, int texU
 
 bool OgreMaterialAsset::RemovePass(int techIndex, int passIndex)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Technique* tech = GetTechnique(techIndex);
     if (!tech)
         return false;
@@ -873,6 +905,8 @@ bool OgreMaterialAsset::RemovePass(int techIndex, int passIndex)
 
 bool OgreMaterialAsset::RemoveTechnique(int techIndex)
 {
+    ContentChangeScope changeScope(this);
+
     if (ogreMaterial.isNull())
         return false;
     if (techIndex < 0 || techIndex >= ogreMaterial->getNumTechniques())
@@ -890,6 +924,8 @@ bool OgreMaterialAsset::RemoveTechnique(int techIndex)
 
 bool OgreMaterialAsset::SetTexture(int techIndex, int passIndex, int texUnitIndex, const QString& assetRef)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::TextureUnitState* texUnit = GetTextureUnit(techIndex, passIndex, texUnitIndex);
     if (!texUnit)
         return false;
@@ -978,6 +1014,8 @@ QString OgreMaterialAsset::Texture(int techIndex, int passIndex, int texUnitInde
 
 bool OgreMaterialAsset::SetVertexShader(int techIndex, int passIndex, const QString& vertexShaderName)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1005,6 +1043,8 @@ QString OgreMaterialAsset::VertexShader(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetPixelShader(int techIndex, int passIndex, const QString& pixelShaderName)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1033,6 +1073,8 @@ QString OgreMaterialAsset::PixelShader(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetVertexShaderParameter(int techIndex, int passIndex, const QString& name, const QVariantList &value)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
     {
@@ -1122,6 +1164,8 @@ bool OgreMaterialAsset::SetVertexShaderParameter(int techIndex, int passIndex, c
 
 bool OgreMaterialAsset::SetPixelShaderParameter(int techIndex, int passIndex, const QString& name, const QVariantList &value)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
     {
@@ -1211,6 +1255,8 @@ bool OgreMaterialAsset::SetPixelShaderParameter(int techIndex, int passIndex, co
 
 bool OgreMaterialAsset::SetLighting(int techIndex, int passIndex, bool enable)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1232,6 +1278,8 @@ bool OgreMaterialAsset::IsLightingEnabled(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetDiffuseColor(int techIndex, int passIndex, const Color& color)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1253,6 +1301,8 @@ Color OgreMaterialAsset::DiffuseColor(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetAmbientColor(int techIndex, int passIndex, const Color& color)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1274,6 +1324,8 @@ Color OgreMaterialAsset::AmbientColor(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetSpecularColor(int techIndex, int passIndex, const Color& color)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1295,6 +1347,8 @@ Color OgreMaterialAsset::SpecularColor(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetEmissiveColor(int techIndex, int passIndex, const Color& color)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1316,6 +1370,8 @@ Color OgreMaterialAsset::EmissiveColor(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetSceneBlend(int techIndex, int passIndex, unsigned blendMode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1325,6 +1381,8 @@ bool OgreMaterialAsset::SetSceneBlend(int techIndex, int passIndex, unsigned ble
 
 bool OgreMaterialAsset::SetSceneBlend(int techIndex, int passIndex, unsigned srcFactor, unsigned dstFactor)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1358,6 +1416,8 @@ unsigned OgreMaterialAsset::DestinationSceneBlendFactor(int techIndex, int passI
 
 bool OgreMaterialAsset::SetPolygonMode(int techIndex, int passIndex, unsigned polygonMode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1379,6 +1439,8 @@ unsigned OgreMaterialAsset::PolygonMode(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetDepthCheck(int techIndex, int passIndex, bool enable)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1400,6 +1462,8 @@ bool OgreMaterialAsset::IsDepthCheckEnabled(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetDepthWrite(int techIndex, int passIndex, bool enable)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1421,6 +1485,8 @@ bool OgreMaterialAsset::IsDepthWriteEnabled(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetDepthBias(int techIndex, int passIndex, float bias)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1443,6 +1509,8 @@ float OgreMaterialAsset::DepthBias(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetHardwareCullingMode(int techIndex, int passIndex, unsigned mode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1464,6 +1532,8 @@ unsigned OgreMaterialAsset::HardwareCullingMode(int techIndex, int passIndex) co
 
 bool OgreMaterialAsset::SetShadingMode(int techIndex, int passIndex, unsigned mode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1485,6 +1555,8 @@ unsigned OgreMaterialAsset::ShadingMode(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetFillMode(int techIndex, int passIndex, unsigned mode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1506,6 +1578,8 @@ unsigned OgreMaterialAsset::FillMode(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetColorWrite(int techIndex, int passIndex, bool enable)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::Pass* pass = GetPass(techIndex, passIndex);
     if (!pass)
         return false;
@@ -1527,6 +1601,8 @@ bool OgreMaterialAsset::IsColorWriteEnabled(int techIndex, int passIndex) const
 
 bool OgreMaterialAsset::SetTextureCoordSet(int techIndex, int passIndex, int texUnitIndex, uint value)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::TextureUnitState* texUnit = GetTextureUnit(techIndex, passIndex, texUnitIndex);
     if (!texUnit)
         return false;
@@ -1547,6 +1623,8 @@ uint OgreMaterialAsset::TextureCoordSet(int techIndex, int passIndex, int texUni
 
 bool OgreMaterialAsset::SetTextureAddressingMode(int techIndex, int passIndex, int texUnitIndex, unsigned mode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::TextureUnitState* texUnit = GetTextureUnit(techIndex, passIndex, texUnitIndex);
     if (!texUnit)
         return false;
@@ -1556,6 +1634,8 @@ bool OgreMaterialAsset::SetTextureAddressingMode(int techIndex, int passIndex, i
 
 bool OgreMaterialAsset::SetTextureAddressingMode(int techIndex, int passIndex, int texUnitIndex, unsigned uMode, unsigned vMode, unsigned wMode)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::TextureUnitState* texUnit = GetTextureUnit(techIndex, passIndex, texUnitIndex);
     if (!texUnit)
         return false;
@@ -1601,6 +1681,8 @@ unsigned OgreMaterialAsset::TextureAddressingModeW(int techIndex, int passIndex,
 
 bool OgreMaterialAsset::SetScrollAnimation(int techIndex, int passIndex, int texUnitIndex, float uSpeed, float vSpeed)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::TextureUnitState* texUnit = GetTextureUnit(techIndex, passIndex, texUnitIndex);
     if (!texUnit)
         return false;
@@ -1654,6 +1736,8 @@ float OgreMaterialAsset::ScrollAnimationV(int techIndex, int passIndex, int texU
 
 bool OgreMaterialAsset::SetRotateAnimation(int techIndex, int passIndex, int texUnitIndex, float speed)
 {
+    ContentChangeScope changeScope(this);
+
     Ogre::TextureUnitState* texUnit = GetTextureUnit(techIndex, passIndex, texUnitIndex);
     if (!texUnit)
         return false;
@@ -1973,6 +2057,8 @@ bool OgreMaterialAsset::SetTextureUnitAttribute(Ogre::TextureUnitState* texUnit,
 
 void OgreMaterialAsset::OnTransferSucceeded(AssetPtr asset)
 {
+    ContentChangeScope changeScope(this);
+
     IAssetTransfer* transfer = static_cast<IAssetTransfer*>(sender());
     for (unsigned i = pendingApplies.size() - 1; i < pendingApplies.size(); --i)
     {
@@ -16,7 +16,7 @@ class OGRE_MODULE_API OgreMaterialAsset : public IAsset
     Q_OBJECT
 
 public:
-    OgreMaterialAsset(AssetAPI *owner, const QString &type_, const QString &name_) : IAsset(owner, type_, name_) {}
+    OgreMaterialAsset(AssetAPI *owner, const QString &type_, const QString &name_) : IAsset(owner, type_, name_), deduplicated(false), contentVersion(0), contentChangeDepth(0) {}
     ~OgreMaterialAsset();
 
     /// IAsset overload.
@@ -44,6 +44,29 @@ public:
     /// references to other resources this resource depends on
     std::vector<AssetReference> references_;
 
+    /// Returns a number that changes every time the content of the material is changed.
+    uint ContentVersion() const { return contentVersion; }
+
+    /// Signals that the Ogre material has been modified.
+    /** Called by all the modifying functions of this class. Code that modifies @c ogreMaterial directly must call this afterwards,
+        otherwise meshes using a deduplicated copy of this material do not see the change. */
+    void MarkContentChanged();
+
+    /// Marks the material changed once when the outermost scope ends, instead of once per modifying function called meanwhile.
+    /** Used by all the modifying functions of this class. Code that makes several modifications in a row, e.g. applies a list of
+        attributes, can hold one scope over them to emit ContentChanged only once. */
+    struct ContentChangeScope
+    {
+        explicit ContentChangeScope(OgreMaterialAsset *asset_) : asset(asset_) { ++asset->contentChangeDepth; }
+        ~ContentChangeScope()
+        {
+            if (--asset->contentChangeDepth == 0)
+                asset->MarkContentChanged();
+        }
+
+        OgreMaterialAsset *asset;
+    };
+
     /// Function that safely returns a technique, or 0 if did not exist
     Ogre::Technique* GetTechnique(int techIndex) const;
     /// Function that safely returns a pass, or 0 if did not exist
@@ -59,6 +82,16 @@ public slots:
 
     /// Copy content from another OgreMaterialAsset using Ogre internal functions, without having to serialize/deserialize
     void CopyContent(AssetPtr source);
+
+    /// Sets whether meshes may render this material using a shared copy of any identical material.
+    /** Deduplicated materials are collapsed by the renderer into one Ogre material per unique definition, which keeps the material count low
+        and lets Ogre batch the objects using them. Enable this for materials that only differ from others by their name, e.g. per-object
+        clones that are tinted with the same color. The materials output by EC_Material are deduplicated by default.
+        @see OgreRenderer::OgreMaterialDeduplicator */
+    void SetDeduplicated(bool enabled);
+
+    /// Returns whether meshes may render this material using a shared copy of any identical material.
+    bool IsDeduplicated() const { return deduplicated; }
     
     /// Set a material attribute using a key-value format.
     /** Format: key is "t<x> p<y> tu<z> paramname", to access technique, pass and texture unit specific attributes.
@@ -213,6 +246,10 @@ public slots:
         If it has scroll effect with different u and v values it has both Ogre::TextureUnitState::ET_USCROLL and Ogre::TextureUnitState::ET_VSCROLL. */
     bool HasTextureEffect(int techIndex, int passIndex, int texUnitIndex, unsigned effect) const;
 
+signals:
+    /// The content of the material has changed after it was loaded.
+    void ContentChanged(OgreMaterialAsset *asset);
+
 private slots:
     /// Asset transfer (for texture apply operation) succeeded
     void OnTransferSucceeded(AssetPtr asset);
@@ -243,5 +280,15 @@ private:
     };
     
     std::vector<PendingTextureApply> pendingApplies;
+
+    /// Whether the material may be replaced with a shared identical material when rendering meshes
+    bool deduplicated;
+
+    /// Incremented every time the content of the material changes
+    uint contentVersion;
+
+    /// Nesting depth of the modifying functions being executed. ContentChanged is emitted when the outermost one returns
+    int contentChangeDepth;
+    friend struct ContentChangeScope;
 };
 
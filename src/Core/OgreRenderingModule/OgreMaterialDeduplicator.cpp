@@ -0,0 +1,200 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "OgreMaterialDeduplicator.h"
+#include "OgreMaterialAsset.h"
+#include "Profiler.h"
+#include "LoggingFunctions.h"
+
+#include <OgreMaterialManager.h>
+
+#include <QCryptographicHash>
+
+#include <algorithm>
+#include <vector>
+
+#include "MemoryLeakCheck.h"
+
+namespace OgreRenderer
+{
+
+OgreMaterialDeduplicator::OgreMaterialDeduplicator() :
+    frameNumber(0),
+    enabled(true)
+{
+}
+
+OgreMaterialDeduplicator::~OgreMaterialDeduplicator()
+{
+    while(!assets.empty())
+        ReleaseAsset(assets.begin()->first);
+}
+
+std::string OgreMaterialDeduplicator::MaterialName(OgreMaterialAsset *asset)
+{
+    if (!asset || asset->ogreMaterial.isNull())
+        return std::string();
+
+    if (!enabled || !asset->IsDeduplicated())
+    {
+        ReleaseAsset(asset);
+        return asset->ogreMaterial->getName();
+    }
+
+    std::map<OgreMaterialAsset*, AssetState>::iterator iter = assets.find(asset);
+    if (iter == assets.end())
+    {
+        // Deduplicate a new asset right away, so that meshes do not need to rebind it on the next frame.
+        connect(asset, SIGNAL(Unloaded(IAsset*)), this, SLOT(OnAssetUnloaded(IAsset*)), Qt::UniqueConnection);
+        AssetState state;
+        state.changeFrame = frameNumber;
+        iter = assets.insert(std::make_pair(asset, state)).first;
+        AssignSharedMaterial(asset, iter->second);
+    }
+    else if (iter->second.contentVersion != asset->ContentVersion())
+    {
+        // Render the changed asset using its own material until Update() deduplicates it again.
+        AssetState &state = iter->second;
+        state.contentVersion = asset->ContentVersion();
+        state.changeFrame = frameNumber;
+        ReleaseSharedMaterial(state.hash);
+        state.hash.clear();
+        changedAssets.insert(asset);
+    }
+
+    const AssetState &state = iter->second;
+    if (state.hash.empty())
+        return asset->ogreMaterial->getName();
+    return sharedMaterials[state.hash].material->getName();
+}
+
+void OgreMaterialDeduplicator::Update()
+{
+    PROFILE(OgreMaterialDeduplicator_Update);
+
+    std::vector<OgreMaterialAsset*> settled;
+    for(std::set<OgreMaterialAsset*>::iterator iter = changedAssets.begin(); iter != changedAssets.end();)
+    {
+        std::map<OgreMaterialAsset*, AssetState>::iterator state = assets.find(*iter);
+        if (state != assets.end() && state->second.changeFrame == frameNumber)
+            ++iter; // Changed during this frame, possibly changing every frame. Keep using the own material.
+        else
+        {
+            if (state != assets.end() && !(*iter)->ogreMaterial.isNull())
+            {
+                AssignSharedMaterial(*iter, state->second);
+                if (!state->second.hash.empty())
+                    settled.push_back(*iter);
+            }
+            changedAssets.erase(iter++);
+        }
+    }
+    ++frameNumber;
+
+    // Emit last, as the listeners may change the assets.
+    for(size_t i = 0; i < settled.size(); ++i)
+        emit SharedMaterialChanged(settled[i]);
+}
+
+void OgreMaterialDeduplicator::SetEnabled(bool enabled_)
+{
+    enabled = enabled_;
+    if (!enabled)
+        while(!assets.empty())
+            ReleaseAsset(assets.begin()->first);
+}
+
+int OgreMaterialDeduplicator::NumDeduplicatedAssets() const
+{
+    int count = 0;
+    for(std::map<OgreMaterialAsset*, AssetState>::const_iterator iter = assets.begin(); iter != assets.end(); ++iter)
+        if (!iter->second.hash.empty())
+            ++count;
+    return count;
+}
+
+void OgreMaterialDeduplicator::OnAssetUnloaded(IAsset *asset)
+{
+    ReleaseAsset(static_cast<OgreMaterialAsset*>(asset));
+}
+
+std::string OgreMaterialDeduplicator::ContentHash(OgreMaterialAsset *asset)
+{
+    std::vector<u8> data;
+    if (!asset->SerializeTo(data, ""))
+        return std::string();
+
+    // The script starts with the material name, which differs between otherwise identical materials. Hash only the body.
+    std::vector<u8>::const_iterator body = std::find(data.begin(), data.end(), '{');
+    if (body == data.end())
+        return std::string();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(reinterpret_cast<const char*>(&*body), (int)(data.end() - body));
+    return hash.result().toHex().constData();
+}
+
+void OgreMaterialDeduplicator::AssignSharedMaterial(OgreMaterialAsset *asset, AssetState &state)
+{
+    PROFILE(OgreMaterialDeduplicator_HashMaterial);
+    state.contentVersion = asset->ContentVersion();
+    std::string hash = ContentHash(asset);
+    if (hash == state.hash)
+        return;
+
+    if (!hash.empty())
+    {
+        std::map<std::string, SharedMaterial>::iterator shared = sharedMaterials.find(hash);
+        if (shared != sharedMaterials.end())
+            ++shared->second.refCount;
+        else
+        {
+            try
+            {
+                SharedMaterial material;
+                material.material = asset->ogreMaterial->clone("DeduplicatedMaterial/" + hash);
+                material.refCount = 1;
+                sharedMaterials[hash] = material;
+            }
+            catch(Ogre::Exception &e)
+            {
+                LogError("OgreMaterialDeduplicator: Failed to create a shared material for " + asset->Name() + ": " + e.what());
+                hash.clear();
+            }
+        }
+    }
+    ReleaseSharedMaterial(state.hash);
+    state.hash = hash;
+}
+
+void OgreMaterialDeduplicator::ReleaseSharedMaterial(const std::string &hash)
+{
+    if (hash.empty())
+        return;
+    std::map<std::string, SharedMaterial>::iterator iter = sharedMaterials.find(hash);
+    if (iter == sharedMaterials.end() || --iter->second.refCount > 0)
+        return;
+
+    // Entities that still refer to the material keep it alive until they switch to another one.
+    try
+    {
+        Ogre::MaterialManager::getSingleton().remove(iter->second.material->getHandle());
+    }
+    catch(...) {}
+    sharedMaterials.erase(iter);
+}
+
+void OgreMaterialDeduplicator::ReleaseAsset(OgreMaterialAsset *asset)
+{
+    std::map<OgreMaterialAsset*, AssetState>::iterator iter = assets.find(asset);
+    if (iter == assets.end())
+        return;
+    disconnect(asset, SIGNAL(Unloaded(IAsset*)), this, SLOT(OnAssetUnloaded(IAsset*)));
+    ReleaseSharedMaterial(iter->second.hash);
+    assets.erase(iter);
+    changedAssets.erase(asset);
+}
+
+}
@@ -0,0 +1,117 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "OgreModuleApi.h"
+#include "CoreTypes.h"
+
+#include <QObject>
+
+#include <OgreMaterial.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+class IAsset;
+class OgreMaterialAsset;
+
+namespace OgreRenderer
+{
+    /// Collapses identical material assets into shared Ogre materials.
+    /** Per-object material clones, e.g. the ones output by EC_Material or created by scripts with OgreMaterialAsset::Clone,
+        each create a unique Ogre material even when their definitions are identical. This prevents Ogre from grouping the objects
+        using them by pass, and the material count grows with the number of objects.
+
+        For the material assets that allow it (OgreMaterialAsset::IsDeduplicated), the definition is hashed from the serialized
+        material script with the material name left out. All the assets with the same hash are rendered using one shared Ogre material,
+        which is a copy of the first of them.
+
+        Hashing serializes the whole material, so it is not done on every content change. An asset whose content changes is rendered
+        using its own Ogre material, and is deduplicated again by Update() once its content has stayed unchanged for a frame.
+        Materials that are changed every frame, e.g. animated by a script, are therefore never hashed or copied.
+
+        Owned by Renderer. Used by EC_Mesh when it applies materials to its submeshes. Can be disabled with --noMaterialDeduplication.
+        @ingroup OgreRenderingModuleClient */
+    class OGRE_MODULE_API OgreMaterialDeduplicator : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        OgreMaterialDeduplicator();
+        ~OgreMaterialDeduplicator();
+
+        /// Returns the name of the Ogre material that should be used to render the given material asset.
+        /** This is the name of a shared material if the asset is deduplicated, otherwise the name of the asset's own Ogre material.
+            @return Ogre material name, or an empty string if the asset is null or not loaded. */
+        std::string MaterialName(OgreMaterialAsset *asset);
+
+        /// Deduplicates the assets whose content has changed, but not during the last frame. Called by Renderer once per frame.
+        /** Emits SharedMaterialChanged for each of them. */
+        void Update();
+
+        /// Enables or disables deduplication. When disabled, all assets are rendered using their own Ogre material.
+        /** Meshes that already use a shared material keep using it until they reapply their materials. */
+        void SetEnabled(bool enabled);
+
+        /// Returns whether deduplication is enabled.
+        bool IsEnabled() const { return enabled; }
+
+        /// Returns the number of material assets currently rendered using a shared material.
+        int NumDeduplicatedAssets() const;
+
+        /// Returns the number of shared Ogre materials.
+        int NumSharedMaterials() const { return (int)sharedMaterials.size(); }
+
+    signals:
+        /// The Ogre material returned by MaterialName for the asset has changed without a change in the content of the asset.
+        void SharedMaterialChanged(OgreMaterialAsset *asset);
+
+    private slots:
+        /// Releases the shared material of an unloaded asset.
+        void OnAssetUnloaded(IAsset *asset);
+
+    private:
+        /// Returns a hash of the material definition of an asset, excluding its name, or an empty string if the asset could not be serialized.
+        static std::string ContentHash(OgreMaterialAsset *asset);
+
+        /// The shared material of an asset, and the content version it was computed for
+        struct AssetState
+        {
+            std::string hash; ///< Empty if the asset could not be hashed, or its content has changed, and it uses its own material.
+            uint contentVersion;
+            uint changeFrame; ///< Number of the frame during which the content of the asset last changed.
+        };
+
+        /// Hashes the content of the asset and assigns it the shared material of the hash.
+        void AssignSharedMaterial(OgreMaterialAsset *asset, AssetState &state);
+
+        /// Decrements the reference count of a shared material, and removes it when no longer used.
+        void ReleaseSharedMaterial(const std::string &hash);
+
+        /// Forgets the deduplication state of an asset.
+        void ReleaseAsset(OgreMaterialAsset *asset);
+
+        /// A shared material and the number of assets using it
+        struct SharedMaterial
+        {
+            Ogre::MaterialPtr material;
+            int refCount;
+        };
+
+        /// Shared materials by content hash
+        std::map<std::string, SharedMaterial> sharedMaterials;
+
+        /// Deduplicated material assets
+        std::map<OgreMaterialAsset*, AssetState> assets;
+
+        /// Assets whose content has changed since they were last hashed
+        std::set<OgreMaterialAsset*> changedAssets;
+
+        /// Number of the current frame, incremented by Update()
+        uint frameNumber;
+
+        /// Deduplication enabled
+        bool enabled;
+    };
+}
@@ -29,7 +29,10 @@ OgreMeshAsset::~OgreMeshAsset()
 bool OgreMeshAsset::LoadFromFile(QString filename)
 {
     bool allowAsynchronous = true;
-    if (assetAPI->GetFramework()->IsHeadless() || assetAPI->GetFramework()->HasCommandLineParameter("--no_async_asset_load") || !assetAPI->GetAssetCache() || (OGRE_THREAD_SUPPORT == 0))
+    // Files converted by OpenAssetImport need their data, the conversion is asynchronous by itself.
+    // Files converted by OpenAssetImport are not loaded with Ogre's background queue: the conversion itself
+    // imports the file in a worker thread and completes the load on a later frame.
+    if (assetAPI->GetFramework()->IsHeadless() || assetAPI->GetFramework()->HasCommandLineParameter("--no_async_asset_load") || !assetAPI->GetAssetCache() || (OGRE_THREAD_SUPPORT == 0) || IsAssimpFileType())
         allowAsynchronous = false;
     QString cacheDiskSource;
     if (allowAsynchronous)
@@ -52,6 +55,8 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, size_t numBytes, bool a
     /// Force an unload of this data first.
     Unload();
 
+    // Files converted by OpenAssetImport are not loaded with Ogre's background queue: the conversion itself
+    // imports the file in a worker thread and completes the load on a later frame.
     if (assetAPI->GetFramework()->IsHeadless() || assetAPI->GetFramework()->HasCommandLineParameter("--no_async_asset_load") || !assetAPI->GetAssetCache() || (OGRE_THREAD_SUPPORT == 0) || IsAssimpFileType())
         allowAsynchronous = false;
     QString cacheDiskSource;
@@ -449,6 +454,16 @@ void OgreMeshAsset::DoUnload()
         loadTicket_ = 0;
     }
     
+#ifdef ASSIMP_ENABLED
+    // Abandon an ongoing conversion, its result would be for the unloaded mesh.
+    if (importer)
+    {
+        importer->disconnect(this);
+        importer->deleteLater();
+        importer = 0;
+    }
+#endif
+
     if (ogreMesh.isNull())
         return;
 
@@ -539,6 +554,14 @@ bool OgreMeshAsset::IsAssimpFileType()
 #ifdef ASSIMP_ENABLED
 void OgreMeshAsset::OnAssimpConversionDone(bool success)
 {
+    // The conversion is done, but the signal is being emitted by the importer, so it cannot be deleted right away.
+    if (importer)
+    {
+        importer->disconnect(this);
+        importer->deleteLater();
+        importer = 0;
+    }
+
     if(success)
     {
         if (GenerateMeshData())
@@ -549,8 +572,5 @@ void OgreMeshAsset::OnAssimpConversionDone(bool success)
         assetAPI->AssetLoadFailed(Name());
         LogError("OgreMeshAsset::DeserializeFromData: Failed to to covert " + Name() +" to Ogre mesh.");
     }
-
-    delete importer;
-	
 }
 #endif
@@ -25,6 +25,9 @@ public:
     OgreMeshAsset(AssetAPI *owner, const QString &type_, const QString &name_) :
         IAsset(owner, type_, name_), loadTicket_(0)
     {
+#ifdef ASSIMP_ENABLED
+        importer = 0;
+#endif
     }
 
     ~OgreMeshAsset();
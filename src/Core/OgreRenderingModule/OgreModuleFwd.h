@@ -39,6 +39,7 @@ namespace OgreRenderer
 {
     class OgreRenderingModule;
     class Renderer;
+    class RenderBenchmark;
     typedef boost::shared_ptr<Renderer> RendererPtr;
     typedef boost::weak_ptr<Renderer> RendererWeakPtr;
 }
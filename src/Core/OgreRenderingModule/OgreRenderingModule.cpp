@@ -19,6 +19,9 @@
 #include "OgreParticleAsset.h"
 #include "OgreSkeletonAsset.h"
 #include "OgreMaterialAsset.h"
+#include "OgreMaterialDeduplicator.h"
+#include "RenderBenchmark.h"
+#include "OcclusionBuffer.h"
 #include "OgreProfiler.h"
 #ifdef OGRE_HAS_PROFILER_HOOKS
 #include "OgreProfilerHook.h"
@@ -82,7 +85,8 @@ void Profiler_EndBlock()
 #endif
 
 OgreRenderingModule::OgreRenderingModule() :
-    IModule("OgreRendering")
+    IModule("OgreRendering"),
+    benchmark(0)
 {
 #ifdef OGRE_HAS_PROFILER_HOOKS
 #ifdef WIN32
@@ -208,10 +212,17 @@ void OgreRenderingModule::Initialize()
 #endif
     framework_->Console()->RegisterCommand("setMaterialAttribute", "Sets an attribute on a material asset",
         this, SLOT(SetMaterialAttribute(const QStringList &)));
+    framework_->Console()->RegisterCommand("occlusionTest", "Tests the occlusion culling depth buffer with synthetic geometry. Works also in headless mode.",
+        this, SLOT(RunOcclusionTest()));
+
+    if (framework_->HasCommandLineParameter("--renderBenchmark"))
+        benchmark = new RenderBenchmark(framework_, renderer.get());
 }
 
 void OgreRenderingModule::Uninitialize()
 {
+    SAFE_DELETE(benchmark);
+
     // We're shutting down. Force a release of all loaded asset objects from the Asset API so that 
     // no refs to Ogre assets remain - below 'renderer.reset()' is going to delete Ogre::Root.
     framework_->Asset()->ForgetAllAssets();
@@ -233,12 +244,42 @@ void OgreRenderingModule::ConsoleStats()
         c->Print("Best FPS: " + QString::number(stats.bestFPS));
         c->Print("Triangles: " + QString::number(stats.triangleCount));
         c->Print("Batches: " + QString::number(stats.batchCount));
+        OgreWorldPtr world = renderer->GetActiveOgreWorld();
+        if (world)
+        {
+            const RenderStateStats &renderStats = world->RenderStats();
+            c->Print("Materials used: " + QString::number(renderStats.numMaterials) + ", pass changes: " + QString::number(renderStats.numPassChanges) +
+                " (" + QString::number(renderStats.numRenderables) + " renderables)");
+        }
+        int numMaterials = 0;
+        Ogre::ResourceManager::ResourceMapIterator materials = Ogre::MaterialManager::getSingleton().getResourceIterator();
+        for(; materials.hasMoreElements(); materials.moveNext())
+            ++numMaterials;
+        OgreMaterialDeduplicator *deduplicator = renderer->MaterialDeduplicator();
+        c->Print("Materials total: " + QString::number(numMaterials) + ", deduplicated assets: " + QString::number(deduplicator->NumDeduplicatedAssets()) +
+            " sharing " + QString::number(deduplicator->NumSharedMaterials()) + " materials");
+        if (world && world->IsOcclusionCullingEnabled())
+        {
+            const OcclusionCullingStats &occlusion = world->OcclusionStats();
+            c->Print("Occluders: " + QString::number(occlusion.numOccluders) + " (" + QString::number(occlusion.numOccluderTriangles) + " triangles)");
+            c->Print("Occlusion tested: " + QString::number(occlusion.numTested) + ", culled: " + QString::number(occlusion.numCulled));
+            c->Print("Occlusion culling time: " + QString::number(occlusion.timeMs) + " ms");
+        }
         return;
     }
     else
         LogError("No renderer found!");
 }
 
+void OgreRenderingModule::RunOcclusionTest()
+{
+    std::string failure;
+    if (OcclusionBuffer::RunSyntheticTest(&failure))
+        LogInfo("Occlusion buffer test passed.");
+    else
+        LogError("Occlusion buffer test failed: " + QString::fromStdString(failure));
+}
+
 void OgreRenderingModule::ToggleOgreProfilerOverlay()
 {
 #if OGRE_PROFILING == 1
@@ -45,6 +45,9 @@ namespace OgreRenderer
         /// Sets attribute value for material.
         void SetMaterialAttribute(const QStringList &params);
 
+        /// Tests the occlusion culling depth buffer with synthetic geometry and prints the result. Works also in headless mode.
+        void RunOcclusionTest();
+
     private slots:
         /// New scene has been created
         void OnSceneAdded(const QString &name);
@@ -54,5 +57,6 @@ namespace OgreRenderer
 
     private:
         RendererPtr renderer;  ///< Renderer
+        RenderBenchmark *benchmark; ///< Render benchmark, exists only when --renderBenchmark is specified.
     };
 }
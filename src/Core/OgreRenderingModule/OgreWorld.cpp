@@ -13,6 +13,7 @@
 #include "OgreCompositionHandler.h"
 #include "OgreShadowCameraSetupFocusedPSSM.h"
 #include "OgreBulletCollisionsDebugLines.h"
+#include "OcclusionBuffer.h"
 
 #include "OgreMeshAsset.h"
 #include "Entity.h"
@@ -20,9 +21,11 @@
 #include "Profiler.h"
 #include "ConfigAPI.h"
 #include "FrameAPI.h"
+#include "HighPerfClock.h"
 #include "Transform.h"
 #include "Math/float2.h"
 #include "Math/float3x4.h"
+#include "Math/float4x4.h"
 #include "Geometry/AABB.h"
 #include "Geometry/OBB.h"
 #include "Geometry/Plane.h"
@@ -33,14 +36,192 @@
 
 #include <Ogre.h>
 
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+/// Blends the enabled animation states of an entity into the bones of its own skeleton instance, and updates their derived transforms.
+/** Run on the worker threads by OgreWorld::UpdateSkeletalAnimations. Ogre::Entity::_updateAnimation() is not called here,
+    as it also reads and may update the cached transforms of the parent scene node, which other entities can share. This
+    only writes to the bones of the skeleton instance, which the entity owns when the skeleton is not shared, and only
+    reads the shared animation tracks, whose lazily built data has been built beforehand on the main thread. */
+void BlendSkeleton(Ogre::Entity *entity)
+{
+    Ogre::SkeletonInstance *skel = entity->getSkeleton();
+    skel->setAnimationState(*entity->getAllAnimationStates());
+    skel->_updateTransforms();
+}
+
+/// Meshes whose world bounding box is at least this large along some axis are used as occluders automatically.
+const float cMinAutoOccluderSize = 10.f;
+/// Maximum number of triangles in an automatically selected occluder mesh. Denser meshes cost more to rasterize than they save.
+const size_t cMaxAutoOccluderTriangles = 500;
+/// Maximum number of triangles in a mesh marked as an occluder with OgreWorld::SetOccluder.
+const size_t cMaxMarkedOccluderTriangles = 5000;
+/// Maximum number of occluders rasterized per frame. The occluders closest to covering the screen are taken first.
+const size_t cMaxOccluders = 32;
+/// Maximum number of occluder triangles rasterized per frame.
+const size_t cMaxOccluderTriangles = 20000;
+
+/// A mesh inside the view frustum for the current frame, tested against the occlusion buffer.
+struct OcclusionCandidate
+{
+    Ogre::Entity *entity;
+    AABB aabb;
+    bool tested; ///< Already tested, or known to be visible, when rasterized as an occluder.
+};
+
+/// An occluder candidate for the current frame.
+struct OccluderCandidate
+{
+    EC_Mesh *mesh;
+    size_t candidate; ///< Index of the mesh in the occlusion candidates.
+    size_t maxTriangles;
+    float screenSize; ///< Approximate size on screen, used to pick the best occluders.
+    float distance; ///< Distance from the camera, used to rasterize the picked occluders front to back.
+
+    bool operator <(const OccluderCandidate &rhs) const { return screenSize > rhs.screenSize; }
+};
+
+/// Orders occluders front to back.
+bool CompareOccluderDistance(const OccluderCandidate &lhs, const OccluderCandidate &rhs)
+{
+    return lhs.distance < rhs.distance;
+}
+
+/// Appends the triangles of an Ogre index buffer range to a 32-bit index list.
+void AppendTriangles(Ogre::IndexData *indexData, u32 vertexOffset, std::vector<u32> &dst)
+{
+    if (!indexData || indexData->indexBuffer.isNull() || indexData->indexCount < 3)
+        return;
+    Ogre::HardwareIndexBufferSharedPtr ibuf = indexData->indexBuffer;
+    const bool use32BitIndices = (ibuf->getType() == Ogre::HardwareIndexBuffer::IT_32BIT);
+    const size_t count = indexData->indexCount - indexData->indexCount % 3;
+    const void *data = ibuf->lock(indexData->indexStart * ibuf->getIndexSize(), count * ibuf->getIndexSize(), Ogre::HardwareBuffer::HBL_READ_ONLY);
+    for(size_t i = 0; i < count; ++i)
+        dst.push_back(vertexOffset + (use32BitIndices ? static_cast<const u32*>(data)[i] : static_cast<const u16*>(data)[i]));
+    ibuf->unlock();
+}
+
+/// Appends the positions of Ogre vertex data to a vertex list. Returns false if the positions are not stored as three floats.
+bool AppendVertices(Ogre::VertexData *vertexData, std::vector<float3> &dst)
+{
+    if (!vertexData)
+        return false;
+    const Ogre::VertexElement *posElem = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
+    if (!posElem || posElem->getType() != Ogre::VET_FLOAT3)
+        return false;
+    Ogre::HardwareVertexBufferSharedPtr vbuf = vertexData->vertexBufferBinding->getBuffer(posElem->getSource());
+    const unsigned char *data = static_cast<const unsigned char*>(vbuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+    const size_t stride = vbuf->getVertexSize();
+    data += vertexData->vertexStart * stride + posElem->getOffset();
+    for(size_t i = 0; i < vertexData->vertexCount; ++i, data += stride)
+    {
+        const float *pos = reinterpret_cast<const float*>(data);
+        dst.push_back(float3(pos[0], pos[1], pos[2]));
+    }
+    vbuf->unlock();
+    return true;
+}
+}
+
+/// Hides the objects found occluded by OgreWorld from the camera the occlusion was computed for.
+class OcclusionCullingListener : public Ogre::MovableObject::Listener
+{
+public:
+    OcclusionCullingListener() : camera(0) {}
+
+    bool objectRendering(const Ogre::MovableObject *object, const Ogre::Camera *cam)
+    {
+        return cam != camera || occluded.find(object) == occluded.end();
+    }
+
+    void objectDestroyed(Ogre::MovableObject *object)
+    {
+        occluded.erase(object);
+        pending.erase(object);
+    }
+
+    /// Marks an object to be hidden once the pending set is committed. Returns false if the object has another listener, in which case it can not be hidden.
+    bool Hide(Ogre::MovableObject *object)
+    {
+        if (!object->getListener())
+            object->setListener(this);
+        else if (object->getListener() != this)
+            return false;
+        pending.insert(object);
+        return true;
+    }
+
+    /// Replaces the occluded set with the objects marked with Hide() since the previous commit.
+    /** @param cam The camera the occlusion was computed for, or null to hide nothing. */
+    void Commit(const Ogre::Camera *cam)
+    {
+        camera = cam;
+        occluded.swap(pending);
+        pending.clear();
+    }
+
+    /// The camera the occluded set is valid for.
+    const Ogre::Camera *camera;
+    /// Objects occluded from the camera during this frame.
+    std::set<const Ogre::MovableObject*> occluded;
+
+private:
+    /// Objects found occluded by the ongoing update.
+    std::set<const Ogre::MovableObject*> pending;
+};
+
+/// Counts the materials and pass changes of the objects rendered by a scene manager.
+class RenderStateCounter : public Ogre::RenderObjectListener
+{
+public:
+    RenderStateCounter() : lastPass(0) {}
+
+    void notifyRenderSingleObject(Ogre::Renderable * /*rend*/, const Ogre::Pass *pass, const Ogre::AutoParamDataSource * /*source*/,
+        const Ogre::LightList * /*lightList*/, bool /*suppressRenderStateChanges*/)
+    {
+        ++stats.numRenderables;
+        if (pass != lastPass)
+        {
+            ++stats.numPassChanges;
+            lastPass = pass;
+            materials.insert(pass->getParent()->getParent());
+        }
+    }
+
+    /// Returns the statistics collected since the last call, and starts collecting anew.
+    RenderStateStats TakeStats()
+    {
+        RenderStateStats result = stats;
+        result.numMaterials = (int)materials.size();
+        stats = RenderStateStats();
+        materials.clear();
+        lastPass = 0;
+        return result;
+    }
+
+private:
+    RenderStateStats stats;
+    std::set<const Ogre::Material*> materials;
+    const Ogre::Pass *lastPass;
+};
+
 OgreWorld::OgreWorld(OgreRenderer::Renderer* renderer, ScenePtr scene) :
     framework_(scene->GetFramework()),
     renderer_(renderer),
     scene_(scene),
     sceneManager_(0),
     rayQuery_(0),
+    parallelSkeletalAnimation_(false),
+    occlusionCulling_(false),
+    occlusionBuffer_(0),
+    occlusionListener_(0),
+    renderStateCounter_(0),
     debugLines_(0),
     debugLinesNoDepth_(0)
 {
@@ -67,9 +248,18 @@ OgreWorld::OgreWorld(OgreRenderer::Renderer* renderer, ScenePtr scene) :
         sceneManager_->getRootSceneNode()->attachObject(debugLines_);
         sceneManager_->getRootSceneNode()->attachObject(debugLinesNoDepth_);
         debugLinesNoDepth_->setRenderQueueGroup(Ogre::RENDER_QUEUE_OVERLAY);
+
+        renderStateCounter_ = new RenderStateCounter();
+        sceneManager_->addRenderObjectListener(renderStateCounter_);
     }
 
+    parallelSkeletalAnimation_ = !framework_->IsHeadless() && (OGRE_THREAD_SUPPORT != 0) &&
+        (framework_->HasCommandLineParameter("--parallelSkeletalAnimation") ||
+        framework_->Config()->Get(ConfigAPI::FILE_FRAMEWORK, ConfigAPI::SECTION_RENDERING, "parallel skeletal animation").toBool());
+    SetOcclusionCullingEnabled(framework_->HasCommandLineParameter("--occlusionCulling"));
+
     connect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdated(float)));
+    connect(framework_->Frame(), SIGNAL(PostFrameUpdate(float)), this, SLOT(OnPostFrameUpdate(float)));
 }
 
 OgreWorld::~OgreWorld()
@@ -87,6 +277,13 @@ OgreWorld::~OgreWorld()
         sceneManager_->getRootSceneNode()->detachObject(debugLinesNoDepth_);
         SAFE_DELETE(debugLinesNoDepth_);
     }
+
+    SetOcclusionCullingEnabled(false);
+    if (renderStateCounter_)
+    {
+        sceneManager_->removeRenderObjectListener(renderStateCounter_);
+        SAFE_DELETE(renderStateCounter_);
+    }
     
     // Remove all compositors.
     /// \todo This does not work with a proper multiscene approach
@@ -509,6 +706,291 @@ void OgreWorld::OnUpdated(float timeStep)
     }
 }
 
+void OgreWorld::QueueSkeletalAnimationUpdate(EC_Mesh *mesh, Ogre::Entity *entity)
+{
+    if (!parallelSkeletalAnimation_ || !mesh || !entity)
+        return; // Ogre will update the skeleton lazily during rendering.
+
+    skeletalAnimationQueue_.push_back(std::make_pair(ComponentWeakPtr(mesh->shared_from_this()), entity));
+}
+
+void OgreWorld::OnPostFrameUpdate(float /*timeStep*/)
+{
+    if (renderStateCounter_)
+        renderStats_ = renderStateCounter_->TakeStats();
+    if (!skeletalAnimationQueue_.empty())
+        UpdateSkeletalAnimations();
+    if (occlusionCulling_)
+        UpdateOcclusionCulling();
+}
+
+void OgreWorld::UpdateSkeletalAnimations()
+{
+    PROFILE(OgreWorld_UpdateSkeletalAnimations);
+
+#if OGRE_VERSION_MAJOR >= 1 && OGRE_VERSION_MINOR >= 7
+    // Only entities with an independent, hardware-skinned skeleton and nothing attached to the bones can be blended concurrently:
+    // shared skeletons, software skinning and tag points all touch state outside the entity itself.
+    QList<Ogre::Entity*> entities;
+    for(size_t i = 0; i < skeletalAnimationQueue_.size(); ++i)
+    {
+        EC_Mesh *mesh = dynamic_cast<EC_Mesh*>(skeletalAnimationQueue_[i].first.lock().get());
+        Ogre::Entity *entity = skeletalAnimationQueue_[i].second;
+        if (!mesh || mesh->GetEntity() != entity || !entity->isVisible() || !entity->hasSkeleton())
+            continue;
+        if (entity->sharesSkeletonInstance() || !entity->isHardwareAnimationEnabled() || entity->hasVertexAnimation() ||
+            entity->getAttachedObjectIterator().hasMoreElements())
+            continue;
+        if (entities.contains(entity))
+            continue;
+
+        // Ogre builds the keyframe time index of an animation lazily on first use. The animation data is shared between
+        // all instances of the skeleton, so make sure the index is built on the main thread before going parallel.
+        // Spline interpolation builds its splines lazily too, so those animations are left to Ogre on the main thread.
+        Ogre::SkeletonInstance *skel = entity->getSkeleton();
+        bool splines = false;
+        Ogre::ConstEnabledAnimationStateIterator it = entity->getAllAnimationStates()->getEnabledAnimationStateIterator();
+        while(it.hasMoreElements())
+        {
+            Ogre::AnimationState *animstate = it.getNext();
+            if (!skel->hasAnimation(animstate->getAnimationName()))
+                continue;
+            Ogre::Animation *anim = skel->getAnimation(animstate->getAnimationName());
+            anim->_getTimeIndex(animstate->getTimePosition());
+            splines = splines || anim->getInterpolationMode() == Ogre::Animation::IM_SPLINE;
+        }
+        if (!splines)
+            entities.push_back(entity);
+    }
+    skeletalAnimationQueue_.clear();
+
+    if (entities.size() > 1)
+        QtConcurrent::blockingMap(entities, BlendSkeleton);
+    else if (entities.size() == 1)
+        BlendSkeleton(entities.front());
+
+    // Finish on the main thread: copy the bone matrices and combine them with the parent node transform, without
+    // blending the animation states again.
+    foreach(Ogre::Entity *entity, entities)
+    {
+        entity->setSkipAnimationStateUpdate(true);
+        entity->_updateAnimation();
+        entity->setSkipAnimationStateUpdate(false);
+    }
+#else
+    skeletalAnimationQueue_.clear();
+#endif
+}
+
+void OgreWorld::SetOcclusionCullingEnabled(bool enabled)
+{
+    if (framework_->IsHeadless())
+        enabled = false; // Nothing is rendered.
+    if (enabled == occlusionCulling_)
+        return;
+
+    occlusionCulling_ = enabled;
+    if (enabled)
+    {
+        occlusionBuffer_ = new OcclusionBuffer();
+        occlusionListener_ = new OcclusionCullingListener();
+    }
+    else
+    {
+        // Detach the listener from the objects that still exist before deleting it.
+        Ogre::SceneManager::MovableObjectIterator it = sceneManager_->getMovableObjectIterator(Ogre::EntityFactory::FACTORY_TYPE_NAME);
+        while(it.hasMoreElements())
+        {
+            Ogre::MovableObject *object = it.getNext();
+            if (object->getListener() == occlusionListener_)
+                object->setListener(0);
+        }
+        SAFE_DELETE(occlusionListener_);
+        SAFE_DELETE(occlusionBuffer_);
+        occluderGeometry_.clear();
+        occlusionStats_ = OcclusionCullingStats();
+    }
+}
+
+void OgreWorld::SetOccluder(Entity *entity, bool occluder)
+{
+    if (!entity)
+        return;
+    if (occluder)
+        occluderEntities_.insert(entity->Id());
+    else
+        occluderEntities_.erase(entity->Id());
+}
+
+bool OgreWorld::IsOccluder(Entity *entity) const
+{
+    return entity && occluderEntities_.find(entity->Id()) != occluderEntities_.end();
+}
+
+void OgreWorld::UpdateOcclusionCulling()
+{
+    PROFILE(OgreWorld_UpdateOcclusionCulling);
+    const tick_t startTime = GetCurrentClockTime();
+
+    occlusionStats_ = OcclusionCullingStats();
+
+    // The previous result stays in effect until the new one is committed. Objects hidden by it are rendering-disabled,
+    // so the meshes are gathered by their own visibility, which the listener does not affect.
+    ScenePtr scene = scene_.lock();
+    Ogre::Camera *camera = VerifyCurrentSceneCamera();
+    if (!scene || !camera)
+    {
+        occlusionListener_->Commit(0);
+        return;
+    }
+
+    // Gather the meshes inside the view frustum. All of them are tested, and the large or marked ones are also occluder candidates.
+    const float3 cameraPos = camera->getDerivedPosition();
+    std::vector<OccluderCandidate> occluders;
+    std::vector<OcclusionCandidate> candidates;
+    for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
+    {
+        const bool marked = occluderEntities_.find(iter->first) != occluderEntities_.end();
+        std::vector<boost::shared_ptr<EC_Mesh> > meshes = iter->second->GetComponents<EC_Mesh>();
+        for(size_t i = 0; i < meshes.size(); ++i)
+        {
+            Ogre::Entity *entity = meshes[i]->GetEntity();
+            if (!entity || !entity->isInScene() || !entity->getVisible())
+                continue;
+            const Ogre::AxisAlignedBox &box = entity->getWorldBoundingBox(true);
+            if (!box.isFinite() || !camera->isVisible(box))
+                continue;
+
+            OcclusionCandidate candidate;
+            candidate.entity = entity;
+            candidate.aabb = AABB(box);
+            candidate.tested = false;
+            const bool animated = entity->hasSkeleton() || entity->hasVertexAnimation();
+            if (marked || (!animated && candidate.aabb.Size().MaxElement() >= cMinAutoOccluderSize))
+            {
+                OccluderCandidate occluder;
+                occluder.mesh = meshes[i].get();
+                occluder.candidate = candidates.size();
+                occluder.maxTriangles = marked ? cMaxMarkedOccluderTriangles : cMaxAutoOccluderTriangles;
+                occluder.distance = candidate.aabb.Distance(cameraPos);
+                occluder.screenSize = candidate.aabb.Size().Length() / std::max(occluder.distance, 1.f);
+                occluders.push_back(occluder);
+            }
+            candidates.push_back(candidate);
+        }
+    }
+
+    if (occluders.empty())
+    {
+        occlusionListener_->Commit(0);
+        return;
+    }
+
+    {
+        PROFILE(OgreWorld_UpdateOcclusionCulling_Rasterize);
+        occlusionBuffer_->Clear();
+        occlusionBuffer_->SetViewProjection(float4x4(camera->getProjectionMatrix()) * float4x4(camera->getViewMatrix()));
+
+        // Pick the occluders closest to covering the screen within the budgets.
+        std::sort(occluders.begin(), occluders.end());
+        std::vector<OccluderCandidate> picked;
+        size_t numTriangles = 0;
+        for(size_t i = 0; i < occluders.size() && picked.size() < cMaxOccluders; ++i)
+        {
+            const OccluderGeometry *geometry = GetOccluderGeometry(candidates[occluders[i].candidate].entity);
+            if (!geometry)
+                continue;
+            const size_t occluderTriangles = geometry->indices.size() / 3;
+            if (occluderTriangles > occluders[i].maxTriangles || numTriangles + occluderTriangles > cMaxOccluderTriangles)
+                continue;
+            numTriangles += occluderTriangles;
+            picked.push_back(occluders[i]);
+        }
+
+        // Rasterize the picked occluders front to back, and test each one before it is rasterized, so that an occluder
+        // is tested only against the occluders in front of it, excluding its own contribution. Occluded ones need not be rasterized.
+        std::sort(picked.begin(), picked.end(), CompareOccluderDistance);
+        for(size_t i = 0; i < picked.size(); ++i)
+        {
+            // The first occluder has nothing in front of it.
+            OcclusionCandidate &candidate = candidates[picked[i].candidate];
+            candidate.tested = true;
+            if (occlusionStats_.numOccluders > 0)
+            {
+                ++occlusionStats_.numTested;
+                if (!occlusionBuffer_->IsVisible(candidate.aabb) && occlusionListener_->Hide(candidate.entity))
+                {
+                    ++occlusionStats_.numCulled;
+                    continue;
+                }
+            }
+
+            const OccluderGeometry *geometry = GetOccluderGeometry(candidate.entity); // Cached when picked
+            occlusionStats_.numOccluderTriangles += occlusionBuffer_->DrawTriangles(picked[i].mesh->LocalToWorld(),
+                &geometry->vertices[0], &geometry->indices[0], geometry->indices.size());
+            ++occlusionStats_.numOccluders;
+        }
+    }
+
+    if (occlusionStats_.numOccluders > 0)
+    {
+        // Test the rest of the meshes, including the occluders left out by the budgets, against all the rasterized occluders.
+        PROFILE(OgreWorld_UpdateOcclusionCulling_Test);
+        for(size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (candidates[i].tested)
+                continue;
+            ++occlusionStats_.numTested;
+            if (!occlusionBuffer_->IsVisible(candidates[i].aabb) && occlusionListener_->Hide(candidates[i].entity))
+                ++occlusionStats_.numCulled;
+        }
+    }
+    occlusionListener_->Commit(occlusionStats_.numOccluders > 0 ? camera : 0);
+
+    occlusionStats_.timeMs = (float)((GetCurrentClockTime() - startTime) * 1000.0 / GetCurrentClockFreq());
+}
+
+const OgreWorld::OccluderGeometry *OgreWorld::GetOccluderGeometry(Ogre::Entity *entity)
+{
+    Ogre::MeshPtr mesh = entity->getMesh();
+    if (mesh.isNull() || !mesh->isLoaded())
+        return 0;
+
+    std::map<std::string, OccluderGeometry>::iterator iter = occluderGeometry_.find(mesh->getName());
+    if (iter != occluderGeometry_.end() && iter->second.mesh == mesh.get())
+        return iter->second.indices.empty() ? 0 : &iter->second;
+
+    PROFILE(OgreWorld_GetOccluderGeometry);
+    OccluderGeometry &geometry = occluderGeometry_[mesh->getName()];
+    geometry.mesh = mesh.get();
+    geometry.vertices.clear();
+    geometry.indices.clear();
+
+    // The coarsest automatically generated LOD level is accurate enough for occlusion. Manual LOD levels are separate meshes.
+    const bool useLod = mesh->getNumLodLevels() > 1 && !mesh->isLodManual();
+    const bool hasSharedVertices = AppendVertices(mesh->sharedVertexData, geometry.vertices);
+    for(unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i)
+    {
+        Ogre::SubMesh *submesh = mesh->getSubMesh(i);
+        if (submesh->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST)
+            continue;
+        Ogre::IndexData *indexData = (useLod && !submesh->mLodFaceList.empty()) ? submesh->mLodFaceList.back() : submesh->indexData;
+        if (submesh->useSharedVertices)
+        {
+            if (hasSharedVertices)
+                AppendTriangles(indexData, 0, geometry.indices);
+        }
+        else
+        {
+            const u32 vertexOffset = (u32)geometry.vertices.size();
+            if (AppendVertices(submesh->vertexData, geometry.vertices))
+                AppendTriangles(indexData, vertexOffset, geometry.indices);
+        }
+    }
+
+    return geometry.indices.empty() ? 0 : &geometry;
+}
+
 void OgreWorld::SetupShadows()
 {
     Ogre::SceneManager* sceneManager = sceneManager_;
@@ -15,14 +15,40 @@
 #include <boost/enable_shared_from_this.hpp>
 
 #include <set>
+#include <map>
 
 class Framework;
 class DebugLines;
 class Transform;
 class Color;
+class OcclusionBuffer;
+class OcclusionCullingListener;
+class RenderStateCounter;
 
 class QRect;
 
+/// Occlusion culling statistics of the last frame.
+struct OcclusionCullingStats
+{
+    OcclusionCullingStats() : numOccluders(0), numOccluderTriangles(0), numTested(0), numCulled(0), timeMs(0.f) {}
+
+    int numOccluders; ///< Number of meshes rasterized to the occlusion buffer.
+    int numOccluderTriangles; ///< Number of occluder triangles rasterized to the occlusion buffer.
+    int numTested; ///< Number of meshes inside the view frustum that were tested against the occlusion buffer.
+    int numCulled; ///< Number of meshes found to be occluded and hidden from the main camera.
+    float timeMs; ///< Time spent in the occlusion culling pass, in milliseconds.
+};
+
+/// Material and render state statistics of the last rendered frame, counted over all the cameras rendering the scene.
+struct RenderStateStats
+{
+    RenderStateStats() : numRenderables(0), numMaterials(0), numPassChanges(0) {}
+
+    int numRenderables; ///< Number of renderables drawn.
+    int numMaterials; ///< Number of distinct materials used by the drawn renderables.
+    int numPassChanges; ///< Number of times the pass, and thus the render state, changed between consecutive renderables.
+};
+
 /// Contains the Ogre representation of a scene, ie. the Ogre Scene
 class OGRE_MODULE_API OgreWorld : public QObject, public boost::enable_shared_from_this<OgreWorld>
 {
@@ -53,6 +79,27 @@ public:
 
     std::string GetUniqueObjectName(const std::string &prefix) { return GenerateUniqueObjectName(prefix); } /**< @deprecated Use GenerateUniqueObjectName @todo Add warning print */
 
+    /// Queues a skeletally animated Ogre entity for bone matrix update at the end of the frame.
+    /** When parallel skeletal animation is enabled (--parallelSkeletalAnimation or the "parallel skeletal animation"
+        rendering config setting, off by default), the animation states of the queued entities that have an independent,
+        hardware-skinned skeleton are blended into their bones across the global thread pool after all frame updates.
+        Only the blending runs on the worker threads. It writes only to the bones of the entity's own skeleton instance
+        and reads the shared animation data, whose lazily built parts are built on the main thread first. This assumes
+        that Ogre's bone nodes are not reachable from other objects, which Ogre does not guarantee across versions.
+        The bone matrices are then finished with Ogre::Entity::_updateAnimation() on the main thread, as it reads and
+        may update the parent scene node, which can be shared. Otherwise, or for the entities that do not qualify, Ogre
+        computes them lazily on the main thread during rendering.
+        Called by EC_AnimationController after it has stepped its animations.
+        @param mesh Mesh component owning the Ogre entity, used to verify the entity is still alive when the queue is processed.
+        @param entity Ogre entity of the mesh. */
+    void QueueSkeletalAnimationUpdate(EC_Mesh *mesh, Ogre::Entity *entity);
+
+    /// Returns the occlusion culling statistics of the last frame.
+    const OcclusionCullingStats &OcclusionStats() const { return occlusionStats_; }
+
+    /// Returns the material and render state statistics of the last rendered frame.
+    const RenderStateStats &RenderStats() const { return renderStats_; }
+
 public slots:
     /// Does raycast into the world from viewport coordinates, using specific selection layer(s)
     /** The coordinates are a position in the render window, not scaled to [0,1].
@@ -92,6 +139,23 @@ public slots:
     /// Stop tracking an entity's visibility
     void StopViewTracking(Entity* entity);
     
+    /// Enables or disables occlusion culling for the main camera.
+    /** When enabled, the occluder meshes of the scene are rasterized to a coarse software depth buffer every frame before rendering,
+        and the meshes in the view frustum whose bounding box is completely behind them are not rendered by the main camera.
+        Shadow and render-to-texture cameras are not affected. Initially enabled with the --occlusionCulling command line parameter. */
+    void SetOcclusionCullingEnabled(bool enabled);
+
+    /// Returns whether occlusion culling is enabled.
+    bool IsOcclusionCullingEnabled() const { return occlusionCulling_; }
+
+    /// Marks the meshes of an entity as occluders, or removes the mark.
+    /** Large non-animated meshes are used as occluders automatically. Marking an entity also allows a denser triangle budget for its meshes.
+        Use this for walls, buildings and other static geometry that hides a lot of the scene behind it. */
+    void SetOccluder(Entity *entity, bool occluder);
+
+    /// Returns whether the entity has been marked as an occluder with SetOccluder.
+    bool IsOccluder(Entity *entity) const;
+
     /// Returns the Renderer instance
     OgreRenderer::Renderer* Renderer() const { return renderer_; }
 
@@ -145,10 +209,30 @@ private slots:
     /// Handle frame update. Used for entity visibility tracking
     void OnUpdated(float timeStep);
 
+    /// Handle post frame update. Used for computing the queued skeletal animations, occlusion culling and collecting the render statistics
+    void OnPostFrameUpdate(float timeStep);
+
 private:
     /// Do the actual raycast. rayQuery_ must have been set up beforehand
     RaycastResult* RaycastInternal(unsigned layerMask);
 
+    /// Computes the bone matrices of the queued skeletal animations in parallel and clears the queue
+    void UpdateSkeletalAnimations();
+
+    /// Triangles of a mesh used for occlusion culling, in the mesh's local space
+    struct OccluderGeometry
+    {
+        Ogre::Mesh *mesh; ///< Mesh the geometry was read from, used to detect reloads.
+        std::vector<float3> vertices;
+        std::vector<u32> indices;
+    };
+
+    /// Rasterizes the occluders and determines the occluded meshes for the main camera
+    void UpdateOcclusionCulling();
+
+    /// Returns the occluder geometry of an Ogre entity's mesh, reading it from the hardware buffers on first use. Returns null if the mesh has no usable geometry.
+    const OccluderGeometry *GetOccluderGeometry(Ogre::Entity *entity);
+
     /// Setup shadows
     void SetupShadows();
     
@@ -188,6 +272,36 @@ private:
     /// Entities being tracked for visibility changes
     std::vector<EntityWeakPtr> visibilityTrackedEntities_;
     
+    /// Animated entities queued for skeletal animation update during this frame, along with their mesh components
+    std::vector<std::pair<ComponentWeakPtr, Ogre::Entity*> > skeletalAnimationQueue_;
+
+    /// Compute skeletal animations in parallel
+    bool parallelSkeletalAnimation_;
+
+    /// Occlusion culling enabled
+    bool occlusionCulling_;
+
+    /// Software depth buffer for occlusion culling. Null when occlusion culling is disabled
+    OcclusionBuffer *occlusionBuffer_;
+
+    /// Hides the occluded objects from the main camera
+    OcclusionCullingListener *occlusionListener_;
+
+    /// Entities marked as occluders
+    std::set<entity_id_t> occluderEntities_;
+
+    /// Occluder geometry read from the meshes, by mesh name
+    std::map<std::string, OccluderGeometry> occluderGeometry_;
+
+    /// Occlusion culling statistics of the last frame
+    OcclusionCullingStats occlusionStats_;
+
+    /// Counts the materials and render state changes during rendering
+    RenderStateCounter *renderStateCounter_;
+
+    /// Material and render state statistics of the last rendered frame
+    RenderStateStats renderStats_;
+
     /// Debug geometry object
     DebugLines* debugLines_;
     /// Debug geometry object, no depth testing
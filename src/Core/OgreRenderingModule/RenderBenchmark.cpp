@@ -0,0 +1,608 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RenderBenchmark.h"
+#include "Renderer.h"
+#include "OgreWorld.h"
+#include "EC_Camera.h"
+#include "EC_Placeable.h"
+#include "EC_RttTarget.h"
+
+#include "Framework.h"
+#include "Application.h"
+#include "FrameAPI.h"
+#include "AssetAPI.h"
+#include "SceneAPI.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "Profiler.h"
+#include "LoggingFunctions.h"
+#include "Math/float3x4.h"
+#include "Math/MathFunc.h"
+
+#include <Ogre.h>
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+const int cDefaultWarmupFrames = 60;
+const int cDefaultFrames = 600;
+const int cDefaultRttWidth = 1280;
+const int cDefaultRttHeight = 720;
+/// Number of consecutive frames without asset transfers after which the scene is considered loaded.
+const int cIdleFramesBeforeStart = 10;
+/// Maximum time to wait for the scene to load, in seconds.
+const double cMaxSceneWaitTime = 300.0;
+const char * const cRttTextureName = "RenderBenchmarkRtt";
+
+const std::string cFindVisibleObjectsBlock = "Ogre_SceneManager_findVisibleObjects";
+
+/// Returns the sum of the cumulative times of the Profiler blocks with any of the given names. The children of matching blocks are not searched.
+/** @param names Null-terminated array of block names. */
+double BlockTotal(ProfilerNodeTree *node, const char * const *names)
+{
+    if (!node)
+        return 0.0;
+    for(const char * const *name = names; *name; ++name)
+        if (node->Name() == *name)
+        {
+            ProfilerNode *timings = dynamic_cast<ProfilerNode*>(node);
+            return timings ? timings->total_ : 0.0;
+        }
+
+    double total = 0.0;
+    const ProfilerNodeTree::NodeList &children = node->GetChildren();
+    for(ProfilerNodeTree::NodeList::const_iterator iter = children.begin(); iter != children.end(); ++iter)
+        total += BlockTotal(iter->get(), names);
+    return total;
+}
+
+QString JsonString(const QString &str)
+{
+    QString escaped;
+    for(int i = 0; i < str.length(); ++i)
+    {
+        QChar c = str[i];
+        if (c == '"' || c == '\\')
+            escaped += QString("\\") + c;
+        else if (c.unicode() < 0x20)
+            escaped += QString("\\u%1").arg((int)c.unicode(), 4, 16, QChar('0'));
+        else
+            escaped += c;
+    }
+    return "\"" + escaped + "\"";
+}
+
+QString JsonNumber(double value)
+{
+    return QString::number(value, 'f', 3);
+}
+
+/// Returns the summary statistics of a series as a JSON object.
+QString JsonSummary(std::vector<double> values)
+{
+    if (values.empty())
+        return "{}";
+    double sum = 0.0;
+    for(size_t i = 0; i < values.size(); ++i)
+        sum += values[i];
+    std::sort(values.begin(), values.end());
+    // Nearest-rank percentiles.
+    const size_t n = values.size();
+    const double median = values[(n - 1) / 2];
+    const double p95 = values[std::min(n - 1, (size_t)ceil(n * 0.95) - 1)];
+    const double p99 = values[std::min(n - 1, (size_t)ceil(n * 0.99) - 1)];
+    return QString("{ \"mean\": %1, \"median\": %2, \"p95\": %3, \"p99\": %4, \"min\": %5, \"max\": %6 }")
+        .arg(JsonNumber(sum / n)).arg(JsonNumber(median)).arg(JsonNumber(p95)).arg(JsonNumber(p99))
+        .arg(JsonNumber(values.front())).arg(JsonNumber(values.back()));
+}
+
+QString JsonArray(const std::vector<double> &values)
+{
+    QStringList items;
+    for(size_t i = 0; i < values.size(); ++i)
+        items << JsonNumber(values[i]);
+    return "[" + items.join(", ") + "]";
+}
+}
+
+/// Times the Ogre frustum culling of a scene manager as a Profiler block.
+class CullingProfilerListener : public Ogre::SceneManager::Listener
+{
+public:
+    virtual void preFindVisibleObjects(Ogre::SceneManager * /*source*/, Ogre::SceneManager::IlluminationRenderStage /*irs*/, Ogre::Viewport * /*v*/)
+    {
+#ifdef PROFILING
+        Profiler *profiler = Framework::Instance()->GetProfiler();
+        if (profiler)
+            profiler->StartBlock(cFindVisibleObjectsBlock);
+#endif
+    }
+
+    virtual void postFindVisibleObjects(Ogre::SceneManager * /*source*/, Ogre::SceneManager::IlluminationRenderStage /*irs*/, Ogre::Viewport * /*v*/)
+    {
+#ifdef PROFILING
+        Profiler *profiler = Framework::Instance()->GetProfiler();
+        if (profiler)
+            profiler->EndBlock(cFindVisibleObjectsBlock);
+#endif
+    }
+};
+
+namespace OgreRenderer
+{
+
+RenderBenchmark::RenderBenchmark(Framework *framework_, Renderer *renderer_) :
+    framework(framework_),
+    renderer(renderer_),
+    state(WaitingForScene),
+    numWarmupFrames(cDefaultWarmupFrames),
+    numFrames(cDefaultFrames),
+    frame(0),
+    waitStartTime(GetCurrentClockTime()),
+    numIdleFrames(0),
+    rtt(false),
+    rttWidth(cDefaultRttWidth),
+    rttHeight(cDefaultRttHeight),
+    cullingListener(0),
+    lastFrameTime(0)
+{
+    QStringList output = framework->CommandLineParameters("--renderBenchmark");
+    outputFile = output.isEmpty() ? "renderbenchmark.json" : output.first();
+
+    QStringList frames = framework->CommandLineParameters("--benchmarkFrames");
+    if (!frames.isEmpty())
+        numFrames = std::max(1, frames.first().toInt());
+    QStringList warmup = framework->CommandLineParameters("--benchmarkWarmup");
+    if (!warmup.isEmpty())
+        numWarmupFrames = std::max(0, warmup.first().toInt());
+
+    rtt = framework->HasCommandLineParameter("--benchmarkRtt");
+    QStringList rttSize = framework->CommandLineParameters("--benchmarkRtt");
+    if (!rttSize.isEmpty())
+    {
+        QStringList size = rttSize.first().split('x');
+        if (size.size() == 2 && size[0].toInt() > 0 && size[1].toInt() > 0)
+        {
+            rttWidth = size[0].toInt();
+            rttHeight = size[1].toInt();
+        }
+        else
+            LogWarning("RenderBenchmark: Invalid --benchmarkRtt size " + rttSize.first() + ", expected <width>x<height>. Using " +
+                QString::number(rttWidth) + "x" + QString::number(rttHeight) + ".");
+    }
+
+    if (framework->IsHeadless())
+    {
+        LogError("RenderBenchmark: --renderBenchmark cannot be used in headless mode, since nothing is rendered. Use --nullRenderer instead on machines without a GPU.");
+        Finish(false);
+        return;
+    }
+
+#ifndef PROFILING
+    LogWarning("RenderBenchmark: Built without PROFILING, only the total frame times will be recorded.");
+#endif
+
+    // Run as fast as possible.
+    framework->App()->SetTargetFpsLimit(0.0);
+
+    connect(framework->Frame(), SIGNAL(FrameProcessed(float)), this, SLOT(OnFrameProcessed(float)));
+    LogInfo("RenderBenchmark: Waiting for the scene to load.");
+}
+
+RenderBenchmark::~RenderBenchmark()
+{
+    OgreWorldPtr ogreWorld = world.lock();
+    if (ogreWorld && cullingListener && ogreWorld->OgreSceneManager())
+        ogreWorld->OgreSceneManager()->removeListener(cullingListener);
+    SAFE_DELETE(cullingListener);
+}
+
+void RenderBenchmark::OnFrameProcessed(float /*frameTime*/)
+{
+    if (state == WaitingForScene)
+    {
+        Scene *scene = ReadyScene();
+        if (scene)
+        {
+            if (!Setup(scene))
+            {
+                Finish(false);
+                return;
+            }
+            state = WarmingUp;
+            frame = 0;
+            LogInfo("RenderBenchmark: Scene loaded, running " + QString::number(numWarmupFrames) + " warmup frames.");
+        }
+        else if ((double)(GetCurrentClockTime() - waitStartTime) / GetCurrentClockFreq() > cMaxSceneWaitTime)
+        {
+            LogError("RenderBenchmark: Timed out waiting for a scene to load.");
+            Finish(false);
+            return;
+        }
+        else
+            return;
+    }
+
+    if (state == Finished)
+        return;
+
+    if (cameraEntity.expired() || world.expired())
+    {
+        LogError("RenderBenchmark: The benchmark camera or scene was removed, aborting.");
+        Finish(false);
+        return;
+    }
+
+    // Keep the benchmark camera active even if e.g. a script activates its own camera.
+    EntityPtr camera = cameraEntity.lock();
+    EC_Camera *cameraComponent = camera->GetComponent<EC_Camera>().get();
+    if (!rtt && cameraComponent && !cameraComponent->IsActive())
+        cameraComponent->SetActive();
+
+    if (state == WarmingUp)
+    {
+        if (frame < numWarmupFrames)
+        {
+            // Traverse the whole path during the warmup, so that the resources seen during the recording get loaded.
+            UpdateCamera(frame * numFrames / numWarmupFrames);
+            ++frame;
+            return;
+        }
+
+        LogInfo("RenderBenchmark: Recording " + QString::number(numFrames) + " frames.");
+        state = Recording;
+        frame = 0;
+        samples.reserve(numFrames);
+        UpdateCamera(0);
+        lastTotals = ReadBlockTotals();
+        lastFrameTime = GetCurrentClockTime();
+        return;
+    }
+
+    // Each sample spans one full iteration of the main loop, from the end of the previous frame to the end of this one.
+    const tick_t now = GetCurrentClockTime();
+    const BlockTotals totals = ReadBlockTotals();
+
+    FrameSample sample;
+    sample.frameMs = (double)(now - lastFrameTime) * 1000.0 / GetCurrentClockFreq();
+    sample.cullingMs = (totals.frustumCulling - lastTotals.frustumCulling + totals.occlusionCulling - lastTotals.occlusionCulling) * 1000.0;
+    sample.animationMs = (totals.animation - lastTotals.animation) * 1000.0;
+    // Frustum culling happens inside Ogre's frame rendering, so subtract it to get the submission time.
+    sample.submissionMs = std::max(0.0, (totals.renderOneFrame - lastTotals.renderOneFrame - (totals.frustumCulling - lastTotals.frustumCulling)) * 1000.0);
+    sample.uiMs = (totals.ui - lastTotals.ui) * 1000.0;
+
+    Ogre::RenderTarget *target = 0;
+    if (rtt)
+    {
+        Ogre::TexturePtr texture = Ogre::TextureManager::getSingleton().getByName(cRttTextureName);
+        if (!texture.isNull())
+            target = texture->getBuffer()->getRenderTarget();
+    }
+    else
+        target = renderer->GetCurrentRenderWindow();
+    sample.batches = target ? target->getBatchCount() : 0;
+    sample.triangles = target ? target->getTriangleCount() : 0;
+    samples.push_back(sample);
+    lastTotals = totals;
+
+    if (++frame >= numFrames)
+    {
+        Finish(true);
+        return;
+    }
+    UpdateCamera(frame);
+
+    // Leave the benchmark's own bookkeeping out of the next sample.
+    lastFrameTime = GetCurrentClockTime();
+}
+
+Scene *RenderBenchmark::ReadyScene()
+{
+    Scene *scene = 0;
+    const SceneMap &scenes = framework->Scene()->Scenes();
+    for(SceneMap::const_iterator iter = scenes.begin(); iter != scenes.end(); ++iter)
+        if (iter->second->ViewEnabled() && !iter->second->Entities().empty() && iter->second->GetWorld<OgreWorld>())
+        {
+            scene = iter->second.get();
+            break;
+        }
+
+    // Wait until the asset transfers of the scene have settled.
+    if (!scene || framework->Asset()->NumCurrentTransfers() > 0)
+    {
+        numIdleFrames = 0;
+        return 0;
+    }
+    return ++numIdleFrames >= cIdleFramesBeforeStart ? scene : 0;
+}
+
+bool RenderBenchmark::Setup(Scene *scene)
+{
+    OgreWorldPtr ogreWorld = scene->GetWorld<OgreWorld>();
+    Ogre::SceneManager *sceneManager = ogreWorld->OgreSceneManager();
+    if (!sceneManager)
+    {
+        LogError("RenderBenchmark: The scene has no Ogre scene manager.");
+        return false;
+    }
+    world = ogreWorld;
+
+    QStringList pathFile = framework->CommandLineParameters("--benchmarkCameraPath");
+    if (!pathFile.isEmpty())
+    {
+        if (!LoadCameraPath(pathFile.first()))
+            return false;
+    }
+    else
+        CreateOrbitCameraPath(sceneManager);
+
+    QStringList components;
+    components << EC_Placeable::TypeNameStatic() << EC_Camera::TypeNameStatic();
+    if (rtt)
+        components << EC_RttTarget::TypeNameStatic();
+    EntityPtr camera = scene->CreateLocalEntity(components, AttributeChange::LocalOnly, false);
+    if (!camera)
+    {
+        LogError("RenderBenchmark: Failed to create the benchmark camera.");
+        return false;
+    }
+    camera->SetTemporary(true);
+    cameraEntity = camera;
+    UpdateCamera(0);
+
+    if (rtt)
+    {
+        EC_RttTarget *rttTarget = camera->GetComponent<EC_RttTarget>().get();
+        rttTarget->textureName.Set(cRttTextureName, AttributeChange::LocalOnly);
+        rttTarget->width.Set(rttWidth, AttributeChange::LocalOnly);
+        rttTarget->height.Set(rttHeight, AttributeChange::LocalOnly);
+        rttTarget->PrepareRtt();
+        rttTarget->SetAutoUpdated(true);
+        // Render only offscreen. The UI is still composited, as it is done before Ogre renders the frame.
+        if (renderer->GetCurrentRenderWindow())
+            renderer->GetCurrentRenderWindow()->setAutoUpdated(false);
+    }
+    else
+        camera->GetComponent<EC_Camera>()->SetActive();
+
+    cullingListener = new CullingProfilerListener();
+    sceneManager->addListener(cullingListener);
+    return true;
+}
+
+bool RenderBenchmark::LoadCameraPath(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        LogError("RenderBenchmark: Failed to open camera path file " + filename);
+        return false;
+    }
+
+    path.clear();
+    QTextStream stream(&file);
+    int lineNumber = 0;
+    while(!stream.atEnd())
+    {
+        QString line = stream.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        QStringList values = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        bool ok = values.size() == 6;
+        float v[6];
+        for(int i = 0; ok && i < 6; ++i)
+            v[i] = values[i].toFloat(&ok);
+        if (!ok)
+        {
+            LogWarning("RenderBenchmark: Ignoring malformed line " + QString::number(lineNumber) + " in camera path file " + filename + ": " + line);
+            continue;
+        }
+        Waypoint waypoint;
+        waypoint.position = float3(v[0], v[1], v[2]);
+        waypoint.target = float3(v[3], v[4], v[5]);
+        path.push_back(waypoint);
+    }
+
+    if (path.size() < 2)
+    {
+        LogError("RenderBenchmark: The camera path file " + filename + " must contain at least two waypoints.");
+        return false;
+    }
+    return true;
+}
+
+void RenderBenchmark::CreateOrbitCameraPath(Ogre::SceneManager *sceneManager)
+{
+    Ogre::AxisAlignedBox box = sceneManager->getRootSceneNode()->_getWorldAABB();
+    float3 center = float3::zero;
+    float radius = 50.f;
+    if (box.isFinite() && !box.isNull())
+    {
+        const Ogre::Vector3 boxCenter = box.getCenter();
+        center = float3(boxCenter.x, boxCenter.y, boxCenter.z);
+        radius = Clamp(box.getSize().length() * 0.5f, 10.f, 500.f);
+    }
+
+    const int numWaypoints = 64;
+    path.clear();
+    for(int i = 0; i <= numWaypoints; ++i)
+    {
+        const float angle = 2.f * pi * i / numWaypoints;
+        Waypoint waypoint;
+        waypoint.position = center + float3(Cos(angle) * radius, radius * 0.35f, Sin(angle) * radius);
+        waypoint.target = center;
+        path.push_back(waypoint);
+    }
+}
+
+void RenderBenchmark::UpdateCamera(int pathFrame)
+{
+    EntityPtr camera = cameraEntity.lock();
+    EC_Placeable *placeable = camera ? camera->GetComponent<EC_Placeable>().get() : 0;
+    if (!placeable || path.size() < 2)
+        return;
+
+    float totalLength = 0.f;
+    for(size_t i = 1; i < path.size(); ++i)
+        totalLength += path[i].position.Distance(path[i-1].position);
+
+    size_t segment = 0;
+    float t = 0.f;
+    if (totalLength > 1e-3f)
+    {
+        // Move at a constant speed along the path.
+        float distance = totalLength * pathFrame / numFrames;
+        for(; segment + 2 < path.size(); ++segment)
+        {
+            const float length = path[segment+1].position.Distance(path[segment].position);
+            if (distance <= length)
+                break;
+            distance -= length;
+        }
+        const float length = path[segment+1].position.Distance(path[segment].position);
+        t = length > 1e-3f ? Clamp01(distance / length) : 0.f;
+    }
+    else
+    {
+        // The camera only turns in place. Spend an equal time on each segment.
+        const float position = (float)pathFrame * (path.size() - 1) / numFrames;
+        segment = std::min((size_t)position, path.size() - 2);
+        t = Clamp01(position - segment);
+    }
+
+    const float3 position = path[segment].position.Lerp(path[segment+1].position, t);
+    const float3 target = path[segment].target.Lerp(path[segment+1].target, t);
+    if (position.DistanceSq(target) < 1e-6f)
+        placeable->SetPosition(position);
+    else
+        placeable->SetWorldTransform(float3x4::LookAt(position, target, -float3::unitZ, float3::unitY, float3::unitY));
+}
+
+RenderBenchmark::BlockTotals RenderBenchmark::ReadBlockTotals() const
+{
+    BlockTotals totals;
+#ifdef PROFILING
+    Profiler *profiler = framework->GetProfiler();
+    ProfilerNodeTree *root = profiler ? profiler->GetThreadRootBlock() : 0;
+    if (!root)
+        return totals;
+
+    static const char * const frustumCulling[] = { cFindVisibleObjectsBlock.c_str(), 0 };
+    static const char * const occlusionCulling[] = { "OgreWorld_UpdateOcclusionCulling", 0 };
+    static const char * const animation[] = { "EC_AnimationController_Update", "OgreWorld_UpdateSkeletalAnimations", 0 };
+    static const char * const renderOneFrame[] = { "Renderer_Render_OgreRoot_renderOneFrame", 0 };
+    // The full UI redraw happens inside the blit on Direct3D. Other render systems upload only the dirty rectangles in the partial redraw,
+    // or fall back to the full redraw before entering its block.
+    static const char * const ui[] = { "Renderer_Render_QtBlit", "Renderer_DoFullUIRedraw", "Renderer_DoPartialUIRedraw", 0 };
+
+    totals.frustumCulling = BlockTotal(root, frustumCulling);
+    totals.occlusionCulling = BlockTotal(root, occlusionCulling);
+    totals.animation = BlockTotal(root, animation);
+    totals.renderOneFrame = BlockTotal(root, renderOneFrame);
+    totals.ui = BlockTotal(root, ui);
+#endif
+    return totals;
+}
+
+void RenderBenchmark::WriteResults()
+{
+    std::vector<double> frameMs, cullingMs, animationMs, submissionMs, uiMs, otherMs, batches, triangles;
+    double totalMs = 0.0;
+    for(size_t i = 0; i < samples.size(); ++i)
+    {
+        const FrameSample &s = samples[i];
+        frameMs.push_back(s.frameMs);
+        cullingMs.push_back(s.cullingMs);
+        animationMs.push_back(s.animationMs);
+        submissionMs.push_back(s.submissionMs);
+        uiMs.push_back(s.uiMs);
+        otherMs.push_back(std::max(0.0, s.frameMs - s.cullingMs - s.animationMs - s.submissionMs - s.uiMs));
+        batches.push_back((double)s.batches);
+        triangles.push_back((double)s.triangles);
+        totalMs += s.frameMs;
+    }
+
+#ifdef PROFILING
+    const bool profiling = true;
+#else
+    const bool profiling = false;
+#endif
+    Ogre::RenderSystem *renderSystem = renderer->OgreRoot()->getRenderSystem();
+    QStringList pathFile = framework->CommandLineParameters("--benchmarkCameraPath");
+
+    QStringList lines;
+    lines << "{";
+    lines << "  \"application\": " + JsonString(Application::FullIdentifier()) + ",";
+    lines << "  \"renderSystem\": " + JsonString(renderSystem ? renderSystem->getName().c_str() : "") + ",";
+    lines << "  \"sceneFiles\": " + JsonString(framework->CommandLineParameters("--file").join(";")) + ",";
+    lines << "  \"cameraPath\": " + JsonString(pathFile.isEmpty() ? "orbit" : pathFile.first()) + ",";
+    lines << "  \"offscreen\": " + QString(rtt ? "true" : "false") + ",";
+    lines << "  \"width\": " + QString::number(rtt ? rttWidth : renderer->WindowWidth()) + ",";
+    lines << "  \"height\": " + QString::number(rtt ? rttHeight : renderer->WindowHeight()) + ",";
+    lines << "  \"profiling\": " + QString(profiling ? "true" : "false") + ",";
+    lines << "  \"warmupFrames\": " + QString::number(numWarmupFrames) + ",";
+    lines << "  \"frames\": " + QString::number(samples.size()) + ",";
+    lines << "  \"totalTimeMs\": " + JsonNumber(totalMs) + ",";
+    lines << "  \"frameTimeMs\": " + JsonSummary(frameMs) + ",";
+    if (profiling)
+    {
+        lines << "  \"phasesMs\": {";
+        lines << "    \"culling\": " + JsonSummary(cullingMs) + ",";
+        lines << "    \"animation\": " + JsonSummary(animationMs) + ",";
+        lines << "    \"batchSubmission\": " + JsonSummary(submissionMs) + ",";
+        lines << "    \"uiCompositing\": " + JsonSummary(uiMs) + ",";
+        lines << "    \"other\": " + JsonSummary(otherMs);
+        lines << "  },";
+    }
+    lines << "  \"batches\": " + JsonSummary(batches) + ",";
+    lines << "  \"triangles\": " + JsonSummary(triangles) + ",";
+    lines << "  \"samples\": {";
+    lines << "    \"frameTimeMs\": " + JsonArray(frameMs) + (profiling ? "," : "");
+    if (profiling)
+    {
+        lines << "    \"cullingMs\": " + JsonArray(cullingMs) + ",";
+        lines << "    \"animationMs\": " + JsonArray(animationMs) + ",";
+        lines << "    \"batchSubmissionMs\": " + JsonArray(submissionMs) + ",";
+        lines << "    \"uiCompositingMs\": " + JsonArray(uiMs);
+    }
+    lines << "  }";
+    lines << "}";
+
+    QFile file(outputFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        LogError("RenderBenchmark: Failed to open " + outputFile + " for writing.");
+        return;
+    }
+    QTextStream stream(&file);
+    stream << lines.join("\n") << "\n";
+    LogInfo("RenderBenchmark: Wrote results of " + QString::number(samples.size()) + " frames to " + outputFile + ", average frame time " +
+        QString::number(samples.empty() ? 0.0 : totalMs / samples.size(), 'f', 3) + " ms.");
+}
+
+void RenderBenchmark::Finish(bool writeResults)
+{
+    state = Finished;
+    disconnect(framework->Frame(), SIGNAL(FrameProcessed(float)), this, SLOT(OnFrameProcessed(float)));
+    OgreWorldPtr ogreWorld = world.lock();
+    if (ogreWorld && cullingListener && ogreWorld->OgreSceneManager())
+        ogreWorld->OgreSceneManager()->removeListener(cullingListener);
+    SAFE_DELETE(cullingListener);
+    if (writeResults)
+        WriteResults();
+    framework->Exit();
+}
+
+}
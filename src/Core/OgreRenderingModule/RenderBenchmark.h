@@ -0,0 +1,137 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "OgreModuleApi.h"
+#include "OgreModuleFwd.h"
+#include "SceneFwd.h"
+#include "HighPerfClock.h"
+#include "Math/float3.h"
+
+#include <QObject>
+#include <QString>
+
+#include <vector>
+
+class Framework;
+class CullingProfilerListener;
+
+namespace OgreRenderer
+{
+    /// Renders a scene along a scripted camera path and writes the CPU frame time breakdown into a JSON file.
+    /** Enabled with --renderBenchmark <output.json>. The scene is loaded normally, e.g. with --file. When the scene has been
+        created and no asset transfers are pending, the benchmark creates a local camera entity, runs --benchmarkWarmup frames
+        (default 60) and then records --benchmarkFrames frames (default 600), after which it writes the results and exits.
+
+        The camera path is read from the file given with --benchmarkCameraPath. Each non-empty line that does not start with '#'
+        is a waypoint "posX posY posZ targetX targetY targetZ", and the camera moves through the waypoints at constant speed per
+        frame over the recorded frames. Without a path file the camera orbits the bounding box of the scene once. The camera
+        position depends only on the frame number, so every run renders the same images regardless of the frame rate.
+
+        With --benchmarkRtt [<width>x<height>], the camera renders offscreen through EC_RttTarget and the render window is
+        not updated. On machines without a GPU, combine the benchmark with --nullRenderer, which runs culling and batch
+        submission through Ogre but skips the actual draw calls.
+
+        The frame time is split into phases using the Profiler blocks, so the phase times are available only in builds
+        with PROFILING defined:
+        - culling: Ogre frustum culling (SceneManager::findVisibleObjects) and OgreWorld occlusion culling.
+        - animation: EC_AnimationController updates and skeleton updates.
+        - batchSubmission: the rest of Ogre's frame rendering, i.e. sorting the render queue and issuing the batches.
+        - uiCompositing: blitting the UI overlay on top of the 3D view.
+        @ingroup OgreRenderingModuleClient */
+    class OGRE_MODULE_API RenderBenchmark : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        RenderBenchmark(Framework *framework, Renderer *renderer);
+        ~RenderBenchmark();
+
+    private slots:
+        /// Advances the benchmark by one frame. Connected to FrameAPI::FrameProcessed, which is emitted once per frame even with a fixed simulation tick rate.
+        void OnFrameProcessed(float frameTime);
+
+    private:
+        enum State
+        {
+            WaitingForScene,
+            WarmingUp,
+            Recording,
+            Finished
+        };
+
+        /// A camera path waypoint
+        struct Waypoint
+        {
+            float3 position;
+            float3 target;
+        };
+
+        /// Measurements of one recorded frame. Times are in milliseconds.
+        struct FrameSample
+        {
+            double frameMs;
+            double cullingMs;
+            double animationMs;
+            double submissionMs;
+            double uiMs;
+            size_t batches;
+            size_t triangles;
+        };
+
+        /// Cumulative Profiler block times in seconds, used to compute the per-frame differences.
+        struct BlockTotals
+        {
+            BlockTotals() : frustumCulling(0), occlusionCulling(0), animation(0), renderOneFrame(0), ui(0) {}
+            double frustumCulling;
+            double occlusionCulling;
+            double animation;
+            double renderOneFrame;
+            double ui;
+        };
+
+        /// Returns the scene to benchmark once it has been loaded, otherwise null.
+        Scene *ReadyScene();
+
+        /// Creates the benchmark camera and the camera path into the scene.
+        bool Setup(Scene *scene);
+
+        /// Reads the camera path from a file. Returns false if the file could not be read or has less than two waypoints.
+        bool LoadCameraPath(const QString &filename);
+
+        /// Creates a path that orbits the bounding box of the scene.
+        void CreateOrbitCameraPath(Ogre::SceneManager *sceneManager);
+
+        /// Moves the camera to its position on the path at the given recorded frame.
+        void UpdateCamera(int pathFrame);
+
+        /// Reads the current cumulative Profiler block times.
+        BlockTotals ReadBlockTotals() const;
+
+        /// Writes the results to the output file.
+        void WriteResults();
+
+        /// Stops the benchmark, optionally writing the results, and exits the application.
+        void Finish(bool writeResults);
+
+        Framework *framework;
+        Renderer *renderer;
+        State state;
+        QString outputFile;
+        int numWarmupFrames;
+        int numFrames;
+        int frame; ///< Frame counter of the current state.
+        tick_t waitStartTime; ///< When waiting for the scene started.
+        int numIdleFrames; ///< Consecutive frames without pending asset transfers.
+        bool rtt;
+        int rttWidth;
+        int rttHeight;
+        std::vector<Waypoint> path;
+        EntityWeakPtr cameraEntity;
+        OgreWorldWeakPtr world;
+        CullingProfilerListener *cullingListener;
+        tick_t lastFrameTime;
+        BlockTotals lastTotals;
+        std::vector<FrameSample> samples;
+    };
+}
@@ -185,6 +185,26 @@ void RenderWindow::UpdateOverlayImage(const QImage &src)
     texture->getBuffer()->blitFromMemory(bufbox);
 }
 
+size_t RenderWindow::UpdateOverlayImage(const QImage &src, const QRect &rect)
+{
+    PROFILE(RenderWindow_UpdateOverlayImageRect);
+
+    Ogre::TextureManager &mgr = Ogre::TextureManager::getSingleton();
+    Ogre::TexturePtr texture = mgr.getByName(rttTextureName);
+    assert(texture.get());
+
+    const QRect bounds(0, 0, min<int>(src.width(), texture->getWidth()), min<int>(src.height(), texture->getHeight()));
+    const QRect r = rect.intersected(bounds);
+    if (r.isEmpty())
+        return 0;
+
+    // The pixel box spans the whole image, so its subvolume refers to the rows of the rectangle in place with the image's row pitch.
+    Ogre::PixelBox image(src.width(), src.height(), 1, Ogre::PF_A8R8G8B8, (void *)src.bits());
+    Ogre::Box box(r.left(), r.top(), r.right() + 1, r.bottom() + 1);
+    texture->getBuffer()->blitFromMemory(image.getSubVolume(box), box);
+    return (size_t)r.width() * r.height() * 4;
+}
+
 void RenderWindow::ShowOverlay(bool visible)
 {
     if (overlayContainer)
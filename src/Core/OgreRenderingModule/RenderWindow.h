@@ -17,6 +17,7 @@ namespace Ogre
 }
 
 class QImage;
+class QRect;
 
 /// Stores the main Ogre::RenderWindow that is created by the Renderer.
 class OGRE_MODULE_API RenderWindow : public QObject
@@ -48,6 +49,11 @@ public slots:
     /// Fully repaints the Ogre 2D Overlay from the given source image.
     void UpdateOverlayImage(const QImage &src);
 
+    /// Uploads a rectangle of the given source image to the same position in the Ogre 2D Overlay.
+    /** The rows of the rectangle are uploaded directly from the image, without copying them to a temporary buffer first.
+        @return Number of bytes uploaded. */
+    size_t UpdateOverlayImage(const QImage &src, const QRect &rect);
+
     /// Shows or hides whether the 2D Ogre Overlay is visible or not.
     void ShowOverlay(bool visible);
 
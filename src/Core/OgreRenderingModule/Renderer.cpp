@@ -11,6 +11,7 @@
 #include "RenderWindow.h"
 #include "OgreShadowCameraSetupFocusedPSSM.h"
 #include "OgreCompositionHandler.h"
+#include "OgreMaterialDeduplicator.h"
 #include "UiPlane.h"
 #include "TextureAsset.h"
 #include "OgreMeshAsset.h"
@@ -162,6 +163,8 @@ namespace OgreRenderer
         textureQuality(Texture_Normal)
     {
         compositionHandler = new OgreCompositionHandler();
+        materialDeduplicator = new OgreMaterialDeduplicator();
+        materialDeduplicator->SetEnabled(!framework->HasCommandLineParameter("--noMaterialDeduplication"));
         logListener = new OgreLogListener(framework->HasCommandLineParameter("--hide_benign_ogre_messages"));
 
         timerFrequency = GetCurrentClockFreq();
@@ -189,6 +192,7 @@ namespace OgreRenderer
             defaultScene = 0;
         }
         
+        SAFE_DELETE(materialDeduplicator);
         ogreRoot.reset();
         SAFE_DELETE(compositionHandler);
         SAFE_DELETE(logListener);
@@ -210,6 +214,9 @@ namespace OgreRenderer
         // Soft shadow
         if (!framework->Config()->HasValue(configData, "soft shadow"))
             framework->Config()->Set(configData, "soft shadow", false);
+        // Parallel skeletal animation, see OgreWorld::QueueSkeletalAnimationUpdate
+        if (!framework->Config()->HasValue(configData, "parallel skeletal animation"))
+            framework->Config()->Set(configData, "parallel skeletal animation", false);
         // Rendering plugin
 #ifdef _WINDOWS
         if (!framework->Config()->HasValue(configData, "rendering plugin"))
@@ -563,6 +570,62 @@ namespace OgreRenderer
         }
 
         renderWindow->UpdateOverlayImage(*backBuffer);
+
+        uiUploadStats.numRects = 1;
+        uiUploadStats.numBytes = (size_t)backBuffer->width() * backBuffer->height() * 4;
+        uiUploadStats.fullRedraw = true;
+    }
+
+    void Renderer::DoPartialUIRedraw()
+    {
+        if (framework->IsHeadless())
+            return;
+
+        UiGraphicsView *view = framework->Ui()->GraphicsView();
+        QImage *backBuffer = view->BackBuffer();
+        const QVector<QRect> &dirtyRects = view->DirtyRectangles();
+        if (!backBuffer || resizedDirty > 0 || dirtyRects.isEmpty())
+        {
+            DoFullUIRedraw();
+            return;
+        }
+
+        PROFILE(Renderer_DoPartialUIRedraw);
+
+        const QRect bufferRect(0, 0, backBuffer->width(), backBuffer->height());
+        {
+            PROFILE(Renderer_DoPartialUIRedraw_GraphicsViewPaint);
+            QPainter painter(backBuffer);
+            for(int i = 0; i < dirtyRects.size(); ++i)
+            {
+                const QRect dirty = dirtyRects[i].intersected(bufferRect);
+                if (dirty.isEmpty())
+                    continue;
+                painter.setCompositionMode(QPainter::CompositionMode_Source);
+                painter.fillRect(dirty, Qt::transparent);
+                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+                view->viewport()->render(&painter, dirty.topLeft(), QRegion(dirty), QWidget::DrawChildren);
+            }
+        }
+
+        UploadDirtyUIRects();
+    }
+
+    void Renderer::UploadDirtyUIRects()
+    {
+        PROFILE(Renderer_UploadDirtyUIRects);
+
+        UiGraphicsView *view = framework->Ui()->GraphicsView();
+        const QVector<QRect> &dirtyRects = view->DirtyRectangles();
+        for(int i = 0; i < dirtyRects.size(); ++i)
+        {
+            size_t bytes = renderWindow->UpdateOverlayImage(*view->BackBuffer(), dirtyRects[i]);
+            if (bytes > 0)
+            {
+                ++uiUploadStats.numRects;
+                uiUploadStats.numBytes += bytes;
+            }
+        }
     }
 
     RaycastResult* Renderer::Raycast(int x, int y)
@@ -597,6 +660,9 @@ namespace OgreRenderer
             
         PROFILE(Renderer_Render);
 
+        // Deduplicate the materials that were changed on the previous frames but not since.
+        materialDeduplicator->Update();
+
         // The message pump must be called on X11 systems,
         // but on Windows it is redundant (Qt already manages this), and has been profiled to take as much as 10ms per frame in some situations.
 #ifdef UNIX
@@ -636,6 +702,8 @@ namespace OgreRenderer
         UiGraphicsView *view = framework->Ui()->GraphicsView();
         assert(view);
 
+        uiUploadStats = UiUploadStats();
+
 #ifdef DIRECTX_ENABLED
         if (!view->BackBuffer())
         {
@@ -676,7 +744,11 @@ namespace OgreRenderer
             Ogre::D3D9RenderWindow *d3d9rw = dynamic_cast<Ogre::D3D9RenderWindow*>(renderWindow->OgreRenderWindow());
             if (!d3d9rw) // We're not using D3D9.
             {
-                DoFullUIRedraw();
+                // The dirty rectangles were painted into the backbuffer above, upload them as such.
+                if (resizedDirty > 0 || view->DirtyRectangles().isEmpty())
+                    DoFullUIRedraw();
+                else
+                    UploadDirtyUIRects();
             }
             else
             {
@@ -760,6 +832,8 @@ namespace OgreRenderer
                     // Update the regions that have changed.
                     for(int y = 0; y < copyableHeight; ++y)
                         memcpy(surfacePtr + y * lock.Pitch, &scanlines[dirty.left()*4 + (y+dirty.top()) * view->BackBuffer()->width()*4], copyableWidthBytes);
+                    uiUploadStats.numRects = 1;
+                    uiUploadStats.numBytes = (size_t)copyableHeight * copyableWidthBytes;
                 }
 
                 {
@@ -773,10 +847,10 @@ namespace OgreRenderer
                 }
             }
         }
-#else // Not using the subrectangle blit - just do a full UI blit.
+#else // Repaint and upload only the dirty rectangles.
         if (view->IsViewDirty() || resizedDirty)
         {
-            DoFullUIRedraw();
+            DoPartialUIRedraw();
         }
 #endif
 
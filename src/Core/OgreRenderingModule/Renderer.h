@@ -21,6 +21,17 @@ class Framework;
 namespace OgreRenderer
 {
     class OgreLogListener;
+    class OgreMaterialDeduplicator;
+
+    /// Statistics of the UI overlay texture uploads of the last rendered frame.
+    struct UiUploadStats
+    {
+        UiUploadStats() : numRects(0), numBytes(0), fullRedraw(false) {}
+
+        int numRects; ///< Number of rectangles uploaded.
+        size_t numBytes; ///< Number of bytes uploaded.
+        bool fullRedraw; ///< Was the whole overlay repainted and uploaded.
+    };
 
     /// Ogre renderer
     /** Created by OgreRenderingModule. Implements the IRenderer.
@@ -78,6 +89,9 @@ namespace OgreRenderer
         /// returns the composition handler responsible of the post-processing effects
         OgreCompositionHandler *CompositionHandler() const { return compositionHandler; }
 
+        /// Returns the material deduplicator that collapses identical material assets into shared Ogre materials
+        OgreMaterialDeduplicator *MaterialDeduplicator() const { return materialDeduplicator; }
+
         /// Returns RenderWindow used to display the 3D scene in.
         RenderWindow *GetRenderWindow() const { return renderWindow; }
 
@@ -130,6 +144,9 @@ namespace OgreRenderer
         /// Returns texture quality.
         TextureQualitySetting TextureQuality() const { return textureQuality; }
 
+        /// Returns the statistics of the UI overlay texture uploads of the last rendered frame.
+        const UiUploadStats &UiUploadStatistics() const { return uiUploadStats; }
+
     public slots:
         /// Renders the screen. Advances Ogre's time internally by the frameTime specified
         virtual void Render(float frameTime);
@@ -184,6 +201,13 @@ namespace OgreRenderer
     private:
         friend class OgreRenderingModule;
 
+        /// Repaints the dirty rectangles of the UI view and uploads only them to the GPU surface.
+        /** Falls back to DoFullUIRedraw() if the whole view needs to be repainted. */
+        void DoPartialUIRedraw();
+
+        /// Uploads the dirty rectangles of the UI view from its backbuffer to the GPU surface.
+        void UploadDirtyUIRects();
+
         /// Sleeps the main thread to throttle the main loop execution speed.
         void DoFrameTimeLimiting();
 
@@ -256,9 +280,13 @@ namespace OgreRenderer
         /// handler for post-processing effects
         OgreCompositionHandler *compositionHandler;
 
+        /// shares the Ogre materials of identical deduplicated material assets
+        OgreMaterialDeduplicator *materialDeduplicator;
+
         int lastHeight; ///< Last render window height
         int lastWidth; ///< Last render window width
         int resizedDirty; ///< Resized dirty count
+        UiUploadStats uiUploadStats; ///< UI overlay texture upload statistics of the last rendered frame.
         ShadowQualitySetting shadowQuality; ///< Shadow quality setting.
         TextureQualitySetting textureQuality; ///< Texture quality setting.
 
@@ -5,6 +5,7 @@
 #include "IComponent.h"
 #include "CoreDefines.h"
 #include "Math/float3.h"
+#include "PhysicsModuleApi.h"
 #include "PhysicsModuleFwd.h"
 
 class EC_Placeable;
@@ -40,7 +41,7 @@ class EC_Placeable;
     <b>Depends on the components @ref EC_RigidBody "RigidBody" and @ref EC_Placeable "Placeable".</b>.
 
     </table> */
-class EC_PhysicsMotor : public IComponent
+class PHYSICS_MODULE_API EC_PhysicsMotor : public IComponent
 {
     Q_OBJECT
     COMPONENT_NAME("EC_PhysicsMotor", 43)
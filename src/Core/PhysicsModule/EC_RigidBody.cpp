@@ -64,7 +64,8 @@ EC_RigidBody::EC_RigidBody(Scene* scene) :
     disconnected_(false),
     cachedShapeType_(-1),
     cachedSize_(float3::zero),
-    clientExtrapolating(false)
+    clientExtrapolating(false),
+    clientPredicted(false)
 {
     owner_ = framework->GetModule<PhysicsModule>();
     
@@ -452,7 +453,8 @@ void EC_RigidBody::setWorldTransform(const btTransform &worldTrans)
     // Important: disconnect our own response to attribute changes to not create an endless loop!
     disconnected_ = true;
     
-    AttributeChange::Type changeType = hasAuthority ? AttributeChange::Default : AttributeChange::LocalOnly;
+    // The client-predicted body is corrected by the server, so its simulated state is not sent back.
+    AttributeChange::Type changeType = (hasAuthority && !clientPredicted) ? AttributeChange::Default : AttributeChange::LocalOnly;
 
     // Set transform
     float3 position = worldTrans.getOrigin();
@@ -502,6 +504,11 @@ void EC_RigidBody::SetClientExtrapolating(bool isClientExtrapolating)
     clientExtrapolating = isClientExtrapolating;
 }
 
+void EC_RigidBody::SetClientPredicted(bool isClientPredicted)
+{
+    clientPredicted = isClientPredicted;
+}
+
 void EC_RigidBody::OnTerrainRegenerated()
 {
     if (shapeType.Get() == Shape_HeightField)
@@ -746,6 +753,8 @@ void EC_RigidBody::GetAabbox(float3 &outAabbMin, float3 &outAabbMax)
 
 bool EC_RigidBody::HasAuthority() const
 {
+    if (clientPredicted && world_)
+        return true;
     if ((!world_) || ((world_->IsClient()) && (!ParentEntity()->IsLocal())))
         return false;
     
@@ -197,6 +197,14 @@ public:
 
     void SetClientExtrapolating(bool isClientExtrapolating);
 
+    /// Sets whether the client predicts this rigid body from its own input, see TundraLogic::SyncManager.
+    /** A predicted body is simulated by the local physics, and accepts forces, impulses and rotations on the client, but
+        its transform and velocities are changed locally only. The server remains the authority, and corrects the body. */
+    void SetClientPredicted(bool isClientPredicted);
+
+    /// Returns whether the client predicts this rigid body.
+    bool IsClientPredicted() const { return clientPredicted; }
+
     btRigidBody* GetRigidBody() const { return body_; }
 
     /// Constructs axis-aligned bounding box from bullet collision shape
@@ -284,7 +292,7 @@ public slots:
     /// Return physics world
     Physics::PhysicsWorld* GetPhysicsWorld() const { return world_; }
 
-    /// Return whether have authority. On the client, returns false for non-local objects.
+    /// Return whether have authority. On the client, returns false for non-local objects, unless the object is predicted by the client.
     bool HasAuthority() const;
 
     /// Returns the minimal axis-aligned bounding box that encloses the collision shape of this rigid body.
@@ -368,6 +376,9 @@ private:
     /// On the server side, this flag is not used.
     bool clientExtrapolating;
 
+    /// On the client side, tells whether the rigid body is predicted by the client. On the server side, this flag is not used.
+    bool clientPredicted;
+
     /// Bullet body
     btRigidBody* body_;
     
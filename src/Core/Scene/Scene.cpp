@@ -18,12 +18,14 @@
 #include "Application.h"
 #include "AssetAPI.h"
 #include "FrameAPI.h"
+#include "TaskAPI.h"
 #include "Profiler.h"
 #include "LoggingFunctions.h"
 
 #include <QString>
 #include <QRegExp>
 #include <QDomDocument>
+#include <QXmlStreamReader>
 #include <QFile>
 #include <QDir>
 #include <QTextStream>
@@ -33,17 +35,228 @@
 #include <kNet/DataSerializer.h>
 
 #include <boost/regex.hpp>
+#include <boost/bind.hpp>
 
 #include <utility>
 #include "MemoryLeakCheck.h"
 
 using namespace kNet;
 
+namespace
+{
+
+/// Number of entities read from a streamed scene XML before they are created. Bounds the memory used by the attribute strings.
+const size_t cXmlEntityBatchSize = 256;
+/// Number of attribute values converted by one task of the parallel conversion.
+const int cXmlAttributeGrainSize = 256;
+
+/// An attribute element read from scene XML.
+struct XmlAttributeData
+{
+    QString name;
+    QString typeName;
+    QString value;
+};
+
+/// A component element read from scene XML.
+struct XmlComponentData
+{
+    QString typeName;
+    QString name;
+    QString sync;
+    std::vector<XmlAttributeData> attributes;
+};
+
+/// An entity element read from scene XML.
+struct XmlEntityData
+{
+    QString id;
+    QString sync;
+    std::vector<XmlComponentData> components;
+};
+
+/// An attribute value to convert from its string form.
+struct XmlAttributeValue
+{
+    IAttribute *attribute;
+    const QString *value;
+};
+
+/// Reads the component element the reader is at, up to and including its end element.
+void ReadXmlComponent(QXmlStreamReader &reader, XmlComponentData &comp)
+{
+    QXmlStreamAttributes attrs = reader.attributes();
+    comp.typeName = attrs.value("type").toString();
+    comp.name = attrs.value("name").toString();
+    comp.sync = attrs.value("sync").toString();
+    while(reader.readNextStartElement())
+    {
+        if (reader.name() == "attribute")
+        {
+            QXmlStreamAttributes attrAttrs = reader.attributes();
+            XmlAttributeData attr = { attrAttrs.value("name").toString(), attrAttrs.value("type").toString(), attrAttrs.value("value").toString() };
+            comp.attributes.push_back(attr);
+        }
+        reader.skipCurrentElement();
+    }
+}
+
+/// Reads the entity element the reader is at, up to and including its end element.
+void ReadXmlEntity(QXmlStreamReader &reader, XmlEntityData &entity)
+{
+    QXmlStreamAttributes attrs = reader.attributes();
+    entity.id = attrs.value("id").toString();
+    entity.sync = attrs.value("sync").toString();
+    while(reader.readNextStartElement())
+    {
+        if (reader.name() == "component")
+        {
+            entity.components.push_back(XmlComponentData());
+            ReadXmlComponent(reader, entity.components.back());
+        }
+        else
+            reader.skipCurrentElement();
+    }
+}
+
+/// Finds the values of the static attributes of the component. Like IComponent::DeserializeFrom, uses the first value
+/// of each attribute name and leaves the attributes that have no value as they are.
+void CollectXmlAttributeValues(IComponent *comp, const XmlComponentData &data, std::vector<XmlAttributeValue> &values)
+{
+    const AttributeVector &attributes = comp->Attributes();
+    for(size_t i = 0; i < attributes.size(); ++i)
+    {
+        if (!attributes[i])
+            continue;
+        const QString &name = attributes[i]->Name();
+        for(size_t j = 0; j < data.attributes.size(); ++j)
+            if (data.attributes[j].name == name)
+            {
+                XmlAttributeValue value = { attributes[i], &data.attributes[j].value };
+                values.push_back(value);
+                break;
+            }
+    }
+}
+
+/// Converts a range of attribute values. No signals are emitted, so that the ranges can be converted in parallel.
+void ConvertXmlAttributeValues(const std::vector<XmlAttributeValue> *values, int begin, int end)
+{
+    for(int i = begin; i < end; ++i)
+        (*values)[i].attribute->FromString((*values)[i].value->toStdString(), AttributeChange::Disconnected);
+}
+
+/// Returns whether the component creates its attributes while deserializing, and must therefore be deserialized through its DeserializeFrom.
+bool HasDynamicAttributes(IComponent *comp)
+{
+    return comp->TypeName() == "EC_DynamicComponent";
+}
+
+/// Deserializes the component from the element data on the calling thread.
+void DeserializeFromXmlData(IComponent *comp, const XmlComponentData &data, AttributeChange::Type change)
+{
+    if (HasDynamicAttributes(comp))
+    {
+        QDomDocument temp_doc;
+        QDomElement root_elem = temp_doc.createElement("component");
+        root_elem.setAttribute("type", data.typeName);
+        root_elem.setAttribute("name", data.name);
+        root_elem.setAttribute("sync", data.sync);
+        for(size_t i = 0; i < data.attributes.size(); ++i)
+        {
+            QDomElement child_elem = temp_doc.createElement("attribute");
+            child_elem.setAttribute("value", data.attributes[i].value);
+            child_elem.setAttribute("type", data.attributes[i].typeName);
+            child_elem.setAttribute("name", data.attributes[i].name);
+            root_elem.appendChild(child_elem);
+        }
+        comp->DeserializeFrom(root_elem, change);
+        return;
+    }
+
+    std::vector<XmlAttributeValue> values;
+    CollectXmlAttributeValues(comp, data, values);
+    for(size_t i = 0; i < values.size(); ++i)
+        values[i].attribute->FromString(values[i].value->toStdString(), change);
+}
+
+/// Creates the entities read from scene XML, see Scene::CreateContentFromXml.
+/** The components are created on the calling thread, and the attribute values of the whole batch are then converted in parallel. */
+void CreateXmlEntityBatch(Scene *scene, std::vector<XmlEntityData> &batch, bool useEntityIDsFromFile, QHash<entity_id_t, entity_id_t> &oldToNewIds,
+    std::vector<EntityWeakPtr> &entities)
+{
+    PROFILE(Scene_CreateXmlEntityBatch);
+
+    // Create the entities and components on this thread, as component constructors may use any API.
+    std::vector<XmlAttributeValue> values;
+    for(size_t i = 0; i < batch.size(); ++i)
+    {
+        const XmlEntityData &data = batch[i];
+        bool replicated = true;
+        if (!data.sync.isEmpty())
+            replicated = ParseBool(data.sync);
+
+        entity_id_t id = !data.id.isEmpty() ? static_cast<entity_id_t>(data.id.toInt()) : 0;
+        if (!useEntityIDsFromFile || id == 0) // If we don't want to use entity IDs from file, or if file doesn't contain one, generate a new one.
+        {
+            entity_id_t originaId = id;
+            id = replicated ? scene->NextFreeId() : scene->NextFreeIdLocal();
+            if (originaId != 0 && !oldToNewIds.contains(originaId))
+                oldToNewIds[originaId] = id;
+        }
+        else if (useEntityIDsFromFile && scene->HasEntity(id)) // If we use IDs from file and they conflict with some of the existing IDs, change the ID of the old entity
+        {
+            entity_id_t newID = replicated ? scene->NextFreeId() : scene->NextFreeIdLocal();
+            scene->ChangeEntityId(id, newID);
+        }
+
+        if (scene->HasEntity(id)) // If the entity we are about to add conflicts in ID with an existing entity in the scene, delete the old entity.
+        {
+            LogDebug("Scene::CreateContentFromXml: Destroying previous entity with id " + QString::number(id) + " to avoid conflict with new created entity with the same id.");
+            LogError("Warning: Invoking buggy behavior: Object with id " + QString::number(id) +" might not replicate properly!");
+            scene->RemoveEntity(id, AttributeChange::Replicate); ///<@todo Consider do we want to always use Replicate
+        }
+
+        EntityPtr entity = scene->CreateEntity(id);
+        if (!entity)
+        {
+            LogError("Scene::CreateContentFromXml: Failed to create entity with id " + QString::number(id) + "!");
+            continue;
+        }
+
+        for(size_t j = 0; j < data.components.size(); ++j)
+        {
+            const XmlComponentData &compData = data.components[j];
+            bool compReplicated = true;
+            if (!compData.sync.isEmpty())
+                compReplicated = ParseBool(compData.sync);
+
+            ComponentPtr new_comp = entity->GetOrCreateComponent(compData.typeName, compData.name, AttributeChange::Default, compReplicated);
+            if (!new_comp)
+                continue;
+            // Trigger no signal yet when scene is in incoherent state
+            if (HasDynamicAttributes(new_comp.get()))
+                DeserializeFromXmlData(new_comp.get(), compData, AttributeChange::Disconnected);
+            else
+                CollectXmlAttributeValues(new_comp.get(), compData, values);
+        }
+        entities.push_back(entity);
+    }
+
+    // Each attribute is converted by one task and no signals are emitted, so the conversions do not touch shared state.
+    scene->GetFramework()->Tasks()->ParallelFor(0, (int)values.size(), boost::bind(&ConvertXmlAttributeValues, &values, _1, _2),
+        cXmlAttributeGrainSize, "SceneXmlAttributes");
+}
+
+}
+
 Scene::Scene(const QString &name, Framework *framework, bool viewEnabled, bool authority) :
     name_(name),
     framework_(framework),
     interpolating_(false),
-    authority_(authority)
+    authority_(authority),
+    bulkCreationDepth_(0),
+    signallingBulkCreation_(false)
 {
     // In headless mode only view disabled-scenes can be created
     viewEnabled_ = framework->IsHeadless() ? false : viewEnabled;
@@ -110,8 +323,17 @@ EntityPtr Scene::CreateEntity(entity_id_t id, const QStringList &components, Att
     }
     entities_[entity->Id()] = entity;
 
-    // Remember the creation and signal at end of frame if EmitEntityCreated() not called for this entity manually
-    entitiesCreatedThisFrame_.push_back(std::make_pair(EntityWeakPtr(entity), change));
+    if (bulkCreationDepth_ > 0)
+    {
+        // Signalled by EndBulkCreation
+        bulkEntities_.push_back(entity);
+        bulkEntitySet_.insert(entity.get());
+    }
+    else
+    {
+        // Remember the creation and signal at end of frame if EmitEntityCreated() not called for this entity manually
+        entitiesCreatedThisFrame_.push_back(std::make_pair(EntityWeakPtr(entity), change));
+    }
 
     return entity;
 }
@@ -185,6 +407,7 @@ bool Scene::RemoveEntity(entity_id_t id, AttributeChange::Type change)
         EmitEntityRemoved(del_entity.get(), change);
 
         entities_.erase(it);
+        bulkEntitySet_.remove(del_entity.get());
         // If entity somehow manages to live, at least it doesn't belong to the scene anymore
         del_entity->SetScene(0);
         del_entity.reset();
@@ -259,6 +482,8 @@ void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange
 {
     if (change == AttributeChange::Disconnected)
         return;
+    if (!bulkEntitySet_.isEmpty() && bulkEntitySet_.contains(entity))
+        return; // Signalled by EndBulkCreation
     if (change == AttributeChange::Default)
         change = comp->UpdateMode();
     emit ComponentAdded(entity, comp, change);
@@ -277,6 +502,8 @@ void Scene::EmitAttributeChanged(IComponent* comp, IAttribute* attribute, Attrib
 {
     if (!comp || !attribute || change == AttributeChange::Disconnected)
         return;
+    if (!bulkEntitySet_.isEmpty() && bulkEntitySet_.contains(comp->ParentEntity()))
+        return; // Signalled by EndBulkCreation
     if (change == AttributeChange::Default)
         change = comp->UpdateMode();
     emit AttributeChanged(comp, attribute, change);
@@ -284,9 +511,12 @@ void Scene::EmitAttributeChanged(IComponent* comp, IAttribute* attribute, Attrib
 
 void Scene::EmitAttributeAdded(IComponent* comp, IAttribute* attribute, AttributeChange::Type change)
 {
-    // "Stealth" addition (disconnected changetype) is not supported. Always signal.
+    // "Stealth" addition (disconnected changetype) is not supported. Always signal, except for entities of a bulk creation,
+    // which are replicated as a whole.
     if (!comp || !attribute)
         return;
+    if (!bulkEntitySet_.isEmpty() && bulkEntitySet_.contains(comp->ParentEntity()))
+        return;
     if (change == AttributeChange::Default)
         change = comp->UpdateMode();
     emit AttributeAdded(comp, attribute, change);
@@ -304,6 +534,9 @@ void Scene::EmitAttributeRemoved(IComponent* comp, IAttribute* attribute, Attrib
 
 void Scene::EmitEntityCreated(Entity *entity, AttributeChange::Type change)
 {
+    if (!bulkEntitySet_.isEmpty() && bulkEntitySet_.contains(entity))
+        return; // Signalled by EndBulkCreation
+
     // Remove from the create signalling queue
     for (unsigned i = 0; i < entitiesCreatedThisFrame_.size(); ++i)
     {
@@ -323,6 +556,72 @@ void Scene::EmitEntityCreated(Entity *entity, AttributeChange::Type change)
         emit EntityCreated(entity, change);
 }
 
+void Scene::BeginBulkCreation()
+{
+    ++bulkCreationDepth_;
+}
+
+QList<Entity *> Scene::EndBulkCreation(AttributeChange::Type change)
+{
+    PROFILE(Scene_EndBulkCreation);
+
+    if (bulkCreationDepth_ <= 0)
+    {
+        LogError("Scene::EndBulkCreation: No bulk creation in progress.");
+        return QList<Entity *>();
+    }
+    if (--bulkCreationDepth_ > 0)
+        return QList<Entity *>();
+
+    std::vector<EntityWeakPtr> entities;
+    entities.swap(bulkEntities_);
+    // Stop suppressing the signals of the entities before signalling them, so that the changes the listeners make to them
+    // are signalled and replicated normally.
+    bulkEntitySet_.clear();
+
+    if (change == AttributeChange::Default)
+        change = AttributeChange::Replicate;
+    if (change != AttributeChange::Disconnected)
+    {
+        QList<Entity *> created;
+        for(size_t i = 0; i < entities.size(); ++i)
+            if (!entities[i].expired())
+                created.append(entities[i].lock().get());
+
+        signallingBulkCreation_ = true;
+        if (!created.isEmpty())
+            emit EntitiesCreated(created, change);
+        // Then the individual signals in the order they are emitted outside a bulk creation. The components are copied,
+        // as the listeners may add components to the entity.
+        std::vector<ComponentPtr> components;
+        for(size_t i = 0; i < entities.size(); ++i)
+        {
+            EntityPtr entity = entities[i].lock();
+            if (!entity)
+                continue;
+            components.clear();
+            const Entity::ComponentMap &componentMap = entity->Components();
+            for(Entity::ComponentMap::const_iterator j = componentMap.begin(); j != componentMap.end(); ++j)
+                components.push_back(j->second);
+            for(size_t j = 0; j < components.size(); ++j)
+                if (components[j]->ParentEntity() == entity.get())
+                    EmitComponentAdded(entity.get(), components[j].get(), change);
+            emit EntityCreated(entity.get(), change);
+            for(size_t j = 0; j < components.size(); ++j)
+                if (components[j]->ParentEntity() == entity.get())
+                    components[j]->ComponentChanged(change);
+        }
+        signallingBulkCreation_ = false;
+    }
+
+    // The above signals may have caused scripts to remove entities. Return those that still exist.
+    QList<Entity *> ret;
+    for(size_t i = 0; i < entities.size(); ++i)
+        if (!entities[i].expired())
+            ret.append(entities[i].lock().get());
+    return ret;
+}
+
 void Scene::EmitEntityRemoved(Entity* entity, AttributeChange::Type change)
 {
     if (change == AttributeChange::Disconnected)
@@ -369,32 +668,19 @@ QVariantList Scene::GetEntityIdsWithComponent(const QString &typeName) const
 
 QList<Entity *> Scene::LoadSceneXML(const QString& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change)
 {
-    QList<Entity *> ret;
-
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly))
     {
         LogError("Failed to open file " + filename + " when loading scene xml.");
-        return ret;
-    }
-
-    QTextStream stream(&file);
-    stream.setCodec("UTF-8");
-    QDomDocument scene_doc("Scene");
-    QString errorMsg;
-    int errorLine, errorColumn;
-    if (!scene_doc.setContent(stream.readAll(), &errorMsg, &errorLine, &errorColumn))
-    {
-        LogError(QString("Parsing scene XML from %1 failed when loading Scene XML: %2 at line %3 column %4.").arg(filename).arg(errorMsg).arg(errorLine).arg(errorColumn));
-        file.close();
-        return ret;
+        return QList<Entity *>();
     }
 
     // Purge all old entities. Send events for the removal
     if (clearScene)
         RemoveAllEntities(true, change);
 
-    return CreateContentFromXml(scene_doc, useEntityIDsFromFile, change);
+    QXmlStreamReader reader(&file);
+    return CreateContentFromXmlStream(reader, filename, useEntityIDsFromFile, change);
 }
 
 QByteArray Scene::GetSceneXML(bool gettemporary, bool getlocal) const
@@ -529,17 +815,66 @@ bool Scene::SaveSceneBinary(const QString& filename, bool getTemporary, bool get
 
 QList<Entity *> Scene::CreateContentFromXml(const QString &xml,  bool useEntityIDsFromFile, AttributeChange::Type change)
 {
-    QList<Entity *> ret;
-    QString errorMsg;
-    QDomDocument scene_doc("Scene");
-    int errorLine, errorColumn;
-    if (!scene_doc.setContent(xml, false, &errorMsg, &errorLine, &errorColumn))
+    QXmlStreamReader reader(xml);
+    return CreateContentFromXmlStream(reader, "text", useEntityIDsFromFile, change);
+}
+
+QList<Entity *> Scene::CreateContentFromXml(QIODevice *device, bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    QXmlStreamReader reader(device);
+    return CreateContentFromXmlStream(reader, "device", useEntityIDsFromFile, change);
+}
+
+QList<Entity *> Scene::CreateContentFromXmlStream(QXmlStreamReader &reader, const QString &source, bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    PROFILE(Scene_CreateContentFromXmlStream);
+
+    std::vector<EntityWeakPtr> entities;
+    QHash<entity_id_t, entity_id_t> oldToNewIds;
+    std::vector<XmlEntityData> batch;
+    batch.reserve(cXmlEntityBatchSize);
+
+    if (!reader.readNextStartElement() || reader.name() != "scene")
     {
-        LogError(QString("Parsing scene XML from text failed when loading Scene XML: %1 at line %2 column %3.").arg(errorMsg).arg(errorLine).arg(errorColumn));
-        return ret;
+        if (reader.hasError())
+            LogError(QString("Parsing scene XML from %1 failed: %2 at line %3 column %4.").arg(source).arg(reader.errorString()).arg(reader.lineNumber()).arg(reader.columnNumber()));
+        else
+            LogError("Could not find 'scene' element from XML.");
+        return QList<Entity *>();
+    }
+
+    // The entities are signalled in EmitContentCreated.
+    BeginBulkCreation();
+
+    while(reader.readNextStartElement())
+    {
+        if (reader.name() == "storage")
+        {
+            framework_->Asset()->DeserializeAssetStorageFromString(Application::ParseWildCardFilename(reader.attributes().value("specifier").toString()), false);
+            reader.skipCurrentElement();
+        }
+        else if (reader.name() == "entity")
+        {
+            batch.push_back(XmlEntityData());
+            ReadXmlEntity(reader, batch.back());
+            if (batch.size() >= cXmlEntityBatchSize)
+            {
+                CreateXmlEntityBatch(this, batch, useEntityIDsFromFile, oldToNewIds, entities);
+                batch.clear();
+            }
+        }
+        else
+            reader.skipCurrentElement();
     }
+    if (!batch.empty())
+        CreateXmlEntityBatch(this, batch, useEntityIDsFromFile, oldToNewIds, entities);
 
-    return CreateContentFromXml(scene_doc, useEntityIDsFromFile, change);
+    // The entities before the error have already been created, so signal them to keep the scene coherent.
+    if (reader.hasError())
+        LogError(QString("Parsing scene XML from %1 failed: %2 at line %3 column %4. Loaded %5 entities before the error.").arg(source)
+            .arg(reader.errorString()).arg(reader.lineNumber()).arg(reader.columnNumber()).arg(entities.size()));
+
+    return EmitContentCreated(entities, oldToNewIds, useEntityIDsFromFile, change);
 }
 
 QList<Entity *> Scene::CreateContentFromXml(const QDomDocument &xml, bool useEntityIDsFromFile, AttributeChange::Type change)
@@ -564,6 +899,9 @@ QList<Entity *> Scene::CreateContentFromXml(const QDomDocument &xml, bool useEnt
     
     QHash<entity_id_t, entity_id_t> oldToNewIds;
 
+    // The entities are signalled in EmitContentCreated.
+    BeginBulkCreation();
+
     // Spawn all entities in the scene storage.
     QDomElement ent_elem = scene_elem.firstChildElement("entity");
     while(!ent_elem.isNull())
@@ -629,48 +967,38 @@ QList<Entity *> Scene::CreateContentFromXml(const QDomDocument &xml, bool useEnt
         ent_elem = ent_elem.nextSiblingElement("entity");
     }
 
-    // Now that we have each entity spawned to the scene, trigger all the signals for EntityCreated/ComponentChanged messages.
-    for(unsigned i = 0; i < entities.size(); ++i)
+    return EmitContentCreated(entities, oldToNewIds, useEntityIDsFromFile, change);
+}
+
+QList<Entity *> Scene::EmitContentCreated(const std::vector<EntityWeakPtr> &entities, const QHash<entity_id_t, entity_id_t> &oldToNewIds,
+    bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    // Go and fix parent refs of EC_Placeable if new entity IDs were generated. The entities have not been signalled yet,
+    // so this is done without signals.
+    if (!useEntityIDsFromFile)
     {
-        if (!entities[i].expired())
-            EmitEntityCreated(entities[i].lock().get(), change);
-        if (!entities[i].expired())
+        for(unsigned i = 0; i < entities.size(); ++i)
         {
-            EntityPtr entityShared = entities[i].lock();
-            const Entity::ComponentMap &components = entityShared->Components();
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+            EntityPtr entity = entities[i].lock();
+            ComponentPtr placeable = entity ? entity->GetComponent("EC_Placeable") : ComponentPtr();
+            IAttribute *iAttr = placeable ? placeable->GetAttribute("Parent entity ref") : 0;
+            Attribute<EntityReference> *parenRef = iAttr != 0 ? dynamic_cast<Attribute<EntityReference> *>(iAttr) : 0;
+            if (parenRef && !parenRef->Get().IsEmpty())
             {
-                if (!useEntityIDsFromFile && i->second->TypeName() == "EC_Placeable")
-                {
-                    // Go and fix parent ref of EC_Placeable if new entity IDs were generated
-                    IAttribute *iAttr = i->second->GetAttribute("Parent entity ref");
-                    Attribute<EntityReference> *parenRef = iAttr != 0 ? dynamic_cast<Attribute<EntityReference> *>(iAttr) : 0;
-                    if (parenRef && !parenRef->Get().IsEmpty())
-                    {
-                        QString ref = parenRef->Get().ref;
-                        
-                        // We only need to fix the id parent refs.
-                        // Ones with entity names should work as expected.
-                        bool isNumber = false;
-                        entity_id_t refId = ref.toUInt(&isNumber);
-                        if (isNumber && refId > 0 && oldToNewIds.contains(refId))
-                            parenRef->Set(EntityReference(oldToNewIds[refId]), change);
-                    }
-                }
-                i->second->ComponentChanged(change);
+                QString ref = parenRef->Get().ref;
+
+                // We only need to fix the id parent refs.
+                // Ones with entity names should work as expected.
+                bool isNumber = false;
+                entity_id_t refId = ref.toUInt(&isNumber);
+                if (isNumber && refId > 0 && oldToNewIds.contains(refId))
+                    parenRef->Set(EntityReference(oldToNewIds[refId]), AttributeChange::Disconnected);
             }
         }
     }
-    
-    // The above signals may have caused scripts to remove entities. Return those that still exist.
-    QList<Entity *> ret;
-    for(unsigned i = 0; i < entities.size(); ++i)
-    {
-        if (!entities[i].expired())
-            ret.append(entities[i].lock().get());
-    }
-    
-    return ret;
+
+    // Now that we have each entity spawned to the scene, trigger all the signals for EntityCreated/ComponentChanged messages.
+    return EndBulkCreation(change);
 }
 
 QList<Entity *> Scene::CreateContentFromBinary(const QString &filename, bool useEntityIDsFromFile, AttributeChange::Type change)
@@ -796,16 +1124,19 @@ QList<Entity *> Scene::CreateContentFromBinary(const char *data, int numBytes, b
 
 QList<Entity *> Scene::CreateContentFromSceneDesc(const SceneDesc &desc, bool useEntityIDsFromFile, AttributeChange::Type change)
 {
-    QList<Entity *> ret;
-
     if (desc.entities.empty())
     {
         LogError("Empty scene description.");
-        return ret;
+        return QList<Entity *>();
     }
 
+    std::vector<EntityWeakPtr> entities;
+
     QHash<entity_id_t, entity_id_t> oldToNewIds;
 
+    // The entities are signalled in EmitContentCreated.
+    BeginBulkCreation();
+
     foreach(const EntityDesc &e, desc.entities)
     {
         entity_id_t id;
@@ -869,38 +1200,11 @@ QList<Entity *> Scene::CreateContentFromSceneDesc(const SceneDesc &desc, bool us
             }
 
             entity->SetTemporary(e.temporary);
-            ret.append(entity.get());
-        }
-    }
-
-    // All entities & components have been loaded. Trigger change for them now.
-    foreach(Entity *entity, ret)
-    {
-        EmitEntityCreated(entity, change);
-        const Entity::ComponentMap &components = entity->Components();
-        for(Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-        {
-            if (!useEntityIDsFromFile && i->second->TypeName() == "EC_Placeable")
-            {
-                // Go and fix parent ref of EC_Placeable if new entity IDs were generated
-                IAttribute *iAttr = i->second->GetAttribute("Parent entity ref");
-                Attribute<EntityReference> *parenRef = iAttr != 0 ? dynamic_cast<Attribute<EntityReference> *>(iAttr) : 0;
-                if (parenRef && !parenRef->Get().IsEmpty())
-                {
-                    QString ref = parenRef->Get().ref;
-                    // We only need to fix the id parent refs.
-                    // Ones with entity names should work as expected.
-                    bool isNumber = false;
-                    entity_id_t refId = ref.toUInt(&isNumber);
-                    if (isNumber && refId > 0 && oldToNewIds.contains(refId))
-                        parenRef->Set(EntityReference(oldToNewIds[refId]), change);
-                }
-            }
-            i->second->ComponentChanged(change);
+            entities.push_back(entity);
         }
     }
 
-    return ret;
+    return EmitContentCreated(entities, oldToNewIds, useEntityIDsFromFile, change);
 }
 
 SceneDesc Scene::CreateSceneDescFromXml(const QString &filename) const
@@ -932,111 +1236,100 @@ SceneDesc Scene::CreateSceneDescFromXml(const QString &filename) const
 
 SceneDesc Scene::CreateSceneDescFromXml(QByteArray &data, SceneDesc &sceneDesc) const
 {
-    QTextStream stream(&data);
-    stream.setCodec("UTF-8");
-    QDomDocument scene_doc("Scene");
-    QString errorMsg;
-    int errorLine, errorColumn;
-    if (!scene_doc.setContent(stream.readAll(), &errorMsg, &errorLine, &errorColumn))
-    {
-        LogError(QString("Parsing scene XML from %1 failed when loading Scene XML: %2 at line %3 column %4.").arg(sceneDesc.filename).arg(errorMsg).arg(errorLine).arg(errorColumn));
-        return sceneDesc;
-    }
-
+    QXmlStreamReader reader(data);
     // Check for existence of the scene element before we begin
-    QDomElement scene_elem = scene_doc.firstChildElement("scene");
-    if (scene_elem.isNull())
+    if (!reader.readNextStartElement() || reader.name() != "scene")
     {
-        LogError("Could not find 'scene' element from XML.");
+        if (reader.hasError())
+            LogError(QString("Parsing scene XML from %1 failed when loading Scene XML: %2 at line %3 column %4.").arg(sceneDesc.filename)
+                .arg(reader.errorString()).arg(reader.lineNumber()).arg(reader.columnNumber()));
+        else
+            LogError("Could not find 'scene' element from XML.");
         return sceneDesc;
     }
 
-    QDomElement ent_elem = scene_elem.firstChildElement("entity");
-    while(!ent_elem.isNull())
+    // Read one entity at a time, so that only the description is kept in memory.
+    while(reader.readNextStartElement())
     {
-        QString id_str = ent_elem.attribute("id");
-        if (!id_str.isEmpty())
+        if (reader.name() != "entity")
         {
-            EntityDesc entityDesc;
-            entityDesc.id = id_str;
+            reader.skipCurrentElement();
+            continue;
+        }
 
-            QDomElement comp_elem = ent_elem.firstChildElement("component");
-            while(!comp_elem.isNull())
-            {
-                QString type_name = comp_elem.attribute("type");
-                QString name = comp_elem.attribute("name");
-                QString sync = comp_elem.attribute("sync");
-                ComponentDesc compDesc;
-                compDesc.typeName = type_name;
-                compDesc.name = name;
-                compDesc.sync = sync;
+        XmlEntityData entityData;
+        ReadXmlEntity(reader, entityData);
+        if (entityData.id.isEmpty())
+            continue;
 
-                // A bit of a hack to get the name from EC_Name.
-                if (entityDesc.name.isEmpty() && type_name == EC_Name::TypeNameStatic())
-                {
-                    ComponentPtr comp = framework_->Scene()->CreateComponentByName(const_cast<Scene*>(this), type_name, name);
-                    EC_Name *ecName = checked_static_cast<EC_Name*>(comp.get());
-                    ecName->DeserializeFrom(comp_elem, AttributeChange::Disconnected);
-                    entityDesc.name = ecName->name.Get();
-                }
+        EntityDesc entityDesc;
+        entityDesc.id = entityData.id;
 
-                // Find asset references.
-                ComponentPtr comp = framework_->Scene()->CreateComponentByName(const_cast<Scene*>(this), type_name, name);
-                if (!comp.get()) // Move to next element if component creation fails.
-                {
-                    comp_elem = comp_elem.nextSiblingElement("component");
-                    continue;
-                }
+        for(size_t i = 0; i < entityData.components.size(); ++i)
+        {
+            const XmlComponentData &compData = entityData.components[i];
+            ComponentDesc compDesc;
+            compDesc.typeName = compData.typeName;
+            compDesc.name = compData.name;
+            compDesc.sync = compData.sync;
+
+            // Find asset references.
+            ComponentPtr comp = framework_->Scene()->CreateComponentByName(const_cast<Scene*>(this), compData.typeName, compData.name);
+            if (!comp.get()) // Move to next element if component creation fails.
+                continue;
+
+            DeserializeFromXmlData(comp.get(), compData, AttributeChange::Disconnected);
+
+            // A bit of a hack to get the name from EC_Name.
+            if (entityDesc.name.isEmpty() && compData.typeName == EC_Name::TypeNameStatic())
+                entityDesc.name = checked_static_cast<EC_Name*>(comp.get())->name.Get();
 
-                comp->DeserializeFrom(comp_elem, AttributeChange::Disconnected);
-                foreach(IAttribute *a,comp->Attributes())
+            foreach(IAttribute *a,comp->Attributes())
+            {
+                if (!a)
+                    continue;
+                
+                QString typeName = a->TypeName();
+                AttributeDesc attrDesc = { typeName, a->Name(), a->ToString().c_str() };
+                compDesc.attributes.append(attrDesc);
+
+                QString attrValue = QString(a->ToString().c_str()).trimmed();
+                if ((typeName == "assetreference" || typeName == "assetreferencelist" || 
+                    (a->Metadata() && a->Metadata()->elementType == "assetreference")) &&
+                    !attrValue.isEmpty())
                 {
-                    if (!a)
-                        continue;
-                    
-                    QString typeName = a->TypeName();
-                    AttributeDesc attrDesc = { typeName, a->Name(), a->ToString().c_str() };
-                    compDesc.attributes.append(attrDesc);
-
-                    QString attrValue = QString(a->ToString().c_str()).trimmed();
-                    if ((typeName == "assetreference" || typeName == "assetreferencelist" || 
-                        (a->Metadata() && a->Metadata()->elementType == "assetreference")) &&
-                        !attrValue.isEmpty())
+                    // We might have multiple references, ";" used as a separator.
+                    QStringList values = attrValue.split(";");
+                    foreach(QString value, values)
                     {
-                        // We might have multiple references, ";" used as a separator.
-                        QStringList values = attrValue.split(";");
-                        foreach(QString value, values)
-                        {
-                            AssetDesc ad;
-                            ad.typeName = a->Name();
-                            ad.dataInMemory = false;
+                        AssetDesc ad;
+                        ad.typeName = a->Name();
+                        ad.dataInMemory = false;
 
-                            // Rewrite source refs for asset descs, if necessary.
-                            QString basePath = QFileInfo(sceneDesc.filename).dir().path();
-                            framework_->Asset()->ResolveLocalAssetPath(value, basePath, ad.source);
-                            ad.destinationName = AssetAPI::ExtractFilenameFromAssetRef(ad.source);
+                        // Rewrite source refs for asset descs, if necessary.
+                        QString basePath = QFileInfo(sceneDesc.filename).dir().path();
+                        framework_->Asset()->ResolveLocalAssetPath(value, basePath, ad.source);
+                        ad.destinationName = AssetAPI::ExtractFilenameFromAssetRef(ad.source);
 
-                            sceneDesc.assets[qMakePair(ad.source, ad.subname)] = ad;
+                        sceneDesc.assets[qMakePair(ad.source, ad.subname)] = ad;
 
-                            // If this is a script, look for dependecies
-                            if (ad.source.toLower().endsWith(".js"))
-                                SearchScriptAssetDependencies(ad.source, sceneDesc);
-                        }
+                        // If this is a script, look for dependecies
+                        if (ad.source.toLower().endsWith(".js"))
+                            SearchScriptAssetDependencies(ad.source, sceneDesc);
                     }
                 }
-
-                entityDesc.components.append(compDesc);
-
-                comp_elem = comp_elem.nextSiblingElement("component");
             }
 
-            sceneDesc.entities.append(entityDesc);
+            entityDesc.components.append(compDesc);
         }
 
-        // Process siblings.
-        ent_elem = ent_elem.nextSiblingElement("entity");
+        sceneDesc.entities.append(entityDesc);
     }
 
+    if (reader.hasError())
+        LogError(QString("Parsing scene XML from %1 failed when loading Scene XML: %2 at line %3 column %4.").arg(sceneDesc.filename)
+            .arg(reader.errorString()).arg(reader.lineNumber()).arg(reader.columnNumber()));
+
     return sceneDesc;
 }
 
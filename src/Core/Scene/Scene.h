@@ -12,6 +12,8 @@
 
 #include <QObject>
 #include <QVariant>
+#include <QHash>
+#include <QSet>
 
 #include <boost/enable_shared_from_this.hpp>
 
@@ -20,6 +22,8 @@ class Framework;
 /// Maybe have some kind of UserConnection interface class defined in Framework and use that instead.
 class UserConnection;
 class QDomDocument;
+class QIODevice;
+class QXmlStreamReader;
 
 /// A collection of entities which form an observable world.
 /** Acts as a factory for all entities.
@@ -216,6 +220,29 @@ public slots:
     EntityPtr CreateLocalEntity(const QStringList &components = QStringList(),
         AttributeChange::Type change = AttributeChange::Default, bool componentsReplicated = true);
 
+    /// Starts a bulk creation of entities.
+    /** Until the matching EndBulkCreation, the entities created with CreateEntity are not signalled one at a time:
+        the EntityCreated, ComponentAdded, AttributeChanged and AttributeAdded signals of the scene are suppressed for them.
+        The signals of the components themselves are emitted normally. Bulk creations can be nested, the outermost one
+        signals all the entities. Use this when creating a large number of entities at once, e.g. when instantiating a prefab. */
+    void BeginBulkCreation();
+
+    /// Ends a bulk creation and signals the created entities.
+    /** Emits EntitiesCreated once with all the entities created since BeginBulkCreation. For the listeners of the individual
+        signals, ComponentAdded and EntityCreated are then emitted for each entity and ComponentChanged is called for each of
+        their components, while IsSignallingBulkCreation returns true. The signals of the entities are no longer suppressed
+        at that point, so the changes the listeners make to them are signalled normally.
+        @param change Change type of the signals. Disconnected emits no signals.
+        @return The created entities that still exist after the signals, or an empty list if this was a nested bulk creation. */
+    QList<Entity *> EndBulkCreation(AttributeChange::Type change = AttributeChange::Default);
+
+    /// Returns whether a bulk creation is in progress.
+    bool IsBulkCreating() const { return bulkCreationDepth_ > 0; }
+
+    /// Returns whether EndBulkCreation is emitting the individual signals of entities already signalled with EntitiesCreated.
+    /** The listeners that handle EntitiesCreated can ignore EntityCreated while this returns true. */
+    bool IsSignallingBulkCreation() const { return signallingBulkCreation_; }
+
     /// Returns scene up vector. For now it is a compile-time constant
     float3 UpVector() const;
 
@@ -303,7 +330,9 @@ public slots:
     EntityMap Entities() /*non-const intentionally*/ { return entities_; }
 
     /// Loads the scene from XML.
-    /** @param filename File name
+    /** The file is read as a stream and the entities are created in batches while reading, see CreateContentFromXml.
+        @note If clearScene is true, the existing entities are removed before the file is read, even if it fails to parse.
+        @param filename File name
         @param clearScene Do we want to clear the existing scene.
         @param useEntityIDsFromFile If true, the created entities will use the Entity IDs from the original file. 
                   If the scene contains any previous entities with conflicting IDs, those are removed. If false, the entity IDs from the files are ignored,
@@ -343,7 +372,12 @@ public slots:
     bool SaveSceneBinary(const QString& filename, bool saveTemporary, bool saveLocal);
 
     /// Creates scene content from XML.
-    /** @param xml XML document as string.
+    /** The XML is read as a stream, without building a document of it. The entities and components are created in
+        batches as they are read, and the attribute values of each batch are converted from strings in parallel on the
+        worker threads of TaskAPI, so the memory used does not grow with the size of the XML. The entity creation and
+        attribute change signals are emitted once all the entities have been created. If the XML is malformed, the entities
+        read before the error are created.
+        @param xml XML document as string.
         @param useEntityIDsFromFile If true, the created entities will use the Entity IDs from the original file.
                   If the scene contains any previous entities with conflicting IDs, those are removed. If false, the entity IDs from the files are ignored,
                   and new IDs are generated for the created entities.
@@ -351,6 +385,7 @@ public slots:
         @return List of created entities. */
     QList<Entity *> CreateContentFromXml(const QString &xml, bool useEntityIDsFromFile, AttributeChange::Type change);
     QList<Entity *> CreateContentFromXml(const QDomDocument &xml, bool useEntityIDsFromFile, AttributeChange::Type change); /**< @overload @param xml XML document. */
+    QList<Entity *> CreateContentFromXml(QIODevice *device, bool useEntityIDsFromFile, AttributeChange::Type change); /**< @overload @param device Open device to stream the XML from. */
 
     /// Creates scene content from binary file.
     /** @param filename File name.
@@ -409,6 +444,9 @@ signals:
     /** @note Entity::IsTemporary() information might not be accurate yet, as it depends on the method that was used to create the entity. */
     void EntityCreated(Entity* entity, AttributeChange::Type change);
 
+    /// Signal when the entities of a bulk creation have been created, see BeginBulkCreation.
+    void EntitiesCreated(const QList<Entity *> &entities, AttributeChange::Type change);
+
     /// Signal when an entity deleted
     void EntityRemoved(Entity* entity, AttributeChange::Type change);
 
@@ -454,6 +492,16 @@ private:
         @param authority Whether the scene has authority ie. a singleuser or server scene, false for network client scenes */
     Scene(const QString &name, Framework *fw, bool viewEnabled, bool authority);
 
+    /// Creates scene content by reading XML from the stream reader, see CreateContentFromXml.
+    /** @param source Name of the XML source for error messages. */
+    QList<Entity *> CreateContentFromXmlStream(QXmlStreamReader &reader, const QString &source, bool useEntityIDsFromFile, AttributeChange::Type change);
+
+    /// Fixes parent references to the regenerated IDs and ends the bulk creation of entities created from a file.
+    /** The caller must have called BeginBulkCreation before creating the entities.
+        @return The entities that still exist after the signals. */
+    QList<Entity *> EmitContentCreated(const std::vector<EntityWeakPtr> &entities, const QHash<entity_id_t, entity_id_t> &oldToNewIds,
+        bool useEntityIDsFromFile, AttributeChange::Type change);
+
     /// Container for an ongoing attribute interpolation
     struct AttributeInterpolation
     {
@@ -476,4 +524,8 @@ private:
     bool authority_; ///< Authority -flag
     std::vector<AttributeInterpolation> interpolations_; ///< Running attribute interpolations.
     std::vector<std::pair<EntityWeakPtr, AttributeChange::Type> > entitiesCreatedThisFrame_; ///< Entities to signal for creation at frame end.
+    int bulkCreationDepth_; ///< Number of nested BeginBulkCreation calls.
+    bool signallingBulkCreation_; ///< Is EndBulkCreation emitting the individual signals.
+    std::vector<EntityWeakPtr> bulkEntities_; ///< Entities created in the ongoing bulk creation, in creation order.
+    QSet<Entity *> bulkEntitySet_; ///< Entities whose scene signals are suppressed by the bulk creation.
 };
@@ -12,6 +12,7 @@
 #include "EntityReference.h"
 #include "SceneInteract.h"
 #include "LoggingFunctions.h"
+#include "HighPerfClock.h"
 
 #include "Color.h"
 #include "Math/Quat.h"
@@ -19,6 +20,11 @@
 #include "Math/float3.h"
 #include "Math/float4.h"
 #include "Transform.h"
+
+#include <QDomDocument>
+#include <QFile>
+#include <QTextStream>
+
 #include "MemoryLeakCheck.h"
 
 QStringList SceneAPI::attributeTypeNames(QStringList() << "string" << "int" << "real" << "color" << "float2" << "float3" << "float4" << "bool" << "uint" << "quat" <<
@@ -101,6 +107,50 @@ void SceneAPI::RemoveScene(const QString &name)
     }
 }
 
+void SceneAPI::BenchmarkSceneLoad(const QString &filename, int runs)
+{
+    const QString sceneName = "SceneLoadBenchmark";
+    if (HasScene(sceneName))
+    {
+        LogError("SceneAPI::BenchmarkSceneLoad: Scene " + sceneName + " already exists.");
+        return;
+    }
+
+    for(int loader = 0; loader < 2; ++loader)
+    {
+        const bool streaming = (loader == 0);
+        double totalMsecs = 0.0;
+        int numEntities = 0;
+        for(int i = 0; i < std::max(runs, 1); ++i)
+        {
+            QFile file(filename);
+            if (!file.open(QIODevice::ReadOnly))
+            {
+                LogError("SceneAPI::BenchmarkSceneLoad: Failed to open " + filename + ".");
+                return;
+            }
+
+            ScenePtr scene = CreateScene(sceneName, false, true);
+            const tick_t startTime = GetCurrentClockTime();
+            if (streaming)
+                numEntities = scene->CreateContentFromXml(&file, true, AttributeChange::LocalOnly).size();
+            else
+            {
+                QTextStream stream(&file);
+                stream.setCodec("UTF-8");
+                QDomDocument doc("Scene");
+                if (doc.setContent(stream.readAll()))
+                    numEntities = scene->CreateContentFromXml(doc, true, AttributeChange::LocalOnly).size();
+            }
+            totalMsecs += (double)(GetCurrentClockTime() - startTime) * 1000.0 / GetCurrentClockFreq();
+            scene.reset();
+            RemoveScene(sceneName);
+        }
+        LogInfo(QString("%1 loader: %2 entities in %3 ms on average over %4 runs.").arg(streaming ? "Streaming" : "QDomDocument")
+            .arg(numEntities).arg(totalMsecs / std::max(runs, 1), 0, 'f', 1).arg(std::max(runs, 1)));
+    }
+}
+
 const SceneMap &SceneAPI::Scenes() const
 {
     return scenes;
@@ -73,6 +73,12 @@ public slots:
         @param name name of the scene to delete */
     void RemoveScene(const QString &name);
 
+    /// Loads a scene XML file into a temporary scene with both the streaming and the QDomDocument loader, and prints the load times.
+    /** The temporary scene is not view enabled. It is removed after each load.
+        @param filename Scene XML file.
+        @param runs Number of times the file is loaded with each loader. */
+    void BenchmarkSceneLoad(const QString &filename, int runs = 1);
+
     /// Returns the scene map for self reflection / introspection.
     SceneMap &Scenes();
     const SceneMap &Scenes() const;
@@ -152,6 +152,8 @@ void Client::Login(const QString& address, unsigned short port, kNet::SocketTran
     SetLoginProperty("client-version", Application::Version());
     SetLoginProperty("client-name", Application::ApplicationName());
     SetLoginProperty("client-organization", Application::OrganizationName());
+    SetLoginProperty("compact-entity-actions", "1"); // Ask for the batched EntityActions message, see EntityActionCodec.
+    SetLoginProperty("batched-entity-creation", "1"); // Ask for the CreateEntities message instead of one CreateEntity message per entity.
 
     KristalliProtocolModule *kristalli = framework_->GetModule<KristalliProtocolModule>();
     connect(kristalli, SIGNAL(NetworkMessageReceived(kNet::MessageConnection *, kNet::packet_id_t, kNet::message_id_t, const char *, size_t)), 
@@ -260,6 +262,10 @@ void Client::CheckLogin()
         if (connection && connection->GetConnectionState() == kNet::ConnectionOK)
         {
             loginstate_ = ConnectionEstablished;
+            // Use the legacy entity action message until the server of this connection announces the compact one.
+            owner_->GetSyncManager()->ResetServerEntityActions();
+            // The entity to predict is assigned again by the server of this connection.
+            owner_->GetSyncManager()->ResetClientPrediction();
             MsgLogin msg;
             emit AboutToConnect(); // This signal is used as a 'function call'. Any interested party can fill in
             // new content to the login properties of the client object, which will then be sent out on the line below.
@@ -0,0 +1,366 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "ClientPrediction.h"
+#include "TundraMessages.h"
+
+#include "EC_Placeable.h"
+#include "EC_RigidBody.h"
+#include "EC_PhysicsMotor.h"
+#include "PhysicsWorld.h"
+#include "Transform.h"
+#include "Profiler.h"
+
+#include <kNet.h>
+
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <BulletDynamics/Dynamics/btRigidBody.h>
+#include <BulletCollision/CollisionShapes/btConvexShape.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+void AddFloat3(kNet::DataSerializer &ds, const float3 &v)
+{
+    ds.Add<float>(v.x);
+    ds.Add<float>(v.y);
+    ds.Add<float>(v.z);
+}
+
+float3 ReadFloat3(kNet::DataDeserializer &dd)
+{
+    float3 v;
+    v.x = dd.Read<float>();
+    v.y = dd.Read<float>();
+    v.z = dd.Read<float>();
+    return v;
+}
+
+void QueueUnreliableMessage(kNet::MessageConnection *connection, kNet::message_id_t id, kNet::DataSerializer &ds)
+{
+    kNet::NetworkMessage *msg = connection->StartNewMessage(id, ds.BytesFilled());
+    memcpy(msg->data, ds.GetData(), ds.BytesFilled());
+    msg->reliable = false; // Each message supersedes the previous ones, so lost messages are not resent.
+    msg->inOrder = false;
+    msg->priority = 100; // Fixed priority as in those defined with xml
+    connection->EndAndQueueMessage(msg);
+}
+
+/// Convex sweep result that ignores the swept body itself, and the surfaces that the motion does not go into.
+class SweepCallback : public btCollisionWorld::ClosestConvexResultCallback
+{
+public:
+    SweepCallback(btRigidBody *body_, const btVector3 &from, const btVector3 &to) :
+        btCollisionWorld::ClosestConvexResultCallback(from, to),
+        body(body_),
+        motion(to - from)
+    {
+        if (body->getBroadphaseHandle())
+        {
+            m_collisionFilterGroup = body->getBroadphaseHandle()->m_collisionFilterGroup;
+            m_collisionFilterMask = body->getBroadphaseHandle()->m_collisionFilterMask;
+        }
+    }
+
+    btScalar addSingleResult(btCollisionWorld::LocalConvexResult &convexResult, bool normalInWorldSpace)
+    {
+        if (convexResult.m_hitCollisionObject == body)
+            return 1.f;
+        const btVector3 normal = normalInWorldSpace ? convexResult.m_hitNormalLocal :
+            convexResult.m_hitCollisionObject->getWorldTransform().getBasis() * convexResult.m_hitNormalLocal;
+        if (normal.dot(motion) >= 0.f)
+            return 1.f; // Moving away from or along the surface, e.g. walking on the ground.
+        return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(convexResult, normalInWorldSpace);
+    }
+
+private:
+    btRigidBody *body;
+    btVector3 motion;
+};
+
+/// Simulates a rigid body driven by an EC_PhysicsMotor on its own, without stepping the rest of the physics world.
+class BodyReplay
+{
+public:
+    BodyReplay(btDiscreteDynamicsWorld *world_, btRigidBody *body_, const float3 &dampingForce_, float timeStep_) :
+        world(world_),
+        body(body_),
+        shape(body_->getCollisionShape() && body_->getCollisionShape()->isConvex() ? static_cast<btConvexShape *>(body_->getCollisionShape()) : 0),
+        dampingForce(dampingForce_),
+        timeStep(timeStep_)
+    {
+    }
+
+    /// Advances the body by one physics step with the given input.
+    void Step(const ClientPrediction::Input &input, float3 &pos, float3 &vel) const
+    {
+        // Integrate the velocity as btRigidBody does: gravity, then damping, then the motion.
+        const float3 linearFactor = body->getLinearFactor();
+        vel += float3(body->getGravity()).Mul(linearFactor) * timeStep;
+        vel *= std::pow(1.f - (float)body->getLinearDamping(), timeStep);
+        Move(pos, vel);
+
+        // Then the impulses of EC_PhysicsMotor::OnPhysicsUpdate, which runs after each physics step.
+        Transform rotation;
+        rotation.rot = input.rotation;
+        const float3 impulse = input.absoluteMoveForce + rotation.Orientation() * input.relativeMoveForce - vel.Mul(dampingForce);
+        vel += impulse.Mul(linearFactor) * (float)body->getInvMass();
+    }
+
+private:
+    /// Moves the body by its velocity for one step, sliding along the surfaces it hits.
+    void Move(float3 &pos, float3 &vel) const
+    {
+        float3 motion = vel * timeStep;
+        if (!shape)
+        {
+            pos += motion;
+            return;
+        }
+
+        const btQuaternion orientation = body->getWorldTransform().getRotation();
+        for(int i = 0; i < cMaxSlides && !motion.IsZero(1e-10f); ++i)
+        {
+            const float3 target = pos + motion;
+            SweepCallback callback(body, pos, target);
+            world->convexSweepTest(shape, btTransform(orientation, pos), btTransform(orientation, target), callback);
+            if (!callback.hasHit())
+            {
+                pos = target;
+                return;
+            }
+
+            // Stop at the surface, and continue with the rest of the motion along it.
+            const float3 normal = float3(callback.m_hitNormalWorld).Normalized();
+            const float fraction = (float)callback.m_closestHitFraction;
+            pos += motion * fraction;
+            motion *= 1.f - fraction;
+            motion -= normal * motion.Dot(normal);
+            vel -= normal * std::min(0.f, vel.Dot(normal));
+        }
+    }
+
+    static const int cMaxSlides = 3;
+
+    btDiscreteDynamicsWorld *world;
+    btRigidBody *body;
+    btConvexShape *shape;
+    float3 dampingForce;
+    float timeStep;
+};
+}
+
+const float ClientPrediction::cMinCorrection = 0.1f;
+
+bool ClientPrediction::Input::Equals(const Input &rhs) const
+{
+    return relativeMoveForce.Equals(rhs.relativeMoveForce) && absoluteMoveForce.Equals(rhs.absoluteMoveForce) &&
+        rotation.Equals(rhs.rotation);
+}
+
+ClientPrediction::Stats::Stats() :
+    numAcks(0),
+    latencySum(0.0),
+    maxLatency(0.f),
+    numCorrections(0),
+    correctionSum(0.0),
+    maxCorrection(0.f),
+    replayedInputs(0),
+    replaySum(0.0),
+    maxReplay(0.f)
+{
+}
+
+ClientPrediction::ClientPrediction() :
+    entityId(0),
+    lastSequence(0),
+    lastAckedSequence(0),
+    ackPending(false)
+{
+}
+
+void ClientPrediction::Reset()
+{
+    SetEntity(0);
+    lastSequence = 0;
+    lastAckedSequence = 0;
+    stats = Stats();
+}
+
+void ClientPrediction::SetEntity(entity_id_t id)
+{
+    // The sequence numbers keep increasing, so that the inputs of the previous entity are not mistaken for newer ones.
+    entityId = id;
+    history.clear();
+    ackPending = false;
+}
+
+bool ClientPrediction::IsPredictedAttribute(IComponent *comp, IAttribute *attr)
+{
+    if (EC_Placeable *placeable = dynamic_cast<EC_Placeable *>(comp))
+        return attr == &placeable->transform;
+    if (EC_RigidBody *rigidBody = dynamic_cast<EC_RigidBody *>(comp))
+        return attr == &rigidBody->linearVelocity || attr == &rigidBody->angularVelocity;
+    return dynamic_cast<EC_PhysicsMotor *>(comp) != 0;
+}
+
+bool ClientPrediction::SendInput(kNet::MessageConnection *connection, EC_PhysicsMotor *motor, EC_Placeable *placeable, EC_RigidBody *rigidBody, bool force)
+{
+    Input input;
+    input.relativeMoveForce = motor->relativeMoveForce.Get();
+    input.absoluteMoveForce = motor->absoluteMoveForce.Get();
+    input.rotation = placeable->transform.Get().rot;
+    if (!force && !history.empty() && input.Equals(history.back().input))
+        return false;
+
+    PROFILE(ClientPrediction_SendInput);
+
+    input.sequence = ++lastSequence;
+
+    HistoryEntry entry;
+    entry.input = input;
+    entry.sendTime = kNet::Clock::Tick();
+    entry.pos = placeable->transform.Get().pos;
+    entry.vel = rigidBody->linearVelocity.Get();
+    history.push_back(entry);
+    if (history.size() > cMaxHistory)
+        history.pop_front();
+
+    kNet::DataSerializer ds(messageBuffer, sizeof(messageBuffer));
+    ds.AddVLE<kNet::VLE8_16_32>(entityId);
+    ds.Add<u32>(input.sequence);
+    AddFloat3(ds, input.relativeMoveForce);
+    AddFloat3(ds, input.absoluteMoveForce);
+    AddFloat3(ds, input.rotation);
+    QueueUnreliableMessage(connection, cInputCommandMessage, ds);
+    return true;
+}
+
+void ClientPrediction::HandleAck(const char *data, size_t numBytes, EC_PhysicsMotor *motor, EC_Placeable *placeable, EC_RigidBody *rigidBody)
+{
+    PROFILE(ClientPrediction_HandleAck);
+
+    kNet::DataDeserializer dd(data, numBytes);
+    const entity_id_t ackEntityId = dd.ReadVLE<kNet::VLE8_16_32>();
+    const u32 sequence = dd.Read<u32>();
+    const float3 serverPos = ReadFloat3(dd);
+    const float3 serverVel = ReadFloat3(dd);
+
+    // Ignore acknowledgements of other entities and acknowledgements received out of order.
+    if (ackEntityId != entityId || sequence <= lastAckedSequence || sequence > lastSequence)
+        return;
+    lastAckedSequence = sequence;
+
+    while(!history.empty() && history.front().input.sequence < sequence)
+        history.pop_front();
+    if (history.empty() || history.front().input.sequence != sequence)
+        return; // The input has been forgotten, so there is nothing to compare the server state to.
+
+    const float latency = kNet::Clock::SecondsSinceF(history.front().sendTime) * 1000.f;
+    ++stats.numAcks;
+    stats.latencySum += latency;
+    stats.maxLatency = std::max(stats.maxLatency, latency);
+
+    const float correction = serverPos.Distance(history.front().pos);
+    Physics::PhysicsWorld *world = rigidBody->GetPhysicsWorld();
+    btRigidBody *body = rigidBody->GetRigidBody();
+    if (correction < cMinCorrection || !world || !world->BulletWorld() || !body)
+    {
+        history.pop_front();
+        return;
+    }
+
+    PROFILE(ClientPrediction_Replay);
+    kNet::PolledTimer timer;
+
+    // Replay the acknowledged input and the newer ones on top of the server state. Each input is in effect from its
+    // sampling to the sampling of the next one, or to now for the newest one. The remembered states are replaced with
+    // the replayed ones, so that the next acknowledgements are compared to the corrected prediction.
+    const float timeStep = world->PhysicsUpdatePeriod();
+    const BodyReplay replay(world->BulletWorld(), body, motor->dampingForce.Get(), timeStep);
+    const kNet::tick_t now = kNet::Clock::Tick();
+    // If the inputs span more than cMaxReplaySteps, the oldest time is skipped by starting with a negative time.
+    double pendingTime = -std::max(0.0, kNet::Clock::TimespanToSecondsD(history.front().sendTime, now) - cMaxReplaySteps * timeStep);
+    float3 pos = serverPos;
+    float3 vel = serverVel;
+    for(size_t i = 0; i < history.size(); ++i)
+    {
+        HistoryEntry &entry = history[i];
+        entry.pos = pos;
+        entry.vel = vel;
+        const kNet::tick_t end = i + 1 < history.size() ? history[i + 1].sendTime : now;
+        // The time left over from the previous input carries over, as the physics steps do not align with the inputs.
+        pendingTime += kNet::Clock::TimespanToSecondsD(entry.sendTime, end);
+        for(; pendingTime >= timeStep; pendingTime -= timeStep)
+            replay.Step(entry.input, pos, vel);
+    }
+    const u32 numReplayed = (u32)history.size();
+    history.pop_front();
+
+    Transform t = placeable->transform.Get();
+    t.pos = pos;
+    placeable->transform.Set(t, AttributeChange::LocalOnly);
+    rigidBody->linearVelocity.Set(vel, AttributeChange::LocalOnly);
+
+    const float replayTime = timer.MSecsElapsed();
+    ++stats.numCorrections;
+    stats.correctionSum += correction;
+    stats.maxCorrection = std::max(stats.maxCorrection, correction);
+    stats.replayedInputs += numReplayed;
+    stats.replaySum += replayTime;
+    stats.maxReplay = std::max(stats.maxReplay, replayTime);
+}
+
+bool ClientPrediction::ReadInput(const char *data, size_t numBytes, entity_id_t &inputEntityId, Input &input)
+{
+    kNet::DataDeserializer dd(data, numBytes);
+    inputEntityId = dd.ReadVLE<kNet::VLE8_16_32>();
+    input.sequence = dd.Read<u32>();
+    input.relativeMoveForce = ReadFloat3(dd);
+    input.absoluteMoveForce = ReadFloat3(dd);
+    input.rotation = ReadFloat3(dd);
+    return input.sequence > lastSequence;
+}
+
+void ClientPrediction::ApplyInput(entity_id_t inputEntityId, const Input &input, EC_PhysicsMotor *motor, EC_Placeable *placeable, EC_RigidBody *rigidBody)
+{
+    PROFILE(ClientPrediction_ApplyInput);
+
+    entityId = inputEntityId;
+    lastSequence = input.sequence;
+
+    // The state acknowledged is the one the input is applied to, as the client remembers its state at the time of sampling the input.
+    ackPending = true;
+    ackPos = placeable->transform.Get().pos;
+    ackVel = rigidBody->linearVelocity.Get();
+
+    // The motor drives only the server simulation of the body, so its changes are not replicated to the clients.
+    if (!motor->relativeMoveForce.Get().Equals(input.relativeMoveForce))
+        motor->relativeMoveForce.Set(input.relativeMoveForce, AttributeChange::LocalOnly);
+    if (!motor->absoluteMoveForce.Get().Equals(input.absoluteMoveForce))
+        motor->absoluteMoveForce.Set(input.absoluteMoveForce, AttributeChange::LocalOnly);
+    if (!placeable->transform.Get().rot.Equals(input.rotation))
+        rigidBody->SetRotation(input.rotation);
+}
+
+bool ClientPrediction::SendAck(kNet::MessageConnection *connection)
+{
+    if (!ackPending)
+        return false;
+
+    kNet::DataSerializer ds(messageBuffer, sizeof(messageBuffer));
+    ds.AddVLE<kNet::VLE8_16_32>(entityId);
+    ds.Add<u32>(lastSequence);
+    AddFloat3(ds, ackPos);
+    AddFloat3(ds, ackVel);
+    QueueUnreliableMessage(connection, cInputAckMessage, ds);
+    ackPending = false;
+    return true;
+}
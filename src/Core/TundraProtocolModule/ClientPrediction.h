@@ -0,0 +1,140 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "TundraProtocolModuleFwd.h"
+
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+
+#include "kNet/Types.h"
+#include "Math/float3.h"
+
+#include <deque>
+
+class EC_Placeable;
+class EC_RigidBody;
+class EC_PhysicsMotor;
+
+/// Client-side prediction of the own avatar of one connection, and its reconciliation with the server.
+/** On the client, the avatar is simulated by the local physics right away from the input, instead of waiting for
+    the server to move it. The input is the state of the EC_PhysicsMotor of the avatar and the rotation of its
+    EC_Placeable. The client sends the input in InputCommand messages tagged with increasing sequence numbers,
+    whenever the input changes and on each network update tick, and remembers the predicted state of the avatar
+    at the time of each input.
+
+    On the server, the newest input received is applied to the avatar, and the state of the avatar at that moment
+    is sent back in an InputAck message on the next network update tick. The client compares the state to the one
+    it predicted for the same input. If they differ, the acknowledged input and all the newer ones are replayed on top
+    of the server state, each for the time it was in effect, and the avatar is moved to the result. The local physics
+    world cannot step a single body back in time, so the replay integrates the body on its own in physics update
+    periods, the same way Bullet and EC_PhysicsMotor do, and sweeps its collision shape against the world to slide
+    along the surfaces it hits. The other bodies are treated as static during the replay.
+
+    The predicted entity is the one the server assigns to the user with UserConnection::SetControlledEntity. It is
+    expected not to be parented, as the physics of parented bodies follows the parent.
+
+    The input is a state rather than an event, so only the newest input matters, and it is sent unreliably: a lost
+    input is replaced by the next one, at the latest on the next network update tick. */
+class TUNDRAPROTOCOL_MODULE_API ClientPrediction
+{
+public:
+    /// Input of the predicted avatar.
+    struct Input
+    {
+        Input() : sequence(0) {}
+
+        bool Equals(const Input &rhs) const;
+
+        u32 sequence;
+        float3 relativeMoveForce;
+        float3 absoluteMoveForce;
+        float3 rotation; ///< Euler rotation of the placeable, in degrees.
+    };
+
+    /// Running statistics of the prediction (client only).
+    struct Stats
+    {
+        Stats();
+
+        u32 numAcks; ///< Number of inputs acknowledged by the server.
+        double latencySum; ///< Sum of the times from sending an input to receiving its acknowledgement, in milliseconds.
+        float maxLatency;
+        u32 numCorrections; ///< Number of acknowledgements that corrected the predicted state.
+        double correctionSum; ///< Sum of the position errors of the corrections, in world units.
+        float maxCorrection;
+        u32 replayedInputs; ///< Number of inputs replayed by the corrections.
+        double replaySum; ///< Sum of the times spent in the replays, in milliseconds.
+        float maxReplay;
+    };
+
+    ClientPrediction();
+
+    /// Forgets the predicted entity, the inputs and the statistics.
+    void Reset();
+
+    /// Sets the predicted entity, and forgets the inputs of the previous one.
+    void SetEntity(entity_id_t entityId);
+
+    /// Returns the predicted entity, or 0 if none.
+    entity_id_t EntityId() const { return entityId; }
+
+    /// Returns whether an attribute is carried by the input commands, and thus not replicated as attribute changes for the predicted entity.
+    static bool IsPredictedAttribute(IComponent *comp, IAttribute *attr);
+
+    /// Samples the input of the predicted entity, and sends it if it changed or if forced to (client only).
+    /** @return Whether an input was sent. */
+    bool SendInput(kNet::MessageConnection *connection, EC_PhysicsMotor *motor, EC_Placeable *placeable, EC_RigidBody *rigidBody, bool force);
+
+    /// Corrects the predicted entity with the server state of a received InputAck message, by replaying the unacknowledged inputs (client only).
+    /** Throws kNet::NetException if the message is malformed. */
+    void HandleAck(const char *data, size_t numBytes, EC_PhysicsMotor *motor, EC_Placeable *placeable, EC_RigidBody *rigidBody);
+
+    /// Returns the statistics of the prediction (client only).
+    const Stats &GetStats() const { return stats; }
+
+    /// Reads the entity and the input of a received InputCommand message (server only).
+    /** Throws kNet::NetException if the message is malformed.
+        @return False if the input is not newer than the inputs already received, in which case it is to be ignored. */
+    bool ReadInput(const char *data, size_t numBytes, entity_id_t &inputEntityId, Input &input);
+
+    /// Applies an input read with ReadInput to the entity, and remembers the state for the acknowledgement (server only).
+    void ApplyInput(entity_id_t inputEntityId, const Input &input, EC_PhysicsMotor *motor, EC_Placeable *placeable, EC_RigidBody *rigidBody);
+
+    /// Sends the acknowledgement of the newest applied input, if not sent yet (server only).
+    /** @return Whether a message was sent. */
+    bool SendAck(kNet::MessageConnection *connection);
+
+    /// Maximum number of unacknowledged inputs remembered. When exceeded, the oldest ones are forgotten.
+    static const size_t cMaxHistory = 256;
+    /// Position errors smaller than this, in world units, are not corrected, as the client and server step their physics at different times.
+    static const float cMinCorrection;
+    /// Maximum number of physics steps simulated by one replay. If the unacknowledged inputs span a longer time, the oldest time is skipped.
+    static const int cMaxReplaySteps = 600;
+
+private:
+    /// An input sent, and the predicted state at the time it was sampled.
+    struct HistoryEntry
+    {
+        Input input;
+        kNet::tick_t sendTime;
+        float3 pos;
+        float3 vel;
+    };
+
+    entity_id_t entityId;
+    u32 lastSequence; ///< On the client the sequence number of the last input sent, on the server of the last input received.
+
+    // Client state.
+    std::deque<HistoryEntry> history; ///< Unacknowledged inputs, in the order of their sequence numbers.
+    u32 lastAckedSequence;
+    Stats stats;
+
+    // Server state.
+    bool ackPending;
+    float3 ackPos;
+    float3 ackVel;
+
+    char messageBuffer[64];
+};
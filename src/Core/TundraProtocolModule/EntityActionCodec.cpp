@@ -0,0 +1,353 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "EntityActionCodec.h"
+#include "TundraMessages.h"
+#include "UniqueIdGenerator.h"
+#include "Profiler.h"
+
+#include <kNet.h>
+
+#include <QByteArray>
+
+#include <cstring>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+/// Flag of the EntityActions message telling that the sender has started a new string table.
+const u8 cResetStringTable = 1;
+
+/// String reference codes. Larger codes are indices to the string table, offset by cFirstStringIndex.
+const u32 cLiteralString = 0; ///< The string follows, and is not added to the string table.
+const u32 cInternedString = 1; ///< The string follows, and is added to the end of the string table.
+const u32 cFirstStringIndex = 2;
+
+/// Maximum number of strings in the string table of one direction.
+const u32 cMaxStrings = 4096;
+/// Strings longer than this, in characters, are always sent as literals.
+const int cMaxInternedLength = 64;
+/// Maximum number of parameters remembered for interning them when they are sent again.
+const int cMaxSeenParameters = 1024;
+
+/// Integers are sent as zigzag encoded VLEs, which hold 30 bits, so their magnitude is limited.
+const s32 cMaxVleInt = 1 << 29;
+
+/// Vector parameters separated with spaces have this bit set in their component count.
+const u8 cSpaceSeparated = 0x80;
+
+enum ParameterType
+{
+    EmptyParameter = 0,
+    StringParameter,
+    IntParameter,
+    FloatParameter,
+    DoubleParameter,
+    VectorParameter
+};
+
+QString FloatToString(float value)
+{
+    return QString::number(value, 'g', 6);
+}
+
+QString DoubleToString(double value)
+{
+    return QString::number(value, 'g', 15);
+}
+
+bool ParseInt(const QString &str, s32 &value)
+{
+    bool ok = false;
+    value = str.toInt(&ok);
+    return ok && value > -cMaxVleInt && value < cMaxVleInt && QString::number(value) == str;
+}
+
+bool ParseFloat(const QString &str, float &value)
+{
+    bool ok = false;
+    value = str.toFloat(&ok);
+    return ok && FloatToString(value) == str;
+}
+
+bool ParseDouble(const QString &str, double &value)
+{
+    bool ok = false;
+    value = str.toDouble(&ok);
+    return ok && DoubleToString(value) == str;
+}
+
+/// Parses a vector of 2-4 floats separated by commas or spaces, which formats back to the exact original string.
+bool ParseVector(const QString &str, float *values, u8 &header)
+{
+    const QChar separators[] = { ',', ' ' };
+    for(int s = 0; s < 2; ++s)
+    {
+        if (!str.contains(separators[s]))
+            continue;
+        const QStringList parts = str.split(separators[s]);
+        if (parts.size() < 2 || parts.size() > 4)
+            return false;
+        for(int i = 0; i < parts.size(); ++i)
+            if (!ParseFloat(parts[i], values[i]))
+                return false;
+        header = (u8)(parts.size() | (s == 1 ? cSpaceSeparated : 0));
+        return true;
+    }
+    return false;
+}
+
+void CheckBytesLeft(kNet::DataDeserializer &ds, size_t numBytes)
+{
+    if (numBytes > ds.BitsLeft() / 8)
+        throw kNet::NetException("Malformed EntityActions message: size exceeds the message");
+}
+}
+
+EntityActionCodec::EntityActionCodec() :
+    enabled(false),
+    resetPending(false),
+    numPendingActions(0)
+{
+}
+
+void EntityActionCodec::Reset()
+{
+    enabled = false;
+    resetPending = false;
+    outgoingStrings.clear();
+    seenParameters.clear();
+    incomingStrings.clear();
+    pendingActions.clear();
+    numPendingActions = 0;
+}
+
+void EntityActionCodec::Enable()
+{
+    if (enabled)
+        return;
+    enabled = true;
+    resetPending = true;
+    outgoingStrings.clear();
+    seenParameters.clear();
+}
+
+void EntityActionCodec::AddAction(entity_id_t entityId, u8 executionType, const QString &name, const QStringList &parameters)
+{
+    PROFILE(EntityActionCodec_AddAction);
+
+    // Upper bound of the serialized size: VLEs take at most 4 bytes, and a UTF-16 code unit at most 3 bytes in UTF-8.
+    size_t maxBytes = 16 + name.size() * 3;
+    foreach(const QString &parameter, parameters)
+        maxBytes += 16 + parameter.size() * 3;
+    if (actionBuffer.size() < maxBytes)
+        actionBuffer.resize(maxBytes);
+
+    assert(entityId <= UniqueIdGenerator::LAST_REPLICATED_ID);
+    kNet::DataSerializer ds(&actionBuffer[0], actionBuffer.size());
+    ds.AddVLE<kNet::VLE8_16_32>(entityId);
+    ds.Add<u8>(executionType);
+    WriteString(ds, name, true);
+    ds.AddVLE<kNet::VLE8_16_32>(parameters.size());
+    foreach(const QString &parameter, parameters)
+        WriteParameter(ds, parameter);
+
+    pendingActions.insert(pendingActions.end(), &actionBuffer[0], &actionBuffer[0] + ds.BytesFilled());
+    ++numPendingActions;
+}
+
+bool EntityActionCodec::Flush(kNet::MessageConnection *connection)
+{
+    if (!enabled || (numPendingActions == 0 && !resetPending))
+        return false;
+    if (!connection)
+    {
+        // Without a connection the batch is lost, and the connection that replaces it resets the codec.
+        pendingActions.clear();
+        numPendingActions = 0;
+        return false;
+    }
+
+    PROFILE(EntityActionCodec_Flush);
+
+    messageBuffer.resize(pendingActions.size() + 8);
+    kNet::DataSerializer ds(&messageBuffer[0], messageBuffer.size());
+    ds.Add<u8>(resetPending ? cResetStringTable : 0);
+    ds.AddVLE<kNet::VLE8_16_32>(numPendingActions);
+    if (!pendingActions.empty())
+        ds.AddArray<u8>((const u8*)&pendingActions[0], pendingActions.size());
+
+    kNet::NetworkMessage *msg = connection->StartNewMessage(cEntityActionsMessage, ds.BytesFilled());
+    memcpy(msg->data, ds.GetData(), ds.BytesFilled());
+    msg->reliable = true;
+    msg->inOrder = true; // The string tables are built in the order of the messages.
+    msg->priority = 100; // Fixed priority as in those defined with xml
+    connection->EndAndQueueMessage(msg);
+
+    pendingActions.clear();
+    numPendingActions = 0;
+    resetPending = false;
+    return true;
+}
+
+void EntityActionCodec::ReadActions(const char *data, size_t numBytes, std::vector<Action> &actions)
+{
+    PROFILE(EntityActionCodec_ReadActions);
+
+    kNet::DataDeserializer ds(data, numBytes);
+    const u8 flags = ds.Read<u8>();
+    if ((flags & cResetStringTable) != 0)
+        incomingStrings.clear();
+
+    const u32 numActions = ds.ReadVLE<kNet::VLE8_16_32>();
+    CheckBytesLeft(ds, numActions); // Each action takes at least 4 bytes, this only bounds the allocation.
+    actions.reserve(actions.size() + numActions);
+    for(u32 i = 0; i < numActions; ++i)
+    {
+        Action action;
+        action.entityId = ds.ReadVLE<kNet::VLE8_16_32>();
+        action.executionType = ds.Read<u8>();
+        action.name = ReadString(ds);
+        const u32 numParameters = ds.ReadVLE<kNet::VLE8_16_32>();
+        CheckBytesLeft(ds, numParameters); // Each parameter takes at least 1 byte.
+        for(u32 j = 0; j < numParameters; ++j)
+            action.parameters << ReadParameter(ds);
+        actions.push_back(action);
+    }
+}
+
+void EntityActionCodec::WriteString(kNet::DataSerializer &ds, const QString &str, bool intern)
+{
+    QHash<QString, u32>::const_iterator iter = outgoingStrings.find(str);
+    if (iter != outgoingStrings.end())
+    {
+        ds.AddVLE<kNet::VLE8_16_32>(cFirstStringIndex + iter.value());
+        return;
+    }
+
+    const bool add = intern && (u32)outgoingStrings.size() < cMaxStrings && str.length() <= cMaxInternedLength;
+    ds.AddVLE<kNet::VLE8_16_32>(add ? cInternedString : cLiteralString);
+    const QByteArray utf8 = str.toUtf8();
+    ds.AddVLE<kNet::VLE8_16_32>(utf8.size());
+    if (utf8.size() > 0)
+        ds.AddArray<u8>((const u8*)utf8.constData(), utf8.size());
+    if (add)
+        outgoingStrings.insert(str, outgoingStrings.size());
+}
+
+QString EntityActionCodec::ReadString(kNet::DataDeserializer &ds)
+{
+    const u32 code = ds.ReadVLE<kNet::VLE8_16_32>();
+    if (code >= cFirstStringIndex)
+    {
+        const u32 index = code - cFirstStringIndex;
+        if (index >= incomingStrings.size())
+            throw kNet::NetException("Malformed EntityActions message: unknown string index");
+        return incomingStrings[index];
+    }
+
+    const u32 length = ds.ReadVLE<kNet::VLE8_16_32>();
+    CheckBytesLeft(ds, length);
+    QByteArray utf8(length, 0);
+    if (length > 0)
+        ds.ReadArray<u8>((u8*)utf8.data(), length);
+    const QString str = QString::fromUtf8(utf8.constData(), utf8.size());
+    if (code == cInternedString)
+    {
+        if (incomingStrings.size() >= cMaxStrings)
+            throw kNet::NetException("Malformed EntityActions message: string table is full");
+        incomingStrings.push_back(str);
+    }
+    return str;
+}
+
+void EntityActionCodec::WriteParameter(kNet::DataSerializer &ds, const QString &parameter)
+{
+    if (parameter.isEmpty())
+    {
+        ds.Add<u8>(EmptyParameter);
+        return;
+    }
+
+    s32 intValue;
+    float floatValue;
+    double doubleValue;
+    float vector[4];
+    u8 vectorHeader;
+    if (ParseInt(parameter, intValue))
+    {
+        ds.Add<u8>(IntParameter);
+        ds.AddVLE<kNet::VLE8_16_32>(((u32)intValue << 1) ^ (u32)(intValue >> 31));
+    }
+    else if (ParseFloat(parameter, floatValue))
+    {
+        ds.Add<u8>(FloatParameter);
+        ds.Add<float>(floatValue);
+    }
+    else if (ParseDouble(parameter, doubleValue))
+    {
+        ds.Add<u8>(DoubleParameter);
+        ds.Add<double>(doubleValue);
+    }
+    else if (ParseVector(parameter, vector, vectorHeader))
+    {
+        ds.Add<u8>(VectorParameter);
+        ds.Add<u8>(vectorHeader);
+        ds.AddArray<float>(vector, vectorHeader & ~cSpaceSeparated);
+    }
+    else
+    {
+        // Intern the parameters that are sent repeatedly. Parameters that change each time would only fill the table.
+        const bool intern = seenParameters.contains(parameter);
+        if (!intern)
+        {
+            if (seenParameters.size() >= cMaxSeenParameters)
+                seenParameters.clear();
+            seenParameters.insert(parameter);
+        }
+        ds.Add<u8>(StringParameter);
+        WriteString(ds, parameter, intern);
+    }
+}
+
+QString EntityActionCodec::ReadParameter(kNet::DataDeserializer &ds)
+{
+    const u8 type = ds.Read<u8>();
+    switch(type)
+    {
+    case EmptyParameter:
+        return QString();
+    case StringParameter:
+        return ReadString(ds);
+    case IntParameter:
+    {
+        const u32 zigzag = ds.ReadVLE<kNet::VLE8_16_32>();
+        return QString::number((s32)(zigzag >> 1) ^ -(s32)(zigzag & 1));
+    }
+    case FloatParameter:
+        return FloatToString(ds.Read<float>());
+    case DoubleParameter:
+        return DoubleToString(ds.Read<double>());
+    case VectorParameter:
+    {
+        const u8 header = ds.Read<u8>();
+        const int count = header & ~cSpaceSeparated;
+        if (count < 2 || count > 4)
+            throw kNet::NetException("Malformed EntityActions message: invalid vector parameter");
+        const QChar separator = ((header & cSpaceSeparated) != 0 ? ' ' : ',');
+        QString str;
+        for(int i = 0; i < count; ++i)
+        {
+            if (i > 0)
+                str += separator;
+            str += FloatToString(ds.Read<float>());
+        }
+        return str;
+    }
+    default:
+        throw kNet::NetException("Malformed EntityActions message: unknown parameter type");
+    }
+}
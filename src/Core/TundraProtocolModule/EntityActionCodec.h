@@ -0,0 +1,93 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "TundraProtocolModuleFwd.h"
+
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+
+#include <vector>
+
+/// Encodes and decodes the compact EntityActions message of one connection.
+/** The EntityActions message carries a batch of entity actions. Action names and repeated parameters are sent as
+    indices to a string table after their first use, and parameters that are numbers or vectors of numbers are sent
+    in binary. Each connection has its own string tables, one for each direction, which both ends build in the same
+    order from the messages, as the messages are sent reliably and in order.
+
+    A parameter is sent as a number only if formatting the number back gives the exact original string, so that
+    the receiver gets the same QStringList as with the legacy EntityAction message.
+
+    The message is used only between peers that both support it. The client asks for it with the
+    "compact-entity-actions" login property, and the server answers by sending an EntityActions message with the
+    reset flag. Until then, and with clients that do not ask for it, the legacy EntityAction message is used. */
+class TUNDRAPROTOCOL_MODULE_API EntityActionCodec
+{
+public:
+    /// An entity action in the batch.
+    struct Action
+    {
+        entity_id_t entityId;
+        u8 executionType;
+        QString name;
+        QStringList parameters;
+    };
+
+    EntityActionCodec();
+
+    /// Clears the string tables and the pending actions, and disables the compact message.
+    void Reset();
+
+    /// Enables the compact message for sending. The next message tells the receiver to clear its string table.
+    void Enable();
+
+    /// Returns whether actions are sent with the compact message.
+    bool IsEnabled() const { return enabled; }
+
+    /// Adds an action to the pending batch.
+    /** The entity ID must be a replicated ID, i.e. at most UniqueIdGenerator::LAST_REPLICATED_ID. */
+    void AddAction(entity_id_t entityId, u8 executionType, const QString &name, const QStringList &parameters);
+
+    /// Returns the size of the pending batch in bytes.
+    size_t PendingBytes() const { return pendingActions.size(); }
+
+    /// Sends the pending batch as one EntityActions message, if there are pending actions or the reset flag needs to be sent.
+    /** @return Whether a message was sent. */
+    bool Flush(kNet::MessageConnection *connection);
+
+    /// Reads the actions of a received EntityActions message.
+    /** Throws kNet::NetException if the message is malformed. */
+    void ReadActions(const char *data, size_t numBytes, std::vector<Action> &actions);
+
+    /// Maximum size of the pending batch before it is sent without waiting for the end of the frame.
+    static const size_t cMaxBatchBytes = 1024;
+
+private:
+    /// Writes a string as a reference to the outgoing string table, interning it if asked to.
+    void WriteString(kNet::DataSerializer &ds, const QString &str, bool intern);
+
+    /// Reads a string written by WriteString.
+    QString ReadString(kNet::DataDeserializer &ds);
+
+    /// Writes a parameter in the most compact form that reproduces it exactly.
+    void WriteParameter(kNet::DataSerializer &ds, const QString &parameter);
+
+    /// Reads a parameter written by WriteParameter.
+    QString ReadParameter(kNet::DataDeserializer &ds);
+
+    bool enabled;
+    bool resetPending; ///< Does the next message need to tell the receiver to clear its string table.
+    QHash<QString, u32> outgoingStrings; ///< Strings of the outgoing string table, and their indices.
+    QSet<QString> seenParameters; ///< Parameters sent once, interned when they are sent again.
+    std::vector<QString> incomingStrings; ///< Strings of the incoming string table, by index.
+    std::vector<char> pendingActions; ///< Serialized actions of the pending batch.
+    u32 numPendingActions;
+    std::vector<char> actionBuffer; ///< Buffer for serializing one action.
+    std::vector<char> messageBuffer; ///< Buffer for crafting the EntityActions message.
+};
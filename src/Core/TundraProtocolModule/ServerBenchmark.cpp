@@ -0,0 +1,797 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "ServerBenchmark.h"
+#include "TundraLogicModule.h"
+#include "KristalliProtocolModule.h"
+#include "Server.h"
+#include "TundraMessages.h"
+#include "MsgLogin.h"
+#include "MsgLoginReply.h"
+#include "MsgEntityAction.h"
+#include "UserConnection.h"
+
+#include "Framework.h"
+#include "Application.h"
+#include "FrameAPI.h"
+#include "SceneAPI.h"
+#include "EntityAction.h"
+#include "EC_Name.h"
+#include "EC_Placeable.h"
+#include "Transform.h"
+#include "CoreStringUtils.h"
+#include "Profiler.h"
+#include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
+
+#include <kNet.h>
+#include <kNet/UDPMessageConnection.h>
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef WIN32
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+const char * const cDefaultStages = "10,100,500";
+const double cDefaultWarmupSecs = 5.0;
+const double cDefaultDurationSecs = 30.0;
+/// Maximum number of clients that start connecting on one frame, so that the server is not flooded with handshakes.
+const int cMaxConnectsPerFrame = 10;
+/// Time after which a client that has not finished logging in is considered failed.
+const double cLoginTimeoutSecs = 60.0;
+/// Maximum time to wait for all the clients of a stage to log in, after which the stage runs with the clients it has.
+const double cMaxStageSetupSecs = 180.0;
+/// Maximum time to wait for the server to start.
+const double cMaxServerWaitSecs = 60.0;
+/// Radius of the circle the avatars walk, and the distance between the circles.
+const float cCircleRadius = 4.f;
+const float cCircleSpacing = 10.f;
+const int cCirclesPerRow = 32;
+/// Local IDs of the avatar components in the CreateEntity message.
+const component_id_t cPlaceableLocalId = 1;
+const component_id_t cNameLocalId = 2;
+const size_t cMessageBufferSize = 64 * 1024;
+const size_t cAttrBufferSize = 16 * 1024;
+
+/// Returns the memory used by the process in megabytes, or 0 if it can not be determined.
+double ProcessMemoryMB()
+{
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize / (1024.0 * 1024.0);
+    return 0.0;
+#elif defined(__APPLE__)
+    task_basic_info info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+        return info.resident_size / (1024.0 * 1024.0);
+    return 0.0;
+#else
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0.0;
+    unsigned long size = 0, resident = 0;
+    int numRead = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+    return numRead == 2 ? resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0) : 0.0;
+#endif
+}
+
+double ElapsedSecs(tick_t since)
+{
+    return (double)(GetCurrentClockTime() - since) / GetCurrentClockFreq();
+}
+
+/// Writes a component with its static attributes in the format of the CreateEntity message.
+void WriteComponent(kNet::DataSerializer &ds, IComponent *comp, component_id_t id, char *attrBuffer)
+{
+    ds.AddVLE<kNet::VLE8_16_32>(id);
+    ds.AddVLE<kNet::VLE8_16_32>(comp->TypeId());
+    ds.AddString(comp->Name().toStdString());
+
+    kNet::DataSerializer attrDs(attrBuffer, cAttrBufferSize);
+    const AttributeVector &attrs = comp->Attributes();
+    for(int i = 0; i < comp->NumStaticAttributes(); ++i)
+        attrs[i]->ToBinary(attrDs);
+    ds.AddVLE<kNet::VLE8_16_32>(attrDs.BytesFilled());
+    ds.AddArray<u8>((unsigned char*)attrBuffer, attrDs.BytesFilled());
+}
+
+/// Writes one changed attribute of a component in the format of the EditAttributes message.
+void WriteAttributeEdit(kNet::DataSerializer &ds, component_id_t id, IAttribute *attr, char *attrBuffer)
+{
+    kNet::DataSerializer attrDs(attrBuffer, cAttrBufferSize);
+    attrDs.Add<kNet::bit>(0); // Attribute indices follow, instead of a bitmask.
+    attrDs.Add<u8>(1);
+    attrDs.Add<u8>(attr->Index());
+    attr->ToBinary(attrDs);
+
+    ds.AddVLE<kNet::VLE8_16_32>(id);
+    ds.AddVLE<kNet::VLE8_16_32>(attrDs.BytesFilled());
+    ds.AddArray<u8>((unsigned char*)attrBuffer, attrDs.BytesFilled());
+}
+
+QString JsonString(const QString &str)
+{
+    QString escaped;
+    for(int i = 0; i < str.length(); ++i)
+    {
+        QChar c = str[i];
+        if (c == '"' || c == '\\')
+            escaped += QString("\\") + c;
+        else if (c.unicode() < 0x20)
+            escaped += QString("\\u%1").arg((int)c.unicode(), 4, 16, QChar('0'));
+        else
+            escaped += c;
+    }
+    return "\"" + escaped + "\"";
+}
+
+QString JsonNumber(double value)
+{
+    return QString::number(value, 'f', 3);
+}
+
+/// Returns the summary statistics of a series as a JSON object.
+QString JsonSummary(std::vector<double> values)
+{
+    if (values.empty())
+        return "{}";
+    double sum = 0.0;
+    for(size_t i = 0; i < values.size(); ++i)
+        sum += values[i];
+    std::sort(values.begin(), values.end());
+    // Nearest-rank percentiles.
+    const size_t n = values.size();
+    const double p50 = values[(n - 1) / 2];
+    const double p90 = values[std::min(n - 1, (size_t)ceil(n * 0.90) - 1)];
+    const double p99 = values[std::min(n - 1, (size_t)ceil(n * 0.99) - 1)];
+    return QString("{ \"mean\": %1, \"p50\": %2, \"p90\": %3, \"p99\": %4, \"min\": %5, \"max\": %6 }")
+        .arg(JsonNumber(sum / n)).arg(JsonNumber(p50)).arg(JsonNumber(p90)).arg(JsonNumber(p99))
+        .arg(JsonNumber(values.front())).arg(JsonNumber(values.back()));
+}
+}
+
+namespace TundraLogic
+{
+
+ServerBenchmark::ServerBenchmark(TundraLogicModule *owner_) :
+    owner(owner_),
+    framework(owner_->GetFramework()),
+    state(WaitingForServer),
+    currentStage(-1),
+    warmupSecs(cDefaultWarmupSecs),
+    durationSecs(cDefaultDurationSecs),
+    stateStartTime(GetCurrentClockTime()),
+    frameBenchmarkMs(0.0),
+    messageBuffer(cMessageBufferSize),
+    attrBuffer(cAttrBufferSize),
+    currentClient(0)
+{
+    QStringList output = framework->CommandLineParameters("--serverBenchmark");
+    outputFile = output.isEmpty() ? "serverbenchmark.json" : output.first();
+
+    QStringList stagesParam = framework->CommandLineParameters("--serverBenchmarkClients");
+    QStringList stages = (stagesParam.isEmpty() ? QString(cDefaultStages) : stagesParam.first()).split(',', QString::SkipEmptyParts);
+    foreach(const QString &stage, stages)
+    {
+        int numClients = stage.trimmed().toInt();
+        if (numClients > 0)
+            stageClients.push_back(numClients);
+        else
+            LogWarning("ServerBenchmark: Ignoring invalid client count \"" + stage + "\" in --serverBenchmarkClients.");
+    }
+    // The clients of a stage stay connected for the next, so the stages must grow.
+    std::sort(stageClients.begin(), stageClients.end());
+
+    QStringList warmup = framework->CommandLineParameters("--serverBenchmarkWarmup");
+    if (!warmup.isEmpty())
+        warmupSecs = std::max(0.0, warmup.first().toDouble());
+    QStringList duration = framework->CommandLineParameters("--serverBenchmarkDuration");
+    if (!duration.isEmpty())
+        durationSecs = std::max(1.0, duration.first().toDouble());
+
+    QStringList workloadParam = framework->CommandLineParameters("--serverBenchmarkWorkload");
+    if (!workloadParam.isEmpty())
+    {
+        workloadFile = workloadParam.first();
+        if (!LoadWorkload(workloadFile))
+        {
+            Finish(false);
+            return;
+        }
+    }
+    else
+    {
+        WorkloadItem move = { WorkloadItem::Move, 10.f, 3.f, QString(), 0 };
+        WorkloadItem edit = { WorkloadItem::Edit, 0.2f, 0.f, QString(), 0 };
+        WorkloadItem action = { WorkloadItem::Action, 1.f, 0.f, "BenchmarkAction", (u8)EntityAction::Server };
+        workload.push_back(move);
+        workload.push_back(edit);
+        workload.push_back(action);
+    }
+
+    if (stageClients.empty())
+    {
+        LogError("ServerBenchmark: No valid client counts given.");
+        Finish(false);
+        return;
+    }
+
+    connect(framework->Frame(), SIGNAL(Updated(float)), this, SLOT(OnFrameUpdated(float)));
+    connect(framework->Frame(), SIGNAL(FrameProcessed(float)), this, SLOT(OnFrameProcessed()));
+    LogInfo("ServerBenchmark: Waiting for the server to start.");
+}
+
+ServerBenchmark::~ServerBenchmark()
+{
+    for(size_t i = 0; i < clients.size(); ++i)
+        if (clients[i].connection)
+            clients[i].connection->Close(0);
+    clients.clear();
+}
+
+bool ServerBenchmark::LoadWorkload(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        LogError("ServerBenchmark: Failed to open workload file " + filename + ".");
+        return false;
+    }
+
+    QTextStream stream(&file);
+    int lineNumber = 0;
+    while(!stream.atEnd())
+    {
+        QString line = stream.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(' ', QString::SkipEmptyParts);
+        WorkloadItem item = { WorkloadItem::Move, 0.f, 3.f, QString(), (u8)EntityAction::Server };
+        bool ok = fields.size() >= 2;
+        if (ok)
+            item.rate = fields[1].toFloat(&ok);
+        ok = ok && item.rate > 0.f;
+        if (ok && fields[0] == "move")
+        {
+            item.kind = WorkloadItem::Move;
+            if (fields.size() >= 3)
+                item.speed = fields[2].toFloat(&ok);
+        }
+        else if (ok && fields[0] == "edit")
+            item.kind = WorkloadItem::Edit;
+        else if (ok && fields[0] == "action" && fields.size() >= 3)
+        {
+            item.kind = WorkloadItem::Action;
+            item.actionName = fields[2];
+            if (fields.size() >= 4)
+            {
+                if (fields[3] == "local")
+                    item.executionType = (u8)EntityAction::Local;
+                else if (fields[3] == "server")
+                    item.executionType = (u8)EntityAction::Server;
+                else if (fields[3] == "peers")
+                    item.executionType = (u8)EntityAction::Peers;
+                else
+                    ok = false;
+            }
+        }
+        else
+            ok = false;
+
+        if (ok)
+            workload.push_back(item);
+        else
+            LogWarning("ServerBenchmark: Ignoring invalid line " + QString::number(lineNumber) + " in " + filename + ": " + line);
+    }
+
+    if (workload.empty())
+    {
+        LogError("ServerBenchmark: Workload file " + filename + " contains no valid items.");
+        return false;
+    }
+    return true;
+}
+
+bool ServerBenchmark::Setup()
+{
+    placeablePrototype = framework->Scene()->CreateComponent<EC_Placeable>(0);
+    namePrototype = framework->Scene()->CreateComponent<EC_Name>(0);
+    if (!placeablePrototype || !namePrototype)
+    {
+        LogError("ServerBenchmark: EC_Placeable and EC_Name must be available to create the avatars.");
+        return false;
+    }
+    return true;
+}
+
+void ServerBenchmark::OnFrameUpdated(float frameTime)
+{
+    PROFILE(ServerBenchmark_Update);
+    const tick_t tickStartTime = GetCurrentClockTime();
+
+    switch(state)
+    {
+    case WaitingForServer:
+        if (owner->GetServer() && owner->GetServer()->IsRunning())
+        {
+            if (!Setup())
+            {
+                Finish(false);
+                return;
+            }
+            StartStage();
+        }
+        else if (ElapsedSecs(stateStartTime) > cMaxServerWaitSecs)
+        {
+            LogError("ServerBenchmark: The server did not start. Use --server to start it.");
+            Finish(false);
+            return;
+        }
+        break;
+    case Connecting:
+    {
+        const int target = stageClients[currentStage];
+        for(int i = 0; i < cMaxConnectsPerFrame && (int)clients.size() < target; ++i)
+            ConnectClient();
+
+        int numPending = 0;
+        for(size_t i = 0; i < clients.size(); ++i)
+            if (clients[i].state != SimulatedClient::ClientRunning && clients[i].state != SimulatedClient::ClientFailed)
+                ++numPending;
+        const bool setupTimedOut = ElapsedSecs(stateStartTime) > cMaxStageSetupSecs;
+        if (((int)clients.size() >= target && numPending == 0) || setupTimedOut)
+        {
+            if (setupTimedOut)
+                LogWarning("ServerBenchmark: Not all clients logged in within " + QString::number(cMaxStageSetupSecs) + " seconds, starting the stage anyway.");
+            LogInfo("ServerBenchmark: " + QString::number(clients.size()) + " clients connected, warming up.");
+            state = WarmingUp;
+            stateStartTime = GetCurrentClockTime();
+        }
+        break;
+    }
+    case WarmingUp:
+        if (ElapsedSecs(stateStartTime) >= warmupSecs)
+            StartRecording();
+        break;
+    case Recording:
+        if (ElapsedSecs(stateStartTime) >= durationSecs)
+        {
+            EndRecording();
+            StartStage();
+            if (state == Finished)
+                return;
+        }
+        break;
+    case Finished:
+        return;
+    }
+
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        SimulatedClient &client = clients[i];
+        if (!client.connection)
+            continue;
+        // Process() calls HandleMessage for each received message.
+        currentClient = &client;
+        client.connection->Process();
+        currentClient = 0;
+        UpdateClient(client, frameTime);
+    }
+
+    frameBenchmarkMs += (GetCurrentClockTime() - tickStartTime) * 1000.0 / GetCurrentClockFreq();
+}
+
+void ServerBenchmark::OnFrameProcessed()
+{
+    // Updated() is emitted once per fixed tick, possibly several times or not at all per frame, so the frame is
+    // recorded only here, once its phase times are known.
+    if (state == Recording)
+        RecordFrame();
+    frameBenchmarkMs = 0.0;
+}
+
+void ServerBenchmark::ConnectClient()
+{
+    Server *server = owner->GetServer().get();
+    kNet::SocketTransportLayer transport = kNet::StringToSocketTransportLayer(server->Protocol().toStdString().c_str());
+
+    SimulatedClient client;
+    client.state = SimulatedClient::ClientConnecting;
+    client.connectTime = GetCurrentClockTime();
+    client.loginMs = 0.0;
+    client.userId = 0;
+    client.avatarId = 0;
+    client.placeableId = 0;
+    client.nameId = 0;
+    const int index = (int)clients.size();
+    client.center = float3((index % cCirclesPerRow) * cCircleSpacing, 0.f, (index / cCirclesPerRow) * cCircleSpacing);
+    client.angle = 0.f;
+    client.accumulators.resize(workload.size(), 0.f);
+    // Spread the workload of the clients evenly over time.
+    for(size_t i = 0; i < workload.size(); ++i)
+        client.accumulators[i] = fmod(index * 0.618034f, 1.f) / workload[i].rate;
+    client.numEdits = 0;
+    client.bytesIn = client.bytesOut = client.messagesIn = client.messagesOut = 0;
+
+    client.connection = network.Connect("127.0.0.1", (unsigned short)server->Port(), transport, this);
+    if (!client.connection)
+    {
+        LogWarning("ServerBenchmark: Client " + QString::number(index) + " failed to connect.");
+        client.state = SimulatedClient::ClientFailed;
+    }
+    else if (transport == kNet::SocketOverUDP)
+        dynamic_cast<kNet::UDPMessageConnection*>(client.connection.ptr())->SetDatagramSendRate(500);
+    else if (client.connection->GetSocket())
+        client.connection->GetSocket()->SetNaglesAlgorithmEnabled(false);
+
+    clients.push_back(client);
+}
+
+void ServerBenchmark::UpdateClient(SimulatedClient &client, float frameTime)
+{
+    if (client.state == SimulatedClient::ClientFailed)
+        return;
+
+    const int index = (int)(&client - &clients[0]);
+    kNet::ConnectionState connectionState = client.connection->GetConnectionState();
+    if (connectionState == kNet::ConnectionClosed || connectionState == kNet::ConnectionDisconnecting ||
+        (client.state != SimulatedClient::ClientRunning && ElapsedSecs(client.connectTime) > cLoginTimeoutSecs))
+    {
+        LogWarning("ServerBenchmark: Client " + QString::number(index) + (connectionState == kNet::ConnectionClosed ||
+            connectionState == kNet::ConnectionDisconnecting ? " was disconnected." : " timed out while logging in."));
+        client.state = SimulatedClient::ClientFailed;
+        client.connection->Close(0);
+        return;
+    }
+
+    switch(client.state)
+    {
+    case SimulatedClient::ClientConnecting:
+        if (connectionState == kNet::ConnectionOK)
+            SendLogin(client, index);
+        break;
+    case SimulatedClient::ClientRunning:
+        if (state != WarmingUp && state != Recording)
+            break;
+        for(size_t i = 0; i < workload.size(); ++i)
+        {
+            const float interval = 1.f / workload[i].rate;
+            client.accumulators[i] += frameTime;
+            if (client.accumulators[i] < interval)
+                continue;
+            // Run at most once per frame. If the frames are longer than the interval, the rate drops rather than sending bursts.
+            client.accumulators[i] = std::min(client.accumulators[i] - interval, interval);
+            RunWorkloadItem(client, workload[i], interval);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ServerBenchmark::SendLogin(SimulatedClient &client, int index)
+{
+    QString loginXml = "<login><username value=\"benchmark" + QString::number(index) + "\"/><password value=\"\"/></login>";
+    MsgLogin msg;
+    msg.loginData = StringToBuffer(loginXml.toStdString());
+    client.connection->Send(msg);
+    client.bytesOut += msg.Size();
+    ++client.messagesOut;
+    client.state = SimulatedClient::ClientLoggingIn;
+}
+
+void ServerBenchmark::SendCreateAvatar(SimulatedClient &client, int index)
+{
+    Transform transform;
+    transform.SetPos(client.center + float3(cCircleRadius, 0.f, 0.f));
+    placeablePrototype->transform.Set(transform, AttributeChange::Disconnected);
+    namePrototype->name.Set("benchmark" + QString::number(index), AttributeChange::Disconnected);
+    namePrototype->description.Set("", AttributeChange::Disconnected);
+
+    kNet::DataSerializer ds(&messageBuffer[0], messageBuffer.size());
+    ds.AddVLE<kNet::VLE8_16_32>(0); // Scene ID
+    ds.AddVLE<kNet::VLE8_16_32>(index + 1); // The server assigns the real entity ID.
+    ds.Add<u8>(1); // Temporary
+    ds.AddVLE<kNet::VLE8_16_32>(2);
+    WriteComponent(ds, placeablePrototype.get(), cPlaceableLocalId, &attrBuffer[0]);
+    WriteComponent(ds, namePrototype.get(), cNameLocalId, &attrBuffer[0]);
+    QueueMessage(client, cCreateEntityMessage, ds);
+    client.state = SimulatedClient::ClientCreatingAvatar;
+}
+
+void ServerBenchmark::RunWorkloadItem(SimulatedClient &client, const WorkloadItem &item, float elapsed)
+{
+    switch(item.kind)
+    {
+    case WorkloadItem::Move:
+    {
+        client.angle = fmod(client.angle + item.speed * elapsed / cCircleRadius, 2.f * pi);
+        Transform transform;
+        transform.SetPos(client.center + float3(cos(client.angle), 0.f, sin(client.angle)) * cCircleRadius);
+        transform.SetRotation(0.f, RadToDeg(-client.angle), 0.f);
+        placeablePrototype->transform.Set(transform, AttributeChange::Disconnected);
+
+        kNet::DataSerializer ds(&messageBuffer[0], messageBuffer.size());
+        ds.AddVLE<kNet::VLE8_16_32>(0); // Scene ID
+        ds.AddVLE<kNet::VLE8_16_32>(client.avatarId);
+        WriteAttributeEdit(ds, client.placeableId, &placeablePrototype->transform, &attrBuffer[0]);
+        QueueMessage(client, cEditAttributesMessage, ds);
+        break;
+    }
+    case WorkloadItem::Edit:
+    {
+        namePrototype->description.Set("edit " + QString::number(++client.numEdits), AttributeChange::Disconnected);
+
+        kNet::DataSerializer ds(&messageBuffer[0], messageBuffer.size());
+        ds.AddVLE<kNet::VLE8_16_32>(0); // Scene ID
+        ds.AddVLE<kNet::VLE8_16_32>(client.avatarId);
+        WriteAttributeEdit(ds, client.nameId, &namePrototype->description, &attrBuffer[0]);
+        QueueMessage(client, cEditAttributesMessage, ds);
+        break;
+    }
+    case WorkloadItem::Action:
+    {
+        MsgEntityAction msg;
+        msg.entityId = client.avatarId;
+        msg.name = StringToBuffer(item.actionName.toStdString());
+        msg.executionType = item.executionType;
+        client.connection->Send(msg);
+        client.bytesOut += msg.Size();
+        ++client.messagesOut;
+        break;
+    }
+    }
+}
+
+void ServerBenchmark::QueueMessage(SimulatedClient &client, kNet::message_id_t id, const kNet::DataSerializer &ds)
+{
+    kNet::NetworkMessage *msg = client.connection->StartNewMessage(id, ds.BytesFilled());
+    memcpy(msg->data, ds.GetData(), ds.BytesFilled());
+    msg->reliable = true;
+    msg->inOrder = true;
+    msg->priority = 100;
+    client.connection->EndAndQueueMessage(msg);
+    client.bytesOut += ds.BytesFilled();
+    ++client.messagesOut;
+}
+
+void ServerBenchmark::HandleMessage(kNet::MessageConnection *source, kNet::packet_id_t /*packetId*/, kNet::message_id_t messageId, const char *data, size_t numBytes)
+{
+    SimulatedClient *client = currentClient;
+    if (!client || client->connection.ptr() != source)
+        return;
+
+    client->bytesIn += numBytes;
+    ++client->messagesIn;
+
+    try
+    {
+        if (messageId == MsgLoginReply::messageID && client->state == SimulatedClient::ClientLoggingIn)
+        {
+            MsgLoginReply msg(data, numBytes);
+            if (msg.success)
+            {
+                client->userId = msg.userID;
+                SendCreateAvatar(*client, (int)(client - &clients[0]));
+            }
+            else
+            {
+                LogWarning("ServerBenchmark: The server refused the login of client " + QString::number(client - &clients[0]) + ".");
+                client->state = SimulatedClient::ClientFailed;
+            }
+        }
+        else if (messageId == cCreateEntityReplyMessage && client->state == SimulatedClient::ClientCreatingAvatar)
+        {
+            kNet::DataDeserializer ds(data, numBytes);
+            ds.ReadVLE<kNet::VLE8_16_32>(); // Scene ID
+            ds.ReadVLE<kNet::VLE8_16_32>(); // Our entity ID
+            client->avatarId = ds.ReadVLE<kNet::VLE8_16_32>();
+            uint numComponents = ds.ReadVLE<kNet::VLE8_16_32>();
+            for(uint i = 0; i < numComponents; ++i)
+            {
+                component_id_t localId = ds.ReadVLE<kNet::VLE8_16_32>();
+                component_id_t serverId = ds.ReadVLE<kNet::VLE8_16_32>();
+                if (localId == cPlaceableLocalId)
+                    client->placeableId = serverId;
+                else if (localId == cNameLocalId)
+                    client->nameId = serverId;
+            }
+            client->state = SimulatedClient::ClientRunning;
+            client->loginMs = ElapsedSecs(client->connectTime) * 1000.0;
+            if (!results.empty())
+                results.back().loginMs.push_back(client->loginMs);
+        }
+    }
+    catch(kNet::NetException &e)
+    {
+        LogWarning("ServerBenchmark: Failed to deserialize message " + QString::number(messageId) + ": " + e.what());
+        client->state = SimulatedClient::ClientFailed;
+    }
+}
+
+void ServerBenchmark::StartStage()
+{
+    ++currentStage;
+    if (currentStage >= (int)stageClients.size())
+    {
+        Finish(true);
+        return;
+    }
+
+    StageResult result;
+    result.targetClients = stageClients[currentStage];
+    result.runningClients = result.failedClients = 0;
+    result.durationSecs = 0.0;
+    result.bytesIn = result.bytesOut = result.messagesIn = result.messagesOut = 0;
+    result.memoryStartMB = result.memoryEndMB = result.memoryPeakMB = 0.0;
+    results.push_back(result);
+
+    state = Connecting;
+    stateStartTime = GetCurrentClockTime();
+    LogInfo("ServerBenchmark: Starting stage " + QString::number(currentStage + 1) + "/" + QString::number(stageClients.size()) +
+        " with " + QString::number(result.targetClients) + " clients.");
+}
+
+void ServerBenchmark::StartRecording()
+{
+    for(size_t i = 0; i < clients.size(); ++i)
+        clients[i].bytesIn = clients[i].bytesOut = clients[i].messagesIn = clients[i].messagesOut = 0;
+
+    StageResult &result = results.back();
+    result.memoryStartMB = result.memoryPeakMB = ProcessMemoryMB();
+    state = Recording;
+    stateStartTime = GetCurrentClockTime();
+    LogInfo("ServerBenchmark: Recording for " + QString::number(durationSecs) + " seconds.");
+}
+
+void ServerBenchmark::RecordFrame()
+{
+    StageResult &result = results.back();
+    result.tickMs.push_back(std::max(0.0, framework->Frame()->PhaseTime("frame") - frameBenchmarkMs));
+
+    size_t numConnections = 0, totalOutbound = 0, maxOutbound = 0, maxInbound = 0;
+    UserConnectionList &users = owner->GetKristalliModule()->GetUserConnections();
+    for(UserConnectionList::const_iterator iter = users.begin(); iter != users.end(); ++iter)
+    {
+        kNet::MessageConnection *connection = (*iter)->connection.ptr();
+        if (!connection)
+            continue;
+        const size_t outbound = connection->NumOutboundMessagesPending();
+        totalOutbound += outbound;
+        maxOutbound = std::max(maxOutbound, outbound);
+        maxInbound = std::max(maxInbound, connection->NumInboundMessagesPending());
+        ++numConnections;
+    }
+    result.outboundQueueDepth.push_back(numConnections ? (double)totalOutbound / numConnections : 0.0);
+    result.maxOutboundQueueDepth.push_back((double)maxOutbound);
+    result.inboundQueueDepth.push_back((double)maxInbound);
+
+    result.memoryPeakMB = std::max(result.memoryPeakMB, ProcessMemoryMB());
+}
+
+void ServerBenchmark::EndRecording()
+{
+    StageResult &result = results.back();
+    result.durationSecs = ElapsedSecs(stateStartTime);
+    result.memoryEndMB = ProcessMemoryMB();
+    result.memoryPeakMB = std::max(result.memoryPeakMB, result.memoryEndMB);
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        const SimulatedClient &client = clients[i];
+        if (client.state == SimulatedClient::ClientRunning)
+            ++result.runningClients;
+        else if (client.state == SimulatedClient::ClientFailed)
+            ++result.failedClients;
+        result.bytesIn += client.bytesIn;
+        result.bytesOut += client.bytesOut;
+        result.messagesIn += client.messagesIn;
+        result.messagesOut += client.messagesOut;
+    }
+    LogInfo("ServerBenchmark: Stage with " + QString::number(result.targetClients) + " clients done, " +
+        QString::number(result.runningClients) + " running, " + QString::number(result.failedClients) + " failed.");
+}
+
+void ServerBenchmark::WriteResults()
+{
+    QStringList workloadLines;
+    for(size_t i = 0; i < workload.size(); ++i)
+    {
+        const WorkloadItem &item = workload[i];
+        QString kind = item.kind == WorkloadItem::Move ? "move" : (item.kind == WorkloadItem::Edit ? "edit" : "action");
+        workloadLines << "    { \"kind\": \"" + kind + "\", \"rate\": " + JsonNumber(item.rate) +
+            (item.kind == WorkloadItem::Move ? ", \"speed\": " + JsonNumber(item.speed) : QString()) +
+            (item.kind == WorkloadItem::Action ? ", \"name\": " + JsonString(item.actionName) + ", \"executionType\": " + QString::number(item.executionType) : QString()) + " }";
+    }
+
+    QStringList stageLines;
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const StageResult &r = results[i];
+        if (r.durationSecs <= 0.0)
+            continue; // The stage did not get to record.
+        const double clientSecs = std::max(1, r.runningClients) * r.durationSecs;
+        QStringList lines;
+        lines << "    {";
+        lines << "      \"clients\": " + QString::number(r.targetClients) + ",";
+        lines << "      \"runningClients\": " + QString::number(r.runningClients) + ",";
+        lines << "      \"failedClients\": " + QString::number(r.failedClients) + ",";
+        lines << "      \"durationSecs\": " + JsonNumber(r.durationSecs) + ",";
+        lines << "      \"frames\": " + QString::number(r.tickMs.size()) + ",";
+        lines << "      \"tickTimeMs\": " + JsonSummary(r.tickMs) + ",";
+        lines << "      \"bytesInPerClientPerSec\": " + JsonNumber(r.bytesIn / clientSecs) + ",";
+        lines << "      \"bytesOutPerClientPerSec\": " + JsonNumber(r.bytesOut / clientSecs) + ",";
+        lines << "      \"messagesInPerClientPerSec\": " + JsonNumber(r.messagesIn / clientSecs) + ",";
+        lines << "      \"messagesOutPerClientPerSec\": " + JsonNumber(r.messagesOut / clientSecs) + ",";
+        lines << "      \"outboundQueueDepth\": " + JsonSummary(r.outboundQueueDepth) + ",";
+        lines << "      \"maxOutboundQueueDepth\": " + JsonSummary(r.maxOutboundQueueDepth) + ",";
+        lines << "      \"maxInboundQueueDepth\": " + JsonSummary(r.inboundQueueDepth) + ",";
+        lines << "      \"loginTimeMs\": " + JsonSummary(r.loginMs) + ",";
+        lines << "      \"memoryMB\": { \"start\": " + JsonNumber(r.memoryStartMB) + ", \"end\": " + JsonNumber(r.memoryEndMB) +
+            ", \"peak\": " + JsonNumber(r.memoryPeakMB) + " }";
+        lines << "    }";
+        stageLines << lines.join("\n");
+    }
+
+    Server *server = owner->GetServer().get();
+    QStringList lines;
+    lines << "{";
+    lines << "  \"application\": " + JsonString(Application::FullIdentifier()) + ",";
+    lines << "  \"protocol\": " + JsonString(server ? server->Protocol() : QString()) + ",";
+    lines << "  \"sceneFiles\": " + JsonString(framework->CommandLineParameters("--file").join(";")) + ",";
+    lines << "  \"workloadFile\": " + JsonString(workloadFile) + ",";
+    lines << "  \"warmupSecs\": " + JsonNumber(warmupSecs) + ",";
+    lines << "  \"workload\": [";
+    lines << workloadLines.join(",\n");
+    lines << "  ],";
+    lines << "  \"stages\": [";
+    lines << stageLines.join(",\n");
+    lines << "  ]";
+    lines << "}";
+
+    QFile file(outputFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        LogError("ServerBenchmark: Failed to open " + outputFile + " for writing.");
+        return;
+    }
+    QTextStream stream(&file);
+    stream << lines.join("\n") << "\n";
+    LogInfo("ServerBenchmark: Wrote results of " + QString::number(stageLines.size()) + " stages to " + outputFile + ".");
+}
+
+void ServerBenchmark::Finish(bool writeResults)
+{
+    state = Finished;
+    disconnect(framework->Frame(), SIGNAL(Updated(float)), this, SLOT(OnFrameUpdated(float)));
+    disconnect(framework->Frame(), SIGNAL(FrameProcessed(float)), this, SLOT(OnFrameProcessed()));
+    for(size_t i = 0; i < clients.size(); ++i)
+        if (clients[i].connection && clients[i].state != SimulatedClient::ClientFailed)
+            clients[i].connection->Disconnect(0);
+    if (writeResults)
+        WriteResults();
+    framework->Exit();
+}
+
+}
@@ -0,0 +1,219 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "TundraProtocolModuleFwd.h"
+#include "SceneFwd.h"
+#include "CoreTypes.h"
+#include "HighPerfClock.h"
+#include "Math/float3.h"
+
+#include <kNet/IMessageHandler.h>
+#include <kNet/Network.h>
+
+#include <QObject>
+#include <QString>
+
+#include <vector>
+
+class Framework;
+class EC_Placeable;
+class EC_Name;
+
+namespace kNet { class DataSerializer; }
+
+namespace TundraLogic
+{
+
+/// Measures how the server scales with connected users by connecting simulated clients to it in-process.
+/** Enabled with --serverBenchmark <output.json> on a server. After the server has started, the benchmark connects simulated
+    clients to it over the loopback interface, using the server's port and protocol. Each client speaks the real protocol:
+    it logs in, creates a temporary avatar entity with EC_Name and EC_Placeable, and then runs the workload while
+    processing everything the server replicates to it.
+
+    The benchmark runs in stages, one for each client count given with --serverBenchmarkClients (default "10,100,500").
+    At each stage, more clients are connected until the count is reached, the workload runs for --serverBenchmarkWarmup seconds
+    (default 5), and then the measurements are recorded for --serverBenchmarkDuration seconds (default 30). When all the stages
+    have run, the results are written and the application exits.
+
+    The workload is read from the file given with --serverBenchmarkWorkload. Each non-empty line that does not start with '#' is
+    "<kind> <rate> [arguments]", where rate is times per second per client, and kind is one of:
+    - move [speed]: sends the avatar transform. The avatar walks in a circle at speed units per second, default 3.
+    - edit: changes the description attribute of the avatar's EC_Name.
+    - action <name> [local|server|peers]: sends an EntityAction to the avatar, by default executed on the server.
+    Without a workload file, the clients move at 10 Hz, edit once in 5 seconds and send an action once a second.
+
+    The following are recorded for each stage:
+    - Server tick time: the frame time of the server, minus the time spent in the simulated clients, as percentiles.
+      One sample is recorded per frame, regardless of the number of fixed simulation ticks the frame runs.
+    - Bytes and messages per client per second, in both directions, as seen by the simulated clients.
+    - Message queue depths: the number of outbound and inbound messages pending in the server's user connections.
+    - Memory usage of the process.
+    - Login time: the time from connecting to the avatar creation being acknowledged.
+
+    The kNet worker threads of the simulated clients run in the same process as the server, so the results include their
+    contention for CPU time. */
+class TUNDRAPROTOCOL_MODULE_API ServerBenchmark : public QObject, public kNet::IMessageHandler
+{
+    Q_OBJECT
+
+public:
+    ServerBenchmark(TundraLogicModule *owner);
+    ~ServerBenchmark();
+
+    /// Invoked by kNet for each message received by a simulated client.
+    void HandleMessage(kNet::MessageConnection *source, kNet::packet_id_t packetId, kNet::message_id_t messageId, const char *data, size_t numBytes);
+
+private slots:
+    /// Advances the benchmark by one simulation tick.
+    void OnFrameUpdated(float frameTime);
+
+    /// Records the measurements of the frame that just ended, if recording.
+    void OnFrameProcessed();
+
+private:
+    enum State
+    {
+        WaitingForServer,
+        Connecting,
+        WarmingUp,
+        Recording,
+        Finished
+    };
+
+    /// One entry of the workload file.
+    struct WorkloadItem
+    {
+        enum Kind
+        {
+            Move,
+            Edit,
+            Action
+        };
+        Kind kind;
+        float rate; ///< Times per second per client.
+        float speed; ///< Walking speed for Move.
+        QString actionName; ///< Name of the EntityAction for Action.
+        u8 executionType; ///< EntityAction::ExecType for Action.
+    };
+
+    /// State of one simulated client.
+    struct SimulatedClient
+    {
+        enum ClientState
+        {
+            ClientConnecting,
+            ClientLoggingIn,
+            ClientCreatingAvatar,
+            ClientRunning,
+            ClientFailed
+        };
+
+        Ptr(kNet::MessageConnection) connection;
+        ClientState state;
+        tick_t connectTime;
+        double loginMs; ///< Time from connecting to the avatar being acknowledged.
+        u32 userId;
+        entity_id_t avatarId; ///< The server's ID of the avatar entity.
+        component_id_t placeableId;
+        component_id_t nameId;
+        float3 center; ///< Center of the circle the avatar walks.
+        float angle;
+        std::vector<float> accumulators; ///< Elapsed time towards the next run of each workload item.
+        uint numEdits;
+        u64 bytesIn;
+        u64 bytesOut;
+        u64 messagesIn;
+        u64 messagesOut;
+    };
+
+    /// Measurements of one stage.
+    struct StageResult
+    {
+        int targetClients;
+        int runningClients;
+        int failedClients;
+        double durationSecs;
+        u64 bytesIn;
+        u64 bytesOut;
+        u64 messagesIn;
+        u64 messagesOut;
+        std::vector<double> tickMs;
+        std::vector<double> outboundQueueDepth; ///< Average over the user connections, per frame.
+        std::vector<double> maxOutboundQueueDepth; ///< Maximum over the user connections, per frame.
+        std::vector<double> inboundQueueDepth;
+        std::vector<double> loginMs;
+        double memoryStartMB;
+        double memoryEndMB;
+        double memoryPeakMB;
+    };
+
+    /// Reads the workload file. Returns false if the file could not be read or contained no valid items.
+    bool LoadWorkload(const QString &filename);
+
+    /// Creates the prototype components used to serialize the avatars. Returns false if the component types are not available.
+    bool Setup();
+
+    /// Connects a new simulated client to the server.
+    void ConnectClient();
+
+    /// Advances the login of a client, and runs the workload if it is running.
+    void UpdateClient(SimulatedClient &client, float frameTime);
+
+    /// Sends the login message.
+    void SendLogin(SimulatedClient &client, int index);
+
+    /// Sends the creation of the avatar entity.
+    void SendCreateAvatar(SimulatedClient &client, int index);
+
+    /// Runs one workload item for a running client.
+    void RunWorkloadItem(SimulatedClient &client, const WorkloadItem &item, float elapsed);
+
+    /// Queues a serialized message to the client's connection.
+    void QueueMessage(SimulatedClient &client, kNet::message_id_t id, const kNet::DataSerializer &ds);
+
+    /// Starts the next stage, or finishes if all the stages have run.
+    void StartStage();
+
+    /// Starts recording the current stage.
+    void StartRecording();
+
+    /// Records the measurements of the current frame.
+    void RecordFrame();
+
+    /// Ends the recording of the current stage.
+    void EndRecording();
+
+    /// Writes the results to the output file.
+    void WriteResults();
+
+    /// Stops the benchmark, optionally writing the results, and exits the application.
+    void Finish(bool writeResults);
+
+    TundraLogicModule *owner;
+    Framework *framework;
+    State state;
+    QString outputFile;
+    QString workloadFile;
+    std::vector<int> stageClients; ///< Number of clients in each stage.
+    int currentStage;
+    double warmupSecs;
+    double durationSecs;
+    std::vector<WorkloadItem> workload;
+    tick_t stateStartTime;
+    double frameBenchmarkMs; ///< Time spent in the simulated clients during the ticks of the current frame.
+
+    boost::shared_ptr<EC_Placeable> placeablePrototype;
+    boost::shared_ptr<EC_Name> namePrototype;
+    std::vector<char> messageBuffer;
+    std::vector<char> attrBuffer;
+
+    kNet::Network network; ///< Network of the simulated clients. Must be destroyed after the connections.
+    std::vector<SimulatedClient> clients;
+    SimulatedClient *currentClient; ///< Client whose connection is being processed, and which receives the messages.
+
+    std::vector<StageResult> results;
+};
+
+}
@@ -10,6 +10,8 @@
 #include "Server.h"
 #include "TundraMessages.h"
 #include "MsgEntityAction.h"
+#include "EntityActionCodec.h"
+#include "UserConnection.h"
 
 #include "Scene.h"
 #include "Entity.h"
@@ -22,6 +24,7 @@
 #include "Profiler.h"
 #include "EC_Placeable.h"
 #include "EC_RigidBody.h"
+#include "EC_PhysicsMotor.h"
 #include "SceneAPI.h"
 
 #include <kNet.h>
@@ -35,6 +38,21 @@
 // This variable is used for the interpolation stop check
 kNet::MessageConnection* currentSender = 0;
 
+namespace
+{
+
+/// Keeps a bulk creation of the scene open for its lifetime, so that it is closed also when an exception is thrown.
+struct BulkCreationScope
+{
+    BulkCreationScope(Scene *scene_, AttributeChange::Type change_) : scene(scene_), change(change_) { scene->BeginBulkCreation(); }
+    ~BulkCreationScope() { scene->EndBulkCreation(change); }
+
+    Scene *scene;
+    AttributeChange::Type change;
+};
+
+}
+
 namespace TundraLogic
 {
 
@@ -87,7 +105,9 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
     updatePeriod_(1.0f / 20.0f),
     updateAcc_(0.0),
     maxLinExtrapTime_(3.0f),
-    noClientPhysicsHandoff_(false)
+    noClientPhysicsHandoff_(false),
+    clientPredictionEnabled_(false),
+    controlledEntityId_(0)
 {
     KristalliProtocolModule *kristalli = framework_->GetModule<KristalliProtocolModule>();
     connect(kristalli, SIGNAL(NetworkMessageReceived(kNet::MessageConnection *, kNet::packet_id_t, kNet::message_id_t, const char *, size_t)), 
@@ -95,6 +115,8 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
     
     if (framework_->HasCommandLineParameter("--noclientphysics"))
         noClientPhysicsHandoff_ = true;
+    if (framework_->HasCommandLineParameter("--clientprediction"))
+        clientPredictionEnabled_ = true;
     
     GetClientExtrapolationTime();
 }
@@ -177,6 +199,8 @@ void SyncManager::RegisterToScene(ScenePtr scene)
         SLOT( OnComponentRemoved(Entity*, IComponent*, AttributeChange::Type) ));
     connect(sceneptr, SIGNAL( EntityCreated(Entity*, AttributeChange::Type) ),
         SLOT( OnEntityCreated(Entity*, AttributeChange::Type) ));
+    connect(sceneptr, SIGNAL( EntitiesCreated(const QList<Entity *> &, AttributeChange::Type) ),
+        SLOT( OnEntitiesCreated(const QList<Entity *> &, AttributeChange::Type) ));
     connect(sceneptr, SIGNAL( EntityRemoved(Entity*, AttributeChange::Type) ),
         SLOT( OnEntityRemoved(Entity*, AttributeChange::Type) ));
     connect(sceneptr, SIGNAL( ActionTriggered(Entity *, const QString &, const QStringList &, EntityAction::ExecTypeField) ),
@@ -192,6 +216,9 @@ void SyncManager::HandleKristalliMessage(kNet::MessageConnection* source, kNet::
         case cCreateEntityMessage:
             HandleCreateEntity(source, data, numBytes);
             break;
+        case cCreateEntitiesMessage:
+            HandleCreateEntities(source, data, numBytes);
+            break;
         case cCreateComponentsMessage:
             HandleCreateComponents(source, data, numBytes);
             break;
@@ -225,6 +252,18 @@ void SyncManager::HandleKristalliMessage(kNet::MessageConnection* source, kNet::
                 HandleEntityAction(source, msg);
             }
             break;
+        case cEntityActionsMessage:
+            HandleEntityActions(source, data, numBytes);
+            break;
+        case cInputCommandMessage:
+            HandleInputCommand(source, data, numBytes);
+            break;
+        case cInputAckMessage:
+            HandleInputAck(source, data, numBytes);
+            break;
+        case cControlledEntityMessage:
+            HandleControlledEntity(source, data, numBytes);
+            break;
         }
     }
     catch (kNet::NetException& e)
@@ -249,6 +288,7 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     // Connect to actions sent to specifically to this user
     connect(user.get(), SIGNAL(ActionTriggered(UserConnection*, Entity*, const QString&, const QStringList&)),
         this, SLOT(OnUserActionTriggered(UserConnection*, Entity*, const QString&, const QStringList&)));
+    connect(user.get(), SIGNAL(ControlledEntityChanged(UserConnection*)), this, SLOT(OnUserControlledEntityChanged(UserConnection*)));
     
     // Mark all entities in the sync state as new so we will send them
     user->syncState = boost::make_shared<SceneSyncState>(user->ConnectionId(), owner_->IsServer());
@@ -257,6 +297,17 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     if (owner_->IsServer())
         emit SceneStateCreated(user.get(), user->syncState.get());
 
+    // If the client supports the compact entity action message, announce that the server supports it too.
+    user->entityActions = boost::make_shared<EntityActionCodec>();
+    if (user->properties["compact-entity-actions"] == "1")
+    {
+        user->entityActions->Enable();
+        user->entityActions->Flush(user->connection);
+    }
+    user->prediction = boost::make_shared<ClientPrediction>();
+    if (user->controlledEntity)
+        OnUserControlledEntityChanged(user.get());
+
     for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
     {
         EntityPtr entity = iter->second;
@@ -267,6 +318,22 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     }
 }
 
+void SyncManager::ResetServerEntityActions()
+{
+    serverEntityActions_.Reset();
+}
+
+void SyncManager::ResetClientPrediction()
+{
+    ScenePtr scene = scene_.lock();
+    EntityPtr entity = scene && clientPrediction_.EntityId() ? scene->GetEntity(clientPrediction_.EntityId()) : EntityPtr();
+    boost::shared_ptr<EC_RigidBody> rigidBody = entity ? entity->GetComponent<EC_RigidBody>() : boost::shared_ptr<EC_RigidBody>();
+    if (rigidBody)
+        rigidBody->SetClientPredicted(false);
+    clientPrediction_.Reset();
+    controlledEntityId_ = 0;
+}
+
 void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change)
 {
     assert(comp && attr);
@@ -295,6 +362,10 @@ void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, Attribu
     if (!entity || entity->IsLocal())
         return; // This is a local entity, don't take it to network.
     
+    // The movement of the predicted avatar goes to the server in the input commands.
+    if (!isServer && entity->Id() == clientPrediction_.EntityId() && ClientPrediction::IsPredictedAttribute(comp, attr))
+        return;
+    
     if (isServer)
     {
         // For each client connected to this server, mark this attribute dirty, so it will be updated to the
@@ -422,6 +493,10 @@ void SyncManager::OnEntityCreated(Entity* entity, AttributeChange::Type change)
         return;
     if ((change != AttributeChange::Replicate) || (entity->IsLocal()))
         return;
+    // Already handled in OnEntitiesCreated
+    ScenePtr scene = scene_.lock();
+    if (scene && scene->IsSignallingBulkCreation())
+        return;
 
     if (owner_->IsServer())
     {
@@ -445,6 +520,40 @@ void SyncManager::OnEntityCreated(Entity* entity, AttributeChange::Type change)
     }
 }
 
+void SyncManager::OnEntitiesCreated(const QList<Entity *> &entities, AttributeChange::Type change)
+{
+    if (change != AttributeChange::Replicate)
+        return;
+
+    if (owner_->IsServer())
+    {
+        UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+        for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+        {
+            SceneSyncState *state = (*i)->syncState.get();
+            if (!state)
+                continue;
+            foreach(Entity *entity, entities)
+            {
+                if (entity->IsLocal())
+                    continue;
+                state->MarkEntityDirty(entity->Id());
+                if (state->entities[entity->Id()].removed)
+                {
+                    LogWarning("An entity with ID " + QString::number(entity->Id()) + " is queued to be deleted, but a new entity \"" + 
+                        entity->Name() + "\" is to be added to the scene!");
+                }
+            }
+        }
+    }
+    else
+    {
+        foreach(Entity *entity, entities)
+            if (!entity->IsLocal())
+                server_syncstate_.MarkEntityDirty(entity->Id());
+    }
+}
+
 void SyncManager::OnEntityRemoved(Entity* entity, AttributeChange::Type change)
 {
     assert(entity);
@@ -475,35 +584,35 @@ void SyncManager::OnActionTriggered(Entity *entity, const QString &action, const
     if (isServer && (type & EntityAction::Server) != 0)
         entity->Exec(EntityAction::Local, action, params);
 
-    // Craft EntityAction message.
-    MsgEntityAction msg;
-    msg.entityId = entity->Id();
-    // msg.executionType will be set below depending are we server or client.
-    msg.name = StringToBuffer(action.toStdString());
-    for(int i = 0; i < params.size(); ++i)
-    {
-        MsgEntityAction::S_parameters p = { StringToBuffer(params[i].toStdString()) };
-        msg.parameters.push_back(p);
-    }
-
     if (!isServer && ((type & EntityAction::Server) != 0 || (type & EntityAction::Peers) != 0) && owner_->GetClient()->GetConnection())
     {
         // send without Local flag
-        msg.executionType = (u8)(type & ~EntityAction::Local);
-        owner_->GetClient()->GetConnection()->Send(msg);
+        SendEntityAction(owner_->GetClient()->GetConnection(), &serverEntityActions_, entity->Id(), (u8)(type & ~EntityAction::Local), action, params);
     }
 
     if (isServer && (type & EntityAction::Peers) != 0)
     {
-        msg.executionType = (u8)EntityAction::Local; // Propagate as local actions.
+        // Propagate as local actions.
         foreach(UserConnectionPtr c, owner_->GetKristalliModule()->GetUserConnections())
         {
             if (c->properties["authenticated"] == "true" && c->connection)
-                c->connection->Send(msg);
+                SendEntityAction(c->connection, c->entityActions.get(), entity->Id(), (u8)EntityAction::Local, action, params);
         }
     }
 }
 
+void SyncManager::OnUserControlledEntityChanged(UserConnection* user)
+{
+    if (!owner_->IsServer() || !user || !user->connection)
+        return;
+
+    char buffer[16];
+    kNet::DataSerializer ds(buffer, sizeof(buffer));
+    ds.AddVLE<kNet::VLE8_16_32>(user->controlledEntity & UniqueIdGenerator::LAST_REPLICATED_ID);
+    // In order, so that the client has received the creation of the entity before.
+    QueueMessage(user->connection, cControlledEntityMessage, true, true, ds);
+}
+
 void SyncManager::OnUserActionTriggered(UserConnection* user, Entity *entity, const QString &action, const QStringList &params)
 {
     assert(user && entity);
@@ -515,17 +624,115 @@ void SyncManager::OnUserActionTriggered(UserConnection* user, Entity *entity, co
     if (user->properties["authenticated"] != "true")
         return; // Not yet authenticated, do not receive actions
     
+    // Propagate as local action.
+    SendEntityAction(user->connection, user->entityActions.get(), entity->Id(), (u8)EntityAction::Local, action, params);
+}
+
+void SyncManager::SendEntityAction(kNet::MessageConnection* connection, EntityActionCodec* codec, entity_id_t entityId, u8 executionType, const QString& action, const QStringList& params)
+{
+    if (codec && codec->IsEnabled())
+    {
+        // The compact message writes the entity ID as a VLE, which fits only replicated IDs. Unacked and local IDs are sent
+        // with the legacy message, after the pending batch to keep the order of the actions.
+        if (entityId > UniqueIdGenerator::LAST_REPLICATED_ID)
+            codec->Flush(connection);
+        else
+        {
+            // Batched until the end of the frame, unless the batch grows large.
+            codec->AddAction(entityId, executionType, action, params);
+            if (codec->PendingBytes() >= EntityActionCodec::cMaxBatchBytes)
+                codec->Flush(connection);
+            return;
+        }
+    }
+
     // Craft EntityAction message.
     MsgEntityAction msg;
-    msg.entityId = entity->Id();
+    msg.entityId = entityId;
     msg.name = StringToBuffer(action.toStdString());
-    msg.executionType = (u8)EntityAction::Local; // Propagate as local action.
+    msg.executionType = executionType;
     for(int i = 0; i < params.size(); ++i)
     {
         MsgEntityAction::S_parameters p = { StringToBuffer(params[i].toStdString()) };
         msg.parameters.push_back(p);
     }
-    user->connection->Send(msg);
+    connection->Send(msg);
+}
+
+void SyncManager::FlushEntityActions()
+{
+    PROFILE(SyncManager_FlushEntityActions);
+
+    if (owner_->IsServer())
+    {
+        UserConnectionList& users = owner_->GetKristalliModule()->GetUserConnections();
+        for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+            if ((*i)->entityActions)
+                (*i)->entityActions->Flush((*i)->connection);
+    }
+    else
+        serverEntityActions_.Flush(owner_->GetKristalliModule()->GetMessageConnection());
+}
+
+void SyncManager::UpdateClientPrediction(bool networkTick)
+{
+    PROFILE(SyncManager_UpdateClientPrediction);
+
+    ScenePtr scene = scene_.lock();
+    kNet::MessageConnection* connection = owner_->GetKristalliModule()->GetMessageConnection();
+    if (!scene || !connection)
+        return;
+
+    // The server tells which entity this client controls. It may not have been replicated yet when the message arrives.
+    EntityPtr entity = controlledEntityId_ ? scene->GetEntity(controlledEntityId_) : EntityPtr();
+    if (clientPrediction_.EntityId() && clientPrediction_.EntityId() != controlledEntityId_)
+    {
+        EntityPtr previous = scene->GetEntity(clientPrediction_.EntityId());
+        boost::shared_ptr<EC_RigidBody> previousBody = previous ? previous->GetComponent<EC_RigidBody>() : boost::shared_ptr<EC_RigidBody>();
+        if (previousBody)
+            previousBody->SetClientPredicted(false);
+        clientPrediction_.SetEntity(0);
+    }
+
+    boost::shared_ptr<EC_PhysicsMotor> motor = entity ? entity->GetComponent<EC_PhysicsMotor>() : boost::shared_ptr<EC_PhysicsMotor>();
+    boost::shared_ptr<EC_Placeable> placeable = entity ? entity->GetComponent<EC_Placeable>() : boost::shared_ptr<EC_Placeable>();
+    boost::shared_ptr<EC_RigidBody> rigidBody = entity ? entity->GetComponent<EC_RigidBody>() : boost::shared_ptr<EC_RigidBody>();
+    // The physics of a parented body follows the parent, so it cannot be predicted.
+    if (!motor || !placeable || !rigidBody || !placeable->parentRef.Get().IsEmpty())
+    {
+        if (rigidBody)
+            rigidBody->SetClientPredicted(false);
+        clientPrediction_.SetEntity(0);
+        return;
+    }
+
+    if (entity->Id() != clientPrediction_.EntityId())
+    {
+        // From now on the avatar is simulated by the local physics instead of interpolating the server updates.
+        clientPrediction_.SetEntity(entity->Id());
+        server_syncstate_.entityInterpolations.erase(entity->Id());
+        rigidBody->SetClientPredicted(true);
+        rigidBody->SetClientExtrapolating(true);
+    }
+
+    clientPrediction_.SendInput(connection, motor.get(), placeable.get(), rigidBody.get(), networkTick);
+}
+
+void SyncManager::PrintClientPredictionStats() const
+{
+    if (owner_->IsServer() || !clientPredictionEnabled_)
+    {
+        LogInfo("SyncManager: Client-side prediction is not in use. Start the client with --clientPrediction to enable it.");
+        return;
+    }
+
+    const ClientPrediction::Stats &stats = clientPrediction_.GetStats();
+    LogInfo(QString("Client prediction: %1 inputs acknowledged, latency avg %2 ms, max %3 ms.").arg(stats.numAcks)
+        .arg(stats.numAcks > 0 ? stats.latencySum / stats.numAcks : 0.0, 0, 'f', 1).arg(stats.maxLatency, 0, 'f', 1));
+    LogInfo(QString("Client prediction: %1 corrections, error avg %2, max %3.").arg(stats.numCorrections)
+        .arg(stats.numCorrections > 0 ? stats.correctionSum / stats.numCorrections : 0.0, 0, 'f', 3).arg(stats.maxCorrection, 0, 'f', 3));
+    LogInfo(QString("Client prediction: %1 inputs replayed, replay time avg %2 ms, max %3 ms.").arg(stats.replayedInputs)
+        .arg(stats.numCorrections > 0 ? stats.replaySum / stats.numCorrections : 0.0, 0, 'f', 3).arg(stats.maxReplay, 0, 'f', 3));
 }
 
 /// Interpolates from (pos0, vel0) to (pos1, vel1) with a C1 curve (continuous in position and velocity)
@@ -669,13 +876,22 @@ void SyncManager::Update(f64 frametime)
 {
     PROFILE(SyncManager_Update);
 
+    // Send the entity actions batched during the frame before any other messages of this update, to keep their order.
+    FlushEntityActions();
+
     // For the client, smoothly update all rigid bodies by interpolating.
     if (!owner_->IsServer())
         InterpolateRigidBodies(frametime, &server_syncstate_);
 
     // Check if it is yet time to perform a network update tick.
     updateAcc_ += (float)frametime;
-    if (updateAcc_ < updatePeriod_)
+    const bool networkTick = updateAcc_ >= updatePeriod_;
+
+    // For the client, send the input of the predicted avatar as soon as it changes, and at least on each network update tick.
+    if (!owner_->IsServer() && clientPredictionEnabled_)
+        UpdateClientPrediction(networkTick);
+
+    if (!networkTick)
         return;
 
     // If multiple updates passed, update still just once.
@@ -694,12 +910,16 @@ void SyncManager::Update(f64 frametime)
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState)
             {
+                // Acknowledge the newest input of the user's predicted avatar with the state the input was applied to.
+                if ((*i)->prediction)
+                    (*i)->prediction->SendAck((*i)->connection);
+
                 // First send out all changes to rigid bodies.
                 // After processing this function, the bits related to rigid body states have been cleared,
                 // so the generic sync will not double-replicate the rigid body positions and velocities.
                 ReplicateRigidBodyChanges((*i)->connection, (*i)->syncState.get());
 
-                ProcessSyncState((*i)->connection, (*i)->syncState.get());
+                ProcessSyncState((*i)->connection, (*i)->syncState.get(), (*i)->Property("batched-entity-creation") == "1");
             }
     }
     else
@@ -1071,6 +1291,8 @@ void SyncManager::HandleRigidBodyChanges(kNet::MessageConnection* source, kNet::
 
         if (!e) // Discard this message - we don't have the entity in our scene to which the message applies to.
             continue;
+        if (entityID == clientPrediction_.EntityId()) // The predicted avatar is corrected by the input acknowledgements instead.
+            continue;
 
         // Did anything change?
         if (posSendType != 0 || rotSendType != 0 || scaleSendType != 0 || velSendType != 0 || angVelSendType != 0)
@@ -1140,7 +1362,7 @@ void SyncManager::HandleRigidBodyChanges(kNet::MessageConnection* source, kNet::
     }
 }
 
-void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSyncState* state)
+void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSyncState* state, bool batchCreations)
 {
     PROFILE(SyncManager_ProcessSyncState);
     
@@ -1149,7 +1371,7 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
     ScenePtr scene = scene_.lock();
     int numMessagesSent = 0;
     bool isServer = owner_->IsServer();
-    UNREFERENCED_PARAM(isServer)
+    batchCreations = batchCreations && isServer;
     
     // Process the state's dirty entity queue.
     /// \todo Limit and prioritize the data sent. For now the whole queue is processed, regardless of whether the connection is being saturated.
@@ -1175,6 +1397,10 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                 continue;
         }
         
+        // Send the batched entity creations before any other message, so that the messages stay in the order of the queue
+        if (entityState.removed || !entityState.isNew)
+            numMessagesSent += FlushCreateEntities(destination);
+        
         // Remove entity
         if (entityState.removed)
         {
@@ -1202,8 +1428,9 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
         {
             kNet::DataSerializer ds(createEntityBuffer_, 64 * 1024);
             
-            // Entity identification and temporary flag
-            ds.AddVLE<kNet::VLE8_16_32>(sceneId);
+            // Entity identification and temporary flag. Batched creations write the scene ID once per message
+            if (!batchCreations)
+                ds.AddVLE<kNet::VLE8_16_32>(sceneId);
             ds.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
             // Do not write the temporary flag as a bit to not desync the byte alignment at this point, as a lot of data potentially follows
             ds.Add<u8>(entity->IsTemporary() ? 1 : 0);
@@ -1229,8 +1456,13 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
                 state->MarkComponentProcessed(entity->Id(), comp->Id());
             }
             
-            QueueMessage(destination, cCreateEntityMessage, true, true, ds);
-            ++numMessagesSent;
+            if (batchCreations)
+                numMessagesSent += AddPendingCreateEntity(destination, ds);
+            else
+            {
+                QueueMessage(destination, cCreateEntityMessage, true, true, ds);
+                ++numMessagesSent;
+            }
             
             // The create has been processed fully. Clear dirty flags.
             state->MarkEntityProcessed(entity->Id());
@@ -1456,10 +1688,43 @@ void SyncManager::ProcessSyncState(kNet::MessageConnection* destination, SceneSy
         if (removeState)
             state->entities.erase(entityState.id);
     }
+    numMessagesSent += FlushCreateEntities(destination);
+    
     //if (numMessagesSent)
     //    std::cout << "Sent " << numMessagesSent << " scenesync messages" << std::endl;
 }
 
+int SyncManager::AddPendingCreateEntity(kNet::MessageConnection* destination, const kNet::DataSerializer& entityDs)
+{
+    int numMessagesSent = 0;
+    size_t entityDataSize = entityDs.BytesFilled();
+    // Send the pending creations first if this entity would not fit in the same message. The size is written as a VLE of at most 4 bytes.
+    if (!pendingCreateEntities_.empty() && pendingCreateEntities_.size() + entityDataSize + 4 > cMaxCreateEntitiesBytes)
+        numMessagesSent = FlushCreateEntities(destination);
+
+    char sizeBuffer[4];
+    kNet::DataSerializer sizeDs(sizeBuffer, 4);
+    sizeDs.AddVLE<kNet::VLE8_16_32>(entityDataSize);
+    pendingCreateEntities_.insert(pendingCreateEntities_.end(), sizeBuffer, sizeBuffer + sizeDs.BytesFilled());
+    pendingCreateEntities_.insert(pendingCreateEntities_.end(), entityDs.GetData(), entityDs.GetData() + entityDataSize);
+    return numMessagesSent;
+}
+
+int SyncManager::FlushCreateEntities(kNet::MessageConnection* destination)
+{
+    if (pendingCreateEntities_.empty())
+        return 0;
+
+    unsigned sceneId = 0; ///\todo Replace with proper scene ID once multiscene support is in place.
+    createEntitiesBuffer_.resize(pendingCreateEntities_.size() + 4);
+    kNet::DataSerializer ds(&createEntitiesBuffer_[0], createEntitiesBuffer_.size());
+    ds.AddVLE<kNet::VLE8_16_32>(sceneId);
+    ds.AddArray<u8>((const u8*)&pendingCreateEntities_[0], pendingCreateEntities_.size());
+    QueueMessage(destination, cCreateEntitiesMessage, true, true, ds);
+    pendingCreateEntities_.clear();
+    return 1;
+}
+
 bool SyncManager::ValidateAction(kNet::MessageConnection* source, unsigned messageID, entity_id_t entityID)
 {
     assert(source);
@@ -1537,7 +1802,117 @@ void SyncManager::HandleCreateEntity(kNet::MessageConnection* source, const char
     }
     
     std::vector<std::pair<component_id_t, component_id_t> > componentIdRewrites;
+    try
+    {
+        ReadEntityContent(ds, scene.get(), entity.get(), state, change, componentIdRewrites);
+    }
+    catch(kNet::NetException &/*e*/)
+    {
+        scene->RemoveEntity(entity->Id(), AttributeChange::Disconnected);
+        throw;
+    }
+    
+    // Emit the component changes last, to signal only a coherent state of the whole entity
+    scene->EmitEntityCreated(entity.get(), change);
+    const Entity::ComponentMap &components = entity->Components();
+    for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+        i->second->ComponentChanged(change);
+    
+    // Send CreateEntityReply (server only)
+    if (isServer)
+    {
+        kNet::DataSerializer replyDs(createEntityBuffer_, 64 * 1024);
+        replyDs.AddVLE<kNet::VLE8_16_32>(sceneID);
+        replyDs.AddVLE<kNet::VLE8_16_32>(senderEntityID & UniqueIdGenerator::LAST_REPLICATED_ID);
+        replyDs.AddVLE<kNet::VLE8_16_32>(entityID & UniqueIdGenerator::LAST_REPLICATED_ID);
+        replyDs.AddVLE<kNet::VLE8_16_32>(componentIdRewrites.size());
+        for (unsigned i = 0; i < componentIdRewrites.size(); ++i)
+        {
+            replyDs.AddVLE<kNet::VLE8_16_32>(componentIdRewrites[i].first & UniqueIdGenerator::LAST_REPLICATED_ID);
+            replyDs.AddVLE<kNet::VLE8_16_32>(componentIdRewrites[i].second & UniqueIdGenerator::LAST_REPLICATED_ID);
+        }
+        QueueMessage(source, cCreateEntityReplyMessage, true, true, replyDs);
+    }
+    
+    // Mark the entity processed (undirty) in the sender's syncstate so that create is not echoed back
+    state->MarkEntityProcessed(entityID);
+}
+
+void SyncManager::HandleCreateEntities(kNet::MessageConnection* source, const char* data, size_t numBytes)
+{
+    assert(source);
+    SceneSyncState* state = GetSceneSyncState(source);
+    ScenePtr scene = GetRegisteredScene();
+    if (!scene || !state)
+    {
+        LogWarning("Null scene or sync state, disregarding CreateEntities message");
+        return;
+    }
+    
+    bool isServer = owner_->IsServer();
+    if (isServer)
+    {
+        LogWarning("Discarding CreateEntities message on server");
+        return;
+    }
+    
+    AttributeChange::Type change = AttributeChange::LocalOnly;
+    
+    kNet::DataDeserializer ds(data, numBytes);
+    unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
+    UNREFERENCED_PARAM(sceneID)
+    
+    // Entity whose content is being read, removed if reading it fails.
+    entity_id_t partialEntityId = 0;
+    try
+    {
+        // Create all the entities of the message before signalling any of them. The bulk creation is closed when leaving
+        // this scope, also on failure, and the entities created so far are signalled to keep the scene coherent.
+        BulkCreationScope bulkCreation(scene.get(), change);
+        std::vector<char> entityData;
+        std::vector<std::pair<component_id_t, component_id_t> > componentIdRewrites;
+        while (ds.BitsLeft() >= 8)
+        {
+            unsigned entityDataSize = ds.ReadVLE<kNet::VLE8_16_32>();
+            entityData.resize(entityDataSize + 1);
+            ds.ReadArray<u8>((u8*)&entityData[0], entityDataSize);
+            kNet::DataDeserializer entityDs(&entityData[0], entityDataSize);
+            entity_id_t entityID = entityDs.ReadVLE<kNet::VLE8_16_32>();
+            
+            // If client gets a entity that already exists, destroy it forcibly
+            if (scene->GetEntity(entityID))
+            {
+                LogWarning("Received entity creation from server for entity ID " + QString::number(entityID) + " that already exists. Removing the old entity.");
+                scene->RemoveEntity(entityID, AttributeChange::LocalOnly);
+            }
+            
+            EntityPtr entity = scene->CreateEntity(entityID);
+            if (!entity)
+            {
+                LogWarning("Could not create entity " + QString::number(entityID) + ", skipping it in CreateEntities message");
+                continue;
+            }
+            
+            partialEntityId = entityID;
+            ReadEntityContent(entityDs, scene.get(), entity.get(), state, change, componentIdRewrites);
+            partialEntityId = 0;
+            state->MarkEntityProcessed(entityID);
+        }
+    }
+    catch(kNet::NetException &/*e*/)
+    {
+        // The bulk creation is closed by now, so the removal of the partially created entity is signalled normally.
+        if (partialEntityId && scene->GetEntity(partialEntityId))
+            scene->RemoveEntity(partialEntityId, change);
+        throw; // Propagate the exception up, to handle a peer which is sending us bad protocol bits.
+    }
+}
 
+void SyncManager::ReadEntityContent(kNet::DataDeserializer& ds, Scene* scene, Entity* entity, SceneSyncState* state, AttributeChange::Type change,
+    std::vector<std::pair<component_id_t, component_id_t> >& componentIdRewrites)
+{
+    bool isServer = owner_->IsServer();
+    
     try
     {    
         // Read the temporary flag
@@ -1579,7 +1954,7 @@ void SyncManager::HandleCreateEntity(kNet::MessageConnection* source, const char
                 componentIdRewrites.push_back(std::make_pair(senderCompID, compID));
             }
             // Create the component to the sender's syncstate, then mark it processed (undirty)
-            state->MarkComponentProcessed(entityID, compID);
+            state->MarkComponentProcessed(entity->Id(), compID);
             
             // Fill static attributes
             unsigned numStaticAttrs = comp->NumStaticAttributes();
@@ -1605,34 +1980,8 @@ void SyncManager::HandleCreateEntity(kNet::MessageConnection* source, const char
     } catch(kNet::NetException &/*e*/)
     {
         LogError("Failed to deserialize the creation of a new entity from the peer. Deleting the partially crafted entity!");
-        scene->RemoveEntity(entity->Id(), AttributeChange::Disconnected);
-        throw; // Propagate the exception up, to handle a peer which is sending us bad protocol bits.
-    }
-    
-    // Emit the component changes last, to signal only a coherent state of the whole entity
-    scene->EmitEntityCreated(entity.get(), change);
-    const Entity::ComponentMap &components = entity->Components();
-    for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-        i->second->ComponentChanged(change);
-    
-    // Send CreateEntityReply (server only)
-    if (isServer)
-    {
-        kNet::DataSerializer replyDs(createEntityBuffer_, 64 * 1024);
-        replyDs.AddVLE<kNet::VLE8_16_32>(sceneID);
-        replyDs.AddVLE<kNet::VLE8_16_32>(senderEntityID & UniqueIdGenerator::LAST_REPLICATED_ID);
-        replyDs.AddVLE<kNet::VLE8_16_32>(entityID & UniqueIdGenerator::LAST_REPLICATED_ID);
-        replyDs.AddVLE<kNet::VLE8_16_32>(componentIdRewrites.size());
-        for (unsigned i = 0; i < componentIdRewrites.size(); ++i)
-        {
-            replyDs.AddVLE<kNet::VLE8_16_32>(componentIdRewrites[i].first & UniqueIdGenerator::LAST_REPLICATED_ID);
-            replyDs.AddVLE<kNet::VLE8_16_32>(componentIdRewrites[i].second & UniqueIdGenerator::LAST_REPLICATED_ID);
-        }
-        QueueMessage(source, cCreateEntityReplyMessage, true, true, replyDs);
+        throw; // The caller removes the entity. Propagate the exception up, to handle a peer which is sending us bad protocol bits.
     }
-    
-    // Mark the entity processed (undirty) in the sender's syncstate so that create is not echoed back
-    state->MarkEntityProcessed(entityID);
 }
 
 void SyncManager::HandleCreateComponents(kNet::MessageConnection* source, const char* data, size_t numBytes)
@@ -2277,8 +2626,6 @@ void SyncManager::HandleCreateComponentsReply(kNet::MessageConnection* source, c
 
 void SyncManager::HandleEntityAction(kNet::MessageConnection* source, MsgEntityAction& msg)
 {
-    bool isServer = owner_->IsServer();
-    
     ScenePtr scene = GetRegisteredScene();
     if (!scene)
     {
@@ -2286,11 +2633,120 @@ void SyncManager::HandleEntityAction(kNet::MessageConnection* source, MsgEntityA
         return;
     }
     
-    entity_id_t entityId = msg.entityId;
+    QString action = BufferToString(msg.name).c_str();
+    QStringList params;
+    for(uint i = 0; i < msg.parameters.size(); ++i)
+        params << BufferToString(msg.parameters[i].parameter).c_str();
+
+    ExecuteEntityAction(source, msg.entityId, msg.executionType, action, params);
+}
+
+void SyncManager::HandleEntityActions(kNet::MessageConnection* source, const char* data, size_t numBytes)
+{
+    // Read the string tables of the connection even without a scene, to keep them in sync with the sender.
+    EntityActionCodec* codec = 0;
+    if (owner_->IsServer())
+    {
+        UserConnectionPtr user = owner_->GetKristalliModule()->GetUserConnection(source);
+        if (user)
+        {
+            if (!user->entityActions)
+                user->entityActions = boost::make_shared<EntityActionCodec>();
+            codec = user->entityActions.get();
+        }
+    }
+    else
+    {
+        // The first message from the server announces that it supports the compact message.
+        if (!serverEntityActions_.IsEnabled())
+            serverEntityActions_.Enable();
+        codec = &serverEntityActions_;
+    }
+    if (!codec)
+        return;
+
+    std::vector<EntityActionCodec::Action> actions;
+    codec->ReadActions(data, numBytes, actions);
+
+    if (!GetRegisteredScene() && !actions.empty())
+    {
+        LogWarning("SyncManager: Ignoring " + QString::number(actions.size()) + " received entity actions as no scene exists!");
+        return;
+    }
+    for(size_t i = 0; i < actions.size(); ++i)
+        ExecuteEntityAction(source, actions[i].entityId, actions[i].executionType, actions[i].name, actions[i].parameters);
+}
+
+void SyncManager::HandleInputCommand(kNet::MessageConnection* source, const char* data, size_t numBytes)
+{
+    if (!owner_->IsServer())
+        return;
+
+    UserConnectionPtr user = owner_->GetKristalliModule()->GetUserConnection(source);
+    ScenePtr scene = GetRegisteredScene();
+    if (!user || !user->prediction || !scene)
+        return;
+
+    entity_id_t entityId;
+    ClientPrediction::Input input;
+    if (!user->prediction->ReadInput(data, numBytes, entityId, input))
+        return; // The inputs are sent unreliably, so an older input may arrive after a newer one.
+    if (!ValidateAction(source, cInputCommandMessage, entityId))
+        return;
+    if (entityId != user->controlledEntity)
+    {
+        LogDebug("SyncManager: Ignoring InputCommand for entity " + QString::number(entityId) + ", which is not controlled by user " + QString::number(user->ConnectionId()) + ".");
+        return;
+    }
+
+    EntityPtr entity = scene->GetEntity(entityId);
+    boost::shared_ptr<EC_PhysicsMotor> motor = entity ? entity->GetComponent<EC_PhysicsMotor>() : boost::shared_ptr<EC_PhysicsMotor>();
+    boost::shared_ptr<EC_Placeable> placeable = entity ? entity->GetComponent<EC_Placeable>() : boost::shared_ptr<EC_Placeable>();
+    boost::shared_ptr<EC_RigidBody> rigidBody = entity ? entity->GetComponent<EC_RigidBody>() : boost::shared_ptr<EC_RigidBody>();
+    if (!motor || !placeable || !rigidBody)
+    {
+        LogDebug("SyncManager: Ignoring InputCommand for entity " + QString::number(entityId) + ", which has no physics motor, placeable and rigid body.");
+        return;
+    }
+
+    user->prediction->ApplyInput(entityId, input, motor.get(), placeable.get(), rigidBody.get());
+}
+
+void SyncManager::HandleInputAck(kNet::MessageConnection* source, const char* data, size_t numBytes)
+{
+    if (owner_->IsServer() || !clientPrediction_.EntityId())
+        return;
+
+    ScenePtr scene = GetRegisteredScene();
+    EntityPtr entity = scene ? scene->GetEntity(clientPrediction_.EntityId()) : EntityPtr();
+    boost::shared_ptr<EC_PhysicsMotor> motor = entity ? entity->GetComponent<EC_PhysicsMotor>() : boost::shared_ptr<EC_PhysicsMotor>();
+    boost::shared_ptr<EC_Placeable> placeable = entity ? entity->GetComponent<EC_Placeable>() : boost::shared_ptr<EC_Placeable>();
+    boost::shared_ptr<EC_RigidBody> rigidBody = entity ? entity->GetComponent<EC_RigidBody>() : boost::shared_ptr<EC_RigidBody>();
+    if (motor && placeable && rigidBody)
+        clientPrediction_.HandleAck(data, numBytes, motor.get(), placeable.get(), rigidBody.get());
+}
+
+void SyncManager::HandleControlledEntity(kNet::MessageConnection* /*source*/, const char* data, size_t numBytes)
+{
+    if (owner_->IsServer())
+        return;
+
+    kNet::DataDeserializer dd(data, numBytes);
+    controlledEntityId_ = dd.ReadVLE<kNet::VLE8_16_32>();
+}
+
+void SyncManager::ExecuteEntityAction(kNet::MessageConnection* source, entity_id_t entityId, u8 executionType, const QString& action, const QStringList& params)
+{
+    bool isServer = owner_->IsServer();
+    
+    ScenePtr scene = GetRegisteredScene();
+    if (!scene)
+        return;
+    
     EntityPtr entity = scene->GetEntity(entityId);
     if (!entity)
     {
-        LogWarning("Entity with ID " + QString::number(entityId) + " not found for EntityAction message \"" + QString(msg.name.size() == 0 ? "(null)" : std::string((const char *)&msg.name[0], msg.name.size()).c_str()) + "\" (" + QString::number(msg.parameters.size()) + " parameters).");
+        LogWarning("Entity with ID " + QString::number(entityId) + " not found for EntityAction message \"" + action + "\" (" + QString::number(params.size()) + " parameters).");
         return;
     }
 
@@ -2305,12 +2761,7 @@ void SyncManager::HandleEntityAction(kNet::MessageConnection* source, MsgEntityA
         }
     }
     
-    QString action = BufferToString(msg.name).c_str();
-    QStringList params;
-    for(uint i = 0; i < msg.parameters.size(); ++i)
-        params << BufferToString(msg.parameters[i].parameter).c_str();
-
-    EntityAction::ExecTypeField type = (EntityAction::ExecTypeField)(msg.executionType);
+    EntityAction::ExecTypeField type = (EntityAction::ExecTypeField)(executionType);
 
     bool handled = false;
 
@@ -2323,10 +2774,9 @@ void SyncManager::HandleEntityAction(kNet::MessageConnection* source, MsgEntityA
     // If execution type is Peers, replicate to all peers but the sender.
     if (isServer && (type & EntityAction::Peers) != 0)
     {
-        msg.executionType = (u8)EntityAction::Local;
         foreach(UserConnectionPtr userConn, owner_->GetKristalliModule()->GetUserConnections())
             if (userConn->connection != source) // The EC action will not be sent to the machine that originated the request to send an action to all peers.
-                userConn->connection->Send(msg);
+                SendEntityAction(userConn->connection, userConn->entityActions.get(), entityId, (u8)EntityAction::Local, action, params);
         handled = true;
     }
     
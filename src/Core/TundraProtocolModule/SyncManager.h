@@ -6,6 +6,8 @@
 #include "TundraProtocolModuleApi.h"
 
 #include "SyncState.h"
+#include "EntityActionCodec.h"
+#include "ClientPrediction.h"
 #include "SceneFwd.h"
 #include "AttributeChangeType.h"
 #include "EntityAction.h"
@@ -38,6 +40,12 @@ public:
     
     /// Create new replication state for user and dirty it (server operation only)
     void NewUserConnected(const UserConnectionPtr &user);
+    
+    /// Reset the entity action string tables of the server connection, and use the legacy EntityAction message until the server announces the compact one (client operation only)
+    void ResetServerEntityActions();
+
+    /// Forget the controlled entity, the predicted avatar and the prediction statistics of the server connection (client only)
+    void ResetClientPrediction();
 
 public slots:
     /// Set update period (seconds)
@@ -52,6 +60,9 @@ public slots:
     SceneSyncState* SceneState(int connectionId) const;
     SceneSyncState* SceneState(const UserConnectionPtr &connection) const; /**< @overload @param connection Client connection.*/
 
+    /// Logs the latency, correction and replay statistics of the client-side prediction (client only).
+    void PrintClientPredictionStats() const;
+
 signals:
     /// This signal is emitted when a new user connects and a new SceneSyncState is created for the connection.
     /// @note See signals of the SceneSyncState object to build prioritization logic how the sync state is filled.
@@ -76,6 +87,9 @@ private slots:
     /// Trigger sync of entity creation
     void OnEntityCreated(Entity* entity, AttributeChange::Type change);
     
+    /// Trigger sync of the entities of a bulk creation
+    void OnEntitiesCreated(const QList<Entity *> &entities, AttributeChange::Type change);
+    
     /// Trigger sync of entity removal
     void OnEntityRemoved(Entity* entity, AttributeChange::Type change);
 
@@ -85,6 +99,9 @@ private slots:
     /// Trigger sync of entity action to specific user
     void OnUserActionTriggered(UserConnection* user, Entity *entity, const QString &action, const QStringList &params);
 
+    /// Tell the client of a user which entity it controls
+    void OnUserControlledEntityChanged(UserConnection* user);
+
     /// Handle a Kristalli protocol message
     void HandleKristalliMessage(kNet::MessageConnection* source, kNet::packet_id_t, kNet::message_id_t id, const char* data, size_t numBytes);
 
@@ -97,8 +114,33 @@ private:
     
     /// Handle entity action message.
     void HandleEntityAction(kNet::MessageConnection* source, MsgEntityAction& msg);
+    /// Handle batched entity actions message.
+    void HandleEntityActions(kNet::MessageConnection* source, const char* data, size_t numBytes);
+    /// Execute a received entity action, and relay it to the peers if requested.
+    void ExecuteEntityAction(kNet::MessageConnection* source, entity_id_t entityId, u8 executionType, const QString& action, const QStringList& params);
+    /// Send an entity action to a connection, batched with the compact message if the connection supports it, otherwise with the legacy message.
+    /** @param codec Entity action state of the connection, or null to use the legacy message. */
+    void SendEntityAction(kNet::MessageConnection* connection, EntityActionCodec* codec, entity_id_t entityId, u8 executionType, const QString& action, const QStringList& params);
+    /// Send the batched entity actions of all connections.
+    void FlushEntityActions();
+    /// Find the controlled entity for the client-side prediction, and send its input (client only).
+    /** @param networkTick Whether this is a network update tick, on which the input is sent even if it has not changed. */
+    void UpdateClientPrediction(bool networkTick);
+    /// Handle input command message (server only).
+    void HandleInputCommand(kNet::MessageConnection* source, const char* data, size_t numBytes);
+    /// Handle input acknowledgement message (client only).
+    void HandleInputAck(kNet::MessageConnection* source, const char* data, size_t numBytes);
+    /// Handle controlled entity message (client only).
+    void HandleControlledEntity(kNet::MessageConnection* source, const char* data, size_t numBytes);
     /// Handle create entity message.
     void HandleCreateEntity(kNet::MessageConnection* source, const char* data, size_t numBytes);
+    /// Handle create entities message (client only).
+    void HandleCreateEntities(kNet::MessageConnection* source, const char* data, size_t numBytes);
+    /// Read the temporary flag and the components of an entity being created, and create the components to it.
+    /** On failure, rethrows the exception. The caller is responsible for removing the partially created entity.
+        @param componentIdRewrites On server, the sender's component IDs and the assigned IDs are appended here. */
+    void ReadEntityContent(kNet::DataDeserializer& ds, Scene* scene, Entity* entity, SceneSyncState* state, AttributeChange::Type change,
+        std::vector<std::pair<component_id_t, component_id_t> >& componentIdRewrites);
     /// Handle create components message.
     void HandleCreateComponents(kNet::MessageConnection* source, const char* data, size_t numBytes);
     /// Handle create attributes message.
@@ -128,8 +170,19 @@ private:
     /// Process one sync state for changes in the scene
     /** \todo For now, sends all changed entities/components. In the future, this shall be subject to interest management
         @param destination MessageConnection where to send the messages
-        @param state Syncstate to process */
-    void ProcessSyncState(kNet::MessageConnection* destination, SceneSyncState* state);
+        @param state Syncstate to process
+        @param batchCreations Whether to send the entity creations in CreateEntities messages instead of one CreateEntity message per entity.
+            Only for clients that advertise the "batched-entity-creation" login property (server only). */
+    void ProcessSyncState(kNet::MessageConnection* destination, SceneSyncState* state, bool batchCreations = false);
+    
+    /// Add a serialized entity creation to the pending CreateEntities message (server only)
+    /** If the entity does not fit in the pending message, the pending message is sent first.
+        @return Number of messages sent */
+    int AddPendingCreateEntity(kNet::MessageConnection* destination, const kNet::DataSerializer& entityDs);
+    
+    /// Send the pending entity creations as one CreateEntities message
+    /** @return Number of messages sent */
+    int FlushCreateEntities(kNet::MessageConnection* destination);
     
     /// Validate the scene manipulation action. If returns false, it is ignored
     /** @param source Where the action came from
@@ -161,9 +214,17 @@ private:
     float maxLinExtrapTime_;
     /// Disable client physics handoff -flag
     bool noClientPhysicsHandoff_;
+    /// Client-side prediction of the own avatar -flag
+    bool clientPredictionEnabled_;
     
     /// Server sync state (client only)
     SceneSyncState server_syncstate_;
+    /// Entity action state of the server connection (client only)
+    EntityActionCodec serverEntityActions_;
+    /// Prediction state of the own avatar (client only)
+    ClientPrediction clientPrediction_;
+    /// Entity the server has assigned to this client to control, 0 if none (client only)
+    entity_id_t controlledEntityId_;
     
     /// Fixed buffers for crafting messages
     char createEntityBuffer_[64 * 1024];
@@ -175,6 +236,13 @@ private:
     char removeEntityBuffer_[1024];
     char removeAttrsBuffer_[1024];
     std::vector<u8> changedAttributes_;
+    
+    /// Maximum size of the entity data in one CreateEntities message, unless a single entity is larger
+    static const size_t cMaxCreateEntitiesBytes = 64 * 1024;
+    /// Entity creations of the ongoing ProcessSyncState not yet sent, as VLE size and entity data for each
+    std::vector<char> pendingCreateEntities_;
+    /// Buffer for crafting CreateEntities messages
+    std::vector<char> createEntitiesBuffer_;
 };
 
 }
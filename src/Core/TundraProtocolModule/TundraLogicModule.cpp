@@ -6,6 +6,7 @@
 #include "TundraLogicModule.h"
 #include "Client.h"
 #include "Server.h"
+#include "ServerBenchmark.h"
 #include "SceneImporter.h"
 #include "SyncManager.h"
 #include "KristalliProtocolModule.h"
@@ -147,6 +148,10 @@ void TundraLogicModule::Initialize()
 
     framework_->Console()->RegisterCommand("disconnect", "Disconnects from a server.", client_.get(), SLOT(Logout()));
 
+    framework_->Console()->RegisterCommand("predictionstats",
+        "Prints the latency, correction and replay statistics of the client-side prediction of the own avatar.",
+        syncManager_.get(), SLOT(PrintClientPredictionStats()));
+
     framework_->Console()->RegisterCommand("savescene",
         "Saves scene into XML or binary. Usage: savescene(filename,asBinary=false,saveTemporaryEntities=false,saveLocalEntities=true)",
         this, SLOT(SaveScene(QString, bool, bool, bool)), SLOT(SaveScene(QString)));
@@ -198,6 +203,17 @@ void TundraLogicModule::Initialize()
         else
             autoStartServerPort_ = GetFramework()->Config()->Get(configData).toInt();
     }
+
+    if (framework_->HasCommandLineParameter("--serverBenchmark"))
+    {
+        if (autoStartServer_)
+            serverBenchmark_ = boost::make_shared<ServerBenchmark>(this);
+        else
+        {
+            LogError("--serverBenchmark requires --server.");
+            GetFramework()->Exit();
+        }
+    }
     
     if (framework_->HasCommandLineParameter("--netrate"))
     {
@@ -216,6 +232,7 @@ void TundraLogicModule::Initialize()
 
 void TundraLogicModule::Uninitialize()
 {
+    serverBenchmark_.reset();
     kristalliModule_ = 0;
     syncManager_.reset();
     client_.reset();
@@ -90,6 +90,7 @@ private:
     boost::shared_ptr<SyncManager> syncManager_; ///< Sync manager
     boost::shared_ptr<Client> client_; ///< Client
     boost::shared_ptr<Server> server_; ///< Server
+    boost::shared_ptr<ServerBenchmark> serverBenchmark_; ///< Server benchmark, exists only when run with --serverBenchmark
     KristalliProtocolModule *kristalliModule_; ///< KristalliProtocolModule pointer
     bool autoStartServer_; ///< Whether to autostart the server
     unsigned short autoStartServerPort_; ///< Autostart server port
@@ -19,9 +19,16 @@ const unsigned long cRemoveEntityMessage = 116;
 const unsigned long cCreateEntityReplyMessage = 117; // Server->client only
 const unsigned long cCreateComponentsReplyMessage = 118; // Server->client only
 const unsigned long cRigidBodyUpdateMessage = 119;
+const unsigned long cCreateEntitiesMessage = 123; // Server->client only, to clients with the "batched-entity-creation" login property
 
 // Entity action
 const unsigned long cEntityActionMessage = 120;
+const unsigned long cEntityActionsMessage = 124; // Batched actions with string tables, see EntityActionCodec
+
+// Client-side prediction, see ClientPrediction
+const unsigned long cInputCommandMessage = 125; // Client->server only
+const unsigned long cInputAckMessage = 126; // Server->client only
+const unsigned long cControlledEntityMessage = 127; // Server->client only, see UserConnection::SetControlledEntity
 
 // Assets
 const unsigned long cAssetDiscoveryMessage = 121;
@@ -22,6 +22,7 @@ namespace TundraLogic
     class Client;
     class Server;
     class SyncManager;
+    class ServerBenchmark;
 }
 
 class UserConnection;
@@ -30,6 +31,8 @@ typedef boost::weak_ptr<UserConnection> UserConnectionWeakPtr;
 typedef std::list<UserConnectionPtr> UserConnectionList;
 
 class SceneSyncState;
+class EntityActionCodec;
+class ClientPrediction;
 struct EntitySyncState;
 struct ComponentSyncState;
 struct UserConnectedResponseData;
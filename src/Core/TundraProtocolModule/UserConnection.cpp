@@ -39,6 +39,15 @@ QString UserConnection::Property(const QString& key) const
         return empty;
 }
 
+void UserConnection::SetControlledEntity(Entity *entity)
+{
+    const entity_id_t id = entity ? entity->Id() : 0;
+    if (id == controlledEntity)
+        return;
+    controlledEntity = id;
+    emit ControlledEntityChanged(this);
+}
+
 void UserConnection::DenyConnection(const QString &reason)
 {
     properties["authenticated"] = "false";
@@ -24,7 +24,7 @@ class TUNDRAPROTOCOL_MODULE_API UserConnection : public QObject, public boost::e
     Q_PROPERTY(int id READ ConnectionId)
 
 public:
-    UserConnection() : userID(0) {}
+    UserConnection() : userID(0), controlledEntity(0) {}
 
     /// Returns the connection ID.
     int ConnectionId() const { return userID; }
@@ -39,6 +39,12 @@ public:
     LoginPropertyMap properties;
     /// Scene sync state, created and used by the SyncManager
     boost::shared_ptr<SceneSyncState> syncState;
+    /// Entity action string tables and pending actions, created and used by the SyncManager
+    boost::shared_ptr<EntityActionCodec> entityActions;
+    /// Inputs received for the client-side prediction of the user's avatar, created and used by the SyncManager
+    boost::shared_ptr<ClientPrediction> prediction;
+    /// ID of the entity controlled by the user, 0 if none
+    entity_id_t controlledEntity;
 
 public slots:
     /// Execute an action on an entity, sent only to the specific user
@@ -57,6 +63,14 @@ public slots:
     /// Returns all the login properties that were used to login to the server.
     LoginPropertyMap LoginProperties() const { return properties; }
 
+    /// Sets the entity controlled by the user, typically the avatar, and tells the client about it.
+    /** The client predicts the motion of the controlled entity when started with --clientPrediction, and the server
+        accepts the prediction inputs only for it. Pass null to clear. */
+    void SetControlledEntity(Entity *entity);
+
+    /// Returns the ID of the entity controlled by the user, or 0 if none.
+    entity_id_t ControlledEntityId() const { return controlledEntity; }
+
     /// Deny connection. Call as a response to server.UserAboutToConnect() if necessary
     void DenyConnection(const QString& reason);
 
@@ -73,4 +87,7 @@ public slots:
 signals:
     /// Emitted when action has been triggered for this specific user connection.
     void ActionTriggered(UserConnection* connection, Entity* entity, const QString& action, const QStringList& params);
+
+    /// Emitted when the controlled entity of this user has been set.
+    void ControlledEntityChanged(UserConnection* connection);
 };
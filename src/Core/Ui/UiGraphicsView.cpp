@@ -21,6 +21,22 @@
 
 using namespace std;
 
+namespace
+{
+
+/// Maximum number of separate dirty rectangles. Further rectangles are merged to the closest existing one.
+const int cMaxDirtyRects = 8;
+
+/// Returns the number of pixels that would be repainted needlessly if the rectangles were merged.
+int MergeCost(const QRect &a, const QRect &b)
+{
+    const QRect united = a.united(b);
+    const QRect overlap = a.intersected(b);
+    return united.width() * united.height() - a.width() * a.height() - b.width() * b.height() + overlap.width() * overlap.height();
+}
+
+}
+
 UiGraphicsView::UiGraphicsView(Framework* fw, QWidget *parent)
 :QGraphicsView(parent), framework(fw), backBuffer(0)
 {
@@ -50,6 +66,7 @@ QImage *UiGraphicsView::BackBuffer() const
 void UiGraphicsView::MarkViewUndirty()
 {
     dirtyRectangle = QRectF(-1, -1, -1, -1);
+    dirtyRects.clear();
 }
 
 bool UiGraphicsView::IsViewDirty() const
@@ -101,6 +118,8 @@ void UiGraphicsView::Resize(int newWidth, int newHeight)
         viewport()->setGeometry(0, 0, newWidth, newHeight);
         scene()->setSceneRect(viewport()->rect());
         dirtyRectangle = QRectF(0, 0, newWidth, newHeight);
+        dirtyRects.clear();
+        dirtyRects.push_back(QRect(0, 0, newWidth, newHeight));
 
         delete backBuffer;
         backBuffer = new QImage(newWidth, newHeight, QImage::Format_ARGB32);
@@ -195,7 +214,11 @@ void UiGraphicsView::HandleSceneChanged(const QList<QRectF> &rectangles)
     // We received an unknown-sized scene change message. Mark everything dirty! (I've no idea what Qt
     // means when it sends a message saying 'nothing changed').
     if (rectangles.size() == 0)
+    {
         dirtyRectangle = QRectF(0, 0, width(), height());
+        dirtyRects.clear();
+        dirtyRects.push_back(QRect(0, 0, width(), height()));
+    }
 #endif
 
     if (!IsViewDirty() && rectangles.size() > 0)
@@ -210,6 +233,7 @@ void UiGraphicsView::HandleSceneChanged(const QList<QRectF> &rectangles)
         dirtyRectangle.setTop(min(dirtyRectangle.top(), rectangles[i].top()-guardbandWidth));
         dirtyRectangle.setRight(max(dirtyRectangle.right(), rectangles[i].right()+guardbandWidth));
         dirtyRectangle.setBottom(max(dirtyRectangle.bottom(), rectangles[i].bottom()+guardbandWidth));
+        AddDirtyRect(rectangles[i].toAlignedRect().adjusted(-guardbandWidth, -guardbandWidth, guardbandWidth, guardbandWidth));
     }
     dirtyRectangle.setLeft(max<int>(dirtyRectangle.left(), 0));
     dirtyRectangle.setTop(max<int>(dirtyRectangle.top(), 0));
@@ -217,6 +241,43 @@ void UiGraphicsView::HandleSceneChanged(const QList<QRectF> &rectangles)
     dirtyRectangle.setBottom(min<int>(dirtyRectangle.bottom(), height()));
 }
 
+void UiGraphicsView::AddDirtyRect(const QRect &rect)
+{
+    QRect r = rect.intersected(QRect(0, 0, width(), height()));
+    if (r.isEmpty())
+        return;
+
+    // Merge with the rectangles that overlap it or are cheaper to repaint together than separately.
+    // A merged rectangle can overlap others it was not merged with, so repeat until nothing merges.
+    for(bool merged = true; merged;)
+    {
+        merged = false;
+        for(int i = 0; i < dirtyRects.size(); ++i)
+            if (r.intersects(dirtyRects[i]) || MergeCost(r, dirtyRects[i]) <= 0)
+            {
+                r = r.united(dirtyRects[i]);
+                dirtyRects.remove(i);
+                merged = true;
+                break;
+            }
+    }
+
+    if (dirtyRects.size() < cMaxDirtyRects)
+    {
+        dirtyRects.push_back(r);
+        return;
+    }
+
+    // Too many rectangles: merge with the one that wastes the least area.
+    int best = 0;
+    for(int i = 1; i < dirtyRects.size(); ++i)
+        if (MergeCost(r, dirtyRects[i]) < MergeCost(r, dirtyRects[best]))
+            best = i;
+    r = r.united(dirtyRects[best]);
+    dirtyRects.remove(best);
+    AddDirtyRect(r);
+}
+
 QGraphicsItem *UiGraphicsView::VisibleItemAtCoords(int x, int y) const
 {
     // Silently just ignore any invalid coordinates we get. (and we do get them, it seems!)
@@ -6,6 +6,7 @@
 #include "UiApiExport.h"
 
 #include <QGraphicsView>
+#include <QVector>
 
 class QDropEvent;
 class QDragEnterEvent;
@@ -37,6 +38,11 @@ public:
     /// Returns the rectangle that represents the dirty area of the screen, pending a Qt repaint.
     QRectF DirtyRectangle() const;
 
+    /// Returns the dirty areas of the screen as separate non-overlapping rectangles, pending a Qt repaint.
+    /** Changes close to each other are merged into one rectangle, so that the rectangles can be repainted and
+        uploaded separately without wasting much work on the area in between. All rectangles are inside the view. */
+    QVector<QRect> DirtyRectangles() const { return dirtyRects; }
+
 public slots:
     /// Returns the topmost visible QGraphicsItem in the given application main window coordinates.
     QGraphicsItem *VisibleItemAtCoords(int x, int y) const;
@@ -72,6 +78,10 @@ private:
     Framework* framework;
     QImage *backBuffer;
     QRectF dirtyRectangle;
+    QVector<QRect> dirtyRects; ///< Dirty rectangles, see DirtyRectangles().
+
+    /// Adds a rectangle to the dirty rectangles, merging it with the existing ones that it overlaps or is close to.
+    void AddDirtyRect(const QRect &rect);
 
     /// This virtual function is overridden from the QGraphicsView original to disable any background drawing functionality.
     /// The main QGraphicsView background displays the 3D scene rendered using Ogre.
@@ -21,6 +21,7 @@
 #include "OgreMaterialUtils.h"
 #include "AssetAPI.h"
 #include "TextureAsset.h"
+#include "HoveringTextBatch.h"
 
 #include <Ogre.h>
 #include <QFile>
@@ -30,6 +31,11 @@
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+const QString cDefaultMaterial = "local://HoveringText.material";
+}
+
 EC_HoveringText::EC_HoveringText(Scene* scene) :
     IComponent(scene),
     font_(QFont("Arial", 100)),
@@ -54,7 +60,7 @@ EC_HoveringText::EC_HoveringText(Scene* scene) :
     texHeight(this, "Texture Height", 256),
     cornerRadius(this, "Corner Radius", float2(20.0, 20.0)),
     enableMipmapping(this, "Enable Mipmapping", true),
-    material(this, "Material", AssetReference("local://HoveringText.material", ""))
+    material(this, "Material", AssetReference(cDefaultMaterial, ""))
 {
     if (scene)
         world_ = scene->GetWorld<OgreWorld>();
@@ -75,6 +81,12 @@ void EC_HoveringText::Destroy()
     if (!ViewEnabled())
         return;
 
+    if (batch_)
+    {
+        batch_->RemoveLabel(this);
+        batch_.reset();
+    }
+
     if (!world_.expired())
     {
         Ogre::SceneManager* sceneMgr = world_.lock()->OgreSceneManager();
@@ -113,7 +125,13 @@ void EC_HoveringText::SetPosition(const float3& position)
     if (!ViewEnabled())
         return;
 
-    if (billboard_)
+    if (batch_)
+    {
+        HoveringTextLabel label = BatchedLabel();
+        label.position = position;
+        batch_->SetLabel(this, label, false);
+    }
+    else if (billboard_)
     {
         billboard_->setPosition(position);
         billboardSet_->_updateBounds(); // Documentation of Ogre::BillboardSet says the update is never called automatically, so now do it manually.
@@ -143,7 +161,9 @@ void EC_HoveringText::Show()
     if (!ViewEnabled())
         return;
 
-    if (billboardSet_)
+    if (batch_)
+        batch_->SetLabelVisible(this, true);
+    else if (billboardSet_)
         billboardSet_->setVisible(true);
 }
 
@@ -152,12 +172,22 @@ void EC_HoveringText::Hide()
     if (!ViewEnabled())
         return;
 
-    if (billboardSet_)
+    if (batch_)
+        batch_->SetLabelVisible(this, false);
+    else if (billboardSet_)
         billboardSet_->setVisible(false);
 }
 
 void EC_HoveringText::SetOverlayAlpha(float alpha)
 {
+    if (batch_)
+    {
+        HoveringTextLabel label = BatchedLabel();
+        label.alpha = alpha;
+        batch_->SetLabel(this, label, false);
+        return;
+    }
+
     Ogre::MaterialManager &mgr = Ogre::MaterialManager::getSingleton();
     Ogre::MaterialPtr material = mgr.getByName(materialName_);
     if (!material.get() || material->getNumTechniques() < 1 || material->getTechnique(0)->getNumPasses() < 1 || material->getTechnique(0)->getPass(0)->getNumTextureUnitStates() < 1)
@@ -169,7 +199,14 @@ void EC_HoveringText::SetOverlayAlpha(float alpha)
 
 void EC_HoveringText::SetBillboardSize(float width, float height)
 {
-    if (billboard_)
+    if (batch_)
+    {
+        HoveringTextLabel label = BatchedLabel();
+        label.width = width;
+        label.height = height;
+        batch_->SetLabel(this, label, true);
+    }
+    else if (billboard_)
     {
         billboard_->setDimensions(width, height);
         // Bug in OGRE: It does not use the actual billboard bounding box size in the computation, but instead guesses it from the "default size", so
@@ -184,7 +221,9 @@ bool EC_HoveringText::IsVisible() const
     if (!ViewEnabled())
         return false;
 
-    if (billboardSet_)
+    if (batch_)
+        return batch_->IsLabelVisible(this);
+    else if (billboardSet_)
         return billboardSet_->isVisible();
     else
         return false;
@@ -217,6 +256,22 @@ void EC_HoveringText::ShowMessage(const QString &text)
     if (!sceneNode)
         return;
 
+    if (CanBatch())
+    {
+        if (billboardSet_)
+            Destroy(); // Switching from the billboard to the batch.
+        if (!batch_)
+            batch_ = HoveringTextBatch::ForWorld(world);
+        UpdateBatchedText(true);
+        return;
+    }
+
+    if (batch_)
+    {
+        batch_->RemoveLabel(this);
+        batch_.reset();
+    }
+
     // Create billboard if it doesn't exist.
     if (!billboardSet_)
     {
@@ -235,7 +290,11 @@ void EC_HoveringText::ShowMessage(const QString &text)
         SetPosition(position.Get());
     }
 
-    Redraw();
+    // The material is not cloned while the text is batched, so it may need to be cloned now.
+    if (materialName_.empty())
+        RecreateMaterial();
+    else
+        Redraw();
 }
 
 void EC_HoveringText::Redraw()
@@ -243,6 +302,12 @@ void EC_HoveringText::Redraw()
     if (!ViewEnabled())
         return;
 
+    if (batch_)
+    {
+        UpdateBatchedText(true);
+        return;
+    }
+
     if (world_.expired() || !billboardSet_ || !billboard_ || materialName_.empty())
         return;
 
@@ -371,8 +436,11 @@ void EC_HoveringText::AttributesChanged()
     // Changes to the following attributes do not alter the texture contents, and don't require a repaint:
     // position, overlayAlpha, width, height.
 
+    // Changing the material or the border may also switch between the batch and the billboard.
+    const bool switchMode = (batch_ || billboardSet_) && (batch_.get() != 0) != CanBatch();
+
     // Repaint the new text with new appearance.
-    if (repaint)
+    if (repaint || switchMode)
         ShowMessage(text.Get());
 }
 
@@ -405,6 +473,9 @@ void EC_HoveringText::RecreateMaterial()
     if (!materialAsset)
         return;
 
+    if (batch_)
+        return; // Batched texts use the materials of the glyph atlas.
+
     DeleteMaterial(); // If we had an old material, free it up to not leak in Ogre.
 
     OgreRenderer::RendererPtr renderer = framework->GetModule<OgreRenderer::OgreRenderingModule>()->GetRenderer();
@@ -438,3 +509,56 @@ void EC_HoveringText::DeleteMaterial()
         materialName_ = "";
     }
 }
+
+bool EC_HoveringText::CanBatch() const
+{
+    if (!ViewEnabled() || world_.expired() || framework->HasCommandLineParameter("--noHoveringTextBatching"))
+        return false;
+    if (material.Get().ref != cDefaultMaterial)
+        return false;
+    return borderThickness.Get() <= 0.f || borderColor.Get().a <= 0.f;
+}
+
+HoveringTextLabel EC_HoveringText::BatchedLabel() const
+{
+    HoveringTextLabel label;
+    Entity *entity = ParentEntity();
+    if (entity)
+        label.placeable = entity->GetComponent<EC_Placeable>();
+    label.position = position.Get();
+    label.text = text.Get();
+    label.text.replace("\\n", "\n");
+    label.fontFamily = font_.family();
+    label.fontSize = font_.pointSize();
+    label.textColor = textColor_;
+    label.width = width.Get();
+    label.height = height.Get();
+    label.texWidth = (int)texWidth.Get();
+    label.texHeight = (int)texHeight.Get();
+    label.cornerRadius = cornerRadius.Get();
+    label.alpha = overlayAlpha.Get();
+
+    // Same colors as the background brush of the unbatched text.
+    if (usingGrad.Get())
+    {
+        QGradientStops stops = bg_grad_.stops();
+        label.background = !stops.isEmpty();
+        if (label.background)
+        {
+            label.backgroundTop = stops.first().second;
+            label.backgroundBottom = stops.last().second;
+        }
+    }
+    else
+    {
+        label.backgroundTop = label.backgroundBottom = backgroundColor.Get();
+        label.background = label.backgroundTop.alpha() > 0;
+    }
+    return label;
+}
+
+void EC_HoveringText::UpdateBatchedText(bool relayout)
+{
+    if (batch_)
+        batch_->SetLabel(this, BatchedLabel(), relayout);
+}
@@ -19,6 +19,9 @@
 #include <QColor>
 #include <QLinearGradient>
 
+class HoveringTextBatch;
+struct HoveringTextLabel;
+
 /// Shows a hovering text attached to an entity.
 /** <table class="header">
     <tr>
@@ -93,7 +96,12 @@
     Does not emit any actions.
 
     <b>Depends on components @ref EC_Placeable "Placeable".</b>
-    </table> */
+    </table>
+
+    Texts using the default material and no border are drawn with the other hovering texts of the scene in a few
+    batches by HoveringTextBatch, from glyphs rasterized once into a shared atlas. The other texts are painted into
+    their own texture and shown with a billboard and a clone of the material. Batching can be disabled with
+    --noHoveringTextBatching. */
 class EC_HoveringText : public IComponent
 {
     Q_OBJECT
@@ -223,7 +231,8 @@ public slots:
     void SetBillboardSize(float width, float height);
 
     /// Gets the name of the material that this component has created for displaying the text.
-    /** Useful for using this just to create the material, and using e.g. a mesh to display it. */
+    /** Useful for using this just to create the material, and using e.g. a mesh to display it.
+        @note Batched texts do not have a material of their own, and return an empty string. */
     QString GetMaterialName() const { return QString::fromStdString(materialName_); }
 
 private slots:
@@ -246,6 +255,17 @@ private:
     /// Recreates the internal cloned material from the currently specified material asset reference (that is assumed to be loaded already).
     void RecreateMaterial();
 
+    /// Returns whether the text can be drawn in the shared HoveringTextBatch of the scene.
+    /** A custom material or a border can only be drawn by painting the text into its own texture. */
+    bool CanBatch() const;
+
+    /// Returns the appearance of the text for the HoveringTextBatch.
+    HoveringTextLabel BatchedLabel() const;
+
+    /// Updates the text in the HoveringTextBatch.
+    /** @param relayout Has the text, font, colors or size changed. */
+    void UpdateBatchedText(bool relayout);
+
     /// Ogre world pointer.
     OgreWorldWeakPtr world_;
     
@@ -275,4 +295,7 @@ private:
     TextureAssetPtr texture_;
 
     AssetRefListener materialAsset;
+
+    /// Shared batch drawing the text, or null if the text is drawn with its own billboard.
+    boost::shared_ptr<HoveringTextBatch> batch_;
 };
@@ -0,0 +1,231 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   GlyphAtlas.cpp
+    @brief  Rasterizes glyphs once into shared textures. */
+
+#include "DebugOperatorNew.h"
+
+#include "GlyphAtlas.h"
+#include "Profiler.h"
+#include "LoggingFunctions.h"
+
+#include <Ogre.h>
+#include <QFontMetricsF>
+#include <QPainter>
+
+#include <algorithm>
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+const int cPageSize = 1024; ///< Width and height of a page.
+const int cSolidSize = 8; ///< Size of the solid white block at the top-left corner of a page.
+const int cCornerX = cSolidSize + 8; ///< Left edge of the rounded corner mask.
+const int cCornerSize = 64; ///< Size of the rounded corner mask.
+const int cPadding = 1; ///< Transparent pixels around each glyph, so that bilinear filtering does not bleed from the neighbours.
+}
+
+GlyphAtlas::GlyphAtlas(const std::string &namePrefix) :
+    prefix(namePrefix),
+    metricsDevice(1, 1, QImage::Format_ARGB32)
+{
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    for(size_t i = 0; i < pages.size(); ++i)
+    {
+        try
+        {
+            Ogre::MaterialManager::getSingleton().remove(pages[i].materialName);
+        }
+        catch(...) {}
+        try
+        {
+            Ogre::TextureManager::getSingleton().remove(pages[i].textureName);
+        }
+        catch(...) {}
+    }
+
+    foreach(FontData *font, fonts)
+    {
+        delete font->metrics;
+        delete font;
+    }
+}
+
+GlyphAtlas::FontData &GlyphAtlas::Font(const QString &family)
+{
+    QHash<QString, FontData *>::iterator iter = fonts.find(family);
+    if (iter != fonts.end())
+        return **iter;
+
+    FontData *data = new FontData;
+    data->font = QFont(family);
+    data->font.setPointSize(cRasterPointSize);
+    data->metrics = new QFontMetricsF(data->font, &metricsDevice);
+    data->vertical.ascent = (float)data->metrics->ascent();
+    data->vertical.height = (float)data->metrics->height();
+    data->vertical.lineSpacing = (float)data->metrics->lineSpacing();
+    fonts[family] = data;
+    return *data;
+}
+
+const GlyphAtlas::FontMetrics &GlyphAtlas::Metrics(const QString &family)
+{
+    return Font(family).vertical;
+}
+
+const GlyphAtlas::Glyph &GlyphAtlas::GetGlyph(const QString &family, QChar ch)
+{
+    FontData &font = Font(family);
+    QHash<ushort, Glyph>::iterator iter = font.glyphs.find(ch.unicode());
+    if (iter != font.glyphs.end())
+        return *iter;
+
+    Glyph glyph;
+    glyph.advance = (float)font.metrics->width(ch);
+
+    const QRectF bounds = font.metrics->boundingRect(ch);
+    if (!ch.isSpace() && !bounds.isEmpty())
+    {
+        const int x0 = (int)floor(bounds.left());
+        const int y0 = (int)floor(bounds.top());
+        const int w = (int)ceil(bounds.right()) - x0 + 2 * cPadding;
+        const int h = (int)ceil(bounds.bottom()) - y0 + 2 * cPadding;
+
+        QPoint pos;
+        const int page = Allocate(w, h, pos);
+        if (page >= 0)
+        {
+            PROFILE(GlyphAtlas_RasterizeGlyph);
+            {
+                QPainter painter(&pages[page].image);
+                painter.setRenderHint(QPainter::TextAntialiasing);
+                painter.setFont(font.font);
+                painter.setPen(Qt::white);
+                painter.drawText(QPointF(pos.x() + cPadding - x0, pos.y() + cPadding - y0), QString(ch));
+            }
+            pages[page].dirty |= QRect(pos, QSize(w, h));
+
+            glyph.page = page;
+            glyph.u0 = (float)pos.x() / cPageSize;
+            glyph.v0 = (float)pos.y() / cPageSize;
+            glyph.u1 = (float)(pos.x() + w) / cPageSize;
+            glyph.v1 = (float)(pos.y() + h) / cPageSize;
+            glyph.left = (float)(x0 - cPadding);
+            glyph.top = (float)(y0 - cPadding);
+            glyph.width = (float)w;
+            glyph.height = (float)h;
+        }
+        else
+            LogWarning(QString("GlyphAtlas: Glyph '%1' of font \"%2\" is too large for the atlas.").arg(ch).arg(family));
+    }
+
+    return *font.glyphs.insert(ch.unicode(), glyph);
+}
+
+void GlyphAtlas::SolidUV(float &u, float &v) const
+{
+    u = v = (cSolidSize * 0.5f) / cPageSize;
+}
+
+void GlyphAtlas::CornerUV(float &u0, float &v0, float &u1, float &v1) const
+{
+    // Inset the opaque edges by half a texel, so that they are not filtered with the transparent padding.
+    u0 = (float)cCornerX / cPageSize;
+    v0 = 0.f;
+    u1 = (cCornerX + cCornerSize - 0.5f) / cPageSize;
+    v1 = (cCornerSize - 0.5f) / cPageSize;
+}
+
+void GlyphAtlas::AddPage()
+{
+    PROFILE(GlyphAtlas_AddPage);
+
+    Page page;
+    page.textureName = prefix + "_page" + QString::number(pages.size()).toStdString();
+    page.materialName = page.textureName + "_material";
+    page.image = QImage(cPageSize, cPageSize, QImage::Format_ARGB32);
+    page.image.fill(0);
+    {
+        QPainter painter(&page.image);
+        painter.fillRect(0, 0, cSolidSize, cSolidSize, Qt::white);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setClipRect(cCornerX, 0, cCornerSize, cCornerSize);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(Qt::white);
+        painter.drawEllipse(QRectF(cCornerX, 0, 2 * cCornerSize, 2 * cCornerSize));
+    }
+    page.shelfX = cCornerX + cCornerSize + cPadding;
+    page.shelfY = 0;
+    page.shelfHeight = cCornerSize;
+    page.dirty = page.image.rect();
+
+    Ogre::TextureManager::getSingleton().createManual(page.textureName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+        Ogre::TEX_TYPE_2D, cPageSize, cPageSize, 0, Ogre::PF_A8R8G8B8, Ogre::TU_DEFAULT);
+
+    Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(page.materialName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    material->setReceiveShadows(false);
+    Ogre::Pass *pass = material->getTechnique(0)->getPass(0);
+    pass->setLightingEnabled(false);
+    pass->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+    pass->setDepthWriteEnabled(false);
+    pass->setCullingMode(Ogre::CULL_NONE);
+    Ogre::TextureUnitState *textureUnit = pass->createTextureUnitState(page.textureName);
+    textureUnit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+
+    pages.push_back(page);
+}
+
+int GlyphAtlas::Allocate(int w, int h, QPoint &pos)
+{
+    if (w > cPageSize || h > cPageSize)
+        return -1;
+    if (pages.empty())
+        AddPage();
+
+    for(;;)
+    {
+        Page &page = pages.back();
+        if (page.shelfX + w > cPageSize)
+        {
+            // Start a new shelf below the current one.
+            page.shelfY += page.shelfHeight + cPadding;
+            page.shelfX = 0;
+            page.shelfHeight = 0;
+        }
+        if (page.shelfY + h <= cPageSize)
+        {
+            pos = QPoint(page.shelfX, page.shelfY);
+            page.shelfX += w + cPadding;
+            page.shelfHeight = std::max(page.shelfHeight, h);
+            return (int)pages.size() - 1;
+        }
+        AddPage();
+    }
+}
+
+void GlyphAtlas::Upload()
+{
+    for(size_t i = 0; i < pages.size(); ++i)
+    {
+        Page &page = pages[i];
+        if (page.dirty.isEmpty())
+            continue;
+
+        PROFILE(GlyphAtlas_Upload);
+        Ogre::TexturePtr texture = Ogre::TextureManager::getSingleton().getByName(page.textureName);
+        if (!texture.isNull())
+        {
+            // The pixel box spans the whole page, so the subvolume refers to the changed rows in place.
+            Ogre::PixelBox image(cPageSize, cPageSize, 1, Ogre::PF_A8R8G8B8, (void *)page.image.constBits());
+            Ogre::Box box(page.dirty.left(), page.dirty.top(), page.dirty.right() + 1, page.dirty.bottom() + 1);
+            texture->getBuffer()->blitFromMemory(image.getSubVolume(box), box);
+        }
+        page.dirty = QRect();
+    }
+}
@@ -0,0 +1,123 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   GlyphAtlas.h
+    @brief  Rasterizes glyphs once into shared textures. */
+
+#pragma once
+
+#include <QImage>
+#include <QFont>
+#include <QHash>
+#include <QRect>
+#include <QString>
+
+#include <string>
+#include <vector>
+
+class QFontMetricsF;
+
+/// Rasterizes the glyphs used by the hovering texts once into a few shared textures, called pages.
+/** The glyphs are rasterized in white with the coverage in alpha, so that they can be drawn in any color with vertex colors.
+    All glyphs of a font family are rasterized at the same size, cRasterPointSize, and scaled when drawn.
+    In addition to the glyphs, each page contains a solid white block for drawing backgrounds, and a mask of a quarter
+    of a disc for drawing rounded corners.
+
+    Each page has an Ogre texture and a material using it. The pages are only modified on the CPU side when new glyphs
+    are added, and the changed areas are uploaded to the textures by Upload(). */
+class GlyphAtlas
+{
+public:
+    /// Point size the glyphs are rasterized at.
+    static const int cRasterPointSize = 32;
+
+    /// Placement of a rasterized glyph.
+    struct Glyph
+    {
+        Glyph() : page(-1), u0(0), v0(0), u1(0), v1(0), left(0), top(0), width(0), height(0), advance(0) {}
+
+        int page; ///< Page containing the glyph, or -1 if the glyph has no pixels, e.g. a space.
+        float u0, v0, u1, v1; ///< Texture coordinates of the glyph image on the page.
+        float left; ///< Offset from the pen position to the left edge of the glyph image, in pixels.
+        float top; ///< Offset from the baseline to the top edge of the glyph image, downwards in pixels.
+        float width; ///< Width of the glyph image in pixels.
+        float height; ///< Height of the glyph image in pixels.
+        float advance; ///< Horizontal advance of the pen in pixels.
+    };
+
+    /// Vertical metrics of a font family at cRasterPointSize.
+    struct FontMetrics
+    {
+        float ascent; ///< Distance from the top of a line to the baseline in pixels.
+        float height; ///< Height of a line in pixels.
+        float lineSpacing; ///< Distance between the baselines of consecutive lines in pixels.
+    };
+
+    /// Constructor.
+    /** @param namePrefix Unique prefix for the names of the Ogre textures and materials of the pages. */
+    explicit GlyphAtlas(const std::string &namePrefix);
+
+    /// Destroys the textures and materials of the pages.
+    ~GlyphAtlas();
+
+    /// Returns the glyph of a character, rasterizing it if it has not been used before.
+    const Glyph &GetGlyph(const QString &family, QChar ch);
+
+    /// Returns the metrics of a font family.
+    const FontMetrics &Metrics(const QString &family);
+
+    /// Returns the number of pages.
+    int NumPages() const { return (int)pages.size(); }
+
+    /// Returns the name of the Ogre material of a page.
+    const std::string &MaterialName(int page) const { return pages[page].materialName; }
+
+    /// Returns the texture coordinates of the solid white block of a page.
+    /** All the vertices of a solid quad use the same coordinates, in the middle of the block. */
+    void SolidUV(float &u, float &v) const;
+
+    /// Returns the texture coordinates of the rounded corner mask of a page.
+    /** The coordinates map the mask to the top-left corner of a rectangle: (u0, v0) is fully outside the rounded corner,
+        and the edges at u1 and v1 are fully inside. Swap the coordinates to get the other corners. */
+    void CornerUV(float &u0, float &v0, float &u1, float &v1) const;
+
+    /// Uploads the changed areas of the pages to their textures.
+    void Upload();
+
+private:
+    /// One texture of the atlas.
+    struct Page
+    {
+        QImage image;
+        std::string textureName;
+        std::string materialName;
+        int shelfX; ///< Position of the next glyph on the current shelf.
+        int shelfY; ///< Top of the current shelf.
+        int shelfHeight; ///< Height of the tallest glyph on the current shelf.
+        QRect dirty; ///< Area changed since the last upload.
+    };
+
+    /// Glyphs and metrics of one font family.
+    struct FontData
+    {
+        QFont font;
+        QFontMetricsF *metrics;
+        FontMetrics vertical;
+        QHash<ushort, Glyph> glyphs;
+    };
+
+    /// Returns the data of a font family, creating it if needed.
+    FontData &Font(const QString &family);
+
+    /// Creates a new page with its texture and material.
+    void AddPage();
+
+    /// Reserves an area of w x h pixels, adding a page if the current one is full.
+    /** @return Index of the page. */
+    int Allocate(int w, int h, QPoint &pos);
+
+    std::string prefix;
+    std::vector<Page> pages;
+    QHash<QString, FontData *> fonts;
+    QImage metricsDevice; ///< Paint device for the font metrics, so that they match the rasterized glyphs.
+};
@@ -0,0 +1,445 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   HoveringTextBatch.cpp
+    @brief  Draws the hovering texts of a scene in a few batches. */
+
+#include "DebugOperatorNew.h"
+
+#include "HoveringTextBatch.h"
+#include "EC_Placeable.h"
+#include "OgreWorld.h"
+#include "Renderer.h"
+#include "Framework.h"
+#include "ConfigAPI.h"
+#include "Profiler.h"
+
+#include <Ogre.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+const float cDefaultFadeDistance = 50.f;
+const float cDefaultCullDistance = 100.f;
+
+/// A line of a laid out text: the characters [start, end) and their width in pixels.
+struct TextLine
+{
+    int start;
+    int end;
+    float width;
+};
+
+typedef std::map<OgreWorld *, boost::weak_ptr<HoveringTextBatch> > BatchMap;
+BatchMap batches; ///< The batches of the worlds.
+
+Color Lerp(const Color &a, const Color &b, float t)
+{
+    return Color(a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t, a.a + (b.a - a.a) * t);
+}
+
+Ogre::ColourValue Faded(const Color &color, float alpha)
+{
+    return Ogre::ColourValue(color.r, color.g, color.b, color.a * alpha);
+}
+}
+
+/// Updates the batch for the camera of each viewport before the scene is culled.
+class HoveringTextBatch::CameraListener : public Ogre::SceneManager::Listener
+{
+public:
+    explicit CameraListener(HoveringTextBatch *batch_) : batch(batch_) {}
+
+    virtual void preFindVisibleObjects(Ogre::SceneManager * /*source*/, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport *v)
+    {
+        // The texts do not cast shadows, so the shadow texture passes can be skipped.
+        if (irs != Ogre::SceneManager::IRS_RENDER_TO_TEXTURE && v && v->getCamera())
+            batch->Update(v->getCamera());
+    }
+
+private:
+    HoveringTextBatch *batch;
+};
+
+struct HoveringTextBatch::VisibleLabel
+{
+    const LabelData *label;
+    Ogre::Vector3 pos; ///< World position.
+    float alpha; ///< Alpha multiplier including the fade.
+};
+
+boost::shared_ptr<HoveringTextBatch> HoveringTextBatch::ForWorld(const OgreWorldPtr &world)
+{
+    boost::weak_ptr<HoveringTextBatch> &existing = batches[world.get()];
+    boost::shared_ptr<HoveringTextBatch> batch = existing.lock();
+    // A new world may have been created at the address of a destroyed one, whose batch is still alive.
+    if (!batch || batch->world.lock() != world)
+    {
+        batch = boost::shared_ptr<HoveringTextBatch>(new HoveringTextBatch(world));
+        existing = batch;
+    }
+    return batch;
+}
+
+HoveringTextBatch::HoveringTextBatch(const OgreWorldPtr &world_) :
+    world(world_),
+    worldKey(world_.get()),
+    atlas(world_->GenerateUniqueObjectName("HoveringTextAtlas")),
+    object(0),
+    node(0),
+    listener(0),
+    fadeDistance(cDefaultFadeDistance),
+    cullDistance(cDefaultCullDistance)
+{
+    Framework *framework = world_->Renderer()->GetFramework();
+    ConfigData configData(ConfigAPI::FILE_FRAMEWORK, ConfigAPI::SECTION_RENDERING);
+    SetFadeDistances(framework->Config()->Get(configData, "hovering text fade distance", cDefaultFadeDistance).toFloat(),
+        framework->Config()->Get(configData, "hovering text cull distance", cDefaultCullDistance).toFloat());
+
+    Ogre::SceneManager *sceneMgr = world_->OgreSceneManager();
+    const std::string name = world_->GenerateUniqueObjectName("HoveringTextBatch");
+    object = sceneMgr->createManualObject(name);
+    object->setDynamic(true);
+    object->setCastShadows(false);
+    object->setQueryFlags(0); // The texts are not hit by raycasts, like they were not when drawn as billboards.
+    object->setVisible(false);
+    node = sceneMgr->getRootSceneNode()->createChildSceneNode(name + "_node");
+    node->attachObject(object);
+
+    listener = new CameraListener(this);
+    sceneMgr->addListener(listener);
+}
+
+HoveringTextBatch::~HoveringTextBatch()
+{
+    BatchMap::iterator iter = batches.find(worldKey);
+    if (iter != batches.end() && iter->second.expired())
+        batches.erase(iter);
+
+    // If the world is already gone, the scene manager has destroyed our objects with it.
+    if (!world.expired())
+    {
+        Ogre::SceneManager *sceneMgr = world.lock()->OgreSceneManager();
+        try
+        {
+            sceneMgr->removeListener(listener);
+            node->detachObject(object);
+            sceneMgr->destroyManualObject(object);
+            sceneMgr->destroySceneNode(node);
+        }
+        catch(...) {}
+    }
+
+    delete listener;
+}
+
+void HoveringTextBatch::SetLabel(EC_HoveringText *owner, const HoveringTextLabel &label, bool relayout)
+{
+    std::map<EC_HoveringText *, LabelData>::iterator iter = labels.find(owner);
+    if (iter == labels.end())
+    {
+        iter = labels.insert(std::make_pair(owner, LabelData())).first;
+        relayout = true;
+    }
+
+    iter->second.desc = label;
+    if (relayout)
+        Layout(iter->second);
+}
+
+void HoveringTextBatch::RemoveLabel(EC_HoveringText *owner)
+{
+    labels.erase(owner);
+}
+
+void HoveringTextBatch::SetLabelVisible(EC_HoveringText *owner, bool visible)
+{
+    std::map<EC_HoveringText *, LabelData>::iterator iter = labels.find(owner);
+    if (iter != labels.end())
+        iter->second.visible = visible;
+}
+
+bool HoveringTextBatch::IsLabelVisible(EC_HoveringText *owner) const
+{
+    std::map<EC_HoveringText *, LabelData>::const_iterator iter = labels.find(owner);
+    return iter != labels.end() && iter->second.visible && !iter->second.quads.empty();
+}
+
+void HoveringTextBatch::SetFadeDistances(float fadeDistance_, float cullDistance_)
+{
+    cullDistance = std::max(0.f, cullDistance_);
+    fadeDistance = std::min(std::max(0.f, fadeDistance_), cullDistance);
+}
+
+void HoveringTextBatch::AddQuad(LabelData &label, float px0, float py0, float px1, float py1, float u0, float v0, float u1, float v1,
+    int page, const Color &top, const Color &bottom)
+{
+    const HoveringTextLabel &desc = label.desc;
+    const float sx = desc.width / desc.texWidth;
+    const float sy = desc.height / desc.texHeight;
+
+    Quad quad;
+    quad.x0 = (px0 - desc.texWidth * 0.5f) * sx;
+    quad.y0 = (desc.texHeight * 0.5f - py0) * sy;
+    quad.x1 = (px1 - desc.texWidth * 0.5f) * sx;
+    quad.y1 = (desc.texHeight * 0.5f - py1) * sy;
+    quad.u0 = u0;
+    quad.v0 = v0;
+    quad.u1 = u1;
+    quad.v1 = v1;
+    quad.top = top;
+    quad.bottom = bottom;
+    quad.page = page;
+    label.quads.push_back(quad);
+
+    const float x = std::max(fabs(quad.x0), fabs(quad.x1));
+    const float y = std::max(fabs(quad.y0), fabs(quad.y1));
+    label.radius = std::max(label.radius, sqrtf(x * x + y * y));
+}
+
+void HoveringTextBatch::Layout(LabelData &label)
+{
+    PROFILE(HoveringTextBatch_Layout);
+
+    label.quads.clear();
+    label.radius = 0.f;
+
+    const HoveringTextLabel &desc = label.desc;
+    const QString &text = desc.text;
+    if (text.isEmpty() || desc.texWidth <= 0 || desc.texHeight <= 0 || desc.fontSize <= 0)
+        return;
+
+    const float scale = (float)desc.fontSize / GlyphAtlas::cRasterPointSize;
+    const GlyphAtlas::FontMetrics metrics = atlas.Metrics(desc.fontFamily);
+
+    // Break the text into lines at line breaks, and wrap the words at the texture width like Qt::TextWordWrap does.
+    std::vector<TextLine> lines;
+    std::vector<float> advances(text.size());
+    for(int i = 0; i < text.size(); ++i)
+        advances[i] = text[i] == '\n' ? 0.f : atlas.GetGlyph(desc.fontFamily, text[i]).advance * scale;
+
+    TextLine line = { 0, 0, 0.f };
+    for(int i = 0; i <= text.size();)
+    {
+        if (i == text.size() || text[i] == '\n')
+        {
+            lines.push_back(line);
+            ++i;
+            line.start = line.end = i;
+            line.width = 0.f;
+            continue;
+        }
+
+        int wordStart = i;
+        float spaceWidth = 0.f;
+        while(wordStart < text.size() && text[wordStart].isSpace() && text[wordStart] != '\n')
+            spaceWidth += advances[wordStart++];
+        int wordEnd = wordStart;
+        float wordWidth = 0.f;
+        while(wordEnd < text.size() && !text[wordEnd].isSpace())
+            wordWidth += advances[wordEnd++];
+
+        if (line.end > line.start && line.width + spaceWidth + wordWidth > desc.texWidth)
+        {
+            lines.push_back(line);
+            line.start = wordStart;
+            line.width = wordWidth;
+        }
+        else
+            line.width += spaceWidth + wordWidth;
+        line.end = wordEnd;
+        i = wordEnd;
+    }
+
+    // Center the lines, and find the bounding rectangle of the text for the background.
+    const float lineSpacing = metrics.lineSpacing * scale;
+    const float blockHeight = metrics.height * scale + (float)(lines.size() - 1) * lineSpacing;
+    const float top = (desc.texHeight - blockHeight) * 0.5f;
+    float left = (float)desc.texWidth;
+    float right = 0.f;
+    for(size_t i = 0; i < lines.size(); ++i)
+    {
+        left = std::min(left, (desc.texWidth - lines[i].width) * 0.5f);
+        right = std::max(right, (desc.texWidth + lines[i].width) * 0.5f);
+    }
+
+    // The background is drawn on the same page as the glyphs, so that the quads of a text stay in drawing order.
+    int page = 0;
+    for(int i = 0; i < text.size(); ++i)
+    {
+        const int glyphPage = text[i] == '\n' ? -1 : atlas.GetGlyph(desc.fontFamily, text[i]).page;
+        if (glyphPage >= 0)
+        {
+            page = glyphPage;
+            break;
+        }
+    }
+
+    if (desc.background && right > left && atlas.NumPages() > 0)
+    {
+        const float bottom = top + blockHeight;
+        const Color colorTop = desc.backgroundTop;
+        const Color colorBottom = desc.backgroundBottom;
+        // The gradient spans the texture space, like the gradient brush of the unbatched text.
+        const float t0 = std::min(std::max(top / desc.texHeight, 0.f), 1.f);
+        const float t1 = std::min(std::max(bottom / desc.texHeight, 0.f), 1.f);
+
+        float su, sv;
+        atlas.SolidUV(su, sv);
+
+        // Like QPainter::drawRoundedRect with Qt::RelativeSize, the radii are percents of the half width and height.
+        const float rx = std::min(std::max(desc.cornerRadius.x, 0.f), 100.f) * 0.01f * (right - left) * 0.5f;
+        const float ry = std::min(std::max(desc.cornerRadius.y, 0.f), 100.f) * 0.01f * blockHeight * 0.5f;
+        if (rx <= 0.f || ry <= 0.f)
+            AddQuad(label, left, top, right, bottom, su, sv, su, sv, page, Lerp(colorTop, colorBottom, t0), Lerp(colorTop, colorBottom, t1));
+        else
+        {
+            // Draw the rounded rectangle as nine quads: the corners from the corner mask, and the rest solid.
+            float cu0, cv0, cu1, cv1;
+            atlas.CornerUV(cu0, cv0, cu1, cv1);
+            const float xs[4] = { left, left + rx, right - rx, right };
+            const float ys[4] = { top, top + ry, bottom - ry, bottom };
+            Color colors[4];
+            for(int i = 0; i < 4; ++i)
+                colors[i] = Lerp(colorTop, colorBottom, std::min(std::max(ys[i] / desc.texHeight, 0.f), 1.f));
+
+            for(int row = 0; row < 3; ++row)
+                for(int col = 0; col < 3; ++col)
+                {
+                    if (xs[col + 1] <= xs[col] || ys[row + 1] <= ys[row])
+                        continue;
+                    if (row == 1 || col == 1)
+                        AddQuad(label, xs[col], ys[row], xs[col + 1], ys[row + 1], su, sv, su, sv, page, colors[row], colors[row + 1]);
+                    else
+                    {
+                        // Mirror the top-left corner mask for the other corners.
+                        const float u0 = col == 0 ? cu0 : cu1;
+                        const float u1 = col == 0 ? cu1 : cu0;
+                        const float v0 = row == 0 ? cv0 : cv1;
+                        const float v1 = row == 0 ? cv1 : cv0;
+                        AddQuad(label, xs[col], ys[row], xs[col + 1], ys[row + 1], u0, v0, u1, v1, page, colors[row], colors[row + 1]);
+                    }
+                }
+        }
+    }
+
+    const Color textColor = desc.textColor;
+    for(size_t i = 0; i < lines.size(); ++i)
+    {
+        float penX = (desc.texWidth - lines[i].width) * 0.5f;
+        const float baseline = top + metrics.ascent * scale + i * lineSpacing;
+        for(int j = lines[i].start; j < lines[i].end; ++j)
+        {
+            const GlyphAtlas::Glyph glyph = atlas.GetGlyph(desc.fontFamily, text[j]);
+            if (glyph.page >= 0)
+            {
+                const float x0 = penX + glyph.left * scale;
+                const float y0 = baseline + glyph.top * scale;
+                AddQuad(label, x0, y0, x0 + glyph.width * scale, y0 + glyph.height * scale,
+                    glyph.u0, glyph.v0, glyph.u1, glyph.v1, glyph.page, textColor, textColor);
+            }
+            penX += advances[j];
+        }
+    }
+}
+
+void HoveringTextBatch::Update(Ogre::Camera *camera)
+{
+    PROFILE(HoveringTextBatch_Update);
+
+    atlas.Upload();
+
+    const Ogre::Vector3 cameraPos = camera->getDerivedPosition();
+    const Ogre::Vector3 right = camera->getDerivedRight();
+    const Ogre::Vector3 up = camera->getDerivedUp();
+
+    // Find the texts that are shown to the camera, and count the quads of each page.
+    std::vector<VisibleLabel> visible;
+    std::vector<int> numQuads(atlas.NumPages(), 0);
+    for(std::map<EC_HoveringText *, LabelData>::const_iterator iter = labels.begin(); iter != labels.end(); ++iter)
+    {
+        const LabelData &label = iter->second;
+        if (!label.visible || label.quads.empty() || label.desc.alpha <= 0.f)
+            continue;
+        boost::shared_ptr<EC_Placeable> placeable = label.desc.placeable.lock();
+        if (!placeable || !placeable->visible.Get() || !placeable->GetSceneNode() || !placeable->GetSceneNode()->isInSceneGraph())
+            continue;
+
+        const float3 &position = label.desc.position;
+        VisibleLabel shown;
+        shown.label = &label;
+        shown.pos = placeable->GetSceneNode()->_getFullTransform() * Ogre::Vector3(position.x, position.y, position.z);
+
+        const float distance = cameraPos.distance(shown.pos);
+        if (distance > cullDistance || !camera->isVisible(Ogre::Sphere(shown.pos, label.radius)))
+            continue;
+        shown.alpha = label.desc.alpha;
+        if (distance > fadeDistance)
+            shown.alpha *= (cullDistance - distance) / (cullDistance - fadeDistance);
+
+        visible.push_back(shown);
+        for(size_t i = 0; i < label.quads.size(); ++i)
+            ++numQuads[label.quads[i].page];
+    }
+
+    std::vector<int> pages;
+    for(size_t i = 0; i < numQuads.size(); ++i)
+        if (numQuads[i] > 0)
+            pages.push_back((int)i);
+
+    // Reuse the sections of the object if the same pages are drawn as on the previous update.
+    const bool reuseSections = pages == sectionPages;
+    if (!reuseSections)
+        object->clear();
+
+    for(size_t s = 0; s < pages.size(); ++s)
+    {
+        const int page = pages[s];
+        if (reuseSections)
+            object->beginUpdate(s);
+        else
+            object->begin(atlas.MaterialName(page), Ogre::RenderOperation::OT_TRIANGLE_LIST);
+        object->estimateVertexCount(numQuads[page] * 4);
+        object->estimateIndexCount(numQuads[page] * 6);
+
+        Ogre::uint32 index = 0;
+        for(size_t i = 0; i < visible.size(); ++i)
+        {
+            const std::vector<Quad> &quads = visible[i].label->quads;
+            const Ogre::Vector3 &pos = visible[i].pos;
+            const float alpha = visible[i].alpha;
+            for(size_t j = 0; j < quads.size(); ++j)
+            {
+                const Quad &q = quads[j];
+                if (q.page != page)
+                    continue;
+                const Ogre::ColourValue top = Faded(q.top, alpha);
+                const Ogre::ColourValue bottom = Faded(q.bottom, alpha);
+                object->position(pos + right * q.x0 + up * q.y0);
+                object->colour(top);
+                object->textureCoord(q.u0, q.v0);
+                object->position(pos + right * q.x0 + up * q.y1);
+                object->colour(bottom);
+                object->textureCoord(q.u0, q.v1);
+                object->position(pos + right * q.x1 + up * q.y1);
+                object->colour(bottom);
+                object->textureCoord(q.u1, q.v1);
+                object->position(pos + right * q.x1 + up * q.y0);
+                object->colour(top);
+                object->textureCoord(q.u1, q.v0);
+                object->quad(index, index + 1, index + 2, index + 3);
+                index += 4;
+            }
+        }
+        object->end();
+    }
+    sectionPages = pages;
+
+    // The quads move with the camera, so keep the object from being culled as a whole. The texts are culled above.
+    object->setBoundingBox(Ogre::AxisAlignedBox(Ogre::AxisAlignedBox::EXTENT_INFINITE));
+    object->setVisible(!pages.empty());
+}
@@ -0,0 +1,134 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   HoveringTextBatch.h
+    @brief  Draws the hovering texts of a scene in a few batches. */
+
+#pragma once
+
+#include "OgreModuleFwd.h"
+#include "GlyphAtlas.h"
+#include "Color.h"
+#include "Math/float2.h"
+#include "Math/float3.h"
+
+#include <QString>
+#include <QColor>
+
+#include <map>
+#include <vector>
+
+class EC_HoveringText;
+class EC_Placeable;
+
+/// Appearance of one hovering text drawn by HoveringTextBatch.
+struct HoveringTextLabel
+{
+    HoveringTextLabel() : fontSize(0), background(false), width(1.f), height(1.f), texWidth(256), texHeight(256), alpha(1.f) {}
+
+    boost::weak_ptr<EC_Placeable> placeable; ///< Placeable the text is attached to.
+    float3 position; ///< Position relative to the placeable.
+    QString text; ///< Text, with "\n" for line breaks.
+    QString fontFamily; ///< Font family.
+    int fontSize; ///< Font size in points of the texture space.
+    QColor textColor; ///< Color of the text.
+    bool background; ///< Is the background drawn.
+    QColor backgroundTop; ///< Color of the background at the top of the texture space.
+    QColor backgroundBottom; ///< Color of the background at the bottom of the texture space.
+    float2 cornerRadius; ///< Radii of the background corners, in percents of the half width and height of the background.
+    float width; ///< World space width of the texture space.
+    float height; ///< World space height of the texture space.
+    int texWidth; ///< Width of the texture space in pixels, used for wrapping the text.
+    int texHeight; ///< Height of the texture space in pixels.
+    float alpha; ///< Alpha multiplier of the whole text.
+};
+
+/// Draws the hovering texts of an Ogre world as camera-facing quads in a few batches.
+/** Instead of painting each text into its own texture and drawing it with its own material, the glyphs are rasterized
+    once into a GlyphAtlas, and the texts are laid out as quads textured from the atlas. The quads of all the texts
+    are drawn with a single dynamic Ogre::ManualObject, with one section, i.e. one batch, for each page of the atlas.
+
+    The texts are laid out in the texture space of the EC_HoveringText, like the texture of the unbatched text,
+    and the layout is redone only when the appearance of a text changes. Before the scene is culled for a viewport,
+    the laid out quads of the visible texts are placed to face its camera. The texts farther than the cull distance
+    are skipped, and the texts between the fade and cull distances are faded out. The distances are read from the
+    "hovering text fade distance" and "hovering text cull distance" keys of the rendering config.
+
+    One batch is shared by all the EC_HoveringText components of a world, and it is destroyed when the last one releases it. */
+class HoveringTextBatch
+{
+public:
+    /// Returns the batch of the world, creating it if it does not exist.
+    static boost::shared_ptr<HoveringTextBatch> ForWorld(const OgreWorldPtr &world);
+
+    /// Destroys the Ogre objects of the batch.
+    ~HoveringTextBatch();
+
+    /// Adds the text of a component or updates it.
+    /** @param owner Component owning the text.
+        @param label Appearance of the text.
+        @param relayout Has the text, font or size changed, so that the text needs to be laid out again. */
+    void SetLabel(EC_HoveringText *owner, const HoveringTextLabel &label, bool relayout);
+
+    /// Removes the text of a component.
+    void RemoveLabel(EC_HoveringText *owner);
+
+    /// Sets whether the text of a component is shown.
+    void SetLabelVisible(EC_HoveringText *owner, bool visible);
+
+    /// Returns whether the text of a component is shown.
+    bool IsLabelVisible(EC_HoveringText *owner) const;
+
+    /// Sets the distance from the camera at which the texts start to fade out, and the distance after which they are not drawn.
+    void SetFadeDistances(float fadeDistance, float cullDistance);
+
+    /// Places the quads of the visible texts to face the camera.
+    /** Called automatically before the scene is culled for each viewport. */
+    void Update(Ogre::Camera *camera);
+
+private:
+    class CameraListener;
+
+    /// One textured quad of a text, in the plane of the text.
+    struct Quad
+    {
+        float x0, y0, x1, y1; ///< Top-left and bottom-right corners in world units, relative to the text position, y up.
+        float u0, v0, u1, v1; ///< Texture coordinates of the corners.
+        Color top; ///< Color of the top edge.
+        Color bottom; ///< Color of the bottom edge.
+        int page; ///< Atlas page.
+    };
+
+    /// A text and its laid out quads.
+    struct LabelData
+    {
+        LabelData() : visible(true), radius(0.f) {}
+
+        HoveringTextLabel desc;
+        std::vector<Quad> quads;
+        bool visible;
+        float radius; ///< Radius of the bounding sphere of the quads.
+    };
+
+    /// A text shown to the camera being updated.
+    struct VisibleLabel;
+
+    explicit HoveringTextBatch(const OgreWorldPtr &world);
+
+    /// Lays out the quads of a text.
+    void Layout(LabelData &label);
+
+    /// Adds a quad given in the pixels of the texture space of a text.
+    void AddQuad(LabelData &label, float px0, float py0, float px1, float py1, float u0, float v0, float u1, float v1, int page, const Color &top, const Color &bottom);
+
+    OgreWorldWeakPtr world;
+    OgreWorld *worldKey; ///< Key of the batch in the registry of the batches.
+    GlyphAtlas atlas;
+    Ogre::ManualObject *object;
+    Ogre::SceneNode *node;
+    CameraListener *listener;
+    std::map<EC_HoveringText *, LabelData> labels;
+    std::vector<int> sectionPages; ///< Atlas page drawn by each section of the object.
+    float fadeDistance;
+    float cullDistance;
+};
@@ -18,7 +18,8 @@ EC_ProximityTrigger::EC_ProximityTrigger(Scene *scene) :
     IComponent(scene),
     active(this, "Is active", true),
     thresholdDistance(this, "Threshold distance", 0.0f),
-    interval(this, "Trigger signal interval", 0.0f)
+    interval(this, "Trigger signal interval", 0.0f),
+    periodicTimer(0)
 {
     SetUpdateMode();
     connect(this, SIGNAL(AttributeChanged(IAttribute*, AttributeChange::Type)), SLOT(OnAttributeUpdated(IAttribute*)));
@@ -26,6 +27,8 @@ EC_ProximityTrigger::EC_ProximityTrigger(Scene *scene) :
 
 EC_ProximityTrigger::~EC_ProximityTrigger()
 {
+    if (periodicTimer)
+        framework->Frame()->CancelDelayedExecute(periodicTimer);
 }
 
 void EC_ProximityTrigger::OnAttributeUpdated(IAttribute* attr)
@@ -73,6 +76,11 @@ void EC_ProximityTrigger::Update(float timeStep)
 void EC_ProximityTrigger::SetUpdateMode()
 {
     FrameAPI* frame = framework->Frame();
+    if (periodicTimer)
+    {
+        frame->CancelDelayedExecute(periodicTimer);
+        periodicTimer = 0;
+    }
     
     float intervalSec = interval.Get();
     if (intervalSec <= 0.0f)
@@ -84,17 +92,12 @@ void EC_ProximityTrigger::SetUpdateMode()
     {
         // Update periodically
         disconnect(frame, SIGNAL(Updated(float)), this, SLOT(Update(float)));
-        frame->DelayedExecute(intervalSec, this, SLOT(PeriodicUpdate()));
+        periodicTimer = frame->RepeatedExecute(intervalSec, this, SLOT(PeriodicUpdate()));
     }
 }
 
 void EC_ProximityTrigger::PeriodicUpdate()
 {
-    // Set up the next periodic update
-    float intervalSec = interval.Get();
-    if (intervalSec > 0.0f)
-        framework->Frame()->DelayedExecute(intervalSec, this, SLOT(PeriodicUpdate()));
-    
-    Update(intervalSec);
+    Update(interval.Get());
 }
 
@@ -80,9 +80,12 @@ private slots:
     /// Check for other triggers and emit signals
     void Update(float timeStep);
 
-    /// Periodic update. Set up the next periodic update, then check triggers
+    /// Periodic update. Called by the repeated FrameAPI timer, check triggers
     void PeriodicUpdate();
 
     /// Change update mode (periodic, or every frame)
     void SetUpdateMode();
+
+private:
+    uint periodicTimer; ///< Handle of the FrameAPI timer of the periodic update, 0 if none.
 };
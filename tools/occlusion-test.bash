@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Tests the occlusion culling depth buffer with synthetic geometry in headless mode.
+# usage: occlusion-test.bash
+
+bindir=$(dirname $(readlink -f $0))/../bin
+cd $bindir
+
+echo 'console.ExecuteCommand("occlusionTest"); framework.Exit();' > occlusiontest.js
+ulimit -t 60 # cpu time limit
+ulimit -c unlimited
+./viewer --headless --run occlusiontest.js 2>&1 | tee occlusiontest.out
+
+if grep -q "Occlusion buffer test passed" occlusiontest.out; then
+    echo 'test outcome: success'
+    exit 0
+fi
+echo 'test outcome: failure'
+exit 1
@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Runs the headless-friendly render benchmark on a scene and optionally compares the result to a baseline.
+# usage: render-benchmark.bash scene.txml result.json [baseline.json] [extra tundra args...]
+# Uses the NULL render system, so no GPU is needed. Pass e.g. --opengl as an extra argument to benchmark real rendering.
+
+if test $# -lt 2; then
+    echo "usage: $0 scene.txml result.json [baseline.json] [extra tundra args...]"
+    exit 2
+fi
+
+bindir=$(dirname $(readlink -f $0))/../bin
+testsdir=$(dirname $(readlink -f $0))/tests
+scenefile=`readlink -f $1`
+resultfile=`readlink -f $2`
+shift 2
+baselinefile=
+case $1 in
+    *.json)
+	baselinefile=`readlink -f $1`
+	shift
+	;;
+esac
+
+cd $bindir
+rm -f $resultfile
+ulimit -c unlimited
+./viewer --nullrenderer --file $scenefile --renderBenchmark $resultfile "$@" 2>&1 | tee renderbenchmark.out
+
+if ! test -f $resultfile; then
+    echo 'test outcome: failure (no benchmark result written)'
+    exit 1
+fi
+
+if test -n "$baselinefile"; then
+    python $testsdir/render-benchmark-compare.py $baselinefile $resultfile
+    exit $?
+fi
+echo 'test outcome: success'
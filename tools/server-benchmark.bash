@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Runs the server scaling benchmark with simulated clients on a scene.
+# usage: server-benchmark.bash scene.txml result.json [extra tundra args...]
+# Extra arguments are passed to the server, e.g. --protocol tcp, --serverBenchmarkClients 10,100,500
+# or --serverBenchmarkWorkload workload.txt. See ServerBenchmark.h for the workload file format.
+
+if test $# -lt 2; then
+    echo "usage: $0 scene.txml result.json [extra tundra args...]"
+    exit 2
+fi
+
+bindir=$(dirname $(readlink -f $0))/../bin
+scenefile=`readlink -f $1`
+resultfile=`readlink -f $2`
+shift 2
+
+cd $bindir
+rm -f $resultfile
+ulimit -c unlimited
+./server --headless --file $scenefile --serverBenchmark $resultfile "$@" 2>&1 | tee serverbenchmark.out
+
+if ! test -f $resultfile; then
+    echo 'test outcome: failure (no benchmark result written)'
+    exit 1
+fi
+echo 'test outcome: success'
@@ -0,0 +1,59 @@
+#!/usr/local/bin/python
+
+# Compares two JSON result files written by --renderBenchmark and reports the phases that got slower.
+# Exits with 1 if the mean frame time or any phase regressed more than the given threshold.
+
+import sys
+import json
+from optparse import OptionParser
+
+phases = ["culling", "animation", "batchSubmission", "uiCompositing", "other"]
+
+def main():
+    parser = OptionParser(usage="usage: %prog [options] baseline.json result.json")
+    parser.add_option("-t", "--threshold", type="float", dest="threshold", default=10.0,
+        help="allowed slowdown in percent before failing (default 10)")
+    parser.add_option("-m", "--min-ms", type="float", dest="minMs", default=0.1,
+        help="ignore phases whose baseline mean is below this many milliseconds (default 0.1)")
+    (options, args) = parser.parse_args()
+    if len(args) != 2:
+        parser.error("expected two result files")
+
+    baseline = load(args[0])
+    result = load(args[1])
+    if baseline.get("renderSystem") != result.get("renderSystem"):
+        print("warning: comparing results from different render systems: %s vs. %s" % (baseline.get("renderSystem"), result.get("renderSystem")))
+
+    print("%-16s %12s %12s %9s" % ("", "baseline ms", "result ms", "change"))
+    regressions = []
+    rows = [("frame", baseline["frameTimeMs"], result["frameTimeMs"])]
+    if "phasesMs" in baseline and "phasesMs" in result:
+        for phase in phases:
+            rows.append((phase, baseline["phasesMs"][phase], result["phasesMs"][phase]))
+    for (name, old, new) in rows:
+        change = percentChange(old["mean"], new["mean"])
+        print("%-16s %12.3f %12.3f %8.1f%%" % (name, old["mean"], new["mean"], change))
+        if old["mean"] >= options.minMs and change > options.threshold:
+            regressions.append(name)
+    print("%-16s %12.1f %12.1f %8.1f%%" % ("batches", baseline["batches"]["mean"], result["batches"]["mean"],
+        percentChange(baseline["batches"]["mean"], result["batches"]["mean"])))
+
+    if regressions:
+        print("test outcome: failure (slower by more than %.1f%%: %s)" % (options.threshold, ", ".join(regressions)))
+        sys.exit(1)
+    print("test outcome: success")
+
+def load(filename):
+    f = open(filename)
+    try:
+        return json.load(f)
+    finally:
+        f.close()
+
+def percentChange(old, new):
+    if old <= 0.0:
+        return 0.0
+    return (new - old) * 100.0 / old
+
+if __name__ == "__main__":
+    main()